@@ -40,6 +40,10 @@
 #include <string/stdstring.h>
 #include <memalign.h>
 
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
 #include <math.h>
 #ifdef _WIN32
 #include <direct.h>
@@ -64,11 +68,13 @@
 
 typedef enum
 {
-   DIRECTION_NONE,
-   DIRECTION_IN,
-   DIRECTION_OUT
+   DIRECTION_NONE = CDROM_CMD_DIRECTION_NONE,
+   DIRECTION_IN   = CDROM_CMD_DIRECTION_IN,
+   DIRECTION_OUT  = CDROM_CMD_DIRECTION_OUT
 } CDROM_CMD_Direction;
 
+static cdrom_send_command_t cdrom_send_command_cb = NULL;
+
 void cdrom_lba_to_msf(unsigned lba, unsigned char *min, unsigned char *sec, unsigned char *frame)
 {
    if (!min || !sec || !frame)
@@ -368,6 +374,43 @@ static int cdrom_send_command_linux(const libretro_vfs_implementation_file *stre
 }
 #endif
 
+static int cdrom_send_command_os(const libretro_vfs_implementation_file *stream, CDROM_CMD_Direction dir, void *buf, size_t len, unsigned char *cmd, size_t cmd_len, unsigned char *sense, size_t sense_len)
+{
+   if (cdrom_send_command_cb)
+      return cdrom_send_command_cb(stream, (enum cdrom_cmd_direction)dir, buf, len, cmd, cmd_len, sense, sense_len);
+
+#if defined(__linux__) && !defined(ANDROID)
+   return cdrom_send_command_linux(stream, dir, buf, len, cmd, cmd_len, sense, sense_len);
+#elif defined(_WIN32) && !defined(_XBOX)
+   return cdrom_send_command_win32(stream, dir, buf, len, cmd, cmd_len, sense, sense_len);
+#else
+   return 0;
+#endif
+}
+
+void cdrom_set_send_command(cdrom_send_command_t cb)
+{
+   cdrom_send_command_cb = cb;
+}
+
+/* Sense keys worth retrying: no sense, not ready, medium error, hardware error and unit attention. */
+static bool cdrom_sense_is_retryable(const unsigned char *sense)
+{
+   switch (sense[2] & 0xF)
+   {
+      case 0:
+      case 2:
+      case 3:
+      case 4:
+      case 6:
+         return true;
+      default:
+         break;
+   }
+
+   return false;
+}
+
 static int cdrom_send_command(libretro_vfs_implementation_file *stream, CDROM_CMD_Direction dir, void *buf, size_t len, unsigned char *cmd, size_t cmd_len, size_t skip)
 {
    unsigned char *xfer_buf = NULL;
@@ -478,13 +521,7 @@ static int cdrom_send_command(libretro_vfs_implementation_file *stream, CDROM_CM
 #endif
 
 retry:
-#if defined(__linux__) && !defined(ANDROID)
-      if (cached_read || !cdrom_send_command_linux(stream, dir, xfer_buf_pos, request_len, cmd, cmd_len, sense, sizeof(sense)))
-#else
-#if defined(_WIN32) && !defined(_XBOX)
-      if (cached_read || !cdrom_send_command_win32(stream, dir, xfer_buf_pos, request_len, cmd, cmd_len, sense, sizeof(sense)))
-#endif
-#endif
+      if (cached_read || !cdrom_send_command_os(stream, dir, xfer_buf_pos, request_len, cmd, cmd_len, sense, sizeof(sense)))
       {
          rv = 0;
 
@@ -525,37 +562,26 @@ retry:
          /* READ ATIP seems to fail outright on some drives with pressed discs, skip retries. */
          if (cmd[0] != 0x0 && cmd[0] != 0x12 && cmd[0] != 0x5A && !(cmd[0] == 0x43 && cmd[2] == 0x4))
          {
-            unsigned char key = sense[2] & 0xF;
-
-            switch (key)
+            if (cdrom_sense_is_retryable(sense))
             {
-               case 0:
-               case 2:
-               case 3:
-               case 4:
-               case 6:
-                  if (retries_left)
-                  {
-   #ifdef CDROM_DEBUG
-                     printf("[CDROM] Read Retry...\n");
-                     fflush(stdout);
-   #endif
-                     retries_left--;
-                      retro_sleep(1000);
-                     goto retry;
-                  }
-                  else
-                  {
-                     rv = 1;
-   #ifdef CDROM_DEBUG
-                     printf("[CDROM] Read retries failed, giving up.\n");
-                     fflush(stdout);
-   #endif
-                  }
-
-                  break;
-               default:
-                  break;
+               if (retries_left)
+               {
+#ifdef CDROM_DEBUG
+                  printf("[CDROM] Read Retry...\n");
+                  fflush(stdout);
+#endif
+                  retries_left--;
+                  retro_sleep(1000);
+                  goto retry;
+               }
+               else
+               {
+                  rv = 1;
+#ifdef CDROM_DEBUG
+                  printf("[CDROM] Read retries failed, giving up.\n");
+                  fflush(stdout);
+#endif
+               }
             }
          }
 
@@ -1238,6 +1264,337 @@ int cdrom_read(libretro_vfs_implementation_file *stream, cdrom_group_timeouts_t
    return 0;
 }
 
+/* Reads "count" raw sectors with a single READ CD command, retrying like cdrom_send_command.
+ * Unlike cdrom_read, this touches no stream state, so it can run on another thread. */
+static int cdrom_read_sectors(const libretro_vfs_implementation_file *stream, unsigned lba, unsigned count, unsigned char *buf)
+{
+   /* MMC Command: READ CD MSF */
+   unsigned char cdb[] = {0xB9, 0, 0, 0, 0, 0, 0, 0, 0, 0xF8, 0, 0};
+   unsigned char sense[CDROM_MAX_SENSE_BYTES];
+   unsigned char retries_left = CDROM_MAX_RETRIES;
+
+   cdrom_lba_to_msf(lba, &cdb[3], &cdb[4], &cdb[5]);
+   cdrom_lba_to_msf(lba + count, &cdb[6], &cdb[7], &cdb[8]);
+
+   for (;;)
+   {
+      memset(sense, 0, sizeof(sense));
+
+      if (!cdrom_send_command_os(stream, DIRECTION_IN, buf, (size_t)count * 2352, cdb, sizeof(cdb), sense, sizeof(sense)))
+         return 0;
+
+      cdrom_print_sense_data(sense, sizeof(sense));
+
+      if (!retries_left || !cdrom_sense_is_retryable(sense))
+         return 1;
+
+#ifdef CDROM_DEBUG
+      printf("[CDROM] Read-ahead retry...\n");
+      fflush(stdout);
+#endif
+      retries_left--;
+      retro_sleep(1000);
+   }
+}
+
+#ifdef HAVE_THREADS
+enum cdrom_chunk_state
+{
+   CDROM_CHUNK_EMPTY = 0,
+   CDROM_CHUNK_READING,
+   CDROM_CHUNK_READY,
+   CDROM_CHUNK_FAILED
+};
+
+typedef struct
+{
+   unsigned char *data;
+   unsigned lba;
+   unsigned count;
+   enum cdrom_chunk_state state;
+} cdrom_readahead_chunk_t;
+
+struct cdrom_readahead
+{
+   libretro_vfs_implementation_file *stream;
+   cdrom_readahead_chunk_t *chunks;
+   sthread_t *thread;
+   slock_t *lock;
+   scond_t *work;
+   scond_t *done;
+   unsigned num_chunks;
+   unsigned chunk_sectors;
+   unsigned lba_start;
+   unsigned lba_end;
+   unsigned want_lba; /* first sector the reader still needs */
+   bool quit;
+};
+
+/* Must be called with the lock held. Prefers a chunk holding the sector over one still reading it or one that failed. */
+static cdrom_readahead_chunk_t* cdrom_readahead_find(cdrom_readahead_t *ra, unsigned lba)
+{
+   cdrom_readahead_chunk_t *found = NULL;
+   unsigned i;
+
+   for (i = 0; i < ra->num_chunks; i++)
+   {
+      cdrom_readahead_chunk_t *chunk = &ra->chunks[i];
+
+      if (chunk->state == CDROM_CHUNK_EMPTY || lba < chunk->lba || lba >= chunk->lba + chunk->count)
+         continue;
+
+      if (chunk->state == CDROM_CHUNK_READY)
+         return chunk;
+
+      if (!found || chunk->state == CDROM_CHUNK_READING)
+         found = chunk;
+   }
+
+   return found;
+}
+
+/* Must be called with the lock held. Finds the first sector of the read-ahead window that no chunk covers
+ * and a chunk to read it into: one that lies outside the window, or else the one furthest ahead of it. */
+static cdrom_readahead_chunk_t* cdrom_readahead_next(cdrom_readahead_t *ra, unsigned *lba)
+{
+   cdrom_readahead_chunk_t *victim = NULL;
+   unsigned window_end = ra->want_lba + ra->num_chunks * ra->chunk_sectors;
+   unsigned pos = ra->want_lba;
+   unsigned i;
+
+   if (window_end > ra->lba_end)
+      window_end = ra->lba_end;
+
+   while (pos < window_end)
+   {
+      cdrom_readahead_chunk_t *chunk = cdrom_readahead_find(ra, pos);
+
+      if (!chunk)
+         break;
+
+      pos = chunk->lba + chunk->count;
+   }
+
+   if (pos >= window_end)
+      return NULL;
+
+   for (i = 0; i < ra->num_chunks; i++)
+   {
+      cdrom_readahead_chunk_t *chunk = &ra->chunks[i];
+
+      if (chunk->state == CDROM_CHUNK_READING)
+         continue;
+
+      if (chunk->state == CDROM_CHUNK_EMPTY || chunk->lba + chunk->count <= ra->want_lba || chunk->lba >= window_end)
+      {
+         victim = chunk;
+         break;
+      }
+
+      if (chunk->lba > pos && (!victim || chunk->lba > victim->lba))
+         victim = chunk;
+   }
+
+   *lba = pos;
+   return victim;
+}
+
+static void cdrom_readahead_thread(void *data)
+{
+   cdrom_readahead_t *ra = (cdrom_readahead_t*)data;
+
+   slock_lock(ra->lock);
+
+   while (!ra->quit)
+   {
+      unsigned lba = 0;
+      cdrom_readahead_chunk_t *chunk = cdrom_readahead_next(ra, &lba);
+      int rv;
+
+      if (!chunk)
+      {
+         scond_wait(ra->work, ra->lock);
+         continue;
+      }
+
+      chunk->lba   = lba;
+      chunk->count = MIN(ra->chunk_sectors, ra->lba_end - lba);
+      chunk->state = CDROM_CHUNK_READING;
+      slock_unlock(ra->lock);
+
+#ifdef CDROM_DEBUG
+      printf("[CDROM] Read-ahead: %u sectors from LBA %u\n", chunk->count, chunk->lba);
+      fflush(stdout);
+#endif
+      rv = cdrom_read_sectors(ra->stream, chunk->lba, chunk->count, chunk->data);
+
+      slock_lock(ra->lock);
+      chunk->state = rv ? CDROM_CHUNK_FAILED : CDROM_CHUNK_READY;
+      scond_broadcast(ra->done);
+   }
+
+   slock_unlock(ra->lock);
+}
+
+cdrom_readahead_t* cdrom_readahead_new(libretro_vfs_implementation_file *stream, unsigned lba_start, unsigned lba_end, unsigned chunks, unsigned chunk_sectors)
+{
+   cdrom_readahead_t *ra = NULL;
+   unsigned i;
+
+   if (!stream || lba_end <= lba_start || chunks < 2 || !chunk_sectors)
+      return NULL;
+
+   ra = (cdrom_readahead_t*)calloc(1, sizeof(*ra));
+
+   if (!ra)
+      return NULL;
+
+   ra->stream        = stream;
+   ra->num_chunks    = chunks;
+   ra->chunk_sectors = chunk_sectors;
+   ra->lba_start     = lba_start;
+   ra->lba_end       = lba_end;
+   ra->want_lba      = lba_start;
+   ra->chunks        = (cdrom_readahead_chunk_t*)calloc(chunks, sizeof(*ra->chunks));
+   ra->lock          = slock_new();
+   ra->work          = scond_new();
+   ra->done          = scond_new();
+
+   if (!ra->chunks || !ra->lock || !ra->work || !ra->done)
+      goto error;
+
+   for (i = 0; i < chunks; i++)
+   {
+      ra->chunks[i].data = (unsigned char*)memalign_alloc(4096, (size_t)chunk_sectors * 2352);
+
+      if (!ra->chunks[i].data)
+         goto error;
+   }
+
+   ra->thread = sthread_create(cdrom_readahead_thread, ra);
+
+   if (!ra->thread)
+      goto error;
+
+   return ra;
+
+error:
+   cdrom_readahead_free(ra);
+   return NULL;
+}
+
+int cdrom_readahead_read(cdrom_readahead_t *ra, unsigned lba, void *s, size_t len, size_t skip)
+{
+   unsigned char *out = (unsigned char*)s;
+   size_t end_offset = len + skip;
+   unsigned sectors;
+   unsigned i;
+   int rv = 0;
+
+   if (!ra || !len)
+      return 1;
+
+   sectors = (unsigned)((end_offset + 2351) / 2352);
+
+   if (lba < ra->lba_start || lba + sectors > ra->lba_end)
+      return 1;
+
+   slock_lock(ra->lock);
+
+   for (i = 0; i < sectors; i++)
+   {
+      unsigned cur = lba + i;
+      size_t copy_len = MIN(2352 - skip, len);
+      cdrom_readahead_chunk_t *chunk;
+
+      ra->want_lba = cur;
+
+      /* the worker may be idle on a window it saw as full, so wake it before waiting */
+      while (!(chunk = cdrom_readahead_find(ra, cur)) || chunk->state == CDROM_CHUNK_READING)
+      {
+         scond_signal(ra->work);
+         scond_wait(ra->done, ra->lock);
+      }
+
+      if (chunk->state == CDROM_CHUNK_FAILED)
+      {
+         /* read it again the next time it is asked for */
+         chunk->state = CDROM_CHUNK_EMPTY;
+         rv = 1;
+         break;
+      }
+
+      memcpy(out, chunk->data + (size_t)(cur - chunk->lba) * 2352 + skip, copy_len);
+      out  += copy_len;
+      len  -= copy_len;
+      skip  = 0;
+   }
+
+   /* move the window on to where the next read starts, which is
+    * still the last sector if this read ended inside it */
+   if (!rv)
+   {
+      ra->want_lba = lba + (unsigned)(end_offset / 2352);
+      scond_signal(ra->work);
+   }
+
+   slock_unlock(ra->lock);
+
+   return rv;
+}
+
+void cdrom_readahead_free(cdrom_readahead_t *ra)
+{
+   unsigned i;
+
+   if (!ra)
+      return;
+
+   if (ra->thread)
+   {
+      slock_lock(ra->lock);
+      ra->quit = true;
+      scond_signal(ra->work);
+      slock_unlock(ra->lock);
+      sthread_join(ra->thread);
+   }
+
+   if (ra->chunks)
+   {
+      for (i = 0; i < ra->num_chunks; i++)
+      {
+         if (ra->chunks[i].data)
+            memalign_free(ra->chunks[i].data);
+      }
+
+      free(ra->chunks);
+   }
+
+   if (ra->done)
+      scond_free(ra->done);
+   if (ra->work)
+      scond_free(ra->work);
+   if (ra->lock)
+      slock_free(ra->lock);
+
+   free(ra);
+}
+#else
+cdrom_readahead_t* cdrom_readahead_new(libretro_vfs_implementation_file *stream, unsigned lba_start, unsigned lba_end, unsigned chunks, unsigned chunk_sectors)
+{
+   return NULL;
+}
+
+int cdrom_readahead_read(cdrom_readahead_t *ra, unsigned lba, void *s, size_t len, size_t skip)
+{
+   return 1;
+}
+
+void cdrom_readahead_free(cdrom_readahead_t *ra)
+{
+}
+#endif
+
 int cdrom_stop(libretro_vfs_implementation_file *stream)
 {
    /* MMC Command: START STOP UNIT */
@@ -34,11 +34,11 @@
 #include <formats/image.h>
 #include <formats/rbmp.h>
 
+#include "../image_output.h"
+
 /* truncate int to byte without warnings */
 #define RBMP_BYTECAST(x)  ((unsigned char) ((x) & 255))
 
-#define RBMP_COMPUTE_Y(r, g, b) ((unsigned char) ((((r) * 77) + ((g) * 150) +  (29 * (b))) >> 8))
-
 typedef struct
 {
    uint32_t img_x;
@@ -57,7 +57,7 @@ typedef struct
 struct rbmp
 {
    uint8_t *buff_data;
-   uint32_t *output_image;
+   struct image_output output;
 };
 
 static INLINE unsigned char rbmp_get8(rbmp_context *s)
@@ -86,107 +86,6 @@ static int rbmp_get16le(rbmp_context *s)
 
 #define RBMP_GET32LE(s) (rbmp_get16le(s) + (rbmp_get16le(s) << 16))
 
-static unsigned char *rbmp_convert_format(
-      unsigned char *data,
-      int img_n,
-      int req_comp,
-      unsigned int x,
-      unsigned int y)
-{
-   int i,j;
-   unsigned char *good = (unsigned char *)malloc(req_comp * x * y);
-
-   if (!good)
-      return NULL;
-
-   for (j=0; j < (int) y; ++j)
-   {
-      unsigned char *src  = data + j * x * img_n   ;
-      unsigned char *dest = good + j * x * req_comp;
-
-      switch (((img_n)*8+(req_comp)))
-      {
-         case 10:
-            for(i = x-1; i >= 0; --i, src += 1, dest += 2)
-            {
-               dest[0]=src[0];
-               dest[1]=255;
-            }
-            break;
-         case 11:
-            for(i = x-1; i >= 0; --i, src += 1, dest += 3)
-               dest[0]=dest[1]=dest[2]=src[0];
-            break;
-         case 12:
-            for(i = x-1; i >= 0; --i, src += 1, dest += 4)
-            {
-               dest[0]=dest[1]=dest[2]=src[0];
-               dest[3]=255;
-            }
-            break;
-         case 17:
-            for(i = x-1; i >= 0; --i, src += 2, dest += 1)
-               dest[0]=src[0];
-            break;
-         case 19:
-            for(i = x-1; i >= 0; --i, src += 2, dest += 3)
-               dest[0]=dest[1]=dest[2]=src[0];
-            break;
-         case 20:
-            for(i = x-1; i >= 0; --i, src += 2, dest += 4)
-            {
-               dest[0]=dest[1]=dest[2]=src[0];
-               dest[3]=src[1];
-            }
-            break;
-         case 28:
-            for(i = x-1; i >= 0; --i, src += 3, dest += 4)
-            {
-               dest[0]=src[0];
-               dest[1]=src[1];
-               dest[2]=src[2];
-               dest[3]=255;
-            }
-            break;
-         case 25:
-            for(i = x-1; i >= 0; --i, src += 3, dest += 1)
-               dest[0] = RBMP_COMPUTE_Y(src[0],src[1],src[2]);
-            break;
-         case 26:
-            for(i = x-1; i >= 0; --i, src += 3, dest += 2)
-            {
-               dest[0] = RBMP_COMPUTE_Y(src[0],src[1],src[2]);
-               dest[1] = 255;
-            }
-            break;
-         case 33:
-            for(i = x-1; i >= 0; --i, src += 4, dest += 1)
-               dest[0] = RBMP_COMPUTE_Y(src[0],src[1],src[2]);
-            break;
-         case 34:
-            for(i = x-1; i >= 0; --i, src += 4, dest += 2)
-            {
-               dest[0] = RBMP_COMPUTE_Y(src[0],src[1],src[2]);
-               dest[1] = src[3];
-            }
-            break;
-         case 35:
-            for(i = x-1; i >= 0; --i, src += 4, dest += 3)
-            {
-               dest[0]=src[0];
-               dest[1]=src[1];
-               dest[2]=src[2];
-            }
-            break;
-         default:
-            break;
-      }
-
-   }
-
-   return good;
-}
-
 /* Microsoft/Windows BMP image */
 
 /* returns 0..31 for the highest set bit */
@@ -251,13 +150,16 @@ static int rbmp_shiftsigned(int v, int shift, int bits)
    return result;
 }
 
-static unsigned char *rbmp_bmp_load(rbmp_context *s, unsigned *x, unsigned *y,
-      int *comp, int req_comp)
+/* Decodes to output, one row at a time */
+static bool rbmp_bmp_load(rbmp_context *s, struct image_output *output,
+      unsigned *x, unsigned *y)
 {
-   unsigned char *out;
-   int bpp, flip_vertically, pad, target, offset, hsz;
+   int bpp, flip_vertically, pad, offset, hsz;
    int psize=0,i,j,width;
    unsigned int mr=0,mg=0,mb=0,ma=0;
+   unsigned char *row = NULL;
+   bool allocated     = false;
+   bool in_place;
 
    /* Corrupt BMP? */
    if (rbmp_get8(s) != 'B' || rbmp_get8(s) != 'M')
@@ -420,27 +322,26 @@ static unsigned char *rbmp_bmp_load(rbmp_context *s, unsigned *x, unsigned *y,
          psize = (offset - 14 - hsz) >> 2;
    }
    s->img_n = ma ? 4 : 3;
-   if (req_comp && req_comp >= 3) /* We can directly decode 3 or 4 */
-      target = req_comp;
-   else
-      target = s->img_n; /* If they want monochrome, we'll post-convert */
 
-   out = (unsigned char *) malloc(target * s->img_x * s->img_y);
+   /* Image too large to decode? */
+   if (!s->img_x || !s->img_y || s->img_x > (1 << 24) || s->img_y > (1 << 24))
+      return false;
 
-   if (!out)
-      return 0;
+   if (!image_output_begin(output, s->img_x, s->img_y, &allocated))
+      return false;
+
+   /* Rows are built as R, G, B, A, in the output if it takes that */
+   in_place = image_output_is_rgba(output);
+   if (!in_place && !(row = (unsigned char*)malloc(4 * s->img_x)))
+      goto error;
 
    if (bpp < 16)
    {
       unsigned char pal[256][4];
-      int z=0;
 
       /* Corrupt BMP? */
       if (psize == 0 || psize > 256)
-      {
-         free(out);
-         return 0;
-      }
+         goto error;
 
       for (i = 0; i < psize; ++i)
       {
@@ -457,16 +358,16 @@ static unsigned char *rbmp_bmp_load(rbmp_context *s, unsigned *x, unsigned *y,
          width = (s->img_x + 1) >> 1;
       else if (bpp == 8)
          width = s->img_x;
-      else
-      {
-         /* Corrupt BMP */
-         free(out);
-         return 0;
-      }
+      else /* Corrupt BMP */
+         goto error;
 
       pad = (-width)&3;
       for (j=0; j < (int) s->img_y; ++j)
       {
+         unsigned out_y   = flip_vertically ? s->img_y - 1 - j : j;
+         unsigned char *out = in_place ? image_output_row(output, out_y) : row;
+         int z            = 0;
+
          for (i = 0; i < (int) s->img_x; i += 2)
          {
             int v  = rbmp_get8(s);
@@ -479,8 +380,7 @@ static unsigned char *rbmp_bmp_load(rbmp_context *s, unsigned *x, unsigned *y,
             out[z++] = pal[v][0];
             out[z++] = pal[v][1];
             out[z++] = pal[v][2];
-            if (target == 4)
-               out[z++] = 255;
+            out[z++] = 255;
 
             if (i+1 == (int)s->img_x)
                break;
@@ -489,11 +389,12 @@ static unsigned char *rbmp_bmp_load(rbmp_context *s, unsigned *x, unsigned *y,
             out[z++] = pal[v][0];
             out[z++] = pal[v][1];
             out[z++] = pal[v][2];
-
-            if (target == 4)
-               out[z++] = 255;
+            out[z++] = 255;
          }
          rbmp_skip(s, pad);
+
+         if (!in_place)
+            image_output_write_rgba(output, out_y, row, s->img_x);
       }
    }
    else
@@ -506,7 +407,6 @@ static unsigned char *rbmp_bmp_load(rbmp_context *s, unsigned *x, unsigned *y,
       int gcount = 0;
       int bcount = 0;
       int acount = 0;
-      int z      = 0;
       int easy   = 0;
 
       rbmp_skip(s, offset - 14 - hsz);
@@ -537,10 +437,7 @@ static unsigned char *rbmp_bmp_load(rbmp_context *s, unsigned *x, unsigned *y,
       {
          /* Corrupt BMP? */
          if (!mr || !mg || !mb)
-         {
-            free(out);
-            return 0;
-         }
+            goto error;
 
          /* right shift amt to put high bit in position #7 */
          rshift = rbmp_high_bit(mr)-7;
@@ -555,209 +452,115 @@ static unsigned char *rbmp_bmp_load(rbmp_context *s, unsigned *x, unsigned *y,
 
       for (j=0; j < (int) s->img_y; ++j)
       {
+         unsigned out_y   = flip_vertically ? s->img_y - 1 - j : j;
+         unsigned char *out = in_place ? image_output_row(output, out_y) : row;
+         int z            = 0;
+
          if (easy)
          {
-            if (target == 4)
+            for (i = 0; i < (int) s->img_x; ++i)
             {
+               out[z+2]        = rbmp_get8(s);
+               out[z+1]        = rbmp_get8(s);
+               out[z+0]        = rbmp_get8(s);
+               z              += 3;
                /* Need to apply alpha channel as well */
-               if (easy == 2)
-               {
-                  for (i = 0; i < (int) s->img_x; ++i)
-                  {
-                     out[z+2]        = rbmp_get8(s);
-                     out[z+1]        = rbmp_get8(s);
-                     out[z+0]        = rbmp_get8(s);
-                     z              += 3;
-                     out[z++]        = rbmp_get8(s);
-                  }
-               }
-               else
-               {
-                  for (i = 0; i < (int) s->img_x; ++i)
-                  {
-                     out[z+2]        = rbmp_get8(s);
-                     out[z+1]        = rbmp_get8(s);
-                     out[z+0]        = rbmp_get8(s);
-                     z              += 3;
-                     out[z++]        = 255;
-                  }
-               }
-            }
-            else
-            {
-               for (i = 0; i < (int) s->img_x; ++i)
-               {
-                  out[z+2]        = rbmp_get8(s);
-                  out[z+1]        = rbmp_get8(s);
-                  out[z+0]        = rbmp_get8(s);
-                  z              += 3;
-               }
+               out[z++]        = easy == 2 ? rbmp_get8(s) : 255;
             }
          }
          else
          {
-            if (target == 4)
-            {
-               /* Need to apply alpha channel as well */
-               if (ma)
-               {
-                  if (bpp == 16)
-                  {
-                     for (i = 0; i < (int) s->img_x; ++i)
-                     {
-                        uint32_t v  = (uint32_t)rbmp_get16le(s);
-                        out[z++]    = RBMP_BYTECAST(rbmp_shiftsigned(v & mr, rshift, rcount));
-                        out[z++]    = RBMP_BYTECAST(rbmp_shiftsigned(v & mg, gshift, gcount));
-                        out[z++]    = RBMP_BYTECAST(rbmp_shiftsigned(v & mb, bshift, bcount));
-                        out[z++]    = RBMP_BYTECAST(rbmp_shiftsigned(v & ma, ashift, acount));
-                     }
-                  }
-                  else
-                  {
-                     for (i = 0; i < (int) s->img_x; ++i)
-                     {
-                        uint32_t v  = (uint32_t)RBMP_GET32LE(s);
-                        out[z++]    = RBMP_BYTECAST(rbmp_shiftsigned(v & mr, rshift, rcount));
-                        out[z++]    = RBMP_BYTECAST(rbmp_shiftsigned(v & mg, gshift, gcount));
-                        out[z++]    = RBMP_BYTECAST(rbmp_shiftsigned(v & mb, bshift, bcount));
-                        out[z++]    = RBMP_BYTECAST(rbmp_shiftsigned(v & ma, ashift, acount));
-                     }
-                  }
-               }
-               else
-               {
-                  if (bpp == 16)
-                  {
-                     for (i = 0; i < (int) s->img_x; ++i)
-                     {
-                        uint32_t v  = (uint32_t)rbmp_get16le(s);
-                        out[z++]    = RBMP_BYTECAST(rbmp_shiftsigned(v & mr, rshift, rcount));
-                        out[z++]    = RBMP_BYTECAST(rbmp_shiftsigned(v & mg, gshift, gcount));
-                        out[z++]    = RBMP_BYTECAST(rbmp_shiftsigned(v & mb, bshift, bcount));
-                        out[z++]    = RBMP_BYTECAST(255);
-                     }
-                  }
-                  else
-                  {
-                     for (i = 0; i < (int) s->img_x; ++i)
-                     {
-                        uint32_t v  = (uint32_t)RBMP_GET32LE(s);
-                        out[z++]    = RBMP_BYTECAST(rbmp_shiftsigned(v & mr, rshift, rcount));
-                        out[z++]    = RBMP_BYTECAST(rbmp_shiftsigned(v & mg, gshift, gcount));
-                        out[z++]    = RBMP_BYTECAST(rbmp_shiftsigned(v & mb, bshift, bcount));
-                        out[z++]    = RBMP_BYTECAST(255);
-                     }
-                  }
-               }
-            }
-            else
+            for (i = 0; i < (int) s->img_x; ++i)
             {
-               if (bpp == 16)
-               {
-                  for (i = 0; i < (int) s->img_x; ++i)
-                  {
-                     uint32_t v  = (uint32_t)rbmp_get16le(s);
-                     out[z++]    = RBMP_BYTECAST(rbmp_shiftsigned(v & mr, rshift, rcount));
-                     out[z++]    = RBMP_BYTECAST(rbmp_shiftsigned(v & mg, gshift, gcount));
-                     out[z++]    = RBMP_BYTECAST(rbmp_shiftsigned(v & mb, bshift, bcount));
-                  }
-               }
-               else
-               {
-                  for (i = 0; i < (int) s->img_x; ++i)
-                  {
-                     uint32_t v  = (uint32_t)RBMP_GET32LE(s);
-                     out[z++]    = RBMP_BYTECAST(rbmp_shiftsigned(v & mr, rshift, rcount));
-                     out[z++]    = RBMP_BYTECAST(rbmp_shiftsigned(v & mg, gshift, gcount));
-                     out[z++]    = RBMP_BYTECAST(rbmp_shiftsigned(v & mb, bshift, bcount));
-                  }
-               }
+               uint32_t v  = bpp == 16
+                  ? (uint32_t)rbmp_get16le(s) : (uint32_t)RBMP_GET32LE(s);
+               out[z++]    = RBMP_BYTECAST(rbmp_shiftsigned(v & mr, rshift, rcount));
+               out[z++]    = RBMP_BYTECAST(rbmp_shiftsigned(v & mg, gshift, gcount));
+               out[z++]    = RBMP_BYTECAST(rbmp_shiftsigned(v & mb, bshift, bcount));
+               out[z++]    = ma ? RBMP_BYTECAST(rbmp_shiftsigned(v & ma, ashift, acount)) : 255;
             }
          }
          rbmp_skip(s, pad);
-      }
-   }
 
-   if (flip_vertically)
-   {
-      unsigned char t;
-      for (j=0; j < (int) s->img_y>>1; ++j)
-      {
-         unsigned char *p1 = out +      j     *s->img_x*target;
-         unsigned char *p2 = out + (s->img_y-1-j)*s->img_x*target;
-         for (i = 0; i < (int) s->img_x*target; ++i)
-         {
-            t     = p1[i];
-            p1[i] = p2[i];
-            p2[i] = t;
-         }
+         if (!in_place)
+            image_output_write_rgba(output, out_y, row, s->img_x);
       }
    }
 
-   if (
-            req_comp
-         && (req_comp >= 1 && req_comp <= 4)
-         && (req_comp != target))
-   {
-      unsigned char *tmp = rbmp_convert_format(out, target, req_comp, s->img_x, s->img_y);
-
-      free(out);
-      out = NULL;
-
-      if (!tmp)
-         return NULL;
-
-      out = tmp;
-   }
+   free(row);
 
    *x = s->img_x;
    *y = s->img_y;
+   return true;
 
-   if (comp)
-      *comp = s->img_n;
-
-   return out;
+error:
+   free(row);
+   if (allocated)
+   {
+      free(output->data);
+      output->data = NULL;
+   }
+   return false;
 }
 
-static unsigned char *rbmp_load_from_memory(unsigned char const *buffer, int len,
-      unsigned *x, unsigned *y, int *comp, int req_comp)
+int rbmp_process_image(rbmp_t *rbmp, void **buf_data,
+      size_t size, unsigned *width, unsigned *height)
 {
    rbmp_context s;
+   struct image_output output;
+
+   if (!rbmp)
+      return IMAGE_PROCESS_ERROR;
+
+   s.img_buffer          = rbmp->buff_data;
+   s.img_buffer_original = rbmp->buff_data;
+   s.img_buffer_end      = rbmp->buff_data + size;
+   output                = rbmp->output;
+
+   if (!rbmp_bmp_load(&s, &output, width, height))
+      return IMAGE_PROCESS_ERROR;
 
-   s.img_buffer          = (unsigned char*)buffer;
-   s.img_buffer_original = (unsigned char*)buffer;
-   s.img_buffer_end      = (unsigned char*)buffer+len;
+   *buf_data             = output.data;
 
-   return rbmp_bmp_load(&s,x,y,comp,req_comp);
+   return IMAGE_PROCESS_END;
 }
 
-static void rbmp_convert_frame(uint32_t *frame, unsigned width, unsigned height)
+bool rbmp_get_size(rbmp_t *rbmp, size_t size,
+      unsigned *width, unsigned *height)
 {
-   uint32_t *end = frame + (width * height * sizeof(uint32_t))/4;
+   const uint8_t *p = rbmp ? rbmp->buff_data : NULL;
+   uint32_t hsz;
+
+   if (!p || size < 26 || p[0] != 'B' || p[1] != 'M')
+      return false;
 
-   while(frame < end)
+   hsz = p[14] | (p[15] << 8) | (p[16] << 16) | ((uint32_t)p[17] << 24);
+
+   if (hsz == 12)
+   {
+      *width  = p[18] | (p[19] << 8);
+      *height = p[20] | (p[21] << 8);
+   }
+   else
    {
-      uint32_t pixel = *frame;
-      *frame = (pixel & 0xff00ff00) | ((pixel << 16) & 0x00ff0000) | ((pixel >> 16) & 0xff);
-      frame++;
+      int32_t h = (int32_t)(p[22] | (p[23] << 8) | (p[24] << 16)
+            | ((uint32_t)p[25] << 24));
+      *width  = p[18] | (p[19] << 8) | (p[20] << 16) | ((uint32_t)p[21] << 24);
+      *height = h < 0 ? (unsigned)-h : (unsigned)h;
    }
+
+   return *width && *height;
 }
 
-int rbmp_process_image(rbmp_t *rbmp, void **buf_data,
-      size_t size, unsigned *width, unsigned *height)
+void rbmp_set_output(rbmp_t *rbmp, const struct image_output *output)
 {
-   int comp;
-
    if (!rbmp)
-      return IMAGE_PROCESS_ERROR;
-
-   rbmp->output_image   = (uint32_t*)rbmp_load_from_memory(rbmp->buff_data,
-                           (int)size, width, height, &comp, 4);
-   *buf_data             = rbmp->output_image;
-
-   rbmp_convert_frame(rbmp->output_image, *width, *height);
+      return;
 
-   return IMAGE_PROCESS_END;
+   if (output)
+      rbmp->output = *output;
+   else
+      memset(&rbmp->output, 0, sizeof(rbmp->output));
 }
 
 bool rbmp_set_buf_ptr(rbmp_t *rbmp, void *data)
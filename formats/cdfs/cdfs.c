@@ -0,0 +1,1139 @@
+/* Copyright  (C) 2010-2019 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (cdfs.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <formats/cdfs.h>
+#include <compat/posix_string.h>
+#include <compat/strl.h>
+#include <file/file_path.h>
+#include <retro_miscellaneous.h>
+#include <streams/file_stream.h>
+#include <string/stdstring.h>
+
+#ifdef HAVE_CHD
+#include <streams/chd_stream.h>
+#endif
+
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
+#define CDFS_SECTOR_DATA        2048
+/* the primary volume descriptor is always 16 sectors in */
+#define CDFS_PVD_SECTOR         16
+/* raw sectors read per intfstream_read when unpacking user data */
+#define CDFS_READ_BATCH         32
+#define CDFS_INDEX_CACHE_SIZE   4
+/* bounds for corrupt or hostile images */
+#define CDFS_MAX_DIRECTORIES    65536
+#define CDFS_MAX_DIRECTORY_SIZE (16 * 1024 * 1024)
+
+typedef struct cdfs_index_entry
+{
+   uint32_t hash;
+   uint32_t name;       /* offset into the name pool */
+   uint32_t sector;
+   uint32_t size;
+} cdfs_index_entry_t;
+
+/* every file and directory on a disc, keyed by its full path */
+typedef struct cdfs_index
+{
+   struct cdfs_index *next;
+   /* identifies the disc; the size and root directory tell apart
+    * patched images that kept the descriptor */
+   uint8_t pvd[CDFS_SECTOR_DATA];
+   int64_t image_size;
+   uint32_t root_hash;
+   unsigned sector_size;
+   unsigned sector_header_size;
+
+   cdfs_index_entry_t *entries;
+   unsigned count;
+   unsigned capacity;
+
+   /* open addressing over entries, -1 for empty */
+   int32_t *buckets;
+   unsigned bucket_mask;
+
+   char *names;
+   size_t names_size;
+   size_t names_capacity;
+} cdfs_index_t;
+
+typedef struct cdfs_directory
+{
+   uint32_t sector;
+   uint32_t path;       /* offset into the name pool */
+} cdfs_directory_t;
+
+static bool cdfs_index_cache_active     = false;
+static cdfs_index_t *cdfs_index_cache   = NULL;
+#ifdef HAVE_THREADS
+static slock_t *cdfs_index_cache_lock   = NULL;
+#endif
+
+static uint32_t cdfs_get_le16(const uint8_t *p)
+{
+   return p[0] | (p[1] << 8);
+}
+
+static uint32_t cdfs_get_le32(const uint8_t *p)
+{
+   return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t cdfs_hash(const char *s)
+{
+   uint32_t hash = 5381;
+   while (*s)
+      hash = (hash << 5) + hash + (uint8_t)*s++;
+   return hash;
+}
+
+static uint32_t cdfs_hash_data(const uint8_t *data, uint32_t size)
+{
+   uint32_t i, hash = 5381;
+   for (i = 0; i < size; i++)
+      hash = (hash << 5) + hash + data[i];
+   return hash;
+}
+
+/* Reads count sectors of user data into out, a batch of raw
+ * sectors at a time when the stream holds headers and ECC. */
+static bool cdfs_read_sectors(intfstream_t *stream,
+      unsigned sector_size, unsigned header_size,
+      unsigned sector, unsigned count, uint8_t *out)
+{
+   uint8_t single[2448];
+   uint8_t *batch = single;
+   bool ok        = true;
+
+   if (intfstream_seek(stream, (int64_t)sector * sector_size, SEEK_SET) < 0)
+      return false;
+
+   if (sector_size == CDFS_SECTOR_DATA)
+      return intfstream_read(stream, out, (uint64_t)count * CDFS_SECTOR_DATA)
+         == (int64_t)count * CDFS_SECTOR_DATA;
+
+   if (count > 1)
+   {
+      batch = (uint8_t*)malloc((count > CDFS_READ_BATCH ? CDFS_READ_BATCH : count)
+            * sector_size);
+      if (!batch)
+         return false;
+   }
+
+   while (count > 0)
+   {
+      unsigned i;
+      unsigned n = (count > CDFS_READ_BATCH) ? CDFS_READ_BATCH : count;
+
+      if (intfstream_read(stream, batch, (uint64_t)n * sector_size)
+            != (int64_t)n * sector_size)
+      {
+         ok = false;
+         break;
+      }
+
+      for (i = 0; i < n; i++)
+         memcpy(out + i * CDFS_SECTOR_DATA,
+               batch + i * sector_size + header_size, CDFS_SECTOR_DATA);
+
+      out   += n * CDFS_SECTOR_DATA;
+      count -= n;
+   }
+
+   if (batch != single)
+      free(batch);
+   return ok;
+}
+
+static bool cdfs_read_sector(cdfs_file_t *file, unsigned sector, uint8_t *out)
+{
+   return cdfs_read_sectors(file->stream, file->stream_sector_size,
+         file->stream_sector_header_size, sector, 1, out);
+}
+
+/* Finds the volume descriptor under each of the sector layouts a
+ * data track can be stored in, then falls back to the sync pattern
+ * and the stream size for images without one. */
+static void cdfs_determine_sector_size(cdfs_file_t *file)
+{
+   static const unsigned layouts[][2] =
+   {
+      { 2352, 16 },  /* MODE1/2352 */
+      { 2352, 24 },  /* MODE2/2352 */
+      { 2048, 0  },  /* MODE1/2048 */
+      { 2336, 8  },  /* MODE2/2336 */
+      { 2448, 0  },  /* cooked CHD frames with subcode */
+   };
+   static const uint8_t sync[12] =
+   { 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00 };
+   uint8_t buffer[16];
+   int64_t stream_size;
+   unsigned i;
+
+   for (i = 0; i < sizeof(layouts) / sizeof(layouts[0]); i++)
+   {
+      if (intfstream_seek(file->stream, (int64_t)CDFS_PVD_SECTOR * layouts[i][0]
+               + layouts[i][1], SEEK_SET) < 0)
+         continue;
+      if (intfstream_read(file->stream, buffer, 6) != 6)
+         continue;
+      if (!memcmp(&buffer[1], "CD001", 5))
+      {
+         file->stream_sector_size        = layouts[i][0];
+         file->stream_sector_header_size = layouts[i][1];
+         return;
+      }
+   }
+
+   intfstream_seek(file->stream, 0, SEEK_SET);
+   if (intfstream_read(file->stream, buffer, sizeof(buffer)) == sizeof(buffer)
+         && !memcmp(buffer, sync, sizeof(sync)))
+   {
+      file->stream_sector_size        = 2352;
+      file->stream_sector_header_size = (buffer[15] == 2) ? 24 : 16;
+      return;
+   }
+
+   stream_size = intfstream_get_size(file->stream);
+   if (stream_size > 0 && (stream_size % 2352) == 0)
+   {
+      file->stream_sector_size        = 2352;
+      file->stream_sector_header_size = 16;
+   }
+   else if (stream_size > 0 && (stream_size % 2336) == 0)
+   {
+      file->stream_sector_size        = 2336;
+      file->stream_sector_header_size = 8;
+   }
+   else
+   {
+      file->stream_sector_size        = 2048;
+      file->stream_sector_header_size = 0;
+   }
+}
+
+/* Uppercases a path, unifies the separators and drops the leading
+ * separator, a ";1" version and the trailing dot of a name without
+ * an extension. Returns the length written. */
+static size_t cdfs_normalize_path(char *out, size_t size,
+      const char *path, size_t len)
+{
+   size_t i, n = 0;
+
+   while (len > 0 && (*path == '/' || *path == '\\'))
+   {
+      path++;
+      len--;
+   }
+
+   for (i = 0; i < len && path[i] != ';' && n + 1 < size; i++)
+   {
+      char c = path[i];
+      out[n++] = (c == '\\') ? '/' : (char)toupper((unsigned char)c);
+   }
+
+   while (n > 0 && (out[n - 1] == '.' || out[n - 1] == '/'))
+      n--;
+   out[n] = '\0';
+   return n;
+}
+
+static void cdfs_index_free(cdfs_index_t *index)
+{
+   if (!index)
+      return;
+   free(index->entries);
+   free(index->buckets);
+   free(index->names);
+   free(index);
+}
+
+static bool cdfs_index_add_name(cdfs_index_t *index,
+      const char *name, size_t len, uint32_t *offset)
+{
+   if (index->names_size + len + 1 > index->names_capacity)
+   {
+      size_t capacity = index->names_capacity ? index->names_capacity * 2 : 4096;
+      char *names;
+      while (capacity < index->names_size + len + 1)
+         capacity *= 2;
+      names = (char*)realloc(index->names, capacity);
+      if (!names)
+         return false;
+      index->names          = names;
+      index->names_capacity = capacity;
+   }
+
+   *offset = (uint32_t)index->names_size;
+   memcpy(index->names + index->names_size, name, len);
+   index->names[index->names_size + len] = '\0';
+   index->names_size += len + 1;
+   return true;
+}
+
+static bool cdfs_index_add(cdfs_index_t *index,
+      const char *path, size_t len, uint32_t sector, uint32_t size)
+{
+   cdfs_index_entry_t *entry;
+
+   if (index->count == index->capacity)
+   {
+      unsigned capacity = index->capacity ? index->capacity * 2 : 256;
+      cdfs_index_entry_t *entries = (cdfs_index_entry_t*)
+         realloc(index->entries, capacity * sizeof(*entries));
+      if (!entries)
+         return false;
+      index->entries  = entries;
+      index->capacity = capacity;
+   }
+
+   entry         = &index->entries[index->count];
+   entry->sector = sector;
+   entry->size   = size;
+   if (!cdfs_index_add_name(index, path, len, &entry->name))
+      return false;
+   entry->hash   = cdfs_hash(index->names + entry->name);
+   index->count++;
+   return true;
+}
+
+/* the table is built once all entries are known, at under half load */
+static bool cdfs_index_build_buckets(cdfs_index_t *index)
+{
+   unsigned i, buckets = 16;
+
+   while (buckets < index->count * 2)
+      buckets *= 2;
+
+   index->buckets = (int32_t*)malloc(buckets * sizeof(int32_t));
+   if (!index->buckets)
+      return false;
+   memset(index->buckets, 0xff, buckets * sizeof(int32_t));
+   index->bucket_mask = buckets - 1;
+
+   for (i = 0; i < index->count; i++)
+   {
+      unsigned slot = index->entries[i].hash & index->bucket_mask;
+      while (index->buckets[slot] >= 0)
+         slot = (slot + 1) & index->bucket_mask;
+      index->buckets[slot] = (int32_t)i;
+   }
+
+   return true;
+}
+
+static const cdfs_index_entry_t *cdfs_index_find(const cdfs_index_t *index,
+      const char *path)
+{
+   uint32_t hash = cdfs_hash(path);
+   unsigned slot = hash & index->bucket_mask;
+
+   while (index->buckets[slot] >= 0)
+   {
+      const cdfs_index_entry_t *entry = &index->entries[index->buckets[slot]];
+      if (entry->hash == hash && !strcmp(index->names + entry->name, path))
+         return entry;
+      slot = (slot + 1) & index->bucket_mask;
+   }
+
+   return NULL;
+}
+
+/* Reads a whole directory extent; its size comes from the "." record
+ * at the start of its first sector. */
+static uint8_t *cdfs_load_directory(cdfs_file_t *file,
+      uint32_t sector, uint32_t *size)
+{
+   uint8_t first[CDFS_SECTOR_DATA];
+   uint8_t *data;
+   uint32_t sectors;
+
+   if (!cdfs_read_sector(file, sector, first) || first[0] < 34)
+      return NULL;
+
+   *size = cdfs_get_le32(&first[10]);
+   if (*size == 0 || *size > CDFS_MAX_DIRECTORY_SIZE)
+      return NULL;
+
+   sectors = (*size + CDFS_SECTOR_DATA - 1) / CDFS_SECTOR_DATA;
+   data    = (uint8_t*)malloc(sectors * CDFS_SECTOR_DATA);
+   if (!data)
+      return NULL;
+
+   memcpy(data, first, CDFS_SECTOR_DATA);
+   if (sectors > 1 && !cdfs_read_sectors(file->stream,
+            file->stream_sector_size, file->stream_sector_header_size,
+            sector + 1, sectors - 1, data + CDFS_SECTOR_DATA))
+   {
+      free(data);
+      return NULL;
+   }
+
+   *size = sectors * CDFS_SECTOR_DATA;
+   return data;
+}
+
+/* Returns the record at *pos in a directory extent and moves past
+ * it, skipping the zero fill at sector ends and the "." and ".."
+ * records. NULL at the end or on a malformed record. */
+static const uint8_t *cdfs_next_record(const uint8_t *data,
+      uint32_t size, uint32_t *pos)
+{
+   while (*pos < size)
+   {
+      const uint8_t *record = data + *pos;
+
+      /* records never cross a sector; zero fills the tail */
+      if (record[0] == 0)
+      {
+         *pos = (*pos / CDFS_SECTOR_DATA + 1) * CDFS_SECTOR_DATA;
+         continue;
+      }
+      if (record[0] < 34 || *pos + record[0] > size
+            || 33 + record[32] > record[0])
+         return NULL;
+
+      *pos += record[0];
+
+      if (record[32] == 1 && record[33] <= 1)
+         continue;
+      return record;
+   }
+
+   return NULL;
+}
+
+/* Lists the directories from the little-endian path table, which
+ * gives every directory's sector and parent in one read. */
+static cdfs_directory_t *cdfs_read_path_table(cdfs_file_t *file,
+      cdfs_index_t *index, unsigned *count)
+{
+   uint32_t size    = cdfs_get_le32(&index->pvd[132]);
+   uint32_t sector  = cdfs_get_le32(&index->pvd[140]);
+   uint32_t sectors = (size + CDFS_SECTOR_DATA - 1) / CDFS_SECTOR_DATA;
+   cdfs_directory_t *dirs = NULL;
+   uint8_t *table;
+   uint32_t pos     = 0;
+   unsigned n       = 0;
+   unsigned capacity = 0;
+
+   if (size == 0 || size > CDFS_MAX_DIRECTORY_SIZE)
+      return NULL;
+
+   table = (uint8_t*)malloc(sectors * CDFS_SECTOR_DATA);
+   if (!table)
+      return NULL;
+   if (!cdfs_read_sectors(file->stream, file->stream_sector_size,
+            file->stream_sector_header_size, sector, sectors, table))
+      goto error;
+
+   while (pos + 8 <= size && n < CDFS_MAX_DIRECTORIES)
+   {
+      char path[512];
+      size_t len           = 0;
+      unsigned name_length = table[pos];
+      uint32_t dir_sector  = cdfs_get_le32(&table[pos + 2]);
+      unsigned parent      = cdfs_get_le16(&table[pos + 6]);
+
+      if (name_length == 0 || pos + 8 + name_length > size)
+         break;
+
+      /* directory numbers are 1-based and parents always come first */
+      if (n > 0)
+      {
+         char name[256];
+         if (parent == 0 || parent > n)
+            break;
+         memcpy(name, &table[pos + 8], name_length);
+         name[name_length] = '\0';
+         len = strlcpy(path, index->names + dirs[parent - 1].path, sizeof(path));
+         if (len > 0 && len + 1 < sizeof(path))
+            path[len++] = '/';
+         len += cdfs_normalize_path(path + len, sizeof(path) - len,
+               name, name_length);
+      }
+
+      if (n == capacity)
+      {
+         cdfs_directory_t *grown;
+         capacity = capacity ? capacity * 2 : 64;
+         grown = (cdfs_directory_t*)realloc(dirs, capacity * sizeof(*dirs));
+         if (!grown)
+            goto error;
+         dirs = grown;
+      }
+
+      dirs[n].sector = dir_sector;
+      if (!cdfs_index_add_name(index, path, len, &dirs[n].path))
+         goto error;
+      n++;
+
+      pos += 8 + name_length + (name_length & 1);
+   }
+
+   free(table);
+   *count = n;
+   return dirs;
+
+error:
+   free(table);
+   free(dirs);
+   return NULL;
+}
+
+/* Reads the path table and every directory once and hashes each
+ * entry by its full path. Without a usable path table, the
+ * directory tree is walked from the root record instead. */
+static cdfs_index_t *cdfs_index_create(cdfs_file_t *file, const uint8_t *pvd)
+{
+   unsigned i, count  = 0;
+   unsigned capacity  = 0;
+   bool walk          = false;
+   cdfs_directory_t *dirs;
+   cdfs_index_t *index = (cdfs_index_t*)calloc(1, sizeof(*index));
+
+   if (!index)
+      return NULL;
+
+   memcpy(index->pvd, pvd, CDFS_SECTOR_DATA);
+   index->sector_size        = file->stream_sector_size;
+   index->sector_header_size = file->stream_sector_header_size;
+
+   dirs = cdfs_read_path_table(file, index, &count);
+   if (dirs)
+      capacity = count;
+   else
+   {
+      /* the root directory record is 156 bytes into the descriptor */
+      walk = true;
+      capacity = count = 1;
+      dirs = (cdfs_directory_t*)malloc(sizeof(*dirs));
+      if (!dirs || !cdfs_index_add_name(index, "", 0, &dirs[0].path))
+         goto error;
+      dirs[0].sector = cdfs_get_le32(&pvd[156 + 2]);
+   }
+
+   for (i = 0; i < count; i++)
+   {
+      uint32_t size, pos = 0;
+      const uint8_t *record;
+      uint8_t *data = cdfs_load_directory(file, dirs[i].sector, &size);
+
+      if (!data)
+         continue;
+
+      while ((record = cdfs_next_record(data, size, &pos)))
+      {
+         char path[512];
+         size_t len = strlcpy(path, index->names + dirs[i].path, sizeof(path));
+
+         if (len > 0 && len + 1 < sizeof(path))
+            path[len++] = '/';
+         len += cdfs_normalize_path(path + len, sizeof(path) - len,
+               (const char*)record + 33, record[32]);
+
+         if (!cdfs_index_add(index, path, len,
+                  cdfs_get_le32(&record[2]), cdfs_get_le32(&record[10])))
+         {
+            free(data);
+            goto error;
+         }
+
+         /* without a path table, queue subdirectories as they appear */
+         if (walk && (record[25] & 0x02) && count < CDFS_MAX_DIRECTORIES)
+         {
+            if (count == capacity)
+            {
+               cdfs_directory_t *grown;
+               capacity *= 2;
+               grown = (cdfs_directory_t*)realloc(dirs, capacity * sizeof(*dirs));
+               if (!grown)
+               {
+                  free(data);
+                  goto error;
+               }
+               dirs = grown;
+            }
+            dirs[count].sector = cdfs_get_le32(&record[2]);
+            dirs[count].path   = index->entries[index->count - 1].name;
+            count++;
+         }
+      }
+
+      free(data);
+   }
+
+   free(dirs);
+   if (!cdfs_index_build_buckets(index))
+      goto error_index;
+   return index;
+
+error:
+   free(dirs);
+error_index:
+   cdfs_index_free(index);
+   return NULL;
+}
+
+static bool cdfs_index_matches(const cdfs_index_t *index,
+      const cdfs_file_t *file, const uint8_t *pvd,
+      int64_t image_size, uint32_t root_hash)
+{
+   return index->sector_size == file->stream_sector_size
+      && index->sector_header_size == file->stream_sector_header_size
+      && index->image_size == image_size
+      && index->root_hash == root_hash
+      && !memcmp(index->pvd, pvd, CDFS_SECTOR_DATA);
+}
+
+/* Looks path up in a cached index for this disc. Returns -1 if no
+ * index is cached, 0 if the path is missing, 1 if found. */
+static int cdfs_index_cache_find(const cdfs_file_t *file,
+      const uint8_t *pvd, int64_t image_size, uint32_t root_hash,
+      const char *path, uint32_t *sector, uint32_t *size)
+{
+   int found = -1;
+   cdfs_index_t *index, *prev = NULL;
+
+#ifdef HAVE_THREADS
+   slock_lock(cdfs_index_cache_lock);
+#endif
+
+   for (index = cdfs_index_cache; index; prev = index, index = index->next)
+   {
+      const cdfs_index_entry_t *entry;
+
+      if (!cdfs_index_matches(index, file, pvd, image_size, root_hash))
+         continue;
+
+      entry = cdfs_index_find(index, path);
+      found = entry ? 1 : 0;
+      if (entry)
+      {
+         *sector = entry->sector;
+         *size   = entry->size;
+      }
+
+      /* most recently used first */
+      if (prev)
+      {
+         prev->next       = index->next;
+         index->next      = cdfs_index_cache;
+         cdfs_index_cache = index;
+      }
+      break;
+   }
+
+#ifdef HAVE_THREADS
+   slock_unlock(cdfs_index_cache_lock);
+#endif
+
+   return found;
+}
+
+/* Hands a new index over to the cache, dropping the least recently
+ * used one past CDFS_INDEX_CACHE_SIZE. Returns false if the cache
+ * is inactive and the caller still owns the index. */
+static bool cdfs_index_cache_insert(cdfs_index_t *index)
+{
+   cdfs_index_t *drop = NULL;
+   unsigned n         = 1;
+   cdfs_index_t *iter;
+
+#ifdef HAVE_THREADS
+   if (!cdfs_index_cache_lock)
+      return false;
+   slock_lock(cdfs_index_cache_lock);
+#endif
+
+   if (!cdfs_index_cache_active)
+   {
+#ifdef HAVE_THREADS
+      slock_unlock(cdfs_index_cache_lock);
+#endif
+      return false;
+   }
+
+   index->next      = cdfs_index_cache;
+   cdfs_index_cache = index;
+
+   for (iter = cdfs_index_cache; iter; iter = iter->next, n++)
+   {
+      if (n == CDFS_INDEX_CACHE_SIZE)
+      {
+         drop       = iter->next;
+         iter->next = NULL;
+         break;
+      }
+   }
+
+#ifdef HAVE_THREADS
+   slock_unlock(cdfs_index_cache_lock);
+#endif
+
+   while (drop)
+   {
+      cdfs_index_t *next = drop->next;
+      cdfs_index_free(drop);
+      drop = next;
+   }
+
+   return true;
+}
+
+bool cdfs_index_cache_init(void)
+{
+   if (cdfs_index_cache_active)
+      return true;
+
+#ifdef HAVE_THREADS
+   cdfs_index_cache_lock = slock_new();
+   if (!cdfs_index_cache_lock)
+      return false;
+#endif
+   cdfs_index_cache_active = true;
+   return true;
+}
+
+void cdfs_index_cache_deinit(void)
+{
+   cdfs_index_t *index;
+
+   if (!cdfs_index_cache_active)
+      return;
+
+#ifdef HAVE_THREADS
+   slock_lock(cdfs_index_cache_lock);
+#endif
+   cdfs_index_cache_active = false;
+   index                   = cdfs_index_cache;
+   cdfs_index_cache        = NULL;
+#ifdef HAVE_THREADS
+   slock_unlock(cdfs_index_cache_lock);
+   slock_free(cdfs_index_cache_lock);
+   cdfs_index_cache_lock = NULL;
+#endif
+
+   while (index)
+   {
+      cdfs_index_t *next = index->next;
+      cdfs_index_free(index);
+      index = next;
+   }
+}
+
+/* Looks path up one directory at a time from the root record,
+ * reading only the directories along the way. */
+static bool cdfs_walk_path(cdfs_file_t *file, const uint8_t *pvd,
+      const char *path, uint32_t *sector, uint32_t *size)
+{
+   uint32_t dir = cdfs_get_le32(&pvd[156 + 2]);
+
+   while (*path)
+   {
+      const char *slash     = strchr(path, '/');
+      size_t len            = slash ? (size_t)(slash - path) : strlen(path);
+      const uint8_t *record = NULL;
+      uint32_t dir_size, pos = 0;
+      uint8_t *data         = cdfs_load_directory(file, dir, &dir_size);
+
+      if (!data)
+         return false;
+
+      while ((record = cdfs_next_record(data, dir_size, &pos)))
+      {
+         char name[256];
+         size_t name_len = cdfs_normalize_path(name, sizeof(name),
+               (const char*)record + 33, record[32]);
+
+         if (name_len == len && !memcmp(name, path, len))
+            break;
+      }
+
+      if (record)
+      {
+         *sector = cdfs_get_le32(&record[2]);
+         *size   = cdfs_get_le32(&record[10]);
+         if (slash && !(record[25] & 0x02))
+            record = NULL;
+      }
+      free(data);
+
+      if (!record)
+         return false;
+      if (!slash)
+         return true;
+
+      dir  = *sector;
+      path = slash + 1;
+   }
+
+   return false;
+}
+
+static int cdfs_find_file(cdfs_file_t *file, const char *path)
+{
+   uint8_t pvd[CDFS_SECTOR_DATA];
+   char normalized[512];
+   const cdfs_index_entry_t *entry;
+   cdfs_index_t *index;
+   uint8_t *root;
+   int64_t image_size;
+   uint32_t root_hash;
+   uint32_t sector = 0;
+   uint32_t size   = 0;
+   int found       = -1;
+
+   if (!cdfs_read_sector(file, CDFS_PVD_SECTOR, pvd)
+         || memcmp(&pvd[1], "CD001", 5))
+      return -1;
+
+   cdfs_normalize_path(normalized, sizeof(normalized), path, strlen(path));
+
+   /* building a whole index only pays off when it is kept */
+   if (!cdfs_index_cache_active)
+   {
+      if (!cdfs_walk_path(file, pvd, normalized, &sector, &size))
+         return -1;
+      file->size = size;
+      return (int)sector;
+   }
+
+   root = cdfs_load_directory(file, cdfs_get_le32(&pvd[156 + 2]), &size);
+   if (!root)
+      return -1;
+   root_hash  = cdfs_hash_data(root, size);
+   image_size = intfstream_get_size(file->stream);
+   free(root);
+
+   found = cdfs_index_cache_find(file, pvd, image_size, root_hash,
+         normalized, &sector, &size);
+
+   if (found < 0)
+   {
+      index = cdfs_index_create(file, pvd);
+      if (!index)
+         return -1;
+      index->image_size = image_size;
+      index->root_hash  = root_hash;
+
+      entry = cdfs_index_find(index, normalized);
+      found = entry ? 1 : 0;
+      if (entry)
+      {
+         sector = entry->sector;
+         size   = entry->size;
+      }
+
+      if (!cdfs_index_cache_insert(index))
+         cdfs_index_free(index);
+   }
+
+   if (found <= 0)
+      return -1;
+
+   file->size = size;
+   return (int)sector;
+}
+
+int cdfs_open_file(cdfs_file_t* file, intfstream_t* stream, const char* path)
+{
+   if (!file || !stream)
+      return 0;
+
+   memset(file, 0, sizeof(*file));
+   file->stream         = stream;
+   file->current_sector = -1;
+
+   cdfs_determine_sector_size(file);
+
+   if (path)
+      file->first_sector = cdfs_find_file(file, path);
+   else
+   {
+      /* the raw track, as a run of 2048 byte sectors */
+      int64_t stream_size = intfstream_get_size(stream);
+      file->first_sector  = 0;
+      file->size          = (stream_size > 0)
+         ? (unsigned)(stream_size / file->stream_sector_size) * CDFS_SECTOR_DATA
+         : 0;
+   }
+
+   if (file->first_sector < 0)
+      return 0;
+
+   file->current_sector = file->first_sector;
+   return 1;
+}
+
+void cdfs_close_file(cdfs_file_t* file)
+{
+   /* the stream belongs to the caller; just stop further reads */
+   if (file)
+   {
+      file->first_sector        = -1;
+      file->sector_buffer_valid = 0;
+   }
+}
+
+int64_t cdfs_read_file(cdfs_file_t* file, void* buffer, uint64_t len)
+{
+   uint8_t *out      = (uint8_t*)buffer;
+   int64_t bytes_read = 0;
+
+   if (!file || !buffer || file->first_sector < 0)
+      return 0;
+
+   if (len > file->size - file->pos)
+      len = file->size - file->pos;
+
+   while (len > 0)
+   {
+      unsigned sector = file->first_sector + file->pos / CDFS_SECTOR_DATA;
+      unsigned offset = file->pos % CDFS_SECTOR_DATA;
+      unsigned amount;
+
+      /* whole sectors go straight to the caller in one batch */
+      if (offset == 0 && len >= CDFS_SECTOR_DATA)
+      {
+         unsigned count = (unsigned)(len / CDFS_SECTOR_DATA);
+         if (!cdfs_read_sectors(file->stream, file->stream_sector_size,
+                  file->stream_sector_header_size, sector, count, out))
+            break;
+         amount = count * CDFS_SECTOR_DATA;
+      }
+      else
+      {
+         if (!file->sector_buffer_valid || file->current_sector != (int)sector)
+         {
+            if (!cdfs_read_sector(file, sector, file->sector_buffer))
+               break;
+            file->current_sector      = sector;
+            file->sector_buffer_valid = 1;
+         }
+
+         amount = CDFS_SECTOR_DATA - offset;
+         if (amount > len)
+            amount = (unsigned)len;
+         memcpy(out, &file->sector_buffer[offset], amount);
+      }
+
+      out        += amount;
+      len        -= amount;
+      bytes_read += amount;
+      file->pos  += amount;
+   }
+
+   file->current_sector_offset = file->pos % CDFS_SECTOR_DATA;
+   return bytes_read;
+}
+
+int64_t cdfs_get_size(cdfs_file_t* file)
+{
+   if (!file || file->first_sector < 0)
+      return 0;
+   return file->size;
+}
+
+int64_t cdfs_tell(cdfs_file_t* file)
+{
+   if (!file || file->first_sector < 0)
+      return -1;
+   return file->pos;
+}
+
+int64_t cdfs_seek(cdfs_file_t* file, int64_t offset, int whence)
+{
+   int64_t new_pos;
+
+   if (!file || file->first_sector < 0)
+      return -1;
+
+   switch (whence)
+   {
+      case SEEK_SET:
+         new_pos = offset;
+         break;
+      case SEEK_CUR:
+         new_pos = file->pos + offset;
+         break;
+      case SEEK_END:
+         new_pos = file->size + offset;
+         break;
+      default:
+         return -1;
+   }
+
+   if (new_pos < 0 || new_pos > file->size)
+      return -1;
+
+   /* the sector buffer stays valid; reads check which sector it holds */
+   file->pos                   = (unsigned)new_pos;
+   file->current_sector_offset = file->pos % CDFS_SECTOR_DATA;
+   return 0;
+}
+
+/* Finds a track in a cue sheet and opens the file holding it. Tracks
+ * that do not start at the beginning of their file are rejected:
+ * sector numbers within the track would not match the stream. */
+static intfstream_t* cdfs_open_cue_track(const char* path,
+      unsigned int track_index, bool first_data)
+{
+   char track_path[PATH_MAX_LENGTH];
+   char file_name[PATH_MAX_LENGTH];
+   void *buf          = NULL;
+   int64_t len        = 0;
+   char *line, *save  = NULL;
+   unsigned track     = 0;
+   bool in_track      = false;
+   bool found         = false;
+   bool file_start    = false;
+   bool at_start      = false;
+
+   if (!filestream_read_file(path, &buf, &len) || !buf)
+      return NULL;
+
+   file_name[0] = '\0';
+
+   for (line = strtok_r((char*)buf, "\r\n", &save); line;
+         line = strtok_r(NULL, "\r\n", &save))
+   {
+      while (*line == ' ' || *line == '\t')
+         line++;
+
+      if (!strncmp(line, "FILE", 4))
+      {
+         const char *start = strchr(line, '"');
+         const char *end   = start ? strchr(start + 1, '"') : NULL;
+
+         if (found)
+            break;
+         if (start && end && (size_t)(end - start) < sizeof(file_name))
+         {
+            memcpy(file_name, start + 1, end - start - 1);
+            file_name[end - start - 1] = '\0';
+         }
+         file_start = true;
+         in_track   = false;
+      }
+      else if (!strncmp(line, "TRACK", 5))
+      {
+         if (found)
+            break;
+         track    = (unsigned)strtoul(line + 5, &line, 10);
+         while (*line == ' ')
+            line++;
+         in_track = first_data
+            ? strncmp(line, "AUDIO", 5) != 0
+            : track == track_index;
+         at_start   = file_start;
+         file_start = false;
+      }
+      else if (in_track && !strncmp(line, "INDEX", 5))
+      {
+         unsigned index = (unsigned)strtoul(line + 5, &line, 10);
+         if (index == 1)
+         {
+            unsigned mm = 0, ss = 0, ff = 0;
+            sscanf(line, " %u:%u:%u", &mm, &ss, &ff);
+            found = at_start && mm == 0 && ss == 0 && ff == 0;
+            if (!found)
+               break;
+         }
+      }
+   }
+
+   free(buf);
+
+   if (!found || !*file_name)
+      return NULL;
+
+   fill_pathname_resolve_relative(track_path, path, file_name, sizeof(track_path));
+   return intfstream_open_file(track_path,
+         RETRO_VFS_FILE_ACCESS_READ, RETRO_VFS_FILE_ACCESS_HINT_NONE);
+}
+
+/* Not string_is_equal_noncase(): that reports a pointer compared
+ * with itself as different, and the compiler may merge "cue" with
+ * the tail of a literal path. */
+static bool cdfs_has_extension(const char *ext, const char *want)
+{
+   return ext && !strcasecmp(ext, want);
+}
+
+intfstream_t* cdfs_open_track(const char* path, unsigned int track_index)
+{
+   const char *ext = path_get_extension(path);
+
+   if (cdfs_has_extension(ext, "cue"))
+      return cdfs_open_cue_track(path, track_index, false);
+
+#ifdef HAVE_CHD
+   if (cdfs_has_extension(ext, "chd"))
+      return intfstream_open_chd_track(path,
+            RETRO_VFS_FILE_ACCESS_READ, RETRO_VFS_FILE_ACCESS_HINT_NONE,
+            (int32_t)track_index);
+#endif
+
+   /* an image holding a single track */
+   if (track_index == 1)
+      return cdfs_open_raw_track(path);
+
+   return NULL;
+}
+
+intfstream_t* cdfs_open_data_track(const char* path)
+{
+   const char *ext = path_get_extension(path);
+
+   if (cdfs_has_extension(ext, "cue"))
+      return cdfs_open_cue_track(path, 0, true);
+
+#ifdef HAVE_CHD
+   if (cdfs_has_extension(ext, "chd"))
+      return intfstream_open_chd_track(path,
+            RETRO_VFS_FILE_ACCESS_READ, RETRO_VFS_FILE_ACCESS_HINT_NONE,
+            CHDSTREAM_TRACK_PRIMARY);
+#endif
+
+   return cdfs_open_raw_track(path);
+}
+
+intfstream_t* cdfs_open_raw_track(const char* path)
+{
+   const char *ext = path_get_extension(path);
+
+   if (     cdfs_has_extension(ext, "bin")
+         || cdfs_has_extension(ext, "iso"))
+      return intfstream_open_file(path,
+            RETRO_VFS_FILE_ACCESS_READ, RETRO_VFS_FILE_ACCESS_HINT_NONE);
+
+   return NULL;
+}
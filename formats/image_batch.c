@@ -0,0 +1,599 @@
+/* Copyright  (C) 2010-2020 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (image_batch.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <formats/image.h>
+#include <file/nbio.h>
+#include <features/features_cpu.h>
+#include <string/stdstring.h>
+
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
+#define IMAGE_BATCH_MAX_THREADS 16
+
+struct image_batch_job
+{
+   struct image_batch_job *next;
+   char *path;             /* NULL for images in memory */
+   const void *buf;
+   size_t len;
+   void *userdata;
+   struct texture_image image;
+   enum image_type_enum type;
+   unsigned max_width;
+   unsigned max_height;
+   uint32_t id;
+   bool cancelled;         /* Dropped while being decoded */
+   bool success;
+};
+
+struct image_batch_queue
+{
+   struct image_batch_job *head;
+   struct image_batch_job *tail;
+};
+
+/* Decoders are kept per format and reset between images */
+struct image_batch_worker
+{
+   void *decoders[IMAGE_TYPE_QOI + 1];
+#ifdef HAVE_THREADS
+   image_batch_t *batch;
+   sthread_t *thread;
+#endif
+};
+
+struct image_batch
+{
+   struct image_batch_queue pending;
+   struct image_batch_queue running;
+   struct image_batch_queue done;
+   struct image_batch_worker *workers;
+   unsigned num_workers;
+   uint32_t next_id;
+#ifdef HAVE_THREADS
+   slock_t *lock;
+   scond_t *job_cond;      /* Signalled when a job is queued */
+   scond_t *done_cond;     /* Broadcast when a job leaves running */
+   bool quit;
+#endif
+};
+
+#ifdef HAVE_THREADS
+#define IMAGE_BATCH_LOCK(batch)   slock_lock((batch)->lock)
+#define IMAGE_BATCH_UNLOCK(batch) slock_unlock((batch)->lock)
+#else
+#define IMAGE_BATCH_LOCK(batch)
+#define IMAGE_BATCH_UNLOCK(batch)
+#endif
+
+static void image_batch_push(struct image_batch_queue *queue,
+      struct image_batch_job *job)
+{
+   job->next = NULL;
+   if (queue->tail)
+      queue->tail->next = job;
+   else
+      queue->head       = job;
+   queue->tail          = job;
+}
+
+static struct image_batch_job *image_batch_pop(struct image_batch_queue *queue)
+{
+   struct image_batch_job *job = queue->head;
+
+   if (job)
+   {
+      queue->head = job->next;
+      if (!queue->head)
+         queue->tail = NULL;
+      job->next   = NULL;
+   }
+
+   return job;
+}
+
+static struct image_batch_job *image_batch_remove(
+      struct image_batch_queue *queue, uint32_t id)
+{
+   struct image_batch_job *prev = NULL;
+   struct image_batch_job *job  = queue->head;
+
+   for (; job; prev = job, job = job->next)
+   {
+      if (job->id != id)
+         continue;
+
+      if (prev)
+         prev->next  = job->next;
+      else
+         queue->head = job->next;
+      if (queue->tail == job)
+         queue->tail = prev;
+      job->next = NULL;
+      return job;
+   }
+
+   return NULL;
+}
+
+#ifdef HAVE_THREADS
+static struct image_batch_job *image_batch_find(
+      struct image_batch_queue *queue, uint32_t id)
+{
+   struct image_batch_job *job = queue->head;
+
+   while (job && job->id != id)
+      job = job->next;
+
+   return job;
+}
+
+/* Whether any job in queue will still come out as a result */
+static bool image_batch_has_live(const struct image_batch_queue *queue)
+{
+   const struct image_batch_job *job;
+
+   for (job = queue->head; job; job = job->next)
+      if (!job->cancelled)
+         return true;
+   return false;
+}
+#endif
+
+static void image_batch_free_job(struct image_batch_job *job)
+{
+   image_texture_free(&job->image);
+   if (job->path)
+      free(job->path);
+   free(job);
+}
+
+static void image_batch_free_queue(struct image_batch_queue *queue)
+{
+   struct image_batch_job *job;
+
+   while ((job = image_batch_pop(queue)))
+      image_batch_free_job(job);
+}
+
+static bool image_batch_is_cancelled(image_batch_t *batch,
+      struct image_batch_job *job)
+{
+   bool cancelled;
+
+   IMAGE_BATCH_LOCK(batch);
+   cancelled = job->cancelled;
+   IMAGE_BATCH_UNLOCK(batch);
+
+   return cancelled;
+}
+
+static bool image_batch_decode_buffer(image_batch_t *batch,
+      struct image_batch_worker *worker, struct image_batch_job *job,
+      void *ptr, size_t len)
+{
+   int ret;
+   unsigned r_shift, g_shift, b_shift, a_shift;
+   bool success              = false;
+   bool converted            = false;
+   enum image_type_enum type = job->type;
+   void *img                 = worker->decoders[type];
+
+   if (!img)
+   {
+      if (!(img = image_transfer_new(type)))
+         return false;
+      worker->decoders[type] = img;
+   }
+
+   image_transfer_set_buffer_ptr(img, type, ptr, len);
+   if (job->max_width || job->max_height)
+      image_transfer_set_scale_target(img, type,
+            job->max_width, job->max_height);
+
+   if (!image_transfer_start(img, type))
+      goto end;
+
+   /* PNGs are read chunk by chunk, so a cancel can stop them early */
+   while (image_transfer_iterate(img, type))
+   {
+      if (image_batch_is_cancelled(batch, job))
+         goto end;
+   }
+
+   if (!image_transfer_is_valid(img, type)
+         || image_batch_is_cancelled(batch, job))
+      goto end;
+
+   /* Decoders that can write RGBA do, instead of swapping after */
+   if (job->image.supports_rgba)
+   {
+      struct image_output output = {0};
+      output.format              = IMAGE_PIXEL_ABGR8888;
+      converted                  = image_transfer_set_output(img, type, &output);
+   }
+
+   /* Not stopped part way, as rpng moves its pointers along the rows */
+   do
+   {
+      ret = image_transfer_process(img, type,
+            &job->image.pixels, len,
+            &job->image.width, &job->image.height);
+   } while (ret == IMAGE_PROCESS_NEXT);
+
+   if (ret != IMAGE_PROCESS_END)
+      goto end;
+
+   if (!converted)
+   {
+      image_texture_set_color_shifts(&r_shift, &g_shift, &b_shift,
+            &a_shift, &job->image);
+      image_texture_color_convert(r_shift, g_shift, b_shift,
+            a_shift, &job->image);
+   }
+
+   success = true;
+
+end:
+   image_transfer_reset(img, type);
+   return success;
+}
+
+static bool image_batch_decode(image_batch_t *batch,
+      struct image_batch_worker *worker, struct image_batch_job *job)
+{
+   bool success;
+   size_t len            = 0;
+   void *ptr             = NULL;
+   struct nbio_t *handle = NULL;
+
+   if (!job->path)
+      return image_batch_decode_buffer(batch, worker, job,
+            (void*)job->buf, job->len);
+
+   if (!(handle = (struct nbio_t*)nbio_open(job->path, NBIO_READ)))
+      return false;
+
+   nbio_begin_read(handle);
+   while (!nbio_iterate(handle));
+
+   ptr     = nbio_get_ptr(handle, &len);
+   success = ptr && !image_batch_is_cancelled(batch, job)
+      && image_batch_decode_buffer(batch, worker, job, ptr, len);
+
+   nbio_free(handle);
+   return success;
+}
+
+/* Decodes job outside the lock, then hands it over; the lock must be
+ * held on entry and is held on return */
+static void image_batch_run(image_batch_t *batch,
+      struct image_batch_worker *worker, struct image_batch_job *job)
+{
+   image_batch_push(&batch->running, job);
+   IMAGE_BATCH_UNLOCK(batch);
+
+   job->success = image_batch_decode(batch, worker, job);
+   if (!job->success)
+      image_texture_free(&job->image);
+
+   IMAGE_BATCH_LOCK(batch);
+   image_batch_remove(&batch->running, job->id);
+   if (job->cancelled)
+      image_batch_free_job(job);
+   else
+      image_batch_push(&batch->done, job);
+}
+
+#ifdef HAVE_THREADS
+static void image_batch_thread(void *data)
+{
+   struct image_batch_worker *worker = (struct image_batch_worker*)data;
+   image_batch_t *batch              = worker->batch;
+
+   slock_lock(batch->lock);
+
+   while (!batch->quit)
+   {
+      struct image_batch_job *job = image_batch_pop(&batch->pending);
+
+      if (!job)
+      {
+         scond_wait(batch->job_cond, batch->lock);
+         continue;
+      }
+
+      image_batch_run(batch, worker, job);
+      scond_broadcast(batch->done_cond);
+   }
+
+   slock_unlock(batch->lock);
+}
+#endif
+
+image_batch_t *image_batch_new(unsigned threads)
+{
+   image_batch_t *batch = (image_batch_t*)calloc(1, sizeof(*batch));
+
+   if (!batch)
+      return NULL;
+
+#ifdef HAVE_THREADS
+   if (!threads)
+      threads = cpu_features_get_core_amount();
+   if (threads > IMAGE_BATCH_MAX_THREADS)
+      threads = IMAGE_BATCH_MAX_THREADS;
+#endif
+   if (!threads)
+      threads = 1;
+#ifndef HAVE_THREADS
+   threads = 1;
+#endif
+
+   batch->next_id = 1;
+   batch->workers = (struct image_batch_worker*)
+      calloc(threads, sizeof(*batch->workers));
+   if (!batch->workers)
+      goto error;
+
+#ifdef HAVE_THREADS
+   batch->lock      = slock_new();
+   batch->job_cond  = scond_new();
+   batch->done_cond = scond_new();
+   if (!batch->lock || !batch->job_cond || !batch->done_cond)
+      goto error;
+
+   for (; batch->num_workers < threads; batch->num_workers++)
+   {
+      struct image_batch_worker *worker = &batch->workers[batch->num_workers];
+
+      worker->batch  = batch;
+      worker->thread = sthread_create(image_batch_thread, worker);
+      if (!worker->thread)
+         break;
+   }
+
+   if (!batch->num_workers)
+      goto error;
+#else
+   batch->num_workers = threads;
+#endif
+
+   return batch;
+
+error:
+   image_batch_free(batch);
+   return NULL;
+}
+
+void image_batch_free(image_batch_t *batch)
+{
+   unsigned i, j;
+
+   if (!batch)
+      return;
+
+#ifdef HAVE_THREADS
+   if (batch->lock)
+   {
+      slock_lock(batch->lock);
+      batch->quit = true;
+      scond_broadcast(batch->job_cond);
+      slock_unlock(batch->lock);
+   }
+
+   for (i = 0; i < batch->num_workers; i++)
+      sthread_join(batch->workers[i].thread);
+
+   if (batch->done_cond)
+      scond_free(batch->done_cond);
+   if (batch->job_cond)
+      scond_free(batch->job_cond);
+   if (batch->lock)
+      slock_free(batch->lock);
+#endif
+
+   image_batch_free_queue(&batch->pending);
+   image_batch_free_queue(&batch->done);
+
+   if (batch->workers)
+   {
+      for (i = 0; i < batch->num_workers; i++)
+         for (j = 0; j <= IMAGE_TYPE_QOI; j++)
+            if (batch->workers[i].decoders[j])
+               image_transfer_free(batch->workers[i].decoders[j],
+                     (enum image_type_enum)j);
+      free(batch->workers);
+   }
+
+   free(batch);
+}
+
+static uint32_t image_batch_add(image_batch_t *batch,
+      struct image_batch_job *job, unsigned max_width,
+      unsigned max_height, bool supports_rgba, void *userdata)
+{
+   uint32_t id;
+
+   job->max_width           = max_width;
+   job->max_height          = max_height;
+   job->image.supports_rgba = supports_rgba;
+   job->userdata            = userdata;
+
+   IMAGE_BATCH_LOCK(batch);
+   id = job->id = batch->next_id++;
+   if (!batch->next_id)
+      batch->next_id = 1;
+   image_batch_push(&batch->pending, job);
+#ifdef HAVE_THREADS
+   scond_signal(batch->job_cond);
+#endif
+   IMAGE_BATCH_UNLOCK(batch);
+
+   return id;
+}
+
+uint32_t image_batch_add_file(image_batch_t *batch, const char *path,
+      unsigned max_width, unsigned max_height, bool supports_rgba,
+      void *userdata)
+{
+   struct image_batch_job *job;
+   enum image_type_enum type;
+
+   if (!batch || string_is_empty(path))
+      return 0;
+   if ((type = image_texture_get_type(path)) == IMAGE_TYPE_NONE)
+      return 0;
+   if (!(job = (struct image_batch_job*)calloc(1, sizeof(*job))))
+      return 0;
+
+   job->type = type;
+   if (!(job->path = strdup(path)))
+   {
+      free(job);
+      return 0;
+   }
+
+   return image_batch_add(batch, job, max_width, max_height,
+         supports_rgba, userdata);
+}
+
+uint32_t image_batch_add_buffer(image_batch_t *batch,
+      enum image_type_enum type, const void *buf, size_t len,
+      unsigned max_width, unsigned max_height, bool supports_rgba,
+      void *userdata)
+{
+   struct image_batch_job *job;
+
+   if (!batch || !buf || !len || type == IMAGE_TYPE_NONE
+         || (unsigned)type > IMAGE_TYPE_QOI)
+      return 0;
+   if (!(job = (struct image_batch_job*)calloc(1, sizeof(*job))))
+      return 0;
+
+   job->type = type;
+   job->buf  = buf;
+   job->len  = len;
+
+   return image_batch_add(batch, job, max_width, max_height,
+         supports_rgba, userdata);
+}
+
+bool image_batch_cancel(image_batch_t *batch, uint32_t id)
+{
+   struct image_batch_job *job;
+
+   if (!batch || !id)
+      return false;
+
+   IMAGE_BATCH_LOCK(batch);
+
+   if (     (job = image_batch_remove(&batch->pending, id))
+         || (job = image_batch_remove(&batch->done, id)))
+   {
+      IMAGE_BATCH_UNLOCK(batch);
+      image_batch_free_job(job);
+      return true;
+   }
+
+#ifdef HAVE_THREADS
+   /* The worker frees it once the decode stops. Only a buffer the
+    * caller owns has to be waited for; a file is read into memory
+    * the worker owns. */
+   if ((job = image_batch_find(&batch->running, id)) && !job->cancelled)
+   {
+      job->cancelled = true;
+      if (!job->path)
+         while (image_batch_find(&batch->running, id))
+            scond_wait(batch->done_cond, batch->lock);
+      slock_unlock(batch->lock);
+      return true;
+   }
+#endif
+
+   IMAGE_BATCH_UNLOCK(batch);
+   return false;
+}
+
+static bool image_batch_take(image_batch_t *batch,
+      struct image_batch_result *result)
+{
+   struct image_batch_job *job = image_batch_pop(&batch->done);
+
+   if (!job)
+      return false;
+
+   result->image    = job->image;
+   result->userdata = job->userdata;
+   result->id       = job->id;
+   result->success  = job->success;
+
+   job->image.pixels = NULL;
+   image_batch_free_job(job);
+   return true;
+}
+
+bool image_batch_poll(image_batch_t *batch, struct image_batch_result *result)
+{
+   bool taken;
+
+   if (!batch || !result)
+      return false;
+
+   IMAGE_BATCH_LOCK(batch);
+#ifndef HAVE_THREADS
+   if (!batch->done.head && batch->pending.head)
+      image_batch_run(batch, &batch->workers[0],
+            image_batch_pop(&batch->pending));
+#endif
+   taken = image_batch_take(batch, result);
+   IMAGE_BATCH_UNLOCK(batch);
+
+   return taken;
+}
+
+bool image_batch_wait(image_batch_t *batch, struct image_batch_result *result)
+{
+#ifdef HAVE_THREADS
+   bool taken;
+
+   if (!batch || !result)
+      return false;
+
+   slock_lock(batch->lock);
+   while (!batch->done.head && (batch->pending.head
+            || image_batch_has_live(&batch->running)))
+      scond_wait(batch->done_cond, batch->lock);
+   taken = image_batch_take(batch, result);
+   slock_unlock(batch->lock);
+
+   return taken;
+#else
+   return image_batch_poll(batch, result);
+#endif
+}
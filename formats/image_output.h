@@ -0,0 +1,117 @@
+/* Copyright  (C) 2010-2020 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (image_output.h).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Shared by the decoders that write into a struct image_output */
+
+#ifndef _IMAGE_OUTPUT_H
+#define _IMAGE_OUTPUT_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <retro_inline.h>
+#include <boolean.h>
+#include <formats/image.h>
+
+static INLINE unsigned image_output_bpp(enum image_pixel_format format)
+{
+   return format == IMAGE_PIXEL_RGB565 ? 2 : 4;
+}
+
+/* Readies out for a width x height image: allocates a packed buffer
+ * if the caller gave none, or checks that the caller's can take it.
+ * Sets *allocated when the buffer is the decoder's to free on error. */
+static INLINE bool image_output_begin(struct image_output *out,
+      unsigned width, unsigned height, bool *allocated)
+{
+   size_t bpp = image_output_bpp(out->format);
+
+   *allocated = false;
+
+   if (out->data)
+      return width <= out->width && height <= out->height
+         && out->pitch >= width * bpp;
+
+   if (!width || !height || height > (size_t)-1 / bpp / width)
+      return false;
+
+   if (!(out->data = malloc(bpp * width * height)))
+      return false;
+
+   out->pitch  = bpp * width;
+   out->width  = width;
+   out->height = height;
+   *allocated  = true;
+   return true;
+}
+
+static INLINE uint8_t *image_output_row(const struct image_output *out,
+      unsigned y)
+{
+   return (uint8_t*)out->data + out->pitch * y;
+}
+
+/* Writes width pixels, given as R, G, B, A bytes, in out's format */
+static INLINE void image_output_write_rgba(const struct image_output *out,
+      unsigned y, const uint8_t *src, unsigned width)
+{
+   unsigned i;
+   uint8_t *dst = image_output_row(out, y);
+
+   switch (out->format)
+   {
+      case IMAGE_PIXEL_ARGB8888:
+         for (i = 0; i < width; i++, src += 4)
+            ((uint32_t*)dst)[i] = (uint32_t)src[3] << 24
+               | (uint32_t)src[0] << 16 | (uint32_t)src[1] << 8 | src[2];
+         break;
+      case IMAGE_PIXEL_ABGR8888:
+#ifdef MSB_FIRST
+         for (i = 0; i < width; i++, src += 4)
+            ((uint32_t*)dst)[i] = (uint32_t)src[3] << 24
+               | (uint32_t)src[2] << 16 | (uint32_t)src[1] << 8 | src[0];
+#else
+         /* R, G, B, A in memory already */
+         if (dst != src)
+            memcpy(dst, src, width * 4);
+#endif
+         break;
+      case IMAGE_PIXEL_RGB565:
+         for (i = 0; i < width; i++, src += 4)
+            ((uint16_t*)dst)[i] = (uint16_t)((src[0] & 0xf8) << 8
+               | (src[1] & 0xfc) << 3 | src[2] >> 3);
+         break;
+   }
+}
+
+/* Whether rows can be built as R, G, B, A bytes in place */
+static INLINE bool image_output_is_rgba(const struct image_output *out)
+{
+#ifdef MSB_FIRST
+   return false;
+#else
+   return out->format == IMAGE_PIXEL_ABGR8888;
+#endif
+}
+
+#endif
@@ -26,9 +26,28 @@
 #include <stddef.h>
 
 #include <boolean.h>
+#include <retro_miscellaneous.h>
 #include <formats/image.h>
 #include <file/nbio.h>
 
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
+/* The texture cache needs files it can map */
+#if defined(HAVE_MMAP) && !defined(_WIN32) && !defined(GEKKO)
+#include <stdio.h>
+#include <time.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#define IMAGE_TEXTURE_CACHE
+
+static bool image_texture_cache_unmap(uint32_t *pixels);
+#endif
 
 enum image_type_enum image_texture_get_type(const char *path)
 {
@@ -47,6 +66,10 @@ enum image_type_enum image_texture_get_type(const char *path)
 #ifdef HAVE_RBMP
    if (strstr(path, ".bmp"))
       return IMAGE_TYPE_BMP;
+#endif
+#ifdef HAVE_RQOI
+   if (strstr(path, ".qoi"))
+      return IMAGE_TYPE_QOI;
 #endif
    return IMAGE_TYPE_NONE;
 }
@@ -90,8 +113,8 @@ bool image_texture_color_convert(unsigned r_shift,
          uint8_t r    = (uint8_t)(col >> 16);
          uint8_t g    = (uint8_t)(col >>  8);
          uint8_t b    = (uint8_t)(col >>  0);
-         pixels[i]    = (a << a_shift) |
-            (r << r_shift) | (g << g_shift) | (b << b_shift);
+         pixels[i]    = ((uint32_t)a << a_shift) |
+            ((uint32_t)r << r_shift) | ((uint32_t)g << g_shift) | ((uint32_t)b << b_shift);
       }
 
       return true;
@@ -166,16 +189,20 @@ static bool image_texture_load_internal(
       size_t len,
       struct texture_image *out_img,
       unsigned a_shift, unsigned r_shift,
-      unsigned g_shift, unsigned b_shift)
+      unsigned g_shift, unsigned b_shift,
+      unsigned max_width, unsigned max_height)
 {
    int ret;
-   bool success = false;
-   void *img    = image_transfer_new(type);
+   bool success   = false;
+   bool converted = false;
+   void *img      = image_transfer_new(type);
 
    if (!img)
       goto end;
 
    image_transfer_set_buffer_ptr(img, type, (uint8_t*)ptr, len);
+   if (max_width || max_height)
+      image_transfer_set_scale_target(img, type, max_width, max_height);
 
    if (!image_transfer_start(img, type))
       goto end;
@@ -185,6 +212,14 @@ static bool image_texture_load_internal(
    if (!image_transfer_is_valid(img, type))
       goto end;
 
+   /* Decoders that can write RGBA do, instead of swapping after */
+   if (r_shift == 0 && g_shift == 8 && b_shift == 16 && a_shift == 24)
+   {
+      struct image_output output = {0};
+      output.format              = IMAGE_PIXEL_ABGR8888;
+      converted                  = image_transfer_set_output(img, type, &output);
+   }
+
    do
    {
       ret = image_transfer_process(img, type,
@@ -195,8 +230,9 @@ static bool image_texture_load_internal(
    if (ret == IMAGE_PROCESS_ERROR || ret == IMAGE_PROCESS_ERROR_END)
       goto end;
 
-   image_texture_color_convert(r_shift, g_shift, b_shift,
-         a_shift, out_img);
+   if (!converted)
+      image_texture_color_convert(r_shift, g_shift, b_shift,
+            a_shift, out_img);
 
 #ifdef GEKKO
    if (!image_texture_internal_gx_convert_texture32(out_img))
@@ -220,6 +256,10 @@ void image_texture_free(struct texture_image *img)
    if (!img)
       return;
 
+#ifdef IMAGE_TEXTURE_CACHE
+   if (img->pixels && image_texture_cache_unmap(img->pixels))
+      img->pixels = NULL;
+#endif
    if (img->pixels)
       free(img->pixels);
    img->width  = 0;
@@ -238,7 +278,7 @@ bool image_texture_load_buffer(struct texture_image *out_img,
    {
       if (image_texture_load_internal(
          type, buffer, buffer_len, out_img,
-         a_shift, r_shift, g_shift, b_shift))
+         a_shift, r_shift, g_shift, b_shift, 0, 0))
       {
          return true;
       }
@@ -252,18 +292,17 @@ bool image_texture_load_buffer(struct texture_image *out_img,
    return false;
 }
 
-bool image_texture_load(struct texture_image *out_img,
-      const char *path)
+static bool image_texture_load_file(struct texture_image *out_img,
+      const char *path,
+      unsigned a_shift, unsigned r_shift,
+      unsigned g_shift, unsigned b_shift,
+      unsigned max_width, unsigned max_height)
 {
-   unsigned r_shift, g_shift, b_shift, a_shift;
    size_t file_len             = 0;
    struct nbio_t      *handle  = NULL;
    void                   *ptr = NULL;
    enum image_type_enum type  = image_texture_get_type(path);
 
-   image_texture_set_color_shifts(&r_shift, &g_shift, &b_shift,
-         &a_shift, out_img);
-
    if (type != IMAGE_TYPE_NONE)
    {
       handle = (struct nbio_t*)nbio_open(path, NBIO_READ);
@@ -281,7 +320,8 @@ bool image_texture_load(struct texture_image *out_img,
       if (image_texture_load_internal(
                type,
                ptr, file_len, out_img,
-               a_shift, r_shift, g_shift, b_shift))
+               a_shift, r_shift, g_shift, b_shift,
+               max_width, max_height))
          goto success;
    }
 
@@ -301,3 +341,495 @@ success:
 
    return true;
 }
+
+bool image_texture_load(struct texture_image *out_img,
+      const char *path)
+{
+   unsigned r_shift, g_shift, b_shift, a_shift;
+
+   image_texture_set_color_shifts(&r_shift, &g_shift, &b_shift,
+         &a_shift, out_img);
+
+   return image_texture_load_file(out_img, path,
+         a_shift, r_shift, g_shift, b_shift, 0, 0);
+}
+
+/* Texture cache */
+
+#ifdef IMAGE_TEXTURE_CACHE
+#define IMAGE_TEXTURE_CACHE_MAGIC      "RTEXCACH"
+#define IMAGE_TEXTURE_CACHE_VERSION    1
+#define IMAGE_TEXTURE_CACHE_BYTE_ORDER 0x01020304
+/* Pixels start on this boundary in the file, and so in its mapping */
+#define IMAGE_TEXTURE_CACHE_ALIGN      64
+
+/* A cache file is this header, the source path, then width * height
+ * ARGB pixels in native byte order. */
+struct image_texture_cache_header
+{
+   char     magic[8];
+   uint32_t version;
+   uint32_t byte_order;
+   uint32_t pixel_offset;   /* from the start of the file */
+   uint32_t path_len;
+   uint32_t width;
+   uint32_t height;
+   uint32_t max_width;      /* scale target it was decoded for */
+   uint32_t max_height;
+   int64_t  src_mtime;
+   int64_t  src_size;
+};
+
+struct image_texture_cache_entry
+{
+   uint64_t key;
+   uint64_t size;
+   int64_t  used;           /* last hit or store, seconds */
+};
+
+/* A cache file handed out as texture pixels */
+struct image_texture_cache_map
+{
+   uint32_t *pixels;
+   void *base;
+   size_t size;
+};
+
+static struct
+{
+   char *dir;
+   uint64_t budget;
+   uint64_t total;
+   struct image_texture_cache_entry *entries;
+   size_t count;
+   size_t capacity;
+   struct image_texture_cache_map *maps;
+   size_t map_count;
+   size_t map_capacity;
+#ifdef HAVE_THREADS
+   slock_t *lock;
+#endif
+} image_texture_cache;
+
+#ifdef HAVE_THREADS
+#define IMAGE_TEXTURE_CACHE_LOCK()   slock_lock(image_texture_cache.lock)
+#define IMAGE_TEXTURE_CACHE_UNLOCK() slock_unlock(image_texture_cache.lock)
+/* before the first init there is no lock, nor anything to guard */
+#define IMAGE_TEXTURE_CACHE_LOCK_IF_ANY() \
+   if (image_texture_cache.lock) slock_lock(image_texture_cache.lock)
+#define IMAGE_TEXTURE_CACHE_UNLOCK_IF_ANY() \
+   if (image_texture_cache.lock) slock_unlock(image_texture_cache.lock)
+#else
+#define IMAGE_TEXTURE_CACHE_LOCK()
+#define IMAGE_TEXTURE_CACHE_UNLOCK()
+#define IMAGE_TEXTURE_CACHE_LOCK_IF_ANY()
+#define IMAGE_TEXTURE_CACHE_UNLOCK_IF_ANY()
+#endif
+
+/* FNV-1a of the source path and scale target */
+static uint64_t image_texture_cache_key(const char *path,
+      unsigned max_width, unsigned max_height)
+{
+   unsigned i;
+   uint64_t hash    = 0xcbf29ce484222325ULL;
+   uint32_t dims[2];
+
+   dims[0] = max_width;
+   dims[1] = max_height;
+
+   for (; *path; path++)
+      hash = (hash ^ (uint8_t)*path) * 0x100000001b3ULL;
+   for (i = 0; i < sizeof(dims); i++)
+      hash = (hash ^ ((const uint8_t*)dims)[i]) * 0x100000001b3ULL;
+
+   return hash;
+}
+
+static void image_texture_cache_file(char *s, size_t len,
+      const char *dir, uint64_t key)
+{
+   snprintf(s, len, "%s/%016llx.tex", dir, (unsigned long long)key);
+}
+
+static struct image_texture_cache_entry *image_texture_cache_find(uint64_t key)
+{
+   size_t i;
+   for (i = 0; i < image_texture_cache.count; i++)
+      if (image_texture_cache.entries[i].key == key)
+         return &image_texture_cache.entries[i];
+   return NULL;
+}
+
+static void image_texture_cache_remove(struct image_texture_cache_entry *entry)
+{
+   char file[PATH_MAX_LENGTH];
+
+   image_texture_cache_file(file, sizeof(file),
+         image_texture_cache.dir, entry->key);
+   unlink(file);
+
+   image_texture_cache.total -= entry->size;
+   *entry = image_texture_cache.entries[--image_texture_cache.count];
+}
+
+/* Adds or updates an entry, then drops the least recently used ones
+ * until the files fit the budget. The entry just added stays. */
+static void image_texture_cache_add(uint64_t key, uint64_t size, int64_t used)
+{
+   struct image_texture_cache_entry *entry = image_texture_cache_find(key);
+
+   if (!entry)
+   {
+      if (image_texture_cache.count == image_texture_cache.capacity)
+      {
+         size_t capacity = image_texture_cache.capacity
+            ? image_texture_cache.capacity * 2 : 64;
+         struct image_texture_cache_entry *entries =
+            (struct image_texture_cache_entry*)realloc(
+                  image_texture_cache.entries, capacity * sizeof(*entries));
+         if (!entries)
+            return;
+         image_texture_cache.entries  = entries;
+         image_texture_cache.capacity = capacity;
+      }
+      entry       = &image_texture_cache.entries[image_texture_cache.count++];
+      entry->key  = key;
+      entry->size = 0;
+   }
+
+   image_texture_cache.total += size - entry->size;
+   entry->size                = size;
+   entry->used                = used;
+
+   while (image_texture_cache.budget
+         && image_texture_cache.total > image_texture_cache.budget
+         && image_texture_cache.count > 1)
+   {
+      size_t i;
+      struct image_texture_cache_entry *oldest = NULL;
+
+      for (i = 0; i < image_texture_cache.count; i++)
+      {
+         struct image_texture_cache_entry *e = &image_texture_cache.entries[i];
+         if (e->key != key && (!oldest || e->used < oldest->used))
+            oldest = e;
+      }
+
+      image_texture_cache_remove(oldest);
+   }
+}
+
+static bool image_texture_cache_unmap(uint32_t *pixels)
+{
+   size_t i;
+   bool found = false;
+
+   /* nothing was ever mapped without the cache set up first */
+#ifdef HAVE_THREADS
+   if (!image_texture_cache.lock)
+#else
+   if (!image_texture_cache.maps)
+#endif
+      return false;
+
+   IMAGE_TEXTURE_CACHE_LOCK();
+   for (i = 0; i < image_texture_cache.map_count; i++)
+   {
+      struct image_texture_cache_map *map = &image_texture_cache.maps[i];
+      if (map->pixels == pixels)
+      {
+         munmap(map->base, map->size);
+         *map  = image_texture_cache.maps[--image_texture_cache.map_count];
+         found = true;
+         break;
+      }
+   }
+   IMAGE_TEXTURE_CACHE_UNLOCK();
+
+   return found;
+}
+
+/* Maps the cache file, if it holds path as it is now */
+static bool image_texture_cache_map(struct texture_image *out_img,
+      const char *file, const char *path, const struct stat *src,
+      unsigned max_width, unsigned max_height)
+{
+   struct stat st;
+   const struct image_texture_cache_header *header;
+   size_t path_len = strlen(path);
+   void *base      = MAP_FAILED;
+   int fd;
+
+   if ((fd = open(file, O_RDONLY)) == -1)
+      return false;
+
+   if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(*header))
+      /* private and writable, so colours can be converted in place */
+      base = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE, fd, 0);
+   close(fd);
+
+   if (base == MAP_FAILED)
+      return false;
+
+   header = (const struct image_texture_cache_header*)base;
+
+   if (     memcmp(header->magic, IMAGE_TEXTURE_CACHE_MAGIC, sizeof(header->magic))
+         || header->version    != IMAGE_TEXTURE_CACHE_VERSION
+         || header->byte_order != IMAGE_TEXTURE_CACHE_BYTE_ORDER
+         || header->path_len   != path_len
+         || header->max_width  != max_width
+         || header->max_height != max_height
+         || header->src_mtime  != (int64_t)src->st_mtime
+         || header->src_size   != (int64_t)src->st_size
+         || !header->width || !header->height
+         || header->pixel_offset < sizeof(*header) + path_len
+         || header->pixel_offset % IMAGE_TEXTURE_CACHE_ALIGN
+         || (uint64_t)header->pixel_offset + (uint64_t)header->width
+            * header->height * sizeof(uint32_t) != (uint64_t)st.st_size
+         || memcmp((const char*)(header + 1), path, path_len))
+   {
+      munmap(base, (size_t)st.st_size);
+      return false;
+   }
+
+   if (image_texture_cache.map_count == image_texture_cache.map_capacity)
+   {
+      size_t capacity = image_texture_cache.map_capacity
+         ? image_texture_cache.map_capacity * 2 : 64;
+      struct image_texture_cache_map *maps =
+         (struct image_texture_cache_map*)realloc(
+               image_texture_cache.maps, capacity * sizeof(*maps));
+      if (!maps)
+      {
+         munmap(base, (size_t)st.st_size);
+         return false;
+      }
+      image_texture_cache.maps         = maps;
+      image_texture_cache.map_capacity = capacity;
+   }
+
+   out_img->pixels = (uint32_t*)((uint8_t*)base + header->pixel_offset);
+   out_img->width  = header->width;
+   out_img->height = header->height;
+
+   image_texture_cache.maps[image_texture_cache.map_count].pixels = out_img->pixels;
+   image_texture_cache.maps[image_texture_cache.map_count].base   = base;
+   image_texture_cache.maps[image_texture_cache.map_count].size   = (size_t)st.st_size;
+   image_texture_cache.map_count++;
+
+   return true;
+}
+
+static bool image_texture_cache_write_all(int fd, const void *data, size_t len)
+{
+   const uint8_t *p = (const uint8_t*)data;
+
+   while (len)
+   {
+      ssize_t written = write(fd, p, len);
+      if (written <= 0)
+         return false;
+      p   += written;
+      len -= (size_t)written;
+   }
+
+   return true;
+}
+
+/* Writes a cache file under a temporary name, then renames it, so a
+ * file is never seen half written. Returns its size, or 0. */
+static uint64_t image_texture_cache_store(const struct texture_image *img,
+      const char *file, const char *path, const struct stat *src,
+      unsigned max_width, unsigned max_height)
+{
+   char tmp[PATH_MAX_LENGTH + 32];
+   static const uint8_t zeroes[IMAGE_TEXTURE_CACHE_ALIGN] = {0};
+   struct image_texture_cache_header header;
+   size_t path_len    = strlen(path);
+   size_t pixels_size = (size_t)img->width * img->height * sizeof(uint32_t);
+   bool ok;
+   int fd;
+
+   memset(&header, 0, sizeof(header));
+   memcpy(header.magic, IMAGE_TEXTURE_CACHE_MAGIC, sizeof(header.magic));
+   header.version      = IMAGE_TEXTURE_CACHE_VERSION;
+   header.byte_order   = IMAGE_TEXTURE_CACHE_BYTE_ORDER;
+   header.pixel_offset = (uint32_t)((sizeof(header) + path_len
+         + IMAGE_TEXTURE_CACHE_ALIGN - 1) & ~(size_t)(IMAGE_TEXTURE_CACHE_ALIGN - 1));
+   header.path_len     = (uint32_t)path_len;
+   header.width        = img->width;
+   header.height       = img->height;
+   header.max_width    = max_width;
+   header.max_height   = max_height;
+   header.src_mtime    = (int64_t)src->st_mtime;
+   header.src_size     = (int64_t)src->st_size;
+
+   /* unique between threads loading the same image */
+   snprintf(tmp, sizeof(tmp), "%s.%lx.tmp", file, (unsigned long)(size_t)img->pixels);
+
+   if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1)
+      return 0;
+
+   ok =  image_texture_cache_write_all(fd, &header, sizeof(header))
+      && image_texture_cache_write_all(fd, path, path_len)
+      && image_texture_cache_write_all(fd, zeroes,
+            header.pixel_offset - sizeof(header) - path_len)
+      && image_texture_cache_write_all(fd, img->pixels, pixels_size);
+
+   if (close(fd) != 0 || !ok || rename(tmp, file) != 0)
+   {
+      unlink(tmp);
+      return 0;
+   }
+
+   return header.pixel_offset + pixels_size;
+}
+#endif
+
+bool image_texture_cache_init(const char *dir, uint64_t budget)
+{
+#ifdef IMAGE_TEXTURE_CACHE
+   DIR *d;
+   struct dirent *ent;
+   bool ok;
+
+   image_texture_cache_deinit();
+
+   if (!dir || !*dir)
+      return false;
+
+   mkdir(dir, 0755);
+   if (!(d = opendir(dir)))
+      return false;
+
+#ifdef HAVE_THREADS
+   if (!image_texture_cache.lock && !(image_texture_cache.lock = slock_new()))
+   {
+      closedir(d);
+      return false;
+   }
+#endif
+
+   IMAGE_TEXTURE_CACHE_LOCK();
+   image_texture_cache.dir    = strdup(dir);
+   image_texture_cache.budget = budget;
+
+   /* Pick up what earlier runs left, oldest use first out */
+   while ((ent = readdir(d)))
+   {
+      char file[PATH_MAX_LENGTH];
+      struct stat st;
+      unsigned long long key;
+      size_t len = strlen(ent->d_name);
+
+      snprintf(file, sizeof(file), "%s/%s", dir, ent->d_name);
+
+      if (len > 4 && !strcmp(ent->d_name + len - 4, ".tmp"))
+         unlink(file);
+      else if (len == 20 && !strcmp(ent->d_name + 16, ".tex")
+            && sscanf(ent->d_name, "%16llx", &key) == 1
+            && stat(file, &st) == 0)
+         image_texture_cache_add((uint64_t)key, (uint64_t)st.st_size,
+               (int64_t)st.st_mtime);
+   }
+
+   ok = image_texture_cache.dir != NULL;
+   IMAGE_TEXTURE_CACHE_UNLOCK();
+
+   closedir(d);
+   return ok;
+#else
+   (void)dir;
+   (void)budget;
+   return false;
+#endif
+}
+
+void image_texture_cache_deinit(void)
+{
+#ifdef IMAGE_TEXTURE_CACHE
+   /* Textures still mapped stay valid, and are unmapped when freed */
+   IMAGE_TEXTURE_CACHE_LOCK_IF_ANY();
+   free(image_texture_cache.dir);
+   free(image_texture_cache.entries);
+   image_texture_cache.dir      = NULL;
+   image_texture_cache.entries  = NULL;
+   image_texture_cache.count    = 0;
+   image_texture_cache.capacity = 0;
+   image_texture_cache.total    = 0;
+   IMAGE_TEXTURE_CACHE_UNLOCK_IF_ANY();
+#endif
+}
+
+bool image_texture_load_cached(struct texture_image *out_img,
+      const char *path, unsigned max_width, unsigned max_height)
+{
+   unsigned r_shift, g_shift, b_shift, a_shift;
+#ifdef IMAGE_TEXTURE_CACHE
+   char file[PATH_MAX_LENGTH];
+   struct stat src;
+   uint64_t key, size;
+   bool hit;
+#endif
+
+   image_texture_set_color_shifts(&r_shift, &g_shift, &b_shift,
+         &a_shift, out_img);
+
+#ifdef IMAGE_TEXTURE_CACHE
+   key     = image_texture_cache_key(path, max_width, max_height);
+   file[0] = '\0';
+
+   /* deinit may free the directory at any time, so work on a copy */
+   IMAGE_TEXTURE_CACHE_LOCK_IF_ANY();
+   if (image_texture_cache.dir)
+      image_texture_cache_file(file, sizeof(file),
+            image_texture_cache.dir, key);
+   IMAGE_TEXTURE_CACHE_UNLOCK_IF_ANY();
+
+   if (!file[0] || stat(path, &src) != 0)
+      return image_texture_load_file(out_img, path,
+            a_shift, r_shift, g_shift, b_shift, max_width, max_height);
+
+   IMAGE_TEXTURE_CACHE_LOCK();
+   if ((hit = image_texture_cache_map(out_img, file, path, &src,
+               max_width, max_height)))
+   {
+      struct image_texture_cache_entry *entry = image_texture_cache_find(key);
+      if (entry)
+         entry->used = (int64_t)time(NULL);
+   }
+   IMAGE_TEXTURE_CACHE_UNLOCK();
+
+   if (hit)
+   {
+      /* keeps the order of use for the next run */
+      utime(file, NULL);
+
+      image_texture_color_convert(r_shift, g_shift, b_shift,
+            a_shift, out_img);
+      return true;
+   }
+
+   /* Stored as decoded, and converted after */
+   if (!image_texture_load_file(out_img, path, 24, 16, 8, 0,
+            max_width, max_height))
+      return false;
+
+   if ((size = image_texture_cache_store(out_img, file, path, &src,
+               max_width, max_height)))
+   {
+      IMAGE_TEXTURE_CACHE_LOCK();
+      if (image_texture_cache.dir)
+         image_texture_cache_add(key, size, (int64_t)time(NULL));
+      IMAGE_TEXTURE_CACHE_UNLOCK();
+   }
+
+   image_texture_color_convert(r_shift, g_shift, b_shift,
+         a_shift, out_img);
+   return true;
+#else
+   return image_texture_load_file(out_img, path,
+         a_shift, r_shift, g_shift, b_shift, max_width, max_height);
+#endif
+}
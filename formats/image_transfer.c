@@ -36,6 +36,9 @@
 #ifdef HAVE_RBMP
 #include <formats/rbmp.h>
 #endif
+#ifdef HAVE_RQOI
+#include <formats/rqoi.h>
+#endif
 
 #include <formats/image.h>
 
@@ -65,6 +68,11 @@ void image_transfer_free(void *data, enum image_type_enum type)
       case IMAGE_TYPE_BMP:
 #ifdef HAVE_RBMP
          rbmp_free((rbmp_t*)data);
+#endif
+         break;
+      case IMAGE_TYPE_QOI:
+#ifdef HAVE_RQOI
+         rqoi_free((rqoi_t*)data);
 #endif
          break;
       case IMAGE_TYPE_NONE:
@@ -99,6 +107,12 @@ void *image_transfer_new(enum image_type_enum type)
          return rbmp_alloc();
 #else
          break;
+#endif
+      case IMAGE_TYPE_QOI:
+#ifdef HAVE_RQOI
+         return rqoi_alloc();
+#else
+         break;
 #endif
       default:
          break;
@@ -134,6 +148,12 @@ bool image_transfer_start(void *data, enum image_type_enum type)
 #endif
       case IMAGE_TYPE_BMP:
          return true;
+      case IMAGE_TYPE_QOI:
+#ifdef HAVE_RQOI
+         return true;
+#else
+         break;
+#endif
       case IMAGE_TYPE_NONE:
          break;
    }
@@ -167,6 +187,12 @@ bool image_transfer_is_valid(
 #endif
       case IMAGE_TYPE_BMP:
          return true;
+      case IMAGE_TYPE_QOI:
+#ifdef HAVE_RQOI
+         return true;
+#else
+         break;
+#endif
       case IMAGE_TYPE_NONE:
          break;
    }
@@ -200,6 +226,146 @@ void image_transfer_set_buffer_ptr(
       case IMAGE_TYPE_BMP:
 #ifdef HAVE_RBMP
          rbmp_set_buf_ptr((rbmp_t*)data, (uint8_t*)ptr);
+#endif
+         break;
+      case IMAGE_TYPE_QOI:
+#ifdef HAVE_RQOI
+         rqoi_set_buf_ptr((rqoi_t*)data, (uint8_t*)ptr);
+#endif
+         break;
+      case IMAGE_TYPE_NONE:
+         break;
+   }
+}
+
+void image_transfer_set_scale_target(
+      void *data,
+      enum image_type_enum type,
+      unsigned width,
+      unsigned height)
+{
+   switch (type)
+   {
+      case IMAGE_TYPE_JPEG:
+#ifdef HAVE_RJPEG
+         rjpeg_set_scale_target((rjpeg_t*)data, width, height);
+#endif
+         break;
+      default:
+         break;
+   }
+}
+
+bool image_transfer_get_size(void *data, enum image_type_enum type,
+      size_t len, unsigned *width, unsigned *height)
+{
+   switch (type)
+   {
+      case IMAGE_TYPE_JPEG:
+#ifdef HAVE_RJPEG
+         return rjpeg_get_size((rjpeg_t*)data, len, width, height);
+#else
+         break;
+#endif
+      case IMAGE_TYPE_TGA:
+#ifdef HAVE_RTGA
+         return rtga_get_size((rtga_t*)data, len, width, height);
+#else
+         break;
+#endif
+      case IMAGE_TYPE_BMP:
+#ifdef HAVE_RBMP
+         return rbmp_get_size((rbmp_t*)data, len, width, height);
+#else
+         break;
+#endif
+      case IMAGE_TYPE_QOI:
+#ifdef HAVE_RQOI
+         return rqoi_get_size((rqoi_t*)data, len, width, height);
+#else
+         break;
+#endif
+      case IMAGE_TYPE_PNG:
+      case IMAGE_TYPE_NONE:
+         break;
+   }
+
+   return false;
+}
+
+bool image_transfer_set_output(void *data, enum image_type_enum type,
+      const struct image_output *output)
+{
+   switch (type)
+   {
+      case IMAGE_TYPE_JPEG:
+#ifdef HAVE_RJPEG
+         rjpeg_set_output((rjpeg_t*)data, output);
+         return true;
+#else
+         break;
+#endif
+      case IMAGE_TYPE_TGA:
+#ifdef HAVE_RTGA
+         rtga_set_output((rtga_t*)data, output);
+         return true;
+#else
+         break;
+#endif
+      case IMAGE_TYPE_BMP:
+#ifdef HAVE_RBMP
+         rbmp_set_output((rbmp_t*)data, output);
+         return true;
+#else
+         break;
+#endif
+      case IMAGE_TYPE_QOI:
+#ifdef HAVE_RQOI
+         rqoi_set_output((rqoi_t*)data, output);
+         return true;
+#else
+         break;
+#endif
+      case IMAGE_TYPE_PNG:
+      case IMAGE_TYPE_NONE:
+         break;
+   }
+
+   return false;
+}
+
+void image_transfer_reset(void *data, enum image_type_enum type)
+{
+   switch (type)
+   {
+      case IMAGE_TYPE_PNG:
+#ifdef HAVE_RPNG
+         rpng_reset((rpng_t*)data);
+#endif
+         break;
+      case IMAGE_TYPE_JPEG:
+#ifdef HAVE_RJPEG
+         rjpeg_set_buf_ptr((rjpeg_t*)data, NULL);
+         rjpeg_set_scale_denom((rjpeg_t*)data, 1);
+         rjpeg_set_output((rjpeg_t*)data, NULL);
+#endif
+         break;
+      case IMAGE_TYPE_TGA:
+#ifdef HAVE_RTGA
+         rtga_set_buf_ptr((rtga_t*)data, NULL);
+         rtga_set_output((rtga_t*)data, NULL);
+#endif
+         break;
+      case IMAGE_TYPE_BMP:
+#ifdef HAVE_RBMP
+         rbmp_set_buf_ptr((rbmp_t*)data, NULL);
+         rbmp_set_output((rbmp_t*)data, NULL);
+#endif
+         break;
+      case IMAGE_TYPE_QOI:
+#ifdef HAVE_RQOI
+         rqoi_set_buf_ptr((rqoi_t*)data, NULL);
+         rqoi_set_output((rqoi_t*)data, NULL);
 #endif
          break;
       case IMAGE_TYPE_NONE:
@@ -243,6 +409,13 @@ int image_transfer_process(
                (void**)buf, len, width, height);
 #else
          break;
+#endif
+      case IMAGE_TYPE_QOI:
+#ifdef HAVE_RQOI
+         return rqoi_process_image((rqoi_t*)data,
+               (void**)buf, len, width, height);
+#else
+         break;
 #endif
       case IMAGE_TYPE_NONE:
          break;
@@ -276,6 +449,8 @@ bool image_transfer_iterate(void *data, enum image_type_enum type)
 #endif
       case IMAGE_TYPE_BMP:
          return false;
+      case IMAGE_TYPE_QOI:
+         return false;
       case IMAGE_TYPE_NONE:
          return false;
    }
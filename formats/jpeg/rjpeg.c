@@ -35,6 +35,12 @@
 #include <formats/rjpeg.h>
 #include <features/features_cpu.h>
 
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
+#include "../image_output.h"
+
 enum
 {
    RJPEG_DEFAULT = 0, /* only used for req_comp */
@@ -61,25 +67,28 @@ typedef struct
    uint8_t *line1;
    int hs,vs;   /* expansion factor in each axis */
    int w_lores; /* horizontal pixels pre-expansion */
+   int h_lores; /* vertical pixels pre-expansion */
    int ystep;   /* how far through vertical expansion we are */
    int ypos;    /* which pre-expansion row we're on */
 } rjpeg_resample;
 
+#ifdef HAVE_THREADS
+/* Restart intervals and output rows are split into at most this many
+ * bands, each done on its own thread... */
+#define RJPEG_MAX_BANDS 8
+/* ...as long as each band has at least this many pixels. */
+#define RJPEG_BAND_PIXELS (256 * 1024)
+#endif
+
 struct rjpeg
 {
    uint8_t *buff_data;
+   struct image_output output;
+   unsigned scale_denom;  /* largest downscale allowed: 1, 2, 4 or 8 */
+   unsigned scale_min_w;  /* smallest size the downscale may go to */
+   unsigned scale_min_h;
 };
 
-#ifdef _MSC_VER
-#define RJPEG_HAS_LROTL
-#endif
-
-#ifdef RJPEG_HAS_LROTL
-   #define RJPEG_LROT(x,y)  _lrotl(x,y)
-#else
-   #define RJPEG_LROT(x,y)  (((x) << (y)) | ((x) >> (32 - (y))))
-#endif
-
 /* x86/x64 detection */
 #if defined(__x86_64__) || defined(_M_X64)
 #define RJPEG_X64_TARGET
@@ -124,6 +133,20 @@ struct rjpeg
 
 #endif
 
+/* AVX2 kernels are built whenever the compiler can target AVX2, and
+ * only picked at runtime when the CPU has it */
+#if defined(__SSE2__) && !defined(RJPEG_NO_SIMD) && !defined(RJPEG_NO_AVX2) \
+   && (defined(__AVX2__) || (defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__))))
+#define RJPEG_AVX2
+#include <immintrin.h>
+
+#ifdef __AVX2__
+#define RJPEG_AVX2_TARGET
+#else
+#define RJPEG_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
 /* ARM NEON */
 #if defined(RJPEG_NO_SIMD) && defined(RJPEG_NEON)
 #undef RJPEG_NEON
@@ -169,6 +192,16 @@ static INLINE uint8_t rjpeg_get8(rjpeg_context *s)
 /* huffman decoding acceleration */
 #define FAST_BITS   9  /* larger handles more cases; smaller stomps less cache */
 
+/* the entropy-coded bits are kept left aligned in a buffer as wide as
+ * a native register, so 64-bit targets refill it half as often */
+#if defined(RJPEG_X64_TARGET) || defined(__aarch64__) || defined(_WIN64) || defined(__LP64__)
+typedef uint64_t rjpeg_bitbuf;
+#define RJPEG_BITBUF_BITS 64
+#else
+typedef uint32_t rjpeg_bitbuf;
+#define RJPEG_BITBUF_BITS 32
+#endif
+
 typedef struct
 {
    uint8_t  fast[1 << FAST_BITS];
@@ -203,15 +236,15 @@ typedef struct
       int dc_pred;
 
       int x,y,w2,h2;
+      int idct_w, idct_h;        /* 8, or 4/2/1 when decoding scaled */
       uint8_t *data;
       void *raw_data, *raw_coeff;
-      uint8_t *linebuf;
       short   *coeff;            /* progressive only */
       int      coeff_w;          /* number of 8x8 coefficient blocks */
       int      coeff_h;          /* number of 8x8 coefficient blocks */
    } img_comp[4];
 
-   uint32_t       code_buffer;   /* jpeg entropy-coded buffer */
+   rjpeg_bitbuf   code_buffer;   /* jpeg entropy-coded buffer */
    int            code_bits;     /* number of valid bits */
    unsigned char  marker;        /* marker seen while filling entropy buffer */
    int            nomore;        /* flag if we saw a marker so must stop */
@@ -226,8 +259,19 @@ typedef struct
    int scan_n, order[4];
    int restart_interval, todo;
 
+   /* with a two block IDCT, a block waits here for the next one */
+   RJPEG_SIMD_ALIGN(short, idct_pending[64]);
+   uint8_t *idct_pending_out;
+   int      idct_pending_stride;
+
+   /* decode-time downscale, 1 << scale_shift */
+   int scale_shift;
+   unsigned scale_min_w, scale_min_h;
+
    /* kernels */
    void (*idct_block_kernel)(uint8_t *out, int out_stride, short data[64]);
+   void (*idct_block_x2_kernel)(uint8_t *out0, int out0_stride, short *data0,
+         uint8_t *out1, int out1_stride, short *data1);
    void (*YCbCr_to_RGB_kernel)(uint8_t *out, const uint8_t *y, const uint8_t *pcb,
          const uint8_t *pcr, int count, int step);
    uint8_t *(*resample_row_hv_2_kernel)(uint8_t *out, uint8_t *in_near,
@@ -362,14 +406,11 @@ static void rjpeg_grow_buffer_unsafe(rjpeg_jpeg *j)
             return;
          }
       }
-      j->code_buffer |= b << (24 - j->code_bits);
+      j->code_buffer |= (rjpeg_bitbuf)b << (RJPEG_BITBUF_BITS - 8 - j->code_bits);
       j->code_bits   += 8;
-   } while (j->code_bits <= 24);
+   } while (j->code_bits <= RJPEG_BITBUF_BITS - 8);
 }
 
-/* (1 << n) - 1 */
-static uint32_t rjpeg_bmask[17]={0,1,3,7,15,31,63,127,255,511,1023,2047,4095,8191,16383,32767,65535};
-
 /* decode a JPEG huffman value from the bitstream */
 static INLINE int rjpeg_jpeg_huff_decode(rjpeg_jpeg *j, rjpeg_huffman *h)
 {
@@ -381,7 +422,7 @@ static INLINE int rjpeg_jpeg_huff_decode(rjpeg_jpeg *j, rjpeg_huffman *h)
 
    /* look at the top FAST_BITS and determine what symbol ID it is,
     * if the code is <= FAST_BITS */
-   c = (j->code_buffer >> (32 - FAST_BITS)) & ((1 << FAST_BITS)-1);
+   c = (int)(j->code_buffer >> (RJPEG_BITBUF_BITS - FAST_BITS));
    k = h->fast[c];
 
    if (k < 255)
@@ -400,7 +441,7 @@ static INLINE int rjpeg_jpeg_huff_decode(rjpeg_jpeg *j, rjpeg_huffman *h)
     * end; in other words, regardless of the number of bits, it
     * wants to be compared against something shifted to have 16;
     * that way we don't need to shift inside the loop. */
-   temp = j->code_buffer >> 16;
+   temp = (unsigned int)(j->code_buffer >> (RJPEG_BITBUF_BITS - 16));
    for (k=FAST_BITS+1 ; ; ++k)
       if (temp < h->maxcode[k])
          break;
@@ -416,8 +457,8 @@ static INLINE int rjpeg_jpeg_huff_decode(rjpeg_jpeg *j, rjpeg_huffman *h)
       return -1;
 
    /* convert the huffman code to the symbol id */
-   c = ((j->code_buffer >> (32 - k)) & rjpeg_bmask[k]) + h->delta[k];
-   retro_assert((((j->code_buffer) >> (32 - h->size[c])) & rjpeg_bmask[h->size[c]]) == h->code[c]);
+   c = (int)(j->code_buffer >> (RJPEG_BITBUF_BITS - k)) + h->delta[k];
+   retro_assert((j->code_buffer >> (RJPEG_BITBUF_BITS - h->size[c])) == h->code[c]);
 
    /* convert the id to a symbol */
    j->code_bits -= k;
@@ -437,11 +478,11 @@ static INLINE int rjpeg_extend_receive(rjpeg_jpeg *j, int n)
    if (j->code_bits < n)
       rjpeg_grow_buffer_unsafe(j);
 
-   sgn = (int32_t)j->code_buffer >> 31; /* sign bit is always in MSB */
-   k = RJPEG_LROT(j->code_buffer, n);
-   retro_assert(n >= 0 && n < (int) (sizeof(rjpeg_bmask)/sizeof(*rjpeg_bmask)));
-   j->code_buffer  = k & ~rjpeg_bmask[n];
-   k              &= rjpeg_bmask[n];
+   retro_assert(n > 0 && n <= 16);
+   /* sign bit is always in MSB */
+   sgn             = -(int)(j->code_buffer >> (RJPEG_BITBUF_BITS - 1));
+   k               = (unsigned int)(j->code_buffer >> (RJPEG_BITBUF_BITS - n));
+   j->code_buffer <<= n;
    j->code_bits   -= n;
    return k + (rjpeg_jbias[n] & ~sgn);
 }
@@ -452,23 +493,22 @@ static INLINE int rjpeg_jpeg_get_bits(rjpeg_jpeg *j, int n)
    unsigned int k;
    if (j->code_bits < n)
       rjpeg_grow_buffer_unsafe(j);
-   k              = RJPEG_LROT(j->code_buffer, n);
-   j->code_buffer = k & ~rjpeg_bmask[n];
-   k             &= rjpeg_bmask[n];
-   j->code_bits  -= n;
+   k               = (unsigned int)(j->code_buffer >> (RJPEG_BITBUF_BITS - n));
+   j->code_buffer <<= n;
+   j->code_bits   -= n;
    return k;
 }
 
 static INLINE int rjpeg_jpeg_get_bit(rjpeg_jpeg *j)
 {
-   unsigned int k;
+   int k;
    if (j->code_bits < 1)
       rjpeg_grow_buffer_unsafe(j);
 
-   k                = j->code_buffer;
+   k                = (int)(j->code_buffer >> (RJPEG_BITBUF_BITS - 1));
    j->code_buffer <<= 1;
    --j->code_bits;
-   return k & 0x80000000;
+   return k;
 }
 
 /* given a value that's at position X in the zigzag stream,
@@ -526,7 +566,7 @@ static int rjpeg_jpeg_decode_block(
       int c,r,s;
       if (j->code_bits < 16)
          rjpeg_grow_buffer_unsafe(j);
-      c = (j->code_buffer >> (32 - FAST_BITS)) & ((1 << FAST_BITS)-1);
+      c = (int)(j->code_buffer >> (RJPEG_BITBUF_BITS - FAST_BITS));
       r = fac[c];
       if (r)
       {
@@ -634,7 +674,7 @@ static int rjpeg_jpeg_decode_block_prog_ac(
          int c,r,s;
          if (j->code_bits < 16)
             rjpeg_grow_buffer_unsafe(j);
-         c = (j->code_buffer >> (32 - FAST_BITS)) & ((1 << FAST_BITS)-1);
+         c = (int)(j->code_buffer >> (RJPEG_BITBUF_BITS - FAST_BITS));
          r = fac[c];
          if (r)
          {
@@ -779,7 +819,7 @@ static INLINE uint8_t rjpeg_clamp(int x)
 {
    /* trick to use a single test to catch both cases */
    if ((unsigned int) x > 255)
-      return 255;
+      return x < 0 ? 0 : 255;
    return (uint8_t) x;
 }
 
@@ -898,6 +938,91 @@ static void rjpeg_idct_block(uint8_t *out, int out_stride, short data[64])
    }
 }
 
+/* Reduced IDCTs for decoding at 1/2, 1/4 and 1/8 scale. Each dimension
+ * takes the 8 coefficients and outputs only its low frequency 4, 2 or 1
+ * samples, as an IDCT of that size would (the 4 and 2 point ones are
+ * IJG's jidctred.c). The results come out scaled by 1 << (15 - log2(n)),
+ * so the two passes can be any mix of sizes, as subsampled planes need. */
+static void rjpeg_idct_1d_scaled(int *out, int out_step, const int *in, int n)
+{
+   switch (n)
+   {
+      case 8:
+         {
+            RJPEG_IDCT_1D(in[0],in[1],in[2],in[3],in[4],in[5],in[6],in[7]);
+            out[0*out_step] = x0+t3;
+            out[7*out_step] = x0-t3;
+            out[1*out_step] = x1+t2;
+            out[6*out_step] = x1-t2;
+            out[2*out_step] = x2+t1;
+            out[5*out_step] = x2-t1;
+            out[3*out_step] = x3+t0;
+            out[4*out_step] = x3-t0;
+         }
+         break;
+      case 4:
+         {
+            int t0  = in[0] * (1 << 13);
+            int t2  = in[2] * RJPEG_F2F(1.847759065f) - in[6] * RJPEG_F2F(0.765366865f);
+            int t10 = t0 + t2;
+            int t12 = t0 - t2;
+
+            t0      = - in[7] * RJPEG_F2F(0.211164243f) + in[5] * RJPEG_F2F(1.451774981f)
+                      - in[3] * RJPEG_F2F(2.172734803f) + in[1] * RJPEG_F2F(1.061594337f);
+            t2      = - in[7] * RJPEG_F2F(0.509795579f) - in[5] * RJPEG_F2F(0.601344887f)
+                      + in[3] * RJPEG_F2F(0.899976223f) + in[1] * RJPEG_F2F(2.562915447f);
+
+            out[0*out_step] = t10 + t2;
+            out[3*out_step] = t10 - t2;
+            out[1*out_step] = t12 + t0;
+            out[2*out_step] = t12 - t0;
+         }
+         break;
+      case 2:
+         {
+            int t10 = in[0] * (1 << 14);
+            int t0  = - in[7] * RJPEG_F2F(0.720959822f) + in[5] * RJPEG_F2F(0.850430095f)
+                      - in[3] * RJPEG_F2F(1.272758580f) + in[1] * RJPEG_F2F(3.624509785f);
+
+            out[0*out_step] = t10 + t0;
+            out[1*out_step] = t10 - t0;
+         }
+         break;
+      default:
+         out[0] = in[0] * (1 << 15);
+         break;
+   }
+}
+
+static void rjpeg_idct_block_scaled(uint8_t *out, int out_stride,
+      short data[64], int w, int h)
+{
+   int i, j, in[8], val[64], row[8];
+   int log_w     = w == 8 ? 3 : w >> 1;
+   int log_h     = h == 8 ? 3 : h >> 1;
+   int col_shift = 13 - log_h; /* keeping 2 extra bits */
+   int row_shift = 20 - log_w; /* those 2, the scale and the 1/8 */
+   int cols      = w == 1 ? 1 : 8;
+
+   /* columns, into the first h rows; one wide rows only need the first */
+   for (i = 0; i < cols; ++i)
+   {
+      for (j = 0; j < 8; ++j)
+         in[j] = data[j * 8 + i];
+      rjpeg_idct_1d_scaled(val + i, 8, in, h);
+      for (j = 0; j < h; ++j)
+         val[j * 8 + i] = (val[j * 8 + i] + (1 << (col_shift - 1))) >> col_shift;
+   }
+
+   for (j = 0; j < h; ++j, out += out_stride)
+   {
+      rjpeg_idct_1d_scaled(row, 1, val + j * 8, w);
+      for (i = 0; i < w; ++i)
+         out[i] = rjpeg_clamp((row[i] + (1 << (row_shift - 1))
+                  + (128 << row_shift)) >> row_shift);
+   }
+}
+
 #if defined(__SSE2__)
 /* sse2 integer IDCT. not the fastest possible implementation but it
  * produces bit-identical results to the generic C version so it's
@@ -1081,6 +1206,186 @@ static void rjpeg_idct_simd(uint8_t *out, int out_stride, short data[64])
 
 #endif
 
+#ifdef RJPEG_AVX2
+/* The SSE2 IDCT on two blocks at once, one in each 128-bit lane.
+ * Every step works within lanes, so the results are the same. */
+static RJPEG_AVX2_TARGET void rjpeg_idct_avx2_x2(
+      uint8_t *out0, int out0_stride, short *data0,
+      uint8_t *out1, int out1_stride, short *data1)
+{
+   __m256i row0, row1, row2, row3, row4, row5, row6, row7;
+   __m256i tmp;
+   int i;
+
+   #define dct_const(x,y)  _mm256_setr_epi16((x),(y),(x),(y),(x),(y),(x),(y), \
+         (x),(y),(x),(y),(x),(y),(x),(y))
+
+   #define dct_rot(out0,out1, x,y,c0,c1) \
+      __m256i c0##lo   = _mm256_unpacklo_epi16((x),(y)); \
+      __m256i c0##hi   = _mm256_unpackhi_epi16((x),(y)); \
+      __m256i out0##_l = _mm256_madd_epi16(c0##lo, c0); \
+      __m256i out0##_h = _mm256_madd_epi16(c0##hi, c0); \
+      __m256i out1##_l = _mm256_madd_epi16(c0##lo, c1); \
+      __m256i out1##_h = _mm256_madd_epi16(c0##hi, c1)
+
+   #define dct_widen(out, in) \
+      __m256i out##_l = _mm256_srai_epi32(_mm256_unpacklo_epi16(_mm256_setzero_si256(), (in)), 4); \
+      __m256i out##_h = _mm256_srai_epi32(_mm256_unpackhi_epi16(_mm256_setzero_si256(), (in)), 4)
+
+   #define dct_wadd(out, a, b) \
+      __m256i out##_l = _mm256_add_epi32(a##_l, b##_l); \
+      __m256i out##_h = _mm256_add_epi32(a##_h, b##_h)
+
+   #define dct_wsub(out, a, b) \
+      __m256i out##_l = _mm256_sub_epi32(a##_l, b##_l); \
+      __m256i out##_h = _mm256_sub_epi32(a##_h, b##_h)
+
+   #define dct_bfly32o(out0, out1, a,b,bias,s) \
+      { \
+         __m256i abiased_l = _mm256_add_epi32(a##_l, bias); \
+         __m256i abiased_h = _mm256_add_epi32(a##_h, bias); \
+         dct_wadd(sum, abiased, b); \
+         dct_wsub(dif, abiased, b); \
+         out0 = _mm256_packs_epi32(_mm256_srai_epi32(sum_l, s), _mm256_srai_epi32(sum_h, s)); \
+         out1 = _mm256_packs_epi32(_mm256_srai_epi32(dif_l, s), _mm256_srai_epi32(dif_h, s)); \
+      }
+
+   #define dct_interleave8(a, b) \
+      tmp = a; \
+      a = _mm256_unpacklo_epi8(a, b); \
+      b = _mm256_unpackhi_epi8(tmp, b)
+
+   #define dct_interleave16(a, b) \
+      tmp = a; \
+      a = _mm256_unpacklo_epi16(a, b); \
+      b = _mm256_unpackhi_epi16(tmp, b)
+
+   #define dct_pass(bias,shift) \
+      { \
+         /* even part */ \
+         dct_rot(t2e,t3e, row2,row6, rot0_0,rot0_1); \
+         __m256i sum04 = _mm256_add_epi16(row0, row4); \
+         __m256i dif04 = _mm256_sub_epi16(row0, row4); \
+         dct_widen(t0e, sum04); \
+         dct_widen(t1e, dif04); \
+         dct_wadd(x0, t0e, t3e); \
+         dct_wsub(x3, t0e, t3e); \
+         dct_wadd(x1, t1e, t2e); \
+         dct_wsub(x2, t1e, t2e); \
+         /* odd part */ \
+         dct_rot(y0o,y2o, row7,row3, rot2_0,rot2_1); \
+         dct_rot(y1o,y3o, row5,row1, rot3_0,rot3_1); \
+         __m256i sum17 = _mm256_add_epi16(row1, row7); \
+         __m256i sum35 = _mm256_add_epi16(row3, row5); \
+         dct_rot(y4o,y5o, sum17,sum35, rot1_0,rot1_1); \
+         dct_wadd(x4, y0o, y4o); \
+         dct_wadd(x5, y1o, y5o); \
+         dct_wadd(x6, y2o, y5o); \
+         dct_wadd(x7, y3o, y4o); \
+         dct_bfly32o(row0,row7, x0,x7,bias,shift); \
+         dct_bfly32o(row1,row6, x1,x6,bias,shift); \
+         dct_bfly32o(row2,row5, x2,x5,bias,shift); \
+         dct_bfly32o(row3,row4, x3,x4,bias,shift); \
+      }
+
+   /* row i of the first block in the low lane, of the second in the high */
+   #define dct_load(i) \
+      _mm256_inserti128_si256(_mm256_castsi128_si256( \
+            _mm_loadu_si128((const __m128i *) (data0 + (i)*8))), \
+            _mm_loadu_si128((const __m128i *) (data1 + (i)*8)), 1)
+
+   __m256i rot0_0 = dct_const(RJPEG_F2F(0.5411961f), RJPEG_F2F(0.5411961f) + RJPEG_F2F(-1.847759065f));
+   __m256i rot0_1 = dct_const(RJPEG_F2F(0.5411961f) + RJPEG_F2F( 0.765366865f), RJPEG_F2F(0.5411961f));
+   __m256i rot1_0 = dct_const(RJPEG_F2F(1.175875602f) + RJPEG_F2F(-0.899976223f), RJPEG_F2F(1.175875602f));
+   __m256i rot1_1 = dct_const(RJPEG_F2F(1.175875602f), RJPEG_F2F(1.175875602f) + RJPEG_F2F(-2.562915447f));
+   __m256i rot2_0 = dct_const(RJPEG_F2F(-1.961570560f) + RJPEG_F2F( 0.298631336f), RJPEG_F2F(-1.961570560f));
+   __m256i rot2_1 = dct_const(RJPEG_F2F(-1.961570560f), RJPEG_F2F(-1.961570560f) + RJPEG_F2F( 3.072711026f));
+   __m256i rot3_0 = dct_const(RJPEG_F2F(-0.390180644f) + RJPEG_F2F( 2.053119869f), RJPEG_F2F(-0.390180644f));
+   __m256i rot3_1 = dct_const(RJPEG_F2F(-0.390180644f), RJPEG_F2F(-0.390180644f) + RJPEG_F2F( 1.501321110f));
+
+   __m256i bias_0 = _mm256_set1_epi32(512);
+   __m256i bias_1 = _mm256_set1_epi32(65536 + (128<<17));
+
+   row0 = dct_load(0);
+   row1 = dct_load(1);
+   row2 = dct_load(2);
+   row3 = dct_load(3);
+   row4 = dct_load(4);
+   row5 = dct_load(5);
+   row6 = dct_load(6);
+   row7 = dct_load(7);
+
+   /* column pass */
+   dct_pass(bias_0, 10);
+
+   /* 16bit 8x8 transposes */
+   dct_interleave16(row0, row4);
+   dct_interleave16(row1, row5);
+   dct_interleave16(row2, row6);
+   dct_interleave16(row3, row7);
+
+   dct_interleave16(row0, row2);
+   dct_interleave16(row1, row3);
+   dct_interleave16(row4, row6);
+   dct_interleave16(row5, row7);
+
+   dct_interleave16(row0, row1);
+   dct_interleave16(row2, row3);
+   dct_interleave16(row4, row5);
+   dct_interleave16(row6, row7);
+
+   /* row pass */
+   dct_pass(bias_1, 17);
+
+   {
+      __m256i p0 = _mm256_packus_epi16(row0, row1);
+      __m256i p1 = _mm256_packus_epi16(row2, row3);
+      __m256i p2 = _mm256_packus_epi16(row4, row5);
+      __m256i p3 = _mm256_packus_epi16(row6, row7);
+      __m128i rows[8];
+
+      /* 8bit 8x8 transposes */
+      dct_interleave8(p0, p2);
+      dct_interleave8(p1, p3);
+
+      dct_interleave8(p0, p1);
+      dct_interleave8(p2, p3);
+
+      dct_interleave8(p0, p2);
+      dct_interleave8(p1, p3);
+
+      /* p0, p2, p1, p3 now hold output rows 0-1, 2-3, 4-5, 6-7 */
+      _mm256_storeu_si256((__m256i *) (rows + 0), p0);
+      _mm256_storeu_si256((__m256i *) (rows + 2), p2);
+      _mm256_storeu_si256((__m256i *) (rows + 4), p1);
+      _mm256_storeu_si256((__m256i *) (rows + 6), p3);
+
+      for (i = 0; i < 8; i += 2)
+      {
+         _mm_storel_epi64((__m128i *) out0, rows[i]);
+         out0 += out0_stride;
+         _mm_storel_epi64((__m128i *) out0, _mm_shuffle_epi32(rows[i], 0x4e));
+         out0 += out0_stride;
+         _mm_storel_epi64((__m128i *) out1, rows[i + 1]);
+         out1 += out1_stride;
+         _mm_storel_epi64((__m128i *) out1, _mm_shuffle_epi32(rows[i + 1], 0x4e));
+         out1 += out1_stride;
+      }
+   }
+
+#undef dct_const
+#undef dct_rot
+#undef dct_widen
+#undef dct_wadd
+#undef dct_wsub
+#undef dct_bfly32o
+#undef dct_interleave8
+#undef dct_interleave16
+#undef dct_pass
+#undef dct_load
+}
+#endif
+
 #ifdef RJPEG_NEON
 
 /* NEON integer IDCT. should produce bit-identical
@@ -1334,10 +1639,286 @@ static void rjpeg_jpeg_reset(rjpeg_jpeg *j)
     * since we don't even allow 1<<30 pixels */
 }
 
+/* IDCT block (bx, by) of component n into its plane, at its scale */
+static INLINE void rjpeg_idct_comp(rjpeg_jpeg *z, int n, int bx, int by,
+      short data[64])
+{
+   int w      = z->img_comp[n].idct_w;
+   int h      = z->img_comp[n].idct_h;
+   uint8_t *o = z->img_comp[n].data + z->img_comp[n].w2 * by * h + bx * w;
+
+   if (w != 8 || h != 8)
+      rjpeg_idct_block_scaled(o, z->img_comp[n].w2, data, w, h);
+   else if (!z->idct_block_x2_kernel)
+      z->idct_block_kernel(o, z->img_comp[n].w2, data);
+   else if (z->idct_pending_out)
+   {
+      z->idct_block_x2_kernel(z->idct_pending_out, z->idct_pending_stride,
+            z->idct_pending, o, z->img_comp[n].w2, data);
+      z->idct_pending_out = NULL;
+   }
+   else
+   {
+      memcpy(z->idct_pending, data, sizeof(z->idct_pending));
+      z->idct_pending_out    = o;
+      z->idct_pending_stride = z->img_comp[n].w2;
+   }
+}
+
+/* IDCT a block left waiting for a pair */
+static void rjpeg_idct_flush(rjpeg_jpeg *z)
+{
+   if (!z->idct_pending_out)
+      return;
+
+   z->idct_block_kernel(z->idct_pending_out, z->idct_pending_stride,
+         z->idct_pending);
+   z->idct_pending_out = NULL;
+}
+
+/* decode and IDCT MCU (i, j) of a baseline scan */
+static INLINE int rjpeg_decode_mcu(rjpeg_jpeg *z, int i, int j, short data[64])
+{
+   int k, x, y;
+
+   if (z->scan_n == 1)
+   {
+      int n  = z->order[0];
+      int ha = z->img_comp[n].ha;
+
+      if (!rjpeg_jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd,
+               z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq]))
+         return 0;
+
+      rjpeg_idct_comp(z, n, i, j, data);
+      return 1;
+   }
+
+   /* scan an interleaved MCU... process scan_n components in order */
+   for (k = 0; k < z->scan_n; ++k)
+   {
+      int n = z->order[k];
+      /* scan out an MCU's worth of this component; that's just determined
+       * by the basic H and V specified for the component */
+      for (y = 0; y < z->img_comp[n].v; ++y)
+      {
+         for (x = 0; x < z->img_comp[n].h; ++x)
+         {
+            int x2 = i*z->img_comp[n].h + x;
+            int y2 = j*z->img_comp[n].v + y;
+            int ha = z->img_comp[n].ha;
+
+            if (!rjpeg_jpeg_decode_block(z, data,
+                     z->huff_dc+z->img_comp[n].hd,
+                     z->huff_ac+ha, z->fast_ac[ha],
+                     n, z->dequant[z->img_comp[n].tq]))
+               return 0;
+
+            rjpeg_idct_comp(z, n, x2, y2, data);
+         }
+      }
+   }
+
+   return 1;
+}
+
+#ifdef HAVE_THREADS
+/* The entropy-coded data of one restart interval */
+typedef struct
+{
+   uint8_t *start;
+   uint8_t *end;
+} rjpeg_interval;
+
+/* A run of restart intervals, decoded with its own copy of the decoder */
+typedef struct
+{
+   rjpeg_jpeg z;
+   rjpeg_context s;
+   const rjpeg_interval *intervals;
+   int first, last;   /* intervals [first, last) */
+   int mcus, mcus_x;
+   int ok;
+   sthread_t *thread;
+} rjpeg_scan_band;
+
+/* Finds the entropy-coded data of each of the count restart intervals
+ * of the scan, and where the scan ends. Fails unless there are exactly
+ * that many, with their RSTn markers in order. */
+static bool rjpeg_index_restarts(rjpeg_context *s,
+      rjpeg_interval *intervals, int count, uint8_t **scan_end)
+{
+   uint8_t *p = s->img_buffer;
+   int k      = 0;
+
+   intervals[0].start = p;
+
+   for (;;)
+   {
+      uint8_t *ff = (uint8_t*)memchr(p, 0xff, s->img_buffer_end - p);
+      uint8_t *m;
+
+      if (!ff)
+         return false;
+
+      /* skip fill bytes */
+      for (m = ff + 1; m < s->img_buffer_end && *m == 0xff; m++);
+      if (m >= s->img_buffer_end)
+         return false;
+
+      p = m + 1;
+
+      if (*m == 0) /* stuffed 0xff */
+         continue;
+
+      intervals[k].end = ff;
+
+      if (!RJPEG_RESTART(*m))
+      {
+         /* left on the 0xff before the marker, as the serial
+          * decoder would be */
+         *scan_end = m - 1;
+         return k + 1 == count;
+      }
+
+      if ((*m & 7) != (k & 7) || ++k >= count)
+         return false;
+
+      intervals[k].start = p;
+   }
+}
+
+static void rjpeg_decode_scan_band(void *data)
+{
+   RJPEG_SIMD_ALIGN(short, block[64]);
+   rjpeg_scan_band *band = (rjpeg_scan_band*)data;
+   rjpeg_jpeg *z         = &band->z;
+   int k;
+
+   for (k = band->first; k < band->last; k++)
+   {
+      int m   = k * z->restart_interval;
+      int end = m + z->restart_interval < band->mcus
+         ? m + z->restart_interval : band->mcus;
+
+      /* past its end, an interval reads as zero bits */
+      band->s.img_buffer     = band->intervals[k].start;
+      band->s.img_buffer_end = band->intervals[k].end;
+      rjpeg_jpeg_reset(z);
+
+      for (; m < end; m++)
+      {
+         if (!rjpeg_decode_mcu(z, m % band->mcus_x, m / band->mcus_x, block))
+         {
+            rjpeg_idct_flush(z);
+            return;
+         }
+      }
+   }
+
+   rjpeg_idct_flush(z);
+   band->ok = 1;
+}
+
+/* Decodes the restart intervals of a baseline scan in bands on threads.
+ * Returns -1, having read nothing, when the scan is too small to split
+ * or its restart markers can't be found, so it's decoded serially. */
+static int rjpeg_parse_restart_intervals(rjpeg_jpeg *z)
+{
+   int i, count, num_bands, mcus, mcus_x;
+   rjpeg_interval *intervals = NULL;
+   rjpeg_scan_band *bands    = NULL;
+   uint8_t *scan_end         = NULL;
+   int ret                   = -1;
+
+   if (z->scan_n == 1)
+   {
+      int n  = z->order[0];
+      mcus_x = (z->img_comp[n].x+7) >> 3;
+      mcus   = mcus_x * ((z->img_comp[n].y+7) >> 3);
+   }
+   else
+   {
+      mcus_x = z->img_mcu_x;
+      mcus   = z->img_mcu_x * z->img_mcu_y;
+   }
+
+   count     = (mcus + z->restart_interval - 1) / z->restart_interval;
+   num_bands = (int)((uint64_t)z->s->img_x * z->s->img_y / RJPEG_BAND_PIXELS);
+   if (num_bands > RJPEG_MAX_BANDS)
+      num_bands = RJPEG_MAX_BANDS;
+   if (num_bands > count)
+      num_bands = count;
+   if (num_bands < 2)
+      return -1;
+
+   intervals = (rjpeg_interval*)malloc(count * sizeof(*intervals));
+   if (!intervals)
+      return -1;
+
+   if (!rjpeg_index_restarts(z->s, intervals, count, &scan_end))
+      goto end;
+
+   bands = (rjpeg_scan_band*)calloc(num_bands, sizeof(*bands));
+   if (!bands)
+      goto end;
+
+   for (i = 0; i < num_bands; i++)
+   {
+      rjpeg_scan_band *band = &bands[i];
+
+      memcpy(&band->z, z, sizeof(*z));
+      band->s         = *z->s;
+      band->z.s       = &band->s;
+      band->intervals = intervals;
+      band->first     = (int)((int64_t)count * i / num_bands);
+      band->last      = (int)((int64_t)count * (i + 1) / num_bands);
+      band->mcus      = mcus;
+      band->mcus_x    = mcus_x;
+   }
+
+   /* The last band is decoded on this thread, as are the others
+    * when threads can't be started. */
+   for (i = 0; i + 1 < num_bands; i++)
+   {
+      bands[i].thread = sthread_create(rjpeg_decode_scan_band, &bands[i]);
+      if (!bands[i].thread)
+         rjpeg_decode_scan_band(&bands[i]);
+   }
+   rjpeg_decode_scan_band(&bands[num_bands - 1]);
+
+   ret = 1;
+   for (i = 0; i < num_bands; i++)
+   {
+      if (bands[i].thread)
+         sthread_join(bands[i].thread);
+      if (!bands[i].ok)
+         ret = 0;
+   }
+
+   z->s->img_buffer = scan_end;
+   z->marker        = RJPEG_MARKER_NONE;
+
+end:
+   free(bands);
+   free(intervals);
+   return ret;
+}
+#endif
+
 static int rjpeg_parse_entropy_coded_data(rjpeg_jpeg *z)
 {
    rjpeg_jpeg_reset(z);
 
+#ifdef HAVE_THREADS
+   if (!z->progressive && z->restart_interval)
+   {
+      int ret = rjpeg_parse_restart_intervals(z);
+      if (ret >= 0)
+         return ret;
+   }
+#endif
+
    if (z->scan_n == 1)
    {
       int i, j;
@@ -1391,14 +1972,9 @@ static int rjpeg_parse_entropy_coded_data(rjpeg_jpeg *z)
          {
             for (i = 0; i < w; ++i)
             {
-               int ha = z->img_comp[n].ha;
-               if (!rjpeg_jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd,
-                        z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq]))
+               if (!rjpeg_decode_mcu(z, i, j, data))
                   return 0;
 
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8,
-                     z->img_comp[n].w2, data);
-
                /* every data block is an MCU, so countdown the restart interval */
                if (--z->todo <= 0)
                {
@@ -1466,31 +2042,8 @@ static int rjpeg_parse_entropy_coded_data(rjpeg_jpeg *z)
          {
             for (i = 0; i < z->img_mcu_x; ++i)
             {
-               /* scan an interleaved MCU... process scan_n components in order */
-               for (k = 0; k < z->scan_n; ++k)
-               {
-                  int n = z->order[k];
-                  /* scan out an MCU's worth of this component; that's just determined
-                   * by the basic H and V specified for the component */
-                  for (y = 0; y < z->img_comp[n].v; ++y)
-                  {
-                     for (x = 0; x < z->img_comp[n].h; ++x)
-                     {
-                        int x2 = (i*z->img_comp[n].h + x)*8;
-                        int y2 = (j*z->img_comp[n].v + y)*8;
-                        int ha = z->img_comp[n].ha;
-
-                        if (!rjpeg_jpeg_decode_block(z, data,
-                                 z->huff_dc+z->img_comp[n].hd,
-                                 z->huff_ac+ha, z->fast_ac[ha],
-                                 n, z->dequant[z->img_comp[n].tq]))
-                           return 0;
-
-                        z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2,
-                              z->img_comp[n].w2, data);
-                     }
-                  }
-               }
+               if (!rjpeg_decode_mcu(z, i, j, data))
+                  return 0;
 
                /* after all interleaved components, that's an interleaved MCU,
                 * so now count down the restart interval */
@@ -1535,11 +2088,12 @@ static void rjpeg_jpeg_finish(rjpeg_jpeg *z)
          {
             short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
             rjpeg_jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
-            z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8,
-                  z->img_comp[n].w2, data);
+            rjpeg_idct_comp(z, n, i, j, data);
          }
       }
    }
+
+   rjpeg_idct_flush(z);
 }
 
 static int rjpeg_process_marker(rjpeg_jpeg *z, int m)
@@ -1709,6 +2263,18 @@ static int rjpeg_process_scan_header(rjpeg_jpeg *z)
    return 1;
 }
 
+/* pick the downscale: the largest allowed one that still covers
+ * the requested size */
+static void rjpeg_pick_scale(rjpeg_jpeg *z)
+{
+   rjpeg_context *s = z->s;
+
+   while (z->scale_shift > 0
+         && (  ((s->img_x + (1 << z->scale_shift) - 1) >> z->scale_shift) < z->scale_min_w
+            || ((s->img_y + (1 << z->scale_shift) - 1) >> z->scale_shift) < z->scale_min_h))
+      z->scale_shift--;
+}
+
 static int rjpeg_process_frame_header(rjpeg_jpeg *z, int scan)
 {
    rjpeg_context *s = z->s;
@@ -1754,10 +2320,7 @@ static int rjpeg_process_frame_header(rjpeg_jpeg *z, int scan)
    s->img_n = c;
 
    for (i = 0; i < c; ++i)
-   {
       z->img_comp[i].data = NULL;
-      z->img_comp[i].linebuf = NULL;
-   }
 
    /* Bad SOF length. Corrupt JPEG? */
    if (Lf != 8+3*s->img_n)
@@ -1805,6 +2368,23 @@ static int rjpeg_process_frame_header(rjpeg_jpeg *z, int scan)
          v_max = z->img_comp[i].v;
    }
 
+   rjpeg_pick_scale(z);
+
+   for (i = 0; i < s->img_n; ++i)
+   {
+      int hs = h_max / z->img_comp[i].h;
+      int vs = v_max / z->img_comp[i].v;
+
+      /* subsampled planes keep more of their coefficients rather than
+       * being upsampled afterwards, as far as the scale allows */
+      z->img_comp[i].idct_w = 8 >> z->scale_shift;
+      z->img_comp[i].idct_h = 8 >> z->scale_shift;
+      for (; z->img_comp[i].idct_w < 8 && !(hs & 1); hs >>= 1)
+         z->img_comp[i].idct_w <<= 1;
+      for (; z->img_comp[i].idct_h < 8 && !(vs & 1); vs >>= 1)
+         z->img_comp[i].idct_h <<= 1;
+   }
+
    /* compute interleaved MCU info */
    z->img_h_max = h_max;
    z->img_v_max = v_max;
@@ -1825,8 +2405,8 @@ static int rjpeg_process_frame_header(rjpeg_jpeg *z, int scan)
           * the bogus oversized data from using interleaved MCUs and their
           * big blocks (e.g. a 16x16 iMCU on an image of width 33); we won't
           * discard the extra data until colorspace conversion */
-         z->img_comp[i].w2       = z->img_mcu_x * z->img_comp[i].h * 8;
-         z->img_comp[i].h2       = z->img_mcu_y * z->img_comp[i].v * 8;
+         z->img_comp[i].w2       = z->img_mcu_x * z->img_comp[i].h * z->img_comp[i].idct_w;
+         z->img_comp[i].h2       = z->img_mcu_y * z->img_comp[i].v * z->img_comp[i].idct_h;
          z->img_comp[i].raw_data = malloc(z->img_comp[i].w2 * z->img_comp[i].h2+15);
 
          /* Out of memory? */
@@ -1835,7 +2415,8 @@ static int rjpeg_process_frame_header(rjpeg_jpeg *z, int scan)
             for (--i; i >= 0; --i)
             {
                free(z->img_comp[i].raw_data);
-               z->img_comp[i].data = NULL;
+               z->img_comp[i].raw_data = NULL;
+               z->img_comp[i].data     = NULL;
             }
 
             return 0;
@@ -1843,9 +2424,8 @@ static int rjpeg_process_frame_header(rjpeg_jpeg *z, int scan)
 
          /* align blocks for IDCT using MMX/SSE */
          z->img_comp[i].data      = (uint8_t*) (((size_t) z->img_comp[i].raw_data + 15) & ~15);
-         z->img_comp[i].linebuf   = NULL;
-         z->img_comp[i].coeff_w   = (z->img_comp[i].w2 + 7) >> 3;
-         z->img_comp[i].coeff_h   = (z->img_comp[i].h2 + 7) >> 3;
+         z->img_comp[i].coeff_w   = z->img_mcu_x * z->img_comp[i].h;
+         z->img_comp[i].coeff_h   = z->img_mcu_y * z->img_comp[i].v;
          z->img_comp[i].raw_coeff = malloc(z->img_comp[i].coeff_w *
                                     z->img_comp[i].coeff_h * 64 * sizeof(short) + 15);
          z->img_comp[i].coeff     = (short*) (((size_t) z->img_comp[i].raw_coeff + 15) & ~15);
@@ -1863,8 +2443,8 @@ static int rjpeg_process_frame_header(rjpeg_jpeg *z, int scan)
           * the bogus oversized data from using interleaved MCUs and their
           * big blocks (e.g. a 16x16 iMCU on an image of width 33); we won't
           * discard the extra data until colorspace conversion */
-         z->img_comp[i].w2       = z->img_mcu_x * z->img_comp[i].h * 8;
-         z->img_comp[i].h2       = z->img_mcu_y * z->img_comp[i].v * 8;
+         z->img_comp[i].w2       = z->img_mcu_x * z->img_comp[i].h * z->img_comp[i].idct_w;
+         z->img_comp[i].h2       = z->img_mcu_y * z->img_comp[i].v * z->img_comp[i].idct_h;
          z->img_comp[i].raw_data = malloc(z->img_comp[i].w2 * z->img_comp[i].h2+15);
 
          /* Out of memory? */
@@ -1873,13 +2453,15 @@ static int rjpeg_process_frame_header(rjpeg_jpeg *z, int scan)
             for (--i; i >= 0; --i)
             {
                free(z->img_comp[i].raw_data);
-               z->img_comp[i].data = NULL;
+               z->img_comp[i].raw_data = NULL;
+               z->img_comp[i].data     = NULL;
             }
+
+            return 0;
          }
 
          /* align blocks for IDCT using MMX/SSE */
          z->img_comp[i].data      = (uint8_t*) (((size_t) z->img_comp[i].raw_data + 15) & ~15);
-         z->img_comp[i].linebuf   = NULL;
          z->img_comp[i].coeff     = 0;
          z->img_comp[i].raw_coeff = 0;
       }
@@ -1946,6 +2528,7 @@ static int rjpeg_decode_jpeg_image(rjpeg_jpeg *j)
             return 0;
          if (!rjpeg_parse_entropy_coded_data(j))
             return 0;
+         rjpeg_idct_flush(j);
 
          if (j->marker == RJPEG_MARKER_NONE )
          {
@@ -2221,15 +2804,9 @@ static void rjpeg_YCbCr_to_RGB_row(uint8_t *out, const uint8_t *y,
       r >>= 20;
       g >>= 20;
       b >>= 20;
-      if ((unsigned) r > 255)
-         r = 255;
-      if ((unsigned) g > 255)
-         g = 255;
-      if ((unsigned) b > 255)
-         b = 255;
-      out[0] = (uint8_t)r;
-      out[1] = (uint8_t)g;
-      out[2] = (uint8_t)b;
+      out[0] = rjpeg_clamp(r);
+      out[1] = rjpeg_clamp(g);
+      out[2] = rjpeg_clamp(b);
       out[3] = 255;
       out += step;
    }
@@ -2365,21 +2942,130 @@ static void rjpeg_YCbCr_to_RGB_simd(uint8_t *out, const uint8_t *y,
       r >>= 20;
       g >>= 20;
       b >>= 20;
-      if ((unsigned) r > 255)
-         r = 255;
-      if ((unsigned) g > 255)
-         g = 255;
-      if ((unsigned) b > 255)
-         b = 255;
-      out[0] = (uint8_t)r;
-      out[1] = (uint8_t)g;
-      out[2] = (uint8_t)b;
+      out[0] = rjpeg_clamp(r);
+      out[1] = rjpeg_clamp(g);
+      out[2] = rjpeg_clamp(b);
       out[3] = 255;
       out += step;
    }
 }
 #endif
 
+#ifdef RJPEG_AVX2
+/* The SSE2 version, 16 pixels at a time; same results */
+static RJPEG_AVX2_TARGET uint8_t *rjpeg_resample_row_hv_2_avx2(uint8_t *out,
+      uint8_t *in_near, uint8_t *in_far, int w, int hs)
+{
+   int i = 0,t0,t1;
+
+   if (w == 1)
+   {
+      out[0] = out[1] = RJPEG_DIV4(3*in_near[0] + in_far[0] + 2);
+      return out;
+   }
+
+   t1 = 3*in_near[0] + in_far[0];
+   for (; i < ((w-1) & ~15); i += 16)
+   {
+      /* vertical pass, 3*x + y = 4*x + (y - x) */
+      __m256i farw  = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_far + i)));
+      __m256i nearw = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_near + i)));
+      __m256i curr  = _mm256_add_epi16(_mm256_slli_epi16(nearw, 2),
+            _mm256_sub_epi16(farw, nearw));
+
+      /* the row shifted by a pixel each way, across the lanes */
+      __m256i prv0  = _mm256_alignr_epi8(curr,
+            _mm256_permute2x128_si256(curr, curr, 0x08), 14);
+      __m256i nxt0  = _mm256_alignr_epi8(
+            _mm256_permute2x128_si256(curr, curr, 0x81), curr, 2);
+      __m256i prev  = _mm256_insert_epi16(prv0, t1, 0);
+      __m256i next  = _mm256_insert_epi16(nxt0, 3*in_near[i+16] + in_far[i+16], 15);
+
+      /* even pixels = cur*4 + (prev - cur), odd pixels = cur*4 + (next - cur) */
+      __m256i curb  = _mm256_add_epi16(_mm256_slli_epi16(curr, 2), _mm256_set1_epi16(8));
+      __m256i even  = _mm256_add_epi16(_mm256_sub_epi16(prev, curr), curb);
+      __m256i odd   = _mm256_add_epi16(_mm256_sub_epi16(next, curr), curb);
+
+      /* interleaving within lanes keeps pixels 0-7 in the low lane */
+      __m256i de0   = _mm256_srli_epi16(_mm256_unpacklo_epi16(even, odd), 4);
+      __m256i de1   = _mm256_srli_epi16(_mm256_unpackhi_epi16(even, odd), 4);
+      _mm256_storeu_si256((__m256i *) (out + i*2), _mm256_packus_epi16(de0, de1));
+
+      t1 = 3*in_near[i+15] + in_far[i+15];
+   }
+
+   t0       = t1;
+   t1       = 3*in_near[i] + in_far[i];
+   out[i*2] = RJPEG_DIV16(3*t1 + t0 + 8);
+
+   for (++i; i < w; ++i)
+   {
+      t0         = t1;
+      t1         = 3*in_near[i]+in_far[i];
+      out[i*2-1] = RJPEG_DIV16(3*t0 + t1 + 8);
+      out[i*2  ] = RJPEG_DIV16(3*t1 + t0 + 8);
+   }
+   out[w*2-1]    = RJPEG_DIV4(t1+2);
+
+   (void)hs;
+
+   return out;
+}
+
+/* The SSE2 version, 16 pixels at a time; same results */
+static RJPEG_AVX2_TARGET void rjpeg_YCbCr_to_RGB_avx2(uint8_t *out,
+      const uint8_t *y, const uint8_t *pcb, const uint8_t *pcr, int count, int step)
+{
+   int i = 0;
+
+   if (step == 4)
+   {
+      __m256i bias128   = _mm256_set1_epi16(128);
+      __m256i cr_const0 = _mm256_set1_epi16(   (short) ( 1.40200f*4096.0f+0.5f));
+      __m256i cr_const1 = _mm256_set1_epi16( - (short) ( 0.71414f*4096.0f+0.5f));
+      __m256i cb_const0 = _mm256_set1_epi16( - (short) ( 0.34414f*4096.0f+0.5f));
+      __m256i cb_const1 = _mm256_set1_epi16(   (short) ( 1.77200f*4096.0f+0.5f));
+      __m256i xw        = _mm256_set1_epi16(255); /* alpha channel */
+
+      for (; i+15 < count; i += 16)
+      {
+         /* y << 8 | 128 and (c - 128) << 8, as the SSE2 unpacks give */
+         __m256i yw  = _mm256_or_si256(_mm256_slli_epi16(_mm256_cvtepu8_epi16(
+                     _mm_loadu_si128((const __m128i *) (y + i))), 8), bias128);
+         __m256i crw = _mm256_slli_epi16(_mm256_sub_epi16(_mm256_cvtepu8_epi16(
+                     _mm_loadu_si128((const __m128i *) (pcr + i))), bias128), 8);
+         __m256i cbw = _mm256_slli_epi16(_mm256_sub_epi16(_mm256_cvtepu8_epi16(
+                     _mm_loadu_si128((const __m128i *) (pcb + i))), bias128), 8);
+
+         /* color transform */
+         __m256i yws = _mm256_srli_epi16(yw, 4);
+         __m256i rws = _mm256_add_epi16(_mm256_mulhi_epi16(cr_const0, crw), yws);
+         __m256i gwt = _mm256_add_epi16(_mm256_mulhi_epi16(cb_const0, cbw), yws);
+         __m256i bws = _mm256_add_epi16(yws, _mm256_mulhi_epi16(cbw, cb_const1));
+         __m256i gws = _mm256_add_epi16(gwt, _mm256_mulhi_epi16(crw, cr_const1));
+
+         /* descale, back to bytes and interleave; that leaves pixels
+          * 0-3 and 8-11 in o0, 4-7 and 12-15 in o1 */
+         __m256i brb = _mm256_packus_epi16(_mm256_srai_epi16(rws, 4), _mm256_srai_epi16(bws, 4));
+         __m256i gxb = _mm256_packus_epi16(_mm256_srai_epi16(gws, 4), xw);
+         __m256i t0  = _mm256_unpacklo_epi8(brb, gxb);
+         __m256i t1  = _mm256_unpackhi_epi8(brb, gxb);
+         __m256i o0  = _mm256_unpacklo_epi16(t0, t1);
+         __m256i o1  = _mm256_unpackhi_epi16(t0, t1);
+
+         _mm256_storeu_si256((__m256i *) (out + 0),
+               _mm256_permute2x128_si256(o0, o1, 0x20));
+         _mm256_storeu_si256((__m256i *) (out + 32),
+               _mm256_permute2x128_si256(o0, o1, 0x31));
+         out += 64;
+      }
+   }
+
+   /* the rest, eight at a time */
+   rjpeg_YCbCr_to_RGB_simd(out, y + i, pcb + i, pcr + i, count - i, step);
+}
+#endif
+
 /* set up the kernels */
 static void rjpeg_setup_jpeg(rjpeg_jpeg *j)
 {
@@ -2388,6 +3074,8 @@ static void rjpeg_setup_jpeg(rjpeg_jpeg *j)
    (void)mask;
 
    j->idct_block_kernel        = rjpeg_idct_block;
+   j->idct_block_x2_kernel     = NULL;
+   j->idct_pending_out         = NULL;
    j->YCbCr_to_RGB_kernel      = rjpeg_YCbCr_to_RGB_row;
    j->resample_row_hv_2_kernel = rjpeg_resample_row_hv_2;
 
@@ -2400,6 +3088,16 @@ static void rjpeg_setup_jpeg(rjpeg_jpeg *j)
    }
 #endif
 
+#ifdef RJPEG_AVX2
+   /* the CPU may report AVX2 without the OS enabling AVX state */
+   if ((mask & (RETRO_SIMD_AVX | RETRO_SIMD_AVX2)) == (RETRO_SIMD_AVX | RETRO_SIMD_AVX2))
+   {
+      j->idct_block_x2_kernel     = rjpeg_idct_avx2_x2;
+      j->YCbCr_to_RGB_kernel      = rjpeg_YCbCr_to_RGB_avx2;
+      j->resample_row_hv_2_kernel = rjpeg_resample_row_hv_2_avx2;
+   }
+#endif
+
 #ifdef RJPEG_NEON
    j->idct_block_kernel           = rjpeg_idct_simd;
    j->YCbCr_to_RGB_kernel         = rjpeg_YCbCr_to_RGB_simd;
@@ -2426,53 +3124,120 @@ static void rjpeg_cleanup_jpeg(rjpeg_jpeg *j)
          j->img_comp[i].raw_coeff = 0;
          j->img_comp[i].coeff = 0;
       }
+   }
+}
+
+/* step a resampler on to the next output row */
+static INLINE void rjpeg_resample_next(rjpeg_resample *r, int w2)
+{
+   if (++r->ystep >= r->vs)
+   {
+      r->ystep = 0;
+      r->line0 = r->line1;
+      if (++r->ypos < r->h_lores)
+         r->line1 += w2;
+   }
+}
+
+/* A run of output rows, resampled and colour converted on its own */
+typedef struct
+{
+   rjpeg_jpeg *z;
+   rjpeg_resample res_comp[4];
+   uint8_t *linebuf;          /* decode_n lines of img_x + 3 */
+   uint8_t *rgba;             /* a row of R, G, B, A, unless built in place */
+   const struct image_output *output;
+   unsigned first, last;      /* rows [first, last) */
+   unsigned img_x;
+   int decode_n;
+#ifdef HAVE_THREADS
+   sthread_t *thread;
+#endif
+} rjpeg_convert_band;
+
+static void rjpeg_convert_rows(void *data)
+{
+   unsigned i, j;
+   int k;
+   uint8_t *coutput[4]      = {0};
+   rjpeg_convert_band *band = (rjpeg_convert_band*)data;
+   rjpeg_jpeg *z            = band->z;
+   unsigned img_x           = band->img_x;
+
+   for (j = band->first; j < band->last; ++j)
+   {
+      uint8_t *y;
+      uint8_t *out = band->rgba ? band->rgba : image_output_row(band->output, j);
 
-      if (j->img_comp[i].linebuf)
+      for (k = 0; k < band->decode_n; ++k)
       {
-         free(j->img_comp[i].linebuf);
-         j->img_comp[i].linebuf = NULL;
+         rjpeg_resample *r = &band->res_comp[k];
+         int         y_bot  = r->ystep >= (r->vs >> 1);
+
+         coutput[k]         = r->resample(band->linebuf + k * (img_x + 3),
+               y_bot ? r->line1 : r->line0,
+               y_bot ? r->line0 : r->line1,
+               r->w_lores, r->hs);
+
+         rjpeg_resample_next(r, z->img_comp[k].w2);
       }
+
+      y = coutput[0];
+      if (z->s->img_n == 3)
+         z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], img_x, 4);
+      else
+         for (i = 0; i < img_x; ++i)
+         {
+            out[i * 4 + 0] = out[i * 4 + 1] = out[i * 4 + 2] = y[i];
+            out[i * 4 + 3] = 255;
+         }
+
+      /* Rows go out in the caller's format while still in cache */
+      if (band->rgba)
+         image_output_write_rgba(band->output, j, band->rgba, img_x);
    }
 }
 
-static uint8_t *rjpeg_load_jpeg_image(rjpeg_jpeg *z,
-      unsigned *out_x, unsigned *out_y, int *comp, int req_comp)
+/* Decodes to R, G, B, A, written to output in its format */
+static bool rjpeg_load_jpeg_image(rjpeg_jpeg *z,
+      struct image_output *output, unsigned *out_x, unsigned *out_y)
 {
-   int n, decode_n;
+   int decode_n;
    int k;
    unsigned int i,j;
+   unsigned int img_x, img_y;
    rjpeg_resample res_comp[4];
-   uint8_t *coutput[4] = {0};
-   uint8_t *output     = NULL;
-   z->s->img_n         = 0;
+   size_t linebuf_size;
+   rjpeg_convert_band *bands = NULL;
+   unsigned num_bands        = 1;
+   bool allocated            = false;
+   bool in_place             = image_output_is_rgba(output);
+   z->s->img_n               = 0;
 
    /* load a jpeg image from whichever source, but leave in YCbCr format */
    if (!rjpeg_decode_jpeg_image(z))
       goto error;
 
-   /* determine actual number of components to generate */
-   n = req_comp ? req_comp : z->s->img_n;
+   decode_n = z->s->img_n;
 
-   if (z->s->img_n == 3 && n < 3)
-      decode_n = 1;
-   else
-      decode_n = z->s->img_n;
+   /* output size, rounded up when decoding scaled */
+   img_x = (z->s->img_x + (1 << z->scale_shift) - 1) >> z->scale_shift;
+   img_y = (z->s->img_y + (1 << z->scale_shift) - 1) >> z->scale_shift;
 
    /* resample and color-convert */
    for (k = 0; k < decode_n; ++k)
    {
       rjpeg_resample *r = &res_comp[k];
 
-      /* allocate line buffer big enough for upsampling off the edges
-       * with upsample factor of 4 */
-      z->img_comp[k].linebuf = (uint8_t *) malloc(z->s->img_x + 3);
-      if (!z->img_comp[k].linebuf)
-         goto error;
-
-      r->hs       = z->img_h_max / z->img_comp[k].h;
-      r->vs       = z->img_v_max / z->img_comp[k].v;
+      /* a plane decoded with a larger IDCT than the scale needs
+       * has that much less to upsample */
+      r->hs       = z->img_h_max / z->img_comp[k].h
+                  / (z->img_comp[k].idct_w / (8 >> z->scale_shift));
+      r->vs       = z->img_v_max / z->img_comp[k].v
+                  / (z->img_comp[k].idct_h / (8 >> z->scale_shift));
       r->ystep    = r->vs >> 1;
-      r->w_lores  = (z->s->img_x + r->hs-1) / r->hs;
+      r->w_lores  = (img_x + r->hs-1) / r->hs;
+      r->h_lores  = (z->img_comp[k].y * z->img_comp[k].idct_h + 7) >> 3;
       r->ypos     = 0;
       r->line0    = r->line1 = z->img_comp[k].data;
       r->resample = rjpeg_resample_row_generic;
@@ -2487,77 +3252,104 @@ static uint8_t *rjpeg_load_jpeg_image(rjpeg_jpeg *z,
          r->resample = z->resample_row_hv_2_kernel;
    }
 
-   /* can't error after this so, this is safe */
-   output = (uint8_t *) malloc(n * z->s->img_x * z->s->img_y + 1);
+#ifdef HAVE_THREADS
+   num_bands = (unsigned)((uint64_t)img_x * img_y / RJPEG_BAND_PIXELS);
+   if (num_bands > RJPEG_MAX_BANDS)
+      num_bands = RJPEG_MAX_BANDS;
+   if (num_bands > img_y)
+      num_bands = img_y;
+   if (num_bands < 1)
+      num_bands = 1;
+#endif
 
-   if (!output)
+   bands = (rjpeg_convert_band*)calloc(num_bands, sizeof(*bands));
+   if (!bands)
       goto error;
 
-   /* now go ahead and resample */
-   for (j = 0; j < z->s->img_y; ++j)
+   /* line buffers big enough for upsampling off the edges
+    * with upsample factor of 4, then the converted row */
+   linebuf_size = decode_n * (img_x + 3) + (in_place ? 0 : img_x * 4);
+
+   for (i = 0; i < num_bands; i++)
    {
-      uint8_t *out = output + n * z->s->img_x * j;
+      rjpeg_convert_band *band = &bands[i];
+
+      band->z        = z;
+      band->first    = (unsigned)((uint64_t)img_y * i / num_bands);
+      band->last     = (unsigned)((uint64_t)img_y * (i + 1) / num_bands);
+      band->img_x    = img_x;
+      band->decode_n = decode_n;
+      band->output   = output;
+      band->linebuf  = (uint8_t*)malloc(linebuf_size);
+      if (!band->linebuf)
+         goto error;
+      if (!in_place)
+         band->rgba  = band->linebuf + decode_n * (img_x + 3);
+
+      /* each band picks the resamplers up at its first row */
       for (k = 0; k < decode_n; ++k)
       {
-         rjpeg_resample *r = &res_comp[k];
-         int         y_bot  = r->ystep >= (r->vs >> 1);
-
-         coutput[k]         = r->resample(z->img_comp[k].linebuf,
-               y_bot ? r->line1 : r->line0,
-               y_bot ? r->line0 : r->line1,
-               r->w_lores, r->hs);
-
-         if (++r->ystep >= r->vs)
-         {
-            r->ystep = 0;
-            r->line0 = r->line1;
-            if (++r->ypos < z->img_comp[k].y)
-               r->line1 += z->img_comp[k].w2;
-         }
+         band->res_comp[k] = res_comp[k];
+         for (j = 0; j < band->first; ++j)
+            rjpeg_resample_next(&band->res_comp[k], z->img_comp[k].w2);
       }
+   }
 
-      if (n >= 3)
-      {
-         uint8_t *y = coutput[0];
-         if (y)
-         {
-            if (z->s->img_n == 3)
-               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-            else
-               for (i = 0; i < z->s->img_x; ++i)
-               {
-                  out[0]  = out[1] = out[2] = y[i];
-                  out[3]  = 255; /* not used if n==3 */
-                  out    += n;
-               }
-         }
-      }
-      else
-      {
-         uint8_t *y = coutput[0];
-         if (n == 1)
-            for (i = 0; i < z->s->img_x; ++i)
-               out[i] = y[i];
-         else
-            for (i = 0; i < z->s->img_x; ++i)
-            {
-               *out++ = y[i];
-               *out++ = 255;
-            }
-      }
+   /* can't error after this so, this is safe */
+   if (!image_output_begin(output, img_x, img_y, &allocated))
+      goto error;
+
+   /* The last band is converted on this thread, as are the others
+    * when threads can't be started. */
+   for (i = 0; i + 1 < num_bands; i++)
+   {
+#ifdef HAVE_THREADS
+      bands[i].thread = sthread_create(rjpeg_convert_rows, &bands[i]);
+      if (!bands[i].thread)
+#endif
+         rjpeg_convert_rows(&bands[i]);
    }
+   rjpeg_convert_rows(&bands[num_bands - 1]);
 
-   rjpeg_cleanup_jpeg(z);
-   *out_x = z->s->img_x;
-   *out_y = z->s->img_y;
+#ifdef HAVE_THREADS
+   for (i = 0; i + 1 < num_bands; i++)
+      if (bands[i].thread)
+         sthread_join(bands[i].thread);
+#endif
 
-   if (comp)
-      *comp  = z->s->img_n; /* report original components, not output */
-   return output;
+   for (i = 0; i < num_bands; i++)
+      free(bands[i].linebuf);
+   free(bands);
+   rjpeg_cleanup_jpeg(z);
+   *out_x = img_x;
+   *out_y = img_y;
+   return true;
 
 error:
+   if (bands)
+   {
+      for (i = 0; i < num_bands; i++)
+         free(bands[i].linebuf);
+      free(bands);
+   }
    rjpeg_cleanup_jpeg(z);
-   return NULL;
+   return false;
+}
+
+static void rjpeg_init_context(rjpeg_t *rjpeg, rjpeg_jpeg *j,
+      rjpeg_context *s, size_t size)
+{
+   s->img_buffer          = (uint8_t*)rjpeg->buff_data;
+   s->img_buffer_original = (uint8_t*)rjpeg->buff_data;
+   s->img_buffer_end      = (uint8_t*)rjpeg->buff_data + (int)size;
+
+   j->s                   = s;
+   j->scale_shift         = 0;
+   j->scale_min_w         = rjpeg->scale_min_w;
+   j->scale_min_h         = rjpeg->scale_min_h;
+
+   while ((1u << j->scale_shift) < rjpeg->scale_denom && j->scale_shift < 3)
+      j->scale_shift++;
 }
 
 int rjpeg_process_image(rjpeg_t *rjpeg, void **buf_data,
@@ -2565,52 +3357,53 @@ int rjpeg_process_image(rjpeg_t *rjpeg, void **buf_data,
 {
    rjpeg_jpeg j;
    rjpeg_context s;
-   int comp;
-   uint32_t *img         = NULL;
-   uint32_t *pixels      = NULL;
-   unsigned size_tex     = 0;
+   struct image_output output;
 
    if (!rjpeg)
       return IMAGE_PROCESS_ERROR;
 
-   s.img_buffer          = (uint8_t*)rjpeg->buff_data;
-   s.img_buffer_original = (uint8_t*)rjpeg->buff_data;
-   s.img_buffer_end      = (uint8_t*)rjpeg->buff_data + (int)size;
+   output = rjpeg->output;
+   rjpeg_init_context(rjpeg, &j, &s, size);
+   rjpeg_setup_jpeg(&j);
 
-   j.s                   = &s;
+   if (!rjpeg_load_jpeg_image(&j, &output, width, height))
+      return IMAGE_PROCESS_ERROR;
 
-   rjpeg_setup_jpeg(&j);
+   *buf_data = output.data;
 
-   img                   =  (uint32_t*)rjpeg_load_jpeg_image(&j, width, height, &comp, 4);
+   return IMAGE_PROCESS_END;
+}
 
-   if (!img)
-      return IMAGE_PROCESS_ERROR;
+bool rjpeg_get_size(rjpeg_t *rjpeg, size_t size,
+      unsigned *width, unsigned *height)
+{
+   rjpeg_jpeg j;
+   rjpeg_context s;
 
-   size_tex = (*width) * (*height);
-   pixels   = (uint32_t*)malloc(size_tex * sizeof(uint32_t));
+   if (!rjpeg || !rjpeg->buff_data)
+      return false;
 
-   if (!pixels)
-   {
-      free(img);
-      return IMAGE_PROCESS_ERROR;
-   }
+   rjpeg_init_context(rjpeg, &j, &s, size);
+   rjpeg_setup_jpeg(&j);
 
-   *buf_data = pixels;
+   if (!rjpeg_decode_jpeg_header(&j, RJPEG_SCAN_HEADER))
+      return false;
 
-   /* Convert RGBA to ARGB */
-   while (size_tex--)
-   {
-      unsigned int texel = img[size_tex];
-      unsigned int A     = texel & 0xFF000000;
-      unsigned int B     = texel & 0x00FF0000;
-      unsigned int G     = texel & 0x0000FF00;
-      unsigned int R     = texel & 0x000000FF;
-      ((unsigned int*)pixels)[size_tex] = A | (R << 16) | G | (B >> 16);
-   }
+   rjpeg_pick_scale(&j);
+   *width  = (s.img_x + (1 << j.scale_shift) - 1) >> j.scale_shift;
+   *height = (s.img_y + (1 << j.scale_shift) - 1) >> j.scale_shift;
+   return true;
+}
 
-   free(img);
+void rjpeg_set_output(rjpeg_t *rjpeg, const struct image_output *output)
+{
+   if (!rjpeg)
+      return;
 
-   return IMAGE_PROCESS_END;
+   if (output)
+      rjpeg->output = *output;
+   else
+      memset(&rjpeg->output, 0, sizeof(rjpeg->output));
 }
 
 bool rjpeg_set_buf_ptr(rjpeg_t *rjpeg, void *data)
@@ -2623,6 +3416,26 @@ bool rjpeg_set_buf_ptr(rjpeg_t *rjpeg, void *data)
    return true;
 }
 
+void rjpeg_set_scale_denom(rjpeg_t *rjpeg, unsigned denom)
+{
+   if (!rjpeg)
+      return;
+
+   rjpeg->scale_denom = denom;
+   rjpeg->scale_min_w = 0;
+   rjpeg->scale_min_h = 0;
+}
+
+void rjpeg_set_scale_target(rjpeg_t *rjpeg, unsigned width, unsigned height)
+{
+   if (!rjpeg)
+      return;
+
+   rjpeg->scale_denom = (width || height) ? 8 : 1;
+   rjpeg->scale_min_w = width;
+   rjpeg->scale_min_h = height;
+}
+
 void rjpeg_free(rjpeg_t *rjpeg)
 {
    if (!rjpeg)
@@ -48,17 +48,40 @@ uint32_t bitstream_peek(struct bitstream* bitstream, int numbits)
 	/* fetch data if we need more */
 	if (numbits > bitstream->bits)
 	{
-		while (bitstream->bits <= 24)
+		/* top up with whole bytes from a single 64-bit big-endian
+		 * load while there are at least 8 bytes of input left */
+		if (bitstream->doffset + 8 <= bitstream->dlength)
 		{
-			if (bitstream->doffset < bitstream->dlength)
-				bitstream->buffer |= bitstream->read[bitstream->doffset] << (24 - bitstream->bits);
-			bitstream->doffset++;
-			bitstream->bits += 8;
+			const uint8_t *src = &bitstream->read[bitstream->doffset];
+			int bytes          = (64 - bitstream->bits) >> 3;
+			uint64_t data      =
+				  ((uint64_t)src[0] << 56) | ((uint64_t)src[1] << 48)
+				| ((uint64_t)src[2] << 40) | ((uint64_t)src[3] << 32)
+				| ((uint64_t)src[4] << 24) | ((uint64_t)src[5] << 16)
+				| ((uint64_t)src[6] <<  8) |  (uint64_t)src[7];
+
+			/* keep only the bytes that fit and line them up after
+			 * the bits that are already in the accumulator */
+			if (bytes < 8)
+				data = (data >> (64 - 8 * bytes)) << (64 - 8 * bytes);
+			bitstream->buffer  |= data >> bitstream->bits;
+			bitstream->doffset += bytes;
+			bitstream->bits    += 8 * bytes;
+		}
+		else
+		{
+			while (bitstream->bits <= 56)
+			{
+				if (bitstream->doffset < bitstream->dlength)
+					bitstream->buffer |= (uint64_t)bitstream->read[bitstream->doffset] << (56 - bitstream->bits);
+				bitstream->doffset++;
+				bitstream->bits += 8;
+			}
 		}
 	}
 
 	/* return the data */
-	return bitstream->buffer >> (32 - numbits);
+	return (uint32_t)(bitstream->buffer >> (64 - numbits));
 }
 
 /*-----------------------------------------------------
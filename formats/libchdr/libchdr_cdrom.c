@@ -340,6 +340,245 @@ void ecc_compute_bytes(const uint8_t *sector, const uint16_t *row, int rowlen, u
 	*val2 ^= *val1;
 }
 
+/*-------------------------------------------------
+ *  Vectorised ECC generation
+ *
+ *  Every P and Q byte pair is an independent
+ *  reduction over its own set of source bytes, so
+ *  the byte pairs are computed side by side in
+ *  SIMD lanes. The ecclow lookup is a multiply by
+ *  2 in GF(2^8) (polynomial 0x11d) and ecchigh is
+ *  a multiply by 0xf4; both are done with shifts,
+ *  masks and nibble shuffles instead of tables.
+ *-------------------------------------------------
+ */
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define ECC_SIMD_WIDTH 32
+#define ECC_SIMD_SHUFFLE
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#define ECC_SIMD_SHUFFLE
+#endif
+#define ECC_SIMD_WIDTH 16
+#elif defined(__ARM_NEON__) && !defined(DONT_WANT_ARM_OPTIMIZATIONS)
+#include <arm_neon.h>
+#define ECC_SIMD_WIDTH 16
+#define ECC_SIMD_SHUFFLE
+#endif
+
+#ifdef ECC_SIMD_WIDTH
+
+/** @brief  bytes covered by the ECC, from the header up to the Q parity. */
+#define ECC_SOURCE_BYTES (ECC_Q_OFFSET - SYNC_NUM_BYTES)
+/** @brief  P lanes rounded up to the vector width. */
+#define ECC_P_LANES (((ECC_P_NUM_BYTES + ECC_SIMD_WIDTH - 1) / ECC_SIMD_WIDTH) * ECC_SIMD_WIDTH)
+/** @brief  Q lanes rounded up to the vector width. */
+#define ECC_Q_LANES (((ECC_Q_NUM_BYTES + ECC_SIMD_WIDTH - 1) / ECC_SIMD_WIDTH) * ECC_SIMD_WIDTH)
+
+#ifdef ECC_SIMD_SHUFFLE
+/** @brief  ecchigh split by nibble: ecchigh[x] = lo[x & 15] ^ hi[x >> 4]. */
+static const uint8_t ecchigh_lo[16] = { 0x00, 0xf4, 0xf5, 0x01, 0xf7, 0x03, 0x02, 0xf6, 0xf3, 0x07, 0x06, 0xf2, 0x04, 0xf0, 0xf1, 0x05 };
+static const uint8_t ecchigh_hi[16] = { 0x00, 0xfb, 0xeb, 0x10, 0xcb, 0x30, 0x20, 0xdb, 0x8b, 0x70, 0x60, 0x9b, 0x40, 0xbb, 0xab, 0x50 };
+#endif
+
+/**
+ * @fn  static void ecc_compute_lanes(const uint8_t *src, int stride, int rowlen, uint8_t *val1, uint8_t *val2)
+ *
+ * @brief   -------------------------------------------------
+ *            ecc_compute_lanes - ecc_compute_bytes for
+ *            ECC_SIMD_WIDTH byte pairs at once; component
+ *            N of every lane is read from src + N * stride
+ *          -------------------------------------------------.
+ */
+
+#if defined(__AVX2__)
+static void ecc_compute_lanes(const uint8_t *src, int stride, int rowlen, uint8_t *val1, uint8_t *val2)
+{
+	int component;
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i poly = _mm256_set1_epi8(0x1d);
+	const __m256i nib  = _mm256_set1_epi8(0x0f);
+	const __m256i lo   = _mm256_broadcastsi128_si256(
+			_mm_loadu_si128((const __m128i*)ecchigh_lo));
+	const __m256i hi   = _mm256_broadcastsi128_si256(
+			_mm_loadu_si128((const __m128i*)ecchigh_hi));
+	__m256i v1 = zero;
+	__m256i v2 = zero;
+
+	for (component = 0; component < rowlen; component++)
+	{
+		__m256i s = _mm256_loadu_si256((const __m256i*)(src + component * stride));
+		v1 = _mm256_xor_si256(v1, s);
+		v2 = _mm256_xor_si256(v2, s);
+		/* v1 = ecclow[v1] */
+		v1 = _mm256_xor_si256(_mm256_add_epi8(v1, v1),
+				_mm256_and_si256(_mm256_cmpgt_epi8(zero, v1), poly));
+	}
+
+	/* v1 = ecchigh[ecclow[v1] ^ v2] */
+	v1 = _mm256_xor_si256(_mm256_add_epi8(v1, v1),
+			_mm256_and_si256(_mm256_cmpgt_epi8(zero, v1), poly));
+	v1 = _mm256_xor_si256(v1, v2);
+	v1 = _mm256_xor_si256(
+			_mm256_shuffle_epi8(lo, _mm256_and_si256(v1, nib)),
+			_mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi16(v1, 4), nib)));
+	v2 = _mm256_xor_si256(v2, v1);
+
+	_mm256_storeu_si256((__m256i*)val1, v1);
+	_mm256_storeu_si256((__m256i*)val2, v2);
+}
+#elif defined(__SSE2__)
+static INLINE __m128i ecc_mul2(__m128i v)
+{
+	return _mm_xor_si128(_mm_add_epi8(v, v),
+			_mm_and_si128(_mm_cmpgt_epi8(_mm_setzero_si128(), v),
+				_mm_set1_epi8(0x1d)));
+}
+
+static void ecc_compute_lanes(const uint8_t *src, int stride, int rowlen, uint8_t *val1, uint8_t *val2)
+{
+	int component;
+	__m128i v1 = _mm_setzero_si128();
+	__m128i v2 = _mm_setzero_si128();
+#ifndef ECC_SIMD_SHUFFLE
+	__m128i x;
+#endif
+
+	for (component = 0; component < rowlen; component++)
+	{
+		__m128i s = _mm_loadu_si128((const __m128i*)(src + component * stride));
+		v2 = _mm_xor_si128(v2, s);
+		v1 = ecc_mul2(_mm_xor_si128(v1, s));
+	}
+
+	v1 = _mm_xor_si128(ecc_mul2(v1), v2);
+#ifdef ECC_SIMD_SHUFFLE
+	{
+		const __m128i nib = _mm_set1_epi8(0x0f);
+		const __m128i lo  = _mm_loadu_si128((const __m128i*)ecchigh_lo);
+		const __m128i hi  = _mm_loadu_si128((const __m128i*)ecchigh_hi);
+		v1 = _mm_xor_si128(
+				_mm_shuffle_epi8(lo, _mm_and_si128(v1, nib)),
+				_mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi16(v1, 4), nib)));
+	}
+#else
+	/* multiply by 0xf4 = 0b11110100, Horner style */
+	x  = v1;
+	v1 = _mm_xor_si128(ecc_mul2(v1), x);
+	v1 = _mm_xor_si128(ecc_mul2(v1), x);
+	v1 = _mm_xor_si128(ecc_mul2(v1), x);
+	v1 = ecc_mul2(v1);
+	v1 = _mm_xor_si128(ecc_mul2(v1), x);
+	v1 = ecc_mul2(ecc_mul2(v1));
+#endif
+	v2 = _mm_xor_si128(v2, v1);
+
+	_mm_storeu_si128((__m128i*)val1, v1);
+	_mm_storeu_si128((__m128i*)val2, v2);
+}
+#else
+static INLINE uint8x16_t ecc_mul2(uint8x16_t v)
+{
+	uint8x16_t carry = vreinterpretq_u8_s8(vshrq_n_s8(vreinterpretq_s8_u8(v), 7));
+	return veorq_u8(vshlq_n_u8(v, 1), vandq_u8(carry, vdupq_n_u8(0x1d)));
+}
+
+static void ecc_compute_lanes(const uint8_t *src, int stride, int rowlen, uint8_t *val1, uint8_t *val2)
+{
+	int component;
+	uint8x16_t v1 = vdupq_n_u8(0);
+	uint8x16_t v2 = vdupq_n_u8(0);
+	uint8x16_t lo_idx, hi_idx;
+
+	for (component = 0; component < rowlen; component++)
+	{
+		uint8x16_t s = vld1q_u8(src + component * stride);
+		v2 = veorq_u8(v2, s);
+		v1 = ecc_mul2(veorq_u8(v1, s));
+	}
+
+	v1     = veorq_u8(ecc_mul2(v1), v2);
+	lo_idx = vandq_u8(v1, vdupq_n_u8(0x0f));
+	hi_idx = vshrq_n_u8(v1, 4);
+#if defined(__aarch64__)
+	v1 = veorq_u8(vqtbl1q_u8(vld1q_u8(ecchigh_lo), lo_idx),
+			vqtbl1q_u8(vld1q_u8(ecchigh_hi), hi_idx));
+#else
+	{
+		uint8x8x2_t lo = { { vld1_u8(ecchigh_lo), vld1_u8(ecchigh_lo + 8) } };
+		uint8x8x2_t hi = { { vld1_u8(ecchigh_hi), vld1_u8(ecchigh_hi + 8) } };
+		v1 = vcombine_u8(
+				veor_u8(vtbl2_u8(lo, vget_low_u8(lo_idx)),  vtbl2_u8(hi, vget_low_u8(hi_idx))),
+				veor_u8(vtbl2_u8(lo, vget_high_u8(lo_idx)), vtbl2_u8(hi, vget_high_u8(hi_idx))));
+	}
+#endif
+	v2 = veorq_u8(v2, v1);
+
+	vst1q_u8(val1, v1);
+	vst1q_u8(val2, v2);
+}
+#endif
+
+/**
+ * @fn  static void ecc_generate_simd(uint8_t *sector)
+ *
+ * @brief   -------------------------------------------------
+ *            ecc_generate_simd - ecc_generate on SIMD lanes
+ *          -------------------------------------------------.
+ *
+ * @param [in,out]  sector  If non-null, the sector.
+ */
+
+static void ecc_generate_simd(uint8_t *sector)
+{
+	int n, m;
+	uint8_t src[ECC_SOURCE_BYTES];
+	uint8_t qsrc[ECC_Q_COMP][ECC_Q_LANES];
+	uint8_t val1[ECC_P_LANES];
+	uint8_t val2[ECC_P_LANES];
+
+	memcpy(src, &sector[SYNC_OFFSET + SYNC_NUM_BYTES], ECC_SOURCE_BYTES);
+	/* in mode 2 the header bytes are treated as 0 */
+	if (sector[MODE_OFFSET] == 2)
+		memset(src, 0, 4);
+
+	/* P: component M of byte N lives at N + M * 86, so every
+	 * component of a run of P bytes is one contiguous load */
+	for (n = 0; n < ECC_P_NUM_BYTES; n += ECC_SIMD_WIDTH)
+		ecc_compute_lanes(&src[n], ECC_P_NUM_BYTES, ECC_P_COMP,
+				&val1[n], &val2[n]);
+
+	memcpy(&sector[ECC_P_OFFSET], val1, ECC_P_NUM_BYTES);
+	memcpy(&sector[ECC_P_OFFSET + ECC_P_NUM_BYTES], val2, ECC_P_NUM_BYTES);
+
+	/* Q covers the P parity we just generated */
+	memcpy(&src[ECC_P_OFFSET - SYNC_NUM_BYTES], val1, ECC_P_NUM_BYTES);
+	memcpy(&src[ECC_P_OFFSET - SYNC_NUM_BYTES + ECC_P_NUM_BYTES], val2, ECC_P_NUM_BYTES);
+
+	/* Q: the components run diagonally through the sector, so
+	 * transpose them into lane order first */
+	for (m = 0; m < ECC_Q_COMP; m++)
+	{
+		for (n = 0; n < ECC_Q_NUM_BYTES; n++)
+			qsrc[m][n] = src[qoffsets[n][m]];
+		for (; n < ECC_Q_LANES; n++)
+			qsrc[m][n] = 0;
+	}
+
+	for (n = 0; n < ECC_Q_NUM_BYTES; n += ECC_SIMD_WIDTH)
+		ecc_compute_lanes(&qsrc[0][n], ECC_Q_LANES, ECC_Q_COMP,
+				&val1[n], &val2[n]);
+
+	memcpy(&sector[ECC_Q_OFFSET], val1, ECC_Q_NUM_BYTES);
+	memcpy(&sector[ECC_Q_OFFSET + ECC_Q_NUM_BYTES], val2, ECC_Q_NUM_BYTES);
+}
+
+#endif /* ECC_SIMD_WIDTH */
+
 /**
  * @fn  int ecc_verify(const uint8_t *sector)
  *
@@ -376,17 +615,18 @@ int ecc_verify(const uint8_t *sector)
 }
 
 /**
- * @fn  void ecc_generate(uint8_t *sector)
+ * @fn  static void ecc_generate_scalar(uint8_t *sector)
  *
  * @brief   -------------------------------------------------
- *            ecc_generate - generate the P and Q ECC codes for a sector, overwriting any
- *            existing codes
+ *            ecc_generate_scalar - ecc_generate one byte pair
+ *            at a time; built with SIMD too, so the vector
+ *            path can be tested against it
  *          -------------------------------------------------.
  *
  * @param [in,out]  sector  If non-null, the sector.
  */
 
-void ecc_generate(uint8_t *sector)
+static INLINE void ecc_generate_scalar(uint8_t *sector)
 {
    int byte;
 	/* first verify P bytes */
@@ -398,6 +638,26 @@ void ecc_generate(uint8_t *sector)
 		ecc_compute_bytes(sector, qoffsets[byte], ECC_Q_COMP, &sector[ECC_Q_OFFSET + byte], &sector[ECC_Q_OFFSET + ECC_Q_NUM_BYTES + byte]);
 }
 
+/**
+ * @fn  void ecc_generate(uint8_t *sector)
+ *
+ * @brief   -------------------------------------------------
+ *            ecc_generate - generate the P and Q ECC codes for a sector, overwriting any
+ *            existing codes
+ *          -------------------------------------------------.
+ *
+ * @param [in,out]  sector  If non-null, the sector.
+ */
+
+void ecc_generate(uint8_t *sector)
+{
+#ifdef ECC_SIMD_WIDTH
+	ecc_generate_simd(sector);
+#else
+	ecc_generate_scalar(sector);
+#endif
+}
+
 /**
  * @fn  void ecc_clear(uint8_t *sector)
  *
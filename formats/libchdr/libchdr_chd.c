@@ -62,6 +62,16 @@
 #include <retro_inline.h>
 #include <streams/file_stream.h>
 
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
+#if defined(HAVE_MMAP) && !defined(_WIN32)
+#include <sys/stat.h>
+#include <sys/mman.h>
+#define CHD_HAVE_MMAP
+#endif
+
 #define TRUE 1
 #define FALSE 0
 
@@ -168,6 +178,30 @@ struct _codec_interface
 	chd_error	(*config)(void *codec, int param, void *config); /* configure */
 };
 
+/* an initialized codec context; idle ones are kept in the codec pool */
+typedef struct _codec_context codec_context;
+struct _codec_context
+{
+	codec_context *			next;			/* next idle context in the pool */
+	const codec_interface *	intf;			/* codec this context belongs to */
+	UINT32					hunkbytes;		/* hunk size it was initialized for */
+	int						counted;		/* acquired while the pool was active */
+	union
+	{
+#ifdef HAVE_ZLIB
+		zlib_codec_data		zlib;			/* zlib codec data */
+		cdzl_codec_data		cdzl;			/* cdzl codec data */
+#endif
+#ifdef HAVE_7ZIP
+		cdlz_codec_data		cdlz;			/* cdlz codec data */
+#endif
+#ifdef HAVE_FLAC
+		cdfl_codec_data		cdfl;			/* cdfl codec data */
+#endif
+		UINT8				none;
+	} data;
+};
+
 /* a single map entry */
 typedef struct _map_entry map_entry;
 struct _map_entry
@@ -213,22 +247,14 @@ struct _chd_file
 
 	UINT8 *					compressed;		/* pointer to buffer for compressed data */
 	const codec_interface *	codecintf[4];	/* interface to the codec */
-
-#ifdef HAVE_ZLIB
-	zlib_codec_data			zlib_codec_data;		/* zlib codec data */
-	cdzl_codec_data			cdzl_codec_data;		/* cdzl codec data */
-#endif
-#ifdef HAVE_7ZIP
-	cdlz_codec_data			cdlz_codec_data;		/* cdlz codec data */
-#endif
-#ifdef HAVE_FLAC
-	cdfl_codec_data			cdfl_codec_data;		/* cdfl codec data */
-#endif
+	codec_context *			codec[4];		/* codec state, from the codec pool */
 
 #ifdef NEED_CACHE_HUNK
 	UINT32					maxhunk;		/* maximum hunk accessed */
 #endif
    UINT8 *              file_cache; /* cache of underlying file */
+   UINT64               file_cache_size; /* size of the file cache in bytes */
+   int                  file_cache_mapped; /* file cache is a read-only mapping */
 };
 
 /***************************************************************************
@@ -238,6 +264,19 @@ struct _chd_file
 static const UINT8 nullmd5[CHD_MD5_BYTES] = { 0 };
 static const UINT8 nullsha1[CHD_SHA1_BYTES] = { 0 };
 
+/* most idle codec contexts the pool keeps; more are freed on release */
+#define CODEC_POOL_MAX_IDLE 8
+
+/* process-wide pool of idle codec contexts, see chd_codec_pool_init.
+ * Everything here, the stats included, only changes while the pool
+ * is active, under codec_pool_lock. */
+static int codec_pool_active = FALSE;
+static codec_context *codec_pool_idle = NULL;
+static chd_codec_pool_stats codec_pool_stats;
+#ifdef HAVE_THREADS
+static slock_t *codec_pool_lock = NULL;
+#endif
+
 /***************************************************************************
     PROTOTYPES
 ***************************************************************************/
@@ -262,13 +301,6 @@ static chd_error metadata_find_entry(chd_file *chd, UINT32 metatag, UINT32 metai
     CODEC INTERFACES
 ***************************************************************************/
 
-#define CHD_MAKE_TAG(a,b,c,d)       (((a) << 24) | ((b) << 16) | ((c) << 8) | (d))
-
-/* general codecs with CD frontend */
-#define CHD_CODEC_CD_ZLIB CHD_MAKE_TAG('c','d','z','l')
-#define CHD_CODEC_CD_LZMA CHD_MAKE_TAG('c','d','l','z')
-#define CHD_CODEC_CD_FLAC CHD_MAKE_TAG('c','d','f','l')
-
 static const codec_interface codec_interfaces[] =
 {
 	/* "none" or no compression */
@@ -555,6 +587,90 @@ uint16_t crc16(const void *data, uint32_t length)
 	return crc;
 }
 
+/*-------------------------------------------------
+	decompress_v5_map_types - decode the
+	huffman/RLE coded compression type of every
+	hunk into the first byte of its map entry
+-------------------------------------------------*/
+
+static void decompress_v5_map_types(chd_header* header,
+		struct huffman_decoder* decoder, struct bitstream* bitbuf)
+{
+	enum
+	{
+		RLE_STATE_NONE = 0,	/* next symbol is a compression type */
+		RLE_STATE_SMALL,	/* next symbol is a small repeat count */
+		RLE_STATE_LARGE_HI,	/* next symbol is the high nibble of a large count */
+		RLE_STATE_LARGE_LO	/* next symbol is the low nibble of a large count */
+	} state = RLE_STATE_NONE;
+	uint32_t hunknum = 0;
+	uint8_t lastcomp = 0;
+	int repcount = 0;
+	/* the map is the main user of the decoder, so it pays to
+	 * resolve several of its short codes per probe */
+	int multi = (huffman_build_multi_table(decoder) == HUFFERR_NONE);
+
+	while (hunknum < header->hunkcount || state != RLE_STATE_NONE)
+	{
+		struct huffman_multi_entry single;
+		const struct huffman_multi_entry *entry = &single;
+		int i, used = 0;
+
+		if (multi)
+			entry = huffman_peek_multi(decoder, bitbuf);
+		else
+		{
+			single.symbol[0]  = huffman_decode_one(decoder, bitbuf);
+			single.numbits[0] = 0;
+			single.count      = 1;
+		}
+
+		/* only consume the codes we need; anything left over in the
+		 * probe stays in the stream for the offset/length fields */
+		for (i = 0; i < entry->count; i++)
+		{
+			uint8_t val = (uint8_t)entry->symbol[i];
+			used += entry->numbits[i];
+
+			switch (state)
+			{
+				case RLE_STATE_NONE:
+					if (val == COMPRESSION_RLE_SMALL)
+						state = RLE_STATE_SMALL;
+					else if (val == COMPRESSION_RLE_LARGE)
+						state = RLE_STATE_LARGE_HI;
+					else
+						lastcomp = val;
+					header->rawmap[hunknum++ * 12] = lastcomp;
+					break;
+				case RLE_STATE_SMALL:
+					repcount = 2 + val;
+					state    = RLE_STATE_NONE;
+					break;
+				case RLE_STATE_LARGE_HI:
+					repcount = 2 + 16 + (val << 4);
+					state    = RLE_STATE_LARGE_LO;
+					break;
+				case RLE_STATE_LARGE_LO:
+					repcount += val;
+					state     = RLE_STATE_NONE;
+					break;
+			}
+
+			if (state != RLE_STATE_NONE)
+				continue;
+
+			for (; repcount > 0 && hunknum < header->hunkcount; repcount--)
+				header->rawmap[hunknum++ * 12] = lastcomp;
+
+			if (hunknum >= header->hunkcount)
+				break;
+		}
+
+		bitstream_remove(bitbuf, used);
+	}
+}
+
 /*-------------------------------------------------
 	decompress_v5_map - decompress the v5 map
 -------------------------------------------------*/
@@ -567,8 +683,7 @@ static chd_error decompress_v5_map(chd_file* chd, chd_header* header)
    uint64_t firstoffs;
 	uint32_t last_self = 0;
 	uint64_t last_parent = 0;
-	uint8_t lastcomp = 0;
-	int hunknum, repcount = 0;
+	int hunknum;
    enum huffman_error err;
    uint8_t lengthbits, selfbits, parentbits;
    uint8_t* compressed;
@@ -633,32 +748,7 @@ static chd_error decompress_v5_map(chd_file* chd, chd_header* header)
 		return CHDERR_DECOMPRESSION_ERROR;
 	}
 
-	for (hunknum = 0; hunknum < header->hunkcount; hunknum++)
-	{
-		uint8_t *rawmap = header->rawmap + (hunknum * 12);
-		if (repcount > 0)
-        {
-            rawmap[0] = lastcomp;
-            repcount--;
-        }
-		else
-		{
-			uint8_t val = huffman_decode_one(decoder, bitbuf);
-			if (val == COMPRESSION_RLE_SMALL)
-            {
-                rawmap[0] = lastcomp;
-                repcount = 2 + huffman_decode_one(decoder, bitbuf);
-            }
-			else if (val == COMPRESSION_RLE_LARGE)
-            {
-                rawmap[0] = lastcomp;
-                repcount = 2 + 16 + (huffman_decode_one(decoder, bitbuf) << 4);
-                repcount += huffman_decode_one(decoder, bitbuf);
-            }
-			else
-				rawmap[0] = lastcomp = val;
-		}
-	}
+	decompress_v5_map_types(header, decoder, bitbuf);
 
 	/* then iterate through the hunks and extract the needed data */
 	curoffset = firstoffs;
@@ -757,6 +847,225 @@ static INLINE void map_extract_old(const UINT8 *base, map_entry *entry, UINT32 h
     CHD FILE MANAGEMENT
 ***************************************************************************/
 
+/*-------------------------------------------------
+    codec_context_acquire - get an initialized
+    context for a codec, from the pool when one
+    for the same hunk size is idle there
+-------------------------------------------------*/
+
+static chd_error codec_context_acquire(const codec_interface *intf,
+		UINT32 hunkbytes, codec_context **result)
+{
+	chd_error err;
+	codec_context *ctx = NULL;
+
+	*result = NULL;
+
+#ifdef HAVE_THREADS
+	if (codec_pool_lock)
+		slock_lock(codec_pool_lock);
+#endif
+	if (codec_pool_active)
+	{
+		codec_context **link;
+		for (link = &codec_pool_idle; *link != NULL; link = &(*link)->next)
+		{
+			if ((*link)->intf == intf && (*link)->hunkbytes == hunkbytes)
+			{
+				ctx   = *link;
+				*link = ctx->next;
+				codec_pool_stats.idle--;
+				codec_pool_stats.reused++;
+				codec_pool_stats.in_use++;
+				ctx->counted = TRUE;
+				break;
+			}
+		}
+	}
+#ifdef HAVE_THREADS
+	if (codec_pool_lock)
+		slock_unlock(codec_pool_lock);
+#endif
+
+	if (ctx == NULL)
+	{
+		/* zeroed, so a failed init can still be freed safely */
+		ctx = (codec_context*)calloc(1, sizeof(*ctx));
+		if (ctx == NULL)
+			return CHDERR_OUT_OF_MEMORY;
+		ctx->intf      = intf;
+		ctx->hunkbytes = hunkbytes;
+
+		err = (*intf->init)(&ctx->data, hunkbytes);
+		if (err != CHDERR_NONE)
+		{
+			if (intf->free != NULL)
+				(*intf->free)(&ctx->data);
+			free(ctx);
+			return err;
+		}
+
+#ifdef HAVE_THREADS
+		if (codec_pool_lock)
+			slock_lock(codec_pool_lock);
+#endif
+		if (codec_pool_active)
+		{
+			codec_pool_stats.created++;
+			codec_pool_stats.in_use++;
+			ctx->counted = TRUE;
+		}
+#ifdef HAVE_THREADS
+		if (codec_pool_lock)
+			slock_unlock(codec_pool_lock);
+#endif
+	}
+
+	ctx->next = NULL;
+	*result   = ctx;
+	return CHDERR_NONE;
+}
+
+/*-------------------------------------------------
+    codec_context_release - return a context to
+    the pool, or free it if there is no pool or
+    the pool is full
+-------------------------------------------------*/
+
+static void codec_context_release(codec_context *ctx)
+{
+	int pooled = FALSE;
+
+#ifdef HAVE_THREADS
+	if (codec_pool_lock)
+		slock_lock(codec_pool_lock);
+#endif
+	if (codec_pool_active)
+	{
+		if (ctx->counted)
+			codec_pool_stats.in_use--;
+		ctx->counted = FALSE;
+
+		if (codec_pool_stats.idle < CODEC_POOL_MAX_IDLE)
+		{
+			ctx->next       = codec_pool_idle;
+			codec_pool_idle = ctx;
+			codec_pool_stats.idle++;
+			pooled          = TRUE;
+		}
+		else
+			codec_pool_stats.freed++;
+	}
+#ifdef HAVE_THREADS
+	if (codec_pool_lock)
+		slock_unlock(codec_pool_lock);
+#endif
+
+	if (!pooled)
+	{
+		if (ctx->intf->free != NULL)
+			(*ctx->intf->free)(&ctx->data);
+		free(ctx);
+	}
+}
+
+/*-------------------------------------------------
+    chd_codec_pool_init - keep codec contexts of
+    closed CHDs around for the next chd_open
+-------------------------------------------------*/
+
+chd_error chd_codec_pool_init(void)
+{
+	if (codec_pool_active)
+		return CHDERR_NONE;
+
+#ifdef HAVE_THREADS
+	codec_pool_lock = slock_new();
+	if (codec_pool_lock == NULL)
+		return CHDERR_OUT_OF_MEMORY;
+#endif
+	codec_pool_active = TRUE;
+	return CHDERR_NONE;
+}
+
+/*-------------------------------------------------
+    chd_codec_pool_trim - free all idle codec
+    contexts
+-------------------------------------------------*/
+
+void chd_codec_pool_trim(void)
+{
+	codec_context *idle;
+
+#ifdef HAVE_THREADS
+	if (codec_pool_lock)
+		slock_lock(codec_pool_lock);
+#endif
+	idle                     = codec_pool_idle;
+	codec_pool_idle          = NULL;
+	codec_pool_stats.freed  += codec_pool_stats.idle;
+	codec_pool_stats.idle    = 0;
+#ifdef HAVE_THREADS
+	if (codec_pool_lock)
+		slock_unlock(codec_pool_lock);
+#endif
+
+	while (idle != NULL)
+	{
+		codec_context *next = idle->next;
+		if (idle->intf->free != NULL)
+			(*idle->intf->free)(&idle->data);
+		free(idle);
+		idle = next;
+	}
+}
+
+/*-------------------------------------------------
+    chd_codec_pool_deinit - free the pool; CHDs
+    still open free their codecs on close
+-------------------------------------------------*/
+
+void chd_codec_pool_deinit(void)
+{
+	if (!codec_pool_active)
+		return;
+
+	/* stop pooling first so nothing is released into the
+	 * pool after it has been emptied */
+#ifdef HAVE_THREADS
+	slock_lock(codec_pool_lock);
+	codec_pool_active = FALSE;
+	slock_unlock(codec_pool_lock);
+#else
+	codec_pool_active = FALSE;
+#endif
+
+	chd_codec_pool_trim();
+
+#ifdef HAVE_THREADS
+	slock_free(codec_pool_lock);
+	codec_pool_lock = NULL;
+#endif
+}
+
+/*-------------------------------------------------
+    chd_codec_pool_get_stats - return counters
+    for the codec pool
+-------------------------------------------------*/
+
+void chd_codec_pool_get_stats(chd_codec_pool_stats *stats)
+{
+#ifdef HAVE_THREADS
+	if (codec_pool_lock)
+		slock_lock(codec_pool_lock);
+#endif
+	*stats = codec_pool_stats;
+#ifdef HAVE_THREADS
+	if (codec_pool_lock)
+		slock_unlock(codec_pool_lock);
+#endif
+}
+
 /*-------------------------------------------------
     chd_open_file - open a CHD file for access
 -------------------------------------------------*/
@@ -862,14 +1171,13 @@ chd_error chd_open_file(RFILE *file, int mode, chd_file *parent, chd_file **chd)
 		if (intfnum == ARRAY_SIZE(codec_interfaces))
 			EARLY_EXIT(err = CHDERR_UNSUPPORTED_FORMAT);
 
-#ifdef HAVE_ZLIB
 		/* initialize the codec */
 		if (newchd->codecintf[0]->init != NULL)
       {
-         err = (*newchd->codecintf[0]->init)(&newchd->zlib_codec_data, newchd->header.hunkbytes);
+         err = codec_context_acquire(newchd->codecintf[0],
+               newchd->header.hunkbytes, &newchd->codec[0]);
          (void)err;
       }
-#endif
 	}
 	else
 	{
@@ -891,32 +1199,9 @@ chd_error chd_open_file(RFILE *file, int mode, chd_file *parent, chd_file **chd)
 					/* initialize the codec */
 					if (newchd->codecintf[decompnum]->init != NULL)
 					{
-						void* codec = NULL;
-						switch (newchd->header.compression[decompnum])
-						{
-							case CHD_CODEC_CD_ZLIB:
-#ifdef HAVE_ZLIB
-								codec = &newchd->cdzl_codec_data;
-#endif
-								break;
-
-							case CHD_CODEC_CD_LZMA:
-#ifdef HAVE_7ZIP
-								codec = &newchd->cdlz_codec_data;
-#endif
-								break;
-
-							case CHD_CODEC_CD_FLAC:
-#ifdef HAVE_FLAC
-								codec = &newchd->cdfl_codec_data;
-#endif
-								break;
-						}
-						if (codec != NULL)
-                        {
-							err = (*newchd->codecintf[decompnum]->init)(codec, newchd->header.hunkbytes);
-                            (void)err;
-                        }
+						err = codec_context_acquire(newchd->codecintf[decompnum],
+								newchd->header.hunkbytes, &newchd->codec[decompnum]);
+						(void)err;
 					}
 
 				}
@@ -986,32 +1271,111 @@ cleanup:
 	return err;
 }
 
-chd_error chd_precache(chd_file *chd)
+#ifdef CHD_HAVE_MMAP
+static chd_error chd_precache_map(chd_file *chd)
+{
+	void *mapped;
+	struct stat st;
+	int64_t size;
+	int fd = filestream_get_fd(chd->file);
+
+	/* only map the descriptor the stream itself reads from; a
+	 * frontend VFS or a cdrom stream falls back to the heap */
+	if (fd == -1)
+		return CHDERR_UNSUPPORTED_FORMAT;
+
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0)
+		return CHDERR_UNSUPPORTED_FORMAT;
+
+	/* refuse images that do not fit the address space, and any
+	 * descriptor that disagrees with the stream about the size */
+	size = filestream_get_size(chd->file);
+	if ((UINT64)(size_t)st.st_size != (UINT64)st.st_size
+			|| size != (int64_t)st.st_size)
+		return CHDERR_UNSUPPORTED_FORMAT;
+
+	/* the mapping is read-only and lets the kernel page hunks in
+	 * on demand; note that truncating the file while it is mapped
+	 * raises SIGBUS on access, use CHD_PRECACHE_MALLOC if the image
+	 * may change underneath us */
+	mapped = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (mapped == MAP_FAILED)
+		return CHDERR_OUT_OF_MEMORY;
+
+	chd->file_cache        = (UINT8*)mapped;
+	chd->file_cache_size   = (UINT64)st.st_size;
+	chd->file_cache_mapped = TRUE;
+	return CHDERR_NONE;
+}
+#endif
+
+static chd_error chd_precache_malloc(chd_file *chd)
 {
 	int64_t size, count;
 
-	if (!chd->file_cache)
+	filestream_seek(chd->file, 0, SEEK_END);
+	size = filestream_tell(chd->file);
+	if (size <= 0)
+		return CHDERR_INVALID_DATA;
+	chd->file_cache = (UINT8*)malloc(size);
+	if (chd->file_cache == NULL)
+		return CHDERR_OUT_OF_MEMORY;
+	filestream_seek(chd->file, 0, SEEK_SET);
+	count = filestream_read(chd->file, chd->file_cache, size);
+	if (count != size)
 	{
-		filestream_seek(chd->file, 0, SEEK_END);
-		size = filestream_tell(chd->file);
-		if (size <= 0)
-			return CHDERR_INVALID_DATA;
-		chd->file_cache = (UINT8*)malloc(size);
-		if (chd->file_cache == NULL)
-			return CHDERR_OUT_OF_MEMORY;
-		filestream_seek(chd->file, 0, SEEK_SET);
-		count = filestream_read(chd->file, chd->file_cache, size);
-		if (count != size)
-		{
-			free(chd->file_cache);
-			chd->file_cache = NULL;
-			return CHDERR_READ_ERROR;
-		}
+		free(chd->file_cache);
+		chd->file_cache = NULL;
+		return CHDERR_READ_ERROR;
 	}
 
+	chd->file_cache_size   = (UINT64)size;
+	chd->file_cache_mapped = FALSE;
 	return CHDERR_NONE;
 }
 
+/*-------------------------------------------------
+    chd_precache_mode - make the whole underlying
+    file available in memory, either by mapping
+    it or by reading it into a heap buffer
+-------------------------------------------------*/
+
+chd_error chd_precache_mode(chd_file *chd, int mode)
+{
+	if (chd->file_cache)
+		return CHDERR_NONE;
+
+	switch (mode)
+	{
+		case CHD_PRECACHE_AUTO:
+#ifdef CHD_HAVE_MMAP
+			if (chd_precache_map(chd) == CHDERR_NONE)
+				return CHDERR_NONE;
+#endif
+			return chd_precache_malloc(chd);
+
+		case CHD_PRECACHE_MMAP:
+#ifdef CHD_HAVE_MMAP
+			return chd_precache_map(chd);
+#else
+			return CHDERR_UNSUPPORTED_FORMAT;
+#endif
+
+		case CHD_PRECACHE_MALLOC:
+			return chd_precache_malloc(chd);
+
+		default:
+			break;
+	}
+
+	return CHDERR_INVALID_PARAMETER;
+}
+
+chd_error chd_precache(chd_file *chd)
+{
+	return chd_precache_mode(chd, CHD_PRECACHE_AUTO);
+}
+
 /*-------------------------------------------------
     chd_close - close a CHD file for access
 -------------------------------------------------*/
@@ -1022,53 +1386,18 @@ void chd_close(chd_file *chd)
 	if (chd == NULL || chd->cookie != COOKIE_VALUE)
 		return;
 
-	/* deinit the codec */
-	if (chd->header.version < 5)
-	{
-#ifdef HAVE_ZLIB
-		if (chd->codecintf[0] != NULL && chd->codecintf[0]->free != NULL)
-			(*chd->codecintf[0]->free)(&chd->zlib_codec_data);
-#endif
-	}
-	else
+	/* hand the codecs back to the pool, or free them */
 	{
 		int i;
-		/* Free the codecs */
 		for (i = 0 ; i < 4 ; i++)
-      {
-         void* codec = NULL;
-         if (!chd->codecintf[i])
-            continue;
-
-         switch (chd->codecintf[i]->compression)
-         {
-            case CHD_CODEC_CD_LZMA:
-#ifdef HAVE_7ZIP
-               codec = &chd->cdlz_codec_data;
-#endif
-               break;
-
-            case CHD_CODEC_CD_ZLIB:
-#ifdef HAVE_ZLIB
-               codec = &chd->cdzl_codec_data;
-#endif
-               break;
-
-            case CHD_CODEC_CD_FLAC:
-#ifdef HAVE_FLAC
-               codec = &chd->cdfl_codec_data;
-#endif
-               break;
-         }
-         if (codec)
-            (*chd->codecintf[i]->free)(codec);
-      }
-
-		/* Free the raw map */
-		if (chd->header.rawmap != NULL)
-			free(chd->header.rawmap);
+			if (chd->codec[i] != NULL)
+				codec_context_release(chd->codec[i]);
 	}
 
+	/* Free the raw map */
+	if (chd->header.version >= 5 && chd->header.rawmap != NULL)
+		free(chd->header.rawmap);
+
 	/* free the compressed data buffer */
 	if (chd->compressed != NULL)
 		free(chd->compressed);
@@ -1094,7 +1423,14 @@ void chd_close(chd_file *chd)
 #endif
 
    if (chd->file_cache)
-      free(chd->file_cache);
+   {
+#ifdef CHD_HAVE_MMAP
+      if (chd->file_cache_mapped)
+         munmap(chd->file_cache, (size_t)chd->file_cache_size);
+      else
+#endif
+         free(chd->file_cache);
+   }
 
 	/* free our memory */
 	free(chd);
@@ -1535,7 +1871,14 @@ static UINT8* read_compressed(chd_file *chd, UINT64 offset, size_t size)
 {
    int64_t bytes;
    if (chd->file_cache)
+   {
+      /* never slice past the end of the cache; with a mapping
+       * that would fault instead of failing the read */
+      if (offset > chd->file_cache_size ||
+            size > chd->file_cache_size - offset)
+         return NULL;
       return chd->file_cache + offset;
+   }
    filestream_seek(chd->file, offset, SEEK_SET);
    bytes = filestream_read(chd->file, chd->compressed, size);
    if (bytes != size)
@@ -1548,6 +1891,9 @@ static chd_error read_uncompressed(chd_file *chd, UINT64 offset, size_t size, UI
    int64_t bytes;
    if (chd->file_cache)
    {
+      if (offset > chd->file_cache_size ||
+            size > chd->file_cache_size - offset)
+         return CHDERR_READ_ERROR;
       memcpy(dest, chd->file_cache + offset, size);
       return CHDERR_NONE;
    }
@@ -1595,15 +1941,15 @@ static chd_error hunk_read_into_memory(chd_file *chd, UINT32 hunknum, UINT8 *des
                if (bytes == NULL)
                   return CHDERR_READ_ERROR;
 
-#ifdef HAVE_ZLIB
                /* now decompress using the codec */
                err   = CHDERR_NONE;
-               codec = &chd->zlib_codec_data;
+               if (chd->codec[0] == NULL)
+                  return CHDERR_CODEC_ERROR;
+               codec = &chd->codec[0]->data;
                if (chd->codecintf[0]->decompress != NULL)
-                  err = (*chd->codecintf[0]->decompress)(codec, chd->compressed, entry->length, dest, chd->header.hunkbytes);
+                  err = (*chd->codecintf[0]->decompress)(codec, bytes, entry->length, dest, chd->header.hunkbytes);
                if (err != CHDERR_NONE)
                   return err;
-#endif
             }
 				break;
 
@@ -1682,29 +2028,11 @@ static chd_error hunk_read_into_memory(chd_file *chd, UINT32 hunknum, UINT8 *des
             bytes = read_compressed(chd, blockoffs, blocklen);
             if (bytes == NULL)
                return CHDERR_READ_ERROR;
-				switch (chd->codecintf[rawmap[0]]->compression)
-				{
-					case CHD_CODEC_CD_LZMA:
-#ifdef HAVE_7ZIP
-						codec = &chd->cdlz_codec_data;
-#endif
-						break;
-
-					case CHD_CODEC_CD_ZLIB:
-#ifdef HAVE_ZLIB
-						codec = &chd->cdzl_codec_data;
-#endif
-						break;
-
-					case CHD_CODEC_CD_FLAC:
-#ifdef HAVE_FLAC
-						codec = &chd->cdfl_codec_data;
-#endif
-						break;
-				}
+				if (chd->codec[rawmap[0]] != NULL)
+					codec = &chd->codec[rawmap[0]]->data;
 				if (codec==NULL)
 					return CHDERR_CODEC_ERROR;
-				err = (*chd->codecintf[rawmap[0]]->decompress)(codec, chd->compressed, blocklen, dest, chd->header.hunkbytes);
+				err = (*chd->codecintf[rawmap[0]]->decompress)(codec, bytes, blocklen, dest, chd->header.hunkbytes);
 				if (err != CHDERR_NONE)
 					return err;
 #ifdef VERIFY_BLOCK_CRC
@@ -0,0 +1,1093 @@
+/* Copyright  (C) 2010-2020 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (libchdr_chd_writer.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Creation of V5 CHD files, with hunk compression spread over a
+ * pool of worker threads. */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libchdr/chd.h>
+#include <libchdr/cdrom.h>
+#include <libchdr/huffman.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
+#include <retro_inline.h>
+#include <streams/file_stream.h>
+
+/***************************************************************************
+    CONSTANTS
+***************************************************************************/
+
+#define METADATA_HEADER_SIZE		16			/* metadata header size */
+#define MAP_HEADER_SIZE				16			/* compressed map header size */
+#define MAP_ENTRY_BYTES				12			/* uncompressed V5 map entry size */
+
+/* V5 compression types; must match the reader in libchdr_chd.c */
+#define COMPRESSION_NONE			4
+#define COMPRESSION_RLE_SMALL		7
+#define COMPRESSION_RLE_LARGE		8
+
+/* the map types are coded with a 16 symbol tree of up to 8 bits */
+#define MAP_TYPE_CODES				16
+#define MAP_TYPE_MAXBITS			8
+
+/* crc16 of the uncompressed data, shared with the reader */
+uint16_t crc16(const void *data, uint32_t length);
+
+/***************************************************************************
+    TYPE DEFINITIONS
+***************************************************************************/
+
+/* interface to a hunk compressor */
+typedef struct _codec_encoder codec_encoder;
+struct _codec_encoder
+{
+	UINT32		compression;	/* type of compression */
+	chd_error	(*init)(void **state, UINT32 hunkbytes);
+	void		(*free)(void *state);
+	chd_error	(*compress)(void *state, const UINT8 *src, UINT32 srclen, UINT8 *dest, UINT32 *complen);
+};
+
+/* everything one thread needs to compress a hunk */
+typedef struct _hunk_compressor hunk_compressor;
+struct _hunk_compressor
+{
+	void *				state[4];		/* encoder state for each codec slot */
+	UINT8 *				scratch;		/* output of the codec being tried */
+};
+
+/* a hunk on its way from the caller to the file */
+typedef struct _hunk_slot hunk_slot;
+struct _hunk_slot
+{
+	UINT8 *				data;			/* uncompressed hunk */
+	UINT8 *				compressed;		/* best compressed form */
+	UINT32				complen;		/* length of the compressed form */
+	UINT8				comptype;		/* COMPRESSION_TYPE_x or COMPRESSION_NONE */
+	int					done;			/* compression finished */
+};
+
+/* a metadata entry waiting to be written */
+typedef struct _pending_metadata pending_metadata;
+struct _pending_metadata
+{
+	pending_metadata *	next;
+	UINT32				metatag;
+	UINT32				length;
+	UINT8				flags;
+	UINT8				data[1];
+};
+
+/* internal representation of a CHD being written */
+struct _chd_writer
+{
+	RFILE *				file;			/* handle to the open file */
+	UINT64				logicalbytes;	/* logical size of the data */
+	UINT32				hunkbytes;		/* bytes per hunk */
+	UINT32				unitbytes;		/* bytes per unit */
+	UINT32				hunkcount;		/* total number of hunks */
+	UINT32				compression[4];	/* compression type per slot */
+	const codec_encoder *encoder[4];	/* encoder per slot, NULL if unused */
+
+	UINT8 *				rawmap;			/* map as the reader will rebuild it */
+	UINT64				curoffset;		/* file offset of the next hunk */
+	UINT32				submitted;		/* hunks handed over by the caller */
+	UINT32				written;		/* hunks stored in the file */
+	chd_error			err;			/* first write error */
+
+	hunk_slot *			slots;			/* ring of hunks in flight */
+	UINT32				numslots;		/* size of the ring */
+	hunk_compressor		compressor;		/* used when there are no workers */
+
+	pending_metadata *	metadata;		/* metadata entries, in order */
+	pending_metadata **	metatail;		/* where to link the next entry */
+
+#ifdef HAVE_THREADS
+	sthread_t **		threads;		/* worker threads */
+	hunk_compressor *	workers;		/* compressor per worker */
+	int					numthreads;		/* number of workers */
+	slock_t *			lock;			/* protects the counters below */
+	scond_t *			work;			/* signalled when hunks are submitted */
+	scond_t *			done;			/* signalled when a hunk is compressed */
+	UINT32				taken;			/* hunks claimed by workers */
+	int					quit;			/* workers should exit */
+#endif
+};
+
+/* worker thread startup data */
+typedef struct _writer_worker writer_worker;
+struct _writer_worker
+{
+	chd_writer *		writer;
+	hunk_compressor *	compressor;
+};
+
+/***************************************************************************
+    INLINE FUNCTIONS
+***************************************************************************/
+
+static INLINE void put_bigendian_uint64(UINT8 *base, UINT64 value)
+{
+	base[0] = value >> 56;
+	base[1] = value >> 48;
+	base[2] = value >> 40;
+	base[3] = value >> 32;
+	base[4] = value >> 24;
+	base[5] = value >> 16;
+	base[6] = value >> 8;
+	base[7] = value;
+}
+
+static INLINE void put_bigendian_uint48(UINT8 *base, UINT64 value)
+{
+	base[0] = value >> 40;
+	base[1] = value >> 32;
+	base[2] = value >> 24;
+	base[3] = value >> 16;
+	base[4] = value >> 8;
+	base[5] = value;
+}
+
+static INLINE void put_bigendian_uint32(UINT8 *base, UINT32 value)
+{
+	base[0] = value >> 24;
+	base[1] = value >> 16;
+	base[2] = value >> 8;
+	base[3] = value;
+}
+
+static INLINE void put_bigendian_uint24(UINT8 *base, UINT32 value)
+{
+	base[0] = value >> 16;
+	base[1] = value >> 8;
+	base[2] = value;
+}
+
+static INLINE void put_bigendian_uint16(UINT8 *base, UINT16 value)
+{
+	base[0] = value >> 8;
+	base[1] = value;
+}
+
+/***************************************************************************
+    CDZL ENCODER
+***************************************************************************/
+
+#ifdef HAVE_ZLIB
+
+typedef struct _cdzl_encoder cdzl_encoder;
+struct _cdzl_encoder
+{
+	z_stream			base;			/* deflater for the sector data */
+	z_stream			subcode;		/* deflater for the subcode data */
+	UINT8 *				buffer;			/* sector data, then subcode data */
+#ifdef WANT_RAW_DATA_SECTOR
+	UINT8				check[CD_MAX_SECTOR_DATA];
+#endif
+};
+
+static void cdzl_encoder_free(void *state)
+{
+	cdzl_encoder *cdzl = (cdzl_encoder*)state;
+	if (cdzl == NULL)
+		return;
+	deflateEnd(&cdzl->base);
+	deflateEnd(&cdzl->subcode);
+	free(cdzl->buffer);
+	free(cdzl);
+}
+
+static chd_error cdzl_encoder_init(void **state, UINT32 hunkbytes)
+{
+	cdzl_encoder *cdzl;
+
+	/* make sure the CHD's hunk size is an even multiple of the frame size */
+	if (hunkbytes % CD_FRAME_SIZE != 0)
+		return CHDERR_CODEC_ERROR;
+
+	cdzl = (cdzl_encoder*)calloc(1, sizeof(*cdzl));
+	if (cdzl == NULL)
+		return CHDERR_OUT_OF_MEMORY;
+
+	/* both streams are raw deflate, as the reader expects */
+	if (deflateInit2(&cdzl->base, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		free(cdzl);
+		return CHDERR_CODEC_ERROR;
+	}
+	if (deflateInit2(&cdzl->subcode, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		deflateEnd(&cdzl->base);
+		free(cdzl);
+		return CHDERR_CODEC_ERROR;
+	}
+
+	cdzl->buffer = (UINT8*)malloc(hunkbytes);
+	if (cdzl->buffer == NULL)
+	{
+		cdzl_encoder_free(cdzl);
+		return CHDERR_OUT_OF_MEMORY;
+	}
+
+	*state = cdzl;
+	return CHDERR_NONE;
+}
+
+/* deflate a whole block; fails if it doesn't fit in destlen */
+static int cdzl_deflate(z_stream *stream, const UINT8 *src, UINT32 srclen, UINT8 *dest, UINT32 destlen, UINT32 *complen)
+{
+	deflateReset(stream);
+	stream->next_in   = (Bytef*)src;
+	stream->avail_in  = srclen;
+	stream->next_out  = dest;
+	stream->avail_out = destlen;
+	if (deflate(stream, Z_FINISH) != Z_STREAM_END)
+		return 0;
+	*complen = (UINT32)stream->total_out;
+	return 1;
+}
+
+static chd_error cdzl_encoder_compress(void *state, const UINT8 *src, UINT32 srclen, UINT8 *dest, UINT32 *complen)
+{
+	cdzl_encoder *cdzl = (cdzl_encoder*)state;
+	UINT32 frames = srclen / CD_FRAME_SIZE;
+	UINT32 complen_bytes = (srclen < 65536) ? 2 : 3;
+	UINT32 ecc_bytes = (frames + 7) / 8;
+	UINT32 header_bytes = ecc_bytes + complen_bytes;
+	UINT8 *subcode = &cdzl->buffer[frames * CD_MAX_SECTOR_DATA];
+	UINT32 complen_base, complen_subcode;
+	UINT32 framenum;
+
+	if (srclen <= header_bytes)
+		return CHDERR_COMPRESSION_ERROR;
+
+	/* split the frames into sector and subcode data */
+	memset(dest, 0, ecc_bytes);
+	for (framenum = 0; framenum < frames; framenum++)
+	{
+		UINT8 *sector = &cdzl->buffer[framenum * CD_MAX_SECTOR_DATA];
+		memcpy(sector, &src[framenum * CD_FRAME_SIZE], CD_MAX_SECTOR_DATA);
+		memcpy(&subcode[framenum * CD_MAX_SUBCODE_DATA], &src[framenum * CD_FRAME_SIZE + CD_MAX_SECTOR_DATA], CD_MAX_SUBCODE_DATA);
+
+#ifdef WANT_RAW_DATA_SECTOR
+		/* drop the sync header and ECC when the reader can rebuild
+		 * them byte for byte */
+		if (memcmp(sector, s_cd_sync_header, sizeof(s_cd_sync_header)) == 0)
+		{
+			memcpy(cdzl->check, sector, CD_MAX_SECTOR_DATA);
+			ecc_generate(cdzl->check);
+			if (memcmp(cdzl->check, sector, CD_MAX_SECTOR_DATA) == 0)
+			{
+				dest[framenum / 8] |= 1 << (framenum % 8);
+				memset(sector, 0, sizeof(s_cd_sync_header));
+				ecc_clear(sector);
+			}
+		}
+#endif
+	}
+
+	/* compress the sector data, then the subcode data behind it */
+	if (!cdzl_deflate(&cdzl->base, cdzl->buffer, frames * CD_MAX_SECTOR_DATA,
+				&dest[header_bytes], srclen - header_bytes, &complen_base))
+		return CHDERR_COMPRESSION_ERROR;
+	if (complen_base >= (1u << (8 * complen_bytes)))
+		return CHDERR_COMPRESSION_ERROR;
+	if (!cdzl_deflate(&cdzl->subcode, subcode, frames * CD_MAX_SUBCODE_DATA,
+				&dest[header_bytes + complen_base], srclen - header_bytes - complen_base, &complen_subcode))
+		return CHDERR_COMPRESSION_ERROR;
+
+	/* store the length of the sector data */
+	dest[ecc_bytes + 0] = complen_base >> ((complen_bytes - 1) * 8);
+	dest[ecc_bytes + 1] = complen_base >> ((complen_bytes - 2) * 8);
+	if (complen_bytes > 2)
+		dest[ecc_bytes + 2] = complen_base;
+
+	*complen = header_bytes + complen_base + complen_subcode;
+	return CHDERR_NONE;
+}
+
+#endif /* HAVE_ZLIB */
+
+static const codec_encoder codec_encoders[] =
+{
+#ifdef HAVE_ZLIB
+	{
+		CHD_CODEC_CD_ZLIB,
+		cdzl_encoder_init,
+		cdzl_encoder_free,
+		cdzl_encoder_compress
+	},
+#endif
+	{
+		CHDCOMPRESSION_NONE,
+		NULL,
+		NULL,
+		NULL
+	}
+};
+
+static const codec_encoder *find_encoder(UINT32 compression)
+{
+	int i;
+	for (i = 0; i < (int)(sizeof(codec_encoders) / sizeof(codec_encoders[0])); i++)
+		if (codec_encoders[i].compression == compression && codec_encoders[i].compress != NULL)
+			return &codec_encoders[i];
+	return NULL;
+}
+
+/***************************************************************************
+    HUNK COMPRESSION
+***************************************************************************/
+
+static void hunk_compressor_free(chd_writer *writer, hunk_compressor *compressor)
+{
+	int i;
+	for (i = 0; i < 4; i++)
+		if (compressor->state[i] != NULL)
+			writer->encoder[i]->free(compressor->state[i]);
+	free(compressor->scratch);
+	memset(compressor, 0, sizeof(*compressor));
+}
+
+static chd_error hunk_compressor_init(chd_writer *writer, hunk_compressor *compressor)
+{
+	int i;
+	memset(compressor, 0, sizeof(*compressor));
+
+	compressor->scratch = (UINT8*)malloc(writer->hunkbytes);
+	if (compressor->scratch == NULL)
+		return CHDERR_OUT_OF_MEMORY;
+
+	for (i = 0; i < 4; i++)
+	{
+		chd_error err;
+		if (writer->encoder[i] == NULL)
+			continue;
+		err = writer->encoder[i]->init(&compressor->state[i], writer->hunkbytes);
+		if (err != CHDERR_NONE)
+		{
+			hunk_compressor_free(writer, compressor);
+			return err;
+		}
+	}
+	return CHDERR_NONE;
+}
+
+/* try every codec on a hunk and keep the smallest result */
+static void hunk_compress(chd_writer *writer, hunk_compressor *compressor, hunk_slot *slot)
+{
+	int i;
+	slot->comptype = COMPRESSION_NONE;
+	slot->complen  = writer->hunkbytes;
+
+	for (i = 0; i < 4; i++)
+	{
+		UINT32 complen;
+		UINT8 *swap;
+		if (compressor->state[i] == NULL)
+			continue;
+		if (writer->encoder[i]->compress(compressor->state[i], slot->data,
+					writer->hunkbytes, compressor->scratch, &complen) != CHDERR_NONE)
+			continue;
+		if (complen >= slot->complen)
+			continue;
+
+		/* the best result so far becomes the slot's; its old
+		 * buffer becomes the scratch space for the next codec */
+		swap                 = slot->compressed;
+		slot->compressed     = compressor->scratch;
+		compressor->scratch  = swap;
+		slot->complen        = complen;
+		slot->comptype       = i;
+	}
+}
+
+/* append a compressed hunk to the file and record it in the map */
+static void hunk_store(chd_writer *writer, hunk_slot *slot)
+{
+	UINT8 *rawmap = &writer->rawmap[writer->written * MAP_ENTRY_BYTES];
+	const UINT8 *data = (slot->comptype == COMPRESSION_NONE) ? slot->data : slot->compressed;
+
+	rawmap[0] = slot->comptype;
+	put_bigendian_uint24(&rawmap[1], slot->complen);
+	put_bigendian_uint48(&rawmap[4], writer->curoffset);
+	put_bigendian_uint16(&rawmap[10], crc16(slot->data, writer->hunkbytes));
+
+	if (writer->err == CHDERR_NONE &&
+			filestream_write(writer->file, data, slot->complen) != slot->complen)
+		writer->err = CHDERR_WRITE_ERROR;
+
+	writer->curoffset += slot->complen;
+	writer->written++;
+}
+
+#ifdef HAVE_THREADS
+static void writer_worker_thread(void *userdata)
+{
+	writer_worker *worker = (writer_worker*)userdata;
+	chd_writer *writer = worker->writer;
+	hunk_compressor *compressor = worker->compressor;
+	free(worker);
+
+	slock_lock(writer->lock);
+	for (;;)
+	{
+		hunk_slot *slot;
+		while (writer->taken == writer->submitted && !writer->quit)
+			scond_wait(writer->work, writer->lock);
+		if (writer->taken == writer->submitted)
+			break;
+
+		/* claim the oldest pending hunk and compress it unlocked */
+		slot = &writer->slots[writer->taken++ % writer->numslots];
+		slock_unlock(writer->lock);
+
+		hunk_compress(writer, compressor, slot);
+
+		slock_lock(writer->lock);
+		slot->done = 1;
+		scond_broadcast(writer->done);
+	}
+	slock_unlock(writer->lock);
+}
+#endif
+
+/* store the oldest hunk in flight once it is compressed */
+static void writer_flush_one(chd_writer *writer)
+{
+	hunk_slot *slot = &writer->slots[writer->written % writer->numslots];
+
+#ifdef HAVE_THREADS
+	if (writer->numthreads > 0)
+	{
+		slock_lock(writer->lock);
+		while (!slot->done)
+			scond_wait(writer->done, writer->lock);
+		slock_unlock(writer->lock);
+	}
+#endif
+
+	hunk_store(writer, slot);
+}
+
+/***************************************************************************
+    MAP COMPRESSION
+***************************************************************************/
+
+/* MSB-first bit writer matching the reader's bitstream */
+typedef struct _map_bitwriter map_bitwriter;
+struct _map_bitwriter
+{
+	UINT8 *				data;
+	UINT32				doffset;
+	UINT64				accum;
+	int					bits;
+};
+
+static void map_bits_write(map_bitwriter *bw, UINT32 value, int numbits)
+{
+	if (numbits == 0)
+		return;
+	bw->accum = (bw->accum << numbits) | (value & (UINT32)(((UINT64)1 << numbits) - 1));
+	bw->bits += numbits;
+	while (bw->bits >= 8)
+	{
+		bw->bits -= 8;
+		bw->data[bw->doffset++] = (UINT8)(bw->accum >> bw->bits);
+	}
+}
+
+static void map_bits_flush(map_bitwriter *bw)
+{
+	if (bw->bits > 0)
+		bw->data[bw->doffset++] = (UINT8)(bw->accum << (8 - bw->bits));
+	bw->bits = 0;
+}
+
+static int bits_for_value(UINT64 value)
+{
+	int result = 0;
+	while (value != 0)
+		value >>= 1, result++;
+	return result;
+}
+
+/* write one run of tree code lengths in huffman_import_tree_rle's format */
+static void map_write_tree_run(map_bitwriter *bw, int value, int repcount, int numbits)
+{
+	while (repcount > 0)
+	{
+		/* a 1 is escaped as a double 1 */
+		if (value == 1)
+		{
+			map_bits_write(bw, 1, numbits);
+			map_bits_write(bw, 1, numbits);
+			repcount--;
+		}
+		/* short runs are cheaper raw */
+		else if (repcount <= 2)
+		{
+			map_bits_write(bw, value, numbits);
+			repcount--;
+		}
+		/* 1, value, count - 3 */
+		else
+		{
+			int reps = repcount - 3;
+			if (reps > (1 << numbits) - 1)
+				reps = (1 << numbits) - 1;
+			map_bits_write(bw, 1, numbits);
+			map_bits_write(bw, value, numbits);
+			map_bits_write(bw, reps, numbits);
+			repcount -= reps + 3;
+		}
+	}
+}
+
+/* turn the hunk types into literal and RLE symbols for the
+ * decoder in decompress_v5_map_types */
+static UINT32 map_type_symbols(const chd_writer *writer, UINT8 *symbols)
+{
+	UINT32 numsymbols = 0;
+	UINT32 hunknum = 0;
+	UINT8 lastcomp = 0;
+
+	while (hunknum < writer->hunkcount)
+	{
+		UINT8 curcomp = writer->rawmap[hunknum * MAP_ENTRY_BYTES];
+		UINT32 run = 1;
+		while (hunknum + run < writer->hunkcount &&
+				writer->rawmap[(hunknum + run) * MAP_ENTRY_BYTES] == curcomp)
+			run++;
+		hunknum += run;
+
+		/* a change of type is always spelled out */
+		if (curcomp != lastcomp)
+		{
+			symbols[numsymbols++] = lastcomp = curcomp;
+			run--;
+		}
+
+		/* the RLE symbols stand for their own hunk plus 2+count more */
+		while (run > 0)
+		{
+			if (run >= 3 + 16)
+			{
+				UINT32 count = (run > 3 + 16 + 255) ? 255 : run - 3 - 16;
+				symbols[numsymbols++] = COMPRESSION_RLE_LARGE;
+				symbols[numsymbols++] = count >> 4;
+				symbols[numsymbols++] = count & 15;
+				run -= 3 + 16 + count;
+			}
+			else if (run >= 3)
+			{
+				symbols[numsymbols++] = COMPRESSION_RLE_SMALL;
+				symbols[numsymbols++] = run - 3;
+				run = 0;
+			}
+			else
+			{
+				symbols[numsymbols++] = curcomp;
+				run--;
+			}
+		}
+	}
+	return numsymbols;
+}
+
+static chd_error writer_write_map(chd_writer *writer)
+{
+	struct huffman_decoder encoder;
+	struct node_t nodes[MAP_TYPE_CODES * 2];
+	uint32_t histo[MAP_TYPE_CODES];
+	UINT8 rawheader[MAP_HEADER_SIZE];
+	map_bitwriter bw;
+	UINT8 *symbols;
+	UINT32 numsymbols, i, hunknum, maxlength = 0;
+	int lengthbits, lastval, repcount;
+	chd_error err = CHDERR_NONE;
+
+	symbols = (UINT8*)malloc(writer->hunkcount + 3);
+	memset(&bw, 0, sizeof(bw));
+	bw.data = (UINT8*)malloc(64 + (size_t)writer->hunkcount * 8);
+	if (symbols == NULL || bw.data == NULL)
+	{
+		free(symbols);
+		free(bw.data);
+		return CHDERR_OUT_OF_MEMORY;
+	}
+
+	/* build a tree for the type symbols; the decoder struct doubles
+	 * as the encoder, with room for the interior nodes */
+	numsymbols = map_type_symbols(writer, symbols);
+	memset(histo, 0, sizeof(histo));
+	for (i = 0; i < numsymbols; i++)
+		histo[symbols[i]]++;
+
+	memset(&encoder, 0, sizeof(encoder));
+	encoder.numcodes  = MAP_TYPE_CODES;
+	encoder.maxbits   = MAP_TYPE_MAXBITS;
+	encoder.huffnode  = nodes;
+	encoder.datahisto = histo;
+	if (huffman_compute_tree_from_histo(&encoder) != HUFFERR_NONE)
+	{
+		err = CHDERR_COMPRESSION_ERROR;
+		goto cleanup;
+	}
+
+	/* export the tree, 4 bits per code length */
+	lastval  = -1;
+	repcount = 0;
+	for (i = 0; i < MAP_TYPE_CODES; i++)
+	{
+		if (nodes[i].numbits == lastval)
+			repcount++;
+		else
+		{
+			if (repcount != 0)
+				map_write_tree_run(&bw, lastval, repcount, 4);
+			lastval  = nodes[i].numbits;
+			repcount = 1;
+		}
+	}
+	map_write_tree_run(&bw, lastval, repcount, 4);
+
+	/* then the types */
+	for (i = 0; i < numsymbols; i++)
+		map_bits_write(&bw, nodes[symbols[i]].bits, nodes[symbols[i]].numbits);
+
+	/* then the lengths and CRCs; offsets are implied by the order */
+	for (hunknum = 0; hunknum < writer->hunkcount; hunknum++)
+	{
+		const UINT8 *rawmap = &writer->rawmap[hunknum * MAP_ENTRY_BYTES];
+		UINT32 length = (rawmap[1] << 16) | (rawmap[2] << 8) | rawmap[3];
+		if (rawmap[0] < COMPRESSION_NONE && length > maxlength)
+			maxlength = length;
+	}
+	lengthbits = bits_for_value(maxlength);
+
+	for (hunknum = 0; hunknum < writer->hunkcount; hunknum++)
+	{
+		const UINT8 *rawmap = &writer->rawmap[hunknum * MAP_ENTRY_BYTES];
+		if (rawmap[0] < COMPRESSION_NONE)
+			map_bits_write(&bw, (rawmap[1] << 16) | (rawmap[2] << 8) | rawmap[3], lengthbits);
+		map_bits_write(&bw, (rawmap[10] << 8) | rawmap[11], 16);
+	}
+	map_bits_flush(&bw);
+
+	memset(rawheader, 0, sizeof(rawheader));
+	put_bigendian_uint32(&rawheader[0], bw.doffset);
+	put_bigendian_uint48(&rawheader[4], CHD_V5_HEADER_SIZE);
+	put_bigendian_uint16(&rawheader[10], crc16(writer->rawmap, writer->hunkcount * MAP_ENTRY_BYTES));
+	rawheader[12] = lengthbits;
+	rawheader[13] = 0;	/* selfbits */
+	rawheader[14] = 0;	/* parentbits */
+
+	if (filestream_write(writer->file, rawheader, sizeof(rawheader)) != sizeof(rawheader) ||
+			filestream_write(writer->file, bw.data, bw.doffset) != bw.doffset)
+		err = CHDERR_WRITE_ERROR;
+	writer->curoffset += sizeof(rawheader) + bw.doffset;
+
+cleanup:
+	free(symbols);
+	free(bw.data);
+	return err;
+}
+
+/***************************************************************************
+    CHD WRITER INTERFACES
+***************************************************************************/
+
+static void writer_free(chd_writer *writer)
+{
+	UINT32 i;
+
+#ifdef HAVE_THREADS
+	if (writer->threads != NULL)
+	{
+		slock_lock(writer->lock);
+		writer->quit = 1;
+		scond_broadcast(writer->work);
+		slock_unlock(writer->lock);
+		for (i = 0; i < (UINT32)writer->numthreads; i++)
+			if (writer->threads[i] != NULL)
+				sthread_join(writer->threads[i]);
+		free(writer->threads);
+	}
+	if (writer->workers != NULL)
+	{
+		for (i = 0; i < (UINT32)writer->numthreads; i++)
+			hunk_compressor_free(writer, &writer->workers[i]);
+		free(writer->workers);
+	}
+	if (writer->work != NULL)
+		scond_free(writer->work);
+	if (writer->done != NULL)
+		scond_free(writer->done);
+	if (writer->lock != NULL)
+		slock_free(writer->lock);
+#endif
+
+	hunk_compressor_free(writer, &writer->compressor);
+
+	if (writer->slots != NULL)
+	{
+		for (i = 0; i < writer->numslots; i++)
+		{
+			free(writer->slots[i].data);
+			free(writer->slots[i].compressed);
+		}
+		free(writer->slots);
+	}
+
+	while (writer->metadata != NULL)
+	{
+		pending_metadata *next = writer->metadata->next;
+		free(writer->metadata);
+		writer->metadata = next;
+	}
+
+	free(writer->rawmap);
+	if (writer->file != NULL)
+		filestream_close(writer->file);
+	free(writer);
+}
+
+#ifdef HAVE_THREADS
+static chd_error writer_start_threads(chd_writer *writer, int threads)
+{
+	int i;
+
+	writer->lock    = slock_new();
+	writer->work    = scond_new();
+	writer->done    = scond_new();
+	writer->threads = (sthread_t**)calloc(threads, sizeof(*writer->threads));
+	writer->workers = (hunk_compressor*)calloc(threads, sizeof(*writer->workers));
+	if (writer->lock == NULL || writer->work == NULL || writer->done == NULL ||
+			writer->threads == NULL || writer->workers == NULL)
+		return CHDERR_OUT_OF_MEMORY;
+
+	for (i = 0; i < threads; i++)
+	{
+		writer_worker *worker;
+		chd_error err = hunk_compressor_init(writer, &writer->workers[i]);
+		if (err != CHDERR_NONE)
+			return err;
+		writer->numthreads = i + 1;
+
+		worker = (writer_worker*)malloc(sizeof(*worker));
+		if (worker == NULL)
+			return CHDERR_OUT_OF_MEMORY;
+		worker->writer     = writer;
+		worker->compressor = &writer->workers[i];
+		writer->threads[i] = sthread_create(writer_worker_thread, worker);
+		if (writer->threads[i] == NULL)
+		{
+			free(worker);
+			return CHDERR_OUT_OF_MEMORY;
+		}
+	}
+	return CHDERR_NONE;
+}
+#endif
+
+/*-------------------------------------------------
+    chd_writer_create - create a new V5 CHD file
+    and prepare it for writing hunks
+-------------------------------------------------*/
+
+chd_error chd_writer_create(const char *filename, UINT64 logicalbytes, UINT32 hunkbytes, UINT32 unitbytes, const UINT32 compression[4], int threads, chd_writer **writer)
+{
+	UINT8 rawheader[CHD_V5_HEADER_SIZE];
+	chd_writer *newwriter;
+	chd_error err;
+	UINT32 i;
+
+	if (filename == NULL || writer == NULL || compression == NULL)
+		return CHDERR_INVALID_PARAMETER;
+	*writer = NULL;
+
+	/* validate the geometry */
+	if (logicalbytes == 0 || hunkbytes == 0 || unitbytes == 0 ||
+			hunkbytes % unitbytes != 0 || hunkbytes >= (1 << 24))
+		return CHDERR_INVALID_PARAMETER;
+	if ((logicalbytes + hunkbytes - 1) / hunkbytes > 0xffffffff / MAP_ENTRY_BYTES)
+		return CHDERR_INVALID_PARAMETER;
+
+	/* the reader only handles compressed V5 maps, so the first slot
+	 * must name a codec */
+	if (compression[0] == CHDCOMPRESSION_NONE)
+		return CHDERR_NOT_SUPPORTED;
+
+	newwriter = (chd_writer*)calloc(1, sizeof(*newwriter));
+	if (newwriter == NULL)
+		return CHDERR_OUT_OF_MEMORY;
+
+	newwriter->logicalbytes = logicalbytes;
+	newwriter->hunkbytes    = hunkbytes;
+	newwriter->unitbytes    = unitbytes;
+	newwriter->hunkcount    = (UINT32)((logicalbytes + hunkbytes - 1) / hunkbytes);
+	newwriter->curoffset    = CHD_V5_HEADER_SIZE;
+	newwriter->metatail     = &newwriter->metadata;
+
+	for (i = 0; i < 4; i++)
+	{
+		newwriter->compression[i] = compression[i];
+		if (compression[i] == CHDCOMPRESSION_NONE)
+			continue;
+		newwriter->encoder[i] = find_encoder(compression[i]);
+		if (newwriter->encoder[i] == NULL)
+		{
+			err = CHDERR_UNSUPPORTED_FORMAT;
+			goto cleanup;
+		}
+	}
+
+	newwriter->rawmap = (UINT8*)malloc((size_t)newwriter->hunkcount * MAP_ENTRY_BYTES);
+	if (newwriter->rawmap == NULL)
+	{
+		err = CHDERR_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+#ifndef HAVE_THREADS
+	threads = 0;
+#endif
+	if (threads <= 1)
+		threads = 0;
+
+	/* two hunks in flight per worker keeps them busy while the
+	 * caller fills the next one */
+	newwriter->numslots = (threads > 0) ? threads * 2 : 1;
+	newwriter->slots    = (hunk_slot*)calloc(newwriter->numslots, sizeof(hunk_slot));
+	if (newwriter->slots == NULL)
+	{
+		err = CHDERR_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+	for (i = 0; i < newwriter->numslots; i++)
+	{
+		newwriter->slots[i].data       = (UINT8*)malloc(hunkbytes);
+		newwriter->slots[i].compressed = (UINT8*)malloc(hunkbytes);
+		if (newwriter->slots[i].data == NULL || newwriter->slots[i].compressed == NULL)
+		{
+			err = CHDERR_OUT_OF_MEMORY;
+			goto cleanup;
+		}
+	}
+
+#ifdef HAVE_THREADS
+	if (threads > 0)
+		err = writer_start_threads(newwriter, threads);
+	else
+#endif
+		err = hunk_compressor_init(newwriter, &newwriter->compressor);
+	if (err != CHDERR_NONE)
+		goto cleanup;
+
+	newwriter->file = filestream_open(filename,
+			RETRO_VFS_FILE_ACCESS_WRITE, RETRO_VFS_FILE_ACCESS_HINT_NONE);
+	if (newwriter->file == NULL)
+	{
+		err = CHDERR_CANT_CREATE_FILE;
+		goto cleanup;
+	}
+
+	/* reserve room for the header; it is filled in on close */
+	memset(rawheader, 0, sizeof(rawheader));
+	if (filestream_write(newwriter->file, rawheader, sizeof(rawheader)) != sizeof(rawheader))
+	{
+		err = CHDERR_WRITE_ERROR;
+		goto cleanup;
+	}
+
+	*writer = newwriter;
+	return CHDERR_NONE;
+
+cleanup:
+	writer_free(newwriter);
+	return err;
+}
+
+/*-------------------------------------------------
+    chd_writer_write - hand over the next hunk;
+    it is stored once it is compressed
+-------------------------------------------------*/
+
+chd_error chd_writer_write(chd_writer *writer, const void *buffer)
+{
+	hunk_slot *slot;
+
+	if (writer == NULL || buffer == NULL)
+		return CHDERR_INVALID_PARAMETER;
+	if (writer->submitted >= writer->hunkcount)
+		return CHDERR_HUNK_OUT_OF_RANGE;
+
+	/* make room by storing the oldest hunk in flight */
+	if (writer->submitted - writer->written == writer->numslots)
+		writer_flush_one(writer);
+	if (writer->err != CHDERR_NONE)
+		return writer->err;
+
+	slot = &writer->slots[writer->submitted % writer->numslots];
+	memcpy(slot->data, buffer, writer->hunkbytes);
+	slot->done = 0;
+
+#ifdef HAVE_THREADS
+	if (writer->numthreads > 0)
+	{
+		slock_lock(writer->lock);
+		writer->submitted++;
+		scond_signal(writer->work);
+		slock_unlock(writer->lock);
+		return CHDERR_NONE;
+	}
+#endif
+
+	hunk_compress(writer, &writer->compressor, slot);
+	slot->done = 1;
+	writer->submitted++;
+	writer_flush_one(writer);
+	return writer->err;
+}
+
+/*-------------------------------------------------
+    chd_writer_add_metadata - queue a metadata
+    entry for the end of the file
+-------------------------------------------------*/
+
+chd_error chd_writer_add_metadata(chd_writer *writer, UINT32 metatag, const void *data, UINT32 datalen, UINT8 flags)
+{
+	pending_metadata *entry;
+
+	if (writer == NULL || metatag == CHDMETATAG_WILDCARD || (data == NULL && datalen != 0))
+		return CHDERR_INVALID_PARAMETER;
+	if (datalen >= (1 << 24))
+		return CHDERR_INVALID_METADATA_SIZE;
+
+	entry = (pending_metadata*)malloc(sizeof(*entry) + datalen);
+	if (entry == NULL)
+		return CHDERR_OUT_OF_MEMORY;
+	entry->next    = NULL;
+	entry->metatag = metatag;
+	entry->length  = datalen;
+	entry->flags   = flags;
+	if (datalen != 0)
+		memcpy(entry->data, data, datalen);
+
+	*writer->metatail = entry;
+	writer->metatail  = &entry->next;
+	return CHDERR_NONE;
+}
+
+/*-------------------------------------------------
+    chd_writer_close - store the remaining hunks,
+    the map, the metadata and the header, then
+    close the file
+-------------------------------------------------*/
+
+chd_error chd_writer_close(chd_writer *writer)
+{
+	UINT8 rawheader[CHD_V5_HEADER_SIZE];
+	UINT64 mapoffset, metaoffset = 0;
+	pending_metadata *entry;
+	chd_error err;
+	UINT8 *zeroes;
+	int i;
+
+	if (writer == NULL)
+		return CHDERR_INVALID_PARAMETER;
+
+	/* hunks the caller never wrote read back as zeroes */
+	if (writer->submitted < writer->hunkcount)
+	{
+		zeroes = (UINT8*)calloc(1, writer->hunkbytes);
+		if (zeroes == NULL)
+			writer->err = CHDERR_OUT_OF_MEMORY;
+		while (writer->err == CHDERR_NONE && writer->submitted < writer->hunkcount)
+			chd_writer_write(writer, zeroes);
+		free(zeroes);
+	}
+	while (writer->written < writer->submitted)
+		writer_flush_one(writer);
+
+	err = writer->err;
+	if (err != CHDERR_NONE)
+		goto cleanup;
+
+	mapoffset = writer->curoffset;
+	err = writer_write_map(writer);
+	if (err != CHDERR_NONE)
+		goto cleanup;
+
+	/* chain the metadata entries behind the map */
+	if (writer->metadata != NULL)
+		metaoffset = writer->curoffset;
+	for (entry = writer->metadata; entry != NULL; entry = entry->next)
+	{
+		UINT8 metaheader[METADATA_HEADER_SIZE];
+		UINT64 next = 0;
+		if (entry->next != NULL)
+			next = writer->curoffset + METADATA_HEADER_SIZE + entry->length;
+
+		put_bigendian_uint32(&metaheader[0], entry->metatag);
+		put_bigendian_uint32(&metaheader[4], ((UINT32)entry->flags << 24) | entry->length);
+		put_bigendian_uint64(&metaheader[8], next);
+		if (filestream_write(writer->file, metaheader, sizeof(metaheader)) != sizeof(metaheader) ||
+				filestream_write(writer->file, entry->data, entry->length) != entry->length)
+		{
+			err = CHDERR_WRITE_ERROR;
+			goto cleanup;
+		}
+		writer->curoffset += METADATA_HEADER_SIZE + entry->length;
+	}
+
+	/* finally the header; the SHA1 fields are left clear */
+	memset(rawheader, 0, sizeof(rawheader));
+	memcpy(&rawheader[0], "MComprHD", 8);
+	put_bigendian_uint32(&rawheader[8], CHD_V5_HEADER_SIZE);
+	put_bigendian_uint32(&rawheader[12], 5);
+	for (i = 0; i < 4; i++)
+		put_bigendian_uint32(&rawheader[16 + i * 4], writer->compression[i]);
+	put_bigendian_uint64(&rawheader[32], writer->logicalbytes);
+	put_bigendian_uint64(&rawheader[40], mapoffset);
+	put_bigendian_uint64(&rawheader[48], metaoffset);
+	put_bigendian_uint32(&rawheader[56], writer->hunkbytes);
+	put_bigendian_uint32(&rawheader[60], writer->unitbytes);
+
+	filestream_seek(writer->file, 0, RETRO_VFS_SEEK_POSITION_START);
+	if (filestream_write(writer->file, rawheader, sizeof(rawheader)) != sizeof(rawheader))
+		err = CHDERR_WRITE_ERROR;
+
+cleanup:
+	writer_free(writer);
+	return err;
+}
@@ -135,6 +135,7 @@ struct huffman_decoder* create_huffman_decoder(int numcodes, int maxbits)
 	decoder->lookup = (lookup_value*)malloc(sizeof(lookup_value) * (1 << maxbits));
 	decoder->huffnode = (struct node_t*)malloc(sizeof(struct node_t) * numcodes);
 	decoder->datahisto = NULL;
+	decoder->multi = NULL;
 	decoder->prevdata = 0;
 	decoder->rleremaining = 0;
 	return decoder;
@@ -148,6 +149,8 @@ void delete_huffman_decoder(struct huffman_decoder* decoder)
 			free(decoder->lookup);
 		if (decoder->huffnode != NULL)
 			free(decoder->huffnode);
+		if (decoder->multi != NULL)
+			free(decoder->multi);
 		free(decoder);
 	}
 }
@@ -171,6 +174,69 @@ uint32_t huffman_decode_one(struct huffman_decoder* decoder, struct bitstream* b
 	return lookup >> 5;
 }
 
+/*-------------------------------------------------
+ *  build_multi_table - build a lookup table that
+ *  resolves several short codes per probe; must
+ *  be called after the tree has been imported
+ *-------------------------------------------------
+ */
+
+enum huffman_error huffman_build_multi_table(struct huffman_decoder* decoder)
+{
+	uint32_t index;
+	int shift = HUFFMAN_MULTI_BITS - decoder->maxbits;
+
+	/* a single code must always fit in one probe */
+	if (shift < 0)
+		return HUFFERR_TOO_MANY_BITS;
+
+	if (decoder->multi == NULL)
+	{
+		decoder->multi = (struct huffman_multi_entry*)malloc(
+				sizeof(struct huffman_multi_entry) << HUFFMAN_MULTI_BITS);
+		if (decoder->multi == NULL)
+			return HUFFERR_INTERNAL_INCONSISTENCY;
+	}
+
+	for (index = 0; index < (1u << HUFFMAN_MULTI_BITS); index++)
+	{
+		struct huffman_multi_entry *entry = &decoder->multi[index];
+		int used = 0;
+
+		entry->count = 0;
+		while (entry->count < HUFFMAN_MULTI_SYMBOLS)
+		{
+			/* the next maxbits of input, zero-padded past the probe */
+			uint32_t bits = (index << used) & ((1u << HUFFMAN_MULTI_BITS) - 1);
+			lookup_value lookup = decoder->lookup[bits >> shift];
+			int numbits = lookup & 0x1f;
+
+			/* stop once a code runs past the bits we actually have;
+			 * the first code always fits since maxbits <= the probe */
+			if (entry->count > 0 && (numbits == 0 || used + numbits > HUFFMAN_MULTI_BITS))
+				break;
+
+			entry->symbol[entry->count]  = lookup >> 5;
+			entry->numbits[entry->count] = numbits;
+			entry->count++;
+			used += numbits;
+		}
+	}
+
+	return HUFFERR_NONE;
+}
+
+/*-------------------------------------------------
+ *  peek_multi - look up the codes at the front of
+ *  the stream without consuming them
+ *-------------------------------------------------
+ */
+
+const struct huffman_multi_entry *huffman_peek_multi(struct huffman_decoder* decoder, struct bitstream* bitbuf)
+{
+	return &decoder->multi[bitstream_peek(bitbuf, HUFFMAN_MULTI_BITS)];
+}
+
 /*-------------------------------------------------
  *  import_tree_rle - import an RLE-encoded
  *  huffman tree from a source data stream
@@ -35,8 +35,40 @@
 #include <streams/trans_stream.h>
 #include <string/stdstring.h>
 
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
 #include "rpng_internal.h"
 
+/* Row unfiltering and pixel expansion have SIMD versions for the
+ * common 8-bit formats; define RPNG_NO_SIMD to leave them out. */
+#ifndef RPNG_NO_SIMD
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define RPNG_SSE2
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#define RPNG_SSSE3
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#define RPNG_AVX2
+#endif
+#elif (defined(__ARM_NEON__) || defined(__ARM_NEON)) && !defined(DONT_WANT_ARM_OPTIMIZATIONS)
+#include <arm_neon.h>
+#define RPNG_NEON
+#endif
+#endif
+
+#ifdef HAVE_THREADS
+/* Images inflating to less than this are decoded on the calling thread,
+ * where starting threads would cost more than it saves. */
+#define RPNG_THREADED_MIN_BYTES (256 * 1024)
+/* Inflated bytes handed from the inflate thread to the row filters at a time. */
+#define RPNG_INFLATE_BAND       (64 * 1024)
+#endif
+
 enum png_ihdr_color_type
 {
    PNG_IHDR_COLOR_GRAY       = 0,
@@ -78,6 +110,7 @@ struct idat_buffer
 {
    uint8_t *data;
    size_t size;
+   size_t capacity;
 };
 
 struct png_chunk
@@ -114,7 +147,34 @@ struct rpng_process
    uint32_t *palette;
    void *stream;
    const struct trans_stream_backend *stream_backend;
+#ifdef HAVE_THREADS
+   /* Set when a thread inflates into inflate_buf while rows are
+    * unfiltered; "inflated" is how far it got. */
+   sthread_t *inflate_thread;
+   slock_t *lock;
+   scond_t *cond;
+   size_t inflated;
+   bool inflate_done;
+   bool inflate_failed;
+   /* Rows wait on this process to inflate them; the data of this
+    * process starts inflate_offset bytes into its inflate_buf. */
+   struct rpng_process *inflater;
+   uint8_t *inflate_base;
+   size_t inflate_offset;
+   size_t inflated_seen;
+   struct png_adam7_job *adam7_jobs;
+#endif
+};
+
+#ifdef HAVE_THREADS
+/* One Adam7 pass, unfiltered on its own thread into its own buffer. */
+struct png_adam7_job
+{
+   struct rpng_process pass;
+   sthread_t *thread;
+   bool failed;
 };
+#endif
 
 struct rpng
 {
@@ -153,7 +213,8 @@ static enum png_chunk_type png_chunk_type(const struct png_chunk *chunk)
 
    for (i = 0; i < ARRAY_SIZE(chunk_map); i++)
    {
-      if (string_is_equal(chunk->type, chunk_map[i].id))
+      /* The type is four letters, with no terminator */
+      if (!memcmp(chunk->type, chunk_map[i].id, sizeof(chunk->type)))
          return chunk_map[i].type;
    }
 
@@ -229,14 +290,66 @@ end:
    return ret;
 }
 
+#ifdef HAVE_THREADS
+/* Blocks until the inflate thread has written "bytes" bytes of data for
+ * pngp, and returns false if the stream ended or failed before that. */
+static bool rpng_process_wait(struct rpng_process *pngp, size_t bytes)
+{
+   struct rpng_process *inflater = pngp->inflater;
+   bool ret;
+
+   bytes += pngp->inflate_offset;
+
+   if (bytes <= pngp->inflated_seen)
+      return true;
+
+   slock_lock(inflater->lock);
+   while (inflater->inflated < bytes && !inflater->inflate_done)
+      scond_wait(inflater->cond, inflater->lock);
+   pngp->inflated_seen = inflater->inflated;
+   ret = !inflater->inflate_failed && inflater->inflated >= bytes;
+   slock_unlock(inflater->lock);
+
+   return ret;
+}
+#endif
+
 static void png_reverse_filter_copy_line_rgb(uint32_t *data,
       const uint8_t *decoded, unsigned width, unsigned bpp)
 {
-   unsigned i;
+   unsigned i = 0;
 
    bpp /= 8;
 
-   for (i = 0; i < width; i++)
+   if (bpp == 1)
+   {
+#if defined(RPNG_SSSE3)
+      const __m128i shuf  = _mm_setr_epi8(
+            2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+      const __m128i alpha = _mm_set1_epi32((int)0xff000000u);
+
+      /* Four pixels per 16 byte load, which must stay inside the row */
+      for (; i + 6 <= width; i += 4, decoded += 12)
+      {
+         __m128i px = _mm_loadu_si128((const __m128i*)decoded);
+         _mm_storeu_si128((__m128i*)(data + i),
+               _mm_or_si128(_mm_shuffle_epi8(px, shuf), alpha));
+      }
+#elif defined(RPNG_NEON)
+      for (; i + 8 <= width; i += 8, decoded += 24)
+      {
+         uint8x8x3_t rgb = vld3_u8(decoded);
+         uint8x8x4_t out;
+         out.val[0] = rgb.val[2];
+         out.val[1] = rgb.val[1];
+         out.val[2] = rgb.val[0];
+         out.val[3] = vdup_n_u8(0xff);
+         vst4_u8((uint8_t*)(data + i), out);
+      }
+#endif
+   }
+
+   for (; i < width; i++)
    {
       uint32_t r, g, b;
 
@@ -253,11 +366,39 @@ static void png_reverse_filter_copy_line_rgb(uint32_t *data,
 static void png_reverse_filter_copy_line_rgba(uint32_t *data,
       const uint8_t *decoded, unsigned width, unsigned bpp)
 {
-   unsigned i;
+   unsigned i = 0;
 
    bpp /= 8;
 
-   for (i = 0; i < width; i++)
+   if (bpp == 1)
+   {
+#if defined(RPNG_SSE2)
+      const __m128i ga = _mm_set1_epi32((int)0xff00ff00u);
+      const __m128i lo = _mm_set1_epi32(0xff);
+
+      /* RGBA bytes are ABGR words; swap R and B */
+      for (; i + 4 <= width; i += 4, decoded += 16)
+      {
+         __m128i px = _mm_loadu_si128((const __m128i*)decoded);
+         __m128i rb = _mm_or_si128(
+               _mm_slli_epi32(_mm_and_si128(px, lo), 16),
+               _mm_and_si128(_mm_srli_epi32(px, 16), lo));
+         _mm_storeu_si128((__m128i*)(data + i),
+               _mm_or_si128(_mm_and_si128(px, ga), rb));
+      }
+#elif defined(RPNG_NEON)
+      for (; i + 8 <= width; i += 8, decoded += 32)
+      {
+         uint8x8x4_t px = vld4_u8(decoded);
+         uint8x8_t   r  = px.val[0];
+         px.val[0]      = px.val[2];
+         px.val[2]      = r;
+         vst4_u8((uint8_t*)(data + i), px);
+      }
+#endif
+   }
+
+   for (; i < width; i++)
    {
       uint32_t r, g, b, a;
       r        = *decoded;
@@ -292,8 +433,40 @@ static void png_reverse_filter_copy_line_bw(uint32_t *data,
    mul  = mul_table[depth];
    mask = (1 << depth) - 1;
    bit  = 0;
+   i    = 0;
+
+   if (depth == 8)
+   {
+#if defined(RPNG_SSE2)
+      const __m128i ff = _mm_set1_epi8((char)0xff);
+
+      for (; i + 16 <= width; i += 16)
+      {
+         __m128i g  = _mm_loadu_si128((const __m128i*)(decoded + i));
+         __m128i gg = _mm_unpacklo_epi8(g, g);
+         __m128i gf = _mm_unpacklo_epi8(g, ff);
+         _mm_storeu_si128((__m128i*)(data + i +  0), _mm_unpacklo_epi16(gg, gf));
+         _mm_storeu_si128((__m128i*)(data + i +  4), _mm_unpackhi_epi16(gg, gf));
+         gg = _mm_unpackhi_epi8(g, g);
+         gf = _mm_unpackhi_epi8(g, ff);
+         _mm_storeu_si128((__m128i*)(data + i +  8), _mm_unpacklo_epi16(gg, gf));
+         _mm_storeu_si128((__m128i*)(data + i + 12), _mm_unpackhi_epi16(gg, gf));
+      }
+#elif defined(RPNG_NEON)
+      for (; i + 8 <= width; i += 8)
+      {
+         uint8x8x4_t out;
+         out.val[0] = vld1_u8(decoded + i);
+         out.val[1] = out.val[0];
+         out.val[2] = out.val[0];
+         out.val[3] = vdup_n_u8(0xff);
+         vst4_u8((uint8_t*)(data + i), out);
+      }
+#endif
+      bit = i * 8;
+   }
 
-   for (i = 0; i < width; i++, bit += depth)
+   for (; i < width; i++, bit += depth)
    {
       unsigned byte = bit >> 3;
       unsigned val  = decoded[byte] >> (8 - depth - (bit & 7));
@@ -308,11 +481,38 @@ static void png_reverse_filter_copy_line_gray_alpha(uint32_t *data,
       const uint8_t *decoded, unsigned width,
       unsigned bpp)
 {
-   unsigned i;
+   unsigned i = 0;
 
    bpp /= 8;
 
-   for (i = 0; i < width; i++)
+   if (bpp == 1)
+   {
+#if defined(RPNG_SSE2)
+      const __m128i lo = _mm_set1_epi16(0xff);
+
+      for (; i + 8 <= width; i += 8, decoded += 16)
+      {
+         __m128i ga = _mm_loadu_si128((const __m128i*)decoded);
+         __m128i g  = _mm_and_si128(ga, lo);
+         __m128i gg = _mm_or_si128(g, _mm_slli_epi16(g, 8));
+         _mm_storeu_si128((__m128i*)(data + i + 0), _mm_unpacklo_epi16(gg, ga));
+         _mm_storeu_si128((__m128i*)(data + i + 4), _mm_unpackhi_epi16(gg, ga));
+      }
+#elif defined(RPNG_NEON)
+      for (; i + 8 <= width; i += 8, decoded += 16)
+      {
+         uint8x8x2_t ga = vld2_u8(decoded);
+         uint8x8x4_t out;
+         out.val[0] = ga.val[0];
+         out.val[1] = ga.val[0];
+         out.val[2] = ga.val[0];
+         out.val[3] = ga.val[1];
+         vst4_u8((uint8_t*)(data + i), out);
+      }
+#endif
+   }
+
+   for (; i < width; i++)
    {
       uint32_t gray, alpha;
 
@@ -415,9 +615,20 @@ static void png_reverse_filter_copy_line_plt(uint32_t *data,
 
       case 8:
          {
-            unsigned i;
+            unsigned i = 0;
 
-            for (i = 0; i < width; i++, decoded++, data++)
+#if defined(RPNG_AVX2)
+            /* The palette always has 256 entries, so any index is safe */
+            for (; i + 8 <= width; i += 8, decoded += 8, data += 8)
+            {
+               __m256i idx = _mm256_cvtepu8_epi32(
+                     _mm_loadl_epi64((const __m128i*)decoded));
+               _mm256_storeu_si256((__m256i*)data,
+                     _mm256_i32gather_epi32((const int*)palette, idx, 4));
+            }
+#endif
+
+            for (; i < width; i++, decoded++, data++)
             {
                *data = palette[*decoded];
             }
@@ -580,10 +791,246 @@ error:
    return -1;
 }
 
+#if defined(RPNG_SSE2) || defined(RPNG_NEON)
+/* The bpp 3 and 4 kernels below step one pixel at a time, as each
+ * pixel depends on the one to its left, and only touch bpp bytes. */
+#if defined(RPNG_SSE2)
+typedef __m128i png_pixel_t;
+
+static INLINE png_pixel_t png_load_pixel(const uint8_t *p, unsigned bpp)
+{
+   uint32_t v = 0;
+   memcpy(&v, p, bpp);
+   return _mm_cvtsi32_si128((int)v);
+}
+
+static INLINE void png_store_pixel(uint8_t *p, png_pixel_t px, unsigned bpp)
+{
+   uint32_t v = (uint32_t)_mm_cvtsi128_si32(px);
+   memcpy(p, &v, bpp);
+}
+
+#define png_pixel_zero()   _mm_setzero_si128()
+#define png_pixel_add(a, b) _mm_add_epi8(a, b)
+
+/* floor((a + b) / 2); pavgb rounds up, so take the odd bit back off */
+static INLINE png_pixel_t png_pixel_avg(png_pixel_t a, png_pixel_t b)
+{
+   return _mm_sub_epi8(_mm_avg_epu8(a, b),
+         _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+}
+
+static INLINE __m128i png_abs_epi16(__m128i x)
+{
+#if defined(RPNG_SSSE3)
+   return _mm_abs_epi16(x);
+#else
+   return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+#endif
+}
+
+static INLINE png_pixel_t png_pixel_paeth(png_pixel_t a8,
+      png_pixel_t b8, png_pixel_t c8)
+{
+   const __m128i zero = _mm_setzero_si128();
+   __m128i a  = _mm_unpacklo_epi8(a8, zero);
+   __m128i b  = _mm_unpacklo_epi8(b8, zero);
+   __m128i c  = _mm_unpacklo_epi8(c8, zero);
+   /* p = a + b - c, so |p - a| = |b - c| and so on */
+   __m128i bc = _mm_sub_epi16(b, c);
+   __m128i ac = _mm_sub_epi16(a, c);
+   __m128i pa = png_abs_epi16(bc);
+   __m128i pb = png_abs_epi16(ac);
+   __m128i pc = png_abs_epi16(_mm_add_epi16(bc, ac));
+   /* b unless pc < pb, then a unless the smaller of those beats pa */
+   __m128i use_c = _mm_cmplt_epi16(pc, pb);
+   __m128i pred  = _mm_or_si128(_mm_and_si128(use_c, c),
+         _mm_andnot_si128(use_c, b));
+   __m128i use_a = _mm_cmplt_epi16(pa, _mm_add_epi16(
+            _mm_min_epi16(pb, pc), _mm_set1_epi16(1)));
+   pred = _mm_or_si128(_mm_and_si128(use_a, a),
+         _mm_andnot_si128(use_a, pred));
+   return _mm_packus_epi16(pred, pred);
+}
+#else
+typedef uint8x8_t png_pixel_t;
+
+static INLINE png_pixel_t png_load_pixel(const uint8_t *p, unsigned bpp)
+{
+   uint32_t v = 0;
+   memcpy(&v, p, bpp);
+   return vreinterpret_u8_u32(vdup_n_u32(v));
+}
+
+static INLINE void png_store_pixel(uint8_t *p, png_pixel_t px, unsigned bpp)
+{
+   uint32_t v = vget_lane_u32(vreinterpret_u32_u8(px), 0);
+   memcpy(p, &v, bpp);
+}
+
+#define png_pixel_zero()    vdup_n_u8(0)
+#define png_pixel_add(a, b) vadd_u8(a, b)
+#define png_pixel_avg(a, b) vhadd_u8(a, b)
+
+static INLINE png_pixel_t png_pixel_paeth(png_pixel_t a,
+      png_pixel_t b, png_pixel_t c)
+{
+   /* p = a + b - c, so |p - a| = |b - c| and so on */
+   uint16x8_t pa     = vabdl_u8(b, c);
+   uint16x8_t pb     = vabdl_u8(a, c);
+   uint16x8_t pc     = vabdq_u16(vaddl_u8(a, b), vaddl_u8(c, c));
+   uint8x8_t  use_a  = vmovn_u16(vandq_u16(vcleq_u16(pa, pb), vcleq_u16(pa, pc)));
+   uint8x8_t  use_b  = vmovn_u16(vcleq_u16(pb, pc));
+   return vbsl_u8(use_a, a, vbsl_u8(use_b, b, c));
+}
+#endif
+
+static INLINE void png_reverse_filter_sub_simd(uint8_t *out,
+      const uint8_t *in, unsigned pitch, unsigned bpp)
+{
+   unsigned i;
+   png_pixel_t a = png_pixel_zero();
+
+   for (i = 0; i < pitch; i += bpp)
+   {
+      a = png_pixel_add(a, png_load_pixel(in + i, bpp));
+      png_store_pixel(out + i, a, bpp);
+   }
+}
+
+static INLINE void png_reverse_filter_avg_simd(uint8_t *out,
+      const uint8_t *prev, const uint8_t *in, unsigned pitch, unsigned bpp)
+{
+   unsigned i;
+   png_pixel_t a = png_pixel_zero();
+
+   for (i = 0; i < pitch; i += bpp)
+   {
+      a = png_pixel_add(png_pixel_avg(a, png_load_pixel(prev + i, bpp)),
+            png_load_pixel(in + i, bpp));
+      png_store_pixel(out + i, a, bpp);
+   }
+}
+
+static INLINE void png_reverse_filter_paeth_simd(uint8_t *out,
+      const uint8_t *prev, const uint8_t *in, unsigned pitch, unsigned bpp)
+{
+   unsigned i;
+   png_pixel_t a = png_pixel_zero();
+   png_pixel_t c = png_pixel_zero();
+
+   for (i = 0; i < pitch; i += bpp)
+   {
+      png_pixel_t b = png_load_pixel(prev + i, bpp);
+      a = png_pixel_add(png_pixel_paeth(a, b, c), png_load_pixel(in + i, bpp));
+      c = b;
+      png_store_pixel(out + i, a, bpp);
+   }
+}
+#endif
+
+static void png_reverse_filter_up(uint8_t *out, const uint8_t *prev,
+      const uint8_t *in, unsigned pitch)
+{
+   unsigned i = 0;
+
+#if defined(RPNG_SSE2)
+   for (; i + 16 <= pitch; i += 16)
+      _mm_storeu_si128((__m128i*)(out + i), _mm_add_epi8(
+               _mm_loadu_si128((const __m128i*)(prev + i)),
+               _mm_loadu_si128((const __m128i*)(in + i))));
+#elif defined(RPNG_NEON)
+   for (; i + 16 <= pitch; i += 16)
+      vst1q_u8(out + i, vaddq_u8(vld1q_u8(prev + i), vld1q_u8(in + i)));
+#endif
+
+   for (; i < pitch; i++)
+      out[i] = prev[i] + in[i];
+}
+
+static void png_reverse_filter_sub(uint8_t *out,
+      const uint8_t *in, unsigned pitch, unsigned bpp)
+{
+   unsigned i;
+
+#if defined(RPNG_SSE2) || defined(RPNG_NEON)
+   /* Constant bpp, so the pixel loads and stores inline */
+   if (bpp == 4)
+   {
+      png_reverse_filter_sub_simd(out, in, pitch, 4);
+      return;
+   }
+   if (bpp == 3)
+   {
+      png_reverse_filter_sub_simd(out, in, pitch, 3);
+      return;
+   }
+#endif
+
+   for (i = 0; i < bpp; i++)
+      out[i] = in[i];
+   for (i = bpp; i < pitch; i++)
+      out[i] = out[i - bpp] + in[i];
+}
+
+static void png_reverse_filter_avg(uint8_t *out, const uint8_t *prev,
+      const uint8_t *in, unsigned pitch, unsigned bpp)
+{
+   unsigned i;
+
+#if defined(RPNG_SSE2) || defined(RPNG_NEON)
+   if (bpp == 4)
+   {
+      png_reverse_filter_avg_simd(out, prev, in, pitch, 4);
+      return;
+   }
+   if (bpp == 3)
+   {
+      png_reverse_filter_avg_simd(out, prev, in, pitch, 3);
+      return;
+   }
+#endif
+
+   for (i = 0; i < bpp; i++)
+   {
+      uint8_t avg = prev[i] >> 1;
+      out[i] = avg + in[i];
+   }
+   for (i = bpp; i < pitch; i++)
+   {
+      uint8_t avg = (out[i - bpp] + prev[i]) >> 1;
+      out[i] = avg + in[i];
+   }
+}
+
+static void png_reverse_filter_paeth(uint8_t *out, const uint8_t *prev,
+      const uint8_t *in, unsigned pitch, unsigned bpp)
+{
+   unsigned i;
+
+#if defined(RPNG_SSE2) || defined(RPNG_NEON)
+   if (bpp == 4)
+   {
+      png_reverse_filter_paeth_simd(out, prev, in, pitch, 4);
+      return;
+   }
+   if (bpp == 3)
+   {
+      png_reverse_filter_paeth_simd(out, prev, in, pitch, 3);
+      return;
+   }
+#endif
+
+   for (i = 0; i < bpp; i++)
+      out[i] = paeth(0, prev[i], 0) + in[i];
+   for (i = bpp; i < pitch; i++)
+      out[i] = paeth(out[i - bpp], prev[i], prev[i - bpp]) + in[i];
+}
+
 static int png_reverse_filter_copy_line(uint32_t *data, const struct png_ihdr *ihdr,
       struct rpng_process *pngp, unsigned filter)
 {
-   unsigned i;
+   uint8_t *swap;
 
    switch (filter)
    {
@@ -591,33 +1038,20 @@ static int png_reverse_filter_copy_line(uint32_t *data, const struct png_ihdr *i
          memcpy(pngp->decoded_scanline, pngp->inflate_buf, pngp->pitch);
          break;
       case PNG_FILTER_SUB:
-         for (i = 0; i < pngp->bpp; i++)
-            pngp->decoded_scanline[i] = pngp->inflate_buf[i];
-         for (i = pngp->bpp; i < pngp->pitch; i++)
-            pngp->decoded_scanline[i] = pngp->decoded_scanline[i - pngp->bpp] + pngp->inflate_buf[i];
+         png_reverse_filter_sub(pngp->decoded_scanline,
+               pngp->inflate_buf, pngp->pitch, pngp->bpp);
          break;
       case PNG_FILTER_UP:
-         for (i = 0; i < pngp->pitch; i++)
-            pngp->decoded_scanline[i] = pngp->prev_scanline[i] + pngp->inflate_buf[i];
+         png_reverse_filter_up(pngp->decoded_scanline,
+               pngp->prev_scanline, pngp->inflate_buf, pngp->pitch);
          break;
       case PNG_FILTER_AVERAGE:
-         for (i = 0; i < pngp->bpp; i++)
-         {
-            uint8_t avg = pngp->prev_scanline[i] >> 1;
-            pngp->decoded_scanline[i] = avg + pngp->inflate_buf[i];
-         }
-         for (i = pngp->bpp; i < pngp->pitch; i++)
-         {
-            uint8_t avg = (pngp->decoded_scanline[i - pngp->bpp] + pngp->prev_scanline[i]) >> 1;
-            pngp->decoded_scanline[i] = avg + pngp->inflate_buf[i];
-         }
+         png_reverse_filter_avg(pngp->decoded_scanline,
+               pngp->prev_scanline, pngp->inflate_buf, pngp->pitch, pngp->bpp);
          break;
       case PNG_FILTER_PAETH:
-         for (i = 0; i < pngp->bpp; i++)
-            pngp->decoded_scanline[i] = paeth(0, pngp->prev_scanline[i], 0) + pngp->inflate_buf[i];
-         for (i = pngp->bpp; i < pngp->pitch; i++)
-            pngp->decoded_scanline[i] = paeth(pngp->decoded_scanline[i - pngp->bpp],
-                  pngp->prev_scanline[i], pngp->prev_scanline[i - pngp->bpp]) + pngp->inflate_buf[i];
+         png_reverse_filter_paeth(pngp->decoded_scanline,
+               pngp->prev_scanline, pngp->inflate_buf, pngp->pitch, pngp->bpp);
          break;
 
       default:
@@ -645,7 +1079,10 @@ static int png_reverse_filter_copy_line(uint32_t *data, const struct png_ihdr *i
          break;
    }
 
-   memcpy(pngp->prev_scanline, pngp->decoded_scanline, pngp->pitch);
+   /* This row is the next one's previous row */
+   swap                   = pngp->prev_scanline;
+   pngp->prev_scanline    = pngp->decoded_scanline;
+   pngp->decoded_scanline = swap;
 
    return IMAGE_PROCESS_NEXT;
 }
@@ -657,7 +1094,18 @@ static int png_reverse_filter_regular_iterate(uint32_t **data, const struct png_
 
    if (pngp->h < ihdr->height)
    {
-      unsigned filter = *pngp->inflate_buf++;
+      unsigned filter;
+
+#ifdef HAVE_THREADS
+      if (pngp->inflater && !rpng_process_wait(pngp,
+               pngp->restore_buf_size + 1 + pngp->pitch))
+      {
+         ret = IMAGE_PROCESS_ERROR_END;
+         goto end;
+      }
+#endif
+
+      filter = *pngp->inflate_buf++;
       pngp->restore_buf_size += 1;
       ret = png_reverse_filter_copy_line(*data,
             ihdr, pngp, filter);
@@ -763,88 +1211,344 @@ static int png_reverse_filter_adam7(uint32_t **data_,
    return ret;
 }
 
-static int png_reverse_filter_iterate(rpng_t *rpng, uint32_t **data)
+#ifdef HAVE_THREADS
+static void png_adam7_job_thread(void *data)
 {
-   if (!rpng)
-      return false;
+   struct png_adam7_job *job = (struct png_adam7_job*)data;
+   struct rpng_process *pass = &job->pass;
+   int ret;
 
-   if (rpng->ihdr.interlace && rpng->process)
-      return png_reverse_filter_adam7(data, &rpng->ihdr, rpng->process);
+   if (png_reverse_filter_init(&pass->ihdr, pass) == -1)
+   {
+      job->failed = true;
+      return;
+   }
 
-   return png_reverse_filter_regular_iterate(data, &rpng->ihdr, rpng->process);
+   do
+   {
+      ret = png_reverse_filter_regular_iterate(&pass->data, &pass->ihdr, pass);
+   } while (ret == IMAGE_PROCESS_NEXT);
+
+   if (ret != IMAGE_PROCESS_END)
+      job->failed = true;
 }
 
-static int rpng_load_image_argb_process_inflate_init(rpng_t *rpng, uint32_t **data)
+/* Starts one thread per non-empty pass. Each unfilters its part of
+ * inflate_buf as the inflate thread gets there. */
+static bool png_adam7_start_jobs(const struct png_ihdr *ihdr,
+      struct rpng_process *pngp)
 {
-   bool zstatus;
-   enum trans_stream_error terror;
-   uint32_t rd, wn;
-   struct rpng_process *process = (struct rpng_process*)rpng->process;
-   bool to_continue        = (process->avail_in > 0
-         && process->avail_out > 0);
-
-   if (!to_continue)
-      goto end;
+   unsigned i;
+   size_t offset = 0;
 
-   zstatus = process->stream_backend->trans(process->stream, false, &rd, &wn, &terror);
+   pngp->adam7_jobs = (struct png_adam7_job*)calloc(ARRAY_SIZE(passes),
+         sizeof(*pngp->adam7_jobs));
 
-   if (!zstatus && terror != TRANS_STREAM_ERROR_BUFFER_FULL)
-      goto error;
+   if (!pngp->adam7_jobs)
+      return false;
 
-   process->avail_in -= rd;
-   process->avail_out -= wn;
-   process->total_out += wn;
+   for (i = 0; i < ARRAY_SIZE(passes); i++)
+   {
+      struct png_adam7_job *job = &pngp->adam7_jobs[i];
+      int ret;
 
-   if (terror)
-      return 0;
+      job->pass            = *pngp;
+      job->pass.pass_pos   = i;
+      job->pass.adam7_jobs = NULL;
 
-end:
-   process->stream_backend->stream_free(process->stream);
-   process->stream = NULL;
+      ret = png_reverse_filter_init(ihdr, &job->pass);
 
-#ifdef GEKKO
-   /* we often use these in textures, make sure they're 32-byte aligned */
-   *data = (uint32_t*)memalign(32, rpng->ihdr.width *
-         rpng->ihdr.height * sizeof(uint32_t));
-#else
-   *data = (uint32_t*)malloc(rpng->ihdr.width *
-         rpng->ihdr.height * sizeof(uint32_t));
-#endif
-   if (!*data)
-      goto false_end;
+      if (ret == 1) /* Empty pass */
+         continue;
+      if (ret == -1)
+         return false;
 
-   process->adam7_restore_buf_size = 0;
-   process->restore_buf_size       = 0;
-   process->palette                = rpng->palette;
+      job->pass.inflate_buf    = pngp->inflate_buf + offset;
+      job->pass.inflate_offset = offset;
+      offset                  += job->pass.pass_size;
 
-   if (rpng->ihdr.interlace != 1)
-      if (png_reverse_filter_init(&rpng->ihdr, process) == -1)
-         goto false_end;
+      job->thread = sthread_create(png_adam7_job_thread, job);
 
-   process->inflate_initialized = true;
-   return 1;
+      if (!job->thread)
+         return false;
+   }
 
-error:
-false_end:
-   process->inflate_initialized = false;
-   return -1;
+   return true;
 }
 
-static bool png_read_plte(uint8_t *buf,
-      uint32_t *buffer, unsigned entries)
+/* Waits for all passes, then puts them together in data unless data
+ * is NULL or a pass failed. */
+static bool png_adam7_finish_jobs(uint32_t *data,
+      const struct png_ihdr *ihdr, struct rpng_process *pngp)
 {
    unsigned i;
+   bool ret = true;
 
-   for (i = 0; i < entries; i++)
+   if (!pngp->adam7_jobs)
+      return false;
+
+   for (i = 0; i < ARRAY_SIZE(passes); i++)
    {
-      uint32_t r = buf[3 * i + 0];
-      uint32_t g = buf[3 * i + 1];
-      uint32_t b = buf[3 * i + 2];
-      buffer[i] = (r << 16) | (g << 8) | (b << 0) | (0xffu << 24);
+      struct png_adam7_job *job = &pngp->adam7_jobs[i];
+
+      if (job->thread)
+      {
+         sthread_join(job->thread);
+         job->thread = NULL;
+         if (job->failed)
+            ret = false;
+      }
    }
 
-   return true;
-}
+   for (i = 0; i < ARRAY_SIZE(passes); i++)
+   {
+      struct png_adam7_job *job = &pngp->adam7_jobs[i];
+
+      if (!job->pass.data)
+         continue;
+
+      if (ret && data)
+         png_reverse_filter_adam7_deinterlace_pass(data, ihdr, job->pass.data,
+               job->pass.pass_width, job->pass.pass_height, &passes[i]);
+
+      png_reverse_filter_deinit(&job->pass);
+      free(job->pass.data);
+   }
+
+   free(pngp->adam7_jobs);
+   pngp->adam7_jobs = NULL;
+
+   return ret;
+}
+
+static void rpng_inflate_thread(void *data)
+{
+   struct rpng_process *process = (struct rpng_process*)data;
+   size_t inflated              = 0;
+   bool failed                  = false;
+
+   while (process->avail_in > 0 && inflated < process->inflate_buf_size)
+   {
+      uint32_t rd                   = 0;
+      uint32_t wn                   = 0;
+      enum trans_stream_error terror = TRANS_STREAM_ERROR_NONE;
+      size_t band                   = process->inflate_buf_size - inflated;
+      bool zstatus;
+
+      if (band > RPNG_INFLATE_BAND)
+         band = RPNG_INFLATE_BAND;
+
+      process->stream_backend->set_out(process->stream,
+            process->inflate_base + inflated, (uint32_t)band);
+      zstatus = process->stream_backend->trans(process->stream, false, &rd, &wn, &terror);
+
+      process->avail_in -= rd;
+      inflated          += wn;
+
+      slock_lock(process->lock);
+      process->inflated = inflated;
+      scond_broadcast(process->cond);
+      slock_unlock(process->lock);
+
+      if (!zstatus && terror != TRANS_STREAM_ERROR_BUFFER_FULL)
+      {
+         failed = true;
+         break;
+      }
+
+      /* End of the zlib stream */
+      if (terror == TRANS_STREAM_ERROR_NONE)
+         break;
+   }
+
+   slock_lock(process->lock);
+   process->inflate_done   = true;
+   process->inflate_failed = failed;
+   scond_broadcast(process->cond);
+   slock_unlock(process->lock);
+}
+
+/* Sets up handing the rest of the inflating to a thread, so the first
+ * rows can be unfiltered while later ones still inflate. */
+static bool rpng_process_prepare_inflate(struct rpng_process *process)
+{
+   process->lock = slock_new();
+   process->cond = scond_new();
+
+   if (!process->lock || !process->cond)
+   {
+      if (process->cond)
+         scond_free(process->cond);
+      if (process->lock)
+         slock_free(process->lock);
+      process->cond = NULL;
+      process->lock = NULL;
+      return false;
+   }
+
+   process->inflater     = process;
+   process->inflate_base = process->inflate_buf;
+   /* Rows check for their bytes as they go, instead of up front */
+   process->total_out    = process->inflate_buf_size;
+
+   return true;
+}
+
+/* Called once the row filters are set up, as the thread changes
+ * the process under them. */
+static void rpng_process_run_inflate(struct rpng_process *process)
+{
+   process->inflate_thread = sthread_create(rpng_inflate_thread, process);
+
+   /* Without a thread, inflate it all right away */
+   if (!process->inflate_thread)
+      rpng_inflate_thread(process);
+}
+
+static void rpng_process_join(struct rpng_process *process)
+{
+   /* Passes still waiting on an inflate that never started give up */
+   if (process->lock && !process->inflate_thread)
+   {
+      slock_lock(process->lock);
+      if (!process->inflate_done)
+      {
+         process->inflate_done   = true;
+         process->inflate_failed = true;
+         scond_broadcast(process->cond);
+      }
+      slock_unlock(process->lock);
+   }
+
+   if (process->adam7_jobs)
+      png_adam7_finish_jobs(NULL, NULL, process);
+
+   if (process->inflate_thread)
+      sthread_join(process->inflate_thread);
+   process->inflate_thread = NULL;
+
+   if (process->cond)
+      scond_free(process->cond);
+   if (process->lock)
+      slock_free(process->lock);
+   process->cond = NULL;
+   process->lock = NULL;
+}
+#endif
+
+static int png_reverse_filter_iterate(rpng_t *rpng, uint32_t **data)
+{
+   if (!rpng)
+      return false;
+
+#ifdef HAVE_THREADS
+   if (rpng->process && rpng->process->adam7_jobs)
+   {
+      if (!png_adam7_finish_jobs(*data, &rpng->ihdr, rpng->process))
+         return IMAGE_PROCESS_ERROR;
+      return IMAGE_PROCESS_END;
+   }
+#endif
+
+   if (rpng->ihdr.interlace && rpng->process)
+      return png_reverse_filter_adam7(data, &rpng->ihdr, rpng->process);
+
+   return png_reverse_filter_regular_iterate(data, &rpng->ihdr, rpng->process);
+}
+
+static int rpng_load_image_argb_process_inflate_init(rpng_t *rpng, uint32_t **data)
+{
+   bool zstatus;
+   enum trans_stream_error terror;
+   uint32_t rd, wn;
+   struct rpng_process *process = (struct rpng_process*)rpng->process;
+   bool to_continue        = (process->avail_in > 0
+         && process->avail_out > 0);
+
+   if (!to_continue)
+      goto end;
+
+#ifdef HAVE_THREADS
+   if (process->total_out == 0
+         && process->inflate_buf_size >= RPNG_THREADED_MIN_BYTES
+         && rpng_process_prepare_inflate(process))
+      goto alloc_output;
+#endif
+
+   zstatus = process->stream_backend->trans(process->stream, false, &rd, &wn, &terror);
+
+   if (!zstatus && terror != TRANS_STREAM_ERROR_BUFFER_FULL)
+      goto error;
+
+   process->avail_in -= rd;
+   process->avail_out -= wn;
+   process->total_out += wn;
+
+   if (terror)
+      return 0;
+
+end:
+   process->stream_backend->stream_free(process->stream);
+   process->stream = NULL;
+
+#ifdef HAVE_THREADS
+alloc_output:
+#endif
+#ifdef GEKKO
+   /* we often use these in textures, make sure they're 32-byte aligned */
+   *data = (uint32_t*)memalign(32, rpng->ihdr.width *
+         rpng->ihdr.height * sizeof(uint32_t));
+#else
+   *data = (uint32_t*)malloc(rpng->ihdr.width *
+         rpng->ihdr.height * sizeof(uint32_t));
+#endif
+   if (!*data)
+      goto false_end;
+
+   process->adam7_restore_buf_size = 0;
+   process->restore_buf_size       = 0;
+   process->palette                = rpng->palette;
+
+   if (rpng->ihdr.interlace != 1)
+   {
+      if (png_reverse_filter_init(&rpng->ihdr, process) == -1)
+         goto false_end;
+   }
+#ifdef HAVE_THREADS
+   else if (process->inflater)
+   {
+      if (!png_adam7_start_jobs(&rpng->ihdr, process))
+         goto false_end;
+   }
+
+   if (process->inflater)
+      rpng_process_run_inflate(process);
+#endif
+
+   process->inflate_initialized = true;
+   return 1;
+
+error:
+false_end:
+   process->inflate_initialized = false;
+   return -1;
+}
+
+static bool png_read_plte(uint8_t *buf,
+      uint32_t *buffer, unsigned entries)
+{
+   unsigned i;
+
+   for (i = 0; i < entries; i++)
+   {
+      uint32_t r = buf[3 * i + 0];
+      uint32_t g = buf[3 * i + 1];
+      uint32_t b = buf[3 * i + 2];
+      buffer[i] = (r << 16) | (g << 8) | (b << 0) | (0xffu << 24);
+   }
+
+   return true;
+}
 
 static bool png_read_trns(uint8_t *buf, uint32_t *palette, unsigned entries)
 {
@@ -858,12 +1562,26 @@ static bool png_read_trns(uint8_t *buf, uint32_t *palette, unsigned entries)
 
 bool png_realloc_idat(const struct png_chunk *chunk, struct idat_buffer *buf)
 {
-   uint8_t *new_buffer = (uint8_t*)realloc(buf->data, buf->size + chunk->size);
+   uint8_t *new_buffer;
+   size_t capacity = buf->capacity;
+
+   if (buf->size + chunk->size <= capacity)
+      return true;
+
+   /* Grow geometrically, so many small IDATs don't copy the
+    * data over and over */
+   if (capacity < 4096)
+      capacity = 4096;
+   while (capacity < buf->size + chunk->size)
+      capacity *= 2;
+
+   new_buffer = (uint8_t*)realloc(buf->data, capacity);
 
    if (!new_buffer)
       return false;
 
-   buf->data  = new_buffer;
+   buf->data     = new_buffer;
+   buf->capacity = capacity;
    return true;
 }
 
@@ -877,10 +1595,34 @@ static struct rpng_process *rpng_process_init(rpng_t *rpng)
 
    process->stream_backend = trans_stream_get_zlib_inflate_backend();
 
-   png_pass_geom(&rpng->ihdr, rpng->ihdr.width,
-         rpng->ihdr.height, NULL, NULL, &process->inflate_buf_size);
-   if (rpng->ihdr.interlace == 1) /* To be sure. */
-      process->inflate_buf_size *= 2;
+   if (rpng->ihdr.interlace == 1)
+   {
+      unsigned i;
+
+      /* Each pass pads its rows and adds a filter byte per row, so
+       * narrow images take more than twice the non-interlaced size. */
+      for (i = 0; i < ARRAY_SIZE(passes); i++)
+      {
+         struct png_ihdr pass_ihdr = rpng->ihdr;
+         size_t pass_size;
+
+         if (rpng->ihdr.width  <= passes[i].x ||
+             rpng->ihdr.height <= passes[i].y)
+            continue;
+
+         pass_ihdr.width  = (rpng->ihdr.width - passes[i].x +
+               passes[i].stride_x - 1) / passes[i].stride_x;
+         pass_ihdr.height = (rpng->ihdr.height - passes[i].y +
+               passes[i].stride_y - 1) / passes[i].stride_y;
+
+         png_pass_geom(&pass_ihdr, pass_ihdr.width,
+               pass_ihdr.height, NULL, NULL, &pass_size);
+         process->inflate_buf_size += pass_size;
+      }
+   }
+   else
+      png_pass_geom(&rpng->ihdr, rpng->ihdr.width,
+            rpng->ihdr.height, NULL, NULL, &process->inflate_buf_size);
 
    process->stream = process->stream_backend->stream_new();
 
@@ -1135,24 +1877,29 @@ int rpng_process_image(rpng_t *rpng,
 error:
    if (rpng->process)
    {
+#ifdef HAVE_THREADS
+      rpng_process_join(rpng->process);
+#endif
+      png_reverse_filter_deinit(rpng->process);
       if (rpng->process->inflate_buf)
          free(rpng->process->inflate_buf);
       if (rpng->process->stream)
          rpng->process->stream_backend->stream_free(rpng->process->stream);
       free(rpng->process);
+      rpng->process = NULL;
    }
    return IMAGE_PROCESS_ERROR;
 }
 
-void rpng_free(rpng_t *rpng)
+static void rpng_free_process(rpng_t *rpng)
 {
-   if (!rpng)
-      return;
-
-   if (rpng->idat_buf.data)
-      free(rpng->idat_buf.data);
    if (rpng->process)
    {
+#ifdef HAVE_THREADS
+      /* The threads use the buffers and stream freed below */
+      rpng_process_join(rpng->process);
+#endif
+      png_reverse_filter_deinit(rpng->process);
       if (rpng->process->inflate_buf)
          free(rpng->process->inflate_buf);
       if (rpng->process->stream)
@@ -1163,11 +1910,37 @@ void rpng_free(rpng_t *rpng)
             free(rpng->process->stream);
       }
       free(rpng->process);
+      rpng->process = NULL;
    }
+}
+
+void rpng_free(rpng_t *rpng)
+{
+   if (!rpng)
+      return;
+
+   rpng_free_process(rpng);
+   if (rpng->idat_buf.data)
+      free(rpng->idat_buf.data);
 
    free(rpng);
 }
 
+void rpng_reset(rpng_t *rpng)
+{
+   struct idat_buffer idat_buf;
+
+   if (!rpng)
+      return;
+
+   rpng_free_process(rpng);
+
+   idat_buf      = rpng->idat_buf;
+   idat_buf.size = 0;
+   memset(rpng, 0, sizeof(*rpng));
+   rpng->idat_buf = idat_buf;
+}
+
 bool rpng_start(rpng_t *rpng)
 {
    unsigned i;
@@ -1222,3 +1995,476 @@ rpng_t *rpng_alloc(void)
       return NULL;
    return rpng;
 }
+
+/* Incremental decoding: the file comes in pieces of any size, and each
+ * row is unfiltered as soon as it has been inflated. Only the chunk
+ * being parsed, one row and the inflate window are held, except for
+ * interlaced images, which need the whole image before any row is
+ * complete. */
+
+enum rpng_stream_state
+{
+   RPNG_STREAM_SIGNATURE = 0,
+   RPNG_STREAM_CHUNK_HEADER,
+   RPNG_STREAM_CHUNK_DATA,
+   RPNG_STREAM_CHUNK_CRC,
+   RPNG_STREAM_DONE,
+   RPNG_STREAM_ERROR
+};
+
+/* Largest chunk kept whole; PLTE, at 256 entries of 3 bytes */
+#define RPNG_STREAM_CHUNK_MAX 768
+
+struct rpng_stream
+{
+   struct rpng_process process; /* Row filter state of the current pass */
+   struct png_ihdr ihdr;
+   struct png_chunk chunk;
+   rpng_row_cb_t row_cb;
+   void *userdata;
+   uint32_t *output;            /* Caller's buffer, or NULL */
+   uint32_t *image;             /* Whole image, for Adam7 without output */
+   uint32_t *argb_row;
+   uint8_t *row;                /* Filter type byte, then one row of the pass */
+   void *stream;
+   const struct trans_stream_backend *stream_backend;
+   size_t output_pitch;         /* In pixels */
+   size_t row_size;
+   size_t row_filled;
+   uint32_t chunk_pos;
+   unsigned header_len;
+   unsigned y;                  /* Next row of the current pass */
+   unsigned pass;
+   enum rpng_stream_state state;
+   bool has_ihdr;
+   bool has_plte;
+   bool has_idat;
+   bool rows_done;
+   /* Chunk header, followed by the data of chunks kept whole */
+   uint8_t chunk_buf[8 + RPNG_STREAM_CHUNK_MAX];
+   uint32_t palette[256];
+};
+
+/* Sets up the filters for the next pass with any pixels in it, or
+ * returns false once there are none left. */
+static bool rpng_stream_start_pass(rpng_stream_t *s)
+{
+   struct png_ihdr ihdr = s->ihdr;
+
+   if (s->ihdr.interlace)
+   {
+      while (s->pass < ARRAY_SIZE(passes) &&
+            (s->ihdr.width  <= passes[s->pass].x ||
+             s->ihdr.height <= passes[s->pass].y))
+         s->pass++;
+
+      if (s->pass >= ARRAY_SIZE(passes))
+         return false;
+
+      ihdr.width  = (s->ihdr.width - passes[s->pass].x +
+            passes[s->pass].stride_x - 1) / passes[s->pass].stride_x;
+      ihdr.height = (s->ihdr.height - passes[s->pass].y +
+            passes[s->pass].stride_y - 1) / passes[s->pass].stride_y;
+   }
+   else if (s->pass > 0)
+      return false;
+
+   png_pass_geom(&ihdr, ihdr.width, ihdr.height,
+         &s->process.bpp, &s->process.pitch, NULL);
+
+   s->process.ihdr = ihdr;
+   s->row_size     = s->process.pitch + 1;
+   s->row_filled   = 0;
+   s->y            = 0;
+   memset(s->process.prev_scanline, 0, s->process.pitch);
+
+   return true;
+}
+
+static bool rpng_stream_init_rows(rpng_stream_t *s)
+{
+   unsigned pitch;
+
+   if (!s->row_cb && !s->output)
+      return false;
+
+   png_pass_geom(&s->ihdr, s->ihdr.width, s->ihdr.height, NULL, &pitch, NULL);
+
+   s->row                      = (uint8_t*)malloc(pitch + 1);
+   s->argb_row                 = (uint32_t*)malloc((size_t)s->ihdr.width * sizeof(uint32_t));
+   s->process.prev_scanline    = (uint8_t*)calloc(1, pitch);
+   s->process.decoded_scanline = (uint8_t*)calloc(1, pitch);
+   s->process.palette          = s->palette;
+
+   if (!s->row || !s->argb_row ||
+         !s->process.prev_scanline || !s->process.decoded_scanline)
+      return false;
+
+   if (s->ihdr.interlace && !s->output)
+   {
+      s->image = (uint32_t*)calloc((size_t)s->ihdr.width * s->ihdr.height,
+            sizeof(uint32_t));
+      if (!s->image)
+         return false;
+   }
+
+   s->stream_backend = trans_stream_get_zlib_inflate_backend();
+   s->stream         = s->stream_backend->stream_new();
+
+   if (!s->stream)
+      return false;
+
+   if (!rpng_stream_start_pass(s))
+      return false;
+
+   return true;
+}
+
+/* Unfilters the row just inflated, and hands it on */
+static bool rpng_stream_row(rpng_stream_t *s)
+{
+   struct rpng_process *pngp = &s->process;
+   uint32_t *row             = s->argb_row;
+
+   if (!s->ihdr.interlace && s->output)
+      row = s->output + s->y * s->output_pitch;
+
+   pngp->inflate_buf = s->row + 1;
+   if (png_reverse_filter_copy_line(row, &pngp->ihdr, pngp, s->row[0])
+         != IMAGE_PROCESS_NEXT)
+      return false;
+
+   if (!s->ihdr.interlace)
+   {
+      if (s->row_cb && !s->row_cb(s->userdata, s->y, row, s->ihdr.width))
+         return false;
+   }
+   else
+   {
+      const struct adam7_pass *pass = &passes[s->pass];
+      size_t pitch                  = s->output ? s->output_pitch : s->ihdr.width;
+      uint32_t *out                 = (s->output ? s->output : s->image)
+         + (pass->y + (size_t)s->y * pass->stride_y) * pitch + pass->x;
+      unsigned x;
+
+      for (x = 0; x < pngp->ihdr.width; x++)
+         out[x * pass->stride_x] = row[x];
+   }
+
+   s->row_filled = 0;
+
+   if (++s->y < pngp->ihdr.height)
+      return true;
+
+   s->pass++;
+   if (rpng_stream_start_pass(s))
+      return true;
+
+   s->rows_done = true;
+
+   /* Only now is every row of an interlaced image complete */
+   if (s->ihdr.interlace && s->row_cb)
+   {
+      size_t pitch    = s->output ? s->output_pitch : s->ihdr.width;
+      uint32_t *image = s->output ? s->output : s->image;
+      unsigned y;
+
+      for (y = 0; y < s->ihdr.height; y++)
+         if (!s->row_cb(s->userdata, y, image + y * pitch, s->ihdr.width))
+            return false;
+   }
+
+   return true;
+}
+
+static bool rpng_stream_inflate(rpng_stream_t *s, const uint8_t *data, size_t len)
+{
+   /* Anything after the last row is the zlib checksum, or padding */
+   if (s->rows_done || !len)
+      return true;
+
+   s->stream_backend->set_in(s->stream, data, (uint32_t)len);
+
+   for (;;)
+   {
+      uint32_t rd                    = 0;
+      uint32_t wn                    = 0;
+      enum trans_stream_error terror = TRANS_STREAM_ERROR_NONE;
+      bool zstatus;
+
+      s->stream_backend->set_out(s->stream, s->row + s->row_filled,
+            (uint32_t)(s->row_size - s->row_filled));
+      zstatus        = s->stream_backend->trans(s->stream, false, &rd, &wn, &terror);
+      len           -= rd;
+      s->row_filled += wn;
+
+      if (s->row_filled == s->row_size)
+      {
+         if (!rpng_stream_row(s))
+            return false;
+         if (s->rows_done)
+            return true;
+         /* zlib may still hold output for the next row */
+         continue;
+      }
+
+      /* Out of input; the next IDAT chunk carries on from here */
+      if (!len && !rd && !wn)
+         return true;
+
+      if (!zstatus && terror != TRANS_STREAM_ERROR_BUFFER_FULL)
+         return false;
+
+      /* The zlib stream ended before the last row */
+      if (terror == TRANS_STREAM_ERROR_NONE)
+         return false;
+
+      if (!len)
+         return true;
+   }
+}
+
+/* The header of a chunk is in; checks it can come next and whether
+ * the data needs to be kept. */
+static bool rpng_stream_chunk_header(rpng_stream_t *s)
+{
+   unsigned i;
+
+   s->chunk.size = dword_be(s->chunk_buf);
+
+   for (i = 0; i < 4; i++)
+   {
+      uint8_t byte = s->chunk_buf[i + 4];
+
+      /* All four bytes of the chunk type must be ASCII letters */
+      if ((byte < 65) || ((byte > 90) && (byte < 97)) || (byte > 122))
+         return false;
+
+      s->chunk.type[i] = byte;
+   }
+
+   switch (png_chunk_type(&s->chunk))
+   {
+      case PNG_CHUNK_IHDR:
+         if (s->has_ihdr || s->chunk.size != 13)
+            return false;
+         break;
+      case PNG_CHUNK_PLTE:
+         if (!s->has_ihdr || s->has_plte || s->has_idat ||
+               s->chunk.size % 3 || s->chunk.size > 256 * 3)
+            return false;
+         break;
+      case PNG_CHUNK_tRNS:
+         /* At most one alpha per palette entry, or one colour key */
+         if (!s->has_ihdr || s->has_idat || s->chunk.size > 256)
+            return false;
+         break;
+      case PNG_CHUNK_IDAT:
+         if (!s->has_ihdr ||
+               (s->ihdr.color_type == PNG_IHDR_COLOR_PLT && !s->has_plte))
+            return false;
+         if (!s->has_idat && !rpng_stream_init_rows(s))
+            return false;
+         s->has_idat = true;
+         break;
+      case PNG_CHUNK_IEND:
+         if (!s->has_idat)
+            return false;
+         break;
+      case PNG_CHUNK_ERROR:
+         return false;
+      default:
+         if (!s->has_ihdr)
+            return false;
+         break;
+   }
+
+   s->chunk_pos = 0;
+   return true;
+}
+
+/* The data of a chunk kept whole is in */
+static bool rpng_stream_chunk_end(rpng_stream_t *s)
+{
+   switch (png_chunk_type(&s->chunk))
+   {
+      case PNG_CHUNK_IHDR:
+         if (!png_parse_ihdr(s->chunk_buf, &s->ihdr) ||
+               !png_process_ihdr(&s->ihdr))
+            return false;
+         s->has_ihdr = true;
+         break;
+      case PNG_CHUNK_PLTE:
+         png_read_plte(s->chunk_buf + 8, s->palette, s->chunk.size / 3);
+         s->has_plte = true;
+         break;
+      case PNG_CHUNK_tRNS:
+         if (s->ihdr.color_type == PNG_IHDR_COLOR_PLT)
+            png_read_trns(s->chunk_buf + 8, s->palette, s->chunk.size);
+         break;
+      default:
+         break;
+   }
+
+   return true;
+}
+
+static int rpng_stream_parse(rpng_stream_t *s, const uint8_t *data, size_t len)
+{
+   while (len)
+   {
+      switch (s->state)
+      {
+         case RPNG_STREAM_SIGNATURE:
+         case RPNG_STREAM_CHUNK_HEADER:
+         case RPNG_STREAM_CHUNK_CRC:
+            {
+               unsigned want = s->state == RPNG_STREAM_CHUNK_CRC ? 4 : 8;
+               size_t n      = want - s->header_len;
+
+               if (n > len)
+                  n = len;
+
+               memcpy(s->chunk_buf + s->header_len, data, n);
+               s->header_len += (unsigned)n;
+               data          += n;
+               len           -= n;
+
+               if (s->header_len < want)
+                  break;
+
+               s->header_len = 0;
+
+               if (s->state == RPNG_STREAM_SIGNATURE)
+               {
+                  if (memcmp(s->chunk_buf, png_magic, sizeof(png_magic)))
+                     return IMAGE_PROCESS_ERROR;
+                  s->state = RPNG_STREAM_CHUNK_HEADER;
+               }
+               else if (s->state == RPNG_STREAM_CHUNK_HEADER)
+               {
+                  if (!rpng_stream_chunk_header(s))
+                     return IMAGE_PROCESS_ERROR;
+                  s->state = RPNG_STREAM_CHUNK_DATA;
+               }
+               else if (png_chunk_type(&s->chunk) == PNG_CHUNK_IEND)
+               {
+                  s->state = RPNG_STREAM_DONE;
+                  return s->rows_done ? IMAGE_PROCESS_END : IMAGE_PROCESS_ERROR;
+               }
+               else
+                  s->state = RPNG_STREAM_CHUNK_HEADER;
+            }
+            break;
+
+         case RPNG_STREAM_CHUNK_DATA:
+            {
+               enum png_chunk_type type = png_chunk_type(&s->chunk);
+               size_t n                 = s->chunk.size - s->chunk_pos;
+
+               if (n > len)
+                  n = len;
+
+               if (type == PNG_CHUNK_IDAT)
+               {
+                  if (!rpng_stream_inflate(s, data, n))
+                     return IMAGE_PROCESS_ERROR;
+               }
+               else if (type == PNG_CHUNK_IHDR || type == PNG_CHUNK_PLTE ||
+                     type == PNG_CHUNK_tRNS)
+                  memcpy(s->chunk_buf + 8 + s->chunk_pos, data, n);
+
+               s->chunk_pos += (uint32_t)n;
+               data         += n;
+               len          -= n;
+
+               if (s->chunk_pos < s->chunk.size)
+                  break;
+
+               if (!rpng_stream_chunk_end(s))
+                  return IMAGE_PROCESS_ERROR;
+               s->state = RPNG_STREAM_CHUNK_CRC;
+            }
+            break;
+
+         case RPNG_STREAM_DONE:
+            return IMAGE_PROCESS_END;
+
+         case RPNG_STREAM_ERROR:
+            return IMAGE_PROCESS_ERROR;
+      }
+
+      /* Empty chunks are done without waiting for more input */
+      if (s->state == RPNG_STREAM_CHUNK_DATA && s->chunk.size == 0)
+      {
+         if (!rpng_stream_chunk_end(s))
+            return IMAGE_PROCESS_ERROR;
+         s->state = RPNG_STREAM_CHUNK_CRC;
+      }
+   }
+
+   return s->state == RPNG_STREAM_DONE ? IMAGE_PROCESS_END : IMAGE_PROCESS_NEXT;
+}
+
+int rpng_stream_push(rpng_stream_t *s, const void *data, size_t len)
+{
+   int ret;
+
+   if (!s)
+      return IMAGE_PROCESS_ERROR;
+
+   ret = rpng_stream_parse(s, (const uint8_t*)data, len);
+
+   if (ret == IMAGE_PROCESS_ERROR)
+      s->state = RPNG_STREAM_ERROR;
+
+   return ret;
+}
+
+bool rpng_stream_get_size(rpng_stream_t *s, unsigned *width, unsigned *height)
+{
+   if (!s || !s->has_ihdr)
+      return false;
+
+   *width  = s->ihdr.width;
+   *height = s->ihdr.height;
+   return true;
+}
+
+void rpng_stream_set_row_cb(rpng_stream_t *s, rpng_row_cb_t cb, void *userdata)
+{
+   if (!s)
+      return;
+
+   s->row_cb   = cb;
+   s->userdata = userdata;
+}
+
+void rpng_stream_set_output(rpng_stream_t *s, uint32_t *data, size_t pitch)
+{
+   if (!s)
+      return;
+
+   s->output       = data;
+   s->output_pitch = pitch / sizeof(uint32_t);
+}
+
+rpng_stream_t *rpng_stream_new(void)
+{
+   return (rpng_stream_t*)calloc(1, sizeof(rpng_stream_t));
+}
+
+void rpng_stream_free(rpng_stream_t *s)
+{
+   if (!s)
+      return;
+
+   if (s->stream)
+      s->stream_backend->stream_free(s->stream);
+   free(s->process.prev_scanline);
+   free(s->process.decoded_scanline);
+   free(s->row);
+   free(s->argb_row);
+   free(s->image);
+   free(s);
+}
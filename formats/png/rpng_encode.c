@@ -21,6 +21,7 @@
  */
 
 #include <stdio.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -29,6 +30,10 @@
 #include <streams/interface_stream.h>
 #include <streams/trans_stream.h>
 
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
 #include "rpng_internal.h"
 
 #undef GOTO_END_ERROR
@@ -203,32 +208,285 @@ static unsigned filter_paeth(uint8_t *target,
    return count_sad(target, width);
 }
 
+#define ADLER32_BASE 65521u
+/* Most bytes that can be summed before the 32-bit sums may overflow */
+#define ADLER32_NMAX 5552
+
+static uint32_t png_adler32(uint32_t adler, const uint8_t *data, size_t size)
+{
+   uint32_t a = adler & 0xffff;
+   uint32_t b = adler >> 16;
+
+   while (size)
+   {
+      size_t n = size < ADLER32_NMAX ? size : ADLER32_NMAX;
+
+      size -= n;
+      while (n--)
+      {
+         a += *data++;
+         b += a;
+      }
+      a %= ADLER32_BASE;
+      b %= ADLER32_BASE;
+   }
+
+   return a | (b << 16);
+}
+
+/* The Adler-32 of two buffers joined, from the Adler-32 of each
+ * and the size of the second. */
+static uint32_t png_adler32_combine(uint32_t adler1, uint32_t adler2, size_t size2)
+{
+   uint32_t rem = (uint32_t)(size2 % ADLER32_BASE);
+   uint32_t a   = adler1 & 0xffff;
+   uint32_t b   = (uint32_t)(((uint64_t)rem * a) % ADLER32_BASE);
+
+   a += (adler2 & 0xffff) + ADLER32_BASE - 1;
+   b += (adler1 >> 16) + (adler2 >> 16) + ADLER32_BASE - rem;
+   if (a >= ADLER32_BASE)
+      a -= ADLER32_BASE;
+   if (a >= ADLER32_BASE)
+      a -= ADLER32_BASE;
+   if (b >= ADLER32_BASE * 2)
+      b -= ADLER32_BASE * 2;
+   if (b >= ADLER32_BASE)
+      b -= ADLER32_BASE;
+
+   return a | (b << 16);
+}
+
+#ifdef HAVE_THREADS
+/* Rows are split into at most this many bands, each filtered and
+ * deflated on its own thread... */
+#define RPNG_SAVE_MAX_BANDS 8
+/* ...as long as each band has at least this many bytes to deflate. */
+#define RPNG_SAVE_BAND_BYTES (512 * 1024)
+#endif
+
+/* A run of rows, filtered and deflated on its own into one IDAT chunk.
+ * The first band starts the zlib stream and the last one ends it; the
+ * others end on a sync flush, so the chunks join into one stream. */
+struct png_encode_band
+{
+   const uint8_t *data;
+   uint8_t *chunk;
+   size_t chunk_size;
+   size_t filtered_size;
+   signed pitch;
+   unsigned width;
+   unsigned height;
+   unsigned bpp;
+   int level;
+   uint32_t adler;
+   bool first;
+   bool last;
+   bool ok;
+#ifdef HAVE_THREADS
+   sthread_t *thread;
+#endif
+};
+
+static void png_copy_line(uint8_t *dst, const uint8_t *src,
+      unsigned width, unsigned bpp)
+{
+   if (bpp == sizeof(uint32_t))
+      copy_argb_line(dst, (const uint32_t*)src, width);
+   else
+      copy_bgr24_line(dst, src, width);
+}
+
+/* Filters one row into target, and returns the filter type.
+ * Level 0 stores rows as they are and level 1 always uses UP,
+ * the cheapest filter that still does well on screenshots.
+ * Otherwise each row gets the filter with the least sum of
+ * absolute differences, trying NONE, SUB and UP up to level 5,
+ * and AVERAGE and PAETH as well above that. */
+static uint8_t png_filter_line(uint8_t *target, uint8_t **scratch,
+      const uint8_t *line, const uint8_t *prev,
+      unsigned width, unsigned bpp, int level)
+{
+   size_t size                    = (size_t)width * bpp;
+   uint8_t filter                 = 0;
+   const uint8_t *chosen_filtered = line;
+   unsigned min_sad;
+
+   if (level == 0)
+   {
+      memcpy(target, line, size);
+      return 0;
+   }
+
+   if (level == 1)
+   {
+      filter_up(target, line, prev, width, bpp);
+      return 2;
+   }
+
+   min_sad = count_sad(line, size);
+
+   {
+      unsigned sub_score = filter_sub(scratch[0], line, width, bpp);
+      unsigned up_score  = filter_up(scratch[1], line, prev, width, bpp);
+
+      if (sub_score < min_sad)
+      {
+         filter          = 1;
+         chosen_filtered = scratch[0];
+         min_sad         = sub_score;
+      }
+
+      if (up_score < min_sad)
+      {
+         filter          = 2;
+         chosen_filtered = scratch[1];
+         min_sad         = up_score;
+      }
+   }
+
+   if (level >= 6)
+   {
+      unsigned avg_score   = filter_avg(scratch[2], line, prev, width, bpp);
+      unsigned paeth_score = filter_paeth(scratch[3], line, prev, width, bpp);
+
+      if (avg_score < min_sad)
+      {
+         filter          = 3;
+         chosen_filtered = scratch[2];
+         min_sad         = avg_score;
+      }
+
+      if (paeth_score < min_sad)
+      {
+         filter          = 4;
+         chosen_filtered = scratch[3];
+      }
+   }
+
+   memcpy(target, chosen_filtered, size);
+   return filter;
+}
+
+static void png_encode_band(void *data)
+{
+   unsigned h, i;
+   struct png_encode_band *band = (struct png_encode_band*)data;
+   const struct trans_stream_backend *stream_backend = trans_stream_get_zlib_deflate_backend();
+   size_t line_size       = (size_t)band->width * band->bpp;
+   size_t header_size     = band->first ? 2 : 0;
+   size_t trailer_size    = band->last  ? 4 : 0;
+   size_t deflate_cap;
+   uint8_t *filtered      = NULL;
+   uint8_t *line          = NULL;
+   uint8_t *prev          = NULL;
+   uint8_t *scratch[4]    = {NULL};
+   uint8_t *target;
+   const uint8_t *src     = band->data;
+   void *stream           = NULL;
+   uint32_t total_in      = 0;
+   uint32_t total_out     = 0;
+   enum trans_stream_error terror = TRANS_STREAM_ERROR_NONE;
+
+   band->ok            = false;
+   band->filtered_size = (line_size + 1) * band->height;
+   /* Stored blocks cost 5 bytes per 64KB, and the sync flush 5 more */
+   deflate_cap         = band->filtered_size + band->filtered_size / 8 + 64;
+
+   filtered = (uint8_t*)malloc(band->filtered_size);
+   line     = (uint8_t*)malloc(line_size);
+   prev     = (uint8_t*)calloc(1, line_size);
+   for (i = 0; i < ARRAY_SIZE(scratch); i++)
+      scratch[i] = (uint8_t*)malloc(line_size);
+   band->chunk = (uint8_t*)malloc(8 + header_size + deflate_cap + trailer_size);
+
+   if (!filtered || !line || !prev || !scratch[0] || !scratch[1]
+         || !scratch[2] || !scratch[3] || !band->chunk)
+      goto end;
+
+   /* Rows are filtered against the row above, which for all but the
+    * first band is the last row of the band before. */
+   if (!band->first)
+      png_copy_line(prev, src - band->pitch, band->width, band->bpp);
+
+   target = filtered;
+   for (h = 0; h < band->height; h++, src += band->pitch)
+   {
+      uint8_t *swap;
+
+      png_copy_line(line, src, band->width, band->bpp);
+      target[0] = png_filter_line(target + 1, scratch, line, prev,
+            band->width, band->bpp, band->level);
+      target   += line_size + 1;
+
+      swap = prev;
+      prev = line;
+      line = swap;
+   }
+
+   band->adler = png_adler32(1, filtered, band->filtered_size);
+
+   if (!(stream = stream_backend->stream_new()))
+      goto end;
+
+   /* A raw deflate stream; the zlib header and checksum are added here */
+   stream_backend->define(stream, "level", (uint32_t)band->level);
+   stream_backend->define(stream, "window_bits", (uint32_t)-15);
+   stream_backend->define(stream, "sync_flush", !band->last);
+   stream_backend->set_in(stream, filtered, (uint32_t)band->filtered_size);
+   stream_backend->set_out(stream, band->chunk + 8 + header_size, (uint32_t)deflate_cap);
+
+   if (!stream_backend->trans(stream, true, &total_in, &total_out, &terror)
+         || terror != TRANS_STREAM_ERROR_NONE)
+      goto end;
+
+   if (band->first)
+   {
+      /* 32K window deflate, with FCHECK making it a multiple of 31 */
+      unsigned flevel = band->level < 2 ? 0 : band->level < 6 ? 1
+         : band->level == 6 ? 2 : 3;
+      unsigned flg    = flevel << 6;
+
+      flg            += 31 - ((0x78 << 8) | flg) % 31;
+      band->chunk[8]  = 0x78;
+      band->chunk[9]  = (uint8_t)flg;
+   }
+
+   band->chunk_size = header_size + total_out + trailer_size;
+   memcpy(band->chunk + 4, "IDAT", 4);
+   dword_write_be(band->chunk, (uint32_t)band->chunk_size);
+   band->chunk_size += 8;
+   band->ok          = true;
+
+end:
+   if (stream)
+      stream_backend->stream_free(stream);
+   free(filtered);
+   free(line);
+   free(prev);
+   for (i = 0; i < ARRAY_SIZE(scratch); i++)
+      free(scratch[i]);
+}
+
 bool rpng_save_image_stream(const uint8_t *data, intfstream_t* intf_s,
-      unsigned width, unsigned height, signed pitch, unsigned bpp)
+      unsigned width, unsigned height, signed pitch, unsigned bpp,
+      int level)
 {
-   unsigned h;
+   unsigned i;
    struct png_ihdr ihdr = {0};
    bool ret = true;
-   const struct trans_stream_backend *stream_backend = NULL;
-   size_t encode_buf_size  = 0;
-   uint8_t *encode_buf     = NULL;
-   uint8_t *deflate_buf    = NULL;
-   uint8_t *rgba_line      = NULL;
-   uint8_t *up_filtered    = NULL;
-   uint8_t *sub_filtered   = NULL;
-   uint8_t *avg_filtered   = NULL;
-   uint8_t *paeth_filtered = NULL;
-   uint8_t *prev_encoded   = NULL;
-   uint8_t *encode_target  = NULL;
-   void *stream            = NULL;
-   uint32_t total_in       = 0;
-   uint32_t total_out      = 0;
-   
+   struct png_encode_band *bands = NULL;
+   unsigned num_bands     = 1;
+   unsigned rows          = 0;
+   uint32_t adler         = 1;
+
+   if (level < 0)
+      level = 0;
+   else if (level > 9)
+      level = 9;
+
    if (!intf_s)
       GOTO_END_ERROR();
 
-   stream_backend = trans_stream_get_zlib_deflate_backend();
-
    if (intfstream_write(intf_s, png_magic, sizeof(png_magic)) != sizeof(png_magic))
       GOTO_END_ERROR();
 
@@ -239,134 +497,82 @@ bool rpng_save_image_stream(const uint8_t *data, intfstream_t* intf_s,
    if (!png_write_ihdr_string(intf_s, &ihdr))
       GOTO_END_ERROR();
 
-   encode_buf_size = (width * bpp + 1) * height;
-   encode_buf      = (uint8_t*)malloc(encode_buf_size);
-   if (!encode_buf)
-      GOTO_END_ERROR();
-
-   prev_encoded = (uint8_t*)calloc(1, width * bpp);
-   if (!prev_encoded)
+#ifdef HAVE_THREADS
+   num_bands = (unsigned)(((size_t)width * bpp + 1) * height / RPNG_SAVE_BAND_BYTES);
+   if (num_bands > RPNG_SAVE_MAX_BANDS)
+      num_bands = RPNG_SAVE_MAX_BANDS;
+   if (num_bands > height)
+      num_bands = height;
+   if (num_bands < 1)
+      num_bands = 1;
+#endif
+
+   bands = (struct png_encode_band*)calloc(num_bands, sizeof(*bands));
+   if (!bands)
       GOTO_END_ERROR();
 
-   rgba_line      = (uint8_t*)malloc(width * bpp);
-   up_filtered    = (uint8_t*)malloc(width * bpp);
-   sub_filtered   = (uint8_t*)malloc(width * bpp);
-   avg_filtered   = (uint8_t*)malloc(width * bpp);
-   paeth_filtered = (uint8_t*)malloc(width * bpp);
-   if (!rgba_line || !up_filtered || !sub_filtered || !avg_filtered || !paeth_filtered)
-      GOTO_END_ERROR();
-
-   encode_target = encode_buf;
-   for (h = 0; h < height;
-         h++, encode_target += width * bpp, data += pitch)
+   for (i = 0; i < num_bands; i++)
    {
-      if (bpp == sizeof(uint32_t))
-         copy_argb_line(rgba_line, (const uint32_t*)data, width);
-      else
-         copy_bgr24_line(rgba_line, data, width);
-
-      /* Try every filtering method, and choose the method
-       * which has most entries as zero.
-       *
-       * This is probably not very optimal, but it's very
-       * simple to implement.
-       */
-      {
-         unsigned none_score  = count_sad(rgba_line, width * bpp);
-         unsigned up_score    = filter_up(up_filtered, rgba_line, prev_encoded, width, bpp);
-         unsigned sub_score   = filter_sub(sub_filtered, rgba_line, width, bpp);
-         unsigned avg_score   = filter_avg(avg_filtered, rgba_line, prev_encoded, width, bpp);
-         unsigned paeth_score = filter_paeth(paeth_filtered, rgba_line, prev_encoded, width, bpp);
-
-         uint8_t filter       = 0;
-         unsigned min_sad     = none_score;
-         const uint8_t *chosen_filtered = rgba_line;
-
-         if (sub_score < min_sad)
-         {
-            filter = 1;
-            chosen_filtered = sub_filtered;
-            min_sad = sub_score;
-         }
-
-         if (up_score < min_sad)
-         {
-            filter = 2;
-            chosen_filtered = up_filtered;
-            min_sad = up_score;
-         }
-
-         if (avg_score < min_sad)
-         {
-            filter = 3;
-            chosen_filtered = avg_filtered;
-            min_sad = avg_score;
-         }
-
-         if (paeth_score < min_sad)
-         {
-            filter = 4;
-            chosen_filtered = paeth_filtered;
-         }
-
-         *encode_target++ = filter;
-         memcpy(encode_target, chosen_filtered, width * bpp);
-
-         memcpy(prev_encoded, rgba_line, width * bpp);
-      }
+      struct png_encode_band *band = &bands[i];
+      unsigned end_row             = (unsigned)((uint64_t)height * (i + 1) / num_bands);
+
+      band->data   = data + (ptrdiff_t)pitch * rows;
+      band->pitch  = pitch;
+      band->width  = width;
+      band->height = end_row - rows;
+      band->bpp    = bpp;
+      band->level  = level;
+      band->first  = i == 0;
+      band->last   = i == num_bands - 1;
+      rows         = end_row;
    }
 
-   deflate_buf = (uint8_t*)malloc(encode_buf_size * 2); /* Just to be sure. */
-   if (!deflate_buf)
-      GOTO_END_ERROR();
+   /* The last band is done on this thread, as are the others
+    * when threads can't be started. */
+   for (i = 0; i + 1 < num_bands; i++)
+   {
+#ifdef HAVE_THREADS
+      bands[i].thread = sthread_create(png_encode_band, &bands[i]);
+      if (!bands[i].thread)
+#endif
+         png_encode_band(&bands[i]);
+   }
+   png_encode_band(&bands[num_bands - 1]);
 
-   stream = stream_backend->stream_new();
+#ifdef HAVE_THREADS
+   for (i = 0; i + 1 < num_bands; i++)
+      if (bands[i].thread)
+         sthread_join(bands[i].thread);
+#endif
 
-   if (!stream)
-      GOTO_END_ERROR();
-
-   stream_backend->set_in(
-         stream,
-         encode_buf,
-         (unsigned)encode_buf_size);
-   stream_backend->set_out(
-         stream,
-         deflate_buf + 8,
-         (unsigned)(encode_buf_size * 2));
+   for (i = 0; i < num_bands; i++)
+   {
+      if (!bands[i].ok)
+         GOTO_END_ERROR();
+      adler = png_adler32_combine(adler, bands[i].adler, bands[i].filtered_size);
+   }
 
-   if (!stream_backend->trans(stream, true, &total_in, &total_out, NULL))
-      GOTO_END_ERROR();
+   dword_write_be(bands[num_bands - 1].chunk
+         + bands[num_bands - 1].chunk_size - 4, adler);
 
-   memcpy(deflate_buf + 4, "IDAT", 4);
-   dword_write_be(deflate_buf + 0,        ((uint32_t)total_out));
-   if (!png_write_idat_string(intf_s, deflate_buf, ((size_t)total_out + 8)))
-      GOTO_END_ERROR();
+   for (i = 0; i < num_bands; i++)
+      if (!png_write_idat_string(intf_s, bands[i].chunk, bands[i].chunk_size))
+         GOTO_END_ERROR();
 
    if (!png_write_iend_string(intf_s))
       GOTO_END_ERROR();
 end:
-   free(encode_buf);
-   free(deflate_buf);
-   free(rgba_line);
-   free(prev_encoded);
-   free(up_filtered);
-   free(sub_filtered);
-   free(avg_filtered);
-   free(paeth_filtered);
-
-   if (stream_backend)
+   if (bands)
    {
-      if (stream)
-      {
-         if (stream_backend->stream_free)
-            stream_backend->stream_free(stream);
-      }
+      for (i = 0; i < num_bands; i++)
+         free(bands[i].chunk);
+      free(bands);
    }
    return ret;
 }
 
-bool rpng_save_image_argb(const char *path, const uint32_t *data,
-      unsigned width, unsigned height, unsigned pitch)
+bool rpng_save_image_argb_level(const char *path, const uint32_t *data,
+      unsigned width, unsigned height, unsigned pitch, int level)
 {
    bool ret                      = false;
    intfstream_t* intf_s          = NULL;
@@ -377,14 +583,20 @@ bool rpng_save_image_argb(const char *path, const uint32_t *data,
 
    ret = rpng_save_image_stream((const uint8_t*) data, intf_s,
                                 width, height,
-                                (signed) pitch, sizeof(uint32_t));
+                                (signed) pitch, sizeof(uint32_t), level);
    intfstream_close(intf_s);
    free(intf_s);
    return ret;
 }
 
-bool rpng_save_image_bgr24(const char *path, const uint8_t *data,
+bool rpng_save_image_argb(const char *path, const uint32_t *data,
       unsigned width, unsigned height, unsigned pitch)
+{
+   return rpng_save_image_argb_level(path, data, width, height, pitch, 9);
+}
+
+bool rpng_save_image_bgr24_level(const char *path, const uint8_t *data,
+      unsigned width, unsigned height, unsigned pitch, int level)
 {
    bool ret                      = false;
    intfstream_t* intf_s          = NULL;
@@ -393,15 +605,22 @@ bool rpng_save_image_bgr24(const char *path, const uint8_t *data,
          RETRO_VFS_FILE_ACCESS_WRITE,
          RETRO_VFS_FILE_ACCESS_HINT_NONE);
    ret = rpng_save_image_stream(data, intf_s, width, height, 
-                                (signed) pitch, 3);
+                                (signed) pitch, 3, level);
    intfstream_close(intf_s);
    free(intf_s);
    return ret;
 }
 
+bool rpng_save_image_bgr24(const char *path, const uint8_t *data,
+      unsigned width, unsigned height, unsigned pitch)
+{
+   return rpng_save_image_bgr24_level(path, data, width, height, pitch, 9);
+}
+
 
-uint8_t* rpng_save_image_bgr24_string(const uint8_t *data,
-      unsigned width, unsigned height, signed pitch, uint64_t* bytes)
+uint8_t* rpng_save_image_bgr24_string_level(const uint8_t *data,
+      unsigned width, unsigned height, signed pitch, uint64_t* bytes,
+      int level)
 {
    bool ret                    = false;
    uint8_t* buf                = NULL;
@@ -420,7 +639,7 @@ uint8_t* rpng_save_image_bgr24_string(const uint8_t *data,
          buf_length);
 
    ret = rpng_save_image_stream((const uint8_t*)data, 
-            intf_s, width, height, pitch, 3);
+            intf_s, width, height, pitch, 3, level);
 
    *bytes = intfstream_get_ptr(intf_s);
    intfstream_rewind(intf_s);
@@ -430,10 +649,13 @@ uint8_t* rpng_save_image_bgr24_string(const uint8_t *data,
    intfstream_read(intf_s, output, *bytes);
 
 end:
-   if (buf)
-      free(buf);
    if (intf_s)
+   {
+      intfstream_close(intf_s);
       free(intf_s);
+   }
+   if (buf)
+      free(buf);
    if (ret == false)
    {
       if (output)
@@ -443,3 +665,9 @@ end:
    return output;
 }
 
+uint8_t* rpng_save_image_bgr24_string(const uint8_t *data,
+      unsigned width, unsigned height, signed pitch, uint64_t* bytes)
+{
+   return rpng_save_image_bgr24_string_level(data, width, height,
+         pitch, bytes, 9);
+}
@@ -0,0 +1,245 @@
+/* Copyright  (C) 2010-2020 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (rqoi.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <retro_inline.h>
+
+#include <formats/image.h>
+#include <formats/rqoi.h>
+
+#include "rqoi_internal.h"
+#include "../image_output.h"
+
+struct rqoi
+{
+   uint8_t *buff_data;
+   struct image_output output;
+};
+
+static INLINE uint32_t rqoi_read32be(const uint8_t *p)
+{
+   return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16)
+      | ((uint32_t)p[2] << 8) | p[3];
+}
+
+/* Checks the header; the image is always decoded to R, G, B, A */
+static bool rqoi_read_header(const uint8_t *buf, size_t size,
+      unsigned *width, unsigned *height)
+{
+   uint32_t w, h;
+
+   if (!buf || size < RQOI_HEADER_SIZE + RQOI_PADDING_SIZE
+         || memcmp(buf, rqoi_magic, sizeof(rqoi_magic)))
+      return false;
+
+   w = rqoi_read32be(buf + 4);
+   h = rqoi_read32be(buf + 8);
+
+   if (     !w || !h
+         || (buf[12] != 3 && buf[12] != 4)
+         || buf[13] > 1
+         || h > RQOI_PIXELS_MAX / w)
+      return false;
+
+   *width  = w;
+   *height = h;
+   return true;
+}
+
+/* Decodes to output, one row at a time */
+static bool rqoi_qoi_load(const uint8_t *buf, size_t size,
+      struct image_output *output, unsigned *x, unsigned *y)
+{
+   unsigned i, j;
+   unsigned width, height;
+   rqoi_pixel index[64];
+   rqoi_pixel px;
+   const uint8_t *p   = NULL;
+   const uint8_t *end = NULL;
+   uint8_t *row       = NULL;
+   unsigned run       = 0;
+   bool allocated     = false;
+   bool in_place;
+
+   if (!rqoi_read_header(buf, size, &width, &height))
+      return false;
+
+   *x = width;
+   *y = height;
+
+   if (!image_output_begin(output, width, height, &allocated))
+      return false;
+
+   /* Rows are built as R, G, B, A, in the output if it takes that */
+   in_place = image_output_is_rgba(output);
+   if (!in_place && !(row = (uint8_t*)malloc(4 * width)))
+   {
+      if (allocated)
+      {
+         free(output->data);
+         output->data = NULL;
+      }
+      return false;
+   }
+
+   memset(index, 0, sizeof(index));
+   px.rgba[0] = 0;
+   px.rgba[1] = 0;
+   px.rgba[2] = 0;
+   px.rgba[3] = 255;
+
+   /* Ops are at most five bytes, so the padding at the
+    * end keeps every read inside the buffer */
+   p   = buf + RQOI_HEADER_SIZE;
+   end = buf + size - RQOI_PADDING_SIZE;
+
+   for (j = 0; j < height; j++)
+   {
+      uint8_t *out = in_place ? image_output_row(output, j) : row;
+
+      for (i = 0; i < width; i++, out += 4)
+      {
+         if (run)
+            run--;
+         else if (p < end)
+         {
+            int b1 = *p++;
+
+            if (b1 == RQOI_OP_RGB)
+            {
+               px.rgba[0] = p[0];
+               px.rgba[1] = p[1];
+               px.rgba[2] = p[2];
+               p         += 3;
+            }
+            else if (b1 == RQOI_OP_RGBA)
+            {
+               memcpy(px.rgba, p, 4);
+               p         += 4;
+            }
+            else
+            {
+               switch (b1 & RQOI_MASK_2)
+               {
+                  case RQOI_OP_INDEX:
+                     px = index[b1];
+                     break;
+                  case RQOI_OP_DIFF:
+                     px.rgba[0] += ((b1 >> 4) & 3) - 2;
+                     px.rgba[1] += ((b1 >> 2) & 3) - 2;
+                     px.rgba[2] += ( b1       & 3) - 2;
+                     break;
+                  case RQOI_OP_LUMA:
+                     {
+                        int b2 = *p++;
+                        int vg = (b1 & 0x3f) - 32;
+                        px.rgba[0] += vg - 8 + ((b2 >> 4) & 0x0f);
+                        px.rgba[1] += vg;
+                        px.rgba[2] += vg - 8 + ( b2       & 0x0f);
+                     }
+                     break;
+                  case RQOI_OP_RUN:
+                     run = b1 & 0x3f;
+                     break;
+               }
+            }
+
+            index[RQOI_HASH(px)] = px;
+         }
+
+         memcpy(out, px.rgba, 4);
+      }
+
+      if (!in_place)
+         image_output_write_rgba(output, j, row, width);
+   }
+
+   free(row);
+   return true;
+}
+
+int rqoi_process_image(rqoi_t *rqoi, void **buf_data,
+      size_t size, unsigned *width, unsigned *height)
+{
+   struct image_output output;
+
+   if (!rqoi)
+      return IMAGE_PROCESS_ERROR;
+
+   output = rqoi->output;
+
+   if (!rqoi_qoi_load(rqoi->buff_data, size, &output, width, height))
+      return IMAGE_PROCESS_ERROR;
+
+   *buf_data = output.data;
+
+   return IMAGE_PROCESS_END;
+}
+
+bool rqoi_get_size(rqoi_t *rqoi, size_t size,
+      unsigned *width, unsigned *height)
+{
+   if (!rqoi)
+      return false;
+   return rqoi_read_header(rqoi->buff_data, size, width, height);
+}
+
+void rqoi_set_output(rqoi_t *rqoi, const struct image_output *output)
+{
+   if (!rqoi)
+      return;
+
+   if (output)
+      rqoi->output = *output;
+   else
+      memset(&rqoi->output, 0, sizeof(rqoi->output));
+}
+
+bool rqoi_set_buf_ptr(rqoi_t *rqoi, void *data)
+{
+   if (!rqoi)
+      return false;
+
+   rqoi->buff_data = (uint8_t*)data;
+
+   return true;
+}
+
+void rqoi_free(rqoi_t *rqoi)
+{
+   if (!rqoi)
+      return;
+
+   free(rqoi);
+}
+
+rqoi_t *rqoi_alloc(void)
+{
+   rqoi_t *rqoi = (rqoi_t*)calloc(1, sizeof(*rqoi));
+   if (!rqoi)
+      return NULL;
+   return rqoi;
+}
@@ -0,0 +1,332 @@
+/* Copyright  (C) 2010-2020 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (rqoi_encode.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <retro_inline.h>
+#include <streams/file_stream.h>
+#include <formats/rqoi.h>
+
+#include "rqoi_internal.h"
+
+/* Rows written to a file are gathered until there are this many */
+#define RQOI_FILE_ROWS 16
+
+typedef struct
+{
+   rqoi_pixel index[64];
+   rqoi_pixel prev;
+   unsigned run;
+} rqoi_encoder;
+
+static const uint8_t rqoi_padding[RQOI_PADDING_SIZE] = {0, 0, 0, 0, 0, 0, 0, 1};
+
+static void rqoi_encoder_init(rqoi_encoder *enc)
+{
+   memset(enc, 0, sizeof(*enc));
+   enc->prev.rgba[3] = 255;
+}
+
+static uint8_t *rqoi_write_header(uint8_t *out,
+      unsigned width, unsigned height, enum rqoi_source_type type)
+{
+   memcpy(out, rqoi_magic, sizeof(rqoi_magic));
+   out[4]  = (uint8_t)(width  >> 24);
+   out[5]  = (uint8_t)(width  >> 16);
+   out[6]  = (uint8_t)(width  >>  8);
+   out[7]  = (uint8_t)(width  >>  0);
+   out[8]  = (uint8_t)(height >> 24);
+   out[9]  = (uint8_t)(height >> 16);
+   out[10] = (uint8_t)(height >>  8);
+   out[11] = (uint8_t)(height >>  0);
+   /* channels, then colorspace: sRGB with linear alpha */
+   out[12] = type == RQOI_SOURCE_TYPE_ARGB8888 ? 4 : 3;
+   out[13] = 0;
+   return out + RQOI_HEADER_SIZE;
+}
+
+/* Widens a row of the source to R, G, B, A bytes */
+static void rqoi_fill_row(uint8_t *dst, const void *src,
+      unsigned width, enum rqoi_source_type type)
+{
+   unsigned i;
+
+   switch (type)
+   {
+      case RQOI_SOURCE_TYPE_XRGB8888:
+      case RQOI_SOURCE_TYPE_ARGB8888:
+         {
+            const uint32_t *in = (const uint32_t*)src;
+            bool alpha         = type == RQOI_SOURCE_TYPE_ARGB8888;
+            for (i = 0; i < width; i++, dst += 4)
+            {
+               uint32_t pixel = in[i];
+               dst[0]         = (uint8_t)(pixel >> 16);
+               dst[1]         = (uint8_t)(pixel >>  8);
+               dst[2]         = (uint8_t)(pixel >>  0);
+               dst[3]         = alpha ? (uint8_t)(pixel >> 24) : 255;
+            }
+         }
+         break;
+      case RQOI_SOURCE_TYPE_RGB565:
+         {
+            const uint16_t *in = (const uint16_t*)src;
+            for (i = 0; i < width; i++, dst += 4)
+            {
+               uint16_t pixel = in[i];
+               uint8_t r      = (pixel >> 11) & 0x1f;
+               uint8_t g      = (pixel >>  5) & 0x3f;
+               uint8_t b      = (pixel >>  0) & 0x1f;
+               dst[0]         = (r << 3) | (r >> 2);
+               dst[1]         = (g << 2) | (g >> 4);
+               dst[2]         = (b << 3) | (b >> 2);
+               dst[3]         = 255;
+            }
+         }
+         break;
+      case RQOI_SOURCE_TYPE_BGR24:
+         {
+            const uint8_t *in = (const uint8_t*)src;
+            for (i = 0; i < width; i++, in += 3, dst += 4)
+            {
+               dst[0] = in[2];
+               dst[1] = in[1];
+               dst[2] = in[0];
+               dst[3] = 255;
+            }
+         }
+         break;
+   }
+}
+
+/* Encodes a row of R, G, B, A bytes. Writes at most 5 bytes a pixel;
+ * a run can carry over into the next row. */
+static uint8_t *rqoi_encode_row(rqoi_encoder *enc,
+      const uint8_t *rgba, unsigned width, uint8_t *out)
+{
+   unsigned i;
+   rqoi_pixel prev = enc->prev;
+   unsigned run    = enc->run;
+
+   for (i = 0; i < width; i++, rgba += 4)
+   {
+      int h;
+      rqoi_pixel px;
+
+      memcpy(px.rgba, rgba, 4);
+
+      if (px.v == prev.v)
+      {
+         if (++run == RQOI_RUN_MAX)
+         {
+            *out++ = RQOI_OP_RUN | (run - 1);
+            run    = 0;
+         }
+         continue;
+      }
+
+      if (run)
+      {
+         *out++ = RQOI_OP_RUN | (run - 1);
+         run    = 0;
+      }
+
+      h = RQOI_HASH(px);
+
+      if (enc->index[h].v == px.v)
+         *out++ = RQOI_OP_INDEX | h;
+      else
+      {
+         enc->index[h] = px;
+
+         if (px.rgba[3] == prev.rgba[3])
+         {
+            signed char vr   = (signed char)(px.rgba[0] - prev.rgba[0]);
+            signed char vg   = (signed char)(px.rgba[1] - prev.rgba[1]);
+            signed char vb   = (signed char)(px.rgba[2] - prev.rgba[2]);
+            signed char vg_r = (signed char)(vr - vg);
+            signed char vg_b = (signed char)(vb - vg);
+
+            if (     vr > -3 && vr < 2
+                  && vg > -3 && vg < 2
+                  && vb > -3 && vb < 2)
+               *out++ = RQOI_OP_DIFF
+                  | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2);
+            else if (   vg_r >  -9 && vg_r <  8
+                     && vg   > -33 && vg   < 32
+                     && vg_b >  -9 && vg_b <  8)
+            {
+               *out++ = RQOI_OP_LUMA | (vg + 32);
+               *out++ = (vg_r + 8) << 4 | (vg_b + 8);
+            }
+            else
+            {
+               *out++ = RQOI_OP_RGB;
+               *out++ = px.rgba[0];
+               *out++ = px.rgba[1];
+               *out++ = px.rgba[2];
+            }
+         }
+         else
+         {
+            *out++ = RQOI_OP_RGBA;
+            memcpy(out, px.rgba, 4);
+            out   += 4;
+         }
+      }
+
+      prev = px;
+   }
+
+   enc->prev = prev;
+   enc->run  = run;
+   return out;
+}
+
+/* Flushes a pending run and ends the stream; at most 9 bytes */
+static uint8_t *rqoi_encode_end(rqoi_encoder *enc, uint8_t *out)
+{
+   if (enc->run)
+      *out++ = RQOI_OP_RUN | (enc->run - 1);
+   enc->run = 0;
+   memcpy(out, rqoi_padding, sizeof(rqoi_padding));
+   return out + sizeof(rqoi_padding);
+}
+
+static bool rqoi_check_size(unsigned width, unsigned height)
+{
+   return width && height && height <= RQOI_PIXELS_MAX / width;
+}
+
+uint8_t *rqoi_save_image_string(
+      const void *frame,
+      unsigned width, unsigned height,
+      unsigned pitch, enum rqoi_source_type type,
+      uint64_t *bytes)
+{
+   unsigned j;
+   rqoi_encoder enc;
+   size_t max_size, len;
+   uint8_t *row      = NULL;
+   uint8_t *buf      = NULL;
+   uint8_t *out      = NULL;
+   uint8_t *shrunk   = NULL;
+   const uint8_t *in = (const uint8_t*)frame;
+
+   if (!frame || !rqoi_check_size(width, height))
+      return NULL;
+
+   max_size = RQOI_HEADER_SIZE + (size_t)width * height * 5
+      + 1 + RQOI_PADDING_SIZE;
+
+   if (     !(row = (uint8_t*)malloc((size_t)width * 4))
+         || !(buf = (uint8_t*)malloc(max_size)))
+   {
+      free(row);
+      return NULL;
+   }
+
+   rqoi_encoder_init(&enc);
+   out = rqoi_write_header(buf, width, height, type);
+
+   for (j = 0; j < height; j++, in += pitch)
+   {
+      rqoi_fill_row(row, in, width, type);
+      out = rqoi_encode_row(&enc, row, width, out);
+   }
+
+   out = rqoi_encode_end(&enc, out);
+   len = out - buf;
+   free(row);
+
+   /* Hand back no more than the file needs */
+   if ((shrunk = (uint8_t*)realloc(buf, len)))
+      buf = shrunk;
+
+   if (bytes)
+      *bytes = len;
+   return buf;
+}
+
+bool rqoi_save_image(
+      const char *filename,
+      const void *frame,
+      unsigned width, unsigned height,
+      unsigned pitch, enum rqoi_source_type type)
+{
+   unsigned j;
+   rqoi_encoder enc;
+   size_t row_max;
+   RFILE *file       = NULL;
+   uint8_t *row      = NULL;
+   uint8_t *buf      = NULL;
+   uint8_t *out      = NULL;
+   bool ret          = false;
+   const uint8_t *in = (const uint8_t*)frame;
+
+   if (!frame || !rqoi_check_size(width, height))
+      return false;
+
+   /* Enough for the header, or for a row and the end */
+   row_max = (size_t)width * 5 + 1 + RQOI_PADDING_SIZE;
+   if (row_max < RQOI_HEADER_SIZE)
+      row_max = RQOI_HEADER_SIZE;
+
+   if (     !(row = (uint8_t*)malloc((size_t)width * 4))
+         || !(buf = (uint8_t*)malloc(row_max * RQOI_FILE_ROWS)))
+      goto end;
+
+   if (!(file = filestream_open(filename,
+         RETRO_VFS_FILE_ACCESS_WRITE,
+         RETRO_VFS_FILE_ACCESS_HINT_NONE)))
+      goto end;
+
+   rqoi_encoder_init(&enc);
+   out = rqoi_write_header(buf, width, height, type);
+
+   for (j = 0; j < height; j++, in += pitch)
+   {
+      /* Write out what's gathered once another row might not fit */
+      if ((size_t)(out - buf) > row_max * (RQOI_FILE_ROWS - 1))
+      {
+         if (filestream_write(file, buf, out - buf) != out - buf)
+            goto end;
+         out = buf;
+      }
+
+      rqoi_fill_row(row, in, width, type);
+      out = rqoi_encode_row(&enc, row, width, out);
+   }
+
+   out = rqoi_encode_end(&enc, out);
+   ret = filestream_write(file, buf, out - buf) == out - buf;
+
+end:
+   if (file)
+      filestream_close(file);
+   free(row);
+   free(buf);
+   return ret;
+}
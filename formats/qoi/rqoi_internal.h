@@ -0,0 +1,59 @@
+/* Copyright  (C) 2010-2020 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (rqoi_internal.h).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef _RQOI_INTERNAL_H
+#define _RQOI_INTERNAL_H
+
+#include <stdint.h>
+
+/* Two bit tags in the high bits of an op, the rest its payload;
+ * the RGB and RGBA ops take up two of the RUN op's codes */
+#define RQOI_OP_INDEX  0x00
+#define RQOI_OP_DIFF   0x40
+#define RQOI_OP_LUMA   0x80
+#define RQOI_OP_RUN    0xc0
+#define RQOI_OP_RGB    0xfe
+#define RQOI_OP_RGBA   0xff
+
+#define RQOI_MASK_2    0xc0
+
+#define RQOI_HEADER_SIZE  14
+#define RQOI_PADDING_SIZE 8
+#define RQOI_RUN_MAX      62
+
+/* Beyond this, files are taken to be corrupt rather than decoded */
+#define RQOI_PIXELS_MAX   400000000
+
+#define RQOI_HASH(px) (((px).rgba[0] * 3 + (px).rgba[1] * 5 \
+         + (px).rgba[2] * 7 + (px).rgba[3] * 11) & 63)
+
+/* A pixel as R, G, B, A bytes, compared as one word */
+typedef union
+{
+   uint8_t rgba[4];
+   uint32_t v;
+} rqoi_pixel;
+
+static const uint8_t rqoi_magic[4] = { 'q', 'o', 'i', 'f' };
+
+#endif
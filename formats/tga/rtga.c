@@ -35,12 +35,12 @@
 #include <formats/image.h>
 #include <formats/rtga.h>
 
-#define RTGA_COMPUTE_Y(r, g, b) ((uint8_t)((((r) * 77) + ((g) * 150) +  (29 * (b))) >> 8))
+#include "../image_output.h"
 
 struct rtga
 {
    uint8_t *buff_data;
-   uint32_t *output_image;
+   struct image_output output;
 };
 
 typedef struct
@@ -78,112 +78,53 @@ static int rtga_get16le(rtga_context *s)
    return rtga_get8(s) + (rtga_get8(s) << 8);
 }
 
-static unsigned char *rtga_convert_format(
-      unsigned char *data,
-      int img_n,
-      int req_comp,
-      unsigned int x,
-      unsigned int y)
+/* Widens a row of comp byte pixels, grey, grey and alpha, or
+ * B, G, R (A), to R, G, B, A */
+static void rtga_expand_row(uint8_t *dst, const uint8_t *src,
+      int width, int comp)
 {
-   int i,j;
-   unsigned char *good = (unsigned char *) malloc(req_comp * x * y);
+   int i;
 
-   if (!good)
+   switch (comp)
    {
-      free(data);
-      return NULL;
-   }
-
-   for (j=0; j < (int) y; ++j)
-   {
-      unsigned char *src  = data + j * x * img_n   ;
-      unsigned char *dest = good + j * x * req_comp;
-
-      switch (((img_n)*8+(req_comp)))
-      {
-         case ((1)*8+(2)):
-            for(i=x-1; i >= 0; --i, src += 1, dest += 2)
-            {
-               dest[0]=src[0];
-               dest[1]=255;
-            }
-            break;
-         case ((1)*8+(3)):
-            for(i=x-1; i >= 0; --i, src += 1, dest += 3)
-               dest[0]=dest[1]=dest[2]=src[0];
-            break;
-         case ((1)*8+(4)):
-            for(i=x-1; i >= 0; --i, src += 1, dest += 4)
-            {
-               dest[0]=dest[1]=dest[2]=src[0];
-               dest[3]=255;
-            }
-            break;
-         case ((2)*8+(1)):
-            for(i=x-1; i >= 0; --i, src += 2, dest += 1)
-               dest[0]=src[0];
-            break;
-         case ((2)*8+(3)):
-            for(i=x-1; i >= 0; --i, src += 2, dest += 3)
-               dest[0]=dest[1]=dest[2]=src[0];
-            break;
-         case ((2)*8+(4)):
-            for(i=x-1; i >= 0; --i, src += 2, dest += 4)
-            {
-               dest[0]=dest[1]=dest[2]=src[0];
-               dest[3]=src[1];
-            }
-            break;
-         case ((3)*8+(4)):
-            for(i=x-1; i >= 0; --i, src += 3, dest += 4)
-            {
-               dest[0]=src[0];
-               dest[1]=src[1];
-               dest[2]=src[2];
-               dest[3]=255;
-            }
-            break;
-         case ((3)*8+(1)):
-            for(i=x-1; i >= 0; --i, src += 3, dest += 1)
-               dest[0] = RTGA_COMPUTE_Y(src[0],src[1],src[2]);
-            break;
-         case ((3)*8+(2)):
-            for(i=x-1; i >= 0; --i, src += 3, dest += 2)
-            {
-               dest[0] = RTGA_COMPUTE_Y(src[0],src[1],src[2]);
-               dest[1] = 255;
-            }
-            break;
-         case ((4)*8+(1)):
-            for(i=x-1; i >= 0; --i, src += 4, dest += 1)
-               dest[0] = RTGA_COMPUTE_Y(src[0],src[1],src[2]);
-            break;
-         case ((4)*8+(2)):
-            for(i=x-1; i >= 0; --i, src += 4, dest += 2)
-            {
-               dest[0] = RTGA_COMPUTE_Y(src[0],src[1],src[2]);
-               dest[1] = src[3];
-            }
-            break;
-         case ((4)*8+(3)):
-            for(i=x-1; i >= 0; --i, src += 4, dest += 3)
-            {
-               dest[0]=src[0];
-               dest[1]=src[1];
-               dest[2]=src[2];
-            }
-            break;
-         default:
-            break;
-      }
+      case 1:
+         for (i = 0; i < width; i++, src += 1, dst += 4)
+         {
+            dst[0] = dst[1] = dst[2] = src[0];
+            dst[3] = 255;
+         }
+         break;
+      case 2:
+         for (i = 0; i < width; i++, src += 2, dst += 4)
+         {
+            dst[0] = dst[1] = dst[2] = src[0];
+            dst[3] = src[1];
+         }
+         break;
+      case 3:
+         for (i = 0; i < width; i++, src += 3, dst += 4)
+         {
+            dst[0] = src[2];
+            dst[1] = src[1];
+            dst[2] = src[0];
+            dst[3] = 255;
+         }
+         break;
+      case 4:
+         for (i = 0; i < width; i++, src += 4, dst += 4)
+         {
+            dst[0] = src[2];
+            dst[1] = src[1];
+            dst[2] = src[0];
+            dst[3] = src[3];
+         }
+         break;
    }
-
-   free(data);
-   return good;
 }
 
-static uint8_t *rtga_tga_load(rtga_context *s,
-      unsigned *x, unsigned *y, int *comp, int req_comp)
+/* Decodes to output, one row at a time */
+static bool rtga_tga_load(rtga_context *s, struct image_output *output,
+      unsigned *x, unsigned *y)
 {
    /* Read in the TGA header stuff */
    int tga_offset          = rtga_get8(s);
@@ -200,11 +141,17 @@ static uint8_t *rtga_tga_load(rtga_context *s,
    int tga_bits_per_pixel  = rtga_get8(s);
    int tga_comp            = tga_bits_per_pixel / 8;
    int tga_inverted        = rtga_get8(s);
+   int i, j, k;
+   int RLE_repeating          = 0;
+   int RLE_count              = 0;
+   int read_next_pixel        = 1;
+   unsigned char raw_data[4]  = {0};
+   unsigned char *tga_palette = NULL;
+   uint8_t *tga_row           = NULL; /* tga_comp bytes a pixel */
+   uint8_t *rgba              = NULL;
+   bool allocated             = false;
+   bool in_place;
 
-   /*   image data */
-   unsigned char *tga_data = NULL;
-
-   (void)tga_palette_start;
    (void)tga_x_origin;
    (void)tga_y_origin;
 
@@ -227,221 +174,191 @@ static uint8_t *rtga_tga_load(rtga_context *s,
           (tga_bits_per_pixel != 24) && (tga_bits_per_pixel != 32)
          )
       )
-      return NULL; /* we don't report this as a bad TGA because we don't even know if it's TGA */
+      return false; /* we don't report this as a bad TGA because we don't even know if it's TGA */
 
    /*   If paletted, then we will use the number of bits from the palette */
    if (tga_indexed)
       tga_comp = tga_palette_bits / 8;
 
+   if (tga_comp < 1 || tga_comp > 4)
+      return false;
+
    /*   TGA info */
    *x = tga_width;
    *y = tga_height;
-   if (comp)
-      *comp = tga_comp;
 
-   tga_data = (unsigned char*)malloc((size_t)tga_width * tga_height * tga_comp);
-   if (!tga_data)
-      return NULL;
+   if (!image_output_begin(output, tga_width, tga_height, &allocated))
+      return false;
+
+   in_place = image_output_is_rgba(output);
+   tga_row  = (uint8_t*)malloc((size_t)tga_width * tga_comp);
+   if (!in_place)
+      rgba  = (uint8_t*)malloc((size_t)tga_width * 4);
+   if (!tga_row || (!in_place && !rgba))
+      goto error;
 
    /* skip to the data's starting position (offset usually = 0) */
    rtga_skip(s, tga_offset );
 
-   if (!tga_indexed && !tga_is_RLE)
+   /*   Do I need to load a palette? */
+   if (tga_indexed)
    {
-      int i;
-      for (i=0; i < tga_height; ++i)
-      {
-         int _y           = tga_inverted ? (tga_height -i - 1) : i;
-         uint8_t *tga_row = tga_data + _y * tga_width * tga_comp;
-         int n            = tga_width * tga_comp;
+      int n = tga_palette_len * tga_palette_bits / 8;
 
-         if (s->img_buffer + n <= s->img_buffer_end)
-         {
-            memcpy(tga_row, s->img_buffer, n);
-            s->img_buffer += n;
-         }
-      }
+      /* Any data to skip? (offset usually = 0) */
+      rtga_skip(s, tga_palette_start );
+      /* Load the palette */
+      if (     !(tga_palette = (unsigned char*)malloc(n))
+            || s->img_buffer + n > s->img_buffer_end)
+         goto error;
+
+      memcpy(tga_palette, s->img_buffer, n);
+      s->img_buffer += n;
    }
-   else
-   {
-      int i, j;
-      int RLE_repeating          = 0;
-      int RLE_count              = 0;
-      int read_next_pixel        = 1;
-      unsigned char raw_data[4]  = {0};
-      unsigned char *tga_palette = NULL;
-
-      /*   Do I need to load a palette? */
-      if (tga_indexed)
-      {
-         int n;
-         /* Any data to skip? (offset usually = 0) */
-         rtga_skip(s, tga_palette_start );
-         /* Load the palette */
-         tga_palette = (unsigned char*)malloc(tga_palette_len * tga_palette_bits / 8);
 
-         if (!tga_palette)
-         {
-            free(tga_data);
-            return NULL;
-         }
+   for (i = 0; i < tga_height; ++i)
+   {
+      /* Bottom up unless inverted */
+      int _y = tga_inverted ? (tga_height - i - 1) : i;
 
-         n = tga_palette_len * tga_palette_bits / 8;
+      if (!tga_indexed && !tga_is_RLE)
+      {
+         int n = tga_width * tga_comp;
 
-         if (s->img_buffer+n <= s->img_buffer_end)
+         if (s->img_buffer + n <= s->img_buffer_end)
          {
-            memcpy(tga_palette, s->img_buffer, n);
+            memcpy(tga_row, s->img_buffer, n);
             s->img_buffer += n;
          }
          else
-         {
-            free(tga_data);
-            free(tga_palette);
-            return NULL;
-         }
+            memset(tga_row, 0, n);
       }
-
-      /*   load the data */
-      for (i=0; i < tga_width * tga_height; ++i)
+      else
       {
-         /*   if I'm in RLE mode, do I need to get a RLE rtga_png chunk? */
-         if (tga_is_RLE)
-         {
-            if (RLE_count == 0)
-            {
-               /*   yep, get the next byte as a RLE command */
-               int RLE_cmd     = rtga_get8(s);
-               RLE_count       = 1 + (RLE_cmd & 127);
-               RLE_repeating   = RLE_cmd >> 7;
-               read_next_pixel = 1;
-            }
-            else if (!RLE_repeating)
-               read_next_pixel = 1;
-         }
-         else
-            read_next_pixel = 1;
-
-         /*   OK, if I need to read a pixel, do it now */
-         if (read_next_pixel)
+         for (k = 0; k < tga_width; ++k)
          {
-            /*   load however much data we did have */
-            if (tga_indexed)
+            /*   if I'm in RLE mode, do I need to get a RLE rtga_png chunk? */
+            if (tga_is_RLE)
             {
-               /*   read in 1 byte, then perform the lookup */
-               int pal_idx = rtga_get8(s);
-               if (pal_idx >= tga_palette_len) /* invalid index */
-                  pal_idx = 0;
-               pal_idx *= tga_bits_per_pixel / 8;
-               for (j = 0; j*8 < tga_bits_per_pixel; ++j)
-                  raw_data[j] = tga_palette[pal_idx+j];
+               if (RLE_count == 0)
+               {
+                  /*   yep, get the next byte as a RLE command */
+                  int RLE_cmd     = rtga_get8(s);
+                  RLE_count       = 1 + (RLE_cmd & 127);
+                  RLE_repeating   = RLE_cmd >> 7;
+                  read_next_pixel = 1;
+               }
+               else if (!RLE_repeating)
+                  read_next_pixel = 1;
             }
             else
-            {
-               /* read in the data raw */
-               for (j = 0; j*8 < tga_bits_per_pixel; ++j)
-                  raw_data[j] = rtga_get8(s);
-            }
-
-            /*   clear the reading flag for the next pixel */
-            read_next_pixel = 0;
-         } /* end of reading a pixel */
-
-         /* copy data */
-         for (j = 0; j < tga_comp; ++j)
-            tga_data[i*tga_comp+j] = raw_data[j];
-
-         /*   in case we're in RLE mode, keep counting down */
-         --RLE_count;
-      }
-
-      /*   do I need to invert the image? */
-      if (tga_inverted)
-      {
-         for (j = 0; j*2 < tga_height; ++j)
-         {
-            int index1 = j * tga_width * tga_comp;
-            int index2 = (tga_height - 1 - j) * tga_width * tga_comp;
+               read_next_pixel = 1;
 
-            for (i = tga_width * tga_comp; i > 0; --i)
+            /*   OK, if I need to read a pixel, do it now */
+            if (read_next_pixel)
             {
-               unsigned char temp = tga_data[index1];
-               tga_data[index1] = tga_data[index2];
-               tga_data[index2] = temp;
-               ++index1;
-               ++index2;
-            }
+               /*   load however much data we did have */
+               if (tga_indexed)
+               {
+                  /*   read in 1 byte, then perform the lookup */
+                  int pal_idx = rtga_get8(s);
+                  if (pal_idx >= tga_palette_len) /* invalid index */
+                     pal_idx = 0;
+                  pal_idx *= tga_bits_per_pixel / 8;
+                  for (j = 0; j*8 < tga_bits_per_pixel; ++j)
+                     raw_data[j] = tga_palette[pal_idx+j];
+               }
+               else
+               {
+                  /* read in the data raw */
+                  for (j = 0; j*8 < tga_bits_per_pixel; ++j)
+                     raw_data[j] = rtga_get8(s);
+               }
+
+               /*   clear the reading flag for the next pixel */
+               read_next_pixel = 0;
+            } /* end of reading a pixel */
+
+            /* copy data */
+            for (j = 0; j < tga_comp; ++j)
+               tga_row[k*tga_comp+j] = raw_data[j];
+
+            /*   in case we're in RLE mode, keep counting down */
+            --RLE_count;
          }
       }
 
-      /* Clear my palette, if I had one */
-      if (tga_palette)
-         free(tga_palette);
-   }
-
-   /* swap RGB */
-   if (tga_comp >= 3)
-   {
-      int i;
-      unsigned char* tga_pixel = tga_data;
-
-      for (i = 0; i < tga_width * tga_height; ++i)
+      if (in_place)
+         rtga_expand_row(image_output_row(output, _y), tga_row, tga_width, tga_comp);
+      else
       {
-         unsigned char temp  = tga_pixel[0];
-         tga_pixel[0]        = tga_pixel[2];
-         tga_pixel[2]        = temp;
-         tga_pixel          += tga_comp;
+         rtga_expand_row(rgba, tga_row, tga_width, tga_comp);
+         image_output_write_rgba(output, _y, rgba, tga_width);
       }
    }
 
-   /* convert to target component count */
-   if (     (req_comp)
-         && (req_comp >= 1 && req_comp <= 4)
-         && (req_comp != tga_comp))
+   free(tga_palette);
+   free(tga_row);
+   free(rgba);
+   return true;
+
+error:
+   free(tga_palette);
+   free(tga_row);
+   free(rgba);
+   if (allocated)
    {
-      tga_data = rtga_convert_format(tga_data, tga_comp, req_comp, tga_width, tga_height);
+      free(output->data);
+      output->data = NULL;
    }
-
-   return tga_data;
+   return false;
 }
 
-static uint8_t *rtga_load_from_memory(uint8_t const *buffer, int len,
-      unsigned *x, unsigned *y, int *comp, int req_comp)
+int rtga_process_image(rtga_t *rtga, void **buf_data,
+      size_t size, unsigned *width, unsigned *height)
 {
    rtga_context s;
+   struct image_output output;
+
+   if (!rtga)
+      return IMAGE_PROCESS_ERROR;
+
+   s.img_buffer          = rtga->buff_data;
+   s.img_buffer_original = rtga->buff_data;
+   s.img_buffer_end      = rtga->buff_data + size;
+   output                = rtga->output;
+
+   if (!rtga_tga_load(&s, &output, width, height))
+      return IMAGE_PROCESS_ERROR;
 
-   s.img_buffer          = (uint8_t *)buffer;
-   s.img_buffer_original = (uint8_t *) buffer;
-   s.img_buffer_end      = (uint8_t *) buffer+len;
+   *buf_data = output.data;
 
-   return rtga_tga_load(&s,x,y,comp,req_comp);
+   return IMAGE_PROCESS_END;
 }
 
-int rtga_process_image(rtga_t *rtga, void **buf_data,
-      size_t size, unsigned *width, unsigned *height)
+bool rtga_get_size(rtga_t *rtga, size_t size,
+      unsigned *width, unsigned *height)
 {
-   int comp;
-   unsigned size_tex     = 0;
+   const uint8_t *p = rtga ? rtga->buff_data : NULL;
 
-   if (!rtga)
-      return IMAGE_PROCESS_ERROR;
+   /* The header is 18 bytes; the size is at 12 */
+   if (!p || size < 18)
+      return false;
 
-   rtga->output_image   = (uint32_t*)rtga_load_from_memory(rtga->buff_data,
-                           (int)size, width, height, &comp, 4);
-   *buf_data             = rtga->output_image;
-   size_tex              = (*width) * (*height);
+   *width  = p[12] | (p[13] << 8);
+   *height = p[14] | (p[15] << 8);
+   return *width && *height;
+}
 
-   /* Convert RGBA to ARGB */
-   while(size_tex--)
-   {
-      unsigned int texel = rtga->output_image[size_tex];
-      unsigned int A     = texel & 0xFF000000;
-      unsigned int B     = texel & 0x00FF0000;
-      unsigned int G     = texel & 0x0000FF00;
-      unsigned int R     = texel & 0x000000FF;
-      ((unsigned int*)rtga->output_image)[size_tex] = A | (R << 16) | G | (B >> 16);
-   };
+void rtga_set_output(rtga_t *rtga, const struct image_output *output)
+{
+   if (!rtga)
+      return;
 
-   return IMAGE_PROCESS_END;
+   if (output)
+      rtga->output = *output;
+   else
+      memset(&rtga->output, 0, sizeof(rtga->output));
 }
 
 bool rtga_set_buf_ptr(rtga_t *rtga, void *data)
@@ -25,7 +25,9 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <boolean.h>
 #include <retro_inline.h>
+#include <features/features_cpu.h>
 
 #include <gfx/scaler/pixconv.h>
 
@@ -43,6 +45,245 @@
 #include <mmintrin.h>
 #endif
 
+/* AVX2 kernels are built whenever the compiler can target AVX2, and
+ * only picked at runtime when the CPU has it */
+#if defined(__SSE2__) && !defined(SCALER_NO_AVX2) \
+   && (defined(__AVX2__) || (defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__))))
+#define PIXCONV_AVX2
+#include <immintrin.h>
+
+#ifdef __AVX2__
+#define PIXCONV_AVX2_TARGET
+#else
+#define PIXCONV_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+/* The conversions each have a scalar reference, the pixconv_*
+ * helpers in pixconv.h, and SSE2 and AVX2 paths that must give
+ * the same bytes for every input. The SIMD paths do the bulk of each row and leave the last
+ * few pixels to the scalar code. */
+
+/* SIMD the conversions may use, from cpu_features_get() on first
+ * use. The flags and a ready bit share one word, so threads racing to
+ * fill it each store the same whole value, and nothing detects twice
+ * once it is set. scaler_ctx_gen_filter fills it ahead of the band
+ * workers through pixconv_init. */
+#define PIXCONV_SIMD_READY (1u << 31)
+static unsigned pixconv_simd_mask;
+
+void pixconv_init(void)
+{
+   uint64_t mask;
+
+   if (pixconv_simd_mask & PIXCONV_SIMD_READY)
+      return;
+
+   mask = cpu_features_get();
+
+   /* the CPU may report AVX2 without the OS enabling AVX state */
+   if (!(mask & RETRO_SIMD_AVX))
+      mask &= ~(uint64_t)RETRO_SIMD_AVX2;
+
+   pixconv_simd_mask = (unsigned)mask | PIXCONV_SIMD_READY;
+}
+
+static uint64_t pixconv_simd(void)
+{
+   unsigned mask = pixconv_simd_mask;
+
+   if (!(mask & PIXCONV_SIMD_READY))
+   {
+      pixconv_init();
+      mask = pixconv_simd_mask;
+   }
+
+   return mask & ~PIXCONV_SIMD_READY;
+}
+
+#ifdef PIXCONV_AVX2
+/* Channels are 16-bit lanes holding 8-bit values, for 16 pixels in
+ * order. Lane order within 128 bits means the halves are swapped
+ * back into place here. */
+static INLINE PIXCONV_AVX2_TARGET void pixconv_interleave_avx2(
+      __m256i b, __m256i g, __m256i r, __m256i a,
+      __m256i *px0, __m256i *px8)
+{
+   __m256i bg = _mm256_or_si256(b, _mm256_slli_epi16(g, 8));
+   __m256i ra = _mm256_or_si256(r, _mm256_slli_epi16(a, 8));
+   __m256i lo = _mm256_unpacklo_epi16(bg, ra);
+   __m256i hi = _mm256_unpackhi_epi16(bg, ra);
+   *px0       = _mm256_permute2x128_si256(lo, hi, 0x20);
+   *px8       = _mm256_permute2x128_si256(lo, hi, 0x31);
+}
+
+static INLINE PIXCONV_AVX2_TARGET void pixconv_store_argb8888_avx2(
+      uint32_t *out, __m256i b, __m256i g, __m256i r, __m256i a)
+{
+   __m256i px0, px8;
+   pixconv_interleave_avx2(b, g, r, a, &px0, &px8);
+   _mm256_storeu_si256((__m256i*)(out + 0), px0);
+   _mm256_storeu_si256((__m256i*)(out + 8), px8);
+}
+
+/* Writes exactly 24 bytes for 8 pixels, with @shuf picking the
+ * three bytes of each pixel in each 128-bit lane */
+static INLINE PIXCONV_AVX2_TARGET void pixconv_store_bgr24_avx2(
+      uint8_t *out, __m256i px, __m256i shuf)
+{
+   const __m256i perm = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+   __m256i v          = _mm256_permutevar8x32_epi32(
+         _mm256_shuffle_epi8(px, shuf), perm);
+   _mm_storeu_si128((__m128i*)out, _mm256_castsi256_si128(v));
+   _mm_storel_epi64((__m128i*)(out + 16), _mm256_extracti128_si256(v, 1));
+}
+
+static INLINE PIXCONV_AVX2_TARGET __m256i pixconv_bgr24_shuf_avx2(void)
+{
+   return _mm256_setr_epi8(
+         0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+         0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+}
+
+/* Reads 28 bytes for 8 pixels, giving 0x00RRGGBB */
+static INLINE PIXCONV_AVX2_TARGET __m256i pixconv_load_bgr24_avx2(
+      const uint8_t *in)
+{
+   const __m256i shuf = _mm256_setr_epi8(
+         0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+         0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+   __m256i v          = _mm256_inserti128_si256(
+         _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)in)),
+         _mm_loadu_si128((const __m128i*)(in + 12)), 1);
+   return _mm256_shuffle_epi8(v, shuf);
+}
+
+/* Packs 16 pixels of 32-bit lanes holding 16-bit values */
+static INLINE PIXCONV_AVX2_TARGET __m256i pixconv_pack16_avx2(
+      __m256i px0, __m256i px8)
+{
+   return _mm256_permute4x64_epi64(_mm256_packus_epi32(px0, px8), 0xd8);
+}
+
+static INLINE PIXCONV_AVX2_TARGET __m256i pixconv_expand5_avx2(__m256i x)
+{
+   return _mm256_or_si256(_mm256_slli_epi16(x, 3), _mm256_srli_epi16(x, 2));
+}
+
+static INLINE PIXCONV_AVX2_TARGET __m256i pixconv_expand6_avx2(__m256i x)
+{
+   return _mm256_or_si256(_mm256_slli_epi16(x, 2), _mm256_srli_epi16(x, 4));
+}
+
+static INLINE PIXCONV_AVX2_TARGET __m256i pixconv_expand4_avx2(__m256i x)
+{
+   return _mm256_or_si256(_mm256_slli_epi16(x, 4), x);
+}
+
+static INLINE PIXCONV_AVX2_TARGET void pixconv_split_0rgb1555_avx2(
+      __m256i in, __m256i *r, __m256i *g, __m256i *b)
+{
+   const __m256i mask5 = _mm256_set1_epi16(0x1f);
+   *r = pixconv_expand5_avx2(_mm256_and_si256(_mm256_srli_epi16(in, 10), mask5));
+   *g = pixconv_expand5_avx2(_mm256_and_si256(_mm256_srli_epi16(in,  5), mask5));
+   *b = pixconv_expand5_avx2(_mm256_and_si256(in, mask5));
+}
+
+static INLINE PIXCONV_AVX2_TARGET void pixconv_split_rgb565_avx2(
+      __m256i in, __m256i *r, __m256i *g, __m256i *b)
+{
+   *r = pixconv_expand5_avx2(_mm256_srli_epi16(in, 11));
+   *g = pixconv_expand6_avx2(_mm256_and_si256(_mm256_srli_epi16(in, 5),
+            _mm256_set1_epi16(0x3f)));
+   *b = pixconv_expand5_avx2(_mm256_and_si256(in, _mm256_set1_epi16(0x1f)));
+}
+
+static INLINE PIXCONV_AVX2_TARGET __m256i pixconv_argb8888_to_0rgb1555_avx2(
+      __m256i c)
+{
+   __m256i r = _mm256_and_si256(_mm256_srli_epi32(c, 9), _mm256_set1_epi32(0x7c00));
+   __m256i g = _mm256_and_si256(_mm256_srli_epi32(c, 6), _mm256_set1_epi32(0x03e0));
+   __m256i b = _mm256_and_si256(_mm256_srli_epi32(c, 3), _mm256_set1_epi32(0x001f));
+   return _mm256_or_si256(r, _mm256_or_si256(g, b));
+}
+
+static INLINE PIXCONV_AVX2_TARGET __m256i pixconv_argb8888_to_rgb565_avx2(
+      __m256i c)
+{
+   __m256i r = _mm256_and_si256(_mm256_srli_epi32(c, 8), _mm256_set1_epi32(0xf800));
+   __m256i g = _mm256_and_si256(_mm256_srli_epi32(c, 5), _mm256_set1_epi32(0x07e0));
+   __m256i b = _mm256_and_si256(_mm256_srli_epi32(c, 3), _mm256_set1_epi32(0x001f));
+   return _mm256_or_si256(r, _mm256_or_si256(g, b));
+}
+
+static INLINE PIXCONV_AVX2_TARGET __m256i pixconv_argb8888_to_rgba4444_avx2(
+      __m256i c)
+{
+   __m256i r = _mm256_and_si256(_mm256_srli_epi32(c, 8), _mm256_set1_epi32(0xf000));
+   __m256i g = _mm256_and_si256(_mm256_srli_epi32(c, 4), _mm256_set1_epi32(0x0f00));
+   __m256i b = _mm256_and_si256(c, _mm256_set1_epi32(0x00f0));
+   __m256i a = _mm256_srli_epi32(c, 28);
+   return _mm256_or_si256(_mm256_or_si256(r, g), _mm256_or_si256(b, a));
+}
+#endif
+
+#if defined(__SSE2__)
+/* Packs 8 pixels of 32-bit lanes holding 16-bit values */
+static INLINE __m128i pixconv_pack16_sse2(__m128i px0, __m128i px4)
+{
+   /* No unsigned 32-bit pack before SSE4.1, so sign extend the low
+    * halves and let a signed pack keep them as they are */
+   px0 = _mm_srai_epi32(_mm_slli_epi32(px0, 16), 16);
+   px4 = _mm_srai_epi32(_mm_slli_epi32(px4, 16), 16);
+   return _mm_packs_epi32(px0, px4);
+}
+
+static INLINE __m128i pixconv_argb8888_to_0rgb1555_sse2(__m128i c)
+{
+   __m128i r = _mm_and_si128(_mm_srli_epi32(c, 9), _mm_set1_epi32(0x7c00));
+   __m128i g = _mm_and_si128(_mm_srli_epi32(c, 6), _mm_set1_epi32(0x03e0));
+   __m128i b = _mm_and_si128(_mm_srli_epi32(c, 3), _mm_set1_epi32(0x001f));
+   return _mm_or_si128(r, _mm_or_si128(g, b));
+}
+
+static INLINE __m128i pixconv_argb8888_to_rgb565_sse2(__m128i c)
+{
+   __m128i r = _mm_and_si128(_mm_srli_epi32(c, 8), _mm_set1_epi32(0xf800));
+   __m128i g = _mm_and_si128(_mm_srli_epi32(c, 5), _mm_set1_epi32(0x07e0));
+   __m128i b = _mm_and_si128(_mm_srli_epi32(c, 3), _mm_set1_epi32(0x001f));
+   return _mm_or_si128(r, _mm_or_si128(g, b));
+}
+
+static INLINE __m128i pixconv_argb8888_to_rgba4444_sse2(__m128i c)
+{
+   __m128i r = _mm_and_si128(_mm_srli_epi32(c, 8), _mm_set1_epi32(0xf000));
+   __m128i g = _mm_and_si128(_mm_srli_epi32(c, 4), _mm_set1_epi32(0x0f00));
+   __m128i b = _mm_and_si128(c, _mm_set1_epi32(0x00f0));
+   __m128i a = _mm_srli_epi32(c, 28);
+   return _mm_or_si128(_mm_or_si128(r, g), _mm_or_si128(b, a));
+}
+#endif
+
+#ifdef PIXCONV_AVX2
+static PIXCONV_AVX2_TARGET int conv_rgb565_0rgb1555_avx2(uint16_t *output,
+      const uint16_t *input, int width)
+{
+   int w                 = 0;
+   const __m256i hi_mask = _mm256_set1_epi16(0x7fe0);
+   const __m256i lo_mask = _mm256_set1_epi16(0x1f);
+
+   for (; w + 16 <= width; w += 16)
+   {
+      const __m256i in = _mm256_loadu_si256((const __m256i*)(input + w));
+      __m256i hi       = _mm256_and_si256(_mm256_srli_epi16(in, 1), hi_mask);
+      __m256i lo       = _mm256_and_si256(in, lo_mask);
+      _mm256_storeu_si256((__m256i*)(output + w), _mm256_or_si256(hi, lo));
+   }
+
+   return w;
+}
+#endif
+
 void conv_rgb565_0rgb1555(void *output_, const void *input_,
       int width, int height,
       int out_stride, int in_stride)
@@ -50,36 +291,62 @@ void conv_rgb565_0rgb1555(void *output_, const void *input_,
    int h;
    const uint16_t *input = (const uint16_t*)input_;
    uint16_t *output = (uint16_t*)output_;
+   uint64_t simd    = pixconv_simd();
 
 #if defined(__SSE2__)
-   int max_width           = width - 7;
+   int max_width           = (simd & RETRO_SIMD_SSE2) ? width - 7 : 0;
    const __m128i hi_mask   = _mm_set1_epi16(0x7fe0);
    const __m128i lo_mask   = _mm_set1_epi16(0x1f);
 #endif
 
+   (void)simd;
+
    for (h = 0; h < height;
          h++, output += out_stride >> 1, input += in_stride >> 1)
    {
       int w = 0;
+#ifdef PIXCONV_AVX2
+      if (simd & RETRO_SIMD_AVX2)
+         w = conv_rgb565_0rgb1555_avx2(output, input, width);
+#endif
 #if defined(__SSE2__)
       for (; w < max_width; w += 8)
       {
          const __m128i in = _mm_loadu_si128((const __m128i*)(input + w));
-         __m128i hi = _mm_and_si128(_mm_slli_epi16(in, 1), hi_mask);
+         __m128i hi = _mm_and_si128(_mm_srli_epi16(in, 1), hi_mask);
          __m128i lo = _mm_and_si128(in, lo_mask);
          _mm_storeu_si128((__m128i*)(output + w), _mm_or_si128(hi, lo));
       }
 #endif
 
       for (; w < width; w++)
-      {
-         uint16_t col = input[w];
-         uint16_t hi  = (col >> 1) & 0x7fe0;
-         uint16_t lo  = col & 0x1f;
-         output[w]    = hi | lo;
-      }
+         output[w] = pixconv_rgb565_to_0rgb1555(input[w]);
+   }
+}
+
+#ifdef PIXCONV_AVX2
+static PIXCONV_AVX2_TARGET int conv_0rgb1555_rgb565_avx2(uint16_t *output,
+      const uint16_t *input, int width)
+{
+   int w                   = 0;
+   const __m256i hi_mask   = _mm256_set1_epi16(
+         (int16_t)((0x1f << 11) | (0x1f << 6)));
+   const __m256i lo_mask   = _mm256_set1_epi16(0x1f);
+   const __m256i glow_mask = _mm256_set1_epi16(1 << 5);
+
+   for (; w + 16 <= width; w += 16)
+   {
+      const __m256i in = _mm256_loadu_si256((const __m256i*)(input + w));
+      __m256i rg       = _mm256_and_si256(_mm256_slli_epi16(in, 1), hi_mask);
+      __m256i b        = _mm256_and_si256(in, lo_mask);
+      __m256i glow     = _mm256_and_si256(_mm256_srli_epi16(in, 4), glow_mask);
+      _mm256_storeu_si256((__m256i*)(output + w),
+            _mm256_or_si256(rg, _mm256_or_si256(b, glow)));
    }
+
+   return w;
 }
+#endif
 
 void conv_0rgb1555_rgb565(void *output_, const void *input_,
       int width, int height,
@@ -88,9 +355,10 @@ void conv_0rgb1555_rgb565(void *output_, const void *input_,
    int h;
    const uint16_t *input   = (const uint16_t*)input_;
    uint16_t *output        = (uint16_t*)output_;
+   uint64_t simd           = pixconv_simd();
 
 #if defined(__SSE2__)
-   int max_width           = width - 7;
+   int max_width           = (simd & RETRO_SIMD_SSE2) ? width - 7 : 0;
 
    const __m128i hi_mask   = _mm_set1_epi16(
          (int16_t)((0x1f << 11) | (0x1f << 6)));
@@ -98,10 +366,16 @@ void conv_0rgb1555_rgb565(void *output_, const void *input_,
    const __m128i glow_mask = _mm_set1_epi16(1 << 5);
 #endif
 
+   (void)simd;
+
    for (h = 0; h < height;
          h++, output += out_stride >> 1, input += in_stride >> 1)
    {
       int w = 0;
+#ifdef PIXCONV_AVX2
+      if (simd & RETRO_SIMD_AVX2)
+         w = conv_0rgb1555_rgb565_avx2(output, input, width);
+#endif
 #if defined(__SSE2__)
       for (; w < max_width; w += 8)
       {
@@ -115,15 +389,28 @@ void conv_0rgb1555_rgb565(void *output_, const void *input_,
 #endif
 
       for (; w < width; w++)
-      {
-         uint16_t col  = input[w];
-         uint16_t rg   = (col << 1) & ((0x1f << 11) | (0x1f << 6));
-         uint16_t b    = col & 0x1f;
-         uint16_t glow = (col >> 4) & (1 << 5);
-         output[w]     = rg | b | glow;
-      }
+         output[w] = pixconv_0rgb1555_to_rgb565(input[w]);
+   }
+}
+
+#ifdef PIXCONV_AVX2
+static PIXCONV_AVX2_TARGET int conv_0rgb1555_argb8888_avx2(uint32_t *output,
+      const uint16_t *input, int width)
+{
+   int w           = 0;
+   const __m256i a = _mm256_set1_epi16(0xff);
+
+   for (; w + 16 <= width; w += 16)
+   {
+      __m256i r, g, b;
+      pixconv_split_0rgb1555_avx2(
+            _mm256_loadu_si256((const __m256i*)(input + w)), &r, &g, &b);
+      pixconv_store_argb8888_avx2(output + w, b, g, r, a);
    }
+
+   return w;
 }
+#endif
 
 void conv_0rgb1555_argb8888(void *output_, const void *input_,
       int width, int height,
@@ -132,6 +419,7 @@ void conv_0rgb1555_argb8888(void *output_, const void *input_,
    int h;
    const uint16_t *input = (const uint16_t*)input_;
    uint32_t *output      = (uint32_t*)output_;
+   uint64_t simd         = pixconv_simd();
 
 #ifdef __SSE2__
    const __m128i pix_mask_r  = _mm_set1_epi16(0x1f << 10);
@@ -140,13 +428,19 @@ void conv_0rgb1555_argb8888(void *output_, const void *input_,
    const __m128i mul15_hi    = _mm_set1_epi16(0x0210);
    const __m128i a           = _mm_set1_epi16(0x00ff);
 
-   int max_width = width - 7;
+   int max_width = (simd & RETRO_SIMD_SSE2) ? width - 7 : 0;
 #endif
 
+   (void)simd;
+
    for (h = 0; h < height;
          h++, output += out_stride >> 2, input += in_stride >> 1)
    {
       int w = 0;
+#ifdef PIXCONV_AVX2
+      if (simd & RETRO_SIMD_AVX2)
+         w = conv_0rgb1555_argb8888_avx2(output, input, width);
+#endif
 #ifdef __SSE2__
       for (; w < max_width; w += 8)
       {
@@ -178,19 +472,28 @@ void conv_0rgb1555_argb8888(void *output_, const void *input_,
 #endif
 
       for (; w < width; w++)
-      {
-         uint32_t col = input[w];
-         uint32_t r   = (col >> 10) & 0x1f;
-         uint32_t g   = (col >>  5) & 0x1f;
-         uint32_t b   = (col >>  0) & 0x1f;
-         r            = (r << 3) | (r >> 2);
-         g            = (g << 3) | (g >> 2);
-         b            = (b << 3) | (b >> 2);
-
-         output[w]    = (0xffu << 24) | (r << 16) | (g << 8) | (b << 0);
-      }
+         output[w] = pixconv_0rgb1555_to_argb8888(input[w]);
+   }
+}
+
+#ifdef PIXCONV_AVX2
+static PIXCONV_AVX2_TARGET int conv_rgb565_argb8888_avx2(uint32_t *output,
+      const uint16_t *input, int width)
+{
+   int w           = 0;
+   const __m256i a = _mm256_set1_epi16(0xff);
+
+   for (; w + 16 <= width; w += 16)
+   {
+      __m256i r, g, b;
+      pixconv_split_rgb565_avx2(
+            _mm256_loadu_si256((const __m256i*)(input + w)), &r, &g, &b);
+      pixconv_store_argb8888_avx2(output + w, b, g, r, a);
    }
+
+   return w;
 }
+#endif
 
 void conv_rgb565_argb8888(void *output_, const void *input_,
       int width, int height,
@@ -199,6 +502,7 @@ void conv_rgb565_argb8888(void *output_, const void *input_,
    int h;
    const uint16_t *input    = (const uint16_t*)input_;
    uint32_t *output         = (uint32_t*)output_;
+   uint64_t simd            = pixconv_simd();
 
 #if defined(__SSE2__)
    const __m128i pix_mask_r = _mm_set1_epi16(0x1f << 10);
@@ -209,7 +513,7 @@ void conv_rgb565_argb8888(void *output_, const void *input_,
    const __m128i mul16_b    = _mm_set1_epi16(0x4200);
    const __m128i a          = _mm_set1_epi16(0x00ff);
 
-   int max_width            = width - 7;
+   int max_width            = (simd & RETRO_SIMD_SSE2) ? width - 7 : 0;
 #elif defined(__MMX__)
    const __m64 pix_mask_r = _mm_set1_pi16(0x1f << 10);
    const __m64 pix_mask_g = _mm_set1_pi16(0x3f << 5);
@@ -219,13 +523,19 @@ void conv_rgb565_argb8888(void *output_, const void *input_,
    const __m64 mul16_b    = _mm_set1_pi16(0x4200);
    const __m64 a          = _mm_set1_pi16(0x00ff);
 
-   int max_width            = width - 3;
+   int max_width            = (simd & RETRO_SIMD_MMX) ? width - 3 : 0;
 #endif
 
+   (void)simd;
+
    for (h = 0; h < height;
          h++, output += out_stride >> 2, input += in_stride >> 1)
    {
       int w = 0;
+#ifdef PIXCONV_AVX2
+      if (simd & RETRO_SIMD_AVX2)
+         w = conv_rgb565_argb8888_avx2(output, input, width);
+#endif
 #if defined(__SSE2__)
       for (; w < max_width; w += 8)
       {
@@ -285,19 +595,28 @@ void conv_rgb565_argb8888(void *output_, const void *input_,
 #endif
 
       for (; w < width; w++)
-      {
-         uint32_t col = input[w];
-         uint32_t r   = (col >> 11) & 0x1f;
-         uint32_t g   = (col >>  5) & 0x3f;
-         uint32_t b   = (col >>  0) & 0x1f;
-         r            = (r << 3) | (r >> 2);
-         g            = (g << 2) | (g >> 4);
-         b            = (b << 3) | (b >> 2);
-
-         output[w]    = (0xffu << 24) | (r << 16) | (g << 8) | (b << 0);
-      }
+         output[w] = pixconv_rgb565_to_argb8888(input[w]);
+   }
+}
+
+#ifdef PIXCONV_AVX2
+static PIXCONV_AVX2_TARGET int conv_rgb565_abgr8888_avx2(uint32_t *output,
+      const uint16_t *input, int width)
+{
+   int w           = 0;
+   const __m256i a = _mm256_set1_epi16(0xff);
+
+   for (; w + 16 <= width; w += 16)
+   {
+      __m256i r, g, b;
+      pixconv_split_rgb565_avx2(
+            _mm256_loadu_si256((const __m256i*)(input + w)), &r, &g, &b);
+      pixconv_store_argb8888_avx2(output + w, r, g, b, a);
    }
+
+   return w;
 }
+#endif
 
 void conv_rgb565_abgr8888(void *output_, const void *input_,
       int width, int height,
@@ -306,6 +625,7 @@ void conv_rgb565_abgr8888(void *output_, const void *input_,
    int h;
    const uint16_t *input    = (const uint16_t*)input_;
    uint32_t *output         = (uint32_t*)output_;
+   uint64_t simd            = pixconv_simd();
  #if defined(__SSE2__)
    const __m128i pix_mask_r = _mm_set1_epi16(0x1f << 10);
    const __m128i pix_mask_g = _mm_set1_epi16(0x3f <<  5);
@@ -314,12 +634,19 @@ void conv_rgb565_abgr8888(void *output_, const void *input_,
    const __m128i mul16_g    = _mm_set1_epi16(0x2080);
    const __m128i mul16_b    = _mm_set1_epi16(0x4200);
    const __m128i a          = _mm_set1_epi16(0x00ff);
-    int max_width            = width - 7;
+    int max_width            = (simd & RETRO_SIMD_SSE2) ? width - 7 : 0;
 #endif
+
+   (void)simd;
+
     for (h = 0; h < height;
          h++, output += out_stride >> 2, input += in_stride >> 1)
    {
       int w = 0;
+#ifdef PIXCONV_AVX2
+      if (simd & RETRO_SIMD_AVX2)
+         w = conv_rgb565_abgr8888_avx2(output, input, width);
+#endif
 #if defined(__SSE2__)
       for (; w < max_width; w += 8)
       {
@@ -332,10 +659,11 @@ void conv_rgb565_abgr8888(void *output_, const void *input_,
          r                = _mm_mulhi_epi16(r, mul16_r);
          g                = _mm_mulhi_epi16(g, mul16_g);
          b                = _mm_mulhi_epi16(b, mul16_b);
-         res_lo_bg        = _mm_unpacklo_epi8(b, g);
-         res_hi_bg        = _mm_unpackhi_epi8(b, g);
-         res_lo_ra        = _mm_unpacklo_epi8(r, a);
-         res_hi_ra        = _mm_unpackhi_epi8(r, a);
+         /* Same as ARGB8888, with R and B the other way round */
+         res_lo_bg        = _mm_unpacklo_epi8(r, g);
+         res_hi_bg        = _mm_unpackhi_epi8(r, g);
+         res_lo_ra        = _mm_unpacklo_epi8(b, a);
+         res_hi_ra        = _mm_unpackhi_epi8(b, a);
          res_lo           = _mm_or_si128(res_lo_bg,
                _mm_slli_si128(res_lo_ra, 2));
          res_hi           = _mm_or_si128(res_hi_bg,
@@ -345,47 +673,89 @@ void conv_rgb565_abgr8888(void *output_, const void *input_,
       }
 #endif
        for (; w < width; w++)
-      {
-         uint32_t col = input[w];
-         uint32_t r   = (col >> 11) & 0x1f;
-         uint32_t g   = (col >>  5) & 0x3f;
-         uint32_t b   = (col >>  0) & 0x1f;
-         r            = (r << 3) | (r >> 2);
-         g            = (g << 2) | (g >> 4);
-         b            = (b << 3) | (b >> 2);
-         output[w]    = (0xffu << 24) | (b << 16) | (g << 8) | (r << 0);
-      }
+         output[w] = pixconv_swap_rb(pixconv_rgb565_to_argb8888(input[w]));
+   }
+}
+
+#ifdef PIXCONV_AVX2
+static PIXCONV_AVX2_TARGET int conv_argb8888_rgba4444_avx2(uint16_t *output,
+      const uint32_t *input, int width)
+{
+   int w = 0;
+
+   for (; w + 16 <= width; w += 16)
+   {
+      __m256i px0 = _mm256_loadu_si256((const __m256i*)(input + w + 0));
+      __m256i px8 = _mm256_loadu_si256((const __m256i*)(input + w + 8));
+      _mm256_storeu_si256((__m256i*)(output + w), pixconv_pack16_avx2(
+               pixconv_argb8888_to_rgba4444_avx2(px0),
+               pixconv_argb8888_to_rgba4444_avx2(px8)));
    }
+
+   return w;
 }
+#endif
 
 void conv_argb8888_rgba4444(void *output_, const void *input_,
       int width, int height,
       int out_stride, int in_stride)
 {
-   int h, w;
+   int h;
    const uint32_t *input = (const uint32_t*)input_;
    uint16_t *output      = (uint16_t*)output_;
+   uint64_t simd         = pixconv_simd();
+
+#if defined(__SSE2__)
+   int max_width         = (simd & RETRO_SIMD_SSE2) ? width - 7 : 0;
+#endif
+
+   (void)simd;
 
    for (h = 0; h < height;
-         h++, output += out_stride >> 2, input += in_stride >> 1)
+         h++, output += out_stride >> 1, input += in_stride >> 2)
    {
-      for (w = 0; w < width; w++)
+      int w = 0;
+#ifdef PIXCONV_AVX2
+      if (simd & RETRO_SIMD_AVX2)
+         w = conv_argb8888_rgba4444_avx2(output, input, width);
+#endif
+#if defined(__SSE2__)
+      for (; w < max_width; w += 8)
       {
-         uint32_t col = input[w];
-         uint32_t r   = (col >> 16) & 0xf;
-         uint32_t g   = (col >>  8) & 0xf;
-         uint32_t b   = (col) & 0xf;
-         uint32_t a   = (col >>  24) & 0xf;
-         r            = (r >> 4) | r;
-         g            = (g >> 4) | g;
-         b            = (b >> 4) | b;
-         a            = (a >> 4) | a;
-
-         output[w]    = (r << 12) | (g << 8) | (b << 4) | a;
+         __m128i px0 = _mm_loadu_si128((const __m128i*)(input + w + 0));
+         __m128i px4 = _mm_loadu_si128((const __m128i*)(input + w + 4));
+         _mm_storeu_si128((__m128i*)(output + w), pixconv_pack16_sse2(
+                  pixconv_argb8888_to_rgba4444_sse2(px0),
+                  pixconv_argb8888_to_rgba4444_sse2(px4)));
       }
+#endif
+
+      for (; w < width; w++)
+         output[w] = pixconv_argb8888_to_rgba4444(input[w]);
    }
 }
 
+#ifdef PIXCONV_AVX2
+static PIXCONV_AVX2_TARGET int conv_rgba4444_argb8888_avx2(uint32_t *output,
+      const uint16_t *input, int width)
+{
+   int w               = 0;
+   const __m256i mask4 = _mm256_set1_epi16(0xf);
+
+   for (; w + 16 <= width; w += 16)
+   {
+      const __m256i in = _mm256_loadu_si256((const __m256i*)(input + w));
+      __m256i r = pixconv_expand4_avx2(_mm256_srli_epi16(in, 12));
+      __m256i g = pixconv_expand4_avx2(_mm256_and_si256(_mm256_srli_epi16(in, 8), mask4));
+      __m256i b = pixconv_expand4_avx2(_mm256_and_si256(_mm256_srli_epi16(in, 4), mask4));
+      __m256i a = pixconv_expand4_avx2(_mm256_and_si256(in, mask4));
+      pixconv_store_argb8888_avx2(output + w, b, g, r, a);
+   }
+
+   return w;
+}
+#endif
+
 void conv_rgba4444_argb8888(void *output_, const void *input_,
       int width, int height,
       int out_stride, int in_stride)
@@ -393,24 +763,51 @@ void conv_rgba4444_argb8888(void *output_, const void *input_,
    int h;
    const uint16_t *input = (const uint16_t*)input_;
    uint32_t *output      = (uint32_t*)output_;
+   uint64_t simd         = pixconv_simd();
+
+#if defined(__SSE2__)
+   const __m128i mask4   = _mm_set1_epi16(0xf);
+   const __m128i mul17   = _mm_set1_epi16(17);
 
-#if defined(__MMX__)
+   int max_width         = (simd & RETRO_SIMD_SSE2) ? width - 7 : 0;
+#elif defined(__MMX__)
    const __m64 pix_mask_r = _mm_set1_pi16(0xf << 10);
    const __m64 pix_mask_g = _mm_set1_pi16(0xf << 8);
    const __m64 pix_mask_b = _mm_set1_pi16(0xf << 8);
    const __m64 mul16_r    = _mm_set1_pi16(0x0440);
    const __m64 mul16_g    = _mm_set1_pi16(0x1100);
    const __m64 mul16_b    = _mm_set1_pi16(0x1100);
-   const __m64 a          = _mm_set1_pi16(0x00ff);
+   const __m64 mask_a     = _mm_set1_pi16(0xf);
+   const __m64 mul17      = _mm_set1_pi16(17);
 
-   int max_width            = width - 3;
+   int max_width            = (simd & RETRO_SIMD_MMX) ? width - 3 : 0;
 #endif
 
+   (void)simd;
+
    for (h = 0; h < height;
          h++, output += out_stride >> 2, input += in_stride >> 1)
    {
       int w = 0;
-#if defined(__MMX__)
+#ifdef PIXCONV_AVX2
+      if (simd & RETRO_SIMD_AVX2)
+         w = conv_rgba4444_argb8888_avx2(output, input, width);
+#endif
+#if defined(__SSE2__)
+      for (; w < max_width; w += 8)
+      {
+         const __m128i in = _mm_loadu_si128((const __m128i*)(input + w));
+         __m128i r  = _mm_mullo_epi16(_mm_srli_epi16(in, 12), mul17);
+         __m128i g  = _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(in, 8), mask4), mul17);
+         __m128i b  = _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(in, 4), mask4), mul17);
+         __m128i a  = _mm_mullo_epi16(_mm_and_si128(in, mask4), mul17);
+         __m128i bg = _mm_or_si128(b, _mm_slli_epi16(g, 8));
+         __m128i ra = _mm_or_si128(r, _mm_slli_epi16(a, 8));
+
+         _mm_storeu_si128((__m128i*)(output + w + 0), _mm_unpacklo_epi16(bg, ra));
+         _mm_storeu_si128((__m128i*)(output + w + 4), _mm_unpackhi_epi16(bg, ra));
+      }
+#elif defined(__MMX__)
       for (; w < max_width; w += 4)
       {
          __m64 res_lo, res_hi;
@@ -419,6 +816,7 @@ void conv_rgba4444_argb8888(void *output_, const void *input_,
          __m64          r = _mm_and_si64(_mm_srli_pi16(in, 2), pix_mask_r);
          __m64          g = _mm_and_si64(in, pix_mask_g);
          __m64          b = _mm_and_si64(_mm_slli_pi16(in, 4), pix_mask_b);
+         __m64          a = _mm_mullo_pi16(_mm_and_si64(in, mask_a), mul17);
 
          r                = _mm_mulhi_pi16(r, mul16_r);
          g                = _mm_mulhi_pi16(g, mul16_g);
@@ -442,42 +840,71 @@ void conv_rgba4444_argb8888(void *output_, const void *input_,
 #endif
 
       for (; w < width; w++)
-      {
-         uint32_t col = input[w];
-         uint32_t r   = (col >> 12) & 0xf;
-         uint32_t g   = (col >>  8) & 0xf;
-         uint32_t b   = (col >>  4) & 0xf;
-         uint32_t a   = (col >>  0) & 0xf;
-         r            = (r << 4) | r;
-         g            = (g << 4) | g;
-         b            = (b << 4) | b;
-         a            = (a << 4) | a;
-
-         output[w]    = (a << 24) | (r << 16) | (g << 8) | (b << 0);
-      }
+         output[w] = pixconv_rgba4444_to_argb8888(input[w]);
    }
 }
 
+#ifdef PIXCONV_AVX2
+static PIXCONV_AVX2_TARGET int conv_rgba4444_rgb565_avx2(uint16_t *output,
+      const uint16_t *input, int width)
+{
+   int w = 0;
+
+   for (; w + 16 <= width; w += 16)
+   {
+      const __m256i in = _mm256_loadu_si256((const __m256i*)(input + w));
+      __m256i r = _mm256_and_si256(in, _mm256_set1_epi16((int16_t)0xf000));
+      __m256i g = _mm256_and_si256(_mm256_srli_epi16(in, 1), _mm256_set1_epi16(0x0780));
+      __m256i b = _mm256_and_si256(_mm256_srli_epi16(in, 3), _mm256_set1_epi16(0x001e));
+      _mm256_storeu_si256((__m256i*)(output + w),
+            _mm256_or_si256(r, _mm256_or_si256(g, b)));
+   }
+
+   return w;
+}
+#endif
+
 void conv_rgba4444_rgb565(void *output_, const void *input_,
       int width, int height,
       int out_stride, int in_stride)
 {
-   int h, w;
+   int h;
    const uint16_t *input = (const uint16_t*)input_;
    uint16_t *output      = (uint16_t*)output_;
+   uint64_t simd         = pixconv_simd();
+
+#if defined(__SSE2__)
+   const __m128i mask_r  = _mm_set1_epi16((int16_t)0xf000);
+   const __m128i mask_g  = _mm_set1_epi16(0x0780);
+   const __m128i mask_b  = _mm_set1_epi16(0x001e);
+
+   int max_width         = (simd & RETRO_SIMD_SSE2) ? width - 7 : 0;
+#endif
+
+   (void)simd;
 
    for (h = 0; h < height;
          h++, output += out_stride >> 1, input += in_stride >> 1)
    {
-      for (w = 0; w < width; w++)
+      int w = 0;
+#ifdef PIXCONV_AVX2
+      if (simd & RETRO_SIMD_AVX2)
+         w = conv_rgba4444_rgb565_avx2(output, input, width);
+#endif
+#if defined(__SSE2__)
+      for (; w < max_width; w += 8)
       {
-         uint32_t col = input[w];
-         uint32_t r   = (col >> 12) & 0xf;
-         uint32_t g   = (col >>  8) & 0xf;
-         uint32_t b   = (col >>  4) & 0xf;
-
-         output[w]    = (r << 12) | (g << 7) | (b << 1);
+         const __m128i in = _mm_loadu_si128((const __m128i*)(input + w));
+         __m128i r = _mm_and_si128(in, mask_r);
+         __m128i g = _mm_and_si128(_mm_srli_epi16(in, 1), mask_g);
+         __m128i b = _mm_and_si128(_mm_srli_epi16(in, 3), mask_b);
+         _mm_storeu_si128((__m128i*)(output + w),
+               _mm_or_si128(r, _mm_or_si128(g, b)));
       }
+#endif
+
+      for (; w < width; w++)
+         output[w] = pixconv_rgba4444_to_rgb565(input[w]);
    }
 }
 
@@ -528,6 +955,28 @@ static INLINE void store_bgr24_sse2(void *output, __m128i a,
 }
 #endif
 
+#ifdef PIXCONV_AVX2
+static PIXCONV_AVX2_TARGET int conv_0rgb1555_bgr24_avx2(uint8_t *output,
+      const uint16_t *input, int width)
+{
+   int w              = 0;
+   const __m256i a    = _mm256_setzero_si256();
+   const __m256i shuf = pixconv_bgr24_shuf_avx2();
+
+   for (; w + 16 <= width; w += 16)
+   {
+      __m256i r, g, b, px0, px8;
+      pixconv_split_0rgb1555_avx2(
+            _mm256_loadu_si256((const __m256i*)(input + w)), &r, &g, &b);
+      pixconv_interleave_avx2(b, g, r, a, &px0, &px8);
+      pixconv_store_bgr24_avx2(output + w * 3 +  0, px0, shuf);
+      pixconv_store_bgr24_avx2(output + w * 3 + 24, px8, shuf);
+   }
+
+   return w;
+}
+#endif
+
 void conv_0rgb1555_bgr24(void *output_, const void *input_,
       int width, int height,
       int out_stride, int in_stride)
@@ -535,6 +984,7 @@ void conv_0rgb1555_bgr24(void *output_, const void *input_,
    int h;
    const uint16_t *input     = (const uint16_t*)input_;
    uint8_t *output           = (uint8_t*)output_;
+   uint64_t simd             = pixconv_simd();
 
 #if defined(__SSE2__)
    const __m128i pix_mask_r  = _mm_set1_epi16(0x1f << 10);
@@ -543,15 +993,24 @@ void conv_0rgb1555_bgr24(void *output_, const void *input_,
    const __m128i mul15_hi    = _mm_set1_epi16(0x0210);
    const __m128i a           = _mm_set1_epi16(0x00ff);
 
-   int max_width             = width - 15;
+   int max_width             = (simd & RETRO_SIMD_SSE2) ? width - 15 : 0;
 #endif
 
+   (void)simd;
+
    for (h = 0; h < height;
          h++, output += out_stride, input += in_stride >> 1)
    {
       uint8_t *out = output;
       int   w = 0;
 
+#ifdef PIXCONV_AVX2
+      if (simd & RETRO_SIMD_AVX2)
+      {
+         w    = conv_0rgb1555_bgr24_avx2(output, input, width);
+         out += w * 3;
+      }
+#endif
 #if defined(__SSE2__)
       for (; w < max_width; w += 16, out += 48)
       {
@@ -599,21 +1058,36 @@ void conv_0rgb1555_bgr24(void *output_, const void *input_,
 
       for (; w < width; w++)
       {
-         uint32_t col = input[w];
-         uint32_t b   = (col >>  0) & 0x1f;
-         uint32_t g   = (col >>  5) & 0x1f;
-         uint32_t r   = (col >> 10) & 0x1f;
-         b            = (b << 3) | (b >> 2);
-         g            = (g << 3) | (g >> 2);
-         r            = (r << 3) | (r >> 2);
-
-         *out++       = b;
-         *out++       = g;
-         *out++       = r;
+         uint32_t col = pixconv_0rgb1555_to_argb8888(input[w]);
+         *out++       = (uint8_t)(col >>  0);
+         *out++       = (uint8_t)(col >>  8);
+         *out++       = (uint8_t)(col >> 16);
       }
    }
 }
 
+#ifdef PIXCONV_AVX2
+static PIXCONV_AVX2_TARGET int conv_rgb565_bgr24_avx2(uint8_t *output,
+      const uint16_t *input, int width)
+{
+   int w              = 0;
+   const __m256i a    = _mm256_setzero_si256();
+   const __m256i shuf = pixconv_bgr24_shuf_avx2();
+
+   for (; w + 16 <= width; w += 16)
+   {
+      __m256i r, g, b, px0, px8;
+      pixconv_split_rgb565_avx2(
+            _mm256_loadu_si256((const __m256i*)(input + w)), &r, &g, &b);
+      pixconv_interleave_avx2(b, g, r, a, &px0, &px8);
+      pixconv_store_bgr24_avx2(output + w * 3 +  0, px0, shuf);
+      pixconv_store_bgr24_avx2(output + w * 3 + 24, px8, shuf);
+   }
+
+   return w;
+}
+#endif
+
 void conv_rgb565_bgr24(void *output_, const void *input_,
       int width, int height,
       int out_stride, int in_stride)
@@ -621,6 +1095,7 @@ void conv_rgb565_bgr24(void *output_, const void *input_,
    int h;
    const uint16_t *input    = (const uint16_t*)input_;
    uint8_t *output          = (uint8_t*)output_;
+   uint64_t simd            = pixconv_simd();
 
 #if defined(__SSE2__)
    const __m128i pix_mask_r = _mm_set1_epi16(0x1f << 10);
@@ -631,13 +1106,22 @@ void conv_rgb565_bgr24(void *output_, const void *input_,
    const __m128i mul16_b    = _mm_set1_epi16(0x4200);
    const __m128i a          = _mm_set1_epi16(0x00ff);
 
-   int max_width            = width - 15;
+   int max_width            = (simd & RETRO_SIMD_SSE2) ? width - 15 : 0;
 #endif
 
+   (void)simd;
+
    for (h = 0; h < height; h++, output += out_stride, input += in_stride >> 1)
    {
       uint8_t *out = output;
       int        w = 0;
+#ifdef PIXCONV_AVX2
+      if (simd & RETRO_SIMD_AVX2)
+      {
+         w    = conv_rgb565_bgr24_avx2(output, input, width);
+         out += w * 3;
+      }
+#endif
 #if defined(__SSE2__)
       for (; w < max_width; w += 16, out += 48)
       {
@@ -684,34 +1168,52 @@ void conv_rgb565_bgr24(void *output_, const void *input_,
 
       for (; w < width; w++)
       {
-         uint32_t col = input[w];
-         uint32_t r   = (col >> 11) & 0x1f;
-         uint32_t g   = (col >>  5) & 0x3f;
-         uint32_t b   = (col >>  0) & 0x1f;
-         r = (r << 3) | (r >> 2);
-         g = (g << 2) | (g >> 4);
-         b = (b << 3) | (b >> 2);
-
-         *out++ = b;
-         *out++ = g;
-         *out++ = r;
+         uint32_t col = pixconv_rgb565_to_argb8888(input[w]);
+         *out++       = (uint8_t)(col >>  0);
+         *out++       = (uint8_t)(col >>  8);
+         *out++       = (uint8_t)(col >> 16);
       }
    }
 }
 
+#ifdef PIXCONV_AVX2
+static PIXCONV_AVX2_TARGET int conv_bgr24_argb8888_avx2(uint32_t *output,
+      const uint8_t *input, int width)
+{
+   int w           = 0;
+   const __m256i a = _mm256_set1_epi32((int)0xff000000u);
+
+   /* Each load reads 28 bytes for 8 pixels */
+   for (; w + 10 <= width; w += 8)
+      _mm256_storeu_si256((__m256i*)(output + w), _mm256_or_si256(
+               pixconv_load_bgr24_avx2(input + w * 3), a));
+
+   return w;
+}
+#endif
+
 void conv_bgr24_argb8888(void *output_, const void *input_,
       int width, int height,
       int out_stride, int in_stride)
 {
-   int h, w;
+   int h;
    const uint8_t *input = (const uint8_t*)input_;
    uint32_t *output     = (uint32_t*)output_;
+   uint64_t simd        = pixconv_simd();
+
+   (void)simd;
 
    for (h = 0; h < height;
          h++, output += out_stride >> 2, input += in_stride)
    {
-      const uint8_t *inp = input;
-      for (w = 0; w < width; w++)
+      int w = 0;
+      const uint8_t *inp;
+#ifdef PIXCONV_AVX2
+      if (simd & RETRO_SIMD_AVX2)
+         w = conv_bgr24_argb8888_avx2(output, input, width);
+#endif
+
+      for (inp = input + w * 3; w < width; w++)
       {
          uint32_t b = *inp++;
          uint32_t g = *inp++;
@@ -721,50 +1223,182 @@ void conv_bgr24_argb8888(void *output_, const void *input_,
    }
 }
 
+#ifdef PIXCONV_AVX2
+static PIXCONV_AVX2_TARGET int conv_bgr24_rgb565_avx2(uint16_t *output,
+      const uint8_t *input, int width)
+{
+   int w = 0;
+
+   for (; w + 10 <= width; w += 8)
+   {
+      __m256i px = pixconv_argb8888_to_rgb565_avx2(
+            pixconv_load_bgr24_avx2(input + w * 3));
+      px         = _mm256_permute4x64_epi64(_mm256_packus_epi32(px, px), 0x08);
+      _mm_storeu_si128((__m128i*)(output + w), _mm256_castsi256_si128(px));
+   }
+
+   return w;
+}
+#endif
+
 void conv_bgr24_rgb565(void *output_, const void *input_,
       int width, int height,
       int out_stride, int in_stride)
 {
-   int h, w;
+   int h;
    const uint8_t *input = (const uint8_t*)input_;
    uint16_t *output     = (uint16_t*)output_;
+   uint64_t simd        = pixconv_simd();
+
+   (void)simd;
+
    for (h = 0; h < height;
-         h++, output += out_stride, input += in_stride)
+         h++, output += out_stride >> 1, input += in_stride)
    {
-      const uint8_t *inp = input;
-      for (w = 0; w < width; w++)
-      {
-         uint16_t b = *inp++;
-         uint16_t g = *inp++;
-         uint16_t r = *inp++;
-    
-         output[w] = ((r & 0x00F8) << 8) | ((g&0x00FC) << 3) | ((b&0x00F8) >> 3);
-      }  
+      int w = 0;
+      const uint8_t *inp;
+#ifdef PIXCONV_AVX2
+      if (simd & RETRO_SIMD_AVX2)
+         w = conv_bgr24_rgb565_avx2(output, input, width);
+#endif
+
+      for (inp = input + w * 3; w < width; w++, inp += 3)
+         output[w] = pixconv_argb8888_to_rgb565(
+               inp[0] | (inp[1] << 8) | ((uint32_t)inp[2] << 16));
+   }
+}
+
+#ifdef PIXCONV_AVX2
+static PIXCONV_AVX2_TARGET int conv_argb8888_0rgb1555_avx2(uint16_t *output,
+      const uint32_t *input, int width)
+{
+   int w = 0;
+
+   for (; w + 16 <= width; w += 16)
+   {
+      __m256i px0 = _mm256_loadu_si256((const __m256i*)(input + w + 0));
+      __m256i px8 = _mm256_loadu_si256((const __m256i*)(input + w + 8));
+      _mm256_storeu_si256((__m256i*)(output + w), pixconv_pack16_avx2(
+               pixconv_argb8888_to_0rgb1555_avx2(px0),
+               pixconv_argb8888_to_0rgb1555_avx2(px8)));
    }
+
+   return w;
 }
+#endif
 
 void conv_argb8888_0rgb1555(void *output_, const void *input_,
       int width, int height,
       int out_stride, int in_stride)
 {
-   int h, w;
+   int h;
    const uint32_t *input = (const uint32_t*)input_;
    uint16_t *output      = (uint16_t*)output_;
+   uint64_t simd         = pixconv_simd();
+
+#if defined(__SSE2__)
+   int max_width         = (simd & RETRO_SIMD_SSE2) ? width - 7 : 0;
+#endif
+
+   (void)simd;
 
    for (h = 0; h < height;
          h++, output += out_stride >> 1, input += in_stride >> 2)
    {
-      for (w = 0; w < width; w++)
+      int w = 0;
+#ifdef PIXCONV_AVX2
+      if (simd & RETRO_SIMD_AVX2)
+         w = conv_argb8888_0rgb1555_avx2(output, input, width);
+#endif
+#if defined(__SSE2__)
+      for (; w < max_width; w += 8)
       {
-         uint32_t col = input[w];
-         uint16_t r   = (col >> 19) & 0x1f;
-         uint16_t g   = (col >> 11) & 0x1f;
-         uint16_t b   = (col >>  3) & 0x1f;
-         output[w]    = (r << 10) | (g << 5) | (b << 0);
+         __m128i px0 = _mm_loadu_si128((const __m128i*)(input + w + 0));
+         __m128i px4 = _mm_loadu_si128((const __m128i*)(input + w + 4));
+         _mm_storeu_si128((__m128i*)(output + w), pixconv_pack16_sse2(
+                  pixconv_argb8888_to_0rgb1555_sse2(px0),
+                  pixconv_argb8888_to_0rgb1555_sse2(px4)));
+      }
+#endif
+
+      for (; w < width; w++)
+         output[w] = pixconv_argb8888_to_0rgb1555(input[w]);
+   }
+}
+
+#ifdef PIXCONV_AVX2
+static PIXCONV_AVX2_TARGET int conv_argb8888_rgb565_avx2(uint16_t *output,
+      const uint32_t *input, int width)
+{
+   int w = 0;
+
+   for (; w + 16 <= width; w += 16)
+   {
+      __m256i px0 = _mm256_loadu_si256((const __m256i*)(input + w + 0));
+      __m256i px8 = _mm256_loadu_si256((const __m256i*)(input + w + 8));
+      _mm256_storeu_si256((__m256i*)(output + w), pixconv_pack16_avx2(
+               pixconv_argb8888_to_rgb565_avx2(px0),
+               pixconv_argb8888_to_rgb565_avx2(px8)));
+   }
+
+   return w;
+}
+#endif
+
+void conv_argb8888_rgb565(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   int h;
+   const uint32_t *input = (const uint32_t*)input_;
+   uint16_t *output      = (uint16_t*)output_;
+   uint64_t simd         = pixconv_simd();
+
+#if defined(__SSE2__)
+   int max_width         = (simd & RETRO_SIMD_SSE2) ? width - 7 : 0;
+#endif
+
+   (void)simd;
+
+   for (h = 0; h < height;
+         h++, output += out_stride >> 1, input += in_stride >> 2)
+   {
+      int w = 0;
+#ifdef PIXCONV_AVX2
+      if (simd & RETRO_SIMD_AVX2)
+         w = conv_argb8888_rgb565_avx2(output, input, width);
+#endif
+#if defined(__SSE2__)
+      for (; w < max_width; w += 8)
+      {
+         __m128i px0 = _mm_loadu_si128((const __m128i*)(input + w + 0));
+         __m128i px4 = _mm_loadu_si128((const __m128i*)(input + w + 4));
+         _mm_storeu_si128((__m128i*)(output + w), pixconv_pack16_sse2(
+                  pixconv_argb8888_to_rgb565_sse2(px0),
+                  pixconv_argb8888_to_rgb565_sse2(px4)));
       }
+#endif
+
+      for (; w < width; w++)
+         output[w] = pixconv_argb8888_to_rgb565(input[w]);
    }
 }
 
+#ifdef PIXCONV_AVX2
+static PIXCONV_AVX2_TARGET int conv_argb8888_bgr24_avx2(uint8_t *output,
+      const uint32_t *input, int width)
+{
+   int w              = 0;
+   const __m256i shuf = pixconv_bgr24_shuf_avx2();
+
+   for (; w + 8 <= width; w += 8)
+      pixconv_store_bgr24_avx2(output + w * 3,
+            _mm256_loadu_si256((const __m256i*)(input + w)), shuf);
+
+   return w;
+}
+#endif
+
 void conv_argb8888_bgr24(void *output_, const void *input_,
       int width, int height,
       int out_stride, int in_stride)
@@ -772,16 +1406,26 @@ void conv_argb8888_bgr24(void *output_, const void *input_,
    int h;
    const uint32_t *input = (const uint32_t*)input_;
    uint8_t *output       = (uint8_t*)output_;
+   uint64_t simd         = pixconv_simd();
 
 #if defined(__SSE2__)
-   int max_width = width - 15;
+   int max_width = (simd & RETRO_SIMD_SSE2) ? width - 15 : 0;
 #endif
 
+   (void)simd;
+
    for (h = 0; h < height;
          h++, output += out_stride, input += in_stride >> 2)
    {
       uint8_t *out = output;
       int        w = 0;
+#ifdef PIXCONV_AVX2
+      if (simd & RETRO_SIMD_AVX2)
+      {
+         w    = conv_argb8888_bgr24_avx2(output, input, width);
+         out += w * 3;
+      }
+#endif
 #if defined(__SSE2__)
       for (; w < max_width; w += 16, out += 48)
       {
@@ -808,13 +1452,30 @@ static INLINE __m128i conv_shuffle_rb_epi32(__m128i c)
 {
    /* SSSE3 plz */
    const __m128i b_mask = _mm_set1_epi32(0x000000ff);
-   const __m128i g_mask = _mm_set1_epi32(0x0000ff00);
+   const __m128i ga_mask = _mm_set1_epi32((int)0xff00ff00u);
    const __m128i r_mask = _mm_set1_epi32(0x00ff0000);
    __m128i sl = _mm_and_si128(_mm_slli_epi32(c, 16), r_mask);
    __m128i sr = _mm_and_si128(_mm_srli_epi32(c, 16), b_mask);
-   __m128i g  = _mm_and_si128(c, g_mask);
+   __m128i ga = _mm_and_si128(c, ga_mask);
    __m128i rb = _mm_or_si128(sl, sr);
-   return _mm_or_si128(g, rb);
+   return _mm_or_si128(ga, rb);
+}
+#endif
+
+#ifdef PIXCONV_AVX2
+static PIXCONV_AVX2_TARGET int conv_abgr8888_bgr24_avx2(uint8_t *output,
+      const uint32_t *input, int width)
+{
+   int w              = 0;
+   const __m256i shuf = _mm256_setr_epi8(
+         2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+         2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+   for (; w + 8 <= width; w += 8)
+      pixconv_store_bgr24_avx2(output + w * 3,
+            _mm256_loadu_si256((const __m256i*)(input + w)), shuf);
+
+   return w;
 }
 #endif
 
@@ -825,23 +1486,33 @@ void conv_abgr8888_bgr24(void *output_, const void *input_,
    int h;
    const uint32_t *input = (const uint32_t*)input_;
    uint8_t *output       = (uint8_t*)output_;
+   uint64_t simd         = pixconv_simd();
 
 #if defined(__SSE2__)
-   int max_width = width - 15;
+   int max_width = (simd & RETRO_SIMD_SSE2) ? width - 15 : 0;
 #endif
 
+   (void)simd;
+
    for (h = 0; h < height;
          h++, output += out_stride, input += in_stride >> 2)
    {
       uint8_t *out = output;
       int        w = 0;
+#ifdef PIXCONV_AVX2
+      if (simd & RETRO_SIMD_AVX2)
+      {
+         w    = conv_abgr8888_bgr24_avx2(output, input, width);
+         out += w * 3;
+      }
+#endif
 #if defined(__SSE2__)
       for (; w < max_width; w += 16, out += 48)
       {
-		 __m128i a = _mm_loadu_si128((const __m128i*)(input + w +  0));
-		 __m128i b = _mm_loadu_si128((const __m128i*)(input + w +  4));
-		 __m128i c = _mm_loadu_si128((const __m128i*)(input + w +  8));
-		 __m128i d = _mm_loadu_si128((const __m128i*)(input + w + 12));
+         __m128i a = _mm_loadu_si128((const __m128i*)(input + w +  0));
+         __m128i b = _mm_loadu_si128((const __m128i*)(input + w +  4));
+         __m128i c = _mm_loadu_si128((const __m128i*)(input + w +  8));
+         __m128i d = _mm_loadu_si128((const __m128i*)(input + w + 12));
          a = conv_shuffle_rb_epi32(a);
          b = conv_shuffle_rb_epi32(b);
          c = conv_shuffle_rb_epi32(c);
@@ -860,23 +1531,54 @@ void conv_abgr8888_bgr24(void *output_, const void *input_,
    }
 }
 
+#ifdef PIXCONV_AVX2
+static PIXCONV_AVX2_TARGET int conv_argb8888_abgr8888_avx2(uint32_t *output,
+      const uint32_t *input, int width)
+{
+   int w              = 0;
+   const __m256i shuf = _mm256_setr_epi8(
+         2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+         2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+   for (; w + 8 <= width; w += 8)
+      _mm256_storeu_si256((__m256i*)(output + w), _mm256_shuffle_epi8(
+               _mm256_loadu_si256((const __m256i*)(input + w)), shuf));
+
+   return w;
+}
+#endif
+
 void conv_argb8888_abgr8888(void *output_, const void *input_,
       int width, int height,
       int out_stride, int in_stride)
 {
-   int h, w;
+   int h;
    const uint32_t *input = (const uint32_t*)input_;
    uint32_t *output      = (uint32_t*)output_;
+   uint64_t simd         = pixconv_simd();
+
+#if defined(__SSE2__)
+   int max_width         = (simd & RETRO_SIMD_SSE2) ? width - 3 : 0;
+#endif
+
+   (void)simd;
 
    for (h = 0; h < height;
          h++, output += out_stride >> 2, input += in_stride >> 2)
    {
-      for (w = 0; w < width; w++)
-      {
-         uint32_t col = input[w];
-         output[w]    = ((col << 16) & 0xff0000) |
-            ((col >> 16) & 0xff) | (col & 0xff00ff00);
-      }
+      int w = 0;
+#ifdef PIXCONV_AVX2
+      if (simd & RETRO_SIMD_AVX2)
+         w = conv_argb8888_abgr8888_avx2(output, input, width);
+#endif
+#if defined(__SSE2__)
+      for (; w < max_width; w += 4)
+         _mm_storeu_si128((__m128i*)(output + w), conv_shuffle_rb_epi32(
+                  _mm_loadu_si128((const __m128i*)(input + w))));
+#endif
+
+      for (; w < width; w++)
+         output[w] = pixconv_swap_rb(input[w]);
    }
 }
 
@@ -888,6 +1590,58 @@ void conv_argb8888_abgr8888(void *output_, const void *input_,
 #define YUV_MAT_V_R (90)
 #define YUV_MAT_V_G (-46)
 
+#ifdef PIXCONV_AVX2
+/* Unlike SSE2, U and V are spread over their pixel pair within each
+ * 32-bit lane, so nothing crosses 128-bit lanes until the store */
+static PIXCONV_AVX2_TARGET int conv_yuyv_argb8888_avx2(uint32_t *output,
+      const uint8_t *input, int width)
+{
+   int w                       = 0;
+   const __m256i mask_y        = _mm256_set1_epi16(0xff);
+   const __m256i mask_u        = _mm256_set1_epi32(0xff);
+   const __m256i chroma_offset = _mm256_set1_epi16(128);
+   const __m256i round_offset  = _mm256_set1_epi16(YUV_OFFSET);
+   const __m256i yuv_mul       = _mm256_set1_epi16(YUV_MAT_Y);
+   const __m256i u_g_mul       = _mm256_set1_epi16(YUV_MAT_U_G);
+   const __m256i u_b_mul       = _mm256_set1_epi16(YUV_MAT_U_B);
+   const __m256i v_r_mul       = _mm256_set1_epi16(YUV_MAT_V_R);
+   const __m256i v_g_mul       = _mm256_set1_epi16(YUV_MAT_V_G);
+   const __m256i zero          = _mm256_setzero_si256();
+   const __m256i a             = _mm256_set1_epi16(0xff);
+
+   for (; w + 16 <= width; w += 16)
+   {
+      __m256i yuv = _mm256_loadu_si256((const __m256i*)(input + w * 2));
+      __m256i y   = _mm256_mullo_epi16(_mm256_and_si256(yuv, mask_y), yuv_mul);
+      __m256i u   = _mm256_and_si256(_mm256_srli_epi32(yuv, 8), mask_u);
+      __m256i v   = _mm256_srli_epi32(yuv, 24);
+      __m256i r, g, b;
+
+      u           = _mm256_sub_epi16(_mm256_or_si256(u,
+               _mm256_slli_epi32(u, 16)), chroma_offset);
+      v           = _mm256_sub_epi16(_mm256_or_si256(v,
+               _mm256_slli_epi32(v, 16)), chroma_offset);
+
+      r = _mm256_srai_epi16(_mm256_adds_epi16(_mm256_adds_epi16(y,
+                  _mm256_mullo_epi16(v, v_r_mul)), round_offset), YUV_SHIFT);
+      g = _mm256_srai_epi16(_mm256_adds_epi16(_mm256_adds_epi16(
+                  _mm256_adds_epi16(y, _mm256_mullo_epi16(v, v_g_mul)),
+                  _mm256_mullo_epi16(u, u_g_mul)), round_offset), YUV_SHIFT);
+      b = _mm256_srai_epi16(_mm256_adds_epi16(_mm256_adds_epi16(y,
+                  _mm256_mullo_epi16(u, u_b_mul)), round_offset), YUV_SHIFT);
+
+      /* Saturate into 8-bit */
+      r = _mm256_min_epi16(_mm256_max_epi16(r, zero), a);
+      g = _mm256_min_epi16(_mm256_max_epi16(g, zero), a);
+      b = _mm256_min_epi16(_mm256_max_epi16(b, zero), a);
+
+      pixconv_store_argb8888_avx2(output + w, b, g, r, a);
+   }
+
+   return w;
+}
+#endif
+
 void conv_yuyv_argb8888(void *output_, const void *input_,
       int width, int height,
       int out_stride, int in_stride)
@@ -895,6 +1649,7 @@ void conv_yuyv_argb8888(void *output_, const void *input_,
    int h;
    const uint8_t *input        = (const uint8_t*)input_;
    uint32_t *output            = (uint32_t*)output_;
+   uint64_t simd               = pixconv_simd();
 
 #if defined(__SSE2__)
    const __m128i mask_y        = _mm_set1_epi16(0xffu);
@@ -910,17 +1665,29 @@ void conv_yuyv_argb8888(void *output_, const void *input_,
    const __m128i v_g_mul       = _mm_set1_epi16(YUV_MAT_V_G);
    const __m128i a             = _mm_cmpeq_epi16(
          _mm_setzero_si128(), _mm_setzero_si128());
+
+   int max_width               = (simd & RETRO_SIMD_SSE2) ? width : 0;
 #endif
 
+   (void)simd;
+
    for (h = 0; h < height; h++, output += out_stride >> 2, input += in_stride)
    {
       const uint8_t *src = input;
       uint32_t      *dst = output;
       int              w = 0;
 
+#ifdef PIXCONV_AVX2
+      if (simd & RETRO_SIMD_AVX2)
+      {
+         w    = conv_yuyv_argb8888_avx2(output, input, width);
+         src += w * 2;
+         dst += w;
+      }
+#endif
 #if defined(__SSE2__)
       /* Each loop processes 16 pixels. */
-      for (; w + 16 <= width; w += 16, src += 32, dst += 16)
+      for (; w + 16 <= max_width; w += 16, src += 32, dst += 16)
       {
          __m128i u, v, u0_g, u1_g, u0_b, u1_b, v0_r, v1_r, v0_g, v1_g,
                  r0, g0, b0, r1, g1, b1;
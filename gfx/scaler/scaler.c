@@ -30,6 +30,46 @@
 #include <gfx/scaler/filter.h>
 #include <gfx/scaler/pixconv.h>
 
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+
+#define SCALER_MAX_THREADS   32
+/* Bands shorter than this cost more to hand out than they save */
+#define SCALER_MIN_BAND_ROWS 16
+
+struct scaler_band
+{
+   /* Copy of the parent context narrowed to the band: scaled.frame
+    * is the band's slice, vert.filter_pos is relative to in_y */
+   struct scaler_ctx ctx;
+   int in_y;
+   int out_y;
+   int out_rows;
+};
+
+struct scaler_pool
+{
+   slock_t *lock;
+   scond_t *job_cond;         /* Broadcast when a frame starts */
+   scond_t *done_cond;        /* Signalled when a frame's last band ends */
+   sthread_t *workers[SCALER_MAX_THREADS];
+   unsigned num_workers;
+   unsigned threads;          /* As requested, workers may be fewer */
+   bool quit;
+
+   struct scaler_band *bands;
+   int *filter_pos;           /* Backs the bands' vert.filter_pos */
+   unsigned num_bands;
+
+   /* Frame being scaled, valid while its bands run */
+   const struct scaler_ctx *ctx;
+   void *output;
+   const void *input;
+   unsigned next_band;
+   unsigned bands_done;
+};
+#endif
+
 static bool allocate_frames(struct scaler_ctx *ctx)
 {
    uint64_t *scaled_frame = NULL;
@@ -44,39 +84,307 @@ static bool allocate_frames(struct scaler_ctx *ctx)
 
    ctx->scaled.frame      = scaled_frame;
 
-   if (ctx->in_fmt != SCALER_FMT_ARGB8888)
+   return true;
+}
+
+static void scaler_ctx_free_frames(struct scaler_ctx *ctx)
+{
+   if (ctx->horiz.filter)
+      free(ctx->horiz.filter);
+   if (ctx->horiz.filter_pos)
+      free(ctx->horiz.filter_pos);
+   if (ctx->vert.filter)
+      free(ctx->vert.filter);
+   if (ctx->vert.filter_pos)
+      free(ctx->vert.filter_pos);
+   if (ctx->scaled.frame)
+      free(ctx->scaled.frame);
+
+   ctx->horiz.filter        = NULL;
+   ctx->horiz.filter_len    = 0;
+   ctx->horiz.filter_stride = 0;
+   ctx->horiz.filter_pos    = NULL;
+
+   ctx->vert.filter         = NULL;
+   ctx->vert.filter_len     = 0;
+   ctx->vert.filter_stride  = 0;
+   ctx->vert.filter_pos     = NULL;
+
+   ctx->scaled.frame        = NULL;
+   ctx->scaled.width        = 0;
+   ctx->scaled.height       = 0;
+   ctx->scaled.stride       = 0;
+
+#ifdef HAVE_THREADS
+   if (ctx->pool)
    {
-      uint32_t *input_frame = NULL;
-      ctx->input.stride     = ((ctx->in_width + 7) & ~7) * sizeof(uint32_t);
-      input_frame           = (uint32_t*)calloc(sizeof(uint32_t),
-               (ctx->input.stride * ctx->in_height) >> 2);
+      /* Workers are idle between frames, but read num_bands */
+      slock_lock(ctx->pool->lock);
+      ctx->pool->num_bands  = 0;
+      ctx->pool->next_band  = 0;
+      ctx->pool->bands_done = 0;
+      slock_unlock(ctx->pool->lock);
+
+      free(ctx->pool->bands);
+      free(ctx->pool->filter_pos);
+      ctx->pool->bands      = NULL;
+      ctx->pool->filter_pos = NULL;
+   }
+#endif
+}
 
-      if (!input_frame)
-         return false;
+#ifdef HAVE_THREADS
+static void scaler_band_run(struct scaler_pool *pool, unsigned i)
+{
+   const struct scaler_ctx *ctx   = pool->ctx;
+   const struct scaler_band *band = &pool->bands[i];
+   const uint8_t *input_frame     = (const uint8_t*)pool->input;
+   uint8_t *output_frame          = (uint8_t*)pool->output;
+
+   if (ctx->scaler_special == scaler_argb8888_area_special)
+      scaler_argb8888_area_rows(ctx, output_frame, input_frame,
+            ctx->out_stride, ctx->in_stride, band->out_y, band->out_rows);
+   else if (ctx->scaler_special)
+      scaler_argb8888_point_rows(ctx, output_frame, input_frame,
+            ctx->out_stride, ctx->in_stride, band->out_y, band->out_rows);
+   else
+   {
+      band->ctx.scaler_horiz(&band->ctx,
+            input_frame + band->in_y * ctx->in_stride, ctx->in_stride);
+      band->ctx.scaler_vert(&band->ctx,
+            output_frame + band->out_y * ctx->out_stride, ctx->out_stride);
+   }
+}
+
+static void scaler_pool_thread(void *data)
+{
+   struct scaler_pool *pool = (struct scaler_pool*)data;
+
+   slock_lock(pool->lock);
+
+   while (!pool->quit)
+   {
+      unsigned i;
+
+      if (pool->next_band >= pool->num_bands)
+      {
+         scond_wait(pool->job_cond, pool->lock);
+         continue;
+      }
+
+      i = pool->next_band++;
+      slock_unlock(pool->lock);
+      scaler_band_run(pool, i);
+      slock_lock(pool->lock);
+
+      if (++pool->bands_done == pool->num_bands)
+         scond_signal(pool->done_cond);
+   }
+
+   slock_unlock(pool->lock);
+}
+
+/* Runs every band, on the workers and the calling thread, and
+ * returns once all bands are done. */
+static void scaler_pool_dispatch(struct scaler_pool *pool)
+{
+   slock_lock(pool->lock);
+
+   pool->next_band  = 0;
+   pool->bands_done = 0;
+   scond_broadcast(pool->job_cond);
+
+   while (pool->next_band < pool->num_bands)
+   {
+      unsigned i = pool->next_band++;
+
+      slock_unlock(pool->lock);
+      scaler_band_run(pool, i);
+      slock_lock(pool->lock);
+
+      pool->bands_done++;
+   }
+
+   while (pool->bands_done < pool->num_bands)
+      scond_wait(pool->done_cond, pool->lock);
+
+   slock_unlock(pool->lock);
+}
+
+static void scaler_pool_free(struct scaler_pool *pool)
+{
+   unsigned i;
+
+   if (pool->lock)
+   {
+      slock_lock(pool->lock);
+      pool->quit = true;
+      scond_broadcast(pool->job_cond);
+      slock_unlock(pool->lock);
+   }
+
+   for (i = 0; i < pool->num_workers; i++)
+      sthread_join(pool->workers[i]);
+
+   if (pool->done_cond)
+      scond_free(pool->done_cond);
+   if (pool->job_cond)
+      scond_free(pool->job_cond);
+   if (pool->lock)
+      slock_free(pool->lock);
+
+   free(pool->bands);
+   free(pool->filter_pos);
+   free(pool);
+}
+
+/* The calling thread takes bands too, so @threads - 1 workers
+ * are started. */
+static struct scaler_pool *scaler_pool_new(unsigned threads)
+{
+   struct scaler_pool *pool = (struct scaler_pool*)
+      calloc(1, sizeof(*pool));
 
-      ctx->input.frame      = input_frame;
+   if (!pool)
+      return NULL;
+
+   pool->lock      = slock_new();
+   pool->job_cond  = scond_new();
+   pool->done_cond = scond_new();
+   if (!pool->lock || !pool->job_cond || !pool->done_cond)
+      goto error;
+
+   pool->threads   = threads;
+
+   for (; pool->num_workers < threads - 1; pool->num_workers++)
+   {
+      pool->workers[pool->num_workers] =
+         sthread_create(scaler_pool_thread, pool);
+      if (!pool->workers[pool->num_workers])
+         break;
+   }
+
+   if (!pool->num_workers)
+      goto error;
+
+   return pool;
+
+error:
+   scaler_pool_free(pool);
+   return NULL;
+}
+
+/* Splits the output rows into bands once the filters are known.
+ * Each band gets a slice of scaled.frame holding just the input
+ * rows its vertical filter reads, so bands never share rows of the
+ * intermediate frame. Failing to set up threads is not an error,
+ * the context then scales serially. */
+static bool scaler_ctx_gen_bands(struct scaler_ctx *ctx)
+{
+   unsigned i;
+   unsigned threads   = ctx->threads;
+   unsigned num_bands = 0;
+   int scaled_rows    = 0;
+   struct scaler_pool *pool;
+
+   if (threads > SCALER_MAX_THREADS)
+      threads = SCALER_MAX_THREADS;
+
+   if (ctx->pool && ctx->pool->threads != threads)
+   {
+      scaler_pool_free(ctx->pool);
+      ctx->pool = NULL;
    }
 
-   if (ctx->out_fmt != SCALER_FMT_ARGB8888)
+   if (ctx->unscaled || threads < 2)
+      return true;
+
+   num_bands = ctx->out_height / SCALER_MIN_BAND_ROWS;
+   if (num_bands > threads)
+      num_bands = threads;
+   if (num_bands < 2)
+      return true;
+
+   if (!ctx->pool && !(ctx->pool = scaler_pool_new(threads)))
+      return true;
+
+   pool             = ctx->pool;
+   pool->bands      = (struct scaler_band*)
+      calloc(num_bands, sizeof(*pool->bands));
+   pool->filter_pos = (int*)calloc(ctx->out_height, sizeof(int));
+   if (!pool->bands || !pool->filter_pos)
+      return false;
+
+   for (i = 0; i < num_bands; i++)
    {
-      uint32_t *output_frame = NULL;
-      ctx->output.stride     = ((ctx->out_width + 7) & ~7) * sizeof(uint32_t);
+      int h;
+      struct scaler_band *band = &pool->bands[i];
+      int in_end               = 0;
+
+      band->out_y     = i * ctx->out_height / num_bands;
+      band->out_rows  = (i + 1) * ctx->out_height / num_bands - band->out_y;
 
-      output_frame           = (uint32_t*)calloc(sizeof(uint32_t),
-               (ctx->output.stride * ctx->out_height) >> 2);
+      if (ctx->scaler_special)
+         continue;
 
-      if (!output_frame)
+      band->in_y = ctx->in_height;
+      for (h = band->out_y; h < band->out_y + band->out_rows; h++)
+      {
+         int pos = ctx->vert.filter_pos[h];
+         if (pos < band->in_y)
+            band->in_y = pos;
+         if (pos + ctx->vert.filter_len > in_end)
+            in_end = pos + ctx->vert.filter_len;
+      }
+
+      for (h = band->out_y; h < band->out_y + band->out_rows; h++)
+         pool->filter_pos[h] = ctx->vert.filter_pos[h] - band->in_y;
+
+      band->ctx                 = *ctx;
+      band->ctx.out_height      = band->out_rows;
+      band->ctx.scaled.height   = in_end - band->in_y;
+      band->ctx.vert.filter    += band->out_y * ctx->vert.filter_stride;
+      band->ctx.vert.filter_pos = pool->filter_pos + band->out_y;
+
+      scaled_rows              += band->ctx.scaled.height;
+   }
+
+   if (!ctx->scaler_special)
+   {
+      /* Replace the full frame intermediate with the band slices */
+      uint64_t *scaled_frame = (uint64_t*)calloc(sizeof(uint64_t),
+            (ctx->scaled.stride * scaled_rows) >> 3);
+
+      if (!scaled_frame)
          return false;
 
-      ctx->output.frame      = output_frame;
+      free(ctx->scaled.frame);
+      ctx->scaled.frame = scaled_frame;
+
+      for (i = 0; i < num_bands; i++)
+      {
+         pool->bands[i].ctx.scaled.frame = scaled_frame;
+         scaled_frame += (ctx->scaled.stride >> 3)
+            * pool->bands[i].ctx.scaled.height;
+      }
    }
 
+   slock_lock(pool->lock);
+   pool->num_bands  = num_bands;
+   pool->next_band  = num_bands;
+   pool->bands_done = num_bands;
+   slock_unlock(pool->lock);
+
    return true;
 }
+#endif
 
 bool scaler_ctx_gen_filter(struct scaler_ctx *ctx)
 {
-   scaler_ctx_gen_reset(ctx);
+   /* before any band worker runs a conversion */
+   pixconv_init();
+
+   scaler_ctx_free_frames(ctx);
 
    ctx->scaler_special = NULL;
    ctx->unscaled       = false;
@@ -150,6 +458,9 @@ bool scaler_ctx_gen_filter(struct scaler_ctx *ctx)
                   case SCALER_FMT_0RGB1555:
                      ctx->direct_pixconv = conv_argb8888_0rgb1555;
                      break;
+                  case SCALER_FMT_RGB565:
+                     ctx->direct_pixconv = conv_argb8888_rgb565;
+                     break;
                   case SCALER_FMT_BGR24:
                      ctx->direct_pixconv = conv_argb8888_bgr24;
                      break;
@@ -204,29 +515,27 @@ bool scaler_ctx_gen_filter(struct scaler_ctx *ctx)
    }
    else
    {
-      ctx->scaler_horiz = scaler_argb8888_horiz;
-      ctx->scaler_vert  = scaler_argb8888_vert;
-
+      /* The passes read and write the formats directly */
       switch (ctx->in_fmt)
       {
          case SCALER_FMT_ARGB8888:
-            /* No need to convert :D */
+            ctx->scaler_horiz = scaler_argb8888_horiz;
             break;
 
          case SCALER_FMT_0RGB1555:
-            ctx->in_pixconv = conv_0rgb1555_argb8888;
+            ctx->scaler_horiz = scaler_0rgb1555_horiz;
             break;
 
          case SCALER_FMT_RGB565:
-            ctx->in_pixconv = conv_rgb565_argb8888;
+            ctx->scaler_horiz = scaler_rgb565_horiz;
             break;
 
          case SCALER_FMT_BGR24:
-            ctx->in_pixconv = conv_bgr24_argb8888;
+            ctx->scaler_horiz = scaler_bgr24_horiz;
             break;
 
          case SCALER_FMT_RGBA4444:
-            ctx->in_pixconv = conv_rgba4444_argb8888;
+            ctx->scaler_horiz = scaler_rgba4444_horiz;
             break;
 
          default:
@@ -236,73 +545,62 @@ bool scaler_ctx_gen_filter(struct scaler_ctx *ctx)
       switch (ctx->out_fmt)
       {
          case SCALER_FMT_ARGB8888:
-            /* No need to convert :D */
+            ctx->scaler_vert = scaler_argb8888_vert;
             break;
 
          case SCALER_FMT_RGBA4444:
-            ctx->out_pixconv = conv_argb8888_rgba4444;
+            ctx->scaler_vert = scaler_rgba4444_vert;
             break;
 
          case SCALER_FMT_0RGB1555:
-            ctx->out_pixconv = conv_argb8888_0rgb1555;
+            ctx->scaler_vert = scaler_0rgb1555_vert;
+            break;
+
+         case SCALER_FMT_RGB565:
+            ctx->scaler_vert = scaler_rgb565_vert;
             break;
 
          case SCALER_FMT_BGR24:
-            ctx->out_pixconv = conv_argb8888_bgr24;
+            ctx->scaler_vert = scaler_bgr24_vert;
             break;
 
          case SCALER_FMT_ABGR8888:
-            ctx->out_pixconv = conv_argb8888_abgr8888;
+            ctx->scaler_vert = scaler_abgr8888_vert;
             break;
 
          default:
             return false;
       }
 
+      /* Long filters need the rounding of the wide passes */
+      if (     ctx->scaler_type == SCALER_TYPE_AREA
+            || ctx->scaler_type == SCALER_TYPE_BICUBIC)
+      {
+         ctx->scaler_horiz = scaler_wide_horiz;
+         ctx->scaler_vert  = scaler_wide_vert;
+      }
+
       if (!scaler_gen_filter(ctx))
          return false;
    }
 
+#ifdef HAVE_THREADS
+   if (!scaler_ctx_gen_bands(ctx))
+      return false;
+#endif
+
    return true;
 }
 
 void scaler_ctx_gen_reset(struct scaler_ctx *ctx)
 {
-   if (ctx->horiz.filter)
-      free(ctx->horiz.filter);
-   if (ctx->horiz.filter_pos)
-      free(ctx->horiz.filter_pos);
-   if (ctx->vert.filter)
-      free(ctx->vert.filter);
-   if (ctx->vert.filter_pos)
-      free(ctx->vert.filter_pos);
-   if (ctx->scaled.frame)
-      free(ctx->scaled.frame);
-   if (ctx->input.frame)
-      free(ctx->input.frame);
-   if (ctx->output.frame)
-      free(ctx->output.frame);
+   scaler_ctx_free_frames(ctx);
 
-   ctx->horiz.filter        = NULL;
-   ctx->horiz.filter_len    = 0;
-   ctx->horiz.filter_stride = 0;
-   ctx->horiz.filter_pos    = NULL;
-
-   ctx->vert.filter         = NULL;
-   ctx->vert.filter_len     = 0;
-   ctx->vert.filter_stride  = 0;
-   ctx->vert.filter_pos     = NULL;
-
-   ctx->scaled.frame        = NULL;
-   ctx->scaled.width        = 0;
-   ctx->scaled.height       = 0;
-   ctx->scaled.stride       = 0;
-
-   ctx->input.frame         = NULL;
-   ctx->input.stride        = 0;
-
-   ctx->output.frame        = NULL;
-   ctx->output.stride       = 0;
+#ifdef HAVE_THREADS
+   if (ctx->pool)
+      scaler_pool_free(ctx->pool);
+   ctx->pool = NULL;
+#endif
 }
 
 /**
@@ -311,49 +609,40 @@ void scaler_ctx_gen_reset(struct scaler_ctx *ctx)
  * @output       : pointer to output image.
  * @input        : pointer to input image.
  *
- * Scales an input image to an output image.
+ * Scales an input image to an output image. With @ctx->threads
+ * above 1, the output is split into that many bands of rows, each
+ * with its own slice of the intermediate frame, and the bands are
+ * scaled on the context's worker threads and the caller's.
  **/
 void scaler_ctx_scale(struct scaler_ctx *ctx,
       void *output, const void *input)
 {
-   const void *input_frame = input;
-   void *output_frame      = output;
-   int input_stride        = ctx->in_stride;
-   int output_stride       = ctx->out_stride;
-
-   if (ctx->in_fmt != SCALER_FMT_ARGB8888)
+#ifdef HAVE_THREADS
+   if (ctx->pool && ctx->pool->num_bands)
    {
-      ctx->in_pixconv(ctx->input.frame, input,
-            ctx->in_width, ctx->in_height,
-            ctx->input.stride, ctx->in_stride);
+      struct scaler_pool *pool = ctx->pool;
 
-      input_frame       = ctx->input.frame;
-      input_stride      = ctx->input.stride;
-   }
+      pool->ctx    = ctx;
+      pool->output = output;
+      pool->input  = input;
 
-   if (ctx->out_fmt != SCALER_FMT_ARGB8888)
-   {
-      output_frame  = ctx->output.frame;
-      output_stride = ctx->output.stride;
+      scaler_pool_dispatch(pool);
+      return;
    }
+#endif
 
    /* Take some special, and (hopefully) more optimized path. */
    if (ctx->scaler_special)
-      ctx->scaler_special(ctx, output_frame, input_frame,
+      ctx->scaler_special(ctx, output, input,
             ctx->out_width, ctx->out_height,
             ctx->in_width, ctx->in_height,
-            output_stride, input_stride);
+            ctx->out_stride, ctx->in_stride);
    else
    {
       /* Take generic filter path. */
       if (ctx->scaler_horiz)
-         ctx->scaler_horiz(ctx, input_frame, input_stride);
+         ctx->scaler_horiz(ctx, input, ctx->in_stride);
       if (ctx->scaler_vert)
-         ctx->scaler_vert (ctx, output, output_stride);
+         ctx->scaler_vert (ctx, output, ctx->out_stride);
    }
-
-   if (ctx->out_fmt != SCALER_FMT_ARGB8888)
-      ctx->out_pixconv(output, ctx->output.frame,
-            ctx->out_width, ctx->out_height,
-            ctx->out_stride, ctx->output.stride);
 }
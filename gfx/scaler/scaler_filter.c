@@ -21,7 +21,9 @@
  */
 
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
+#include <math.h>
 
 #include <gfx/scaler/filter.h>
 #include <gfx/scaler/scaler_int.h>
@@ -75,6 +77,134 @@ static INLINE void gen_filter_sinc_sub(struct scaler_filter *filter,
    }
 }
 
+/* Puts whatever rounding left the taps short of FILTER_UNITY on
+ * the largest one, so flat areas keep their colour. */
+static INLINE void normalize_filter_sub(int16_t *taps, int len)
+{
+   int j;
+   int sum     = 0;
+   int largest = 0;
+
+   for (j = 0; j < len; j++)
+   {
+      sum += taps[j];
+      if (taps[j] > taps[largest])
+         largest = j;
+   }
+
+   taps[largest] += FILTER_UNITY - sum;
+}
+
+/* Output pixel i covers input span [i * in / out, (i + 1) * in / out),
+ * and each tap weighs the part of its pixel inside that span. */
+static INLINE void gen_filter_area_sub(struct scaler_filter *filter,
+      int len, int in_len)
+{
+   int i, j;
+   const int taps = filter->filter_len;
+
+   for (i = 0; i < len; i++)
+   {
+      int16_t *base = filter->filter + i * filter->filter_stride;
+      int64_t start = ((int64_t)i       * in_len << 16) / len;
+      int64_t end   = ((int64_t)(i + 1) * in_len << 16) / len;
+      int pos       = (int)(start >> 16);
+
+      if (pos > in_len - taps)
+         pos = in_len - taps;
+
+      filter->filter_pos[i] = pos;
+
+      for (j = 0; j < taps; j++)
+      {
+         int64_t lo = (int64_t)(pos + j)     << 16;
+         int64_t hi = (int64_t)(pos + j + 1) << 16;
+
+         if (lo < start)
+            lo = start;
+         if (hi > end)
+            hi = end;
+
+         base[j] = hi > lo
+            ? (int16_t)(((hi - lo) * FILTER_UNITY + ((end - start) >> 1)) / (end - start))
+            : 0;
+      }
+
+      normalize_filter_sub(base, taps);
+   }
+}
+
+/* Keys cubic with a = -0.5 (Catmull-Rom) */
+static double bicubic(double x)
+{
+   x = fabs(x);
+   if (x < 1.0)
+      return (1.5 * x - 2.5) * x * x + 1.0;
+   if (x < 2.0)
+      return ((-0.5 * x + 2.5) * x - 4.0) * x + 2.0;
+   return 0.0;
+}
+
+/* @taps is the width of the kernel, which can be more than
+ * filter_len for tiny inputs. Taps past an edge fold into the edge
+ * pixel rather than being dropped. */
+static INLINE void gen_filter_bicubic_sub(struct scaler_filter *filter,
+      int len, int pos, int step, int in_len, int taps, double phase_mul)
+{
+   int i, j;
+   const int filter_len = filter->filter_len;
+
+   for (i = 0; i < len; i++, pos += step)
+   {
+      int16_t *base = filter->filter + i * filter->filter_stride;
+      int first     = (pos >> 16) - (taps / 2 - 1);
+      int start     = first;
+      double sum    = 0.0;
+
+      if (start > in_len - filter_len)
+         start = in_len - filter_len;
+      if (start < 0)
+         start = 0;
+
+      filter->filter_pos[i] = start;
+
+      for (j = 0; j < taps; j++)
+         sum += bicubic(((first + j) - pos / 65536.0) * phase_mul);
+
+      for (j = 0; j < taps; j++)
+      {
+         int x     = first + j;
+         double w  = bicubic((x - pos / 65536.0) * phase_mul);
+
+         if (x < 0)
+            x = 0;
+         if (x > in_len - 1)
+            x = in_len - 1;
+
+         base[x - start] += (int16_t)floor(w * FILTER_UNITY / sum + 0.5);
+      }
+
+      normalize_filter_sub(base, filter_len);
+   }
+}
+
+/* Span of one output pixel, rounded up and plus one when spans
+ * don't start on pixel boundaries */
+static int area_filter_len(int in_len, int out_len)
+{
+   int len = in_len % out_len
+      ? in_len / out_len + 2 : in_len / out_len;
+   return len > in_len ? in_len : len;
+}
+
+/* Cubic support of two pixels each side, widened by the downscale */
+static int bicubic_taps(int in_len, int out_len)
+{
+   if (in_len <= out_len)
+      return 4;
+   return 2 * (int)ceil(2.0 * in_len / out_len);
+}
+
 static bool validate_filter(struct scaler_ctx *ctx)
 {
    int i;
@@ -157,6 +287,8 @@ bool scaler_gen_filter(struct scaler_ctx *ctx)
 {
    int x_pos, x_step, y_pos, y_step;
    int sinc_size = 0;
+   int x_taps    = 0;
+   int y_taps    = 0;
 
    switch (ctx->scaler_type)
    {
@@ -180,6 +312,20 @@ bool scaler_gen_filter(struct scaler_ctx *ctx)
          ctx->vert.filter_len     = sinc_size;
          ctx->vert.filter_stride  = sinc_size;
          break;
+      case SCALER_TYPE_AREA:
+         ctx->horiz.filter_len    = area_filter_len(ctx->in_width, ctx->out_width);
+         ctx->horiz.filter_stride = ctx->horiz.filter_len;
+         ctx->vert.filter_len     = area_filter_len(ctx->in_height, ctx->out_height);
+         ctx->vert.filter_stride  = ctx->vert.filter_len;
+         break;
+      case SCALER_TYPE_BICUBIC:
+         x_taps                   = bicubic_taps(ctx->in_width, ctx->out_width);
+         y_taps                   = bicubic_taps(ctx->in_height, ctx->out_height);
+         ctx->horiz.filter_len    = MIN(x_taps, ctx->in_width);
+         ctx->horiz.filter_stride = ctx->horiz.filter_len;
+         ctx->vert.filter_len     = MIN(y_taps, ctx->in_height);
+         ctx->vert.filter_stride  = ctx->vert.filter_len;
+         break;
       case SCALER_TYPE_UNKNOWN:
       default:
          return false;
@@ -230,6 +376,28 @@ bool scaler_gen_filter(struct scaler_ctx *ctx)
                ctx->in_height > ctx->out_height ? (double)ctx->out_height / ctx->in_height : 1.0
                );
          break;
+
+      case SCALER_TYPE_AREA:
+         gen_filter_area_sub(&ctx->horiz, ctx->out_width,  ctx->in_width);
+         gen_filter_area_sub(&ctx->vert,  ctx->out_height, ctx->in_height);
+
+         /* Whole 2x2 to 4x4 blocks are plain averages */
+         if (     (ctx->in_width  == 2 * ctx->out_width  || ctx->in_width  == 4 * ctx->out_width)
+               && (ctx->in_height == 2 * ctx->out_height || ctx->in_height == 4 * ctx->out_height))
+            ctx->scaler_special = scaler_argb8888_area_special;
+         break;
+
+      case SCALER_TYPE_BICUBIC:
+         x_pos  = (1 << 15) * ctx->in_width / ctx->out_width   - (1 << 15);
+         y_pos  = (1 << 15) * ctx->in_height / ctx->out_height - (1 << 15);
+
+         gen_filter_bicubic_sub(&ctx->horiz, ctx->out_width, x_pos, x_step,
+               ctx->in_width, x_taps,
+               ctx->in_width  > ctx->out_width  ? (double)ctx->out_width  / ctx->in_width  : 1.0);
+         gen_filter_bicubic_sub(&ctx->vert, ctx->out_height, y_pos, y_step,
+               ctx->in_height, y_taps,
+               ctx->in_height > ctx->out_height ? (double)ctx->out_height / ctx->in_height : 1.0);
+         break;
       case SCALER_TYPE_UNKNOWN:
          break;
    }
@@ -21,6 +21,7 @@
  */
 
 #include <gfx/scaler/scaler_int.h>
+#include <gfx/scaler/pixconv.h>
 
 #include <retro_inline.h>
 
@@ -60,18 +61,83 @@
  *
  * The C version of scalers perform the exact same operations as the
  * SIMD code for testing purposes.
+ *
+ * Other formats are read and written a pixel at a time by the
+ * horizontal and vertical passes, going through ARGB8888 with the
+ * pixconv.h helpers, so no frame is converted as a whole.
  */
 
-void scaler_argb8888_vert(const struct scaler_ctx *ctx, void *output_, int stride)
+/* Reads pixel @x of @row as ARGB8888. @fmt is a constant wherever
+ * speed matters, so the switch folds away. */
+static INLINE uint32_t scaler_load_argb8888(const void *row, int x,
+      enum scaler_pix_fmt fmt)
+{
+   const uint8_t *bgr;
+
+   switch (fmt)
+   {
+      case SCALER_FMT_0RGB1555:
+         return pixconv_0rgb1555_to_argb8888(((const uint16_t*)row)[x]);
+      case SCALER_FMT_RGB565:
+         return pixconv_rgb565_to_argb8888(((const uint16_t*)row)[x]);
+      case SCALER_FMT_RGBA4444:
+         return pixconv_rgba4444_to_argb8888(((const uint16_t*)row)[x]);
+      case SCALER_FMT_BGR24:
+         bgr = (const uint8_t*)row + x * 3;
+         return (0xffu << 24) | ((uint32_t)bgr[2] << 16)
+            | ((uint32_t)bgr[1] << 8) | bgr[0];
+      case SCALER_FMT_ABGR8888:
+         return pixconv_swap_rb(((const uint32_t*)row)[x]);
+      default:
+         break;
+   }
+
+   return ((const uint32_t*)row)[x];
+}
+
+/* Writes ARGB8888 @col as pixel @x of @row */
+static INLINE void scaler_store_argb8888(void *row, int x, uint32_t col,
+      enum scaler_pix_fmt fmt)
+{
+   uint8_t *bgr;
+
+   switch (fmt)
+   {
+      case SCALER_FMT_0RGB1555:
+         ((uint16_t*)row)[x] = pixconv_argb8888_to_0rgb1555(col);
+         break;
+      case SCALER_FMT_RGB565:
+         ((uint16_t*)row)[x] = pixconv_argb8888_to_rgb565(col);
+         break;
+      case SCALER_FMT_RGBA4444:
+         ((uint16_t*)row)[x] = pixconv_argb8888_to_rgba4444(col);
+         break;
+      case SCALER_FMT_BGR24:
+         bgr    = (uint8_t*)row + x * 3;
+         bgr[0] = (uint8_t)(col >>  0);
+         bgr[1] = (uint8_t)(col >>  8);
+         bgr[2] = (uint8_t)(col >> 16);
+         break;
+      case SCALER_FMT_ABGR8888:
+         ((uint32_t*)row)[x] = pixconv_swap_rb(col);
+         break;
+      default:
+         ((uint32_t*)row)[x] = col;
+         break;
+   }
+}
+
+static INLINE void scaler_vert(const struct scaler_ctx *ctx,
+      void *output_, int stride, enum scaler_pix_fmt fmt)
 {
    int h, w, y;
    const uint64_t      *input = ctx->scaled.frame;
-   uint32_t           *output = (uint32_t*)output_;
+   uint8_t            *output = (uint8_t*)output_;
 
    const int16_t *filter_vert = ctx->vert.filter;
 
    for (h = 0; h < ctx->out_height; h++,
-         filter_vert += ctx->vert.filter_stride, output += stride >> 2)
+         filter_vert += ctx->vert.filter_stride, output += stride)
    {
       const uint64_t *input_base = input + ctx->vert.filter_pos[h]
          * (ctx->scaled.stride >> 3);
@@ -105,7 +171,7 @@ void scaler_argb8888_vert(const struct scaler_ctx *ctx, void *output_, int strid
 
          final     = _mm_packus_epi16(res, res);
 
-         output[w] = _mm_cvtsi128_si32(final);
+         scaler_store_argb8888(output, w, _mm_cvtsi128_si32(final), fmt);
 #else
          int16_t res_a = 0;
          int16_t res_r = 0;
@@ -135,23 +201,54 @@ void scaler_argb8888_vert(const struct scaler_ctx *ctx, void *output_, int strid
          res_g           >>= (7 - 2 - 2);
          res_b           >>= (7 - 2 - 2);
 
-         output[w]         =
-            (clamp_8bit(res_a) << 24) |
+         scaler_store_argb8888(output, w,
+            ((uint32_t)clamp_8bit(res_a) << 24) |
             (clamp_8bit(res_r) << 16) |
             (clamp_8bit(res_g) << 8)  |
-            (clamp_8bit(res_b) << 0);
+            (clamp_8bit(res_b) << 0), fmt);
 #endif
       }
    }
 }
 
-void scaler_argb8888_horiz(const struct scaler_ctx *ctx, const void *input_, int stride)
+void scaler_argb8888_vert(const struct scaler_ctx *ctx, void *output, int stride)
+{
+   scaler_vert(ctx, output, stride, SCALER_FMT_ARGB8888);
+}
+
+void scaler_abgr8888_vert(const struct scaler_ctx *ctx, void *output, int stride)
+{
+   scaler_vert(ctx, output, stride, SCALER_FMT_ABGR8888);
+}
+
+void scaler_0rgb1555_vert(const struct scaler_ctx *ctx, void *output, int stride)
+{
+   scaler_vert(ctx, output, stride, SCALER_FMT_0RGB1555);
+}
+
+void scaler_rgb565_vert(const struct scaler_ctx *ctx, void *output, int stride)
+{
+   scaler_vert(ctx, output, stride, SCALER_FMT_RGB565);
+}
+
+void scaler_bgr24_vert(const struct scaler_ctx *ctx, void *output, int stride)
+{
+   scaler_vert(ctx, output, stride, SCALER_FMT_BGR24);
+}
+
+void scaler_rgba4444_vert(const struct scaler_ctx *ctx, void *output, int stride)
+{
+   scaler_vert(ctx, output, stride, SCALER_FMT_RGBA4444);
+}
+
+static INLINE void scaler_horiz(const struct scaler_ctx *ctx,
+      const void *input_, int stride, enum scaler_pix_fmt fmt)
 {
    int h, w, x;
-   const uint32_t *input = (uint32_t*)input_;
+   const uint8_t *input  = (const uint8_t*)input_;
    uint64_t *output      = ctx->scaled.frame;
 
-   for (h = 0; h < ctx->scaled.height; h++, input += stride >> 2,
+   for (h = 0; h < ctx->scaled.height; h++, input += stride,
          output += ctx->scaled.stride >> 3)
    {
       const int16_t *filter_horiz = ctx->horiz.filter;
@@ -159,7 +256,7 @@ void scaler_argb8888_horiz(const struct scaler_ctx *ctx, const void *input_, int
       for (w = 0; w < ctx->scaled.width; w++,
             filter_horiz += ctx->horiz.filter_stride)
       {
-         const uint32_t *input_base_x = input + ctx->horiz.filter_pos[w];
+         int pos                      = ctx->horiz.filter_pos[w];
 #if defined(__SSE2__)
          __m128i res = _mm_setzero_si128();
 #ifndef __x86_64__
@@ -174,7 +271,8 @@ void scaler_argb8888_horiz(const struct scaler_ctx *ctx, const void *input_, int
             __m128i coeff = _mm_set_epi64x(filter_horiz[x + 1] * 0x0001000100010001ll, filter_horiz[x + 0] * 0x0001000100010001ll);
 
             __m128i col   = _mm_unpacklo_epi8(_mm_set_epi64x(0,
-                     ((uint64_t)input_base_x[x + 1] << 32) | input_base_x[x + 0]), _mm_setzero_si128());
+                     ((uint64_t)scaler_load_argb8888(input, pos + x + 1, fmt) << 32)
+                     | scaler_load_argb8888(input, pos + x, fmt)), _mm_setzero_si128());
 
             col           = _mm_slli_epi16(col, 7);
             res           = _mm_adds_epi16(_mm_mulhi_epi16(col, coeff), res);
@@ -183,7 +281,8 @@ void scaler_argb8888_horiz(const struct scaler_ctx *ctx, const void *input_, int
          for (; x < ctx->horiz.filter_len; x++)
          {
             __m128i coeff = _mm_set_epi64x(0, filter_horiz[x] * 0x0001000100010001ll);
-            __m128i col   = _mm_unpacklo_epi8(_mm_set_epi32(0, 0, 0, input_base_x[x]), _mm_setzero_si128());
+            __m128i col   = _mm_unpacklo_epi8(_mm_set_epi32(0, 0, 0,
+                     scaler_load_argb8888(input, pos + x, fmt)), _mm_setzero_si128());
 
             col           = _mm_slli_epi16(col, 7);
             res           = _mm_adds_epi16(_mm_mulhi_epi16(col, coeff), res);
@@ -206,7 +305,7 @@ void scaler_argb8888_horiz(const struct scaler_ctx *ctx, const void *input_, int
 
          for (x = 0; x < ctx->horiz.filter_len; x++)
          {
-            uint32_t col   = input_base_x[x];
+            uint32_t col   = scaler_load_argb8888(input, pos + x, fmt);
 
             int16_t a      = (col >> (24 - 7)) & (0xff << 7);
             int16_t r      = (col >> (16 - 7)) & (0xff << 7);
@@ -231,31 +330,424 @@ void scaler_argb8888_horiz(const struct scaler_ctx *ctx, const void *input_, int
    }
 }
 
-void scaler_argb8888_point_special(const struct scaler_ctx *ctx,
+void scaler_argb8888_horiz(const struct scaler_ctx *ctx, const void *input, int stride)
+{
+   scaler_horiz(ctx, input, stride, SCALER_FMT_ARGB8888);
+}
+
+void scaler_0rgb1555_horiz(const struct scaler_ctx *ctx, const void *input, int stride)
+{
+   scaler_horiz(ctx, input, stride, SCALER_FMT_0RGB1555);
+}
+
+void scaler_rgb565_horiz(const struct scaler_ctx *ctx, const void *input, int stride)
+{
+   scaler_horiz(ctx, input, stride, SCALER_FMT_RGB565);
+}
+
+void scaler_bgr24_horiz(const struct scaler_ctx *ctx, const void *input, int stride)
+{
+   scaler_horiz(ctx, input, stride, SCALER_FMT_BGR24);
+}
+
+void scaler_rgba4444_horiz(const struct scaler_ctx *ctx, const void *input, int stride)
+{
+   scaler_horiz(ctx, input, stride, SCALER_FMT_RGBA4444);
+}
+
+/* The wide passes take the same filters and intermediate as the ones
+ * above, but accumulate taps in 32 bits with madd and round once at
+ * the end of each pass. Long filters then don't drift darker from
+ * the truncation of every mulhi. Two taps are paired per madd, with
+ * the channels of both interleaved. */
+
+/* Both taps of a madd pair, as one 32-bit lane */
+#define SCALER_TAP_PAIR(a, b) ((int)(((uint32_t)(uint16_t)(b) << 16) | (uint16_t)(a)))
+
+static INLINE void scaler_horiz_wide(const struct scaler_ctx *ctx,
+      const void *input_, int stride, enum scaler_pix_fmt fmt)
+{
+   int h, w, x;
+   const uint8_t *input  = (const uint8_t*)input_;
+   uint64_t *output      = ctx->scaled.frame;
+
+   for (h = 0; h < ctx->scaled.height; h++, input += stride,
+         output += ctx->scaled.stride >> 3)
+   {
+      const int16_t *filter_horiz = ctx->horiz.filter;
+
+      for (w = 0; w < ctx->scaled.width; w++,
+            filter_horiz += ctx->horiz.filter_stride)
+      {
+         int pos                      = ctx->horiz.filter_pos[w];
+#if defined(__SSE2__)
+         __m128i res = _mm_setzero_si128();
+
+         for (x = 0; (x + 1) < ctx->horiz.filter_len; x += 2)
+         {
+            __m128i coeff = _mm_set1_epi32(
+                  SCALER_TAP_PAIR(filter_horiz[x], filter_horiz[x + 1]));
+            __m128i col   = _mm_unpacklo_epi8(_mm_set_epi32(0, 0,
+                     scaler_load_argb8888(input, pos + x + 1, fmt),
+                     scaler_load_argb8888(input, pos + x, fmt)), _mm_setzero_si128());
+
+            col           = _mm_unpacklo_epi16(col, _mm_srli_si128(col, 8));
+            res           = _mm_add_epi32(_mm_madd_epi16(col, coeff), res);
+         }
+
+         for (; x < ctx->horiz.filter_len; x++)
+         {
+            __m128i coeff = _mm_set1_epi32(SCALER_TAP_PAIR(filter_horiz[x], 0));
+            __m128i col   = _mm_unpacklo_epi8(_mm_cvtsi32_si128(
+                     scaler_load_argb8888(input, pos + x, fmt)), _mm_setzero_si128());
+
+            col           = _mm_unpacklo_epi16(col, _mm_setzero_si128());
+            res           = _mm_add_epi32(_mm_madd_epi16(col, coeff), res);
+         }
+
+         /* 8-bit channels times 1 << 14, down to the 13 bits of the
+          * mulhi pass */
+         res              = _mm_srai_epi32(_mm_add_epi32(res, _mm_set1_epi32(1 << 8)), 9);
+         res              = _mm_packs_epi32(res, res);
+
+         _mm_storel_epi64((__m128i*)(output + w), res);
+#else
+         int32_t res_a = 0;
+         int32_t res_r = 0;
+         int32_t res_g = 0;
+         int32_t res_b = 0;
+
+         for (x = 0; x < ctx->horiz.filter_len; x++)
+         {
+            uint32_t col   = scaler_load_argb8888(input, pos + x, fmt);
+            int32_t coeff  = filter_horiz[x];
+
+            res_a         += (int32_t)((col >> 24) & 0xff) * coeff;
+            res_r         += (int32_t)((col >> 16) & 0xff) * coeff;
+            res_g         += (int32_t)((col >>  8) & 0xff) * coeff;
+            res_b         += (int32_t)((col >>  0) & 0xff) * coeff;
+         }
+
+         output[w]         = (
+               (uint64_t)(uint16_t)((res_a + (1 << 8)) >> 9)  << 48) |
+               ((uint64_t)(uint16_t)((res_r + (1 << 8)) >> 9) << 32) |
+               ((uint64_t)(uint16_t)((res_g + (1 << 8)) >> 9) << 16) |
+               ((uint64_t)(uint16_t)((res_b + (1 << 8)) >> 9) << 0);
+#endif
+      }
+   }
+}
+
+static INLINE void scaler_vert_wide(const struct scaler_ctx *ctx,
+      void *output_, int stride, enum scaler_pix_fmt fmt)
+{
+   int h, w, y;
+   const uint64_t      *input = ctx->scaled.frame;
+   uint8_t            *output = (uint8_t*)output_;
+
+   const int16_t *filter_vert = ctx->vert.filter;
+
+   for (h = 0; h < ctx->out_height; h++,
+         filter_vert += ctx->vert.filter_stride, output += stride)
+   {
+      const uint64_t *input_base = input + ctx->vert.filter_pos[h]
+         * (ctx->scaled.stride >> 3);
+
+      for (w = 0; w < ctx->out_width; w++)
+      {
+         const uint64_t *input_base_y = input_base + w;
+#if defined(__SSE2__)
+         __m128i res = _mm_setzero_si128();
+
+         for (y = 0; (y + 1) < ctx->vert.filter_len; y += 2,
+               input_base_y += (ctx->scaled.stride >> 2))
+         {
+            __m128i coeff = _mm_set1_epi32(
+                  SCALER_TAP_PAIR(filter_vert[y], filter_vert[y + 1]));
+            __m128i col   = _mm_unpacklo_epi16(
+                  _mm_loadl_epi64((const __m128i*)input_base_y),
+                  _mm_loadl_epi64((const __m128i*)(input_base_y + (ctx->scaled.stride >> 3))));
+
+            res           = _mm_add_epi32(_mm_madd_epi16(col, coeff), res);
+         }
+
+         for (; y < ctx->vert.filter_len; y++, input_base_y += (ctx->scaled.stride >> 3))
+         {
+            __m128i coeff = _mm_set1_epi32(SCALER_TAP_PAIR(filter_vert[y], 0));
+            __m128i col   = _mm_unpacklo_epi16(
+                  _mm_loadl_epi64((const __m128i*)input_base_y), _mm_setzero_si128());
+
+            res           = _mm_add_epi32(_mm_madd_epi16(col, coeff), res);
+         }
+
+         /* 13-bit channels times 1 << 14, down to 8 bits */
+         res       = _mm_srai_epi32(_mm_add_epi32(res, _mm_set1_epi32(1 << 18)), 19);
+         res       = _mm_packs_epi32(res, res);
+         res       = _mm_packus_epi16(res, res);
+
+         scaler_store_argb8888(output, w, _mm_cvtsi128_si32(res), fmt);
+#else
+         int32_t res_a = 0;
+         int32_t res_r = 0;
+         int32_t res_g = 0;
+         int32_t res_b = 0;
+
+         for (y = 0; y < ctx->vert.filter_len; y++,
+               input_base_y += (ctx->scaled.stride >> 3))
+         {
+            uint64_t col   = *input_base_y;
+            int32_t coeff  = filter_vert[y];
+
+            res_a         += (int16_t)((col >> 48) & 0xffff) * coeff;
+            res_r         += (int16_t)((col >> 32) & 0xffff) * coeff;
+            res_g         += (int16_t)((col >> 16) & 0xffff) * coeff;
+            res_b         += (int16_t)((col >>  0) & 0xffff) * coeff;
+         }
+
+         scaler_store_argb8888(output, w,
+            ((uint32_t)clamp_8bit((res_a + (1 << 18)) >> 19) << 24) |
+            (clamp_8bit((res_r + (1 << 18)) >> 19) << 16) |
+            (clamp_8bit((res_g + (1 << 18)) >> 19) << 8)  |
+            (clamp_8bit((res_b + (1 << 18)) >> 19) << 0), fmt);
+#endif
+      }
+   }
+}
+
+/* One switch a frame, so the format is a constant in each pass */
+void scaler_wide_horiz(const struct scaler_ctx *ctx, const void *input, int stride)
+{
+   switch (ctx->in_fmt)
+   {
+      case SCALER_FMT_0RGB1555:
+         scaler_horiz_wide(ctx, input, stride, SCALER_FMT_0RGB1555);
+         break;
+      case SCALER_FMT_RGB565:
+         scaler_horiz_wide(ctx, input, stride, SCALER_FMT_RGB565);
+         break;
+      case SCALER_FMT_BGR24:
+         scaler_horiz_wide(ctx, input, stride, SCALER_FMT_BGR24);
+         break;
+      case SCALER_FMT_RGBA4444:
+         scaler_horiz_wide(ctx, input, stride, SCALER_FMT_RGBA4444);
+         break;
+      default:
+         scaler_horiz_wide(ctx, input, stride, SCALER_FMT_ARGB8888);
+         break;
+   }
+}
+
+void scaler_wide_vert(const struct scaler_ctx *ctx, void *output, int stride)
+{
+   switch (ctx->out_fmt)
+   {
+      case SCALER_FMT_ABGR8888:
+         scaler_vert_wide(ctx, output, stride, SCALER_FMT_ABGR8888);
+         break;
+      case SCALER_FMT_0RGB1555:
+         scaler_vert_wide(ctx, output, stride, SCALER_FMT_0RGB1555);
+         break;
+      case SCALER_FMT_RGB565:
+         scaler_vert_wide(ctx, output, stride, SCALER_FMT_RGB565);
+         break;
+      case SCALER_FMT_BGR24:
+         scaler_vert_wide(ctx, output, stride, SCALER_FMT_BGR24);
+         break;
+      case SCALER_FMT_RGBA4444:
+         scaler_vert_wide(ctx, output, stride, SCALER_FMT_RGBA4444);
+         break;
+      default:
+         scaler_vert_wide(ctx, output, stride, SCALER_FMT_ARGB8888);
+         break;
+   }
+}
+
+static INLINE void scaler_point_row(void *output, const void *input,
+      int width, int x, int x_step,
+      enum scaler_pix_fmt out_fmt, enum scaler_pix_fmt in_fmt)
+{
+   int w;
+   for (w = 0; w < width; w++, x += x_step)
+      scaler_store_argb8888(output,
+            w, scaler_load_argb8888(input, x >> 16, in_fmt), out_fmt);
+}
+
+static void scaler_point(const struct scaler_ctx *ctx,
       void *output_, const void *input_,
       int out_width, int out_height,
       int in_width, int in_height,
-      int out_stride, int in_stride)
+      int out_stride, int in_stride,
+      int y, int rows)
 {
-   int h, w;
+   int h;
    int x_pos             = (1 << 15) * in_width / out_width - (1 << 15);
    int x_step            = (1 << 16) * in_width / out_width;
    int y_pos             = (1 << 15) * in_height / out_height - (1 << 15);
    int y_step            = (1 << 16) * in_height / out_height;
-   const uint32_t *input = (const uint32_t*)input_;
-   uint32_t *output      = (uint32_t*)output_;
+   const uint8_t *input  = (const uint8_t*)input_;
+   uint8_t *output       = (uint8_t*)output_ + y * out_stride;
+   bool argb8888         = ctx->in_fmt == SCALER_FMT_ARGB8888
+      && ctx->out_fmt == SCALER_FMT_ARGB8888;
 
    if (x_pos < 0)
       x_pos = 0;
    if (y_pos < 0)
       y_pos = 0;
 
-   for (h = 0; h < out_height; h++, y_pos += y_step, output += out_stride >> 2)
+   y_pos += y * y_step;
+
+   for (h = 0; h < rows; h++, y_pos += y_step, output += out_stride)
    {
-      int               x = x_pos;
-      const uint32_t *inp = input + (y_pos >> 16) * (in_stride >> 2);
+      const uint8_t *inp = input + (y_pos >> 16) * in_stride;
+
+      /* Other formats pay for a switch on each pixel */
+      if (argb8888)
+         scaler_point_row(output, inp, out_width, x_pos, x_step,
+               SCALER_FMT_ARGB8888, SCALER_FMT_ARGB8888);
+      else
+         scaler_point_row(output, inp, out_width, x_pos, x_step,
+               ctx->out_fmt, ctx->in_fmt);
+   }
+}
+
+void scaler_argb8888_point_special(const struct scaler_ctx *ctx,
+      void *output, const void *input,
+      int out_width, int out_height,
+      int in_width, int in_height,
+      int out_stride, int in_stride)
+{
+   scaler_point(ctx, output, input,
+         out_width, out_height, in_width, in_height,
+         out_stride, in_stride, 0, out_height);
+}
+
+void scaler_argb8888_point_rows(const struct scaler_ctx *ctx,
+      void *output, const void *input,
+      int out_stride, int in_stride,
+      int y, int rows)
+{
+   scaler_point(ctx, output, input,
+         ctx->out_width, ctx->out_height,
+         ctx->in_width, ctx->in_height,
+         out_stride, in_stride, y, rows);
+}
+
+/* Averages @fx x @fy blocks of @input into one row of @output.
+ * Sums stay exact in 16 bits up to 4x4 blocks, so the SIMD and C
+ * paths round the same way. */
+static INLINE void scaler_area_row(void *output, const uint8_t *input,
+      int in_stride, int width, int fx, int fy, int shift,
+      enum scaler_pix_fmt out_fmt, enum scaler_pix_fmt in_fmt)
+{
+   int w;
+   const int round = (fx * fy) >> 1;
+#if defined(__SSE2__)
+   const __m128i zero   = _mm_setzero_si128();
+   const __m128i bias   = _mm_set1_epi16(round);
+   const __m128i count  = _mm_cvtsi32_si128(shift);
+#endif
+
+   for (w = 0; w < width; w++)
+   {
+      int x, y;
+      uint32_t col;
+#if defined(__SSE2__)
+      if (in_fmt == SCALER_FMT_ARGB8888)
+      {
+         __m128i sum         = zero;
+         const uint8_t *inp  = input + w * fx * 4;
+
+         for (y = 0; y < fy; y++, inp += in_stride)
+         {
+            if (fx == 4)
+            {
+               __m128i v = _mm_loadu_si128((const __m128i*)inp);
+               sum = _mm_add_epi16(sum, _mm_unpacklo_epi8(v, zero));
+               sum = _mm_add_epi16(sum, _mm_unpackhi_epi8(v, zero));
+            }
+            else
+               sum = _mm_add_epi16(sum, _mm_unpacklo_epi8(
+                        _mm_loadl_epi64((const __m128i*)inp), zero));
+         }
+
+         sum = _mm_add_epi16(sum, _mm_srli_si128(sum, 8));
+         sum = _mm_srl_epi16(_mm_add_epi16(sum, bias), count);
+         col = _mm_cvtsi128_si32(_mm_packus_epi16(sum, sum));
+      }
+      else
+#endif
+      {
+         uint32_t a = 0, r = 0, g = 0, b = 0;
+         const uint8_t *inp = input;
+
+         for (y = 0; y < fy; y++, inp += in_stride)
+         {
+            for (x = w * fx; x < (w + 1) * fx; x++)
+            {
+               uint32_t c = scaler_load_argb8888(inp, x, in_fmt);
+               a += (c >> 24);
+               r += (c >> 16) & 0xff;
+               g += (c >>  8) & 0xff;
+               b += (c >>  0) & 0xff;
+            }
+         }
+
+         col = ((a + round) >> shift) << 24
+             | ((r + round) >> shift) << 16
+             | ((g + round) >> shift) <<  8
+             | ((b + round) >> shift) <<  0;
+      }
+
+      scaler_store_argb8888(output, w, col, out_fmt);
+   }
+}
 
-      for (w = 0; w < out_width; w++, x += x_step)
-         output[w] = inp[x >> 16];
+static void scaler_area(const struct scaler_ctx *ctx,
+      void *output_, const void *input_,
+      int out_width, int out_height,
+      int in_width, int in_height,
+      int out_stride, int in_stride,
+      int y, int rows)
+{
+   int h;
+   int fx                = in_width  / out_width;
+   int fy                = in_height / out_height;
+   /* log2 of the block size, as fx and fy are 2 or 4 */
+   int shift             = (fx >> 1) + (fy >> 1);
+   const uint8_t *input  = (const uint8_t*)input_ + y * fy * in_stride;
+   uint8_t *output       = (uint8_t*)output_ + y * out_stride;
+   bool argb8888         = ctx->in_fmt == SCALER_FMT_ARGB8888
+      && ctx->out_fmt == SCALER_FMT_ARGB8888;
+
+   for (h = 0; h < rows; h++, input += fy * in_stride, output += out_stride)
+   {
+      if (argb8888)
+         scaler_area_row(output, input, in_stride, out_width, fx, fy, shift,
+               SCALER_FMT_ARGB8888, SCALER_FMT_ARGB8888);
+      else
+         scaler_area_row(output, input, in_stride, out_width, fx, fy, shift,
+               ctx->out_fmt, ctx->in_fmt);
    }
 }
+
+void scaler_argb8888_area_special(const struct scaler_ctx *ctx,
+      void *output, const void *input,
+      int out_width, int out_height,
+      int in_width, int in_height,
+      int out_stride, int in_stride)
+{
+   scaler_area(ctx, output, input,
+         out_width, out_height, in_width, in_height,
+         out_stride, in_stride, 0, out_height);
+}
+
+void scaler_argb8888_area_rows(const struct scaler_ctx *ctx,
+      void *output, const void *input,
+      int out_stride, int in_stride,
+      int y, int rows)
+{
+   scaler_area(ctx, output, input,
+         ctx->out_width, ctx->out_height,
+         ctx->in_width, ctx->in_height,
+         out_stride, in_stride, y, rows);
+}
@@ -68,6 +68,21 @@ typedef struct
    cdrom_track_t track[99];
 } cdrom_toc_t;
 
+enum cdrom_cmd_direction
+{
+   CDROM_CMD_DIRECTION_NONE = 0,
+   CDROM_CMD_DIRECTION_IN,
+   CDROM_CMD_DIRECTION_OUT
+};
+
+/* Sends one SCSI command, returns 0 on success. On failure, sense data is left in "sense". */
+typedef int (*cdrom_send_command_t)(const libretro_vfs_implementation_file *stream, enum cdrom_cmd_direction dir, void *buf, size_t len, unsigned char *cmd, size_t cmd_len, unsigned char *sense, size_t sense_len);
+
+/* Routes every SCSI command through "cb" instead of the drive, so a drive can be emulated in tests. NULL restores the OS transport. */
+void cdrom_set_send_command(cdrom_send_command_t cb);
+
+typedef struct cdrom_readahead cdrom_readahead_t;
+
 void cdrom_lba_to_msf(unsigned lba, unsigned char *min, unsigned char *sec, unsigned char *frame);
 
 unsigned cdrom_msf_to_lba(unsigned char min, unsigned char sec, unsigned char frame);
@@ -118,6 +133,16 @@ bool cdrom_get_timeouts(libretro_vfs_implementation_file *stream, cdrom_group_ti
 
 bool cdrom_has_atip(libretro_vfs_implementation_file *stream);
 
+/* Streams raw 2352-byte sectors in [lba_start, lba_end) ahead of the reader on a worker thread.
+ * "chunks" multi-sector commands of "chunk_sectors" each are kept queued or buffered past the last read.
+ * Returns NULL without HAVE_THREADS. */
+cdrom_readahead_t* cdrom_readahead_new(libretro_vfs_implementation_file *stream, unsigned lba_start, unsigned lba_end, unsigned chunks, unsigned chunk_sectors);
+
+/* Same as cdrom_read, but served from the read-ahead buffers, waiting only for sectors not read yet. Returns 0 on success. */
+int cdrom_readahead_read(cdrom_readahead_t *ra, unsigned lba, void *s, size_t len, size_t skip);
+
+void cdrom_readahead_free(cdrom_readahead_t *ra);
+
 void cdrom_device_fillpath(char *path, size_t len, char drive, unsigned char track, bool is_cue);
 
 RETRO_END_DECLS
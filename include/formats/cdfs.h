@@ -23,6 +23,7 @@
 #ifndef __RARCH_CDFS_H
 #define __RARCH_CDFS_H
 
+#include <boolean.h>
 #include <streams/interface_stream.h>
 
 RETRO_BEGIN_DECLS
@@ -91,6 +92,17 @@ intfstream_t* cdfs_open_data_track(const char* path);
  */
 intfstream_t* cdfs_open_raw_track(const char* path);
 
+/* keeps the directory index of recently opened discs, so opening
+ * further files on the same disc does not read its directories
+ * again; call once before opening files from several threads.
+ * Without it, each open reads just the directories on its path.
+ * Discs are told apart by their descriptor, size and root
+ * directory. */
+bool cdfs_index_cache_init(void);
+
+/* frees the cached indices */
+void cdfs_index_cache_deinit(void);
+
 RETRO_END_DECLS
 
 #endif /* __RARCH_CDFS_H */
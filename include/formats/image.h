@@ -54,7 +54,29 @@ enum image_type_enum
    IMAGE_TYPE_PNG,
    IMAGE_TYPE_JPEG,
    IMAGE_TYPE_BMP,
-   IMAGE_TYPE_TGA
+   IMAGE_TYPE_TGA,
+   IMAGE_TYPE_QOI
+};
+
+/* Pixel formats a decoder can write, as 32 or 16 bit words */
+enum image_pixel_format
+{
+   IMAGE_PIXEL_ARGB8888 = 0,
+   IMAGE_PIXEL_ABGR8888,
+   IMAGE_PIXEL_RGB565
+};
+
+/* Where a decoder writes its pixels. With data set, the image goes
+ * into the caller's buffer of width x height pixels, pitch bytes
+ * apart, and fails if it doesn't fit. With data NULL, the decoder
+ * allocates a packed buffer in format. */
+struct image_output
+{
+   void *data;
+   size_t pitch;
+   unsigned width;
+   unsigned height;
+   enum image_pixel_format format;
 };
 
 enum image_type_enum image_texture_get_type(const char *path);
@@ -73,6 +95,32 @@ bool image_texture_load_buffer(struct texture_image *img,
 bool image_texture_load(struct texture_image *img, const char *path);
 void image_texture_free(struct texture_image *img);
 
+/* Texture cache
+ *
+ * Decoded images are kept in dir, one file per image: a header, then
+ * the raw ARGB pixels. Files are keyed by source path, modification
+ * time and scale target. Loading an image again maps its file instead
+ * of decoding it. Once the files add up to more than budget bytes
+ * (0 for no limit), the least recently used ones are deleted.
+ *
+ * Only built with HAVE_MMAP, and not on Windows; elsewhere init fails
+ * and image_texture_load_cached always decodes.
+ *
+ * The cache goes straight to the local filesystem, not through a
+ * frontend VFS: dir must be a local directory, and a source that only
+ * the VFS can reach is never cached, but decoded on every load. */
+bool image_texture_cache_init(const char *dir, uint64_t budget);
+
+/* Stops caching. Textures already loaded through the cache stay valid
+ * until image_texture_free. */
+void image_texture_cache_deinit(void);
+
+/* image_texture_load through the cache. A non-zero max_width or
+ * max_height lets JPEGs be decoded scaled down, to no less than that.
+ * The pixels must be released with image_texture_free. */
+bool image_texture_load_cached(struct texture_image *img, const char *path,
+      unsigned max_width, unsigned max_height);
+
 /* Image transfer */
 
 void image_transfer_free(void *data, enum image_type_enum type);
@@ -87,6 +135,32 @@ void image_transfer_set_buffer_ptr(
       void *ptr,
       size_t len);
 
+/* Lets a format that can decode scaled down do so, to no less than
+ * width x height (0 for either leaves that side free). Only JPEGs
+ * are scaled; other formats are always decoded full size. */
+void image_transfer_set_scale_target(
+      void *data,
+      enum image_type_enum type,
+      unsigned width,
+      unsigned height);
+
+/* Reads the size the image will decode to, scale target included,
+ * from its headers. JPEG, BMP, TGA and QOI only. */
+bool image_transfer_get_size(void *data, enum image_type_enum type,
+      size_t len, unsigned *width, unsigned *height);
+
+/* Has the decoder write its final pixels as output describes, in one
+ * pass, rather than ARGB8888 in a buffer of its own. The pointer
+ * image_transfer_process hands back is then output->data, or the
+ * buffer it allocated. JPEG, BMP, TGA and QOI only; returns false
+ * for other formats. */
+bool image_transfer_set_output(void *data, enum image_type_enum type,
+      const struct image_output *output);
+
+/* Readies a decoder for another image, so it can be used again
+ * instead of freed and allocated anew. */
+void image_transfer_reset(void *data, enum image_type_enum type);
+
 int image_transfer_process(
       void *data,
       enum image_type_enum type,
@@ -97,6 +171,60 @@ bool image_transfer_iterate(void *data, enum image_type_enum type);
 
 bool image_transfer_is_valid(void *data, enum image_type_enum type);
 
+/* Batch decoding
+ *
+ * Decodes many images on a pool of threads. Each thread keeps one
+ * decoder per format and reuses it from image to image. Finished
+ * images are handed back in the order they complete. Without
+ * HAVE_THREADS, images are decoded one at a time by
+ * image_batch_poll and image_batch_wait. */
+
+typedef struct image_batch image_batch_t;
+
+struct image_batch_result
+{
+   struct texture_image image; /* Free with image_texture_free */
+   void *userdata;
+   uint32_t id;
+   bool success;
+};
+
+/* threads is the number of decoding threads; 0 for one per core */
+image_batch_t *image_batch_new(unsigned threads);
+
+/* Stops the threads. Images not taken yet are freed. */
+void image_batch_free(image_batch_t *batch);
+
+/* Queues path to be decoded, scaled down to no less than max_width x
+ * max_height where the format allows (0 for full size). The pixels
+ * come out as RGBA if supports_rgba is set, ARGB otherwise, as with
+ * image_texture_load. Returns an id for the image, or 0 on failure. */
+uint32_t image_batch_add_file(image_batch_t *batch, const char *path,
+      unsigned max_width, unsigned max_height, bool supports_rgba,
+      void *userdata);
+
+/* As image_batch_add_file, for an image already in memory. buf must
+ * stay valid until its result is taken or it is cancelled. */
+uint32_t image_batch_add_buffer(image_batch_t *batch,
+      enum image_type_enum type, const void *buf, size_t len,
+      unsigned max_width, unsigned max_height, bool supports_rgba,
+      void *userdata);
+
+/* Drops an image that is no longer needed, such as one scrolled off
+ * screen. Once this returns true, the image has no result and its
+ * buffer is no longer used. A file being decoded is left for its
+ * thread to drop, so this returns at once; an image in memory being
+ * decoded is waited for, though a PNG stops once its chunks are
+ * read. Returns false for unknown ids and images already taken. */
+bool image_batch_cancel(image_batch_t *batch, uint32_t id);
+
+/* Takes a finished image, if there is one. */
+bool image_batch_poll(image_batch_t *batch, struct image_batch_result *result);
+
+/* Takes a finished image, waiting for one if need be. Returns false
+ * once no images are left. */
+bool image_batch_wait(image_batch_t *batch, struct image_batch_result *result);
+
 RETRO_END_DECLS
 
 #endif
@@ -23,6 +23,9 @@
 #ifndef __LIBRETRO_SDK_FORMAT_RBMP_H__
 #define __LIBRETRO_SDK_FORMAT_RBMP_H__
 
+#include <stdint.h>
+#include <stddef.h>
+
 #include <retro_common_api.h>
 
 #include <boolean.h>
@@ -40,6 +43,8 @@ enum rbmp_source_type
 
 typedef struct rbmp rbmp_t;
 
+struct image_output;
+
 bool rbmp_save_image(
       const char *filename,
       const void *frame,
@@ -57,6 +62,14 @@ void form_bmp_header(uint8_t *header,
 
 bool rbmp_set_buf_ptr(rbmp_t *rbmp, void *data);
 
+/* Size of the image in the buffer */
+bool rbmp_get_size(rbmp_t *rbmp, size_t size,
+      unsigned *width, unsigned *height);
+
+/* Decode into output (see formats/image.h); NULL for a new
+ * ARGB8888 buffer */
+void rbmp_set_output(rbmp_t *rbmp, const struct image_output *output);
+
 void rbmp_free(rbmp_t *rbmp);
 
 rbmp_t *rbmp_alloc(void);
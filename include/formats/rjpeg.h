@@ -34,11 +34,31 @@ RETRO_BEGIN_DECLS
 
 typedef struct rjpeg rjpeg_t;
 
+struct image_output;
+
 int rjpeg_process_image(rjpeg_t *rjpeg, void **buf,
       size_t size, unsigned *width, unsigned *height);
 
 bool rjpeg_set_buf_ptr(rjpeg_t *rjpeg, void *data);
 
+/* Decodes at 1/denom of the size (1, 2, 4 or 8) with a reduced IDCT,
+ * instead of decoding in full and downscaling. The size returned by
+ * rjpeg_process_image is rounded up. */
+void rjpeg_set_scale_denom(rjpeg_t *rjpeg, unsigned denom);
+
+/* Picks the smallest scale, down to 1/8, that still covers
+ * width x height (either may be 0), for thumbnails. 0, 0 decodes
+ * at full size again. */
+void rjpeg_set_scale_target(rjpeg_t *rjpeg, unsigned width, unsigned height);
+
+/* Size of the image in the buffer, as it will be decoded */
+bool rjpeg_get_size(rjpeg_t *rjpeg, size_t size,
+      unsigned *width, unsigned *height);
+
+/* Decode into output (see formats/image.h); NULL for a new
+ * ARGB8888 buffer */
+void rjpeg_set_output(rjpeg_t *rjpeg, const struct image_output *output);
+
 void rjpeg_free(rjpeg_t *rjpeg);
 
 rjpeg_t *rjpeg_alloc(void);
@@ -44,6 +44,10 @@ rpng_t *rpng_alloc(void);
 
 void rpng_free(rpng_t *rpng);
 
+/* Readies rpng for another image, keeping the buffer the
+ * compressed data was gathered in. */
+void rpng_reset(rpng_t *rpng);
+
 bool rpng_iterate_image(rpng_t *rpng);
 
 int rpng_process_image(rpng_t *rpng,
@@ -51,6 +55,36 @@ int rpng_process_image(rpng_t *rpng,
 
 bool rpng_start(rpng_t *rpng);
 
+typedef struct rpng_stream rpng_stream_t;
+
+/* Gets each decoded row as ARGB8888, top to bottom. Rows of interlaced
+ * images only come once the last pass is in. Return false to stop. */
+typedef bool (*rpng_row_cb_t)(void *userdata, unsigned y,
+      const uint32_t *row, unsigned width);
+
+/* Incremental decoder, for files arriving in pieces of any size.
+ * Memory use depends on the image width, not on the file size, except
+ * that interlaced images without an output buffer hold a whole image. */
+rpng_stream_t *rpng_stream_new(void);
+
+void rpng_stream_free(rpng_stream_t *stream);
+
+/* Either or both of these must be set before the first IDAT chunk.
+ * The size is known once the first 33 bytes are pushed. */
+void rpng_stream_set_row_cb(rpng_stream_t *stream,
+      rpng_row_cb_t cb, void *userdata);
+void rpng_stream_set_output(rpng_stream_t *stream,
+      uint32_t *data, size_t pitch);
+
+bool rpng_stream_get_size(rpng_stream_t *stream,
+      unsigned *width, unsigned *height);
+
+/* Returns IMAGE_PROCESS_NEXT while more input is wanted,
+ * IMAGE_PROCESS_END once the image is done and IMAGE_PROCESS_ERROR
+ * if it is not a valid PNG. */
+int rpng_stream_push(rpng_stream_t *stream, const void *data, size_t len);
+
+/* These save at level 9, the smallest output. */
 bool rpng_save_image_argb(const char *path, const uint32_t *data,
       unsigned width, unsigned height, unsigned pitch);
 bool rpng_save_image_bgr24(const char *path, const uint8_t *data,
@@ -59,6 +93,18 @@ bool rpng_save_image_bgr24(const char *path, const uint8_t *data,
 uint8_t* rpng_save_image_bgr24_string(const uint8_t *data,
       unsigned width, unsigned height, signed pitch, uint64_t *bytes);
 
+/* The level sets how hard the encoder works, from 0 (fastest,
+ * uncompressed) to 9 (smallest). Level 1 uses a fixed filter and
+ * the fastest zlib level; 2 to 5 pick cheap filters per row. */
+bool rpng_save_image_argb_level(const char *path, const uint32_t *data,
+      unsigned width, unsigned height, unsigned pitch, int level);
+bool rpng_save_image_bgr24_level(const char *path, const uint8_t *data,
+      unsigned width, unsigned height, unsigned pitch, int level);
+
+uint8_t* rpng_save_image_bgr24_string_level(const uint8_t *data,
+      unsigned width, unsigned height, signed pitch, uint64_t *bytes,
+      int level);
+
 RETRO_END_DECLS
 
 #endif
@@ -0,0 +1,89 @@
+/* Copyright  (C) 2010-2020 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (rqoi.h).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef __LIBRETRO_SDK_FORMAT_RQOI_H__
+#define __LIBRETRO_SDK_FORMAT_RQOI_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <retro_common_api.h>
+
+#include <boolean.h>
+
+RETRO_BEGIN_DECLS
+
+/* QOI, the "Quite OK Image" format: lossless, with one pass over the
+ * pixels each way, so it encodes and decodes many times faster than
+ * PNG at a similar size for screenshots. */
+
+enum rqoi_source_type
+{
+   RQOI_SOURCE_TYPE_XRGB8888 = 0,
+   RQOI_SOURCE_TYPE_ARGB8888,
+   RQOI_SOURCE_TYPE_RGB565,
+   RQOI_SOURCE_TYPE_BGR24
+};
+
+typedef struct rqoi rqoi_t;
+
+struct image_output;
+
+int rqoi_process_image(rqoi_t *rqoi, void **buf,
+      size_t size, unsigned *width, unsigned *height);
+
+bool rqoi_set_buf_ptr(rqoi_t *rqoi, void *data);
+
+/* Size of the image in the buffer */
+bool rqoi_get_size(rqoi_t *rqoi, size_t size,
+      unsigned *width, unsigned *height);
+
+/* Decode into output (see formats/image.h); NULL for a new
+ * ARGB8888 buffer */
+void rqoi_set_output(rqoi_t *rqoi, const struct image_output *output);
+
+void rqoi_free(rqoi_t *rqoi);
+
+rqoi_t *rqoi_alloc(void);
+
+/* ARGB8888 frames keep their alpha; the others are saved as RGB */
+bool rqoi_save_image(
+      const char *filename,
+      const void *frame,
+      unsigned width,
+      unsigned height,
+      unsigned pitch,
+      enum rqoi_source_type type);
+
+/* As rqoi_save_image, to a buffer the caller frees */
+uint8_t *rqoi_save_image_string(
+      const void *frame,
+      unsigned width,
+      unsigned height,
+      unsigned pitch,
+      enum rqoi_source_type type,
+      uint64_t *bytes);
+
+RETRO_END_DECLS
+
+#endif
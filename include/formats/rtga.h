@@ -34,11 +34,21 @@ RETRO_BEGIN_DECLS
 
 typedef struct rtga rtga_t;
 
+struct image_output;
+
 int rtga_process_image(rtga_t *rtga, void **buf,
       size_t size, unsigned *width, unsigned *height);
 
 bool rtga_set_buf_ptr(rtga_t *rtga, void *data);
 
+/* Size of the image in the buffer */
+bool rtga_get_size(rtga_t *rtga, size_t size,
+      unsigned *width, unsigned *height);
+
+/* Decode into output (see formats/image.h); NULL for a new
+ * ARGB8888 buffer */
+void rtga_set_output(rtga_t *rtga, const struct image_output *output);
+
 void rtga_free(rtga_t *rtga);
 
 rtga_t *rtga_alloc(void);
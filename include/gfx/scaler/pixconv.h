@@ -23,12 +23,114 @@
 #ifndef __LIBRETRO_SDK_SCALER_PIXCONV_H__
 #define __LIBRETRO_SDK_SCALER_PIXCONV_H__
 
+#include <stdint.h>
+
 #include <clamping.h>
+#include <retro_inline.h>
 
 #include <retro_common_api.h>
 
 RETRO_BEGIN_DECLS
 
+/* Single pixel conversions. The conv_* functions give the same bytes
+ * as these for every input, whichever SIMD path they take. */
+
+static INLINE uint16_t pixconv_rgb565_to_0rgb1555(uint16_t col)
+{
+   uint16_t hi = (col >> 1) & 0x7fe0;
+   uint16_t lo = col & 0x1f;
+   return hi | lo;
+}
+
+static INLINE uint16_t pixconv_0rgb1555_to_rgb565(uint16_t col)
+{
+   uint16_t rg   = (col << 1) & ((0x1f << 11) | (0x1f << 6));
+   uint16_t b    = col & 0x1f;
+   uint16_t glow = (col >> 4) & (1 << 5);
+   return rg | b | glow;
+}
+
+static INLINE uint32_t pixconv_0rgb1555_to_argb8888(uint32_t col)
+{
+   uint32_t r = (col >> 10) & 0x1f;
+   uint32_t g = (col >>  5) & 0x1f;
+   uint32_t b = (col >>  0) & 0x1f;
+   r          = (r << 3) | (r >> 2);
+   g          = (g << 3) | (g >> 2);
+   b          = (b << 3) | (b >> 2);
+   return (0xffu << 24) | (r << 16) | (g << 8) | (b << 0);
+}
+
+static INLINE uint32_t pixconv_rgb565_to_argb8888(uint32_t col)
+{
+   uint32_t r = (col >> 11) & 0x1f;
+   uint32_t g = (col >>  5) & 0x3f;
+   uint32_t b = (col >>  0) & 0x1f;
+   r          = (r << 3) | (r >> 2);
+   g          = (g << 2) | (g >> 4);
+   b          = (b << 3) | (b >> 2);
+   return (0xffu << 24) | (r << 16) | (g << 8) | (b << 0);
+}
+
+static INLINE uint32_t pixconv_rgba4444_to_argb8888(uint32_t col)
+{
+   uint32_t r = (col >> 12) & 0xf;
+   uint32_t g = (col >>  8) & 0xf;
+   uint32_t b = (col >>  4) & 0xf;
+   uint32_t a = (col >>  0) & 0xf;
+   r          = (r << 4) | r;
+   g          = (g << 4) | g;
+   b          = (b << 4) | b;
+   a          = (a << 4) | a;
+   return (a << 24) | (r << 16) | (g << 8) | (b << 0);
+}
+
+static INLINE uint16_t pixconv_rgba4444_to_rgb565(uint32_t col)
+{
+   uint32_t r = (col >> 12) & 0xf;
+   uint32_t g = (col >>  8) & 0xf;
+   uint32_t b = (col >>  4) & 0xf;
+   return (r << 12) | (g << 7) | (b << 1);
+}
+
+static INLINE uint16_t pixconv_argb8888_to_0rgb1555(uint32_t col)
+{
+   uint16_t r = (col >> 19) & 0x1f;
+   uint16_t g = (col >> 11) & 0x1f;
+   uint16_t b = (col >>  3) & 0x1f;
+   return (r << 10) | (g << 5) | (b << 0);
+}
+
+static INLINE uint16_t pixconv_argb8888_to_rgb565(uint32_t col)
+{
+   uint16_t r = (col >> 19) & 0x1f;
+   uint16_t g = (col >> 10) & 0x3f;
+   uint16_t b = (col >>  3) & 0x1f;
+   return (r << 11) | (g << 5) | (b << 0);
+}
+
+/* Keeps the top four bits of each channel */
+static INLINE uint16_t pixconv_argb8888_to_rgba4444(uint32_t col)
+{
+   uint16_t r = (col >> 20) & 0xf;
+   uint16_t g = (col >> 12) & 0xf;
+   uint16_t b = (col >>  4) & 0xf;
+   uint16_t a = (col >> 28) & 0xf;
+   return (r << 12) | (g << 8) | (b << 4) | a;
+}
+
+/* ARGB8888 <-> ABGR8888 */
+static INLINE uint32_t pixconv_swap_rb(uint32_t col)
+{
+   return ((col << 16) & 0xff0000) |
+      ((col >> 16) & 0xff) | (col & 0xff00ff00);
+}
+
+/* Picks the SIMD paths of the conv_* functions from the CPU. The
+ * first conversion does this too; scaler_ctx_gen_filter calls it so
+ * band workers start with it done. */
+void pixconv_init(void);
+
 void conv_0rgb1555_argb8888(void *output, const void *input,
       int width, int height,
       int out_stride, int in_stride);
@@ -48,9 +48,17 @@ enum scaler_type
    SCALER_TYPE_UNKNOWN = 0,
    SCALER_TYPE_POINT,
    SCALER_TYPE_BILINEAR,
-   SCALER_TYPE_SINC
+   SCALER_TYPE_SINC,
+   /* Box filter: each output pixel averages the input pixels it
+    * covers. Meant for downscaling; exact 2x and 4x reductions skip
+    * the filter passes. */
+   SCALER_TYPE_AREA,
+   /* Catmull-Rom cubic, widened when downscaling */
+   SCALER_TYPE_BICUBIC
 };
 
+struct scaler_pool;
+
 struct scaler_filter
 {
    int16_t *filter;
@@ -80,19 +88,13 @@ struct scaler_ctx
    void (*scaler_special)(const struct scaler_ctx*,
          void*, const void*, int, int, int, int, int, int);
 
-   void (*in_pixconv)(void*, const void*, int, int, int, int);
-   void (*out_pixconv)(void*, const void*, int, int, int, int);
    void (*direct_pixconv)(void*, const void*, int, int, int, int);
 
    bool unscaled;
    struct scaler_filter horiz, vert;
 
-   struct
-   {
-      uint32_t *frame;
-      int stride;
-   } input;
-
+   /* ARGB8888 rows after the horizontal pass, in 16-bit channels.
+    * The passes read in_fmt and write out_fmt themselves. */
    struct
    {
       uint64_t *frame;
@@ -101,15 +103,24 @@ struct scaler_ctx
       int stride;
    } scaled;
 
-   struct
-   {
-      uint32_t *frame;
-      int stride;
-   } output;
+   /* Number of horizontal output bands scaler_ctx_scale processes in
+    * parallel, read by scaler_ctx_gen_filter. 0 or 1 scales on the
+    * caller's thread. Only honoured with HAVE_THREADS. */
+   unsigned threads;
+   /* Worker threads and bands, owned by the context and kept
+    * across scaler_ctx_gen_filter calls. */
+   struct scaler_pool *pool;
 };
 
 bool scaler_ctx_gen_filter(struct scaler_ctx *ctx);
 
+/**
+ * scaler_ctx_gen_reset:
+ * @ctx          : pointer to scaler context object.
+ *
+ * Frees the filters and frames of @ctx, and stops its worker
+ * threads if it has any.
+ **/
 void scaler_ctx_gen_reset(struct scaler_ctx *ctx);
 
 /**
@@ -118,7 +129,10 @@ void scaler_ctx_gen_reset(struct scaler_ctx *ctx);
  * @output       : pointer to output image.
  * @input        : pointer to input image.
  *
- * Scales an input image to an output image.
+ * Scales an input image to an output image. With @ctx->threads
+ * above 1, the output is split into that many bands of rows, each
+ * with its own slice of the intermediate frame, and the bands are
+ * scaled on the context's worker threads and the caller's.
  **/
 void scaler_ctx_scale(struct scaler_ctx *ctx,
       void *output, const void *input);
@@ -29,18 +29,80 @@
 
 RETRO_BEGIN_DECLS
 
+/* Vertical passes, named by the format they write. All of them read
+ * the ARGB8888 intermediate in ctx->scaled. */
 void scaler_argb8888_vert(const struct scaler_ctx *ctx,
       void *output, int stride);
 
+void scaler_abgr8888_vert(const struct scaler_ctx *ctx,
+      void *output, int stride);
+
+void scaler_0rgb1555_vert(const struct scaler_ctx *ctx,
+      void *output, int stride);
+
+void scaler_rgb565_vert(const struct scaler_ctx *ctx,
+      void *output, int stride);
+
+void scaler_bgr24_vert(const struct scaler_ctx *ctx,
+      void *output, int stride);
+
+void scaler_rgba4444_vert(const struct scaler_ctx *ctx,
+      void *output, int stride);
+
+/* Horizontal passes, named by the format they read */
 void scaler_argb8888_horiz(const struct scaler_ctx *ctx,
       const void *input, int stride);
 
+void scaler_0rgb1555_horiz(const struct scaler_ctx *ctx,
+      const void *input, int stride);
+
+void scaler_rgb565_horiz(const struct scaler_ctx *ctx,
+      const void *input, int stride);
+
+void scaler_bgr24_horiz(const struct scaler_ctx *ctx,
+      const void *input, int stride);
+
+void scaler_rgba4444_horiz(const struct scaler_ctx *ctx,
+      const void *input, int stride);
+
+/* Passes for the area and bicubic filters, with 32-bit sums rounded
+ * once a pass. Horizontal reads ctx->in_fmt, vertical writes
+ * ctx->out_fmt; the intermediate is the same as above. */
+void scaler_wide_horiz(const struct scaler_ctx *ctx,
+      const void *input, int stride);
+
+void scaler_wide_vert(const struct scaler_ctx *ctx,
+      void *output, int stride);
+
+/* Reads ctx->in_fmt and writes ctx->out_fmt */
 void scaler_argb8888_point_special(const struct scaler_ctx *ctx,
       void *output, const void *input,
       int out_width, int out_height,
       int in_width, int in_height,
       int out_stride, int in_stride);
 
+/* Same mapping as scaler_argb8888_point_special, but only writes
+ * output rows [y, y + rows). @output and @input still point at the
+ * first row of their frames. */
+void scaler_argb8888_point_rows(const struct scaler_ctx *ctx,
+      void *output, const void *input,
+      int out_stride, int in_stride,
+      int y, int rows);
+
+/* Box averages for input exactly 2x or 4x the output on each axis.
+ * Reads ctx->in_fmt and writes ctx->out_fmt. */
+void scaler_argb8888_area_special(const struct scaler_ctx *ctx,
+      void *output, const void *input,
+      int out_width, int out_height,
+      int in_width, int in_height,
+      int out_stride, int in_stride);
+
+/* Output rows [y, y + rows) of scaler_argb8888_area_special */
+void scaler_argb8888_area_rows(const struct scaler_ctx *ctx,
+      void *output, const void *input,
+      int out_stride, int in_stride,
+      int y, int rows);
+
 RETRO_END_DECLS
 
 #endif
@@ -23,7 +23,7 @@
 /* helper class for reading from a bit buffer */
 struct bitstream
 {
-	uint32_t          buffer;       /* current bit accumulator */
+	uint64_t          buffer;       /* current bit accumulator */
 	int               bits;         /* number of bits in the accumulator */
 	const uint8_t *   read;         /* read pointer */
 	uint32_t          doffset;      /* byte offset within the data */
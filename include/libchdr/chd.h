@@ -199,6 +199,13 @@ extern "C" {
 #define CHDCOMPRESSION_ZLIB_PLUS	2
 #define CHDCOMPRESSION_AV			3
 
+#define CHD_MAKE_TAG(a,b,c,d)       (((a) << 24) | ((b) << 16) | ((c) << 8) | (d))
+
+/* V5 codecs with CD frontend */
+#define CHD_CODEC_CD_ZLIB CHD_MAKE_TAG('c','d','z','l')
+#define CHD_CODEC_CD_LZMA CHD_MAKE_TAG('c','d','l','z')
+#define CHD_CODEC_CD_FLAC CHD_MAKE_TAG('c','d','f','l')
+
 /* A/V codec configuration parameters */
 #define AV_CODEC_COMPRESS_CONFIG	1
 #define AV_CODEC_DECOMPRESS_CONFIG	2
@@ -243,6 +250,13 @@ extern "C" {
 #define CHD_OPEN_READ				1
 #define CHD_OPEN_READWRITE			2
 
+/* CHD precache modes */
+/* Mapping only applies to streams backed by a plain local file (not a
+ * frontend VFS); the file must not be truncated while it is mapped. */
+#define CHD_PRECACHE_AUTO			0	/* map the file if possible, else read it */
+#define CHD_PRECACHE_MMAP			1	/* map the file read-only, shared */
+#define CHD_PRECACHE_MALLOC			2	/* read the whole file into memory */
+
 /* error types */
 enum _chd_error
 {
@@ -283,6 +297,7 @@ typedef enum _chd_error chd_error;
 
 /* opaque types */
 typedef struct _chd_file chd_file;
+typedef struct _chd_writer chd_writer;
 
 /* extract header structure (NOT the on-disk header structure) */
 typedef struct _chd_header chd_header;
@@ -316,6 +331,17 @@ struct _chd_header
 	UINT32		obsolete_hunksize;			/* obsolete field -- do not use! */
 };
 
+/* structure for returning codec pool counters */
+typedef struct _chd_codec_pool_stats chd_codec_pool_stats;
+struct _chd_codec_pool_stats
+{
+	UINT32		created;					/* codec contexts initialized from scratch */
+	UINT32		reused;						/* codec contexts taken from the pool */
+	UINT32		freed;						/* codec contexts freed */
+	UINT32		in_use;						/* codec contexts held by open CHDs */
+	UINT32		idle;						/* codec contexts waiting in the pool */
+};
+
 /* structure for returning information about a verification pass */
 typedef struct _chd_verify_result chd_verify_result;
 struct _chd_verify_result
@@ -338,14 +364,30 @@ struct _chd_verify_result
 /* same as chd_create(), but accepts an already-opened core_file object */
 /* chd_error chd_create_file(core_file *file, UINT64 logicalbytes, UINT32 hunkbytes, UINT32 compression, chd_file *parent); */
 
+/* create a new V5 CHD file; hunks are handed over in order and compressed
+ * with the best of up to four codecs on 'threads' worker threads */
+chd_error chd_writer_create(const char *filename, UINT64 logicalbytes, UINT32 hunkbytes, UINT32 unitbytes, const UINT32 compression[4], int threads, chd_writer **writer);
+
+/* compress and append the next hunk */
+chd_error chd_writer_write(chd_writer *writer, const void *buffer);
+
+/* append a metadata entry, written out when the file is finished */
+chd_error chd_writer_add_metadata(chd_writer *writer, UINT32 metatag, const void *data, UINT32 datalen, UINT8 flags);
+
+/* flush the remaining hunks, write the map and metadata and close the file */
+chd_error chd_writer_close(chd_writer *writer);
+
 /* open an existing CHD file */
 chd_error chd_open_file(RFILE *file, int mode, chd_file *parent, chd_file **chd);
 
 chd_error chd_open(const char *filename, int mode, chd_file *parent, chd_file **chd);
 
-/* precache underlying file */
+/* precache underlying file (maps it when possible, else reads it) */
 chd_error chd_precache(chd_file *chd);
 
+/* precache underlying file using one of the CHD_PRECACHE_* modes */
+chd_error chd_precache_mode(chd_file *chd, int mode);
+
 /* close a CHD file */
 void chd_close(chd_file *chd);
 
@@ -372,6 +414,21 @@ chd_error chd_get_metadata(chd_file *chd, UINT32 searchtag, UINT32 searchindex,
 
 /* ----- codec interfaces ----- */
 
+/* keep the codec contexts of closed CHDs for reuse by later opens,
+ * on any thread; call before opening CHDs from several threads.
+ * At most 8 idle contexts are kept; chd_codec_pool_trim frees them
+ * sooner. The stats only count while the pool is active. */
+chd_error chd_codec_pool_init(void);
+
+/* free the pool; call once every CHD is closed */
+void chd_codec_pool_deinit(void);
+
+/* free the idle codec contexts held by the pool */
+void chd_codec_pool_trim(void);
+
+/* return the codec pool counters */
+void chd_codec_pool_get_stats(chd_codec_pool_stats *stats);
+
 /* set internal codec parameters */
 chd_error chd_codec_config(chd_file *chd, int param, void *config);
 
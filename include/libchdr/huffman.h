@@ -31,6 +31,11 @@ enum huffman_error
 	HUFFERR_TOO_MANY_CONTEXTS
 };
 
+/* index width of the multi-symbol lookup table */
+#define HUFFMAN_MULTI_BITS		12
+/* maximum number of symbols resolved by one multi-symbol probe */
+#define HUFFMAN_MULTI_SYMBOLS	3
+
 /***************************************************************************
  *  TYPE DEFINITIONS
  ***************************************************************************
@@ -48,6 +53,15 @@ struct node_t
 	uint8_t				numbits;	/* number of bits needed for this node */
 };
 
+/* a multi-symbol lookup entry: the codes packed at the front of
+ * HUFFMAN_MULTI_BITS bits of input */
+struct huffman_multi_entry
+{
+	uint16_t			symbol[HUFFMAN_MULTI_SYMBOLS];	/* decoded symbols, in stream order */
+	uint8_t				numbits[HUFFMAN_MULTI_SYMBOLS];	/* code length of each symbol */
+	uint8_t				count;		/* number of symbols resolved (at least 1) */
+};
+
 /* ======================> huffman_context_base */
 
 /* context class for decoding */
@@ -61,6 +75,7 @@ struct huffman_decoder
 	lookup_value *  	lookup;               /* pointer to the lookup table */
 	struct node_t *     huffnode;             /* array of nodes */
 	uint32_t *      	datahisto;            /* histogram of data values */
+	struct huffman_multi_entry * multi;       /* multi-symbol lookup table, or NULL */
 
 	/* array versions of the info we need */
 #if 0
@@ -77,6 +92,11 @@ void delete_huffman_decoder(struct huffman_decoder* decoder);
 /* single item operations */
 uint32_t huffman_decode_one(struct huffman_decoder* decoder, struct bitstream* bitbuf);
 
+/* multi-symbol operations; the caller consumes the symbols it
+ * needs from the entry with bitstream_remove() */
+enum huffman_error huffman_build_multi_table(struct huffman_decoder* decoder);
+const struct huffman_multi_entry *huffman_peek_multi(struct huffman_decoder* decoder, struct bitstream* bitbuf);
+
 enum huffman_error huffman_import_tree_rle(struct huffman_decoder* decoder, struct bitstream* bitbuf);
 enum huffman_error huffman_import_tree_huffman(struct huffman_decoder* decoder, struct bitstream* bitbuf);
 
@@ -50,7 +50,15 @@ typedef struct
    enum media_detect_cd_system system_id;
 } media_detect_cd_info_t;
 
-/* Fill in "info" with detected CD info. Use this when you want to open a specific track file directly, and the pregap is known. */
+/* Keeps detection results keyed by path and file size, so scanning the same images again reads nothing but their size.
+ * Call once before detecting from several threads. */
+bool media_detect_cd_cache_init(void);
+
+/* Frees the cached detection results. */
+void media_detect_cd_cache_deinit(void);
+
+/* Fill in "info" with detected CD info. Fields that do not apply to the detected system, or all of them if no system is recognized, are left empty.
+ * Use this when you want to open a specific track file directly, and the pregap is known. */
 bool media_detect_cd_info(const char *path, uint64_t pregap_bytes, media_detect_cd_info_t *info);
 
 /* Fill in "info" with detected CD info. Use this when you have a cue file and want it parsed to find the first data track and any pregap info. */
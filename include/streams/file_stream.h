@@ -110,6 +110,11 @@ char* filestream_getline(RFILE *stream);
 
 libretro_vfs_implementation_file* filestream_get_vfs_handle(RFILE *stream);
 
+/* Returns the descriptor of a stream backed by a plain local file,
+ * or -1 if the stream goes through a frontend VFS or a special
+ * scheme (e.g. cdrom). The descriptor stays owned by the stream. */
+int filestream_get_fd(RFILE *stream);
+
 RETRO_END_DECLS
 
 #endif
@@ -53,6 +53,7 @@ typedef struct
    unsigned last_frame_lba;
    unsigned char last_frame[2352];
    bool last_frame_valid;
+   struct cdrom_readahead *readahead;
 } vfs_cdrom_t;
 #endif
 
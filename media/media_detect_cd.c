@@ -26,8 +26,88 @@
 #include <file/file_path.h>
 #include <retro_miscellaneous.h>
 
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
+#include <stddef.h>
+
 /*#define MEDIA_CUE_PARSE_DEBUG*/
 
+/* Every signature lies within the first two sectors of the data track,
+ * except the ISO9660 volume descriptor in sector 16. */
+#define MEDIA_DETECT_CD_HEADER_BYTES (2 * 2352)
+#define MEDIA_DETECT_CD_PVD_BYTES    128
+
+#define MEDIA_DETECT_CD_CACHE_BUCKETS 256
+#define MEDIA_DETECT_CD_CACHE_CHAIN   16
+
+typedef struct
+{
+   unsigned offset;
+   unsigned len;
+   size_t field;
+   size_t field_size;
+} media_detect_cd_field_t;
+
+#define MEDIA_DETECT_CD_FIELD(offset, len, name) { offset, len, offsetof(media_detect_cd_info_t, name), sizeof(((media_detect_cd_info_t*)0)->name) }
+#define MEDIA_DETECT_CD_NO_FIELD { 0, 0, 0, 0 }
+
+typedef struct
+{
+   const char *magic;
+   unsigned magic_len;
+   unsigned offset;
+   enum media_detect_cd_system system_id;
+   const char *system;
+   media_detect_cd_field_t fields[4];
+} media_detect_cd_signature_t;
+
+/* Matched against the start of the user data, in order of precedence. */
+static const media_detect_cd_signature_t media_detect_cd_header_signatures[] = {
+   /* All discs currently in Redump for MCD start with SEGADISCSYSTEM. There are other strings mentioned elsewhere online,
+    * but I have not seen any real examples of them. */
+   { "SEGADISCSYSTEM", 14, 0, MEDIA_CD_SYSTEM_MEGA_CD, "Sega CD / Mega CD",
+      { MEDIA_DETECT_CD_FIELD(0x150, 48, title), MEDIA_DETECT_CD_FIELD(0x183, 8, serial),
+        MEDIA_DETECT_CD_NO_FIELD, MEDIA_DETECT_CD_NO_FIELD } },
+   { "SEGA SEGASATURN", 15, 0, MEDIA_CD_SYSTEM_SATURN, "Sega Saturn",
+      { MEDIA_DETECT_CD_FIELD(0x60, 112, title), MEDIA_DETECT_CD_FIELD(0x20, 10, serial),
+        MEDIA_DETECT_CD_FIELD(0x2a, 6, version), MEDIA_DETECT_CD_FIELD(0x30, 8, release_date) } },
+   { "SEGA SEGAKATANA", 15, 0, MEDIA_CD_SYSTEM_DREAMCAST, "Sega Dreamcast",
+      { MEDIA_DETECT_CD_FIELD(0x80, 96, title), MEDIA_DETECT_CD_FIELD(0x40, 10, serial),
+        MEDIA_DETECT_CD_FIELD(0x4a, 6, version), MEDIA_DETECT_CD_FIELD(0x50, 8, release_date) } },
+   { "\x01\x5a\x5a\x5a\x5a\x5a\x01\x00\x00\x00\x00\x00", 12, 0, MEDIA_CD_SYSTEM_3DO, "3DO",
+      { MEDIA_DETECT_CD_NO_FIELD, MEDIA_DETECT_CD_NO_FIELD, MEDIA_DETECT_CD_NO_FIELD, MEDIA_DETECT_CD_NO_FIELD } },
+   { "PC Engine CD-ROM SYSTEM", 23, 0x950, MEDIA_CD_SYSTEM_PC_ENGINE_CD, "TurboGrafx-CD / PC-Engine CD",
+      { MEDIA_DETECT_CD_NO_FIELD, MEDIA_DETECT_CD_NO_FIELD, MEDIA_DETECT_CD_NO_FIELD, MEDIA_DETECT_CD_NO_FIELD } },
+};
+
+/* Matched against the user data of sector 16, the Primary Volume Descriptor of ISO9660. */
+static const media_detect_cd_signature_t media_detect_cd_pvd_signatures[] = {
+   { "\1CD001\1\0PLAYSTATION", 19, 0, MEDIA_CD_SYSTEM_PSX, "Sony PlayStation",
+      { MEDIA_DETECT_CD_FIELD(40, 32, title), MEDIA_DETECT_CD_NO_FIELD,
+        MEDIA_DETECT_CD_NO_FIELD, MEDIA_DETECT_CD_NO_FIELD } },
+};
+
+/* Detection results, keyed by path and file size. Cue sheets keep the
+ * data track they point at, whose result has an entry of its own. */
+typedef struct media_detect_cd_cache_entry
+{
+   struct media_detect_cd_cache_entry *next;
+   char *path;
+   char *track_path;
+   uint64_t pregap_bytes;
+   int32_t size;
+   bool cue;
+   media_detect_cd_info_t info;
+} media_detect_cd_cache_entry_t;
+
+static bool media_detect_cd_cache_active = false;
+static media_detect_cd_cache_entry_t *media_detect_cd_cache[MEDIA_DETECT_CD_CACHE_BUCKETS];
+#ifdef HAVE_THREADS
+static slock_t *media_detect_cd_cache_lock = NULL;
+#endif
+
 static void media_zero_trailing_spaces(char *buf, size_t len)
 {
    int i;
@@ -65,21 +145,21 @@ static bool media_skip_spaces(const char **buf, size_t len)
    return false;
 }
 
-/* Fill in "info" with detected CD info. Use this when you have a cue file and want it parsed to find the first data track and any pregap info. */
-bool media_detect_cd_info_cue(const char *path, media_detect_cd_info_t *info)
+/* Finds the file of the first data track in a cue sheet and the pregap in front of it.
+ * track_abs_path is left empty if the sheet has no data track. */
+static bool media_detect_cd_parse_cue(const char *path, char *track_abs_path, size_t track_abs_path_size, uint64_t *pregap_bytes)
 {
    RFILE *file = NULL;
    char *line = NULL;
    char track_path[PATH_MAX_LENGTH] = {0};
-   char track_abs_path[PATH_MAX_LENGTH] = {0};
    char track_mode[11] = {0};
    bool found_file = false;
    bool found_track = false;
    unsigned first_data_track = 0;
    uint64_t data_track_pregap_bytes = 0;
 
-   if (string_is_empty(path) || !info)
-      return false;
+   track_abs_path[0] = '\0';
+   *pregap_bytes     = 0;
 
    file = filestream_open(path, RETRO_VFS_FILE_ACCESS_READ, 0);
 
@@ -226,6 +306,7 @@ bool media_detect_cd_info_cue(const char *path, media_detect_cd_info_t *info)
                               printf("Found pregap of %02d:%02d:%02d (bytes: %" PRIu64 ")\n", min, sec, frame, data_track_pregap_bytes);
                               fflush(stdout);
 #endif
+                              free(line);
                               break;
                            }
                         }
@@ -241,36 +322,101 @@ bool media_detect_cd_info_cue(const char *path, media_detect_cd_info_t *info)
 
    filestream_close(file);
 
+   *pregap_bytes = data_track_pregap_bytes;
+
    if (!string_is_empty(track_path))
    {
       if (strstr(track_path, "/") || strstr(track_path, "\\"))
       {
          printf("using path %s\n", track_path);
          fflush(stdout);
-         return media_detect_cd_info(track_path, data_track_pregap_bytes, info);
+         strlcpy(track_abs_path, track_path, track_abs_path_size);
       }
       else
       {
-         fill_pathname_basedir(track_abs_path, path, sizeof(track_abs_path));
-         strlcat(track_abs_path, track_path, sizeof(track_abs_path));
+         fill_pathname_basedir(track_abs_path, path, track_abs_path_size);
+         strlcat(track_abs_path, track_path, track_abs_path_size);
          printf("using abs path %s\n", track_abs_path);
          fflush(stdout);
-         return media_detect_cd_info(track_abs_path, data_track_pregap_bytes, info);
       }
    }
 
    return true;
 }
 
-/* Fill in "info" with detected CD info. Use this when you want to open a specific track file directly, and the pregap is known. */
-bool media_detect_cd_info(const char *path, uint64_t pregap_bytes, media_detect_cd_info_t *info)
+static uint32_t media_detect_cd_hash(const char *s)
 {
-   RFILE *file;
+   uint32_t hash = 5381;
+   while (*s)
+      hash = (hash << 5) + hash + (uint8_t)*s++;
+   return hash;
+}
 
-   if (string_is_empty(path) || !info)
-      return false;
+/* Returns the first signature found in data. Signatures sit at fixed offsets,
+ * so a single pass over the table with a first byte test rejects almost all
+ * of them without a full compare. */
+static const media_detect_cd_signature_t *media_detect_cd_match(
+      const media_detect_cd_signature_t *signatures, size_t count,
+      const char *data, size_t len)
+{
+   size_t i;
 
-   file = filestream_open(path, RETRO_VFS_FILE_ACCESS_READ, 0);
+   for (i = 0; i < count; i++)
+   {
+      const media_detect_cd_signature_t *sig = &signatures[i];
+
+      if (sig->offset + sig->magic_len > len || data[sig->offset] != sig->magic[0])
+         continue;
+
+      if (!memcmp(data + sig->offset + 1, sig->magic + 1, sig->magic_len - 1))
+         return sig;
+   }
+
+   return NULL;
+}
+
+static void media_detect_cd_copy_fields(const media_detect_cd_signature_t *sig,
+      const char *data, media_detect_cd_info_t *info)
+{
+   unsigned i;
+
+   info->system_id = sig->system_id;
+   strlcpy(info->system, sig->system, sizeof(info->system));
+
+   for (i = 0; i < ARRAY_SIZE(sig->fields); i++)
+   {
+      const media_detect_cd_field_t *field = &sig->fields[i];
+      const char *start = data + field->offset;
+      const char *pos   = start;
+      char *dst         = (char*)info + field->field;
+      size_t len;
+
+      if (!field->len)
+         continue;
+
+      if (!media_skip_spaces(&pos, field->len))
+      {
+         strlcpy(dst, "N/A", field->field_size);
+         continue;
+      }
+
+      len = field->len - (pos - start);
+      memcpy(dst, pos, len);
+      dst[len] = '\0';
+      media_zero_trailing_spaces(dst, len);
+   }
+}
+
+static bool media_detect_cd_read(const char *path, uint64_t pregap_bytes, media_detect_cd_info_t *info)
+{
+   const media_detect_cd_signature_t *sig = NULL;
+   const char *data = NULL;
+   char pvd[MEDIA_DETECT_CD_PVD_BYTES];
+   unsigned offset = 0;
+   unsigned sector_size = 0;
+   int64_t read_bytes = 0;
+   char *buf = NULL;
+   RFILE *file = filestream_open(path, RETRO_VFS_FILE_ACCESS_READ, 0);
 
    if (!file)
    {
@@ -279,232 +425,350 @@ bool media_detect_cd_info(const char *path, uint64_t pregap_bytes, media_detect_
       return false;
    }
 
+   buf = (char*)calloc(1, MEDIA_DETECT_CD_HEADER_BYTES);
+
+   if (!buf)
    {
-      unsigned offset = 0;
-      unsigned sector_size = 0;
-      unsigned buf_size = 17 * 2352;
-      char *buf = (char*)calloc(1, buf_size);
-      int64_t read_bytes = 0;
+      filestream_close(file);
+      return false;
+   }
 
-      if (!buf)
-         return false;
+   if (pregap_bytes)
+      filestream_seek(file, pregap_bytes, RETRO_VFS_SEEK_POSITION_START);
 
-      if (pregap_bytes)
-         filestream_seek(file, pregap_bytes, RETRO_VFS_SEEK_POSITION_START);
+   read_bytes = filestream_read(file, buf, MEDIA_DETECT_CD_HEADER_BYTES);
 
-      read_bytes = filestream_read(file, buf, buf_size);
+   if (read_bytes < 2048)
+   {
+      printf("[MEDIA] Could not read from media: got %" PRId64 " bytes instead of %d.\n", read_bytes, MEDIA_DETECT_CD_HEADER_BYTES);
+      fflush(stdout);
+      filestream_close(file);
+      free(buf);
+      return false;
+   }
 
-      if (read_bytes != buf_size)
-      {
-         printf("[MEDIA] Could not read from media: got %" PRId64 " bytes instead of %d.\n", read_bytes, buf_size);
-         fflush(stdout);
-         filestream_close(file);
-         free(buf);
-         return false;
-      }
+   /* 12-byte sync field at the start of every sector, common to both mode1 and mode2 data tracks
+    * (when at least sync data is requested). This is a CD-ROM standard feature and not specific to any game devices,
+    * and as such should not be part of any system-specific detection or "magic" bytes.
+    * Depending on what parts of a sector were requested from the disc, the user data might start at
+    * byte offset 0, 4, 8, 12, 16 or 24. Cue sheets only specify the total number of bytes requested from the sectors
+    * of a track (like 2048 or 2352) and it is then assumed based on the size/mode as to what fields are present. */
+   if (!memcmp(buf, "\x00\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\x00", 12))
+   {
+      /* Assume track data contains all fields. */
+      sector_size = 2352;
 
-      /* 12-byte sync field at the start of every sector, common to both mode1 and mode2 data tracks
-       * (when at least sync data is requested). This is a CD-ROM standard feature and not specific to any game devices,
-       * and as such should not be part of any system-specific detection or "magic" bytes.
-       * Depending on what parts of a sector were requested from the disc, the user data might start at
-       * byte offset 0, 4, 8, 12, 16 or 24. Cue sheets only specify the total number of bytes requested from the sectors
-       * of a track (like 2048 or 2352) and it is then assumed based on the size/mode as to what fields are present. */
-      if (!memcmp(buf, "\x00\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\x00", 12))
+      if (buf[15] == 2)
       {
-         /* Assume track data contains all fields. */
-         sector_size = 2352;
-
-         if (buf[15] == 2)
-         {
-            /* assume Mode 2 formed (formless is rarely used) */
-            offset = 24;
-         }
-         else
-         {
-            /* assume Mode 1 */
-            offset = 16;
-         }
+         /* assume Mode 2 formed (formless is rarely used) */
+         offset = 24;
       }
       else
       {
-         /* Assume sectors only contain user data instead. */
-         offset = 0;
-         sector_size = 2048;
+         /* assume Mode 1 */
+         offset = 16;
       }
+   }
+   else
+   {
+      /* Assume sectors only contain user data instead. */
+      offset = 0;
+      sector_size = 2048;
+   }
+
+   data = buf + offset;
+   sig  = media_detect_cd_match(media_detect_cd_header_signatures,
+         ARRAY_SIZE(media_detect_cd_header_signatures), data, (size_t)read_bytes - offset);
+
+   /* Only ISO9660 discs get this far, so read just the start of their volume descriptor */
+   if (!sig)
+   {
+      filestream_seek(file, pregap_bytes + 16 * sector_size + offset, RETRO_VFS_SEEK_POSITION_START);
+      read_bytes = filestream_read(file, pvd, sizeof(pvd));
 
-      if (!memcmp(buf + offset, "SEGADISCSYSTEM", strlen("SEGADISCSYSTEM")))
+      if (read_bytes > 0)
       {
-         const char *title_pos;
-         const char *serial_pos;
-         bool title_found = false;
+         data = pvd;
+         sig  = media_detect_cd_match(media_detect_cd_pvd_signatures,
+               ARRAY_SIZE(media_detect_cd_pvd_signatures), data, (size_t)read_bytes);
+      }
+   }
 
-         /* All discs currently in Redump for MCD start with SEGADISCSYSTEM. There are other strings mentioned elsewhere online,
-          * but I have not seen any real examples of them. */
-         info->system_id = MEDIA_CD_SYSTEM_MEGA_CD;
+   if (sig)
+      media_detect_cd_copy_fields(sig, data, info);
 
-         strlcpy(info->system, "Sega CD / Mega CD", sizeof(info->system));
+   free(buf);
+   filestream_close(file);
 
-         title_pos = buf + offset + 0x150;
+   return true;
+}
 
-         if (media_skip_spaces(&title_pos, 48))
-         {
-            memcpy(info->title, title_pos, 48 - (title_pos - (buf + offset + 0x150)));
-            media_zero_trailing_spaces(info->title, sizeof(info->title));
-         }
-         else
-            strlcpy(info->title, "N/A", sizeof(info->title));
+static void media_detect_cd_cache_entry_free(media_detect_cd_cache_entry_t *entry)
+{
+   free(entry->path);
+   free(entry->track_path);
+   free(entry);
+}
 
-         serial_pos = buf + offset + 0x183;
+/* Must be called with the cache locked. Moves a hit to the front of its bucket. */
+static media_detect_cd_cache_entry_t *media_detect_cd_cache_lookup(const char *path,
+      int32_t size, uint64_t pregap_bytes, bool cue)
+{
+   media_detect_cd_cache_entry_t **bucket = &media_detect_cd_cache[
+      media_detect_cd_hash(path) % MEDIA_DETECT_CD_CACHE_BUCKETS];
+   media_detect_cd_cache_entry_t *entry, *prev = NULL;
 
-         if (media_skip_spaces(&serial_pos, 8))
-         {
-            memcpy(info->serial, serial_pos, 8 - (serial_pos - (buf + offset + 0x183)));
-            media_zero_trailing_spaces(info->serial, sizeof(info->serial));
-         }
-         else
-            strlcpy(info->serial, "N/A", sizeof(info->serial));
-      }
-      else if (!memcmp(buf + offset, "SEGA SEGASATURN", strlen("SEGA SEGASATURN")))
+   for (entry = *bucket; entry; prev = entry, entry = entry->next)
+   {
+      if (entry->cue != cue || entry->size != size || !string_is_equal(entry->path, path))
+         continue;
+
+      if (!cue && entry->pregap_bytes != pregap_bytes)
+         continue;
+
+      if (prev)
       {
-         const char *title_pos;
-         const char *serial_pos;
-         const char *version_pos;
-         const char *release_date_pos;
-         bool title_found = false;
+         prev->next  = entry->next;
+         entry->next = *bucket;
+         *bucket     = entry;
+      }
 
-         info->system_id = MEDIA_CD_SYSTEM_SATURN;
+      return entry;
+   }
 
-         strlcpy(info->system, "Sega Saturn", sizeof(info->system));
+   return NULL;
+}
 
-         title_pos = buf + offset + 0x60;
+static bool media_detect_cd_cache_find_track(const char *path, int32_t size,
+      uint64_t pregap_bytes, media_detect_cd_info_t *info)
+{
+   media_detect_cd_cache_entry_t *entry;
 
-         if (media_skip_spaces(&title_pos, 112))
-         {
-            memcpy(info->title, title_pos, 112 - (title_pos - (buf + offset + 0x60)));
-            media_zero_trailing_spaces(info->title, sizeof(info->title));
-         }
-         else
-            strlcpy(info->title, "N/A", sizeof(info->title));
+#ifdef HAVE_THREADS
+   slock_lock(media_detect_cd_cache_lock);
+#endif
+   entry = media_detect_cd_cache_lookup(path, size, pregap_bytes, false);
+   if (entry)
+      memcpy(info, &entry->info, sizeof(*info));
+#ifdef HAVE_THREADS
+   slock_unlock(media_detect_cd_cache_lock);
+#endif
 
-         serial_pos = buf + offset + 0x20;
+   return entry != NULL;
+}
 
-         if (media_skip_spaces(&serial_pos, 10))
-         {
-            memcpy(info->serial, serial_pos, 10 - (serial_pos - (buf + offset + 0x20)));
-            media_zero_trailing_spaces(info->serial, sizeof(info->serial));
-         }
-         else
-            strlcpy(info->serial, "N/A", sizeof(info->serial));
+static bool media_detect_cd_cache_find_cue(const char *path, int32_t size,
+      char *track_path, size_t track_path_size, uint64_t *pregap_bytes)
+{
+   media_detect_cd_cache_entry_t *entry;
 
-         version_pos = buf + offset + 0x2a;
+#ifdef HAVE_THREADS
+   slock_lock(media_detect_cd_cache_lock);
+#endif
+   entry = media_detect_cd_cache_lookup(path, size, 0, true);
+   if (entry)
+   {
+      strlcpy(track_path, entry->track_path, track_path_size);
+      *pregap_bytes = entry->pregap_bytes;
+   }
+#ifdef HAVE_THREADS
+   slock_unlock(media_detect_cd_cache_lock);
+#endif
 
-         if (media_skip_spaces(&version_pos, 6))
-         {
-            memcpy(info->version, version_pos, 6 - (version_pos - (buf + offset + 0x2a)));
-            media_zero_trailing_spaces(info->version, sizeof(info->version));
-         }
-         else
-            strlcpy(info->version, "N/A", sizeof(info->version));
+   return entry != NULL;
+}
 
-         release_date_pos = buf + offset + 0x30;
+/* Replaces any older result for the same file. A cue sheet passes the
+ * data track it points at, a data track passes its detected info. */
+static void media_detect_cd_cache_insert(const char *path, int32_t size,
+      uint64_t pregap_bytes, const char *track_path, const media_detect_cd_info_t *info)
+{
+   media_detect_cd_cache_entry_t **bucket;
+   media_detect_cd_cache_entry_t *entry, *iter, *prev = NULL;
+   media_detect_cd_cache_entry_t *drop = NULL;
+   unsigned n = 1;
+
+   entry = (media_detect_cd_cache_entry_t*)calloc(1, sizeof(*entry));
+   if (!entry)
+      return;
+
+   entry->path         = strdup(path);
+   entry->track_path   = track_path ? strdup(track_path) : NULL;
+   entry->pregap_bytes = pregap_bytes;
+   entry->size         = size;
+   entry->cue          = track_path != NULL;
+   if (info)
+      memcpy(&entry->info, info, sizeof(*info));
+
+   if (!entry->path || (track_path && !entry->track_path))
+   {
+      media_detect_cd_cache_entry_free(entry);
+      return;
+   }
 
-         if (media_skip_spaces(&release_date_pos, 8))
-         {
-            memcpy(info->release_date, release_date_pos, 8 - (release_date_pos - (buf + offset + 0x30)));
-            media_zero_trailing_spaces(info->release_date, sizeof(info->release_date));
-         }
-         else
-            strlcpy(info->release_date, "N/A", sizeof(info->release_date));
-      }
-      else if (!memcmp(buf + offset, "SEGA SEGAKATANA", strlen("SEGA SEGAKATANA")))
-      {
-         const char *title_pos;
-         const char *serial_pos;
-         const char *version_pos;
-         const char *release_date_pos;
-         bool title_found = false;
+#ifdef HAVE_THREADS
+   if (!media_detect_cd_cache_lock)
+   {
+      media_detect_cd_cache_entry_free(entry);
+      return;
+   }
+   slock_lock(media_detect_cd_cache_lock);
+#endif
 
-         info->system_id = MEDIA_CD_SYSTEM_DREAMCAST;
+   if (!media_detect_cd_cache_active)
+   {
+#ifdef HAVE_THREADS
+      slock_unlock(media_detect_cd_cache_lock);
+#endif
+      media_detect_cd_cache_entry_free(entry);
+      return;
+   }
 
-         strlcpy(info->system, "Sega Dreamcast", sizeof(info->system));
+   bucket = &media_detect_cd_cache[media_detect_cd_hash(path) % MEDIA_DETECT_CD_CACHE_BUCKETS];
 
-         title_pos = buf + offset + 0x80;
+   for (iter = *bucket; iter; prev = iter, iter = iter->next)
+   {
+      if (iter->cue != entry->cue || !string_is_equal(iter->path, path))
+         continue;
 
-         if (media_skip_spaces(&title_pos, 96))
-         {
-            memcpy(info->title, title_pos, 96 - (title_pos - (buf + offset + 0x80)));
-            media_zero_trailing_spaces(info->title, sizeof(info->title));
-         }
-         else
-            strlcpy(info->title, "N/A", sizeof(info->title));
+      if (!entry->cue && iter->pregap_bytes != pregap_bytes)
+         continue;
 
-         serial_pos = buf + offset + 0x40;
+      if (prev)
+         prev->next = iter->next;
+      else
+         *bucket    = iter->next;
+      iter->next = NULL;
+      drop       = iter;
+      break;
+   }
 
-         if (media_skip_spaces(&serial_pos, 10))
-         {
-            memcpy(info->serial, serial_pos, 10 - (serial_pos - (buf + offset + 0x40)));
-            media_zero_trailing_spaces(info->serial, sizeof(info->serial));
-         }
+   entry->next = *bucket;
+   *bucket     = entry;
+
+   /* least recently used entries fall off the end of a long bucket */
+   for (iter = *bucket; iter; iter = iter->next, n++)
+   {
+      if (n == MEDIA_DETECT_CD_CACHE_CHAIN)
+      {
+         if (drop)
+            drop->next = iter->next;
          else
-            strlcpy(info->serial, "N/A", sizeof(info->serial));
+            drop       = iter->next;
+         iter->next = NULL;
+         break;
+      }
+   }
 
-         version_pos = buf + offset + 0x4a;
+#ifdef HAVE_THREADS
+   slock_unlock(media_detect_cd_cache_lock);
+#endif
 
-         if (media_skip_spaces(&version_pos, 6))
-         {
-            memcpy(info->version, version_pos, 6 - (version_pos - (buf + offset + 0x4a)));
-            media_zero_trailing_spaces(info->version, sizeof(info->version));
-         }
-         else
-            strlcpy(info->version, "N/A", sizeof(info->version));
+   while (drop)
+   {
+      media_detect_cd_cache_entry_t *next = drop->next;
+      media_detect_cd_cache_entry_free(drop);
+      drop = next;
+   }
+}
 
-         release_date_pos = buf + offset + 0x50;
+bool media_detect_cd_cache_init(void)
+{
+   if (media_detect_cd_cache_active)
+      return true;
 
-         if (media_skip_spaces(&release_date_pos, 8))
-         {
-            memcpy(info->release_date, release_date_pos, 8 - (release_date_pos - (buf + offset + 0x50)));
-            media_zero_trailing_spaces(info->release_date, sizeof(info->release_date));
-         }
-         else
-            strlcpy(info->release_date, "N/A", sizeof(info->release_date));
-      }
-      /* Primary Volume Descriptor fields of ISO9660 */
-      else if (!memcmp(buf + offset + (16 * sector_size), "\1CD001\1\0PLAYSTATION", 19))
-      {
-         const char *title_pos = NULL;
-         bool title_found      = false;
+#ifdef HAVE_THREADS
+   media_detect_cd_cache_lock = slock_new();
+   if (!media_detect_cd_cache_lock)
+      return false;
+#endif
+   media_detect_cd_cache_active = true;
+   return true;
+}
 
-         info->system_id = MEDIA_CD_SYSTEM_PSX;
+void media_detect_cd_cache_deinit(void)
+{
+   unsigned i;
 
-         strlcpy(info->system, "Sony PlayStation", sizeof(info->system));
+   if (!media_detect_cd_cache_active)
+      return;
 
-         title_pos = buf + offset + (16 * sector_size) + 40;
+#ifdef HAVE_THREADS
+   slock_lock(media_detect_cd_cache_lock);
+#endif
+   media_detect_cd_cache_active = false;
+#ifdef HAVE_THREADS
+   slock_unlock(media_detect_cd_cache_lock);
+   slock_free(media_detect_cd_cache_lock);
+   media_detect_cd_cache_lock = NULL;
+#endif
 
-         if (media_skip_spaces(&title_pos, 32))
-         {
-            memcpy(info->title, title_pos, 32 - (title_pos - (buf + offset + (16 * sector_size) + 40)));
-            media_zero_trailing_spaces(info->title, sizeof(info->title));
-         }
-         else
-            strlcpy(info->title, "N/A", sizeof(info->title));
-      }
-      else if (!memcmp(buf + offset, "\x01\x5a\x5a\x5a\x5a\x5a\x01\x00\x00\x00\x00\x00", 12))
-      {
-         info->system_id = MEDIA_CD_SYSTEM_3DO;
+   for (i = 0; i < MEDIA_DETECT_CD_CACHE_BUCKETS; i++)
+   {
+      media_detect_cd_cache_entry_t *entry = media_detect_cd_cache[i];
 
-         strlcpy(info->system, "3DO", sizeof(info->system));
-      }
-      else if (!memcmp(buf + offset + 0x950, "PC Engine CD-ROM SYSTEM", 23))
+      while (entry)
       {
-         info->system_id = MEDIA_CD_SYSTEM_PC_ENGINE_CD;
-
-         strlcpy(info->system, "TurboGrafx-CD / PC-Engine CD", sizeof(info->system));
+         media_detect_cd_cache_entry_t *next = entry->next;
+         media_detect_cd_cache_entry_free(entry);
+         entry = next;
       }
 
-      free(buf);
+      media_detect_cd_cache[i] = NULL;
    }
+}
 
-   filestream_close(file);
+/* Fill in "info" with detected CD info. Use this when you have a cue file and want it parsed to find the first data track and any pregap info. */
+bool media_detect_cd_info_cue(const char *path, media_detect_cd_info_t *info)
+{
+   char track_path[PATH_MAX_LENGTH];
+   uint64_t pregap_bytes = 0;
+   int32_t size = -1;
+
+   if (string_is_empty(path) || !info)
+      return false;
+
+   if (media_detect_cd_cache_active)
+      size = path_get_size(path);
+
+   if (size < 0 || !media_detect_cd_cache_find_cue(path, size, track_path, sizeof(track_path), &pregap_bytes))
+   {
+      if (!media_detect_cd_parse_cue(path, track_path, sizeof(track_path), &pregap_bytes))
+         return false;
+
+      if (size >= 0)
+         media_detect_cd_cache_insert(path, size, pregap_bytes, track_path, NULL);
+   }
+
+   if (string_is_empty(track_path))
+      return true;
+
+   return media_detect_cd_info(track_path, pregap_bytes, info);
+}
+
+/* Fill in "info" with detected CD info. Use this when you want to open a specific track file directly, and the pregap is known. */
+bool media_detect_cd_info(const char *path, uint64_t pregap_bytes, media_detect_cd_info_t *info)
+{
+   int32_t size = -1;
+
+   if (string_is_empty(path) || !info)
+      return false;
+
+   memset(info, 0, sizeof(*info));
+
+   if (media_detect_cd_cache_active)
+   {
+      size = path_get_size(path);
+
+      if (size >= 0 && media_detect_cd_cache_find_track(path, size, pregap_bytes, info))
+         return true;
+   }
+
+   if (!media_detect_cd_read(path, pregap_bytes, info))
+      return false;
+
+   if (size >= 0)
+      media_detect_cd_cache_insert(path, size, pregap_bytes, NULL, info);
 
    return true;
 }
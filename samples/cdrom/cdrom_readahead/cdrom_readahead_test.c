@@ -0,0 +1,198 @@
+/* Copyright  (C) 2010-2020 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (cdrom_readahead_test.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <cdrom/cdrom.h>
+#include <rthreads/rthreads.h>
+
+/* Emulates a drive behind cdrom_set_send_command and reads through the
+ * read-ahead engine: sequential streaming in odd sized pieces, seeks,
+ * a failing sector and requests outside the track. */
+
+#define TRACK_START   4500
+#define TRACK_SECTORS 1200
+#define CHUNKS        4
+#define CHUNK_SECTORS 16
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf(__VA_ARGS__); printf("\n"); failures++; } } while (0)
+
+static slock_t *drive_lock      = NULL;
+static unsigned drive_commands  = 0;
+static unsigned drive_sectors   = 0;
+static unsigned drive_max_count = 0;
+static unsigned drive_bad_lba   = (unsigned)-1;
+
+static uint8_t sector_byte(unsigned lba, unsigned i)
+{
+   return (uint8_t)(lba * 7 + i * 13 + (lba >> 8));
+}
+
+static int fake_drive(const libretro_vfs_implementation_file *stream, enum cdrom_cmd_direction dir, void *buf, size_t len, unsigned char *cmd, size_t cmd_len, unsigned char *sense, size_t sense_len)
+{
+   unsigned lba, end, i;
+   uint8_t *out = (uint8_t*)buf;
+
+   if (cmd[0] != 0xB9 || dir != CDROM_CMD_DIRECTION_IN)
+      return 1;
+
+   lba = cdrom_msf_to_lba(cmd[3], cmd[4], cmd[5]);
+   end = cdrom_msf_to_lba(cmd[6], cmd[7], cmd[8]);
+
+   if (end <= lba || len != (size_t)(end - lba) * 2352)
+      return 1;
+
+   slock_lock(drive_lock);
+   drive_commands++;
+   drive_sectors += end - lba;
+   if (end - lba > drive_max_count)
+      drive_max_count = end - lba;
+
+   if (drive_bad_lba >= lba && drive_bad_lba < end)
+   {
+      slock_unlock(drive_lock);
+      /* ILLEGAL REQUEST, which is not retried */
+      sense[2] = 5;
+      return 1;
+   }
+   slock_unlock(drive_lock);
+
+   for (; lba < end; lba++)
+      for (i = 0; i < 2352; i++)
+         *out++ = sector_byte(lba, i);
+
+   return 0;
+}
+
+static int check_bytes(const uint8_t *buf, uint64_t pos, size_t len)
+{
+   size_t i;
+
+   for (i = 0; i < len; i++, pos++)
+   {
+      unsigned lba = TRACK_START + (unsigned)(pos / 2352);
+
+      if (buf[i] != sector_byte(lba, (unsigned)(pos % 2352)))
+         return 0;
+   }
+
+   return 1;
+}
+
+/* reads like retro_vfs_file_read_cdrom: a byte position turned into a sector and a skip */
+static int read_at(cdrom_readahead_t *ra, uint64_t pos, uint8_t *buf, size_t len)
+{
+   return cdrom_readahead_read(ra, TRACK_START + (unsigned)(pos / 2352), buf, len, (size_t)(pos % 2352));
+}
+
+int main(void)
+{
+   libretro_vfs_implementation_file stream;
+   static uint8_t buf[64 * 2352];
+   cdrom_readahead_t *ra;
+   uint64_t pos = 0;
+   uint64_t track_bytes = (uint64_t)TRACK_SECTORS * 2352;
+   size_t piece = 1;
+   unsigned char min, sec, frame;
+
+   memset(&stream, 0, sizeof(stream));
+   drive_lock = slock_new();
+   cdrom_set_send_command(fake_drive);
+
+   /* the synchronous path goes through the same transport */
+   cdrom_lba_to_msf(TRACK_START + 3, &min, &sec, &frame);
+   CHECK(!cdrom_read(&stream, NULL, min, sec, frame, buf, 3000, 100), "cdrom_read failed");
+   CHECK(check_bytes(buf, 3 * 2352 + 100, 3000), "cdrom_read returned wrong data");
+
+   /* the worker starts reading as soon as it exists */
+   slock_lock(drive_lock);
+   drive_commands = drive_sectors = drive_max_count = 0;
+   slock_unlock(drive_lock);
+
+   ra = cdrom_readahead_new(&stream, TRACK_START, TRACK_START + TRACK_SECTORS, CHUNKS, CHUNK_SECTORS);
+   CHECK(ra != NULL, "cdrom_readahead_new failed");
+   if (!ra)
+      return 1;
+
+   /* stream the whole track in pieces of varying size */
+   while (pos < track_bytes)
+   {
+      size_t len = (size_t)MIN((uint64_t)piece, track_bytes - pos);
+
+      if (read_at(ra, pos, buf, len) || !check_bytes(buf, pos, len))
+      {
+         CHECK(0, "sequential read of %u bytes at %u failed", (unsigned)len, (unsigned)pos);
+         break;
+      }
+
+      pos  += len;
+      piece = (piece * 37 + 911) % (20 * 2352) + 1;
+   }
+
+   slock_lock(drive_lock);
+   CHECK(drive_max_count == CHUNK_SECTORS, "largest command read %u sectors", drive_max_count);
+   CHECK(drive_sectors == TRACK_SECTORS, "streaming read %u sectors for a %u sector track", drive_sectors, TRACK_SECTORS);
+   CHECK(drive_commands <= TRACK_SECTORS / CHUNK_SECTORS + 1, "streaming took %u commands", drive_commands);
+   slock_unlock(drive_lock);
+
+   /* seeks backwards and forwards */
+   CHECK(!read_at(ra, 10 * 2352 + 5, buf, 5000) && check_bytes(buf, 10 * 2352 + 5, 5000), "seek to start failed");
+   CHECK(!read_at(ra, 700 * 2352 + 2000, buf, 40000) && check_bytes(buf, 700 * 2352 + 2000, 40000), "seek forward failed");
+   CHECK(!read_at(ra, 690 * 2352, buf, 2352) && check_bytes(buf, 690 * 2352, 2352), "short seek back failed");
+   CHECK(!read_at(ra, track_bytes - 100, buf, 100) && check_bytes(buf, track_bytes - 100, 100), "read of the last bytes failed");
+
+   /* outside the track */
+   CHECK(read_at(ra, track_bytes - 100, buf, 200), "read past the track end succeeded");
+   CHECK(cdrom_readahead_read(ra, TRACK_START - 1, buf, 2352, 0), "read before the track start succeeded");
+
+   /* a bad sector fails the read that needs it, and is asked for again later */
+   slock_lock(drive_lock);
+   drive_bad_lba = TRACK_START + 300;
+   slock_unlock(drive_lock);
+   CHECK(read_at(ra, 299 * 2352, buf, 3 * 2352), "read over a bad sector succeeded");
+   slock_lock(drive_lock);
+   drive_bad_lba = (unsigned)-1;
+   slock_unlock(drive_lock);
+   CHECK(!read_at(ra, 299 * 2352, buf, 3 * 2352) && check_bytes(buf, 299 * 2352, 3 * 2352), "read after a bad sector recovered failed");
+
+   cdrom_readahead_free(ra);
+
+   CHECK(!cdrom_readahead_new(&stream, TRACK_START, TRACK_START, CHUNKS, CHUNK_SECTORS), "empty range accepted");
+   CHECK(!cdrom_readahead_new(&stream, TRACK_START, TRACK_START + 10, 1, CHUNK_SECTORS), "single chunk accepted");
+
+   cdrom_set_send_command(NULL);
+   slock_free(drive_lock);
+
+   if (failures)
+   {
+      printf("%d check(s) failed\n", failures);
+      return 1;
+   }
+
+   printf("all checks passed\n");
+   return 0;
+}
@@ -0,0 +1,947 @@
+/* Copyright  (C) 2010-2020 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (formats_bench.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include <formats/image.h>
+#include <formats/rpng.h>
+#include <formats/rbmp.h>
+#include <formats/rqoi.h>
+#include <formats/rwav.h>
+#include <encodings/crc32.h>
+#include <features/features_cpu.h>
+#include <streams/file_stream.h>
+
+#include "../png/png_writer.h"
+#include "../jpeg/jpeg_writer.h"
+
+/* Times each codec in formats/ over a synthetic corpus built at start
+ * up, so every run measures the same bytes: PNGs of every colour type
+ * and depth, interlaced or not; baseline, restart and progressive
+ * JPEGs; BMPs, TGAs (raw, RLE, grey), QOIs and WAVs. Encoders are
+ * timed on the same pixels.
+ *
+ * usage: formats_bench [-n runs] [-o out.json] [filter]
+ *
+ * Each case runs n times (5 by default) and the fastest is kept.
+ * filter picks the cases whose "codec/stage/case" name contains it.
+ * Results are printed as JSON:
+ *
+ *   mb_s      the file's bytes per second: read when decoding,
+ *             written when encoding
+ *   mpixel_s  pixels per second (msample_s for WAV)
+ *   crc32     of the decoded pixels or samples, to tell when a
+ *             change alters the output
+ *   ok        whether the output matched the source; JPEG, being
+ *             lossy, is only checked for its size
+ *
+ * The exit status is non-zero if any case failed. */
+
+#define TEMP_PATH "/tmp/formats_bench.tmp"
+
+static unsigned runs        = 5;
+static const char *filter   = NULL;
+static FILE *out_file       = NULL;
+static unsigned num_results = 0;
+static int failures         = 0;
+
+static uint32_t rng_state   = 1;
+
+static uint32_t rng(void)
+{
+   rng_state = rng_state * 1103515245u + 12345u;
+   return rng_state >> 8;
+}
+
+static double now(void)
+{
+   return cpu_features_get_time_usec() / 1000000.0;
+}
+
+static bool wanted(const char *codec, const char *stage, const char *name)
+{
+   char full[128];
+
+   if (!filter)
+      return true;
+   snprintf(full, sizeof(full), "%s/%s/%s", codec, stage, name);
+   return strstr(full, filter) != NULL;
+}
+
+static void report(const char *codec, const char *stage, const char *name,
+      unsigned width, unsigned height, size_t bytes, uint64_t units,
+      double seconds, uint32_t crc, bool ok)
+{
+   if (seconds <= 0.0)
+      seconds = 1e-9;
+
+   fprintf(out_file, "%s\n    { \"codec\": \"%s\", \"stage\": \"%s\", \"case\": \"%s\", ",
+         num_results++ ? "," : "", codec, stage, name);
+   if (width)
+      fprintf(out_file, "\"width\": %u, \"height\": %u, ", width, height);
+   fprintf(out_file, "\"bytes\": %lu, \"seconds\": %.6f, \"mb_s\": %.2f, ",
+         (unsigned long)bytes, seconds, bytes / seconds / 1e6);
+   fprintf(out_file, "\"%s\": %.2f, \"crc32\": \"%08x\", \"ok\": %s }",
+         width ? "mpixel_s" : "msample_s", units / seconds / 1e6,
+         (unsigned)crc, ok ? "true" : "false");
+
+   if (!ok)
+   {
+      fprintf(stderr, "%s/%s/%s: output differs\n", codec, stage, name);
+      failures++;
+   }
+}
+
+/* Corpus */
+
+enum image_kind
+{
+   IMAGE_SCREENSHOT = 0, /* flat areas, hard edges, opaque */
+   IMAGE_PHOTO,          /* smooth gradients and noise, opaque */
+   IMAGE_ALPHA           /* screenshot with an alpha ramp */
+};
+
+static uint32_t *make_image(unsigned width, unsigned height,
+      enum image_kind kind)
+{
+   unsigned x, y;
+   uint32_t *argb = (uint32_t*)malloc((size_t)width * height * 4);
+
+   for (y = 0; y < height; y++)
+   {
+      for (x = 0; x < width; x++)
+      {
+         uint32_t r, g, b, a = 0xff;
+
+         if (kind == IMAGE_PHOTO)
+         {
+            r = (uint32_t)(128 + 90 * sin(x / 37.0) * cos(y / 53.0));
+            g = (uint32_t)(128 + 90 * sin((x + y) / 71.0));
+            b = (uint32_t)(100 + 60 * cos(x / 19.0 - y / 41.0));
+            r = (r + rng() % 9) & 0xff;
+            g = (g + rng() % 9) & 0xff;
+         }
+         else
+         {
+            unsigned t = (x / 24 + y / 16) % 6;
+            r = 30 + t * 35;
+            g = y * 200 / height + 20;
+            b = (x / 8 + y / 8) & 1 ? 200 : 60;
+            if ((x ^ y) % 97 == 0)
+               r = g = b = 250;
+            if (kind == IMAGE_ALPHA)
+               a = (x + y / 2) & 0xff;
+         }
+
+         argb[(size_t)y * width + x] = a << 24 | r << 16 | g << 8 | b;
+      }
+   }
+
+   return argb;
+}
+
+static unsigned luma(uint32_t argb)
+{
+   return (((argb >> 16) & 0xff) * 77 + ((argb >> 8) & 0xff) * 150
+         + (argb & 0xff) * 29) >> 8;
+}
+
+static void put_sample(uint8_t *row, unsigned i, unsigned v, unsigned depth)
+{
+   if (depth == 16)
+   {
+      row[i * 2 + 0] = (uint8_t)(v >> 8);
+      row[i * 2 + 1] = (uint8_t)v;
+   }
+   else if (depth == 8)
+      row[i] = (uint8_t)v;
+   else
+      row[i * depth / 8] |= (uint8_t)(v << (8 - depth - i * depth % 8));
+}
+
+/* Packs src as the PNG opts describe, into *raw, and returns the
+ * ARGB rpng should decode it to */
+static uint32_t *make_png_raw(const uint32_t *src, unsigned width,
+      unsigned height, const png_writer_opts *opts, uint8_t **raw)
+{
+   static const unsigned gray_mul[9] = { 0, 0xff, 0x55, 0, 0x11, 0, 0, 0, 0x01 };
+   static const unsigned channels[7] = { 1, 0, 3, 1, 2, 0, 4 };
+   unsigned x, y;
+   unsigned depth     = opts->depth;
+   unsigned samples   = channels[opts->color_type];
+   size_t stride      = ((size_t)width * samples * depth + 7) / 8;
+   uint32_t *expected = (uint32_t*)malloc((size_t)width * height * 4);
+   /* 16 bit samples are the 8 bit value twice, so both bytes agree */
+   unsigned wide      = depth == 16 ? 257 : 1;
+
+   *raw = (uint8_t*)calloc(1, stride * height);
+
+   for (y = 0; y < height; y++)
+   {
+      uint8_t *row = *raw + stride * y;
+
+      for (x = 0; x < width; x++)
+      {
+         uint32_t px = src[(size_t)y * width + x];
+         unsigned a  = px >> 24;
+         unsigned r  = (px >> 16) & 0xff;
+         unsigned g  = (px >>  8) & 0xff;
+         unsigned b  = px & 0xff;
+         unsigned i  = x * samples;
+         uint32_t e  = 0;
+
+         switch (opts->color_type)
+         {
+            case 0:
+               {
+                  unsigned v = depth >= 8 ? luma(px) : luma(px) >> (8 - depth);
+                  put_sample(row, i, v * wide, depth);
+                  e = depth >= 8 ? v * 0x010101 : v * gray_mul[depth] * 0x010101;
+                  e |= 0xff000000;
+               }
+               break;
+            case 2:
+               put_sample(row, i + 0, r * wide, depth);
+               put_sample(row, i + 1, g * wide, depth);
+               put_sample(row, i + 2, b * wide, depth);
+               e = 0xff000000 | (px & 0xffffff);
+               break;
+            case 3:
+               {
+                  unsigned v = luma(px) >> (8 - depth);
+                  put_sample(row, i, v, depth);
+                  e = opts->palette[v];
+               }
+               break;
+            case 4:
+               put_sample(row, i + 0, luma(px) * wide, depth);
+               put_sample(row, i + 1, a * wide, depth);
+               e = a << 24 | luma(px) * 0x010101;
+               break;
+            case 6:
+               put_sample(row, i + 0, r * wide, depth);
+               put_sample(row, i + 1, g * wide, depth);
+               put_sample(row, i + 2, b * wide, depth);
+               put_sample(row, i + 3, a * wide, depth);
+               e = px;
+               break;
+         }
+
+         expected[(size_t)y * width + x] = e;
+      }
+   }
+
+   return expected;
+}
+
+/* A colour ramp, indexed by luma */
+static void make_palette(uint32_t *palette, unsigned len)
+{
+   unsigned i;
+
+   for (i = 0; i < len; i++)
+   {
+      unsigned v = i * 255 / (len - 1);
+      palette[i] = 0xff000000 | v << 16 | (255 - v) << 8 | ((v * 3) & 0xff);
+   }
+}
+
+enum tga_layout
+{
+   TGA_24 = 0,
+   TGA_32,
+   TGA_32_RLE,
+   TGA_8_GREY
+};
+
+static void tga_put_pixel(uint8_t **p, uint32_t px, enum tga_layout layout)
+{
+   if (layout == TGA_8_GREY)
+   {
+      *(*p)++ = (uint8_t)px;
+      return;
+   }
+   *(*p)++ = (uint8_t)(px >>  0);
+   *(*p)++ = (uint8_t)(px >>  8);
+   *(*p)++ = (uint8_t)(px >> 16);
+   if (layout != TGA_24)
+      *(*p)++ = (uint8_t)(px >> 24);
+}
+
+/* Top-down TGA of src; grey TGAs take the blue channel */
+static uint8_t *make_tga(const uint32_t *src, unsigned width,
+      unsigned height, enum tga_layout layout, size_t *len,
+      uint32_t **expected)
+{
+   static const uint8_t types[] = { 2, 2, 10, 3 };
+   static const uint8_t bits[]  = { 24, 32, 32, 8 };
+   size_t i, n    = (size_t)width * height;
+   uint8_t *tga   = (uint8_t*)malloc(18 + n * 5);
+   uint8_t *p     = tga + 18;
+
+   memset(tga, 0, 18);
+   tga[2]  = types[layout];
+   tga[12] = (uint8_t)width;
+   tga[13] = (uint8_t)(width >> 8);
+   tga[14] = (uint8_t)height;
+   tga[15] = (uint8_t)(height >> 8);
+   tga[16] = bits[layout];
+   tga[17] = 0x20 | (bits[layout] == 32 ? 8 : 0);
+
+   *expected = (uint32_t*)malloc(n * 4);
+   for (i = 0; i < n; i++)
+   {
+      uint32_t px = src[i];
+      if (layout == TGA_8_GREY)
+         px = 0xff000000 | (px & 0xff) * 0x010101;
+      else if (layout == TGA_24)
+         px |= 0xff000000;
+      (*expected)[i] = px;
+   }
+
+   if (layout != TGA_32_RLE)
+      for (i = 0; i < n; i++)
+         tga_put_pixel(&p, src[i], layout);
+   else
+   {
+      /* Repeats of 3 or more are packed; packets don't cross rows */
+      for (i = 0; i < n; )
+      {
+         size_t row_end = (i / width + 1) * width;
+         size_t run     = 1;
+
+         while (i + run < row_end && run < 128 && src[i + run] == src[i])
+            run++;
+
+         if (run >= 3)
+         {
+            *p++ = (uint8_t)(0x80 | (run - 1));
+            tga_put_pixel(&p, src[i], layout);
+            i   += run;
+         }
+         else
+         {
+            size_t raw = 0;
+            uint8_t *head = p++;
+            while (i + raw < row_end && raw < 128
+                  && !(i + raw + 2 < row_end
+                     && src[i + raw] == src[i + raw + 1]
+                     && src[i + raw] == src[i + raw + 2]))
+               tga_put_pixel(&p, src[i + raw++], layout);
+            if (!raw)
+               tga_put_pixel(&p, src[i + raw++], layout);
+            *head = (uint8_t)(raw - 1);
+            i    += raw;
+         }
+      }
+   }
+
+   *len = p - tga;
+   return tga;
+}
+
+static uint8_t *make_wav(const void *samples, size_t size,
+      unsigned channels, unsigned rate, unsigned bits)
+{
+   uint8_t *wav = (uint8_t*)malloc(44 + size);
+   uint32_t v;
+
+   memcpy(wav, "RIFF", 4);
+   v = (uint32_t)(36 + size);
+   wav[4]  = v; wav[5]  = v >> 8; wav[6]  = v >> 16; wav[7]  = v >> 24;
+   memcpy(wav + 8, "WAVEfmt ", 8);
+   wav[16] = 16; wav[17] = 0; wav[18] = 0; wav[19] = 0;
+   wav[20] = 1;  wav[21] = 0;
+   wav[22] = channels; wav[23] = 0;
+   wav[24] = rate; wav[25] = rate >> 8; wav[26] = rate >> 16; wav[27] = rate >> 24;
+   v = rate * channels * bits / 8;
+   wav[28] = v; wav[29] = v >> 8; wav[30] = v >> 16; wav[31] = v >> 24;
+   wav[32] = channels * bits / 8; wav[33] = 0;
+   wav[34] = bits; wav[35] = 0;
+   memcpy(wav + 36, "data", 4);
+   v = (uint32_t)size;
+   wav[40] = v; wav[41] = v >> 8; wav[42] = v >> 16; wav[43] = v >> 24;
+
+   /* Samples are little endian in the file */
+   if (bits == 16)
+   {
+      size_t i;
+      const int16_t *s = (const int16_t*)samples;
+      for (i = 0; i < size / 2; i++)
+      {
+         wav[44 + i * 2 + 0] = (uint8_t)s[i];
+         wav[44 + i * 2 + 1] = (uint8_t)((uint16_t)s[i] >> 8);
+      }
+   }
+   else
+      memcpy(wav + 44, samples, size);
+
+   return wav;
+}
+
+/* Decoding */
+
+static uint32_t *decode_image(enum image_type_enum type, void *data,
+      size_t len, unsigned *width, unsigned *height)
+{
+   int ret;
+   uint32_t *argb = NULL;
+   void *img      = image_transfer_new(type);
+
+   if (!img)
+      return NULL;
+
+   image_transfer_set_buffer_ptr(img, type, data, len);
+
+   if (image_transfer_start(img, type))
+   {
+      while (image_transfer_iterate(img, type));
+
+      if (image_transfer_is_valid(img, type))
+      {
+         do
+         {
+            ret = image_transfer_process(img, type, &argb, len,
+                  width, height);
+         } while (ret == IMAGE_PROCESS_NEXT);
+
+         if (ret != IMAGE_PROCESS_END)
+         {
+            free(argb);
+            argb = NULL;
+         }
+      }
+   }
+
+   image_transfer_free(img, type);
+   return argb;
+}
+
+/* Times decoding data; expected NULL only checks the size */
+static void bench_decode(const char *codec, enum image_type_enum type,
+      const char *name, void *data, size_t len,
+      unsigned width, unsigned height, const uint32_t *expected)
+{
+   unsigned i;
+   double best   = 1e9;
+   uint32_t crc  = 0;
+   bool ok       = true;
+
+   if (!data)
+   {
+      fprintf(stderr, "%s/decode/%s: couldn't build the file\n", codec, name);
+      failures++;
+      return;
+   }
+
+   for (i = 0; i < runs; i++)
+   {
+      unsigned w = 0, h = 0;
+      double t0  = now();
+      uint32_t *argb = decode_image(type, data, len, &w, &h);
+      double t   = now() - t0;
+
+      if (t < best)
+         best = t;
+
+      if (!argb || w != width || h != height)
+         ok = false;
+      else if (i == 0)
+      {
+         crc = encoding_crc32(0, (const uint8_t*)argb, (size_t)w * h * 4);
+         if (expected && memcmp(argb, expected, (size_t)w * h * 4))
+            ok = false;
+      }
+      free(argb);
+   }
+
+   report(codec, "decode", name, width, height, len,
+         (uint64_t)width * height, best, crc, ok);
+}
+
+static void bench_png(const char *name, unsigned width, unsigned height,
+      enum image_kind kind, int color_type, int depth, int interlace)
+{
+   png_writer_opts opts;
+   uint32_t palette[256];
+   uint32_t *src, *expected;
+   uint8_t *raw, *png;
+   size_t len = 0;
+   char full[64];
+
+   snprintf(full, sizeof(full), "%s_%ux%u", name, width, height);
+   if (!wanted("rpng", "decode", full))
+      return;
+
+   opts.color_type  = color_type;
+   opts.depth       = depth;
+   opts.interlace   = interlace;
+   opts.palette     = palette;
+   opts.palette_len = color_type == 3 ? 1u << depth : 0;
+   if (color_type == 3)
+      make_palette(palette, opts.palette_len);
+
+   src      = make_image(width, height, kind);
+   expected = make_png_raw(src, width, height, &opts, &raw);
+   png      = png_writer_encode(raw, width, height, &opts, &len);
+
+   bench_decode("rpng", IMAGE_TYPE_PNG, full, png, len, width, height, expected);
+
+   free(png);
+   free(raw);
+   free(expected);
+   free(src);
+}
+
+static void bench_jpeg(const char *name, unsigned width, unsigned height,
+      int comps, int h, int v, int restart_interval, int progressive)
+{
+   jpeg_writer_opts opts;
+   uint32_t *src;
+   uint8_t *rgb, *jpg;
+   size_t i, len = 0;
+   char full[64];
+
+   snprintf(full, sizeof(full), "%s_%ux%u", name, width, height);
+   if (!wanted("rjpeg", "decode", full))
+      return;
+
+   opts.comps            = comps;
+   opts.h                = h;
+   opts.v                = v;
+   opts.quality          = 90;
+   opts.restart_interval = restart_interval;
+   opts.progressive      = progressive;
+
+   src = make_image(width, height, IMAGE_PHOTO);
+   rgb = (uint8_t*)malloc((size_t)width * height * 3);
+   for (i = 0; i < (size_t)width * height; i++)
+   {
+      rgb[i * 3 + 0] = (uint8_t)(src[i] >> 16);
+      rgb[i * 3 + 1] = (uint8_t)(src[i] >>  8);
+      rgb[i * 3 + 2] = (uint8_t)(src[i] >>  0);
+   }
+   jpg = jpeg_writer_encode(rgb, (int)width, (int)height, &opts, &len);
+
+   bench_decode("rjpeg", IMAGE_TYPE_JPEG, full, jpg, len, width, height, NULL);
+
+   free(jpg);
+   free(rgb);
+   free(src);
+}
+
+static void bench_tga(const char *name, unsigned width, unsigned height,
+      enum tga_layout layout)
+{
+   uint32_t *src, *expected;
+   uint8_t *tga;
+   size_t len = 0;
+   char full[64];
+
+   snprintf(full, sizeof(full), "%s_%ux%u", name, width, height);
+   if (!wanted("rtga", "decode", full))
+      return;
+
+   src = make_image(width, height,
+         layout == TGA_24 ? IMAGE_SCREENSHOT : IMAGE_ALPHA);
+   tga = make_tga(src, width, height, layout, &len, &expected);
+
+   bench_decode("rtga", IMAGE_TYPE_TGA, full, tga, len, width, height, expected);
+
+   free(tga);
+   free(expected);
+   free(src);
+}
+
+static void bench_wav(const char *name, unsigned channels, unsigned rate,
+      unsigned bits, unsigned seconds)
+{
+   unsigned i;
+   rwav_t rwav;
+   uint8_t *wav;
+   void *samples;
+   double best     = 1e9;
+   uint32_t crc    = 0;
+   bool ok         = true;
+   size_t count    = (size_t)rate * seconds * channels;
+   size_t size     = count * bits / 8;
+
+   if (!wanted("rwav", "decode", name))
+      return;
+
+   samples = malloc(size);
+   for (i = 0; i < count; i++)
+   {
+      double s = sin(i / (double)channels * 440.0 * 6.2831853 / rate);
+      if (bits == 16)
+         ((int16_t*)samples)[i] = (int16_t)(s * 20000 + (int)(rng() % 64) - 32);
+      else
+         ((uint8_t*)samples)[i] = (uint8_t)(128 + s * 100);
+   }
+   wav = make_wav(samples, size, channels, rate, bits);
+
+   for (i = 0; i < runs; i++)
+   {
+      double t0 = now();
+      enum rwav_state state = rwav_load(&rwav, wav, 44 + size);
+      double t  = now() - t0;
+
+      if (t < best)
+         best = t;
+
+      if (state != RWAV_ITERATE_DONE)
+      {
+         ok = false;
+         continue;
+      }
+
+      if (     rwav.numsamples != count / channels
+            || rwav.numchannels != channels
+            || rwav.subchunk2size != size
+            || memcmp(rwav.samples, samples, size))
+         ok = false;
+      if (i == 0)
+         crc = encoding_crc32(0, (const uint8_t*)rwav.samples, size);
+      rwav_free(&rwav);
+   }
+
+   report("rwav", "decode", name, 0, 0, 44 + size, count, best, crc, ok);
+
+   free(wav);
+   free(samples);
+}
+
+/* Encoding */
+
+/* rbmp_save_image takes rows bottom up, as BMPs store them */
+static void *flip_rows(const void *src, size_t pitch, unsigned height)
+{
+   unsigned y;
+   uint8_t *dst = (uint8_t*)malloc(pitch * height);
+
+   for (y = 0; y < height; y++)
+      memcpy(dst + pitch * (height - 1 - y),
+            (const uint8_t*)src + pitch * y, pitch);
+   return dst;
+}
+
+enum encoder
+{
+   ENC_RPNG_BGR24 = 0, /* to memory */
+   ENC_RPNG_ARGB,      /* to a file */
+   ENC_RBMP_BGR24,     /* to a file */
+   ENC_RBMP_ARGB,      /* to a file */
+   ENC_RQOI_XRGB       /* to memory */
+};
+
+/* Returns the encoded bytes; file encoders are read back after.
+ * level only applies to rpng. */
+static uint8_t *encode(enum encoder enc, const uint32_t *argb,
+      const uint8_t *bgr, unsigned width, unsigned height, int level,
+      size_t *len)
+{
+   uint64_t bytes = 0;
+   uint8_t *buf   = NULL;
+
+   switch (enc)
+   {
+      case ENC_RPNG_BGR24:
+         buf = rpng_save_image_bgr24_string_level(bgr, width, height,
+               (signed)width * 3, &bytes, level);
+         break;
+      case ENC_RQOI_XRGB:
+         buf = rqoi_save_image_string(argb, width, height, width * 4,
+               RQOI_SOURCE_TYPE_XRGB8888, &bytes);
+         break;
+      case ENC_RPNG_ARGB:
+         if (!rpng_save_image_argb_level(TEMP_PATH, argb, width, height,
+                  width * 4, level))
+            return NULL;
+         break;
+      case ENC_RBMP_BGR24:
+      case ENC_RBMP_ARGB:
+         if (!rbmp_save_image(TEMP_PATH, enc == ENC_RBMP_ARGB
+                  ? (const void*)argb : (const void*)bgr,
+                  width, height, enc == ENC_RBMP_ARGB ? width * 4 : width * 3,
+                  enc == ENC_RBMP_ARGB
+                  ? RBMP_SOURCE_TYPE_ARGB8888 : RBMP_SOURCE_TYPE_BGR24))
+            return NULL;
+         break;
+   }
+
+   *len = (size_t)bytes;
+   return buf;
+}
+
+static uint8_t *read_back(size_t *len)
+{
+   void *file  = NULL;
+   int64_t size = 0;
+
+   if (!filestream_read_file(TEMP_PATH, &file, &size))
+      return NULL;
+   remove(TEMP_PATH);
+   *len = (size_t)size;
+   return (uint8_t*)file;
+}
+
+static void bench_encode(const char *codec, const char *name,
+      enum encoder enc, enum image_type_enum type, int level,
+      unsigned width, unsigned height, enum image_kind kind)
+{
+   unsigned i;
+   size_t len        = 0;
+   double best       = 1e9;
+   bool is_bmp       = enc == ENC_RBMP_BGR24 || enc == ENC_RBMP_ARGB;
+   bool to_file      = is_bmp || enc == ENC_RPNG_ARGB;
+   uint32_t crc      = 0;
+   bool ok           = false;
+   uint32_t *argb    = NULL;
+   uint8_t *bgr      = NULL;
+   uint32_t *argb_in = NULL;
+   uint8_t *bgr_in   = NULL;
+   uint8_t *buf      = NULL;
+   char full[64];
+
+   snprintf(full, sizeof(full), "%s_%ux%u", name, width, height);
+   if (!wanted(codec, "encode", full))
+      return;
+
+   argb = make_image(width, height, kind);
+   bgr  = (uint8_t*)malloc((size_t)width * height * 3);
+   for (i = 0; i < width * height; i++)
+   {
+      bgr[i * 3 + 0] = (uint8_t)(argb[i] >>  0);
+      bgr[i * 3 + 1] = (uint8_t)(argb[i] >>  8);
+      bgr[i * 3 + 2] = (uint8_t)(argb[i] >> 16);
+   }
+
+   argb_in = is_bmp ? (uint32_t*)flip_rows(argb, width * 4, height) : argb;
+   bgr_in  = is_bmp ? (uint8_t*)flip_rows(bgr, width * 3, height) : bgr;
+
+   for (i = 0; i < runs; i++)
+   {
+      double t0, t;
+
+      free(buf);
+      t0  = now();
+      buf = encode(enc, argb_in, bgr_in, width, height, level, &len);
+      t   = now() - t0;
+      if (to_file)
+         buf = read_back(&len);
+
+      if (t < best)
+         best = t;
+   }
+
+   /* Decoded again, the pixels must be the ones saved. rbmp doesn't
+    * read 32 bit BMPs without bit masks, so those are only sized. */
+   if (buf && enc == ENC_RBMP_ARGB)
+   {
+      ok  = len == 54 + (size_t)width * height * 4;
+      crc = encoding_crc32(0, buf, len);
+   }
+   else if (buf)
+   {
+      unsigned w = 0, h = 0;
+      uint32_t *back = decode_image(type, buf, len, &w, &h);
+
+      if (back && w == width && h == height)
+      {
+         size_t n = (size_t)width * height;
+         ok       = true;
+         for (i = 0; i < n; i++)
+         {
+            uint32_t want = enc == ENC_RPNG_ARGB || enc == ENC_RBMP_ARGB
+               ? argb[i] : (argb[i] | 0xff000000);
+            if (back[i] != want)
+               ok = false;
+         }
+         crc = encoding_crc32(0, buf, len);
+      }
+      free(back);
+   }
+
+   report(codec, "encode", full, width, height, len,
+         (uint64_t)width * height, best, crc, ok);
+
+   if (is_bmp)
+   {
+      free(argb_in);
+      free(bgr_in);
+   }
+   free(buf);
+   free(bgr);
+   free(argb);
+}
+
+/* Cases */
+
+static void bench_all(void)
+{
+   static const unsigned sizes[][2] = { { 64, 64 }, { 640, 480 }, { 1920, 1080 } };
+   unsigned s;
+
+   for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+   {
+      unsigned w   = sizes[s][0];
+      unsigned h   = sizes[s][1];
+      bool all     = s < 2;
+
+      bench_png("rgba8",            w, h, IMAGE_ALPHA,      6,  8, 0);
+      bench_png("rgb8",             w, h, IMAGE_SCREENSHOT, 2,  8, 0);
+      bench_png("rgb8_photo",       w, h, IMAGE_PHOTO,      2,  8, 0);
+      bench_png("palette8",         w, h, IMAGE_SCREENSHOT, 3,  8, 0);
+      bench_png("rgba8_interlaced", w, h, IMAGE_ALPHA,      6,  8, 1);
+      if (all)
+      {
+         bench_png("gray1",             w, h, IMAGE_SCREENSHOT, 0,  1, 0);
+         bench_png("gray4",             w, h, IMAGE_SCREENSHOT, 0,  4, 0);
+         bench_png("gray8",             w, h, IMAGE_PHOTO,      0,  8, 0);
+         bench_png("gray16",            w, h, IMAGE_PHOTO,      0, 16, 0);
+         bench_png("gray_alpha8",       w, h, IMAGE_ALPHA,      4,  8, 0);
+         bench_png("rgb16",             w, h, IMAGE_PHOTO,      2, 16, 0);
+         bench_png("rgba16",            w, h, IMAGE_ALPHA,      6, 16, 0);
+         bench_png("palette4",          w, h, IMAGE_SCREENSHOT, 3,  4, 0);
+         bench_png("palette8_interlaced", w, h, IMAGE_SCREENSHOT, 3, 8, 1);
+         bench_png("gray2_interlaced",  w, h, IMAGE_SCREENSHOT, 0,  2, 1);
+      }
+
+      bench_jpeg("ycbcr420",             w, h, 3, 2, 2, 0, 0);
+      bench_jpeg("ycbcr420_progressive", w, h, 3, 2, 2, 0, 1);
+      if (all)
+      {
+         bench_jpeg("ycbcr444",          w, h, 3, 1, 1, 0, 0);
+         bench_jpeg("ycbcr422",          w, h, 3, 2, 1, 0, 0);
+         bench_jpeg("gray",              w, h, 1, 1, 1, 0, 0);
+         bench_jpeg("ycbcr420_restart",  w, h, 3, 2, 2, 4, 0);
+         bench_jpeg("gray_progressive",  w, h, 1, 1, 1, 0, 1);
+      }
+
+      bench_tga("rgb24",  w, h, TGA_24);
+      bench_tga("rgba32", w, h, TGA_32);
+      bench_tga("rle32",  w, h, TGA_32_RLE);
+      bench_tga("grey8",  w, h, TGA_8_GREY);
+
+      /* BMPs and QOIs come from their encoders */
+      bench_encode("rbmp", "rgb24",  ENC_RBMP_BGR24, IMAGE_TYPE_BMP, 9, w, h, IMAGE_PHOTO);
+      bench_encode("rbmp", "argb32", ENC_RBMP_ARGB,  IMAGE_TYPE_BMP, 9, w, h, IMAGE_SCREENSHOT);
+      bench_encode("rpng", "rgb8_level9",  ENC_RPNG_BGR24, IMAGE_TYPE_PNG, 9, w, h, IMAGE_SCREENSHOT);
+      bench_encode("rpng", "rgb8_level1",  ENC_RPNG_BGR24, IMAGE_TYPE_PNG, 1, w, h, IMAGE_SCREENSHOT);
+      bench_encode("rpng", "photo_level6", ENC_RPNG_BGR24, IMAGE_TYPE_PNG, 6, w, h, IMAGE_PHOTO);
+      bench_encode("rpng", "argb_file",    ENC_RPNG_ARGB,  IMAGE_TYPE_PNG, 9, w, h, IMAGE_ALPHA);
+      bench_encode("rqoi", "rgb",          ENC_RQOI_XRGB,  IMAGE_TYPE_QOI, 9, w, h, IMAGE_SCREENSHOT);
+
+      {
+         char name[64];
+         size_t len;
+         uint32_t *argb = make_image(w, h, IMAGE_SCREENSHOT);
+         uint32_t *flipped;
+         uint8_t *buf;
+
+         snprintf(name, sizeof(name), "rgb24_%ux%u", w, h);
+         if (wanted("rbmp", "decode", name))
+         {
+            flipped = (uint32_t*)flip_rows(argb, w * 4, h);
+            if (rbmp_save_image(TEMP_PATH, flipped, w, h, w * 4,
+                     RBMP_SOURCE_TYPE_XRGB888) && (buf = read_back(&len)))
+            {
+               size_t i;
+               for (i = 0; i < (size_t)w * h; i++)
+                  argb[i] |= 0xff000000;
+               bench_decode("rbmp", IMAGE_TYPE_BMP, name, buf, len, w, h, argb);
+               free(buf);
+            }
+            else
+               bench_decode("rbmp", IMAGE_TYPE_BMP, name, NULL, 0, w, h, NULL);
+            free(flipped);
+         }
+         free(argb);
+
+         argb = make_image(w, h, IMAGE_ALPHA);
+         snprintf(name, sizeof(name), "rgba_%ux%u", w, h);
+         if (wanted("rqoi", "decode", name))
+         {
+            uint64_t bytes = 0;
+            buf = rqoi_save_image_string(argb, w, h, w * 4,
+                  RQOI_SOURCE_TYPE_ARGB8888, &bytes);
+            bench_decode("rqoi", IMAGE_TYPE_QOI, name, buf, (size_t)bytes, w, h, argb);
+            free(buf);
+         }
+         free(argb);
+      }
+   }
+
+   bench_wav("pcm16_stereo_44100", 2, 44100, 16, 10);
+   bench_wav("pcm8_mono_22050",    1, 22050,  8, 10);
+}
+
+int main(int argc, char **argv)
+{
+   int i;
+   const char *out_path = NULL;
+
+   for (i = 1; i < argc; i++)
+   {
+      if (!strcmp(argv[i], "-n") && i + 1 < argc)
+         runs = (unsigned)atoi(argv[++i]);
+      else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+         out_path = argv[++i];
+      else if (argv[i][0] == '-')
+      {
+         fprintf(stderr, "usage: %s [-n runs] [-o out.json] [filter]\n", argv[0]);
+         return 1;
+      }
+      else
+         filter = argv[i];
+   }
+
+   if (!runs)
+      runs = 1;
+
+   out_file = out_path ? fopen(out_path, "w") : stdout;
+   if (!out_file)
+   {
+      fprintf(stderr, "couldn't open %s\n", out_path);
+      return 1;
+   }
+
+   fprintf(out_file, "{\n  \"runs\": %u,\n  \"results\": [", runs);
+   bench_all();
+   fprintf(out_file, "\n  ]\n}\n");
+
+   if (out_path)
+      fclose(out_file);
+
+   if (failures)
+   {
+      fprintf(stderr, "%d case(s) failed\n", failures);
+      return 1;
+   }
+
+   return 0;
+}
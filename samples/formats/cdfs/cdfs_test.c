@@ -0,0 +1,383 @@
+/* Copyright  (C) 2010-2020 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (cdfs_test.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <formats/cdfs.h>
+#include <streams/file_stream.h>
+#include <streams/interface_stream.h>
+
+/* Builds small ISO-9660 images in memory, cooked and raw, with and
+ * without a path table, and checks lookups, reads and seeks through
+ * cdfs. Also opens the data track of a cue sheet on disk. */
+
+#define SECTOR          2048
+#define IMAGE_SECTORS   64
+#define PVD_SECTOR      16
+#define PATH_SECTOR     18
+#define ROOT_SECTOR     19
+#define DATA_SECTOR     20    /* two sectors */
+#define SUB_SECTOR      22
+#define FILE_SECTOR     24
+#define DATA_FILES      60
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf(__VA_ARGS__); printf("\n"); failures++; } } while (0)
+
+static void put_both32(uint8_t *p, uint32_t v)
+{
+   p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+   p[4] = v >> 24; p[5] = v >> 16; p[6] = v >> 8; p[7] = v;
+}
+
+/* appends a directory record, moving to the next sector if it
+ * would cross one */
+static size_t add_record(uint8_t *dir, size_t pos, const char *name,
+      uint32_t sector, uint32_t size, int is_dir)
+{
+   size_t name_len = (name[0] == 0 || name[0] == 1) ? 1 : strlen(name);
+   size_t len      = 33 + name_len + ((name_len & 1) ? 0 : 1);
+   uint8_t *rec;
+
+   if (pos % SECTOR + len > SECTOR)
+      pos = (pos / SECTOR + 1) * SECTOR;
+
+   rec = dir + pos;
+   memset(rec, 0, len);
+   rec[0]  = (uint8_t)len;
+   put_both32(&rec[2], sector);
+   put_both32(&rec[10], size);
+   rec[25] = is_dir ? 0x02 : 0x00;
+   rec[32] = (uint8_t)name_len;
+   memcpy(&rec[33], name, name_len);
+   return pos + len;
+}
+
+static uint8_t file_byte(uint32_t sector, uint32_t i)
+{
+   return (uint8_t)(sector * 31 + i * 7 + (i >> 11));
+}
+
+/* a file of size bytes at sector, filled with a pattern */
+static uint32_t add_file(uint8_t *image, uint32_t *next, uint32_t size)
+{
+   uint32_t i, sector = *next;
+   for (i = 0; i < size; i++)
+      image[sector * SECTOR + i] = file_byte(sector, i);
+   *next += (size + SECTOR - 1) / SECTOR;
+   return sector;
+}
+
+typedef struct
+{
+   const char *lookup;
+   uint32_t sector;
+   uint32_t size;
+} expected_file_t;
+
+static expected_file_t expected[8];
+static unsigned expected_count = 0;
+
+static uint8_t *build_image(int with_path_table)
+{
+   uint8_t *image = (uint8_t*)calloc(IMAGE_SECTORS, SECTOR);
+   uint8_t *pvd   = image + PVD_SECTOR * SECTOR;
+   uint8_t *pt    = image + PATH_SECTOR * SECTOR;
+   uint8_t *root  = image + ROOT_SECTOR * SECTOR;
+   uint8_t *data  = image + DATA_SECTOR * SECTOR;
+   uint8_t *sub   = image + SUB_SECTOR * SECTOR;
+   uint32_t next  = FILE_SECTOR;
+   uint32_t system_cnf, readme, deep, big, small;
+   size_t pos;
+   unsigned i;
+
+   system_cnf = add_file(image, &next, 60);
+   readme     = add_file(image, &next, 5000);
+   deep       = add_file(image, &next, 3);
+   big        = add_file(image, &next, 3 * SECTOR + 100);
+   small      = add_file(image, &next, 2);
+
+   /* root: SYSTEM.CNF, README., DATA/ */
+   pos = add_record(root, 0, "\0", ROOT_SECTOR, SECTOR, 1);
+   pos = add_record(root, pos, "\1", ROOT_SECTOR, SECTOR, 1);
+   pos = add_record(root, pos, "SYSTEM.CNF;1", system_cnf, 60, 0);
+   pos = add_record(root, pos, "README.;1", readme, 5000, 0);
+   pos = add_record(root, pos, "DATA", DATA_SECTOR, 2 * SECTOR, 1);
+
+   /* DATA: enough files to spill into a second sector, then SUB/ */
+   pos = add_record(data, 0, "\0", DATA_SECTOR, 2 * SECTOR, 1);
+   pos = add_record(data, pos, "\1", ROOT_SECTOR, SECTOR, 1);
+   for (i = 0; i < DATA_FILES; i++)
+   {
+      char name[32];
+      sprintf(name, "FILE%02u.BIN;1", i);
+      pos = add_record(data, pos, name, (i == 57) ? big : small,
+            (i == 57) ? 3 * SECTOR + 100 : 2, 0);
+   }
+   pos = add_record(data, pos, "SUB", SUB_SECTOR, SECTOR, 1);
+
+   pos = add_record(sub, 0, "\0", SUB_SECTOR, SECTOR, 1);
+   pos = add_record(sub, pos, "\1", DATA_SECTOR, 2 * SECTOR, 1);
+   pos = add_record(sub, pos, "DEEP.TXT;1", deep, 3, 0);
+
+   /* little-endian path table: root, DATA, DATA/SUB */
+   if (with_path_table)
+   {
+      static const struct { const char *name; uint32_t sector; unsigned parent; } dirs[] =
+      {
+         { "\0", ROOT_SECTOR, 1 }, { "DATA", DATA_SECTOR, 1 }, { "SUB", SUB_SECTOR, 2 }
+      };
+      pos = 0;
+      for (i = 0; i < 3; i++)
+      {
+         size_t len = (i == 0) ? 1 : strlen(dirs[i].name);
+         pt[pos] = (uint8_t)len;
+         pt[pos + 2] = dirs[i].sector;
+         pt[pos + 6] = dirs[i].parent;
+         memcpy(&pt[pos + 8], dirs[i].name, len);
+         pos += 8 + len + (len & 1);
+      }
+      put_both32(&pvd[132], (uint32_t)pos);
+      pvd[140] = PATH_SECTOR;
+   }
+
+   pvd[0] = 1;
+   memcpy(&pvd[1], "CD001", 5);
+   pvd[6] = 1;
+   memcpy(&pvd[40], "CDFS_TEST", 9);
+   pvd[40 + 31] = with_path_table ? 'P' : 'W';
+   add_record(pvd + 156, 0, "\0", ROOT_SECTOR, SECTOR, 1);
+
+   image[(PVD_SECTOR + 1) * SECTOR] = 255;
+   memcpy(&image[(PVD_SECTOR + 1) * SECTOR + 1], "CD001", 5);
+
+   expected_count = 0;
+   expected[expected_count].lookup = "SYSTEM.CNF";
+   expected[expected_count].sector = system_cnf;
+   expected[expected_count++].size = 60;
+   expected[expected_count].lookup = "\\readme";
+   expected[expected_count].sector = readme;
+   expected[expected_count++].size = 5000;
+   expected[expected_count].lookup = "data/sub/DEEP.TXT;1";
+   expected[expected_count].sector = deep;
+   expected[expected_count++].size = 3;
+   expected[expected_count].lookup = "\\DATA\\FILE57.BIN;1";
+   expected[expected_count].sector = big;
+   expected[expected_count++].size = 3 * SECTOR + 100;
+   expected[expected_count].lookup = "DATA/FILE59.BIN";
+   expected[expected_count].sector = small;
+   expected[expected_count++].size = 2;
+
+   return image;
+}
+
+/* wraps each cooked sector as a raw MODE1/2352 sector */
+static uint8_t *make_raw(const uint8_t *image)
+{
+   static const uint8_t sync[12] =
+   { 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00 };
+   uint8_t *raw = (uint8_t*)calloc(IMAGE_SECTORS, 2352);
+   unsigned i;
+   for (i = 0; i < IMAGE_SECTORS; i++)
+   {
+      memcpy(raw + i * 2352, sync, sizeof(sync));
+      raw[i * 2352 + 15] = 1;
+      memcpy(raw + i * 2352 + 16, image + i * SECTOR, SECTOR);
+   }
+   return raw;
+}
+
+static void check_file(intfstream_t *stream, const expected_file_t *exp, const char *what)
+{
+   cdfs_file_t file;
+   uint8_t buffer[4 * SECTOR];
+   uint32_t i, got = 0;
+
+   if (!cdfs_open_file(&file, stream, exp->lookup))
+   {
+      CHECK(0, "%s: could not open %s", what, exp->lookup);
+      return;
+   }
+   CHECK(cdfs_get_size(&file) == exp->size, "%s: %s has size %d",
+         what, exp->lookup, (int)cdfs_get_size(&file));
+
+   /* odd-sized reads across sector edges */
+   while (got < exp->size)
+   {
+      int64_t n = cdfs_read_file(&file, buffer + got, 777);
+      if (n <= 0)
+         break;
+      got += (uint32_t)n;
+   }
+   CHECK(got == exp->size, "%s: read %u of %u bytes of %s", what, got, exp->size, exp->lookup);
+   for (i = 0; i < got; i++)
+      if (buffer[i] != file_byte(exp->sector, i))
+      {
+         CHECK(0, "%s: %s differs at %u", what, exp->lookup, i);
+         break;
+      }
+   CHECK(cdfs_read_file(&file, buffer, 1) == 0, "%s: read past the end", what);
+
+   /* seek back into the middle and read whole sectors from there */
+   if (exp->size > SECTOR + 10)
+   {
+      CHECK(cdfs_seek(&file, SECTOR, SEEK_SET) == 0, "%s: seek failed", what);
+      CHECK(cdfs_tell(&file) == SECTOR, "%s: tell after seek", what);
+      got = (uint32_t)cdfs_read_file(&file, buffer, exp->size);
+      CHECK(got == exp->size - SECTOR, "%s: read after seek got %u", what, got);
+      CHECK(buffer[0] == file_byte(exp->sector, SECTOR)
+            && buffer[got - 1] == file_byte(exp->sector, exp->size - 1),
+            "%s: data after seek", what);
+      CHECK(cdfs_seek(&file, -1, SEEK_END) == 0 && cdfs_read_file(&file, buffer, 8) == 1
+            && buffer[0] == file_byte(exp->sector, exp->size - 1),
+            "%s: seek from end", what);
+   }
+
+   cdfs_close_file(&file);
+}
+
+static void check_image(uint8_t *data, size_t size, const char *what)
+{
+   cdfs_file_t file;
+   unsigned i;
+   intfstream_t *stream = intfstream_open_memory(data,
+         RETRO_VFS_FILE_ACCESS_READ, RETRO_VFS_FILE_ACCESS_HINT_NONE, size);
+
+   for (i = 0; i < expected_count; i++)
+      check_file(stream, &expected[i], what);
+
+   CHECK(!cdfs_open_file(&file, stream, "MISSING.BIN"), "%s: found a missing file", what);
+   CHECK(!cdfs_open_file(&file, stream, "DATA/FILE60.BIN"), "%s: found a missing file", what);
+
+   /* a NULL path opens the raw track as 2048 byte sectors */
+   CHECK(cdfs_open_file(&file, stream, NULL)
+         && cdfs_get_size(&file) == IMAGE_SECTORS * SECTOR, "%s: raw open", what);
+
+   intfstream_close(stream);
+   free(stream);
+}
+
+static void check_cue(const uint8_t *raw)
+{
+   cdfs_file_t file;
+   intfstream_t *stream;
+   FILE *fp = fopen("cdfs_test_data.bin", "wb");
+   fwrite(raw, 2352, IMAGE_SECTORS, fp);
+   fclose(fp);
+   fp = fopen("cdfs_test_audio.bin", "wb");
+   fwrite(raw, 2352, 4, fp);
+   fclose(fp);
+   fp = fopen("cdfs_test.cue", "w");
+   fputs("FILE \"cdfs_test_audio.bin\" BINARY\n"
+         "  TRACK 01 AUDIO\n"
+         "    INDEX 01 00:00:00\n"
+         "FILE \"cdfs_test_data.bin\" BINARY\n"
+         "  TRACK 02 MODE1/2352\n"
+         "    INDEX 01 00:00:00\n", fp);
+   fclose(fp);
+
+   stream = cdfs_open_data_track("cdfs_test.cue");
+   CHECK(stream != NULL, "cue: could not open the data track");
+   if (stream)
+   {
+      CHECK(cdfs_open_file(&file, stream, "SYSTEM.CNF") && cdfs_get_size(&file) == 60,
+            "cue: SYSTEM.CNF not found");
+      intfstream_close(stream);
+      free(stream);
+   }
+
+   stream = cdfs_open_track("cdfs_test.cue", 2);
+   CHECK(stream != NULL, "cue: could not open track 2");
+   if (stream)
+   {
+      intfstream_close(stream);
+      free(stream);
+   }
+   CHECK(cdfs_open_track("cdfs_test.cue", 3) == NULL, "cue: opened a missing track");
+
+   remove("cdfs_test.cue");
+   remove("cdfs_test_audio.bin");
+   remove("cdfs_test_data.bin");
+}
+
+/* same descriptor, but SYSTEM.CNF shrunk in the root directory:
+ * the cached index of the original must not be used */
+static void check_patched(uint8_t *image)
+{
+   cdfs_file_t file;
+   intfstream_t *stream = intfstream_open_memory(image,
+         RETRO_VFS_FILE_ACCESS_READ, RETRO_VFS_FILE_ACCESS_HINT_NONE,
+         IMAGE_SECTORS * SECTOR);
+   uint8_t *root = image + ROOT_SECTOR * SECTOR;
+   uint8_t *rec  = root + root[0] + root[root[0]];
+
+   put_both32(&rec[10], 50);
+
+   CHECK(cdfs_open_file(&file, stream, "SYSTEM.CNF") && cdfs_get_size(&file) == 50,
+         "patched: got the size from a stale index");
+
+   intfstream_close(stream);
+   free(stream);
+}
+
+int main(void)
+{
+   uint8_t *image, *raw;
+   unsigned pass;
+
+   for (pass = 0; pass < 2; pass++)
+   {
+      const char *what = pass ? "cached" : "uncached";
+      if (pass)
+         cdfs_index_cache_init();
+
+      image = build_image(1);
+      raw   = make_raw(image);
+      check_image(image, IMAGE_SECTORS * SECTOR, what);
+      check_image(raw, IMAGE_SECTORS * 2352, what);
+
+      if (pass)
+         check_patched(image);
+      else
+         check_cue(raw);
+
+      free(image);
+      free(raw);
+
+      /* no path table: the directories are walked from the root */
+      image = build_image(0);
+      check_image(image, IMAGE_SECTORS * SECTOR, pass ? "walk, cached" : "walk");
+      free(image);
+   }
+
+   cdfs_index_cache_deinit();
+
+   if (failures)
+      printf("FAIL: %d checks failed\n", failures);
+   else
+      printf("PASS\n");
+   return failures ? 1 : 0;
+}
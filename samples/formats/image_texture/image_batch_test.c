@@ -0,0 +1,379 @@
+/* Copyright  (C) 2010-2020 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (image_batch_test.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include <formats/image.h>
+#include <formats/rpng.h>
+#include <features/features_cpu.h>
+#include <retro_timers.h>
+
+#include "../jpeg/jpeg_writer.h"
+
+/* Decodes a mix of PNG files and JPEGs in memory through the batch
+ * service, and checks each result against a plain load. Also checks
+ * scaled JPEGs, failures and cancelling images at every stage. */
+
+#define NUM_IMAGES 24
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf(__VA_ARGS__); printf("\n"); failures++; } } while (0)
+
+struct test_image
+{
+   char path[64];
+   uint8_t *jpg;     /* NULL for PNG files */
+   size_t len;
+   struct texture_image ref;
+   bool seen;
+};
+
+static uint8_t *make_rgb(int width, int height, int seed)
+{
+   int x, y;
+   uint8_t *rgb = (uint8_t*)malloc((size_t)width * height * 3);
+
+   for (y = 0; y < height; y++)
+      for (x = 0; x < width; x++)
+      {
+         uint8_t *p = rgb + ((size_t)y * width + x) * 3;
+         p[0] = (uint8_t)(128 + 100 * sin((x + seed * 7) / 23.0));
+         p[1] = (uint8_t)(y + seed * 40);
+         p[2] = (uint8_t)(((x / 16) & 1) ? 200 : 40 + seed);
+      }
+
+   return rgb;
+}
+
+static bool write_png(const char *path, int width, int height, int seed)
+{
+   size_t i, n    = (size_t)width * height;
+   uint8_t *rgb   = make_rgb(width, height, seed);
+   uint32_t *argb = (uint32_t*)malloc(n * sizeof(*argb));
+   bool ok;
+
+   for (i = 0; i < n; i++)
+      argb[i] = 0xff000000u | (uint32_t)rgb[i * 3] << 16
+         | (uint32_t)rgb[i * 3 + 1] << 8 | rgb[i * 3 + 2];
+
+   ok = rpng_save_image_argb(path, argb, width, height, width * 4);
+   free(argb);
+   free(rgb);
+   return ok;
+}
+
+static uint8_t *make_jpeg(int width, int height, int seed, size_t *len)
+{
+   jpeg_writer_opts opts = { 3, 2, 2, 90, 0, 0 };
+   uint8_t *rgb          = make_rgb(width, height, seed);
+   uint8_t *jpg          = jpeg_writer_encode(rgb, width, height, &opts, len);
+
+   free(rgb);
+   return jpg;
+}
+
+static bool same_image(const struct texture_image *a, const struct texture_image *b)
+{
+   return a->pixels && b->pixels
+      && a->width == b->width && a->height == b->height
+      && !memcmp(a->pixels, b->pixels, (size_t)a->width * a->height * 4);
+}
+
+static void make_images(struct test_image *images, int count, int width, int height)
+{
+   int i;
+
+   for (i = 0; i < count; i++)
+   {
+      struct test_image *t = &images[i];
+
+      memset(t, 0, sizeof(*t));
+      t->ref.supports_rgba = (i % 3) == 0;
+
+      if (i & 1)
+      {
+         t->jpg = make_jpeg(width, height, i, &t->len);
+         CHECK(image_texture_load_buffer(&t->ref, IMAGE_TYPE_JPEG, t->jpg, t->len),
+               "reference JPEG %d failed", i);
+      }
+      else
+      {
+         snprintf(t->path, sizeof(t->path), "/tmp/image_batch_test_%d.png", i);
+         CHECK(write_png(t->path, width, height, i), "writing %s failed", t->path);
+         CHECK(image_texture_load(&t->ref, t->path), "reference %s failed", t->path);
+      }
+   }
+}
+
+static void free_images(struct test_image *images, int count)
+{
+   int i;
+
+   for (i = 0; i < count; i++)
+   {
+      image_texture_free(&images[i].ref);
+      if (images[i].jpg)
+         free(images[i].jpg);
+      else
+         remove(images[i].path);
+   }
+}
+
+static uint32_t add_image(image_batch_t *batch, struct test_image *t)
+{
+   if (t->jpg)
+      return image_batch_add_buffer(batch, IMAGE_TYPE_JPEG, t->jpg, t->len,
+            0, 0, t->ref.supports_rgba, t);
+   return image_batch_add_file(batch, t->path, 0, 0, t->ref.supports_rgba, t);
+}
+
+static void test_results(unsigned threads)
+{
+   int i;
+   struct test_image images[NUM_IMAGES];
+   struct image_batch_result result;
+   uint32_t ids[NUM_IMAGES];
+   image_batch_t *batch = image_batch_new(threads);
+   int taken            = 0;
+
+   make_images(images, NUM_IMAGES, 200, 150);
+
+   for (i = 0; i < NUM_IMAGES; i++)
+   {
+      ids[i] = add_image(batch, &images[i]);
+      CHECK(ids[i], "%u threads: queueing image %d failed", threads, i);
+   }
+
+   while (image_batch_wait(batch, &result))
+   {
+      struct test_image *t = (struct test_image*)result.userdata;
+      int n                = (int)(t - images);
+
+      CHECK(result.success, "%u threads: image %d failed", threads, n);
+      CHECK(result.id == ids[n], "%u threads: image %d has id %u, not %u",
+            threads, n, result.id, ids[n]);
+      CHECK(!t->seen, "%u threads: image %d came back twice", threads, n);
+      CHECK(same_image(&t->ref, &result.image),
+            "%u threads: image %d isn't the same as a plain load", threads, n);
+      CHECK(result.image.supports_rgba == t->ref.supports_rgba,
+            "%u threads: image %d lost its format", threads, n);
+      t->seen = true;
+      taken++;
+      image_texture_free(&result.image);
+   }
+
+   CHECK(taken == NUM_IMAGES, "%u threads: %d of %d images came back",
+         threads, taken, NUM_IMAGES);
+   CHECK(!image_batch_poll(batch, &result), "%u threads: poll found more", threads);
+   CHECK(!image_batch_cancel(batch, ids[0]), "%u threads: taken image cancelled", threads);
+
+   image_batch_free(batch);
+   free_images(images, NUM_IMAGES);
+}
+
+static void test_scaled_and_broken(void)
+{
+   struct image_batch_result result;
+   static const uint8_t junk[64] = { 0xff, 0xd8, 0xff, 0xdb };
+   size_t len           = 0;
+   uint8_t *jpg         = make_jpeg(512, 384, 1, &len);
+   image_batch_t *batch = image_batch_new(2);
+   uint32_t id_small    = image_batch_add_buffer(batch, IMAGE_TYPE_JPEG, jpg, len, 64, 48, false, NULL);
+   uint32_t id_junk     = image_batch_add_buffer(batch, IMAGE_TYPE_JPEG, junk, sizeof(junk), 0, 0, false, NULL);
+   uint32_t id_missing  = image_batch_add_file(batch, "/tmp/image_batch_test_missing.png", 0, 0, false, NULL);
+
+   CHECK(!image_batch_add_file(batch, "/tmp/image_batch_test.txt", 0, 0, false, NULL),
+         "a file of no known type was queued");
+   CHECK(!image_batch_add_buffer(batch, IMAGE_TYPE_NONE, jpg, len, 0, 0, false, NULL),
+         "a buffer of no type was queued");
+
+   while (image_batch_wait(batch, &result))
+   {
+      if (result.id == id_small)
+         CHECK(result.success && result.image.width == 64 && result.image.height == 48,
+               "thumbnail is %ux%u", result.image.width, result.image.height);
+      else
+         CHECK(!result.success && !result.image.pixels
+               && (result.id == id_junk || result.id == id_missing),
+               "broken image %u didn't fail", result.id);
+      image_texture_free(&result.image);
+   }
+
+   image_batch_free(batch);
+   free(jpg);
+}
+
+static double now(void)
+{
+   return cpu_features_get_time_usec() / 1000000.0;
+}
+
+/* A file being decoded is left to its thread, so cancelling it must
+ * not take as long as the decode */
+static void test_cancel_running(void)
+{
+   double t0, t_decode, t_cancel;
+   struct image_batch_result result;
+   const char *path     = "/tmp/image_batch_test_big.png";
+   image_batch_t *batch = image_batch_new(1);
+   uint32_t id;
+
+   CHECK(write_png(path, 3000, 2000, 5), "writing %s failed", path);
+
+   t0 = now();
+   image_batch_add_file(batch, path, 0, 0, false, NULL);
+   CHECK(image_batch_wait(batch, &result) && result.success, "big PNG failed");
+   t_decode = now() - t0;
+   image_texture_free(&result.image);
+
+   id = image_batch_add_file(batch, path, 0, 0, false, NULL);
+   retro_sleep((unsigned)(t_decode * 250));
+   t0 = now();
+   CHECK(image_batch_cancel(batch, id), "cancelling a running file failed");
+   t_cancel = now() - t0;
+   CHECK(!image_batch_cancel(batch, id), "running file cancelled twice");
+   CHECK(t_cancel < t_decode / 10, "cancel took %.1f ms, the decode %.1f ms",
+         t_cancel * 1000.0, t_decode * 1000.0);
+   CHECK(!image_batch_wait(batch, &result), "cancelled file came back");
+
+   image_batch_free(batch);
+   remove(path);
+}
+
+/* Cancels every other image, some while waiting, some while being
+ * decoded and some already done, and frees the batch with work left */
+static void test_cancel(unsigned threads)
+{
+   int i, taken = 0, cancelled = 0;
+   struct test_image images[NUM_IMAGES];
+   struct image_batch_result result;
+   uint32_t ids[NUM_IMAGES];
+   image_batch_t *batch = image_batch_new(threads);
+
+   make_images(images, NUM_IMAGES, 640, 480);
+
+   for (i = 0; i < NUM_IMAGES; i++)
+      ids[i] = add_image(batch, &images[i]);
+
+   for (i = 0; i < NUM_IMAGES; i += 2)
+   {
+      CHECK(image_batch_cancel(batch, ids[i]), "%u threads: cancel %d failed", threads, i);
+      CHECK(!image_batch_cancel(batch, ids[i]), "%u threads: cancel %d twice", threads, i);
+      cancelled++;
+      /* Let some finish before the next cancel */
+      if (i == NUM_IMAGES / 2 && image_batch_wait(batch, &result))
+      {
+         struct test_image *t = (struct test_image*)result.userdata;
+         CHECK(((t - images) & 1), "%u threads: cancelled image came back", threads);
+         t->seen = true;
+         taken++;
+         image_texture_free(&result.image);
+      }
+   }
+
+   CHECK(!image_batch_cancel(batch, 0xdeadbeef), "%u threads: unknown id cancelled", threads);
+
+   while (image_batch_wait(batch, &result))
+   {
+      struct test_image *t = (struct test_image*)result.userdata;
+      int n                = (int)(t - images);
+      CHECK((n & 1), "%u threads: cancelled image %d came back", threads, n);
+      CHECK(same_image(&t->ref, &result.image), "%u threads: image %d differs", threads, n);
+      taken++;
+      image_texture_free(&result.image);
+   }
+
+   CHECK(taken + cancelled == NUM_IMAGES, "%u threads: %d taken, %d cancelled",
+         threads, taken, cancelled);
+
+   /* Freed with images waiting, being decoded and done */
+   for (i = 0; i < NUM_IMAGES; i++)
+      add_image(batch, &images[i]);
+   image_batch_poll(batch, &result);
+   image_texture_free(&result.image);
+   image_batch_free(batch);
+
+   free_images(images, NUM_IMAGES);
+}
+
+
+static void bench(void)
+{
+   int i;
+   double t0, t_plain, t_batch;
+   struct test_image images[NUM_IMAGES];
+   struct image_batch_result result;
+   image_batch_t *batch;
+
+   make_images(images, NUM_IMAGES, 1024, 768);
+
+   t0 = now();
+   for (i = 0; i < NUM_IMAGES; i++)
+   {
+      struct texture_image img = {0};
+      if (images[i].jpg)
+         image_texture_load_buffer(&img, IMAGE_TYPE_JPEG, images[i].jpg, images[i].len);
+      else
+         image_texture_load(&img, images[i].path);
+      image_texture_free(&img);
+   }
+   t_plain = now() - t0;
+
+   t0    = now();
+   batch = image_batch_new(0);
+   for (i = 0; i < NUM_IMAGES; i++)
+      add_image(batch, &images[i]);
+   while (image_batch_wait(batch, &result))
+      image_texture_free(&result.image);
+   image_batch_free(batch);
+   t_batch = now() - t0;
+
+   printf("%d 1024x768 images on %u cores: %.1f ms one by one, %.1f ms batched\n",
+         NUM_IMAGES, cpu_features_get_core_amount(), t_plain * 1000.0, t_batch * 1000.0);
+
+   free_images(images, NUM_IMAGES);
+}
+
+int main(void)
+{
+   test_results(1);
+   test_results(4);
+   test_scaled_and_broken();
+   test_cancel(1);
+   test_cancel(3);
+   test_cancel_running();
+   bench();
+
+   if (failures)
+   {
+      printf("%d check(s) failed\n", failures);
+      return 1;
+   }
+
+   printf("all checks passed\n");
+   return 0;
+}
@@ -0,0 +1,520 @@
+/* Copyright  (C) 2010-2020 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (image_output_test.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include <formats/image.h>
+#include <formats/rqoi.h>
+#include <features/features_cpu.h>
+
+#include "../jpeg/jpeg_writer.h"
+
+/* Builds BMPs, TGAs and QOIs of every layout the decoders read, and
+ * checks that they decode to their source pixels. Then decodes them, and
+ * JPEGs, into caller buffers of each pixel format with padded rows,
+ * and checks those against the plain ARGB8888 decode. */
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf(__VA_ARGS__); printf("\n"); failures++; } } while (0)
+
+struct bytes
+{
+   uint8_t *data;
+   size_t len;
+};
+
+static void put8(struct bytes *b, unsigned v)
+{
+   b->data[b->len++] = (uint8_t)v;
+}
+
+static void put16(struct bytes *b, unsigned v)
+{
+   put8(b, v & 0xff);
+   put8(b, v >> 8);
+}
+
+static void put32(struct bytes *b, uint32_t v)
+{
+   put16(b, v & 0xffff);
+   put16(b, v >> 16);
+}
+
+/* ARGB source pixels; opaque unless alpha is set */
+static uint32_t *make_argb(unsigned width, unsigned height, bool alpha)
+{
+   unsigned x, y;
+   uint32_t *argb = (uint32_t*)malloc(width * height * sizeof(*argb));
+
+   for (y = 0; y < height; y++)
+      for (x = 0; x < width; x++)
+      {
+         uint32_t a = alpha ? (x * 7 + y) & 0xff : 0xff;
+         uint32_t r = (uint32_t)(128 + 100 * sin(x / 9.0));
+         uint32_t g = (y * 3) & 0xff;
+         uint32_t b = ((x / 8 + y / 8) & 1) ? 220 : 20;
+         argb[y * width + x] = a << 24 | r << 16 | g << 8 | b;
+      }
+
+   return argb;
+}
+
+/* Greys, for palettes and 8 bit TGAs */
+static uint32_t *make_grey(unsigned width, unsigned height)
+{
+   unsigned i;
+   uint32_t *argb = (uint32_t*)malloc(width * height * sizeof(*argb));
+
+   for (i = 0; i < width * height; i++)
+   {
+      uint32_t l = (i * 13 + i / width) & 0xff;
+      argb[i]    = 0xff000000u | l << 16 | l << 8 | l;
+   }
+
+   return argb;
+}
+
+enum bmp_layout
+{
+   BMP_24_BOTTOM_UP = 0,
+   BMP_32_ALPHA,
+   BMP_8_PALETTE_TOP_DOWN
+};
+
+static struct bytes make_bmp(const uint32_t *argb, unsigned width,
+      unsigned height, enum bmp_layout layout)
+{
+   unsigned x, y, i;
+   struct bytes b;
+   unsigned hsz    = layout == BMP_32_ALPHA ? 108 : 40;
+   unsigned bpp    = layout == BMP_24_BOTTOM_UP ? 24 : layout == BMP_32_ALPHA ? 32 : 8;
+   unsigned pal    = layout == BMP_8_PALETTE_TOP_DOWN ? 256 * 4 : 0;
+   unsigned stride = (width * bpp / 8 + 3) & ~3u;
+   unsigned offset = 14 + hsz + pal;
+
+   b.len  = 0;
+   b.data = (uint8_t*)calloc(1, offset + stride * height);
+
+   put8(&b, 'B');
+   put8(&b, 'M');
+   put32(&b, offset + stride * height);
+   put32(&b, 0);
+   put32(&b, offset);
+   put32(&b, hsz);
+   put32(&b, width);
+   put32(&b, layout == BMP_8_PALETTE_TOP_DOWN ? (uint32_t)-(int32_t)height : height);
+   put16(&b, 1);
+   put16(&b, bpp);
+   put32(&b, layout == BMP_32_ALPHA ? 3 : 0);
+   for (i = 0; i < 5; i++)
+      put32(&b, 0);
+   if (layout == BMP_32_ALPHA)
+   {
+      put32(&b, 0x00ff0000);
+      put32(&b, 0x0000ff00);
+      put32(&b, 0x000000ff);
+      put32(&b, 0xff000000);
+      put32(&b, 0);
+      for (i = 0; i < 12; i++)
+         put32(&b, 0);
+   }
+   for (i = 0; i < pal / 4; i++)
+      put32(&b, i | i << 8 | i << 16);
+
+   for (y = 0; y < height; y++)
+   {
+      unsigned row = layout == BMP_8_PALETTE_TOP_DOWN ? y : height - 1 - y;
+      size_t start = b.len;
+
+      for (x = 0; x < width; x++)
+      {
+         uint32_t p = argb[row * width + x];
+         if (bpp == 8)
+            put8(&b, p & 0xff);
+         else
+         {
+            put8(&b, p & 0xff);
+            put8(&b, (p >> 8) & 0xff);
+            put8(&b, (p >> 16) & 0xff);
+            if (bpp == 32)
+               put8(&b, p >> 24);
+         }
+      }
+      b.len = start + stride;
+   }
+
+   return b;
+}
+
+enum tga_layout
+{
+   TGA_24_BOTTOM_UP = 0,
+   TGA_32_TOP_DOWN,
+   TGA_32_RLE,
+   TGA_8_GREY
+};
+
+static struct bytes make_tga(const uint32_t *argb, unsigned width,
+      unsigned height, enum tga_layout layout)
+{
+   unsigned x, y;
+   struct bytes b;
+   unsigned comp = layout == TGA_24_BOTTOM_UP ? 3 : layout == TGA_8_GREY ? 1 : 4;
+
+   b.len  = 0;
+   /* RLE can take a command byte per pixel */
+   b.data = (uint8_t*)malloc(18 + (size_t)width * height * (comp + 1));
+
+   put8(&b, 0);
+   put8(&b, 0);
+   put8(&b, layout == TGA_8_GREY ? 3 : layout == TGA_32_RLE ? 10 : 2);
+   put16(&b, 0);
+   put16(&b, 0);
+   put8(&b, 0);
+   put16(&b, 0);
+   put16(&b, 0);
+   put16(&b, width);
+   put16(&b, height);
+   put8(&b, comp * 8);
+   put8(&b, layout == TGA_32_TOP_DOWN || layout == TGA_32_RLE ? 0x20 : 0);
+
+   for (y = 0; y < height; y++)
+   {
+      unsigned row = layout == TGA_32_TOP_DOWN || layout == TGA_32_RLE ? y : height - 1 - y;
+
+      for (x = 0; x < width; x++)
+      {
+         const uint32_t *p = &argb[row * width + x];
+         unsigned run      = 1;
+
+         if (layout == TGA_32_RLE)
+         {
+            /* Runs of equal pixels, which may cross rows */
+            while (run < 128 && row * width + x + run < width * height
+                  && p[run] == p[0] && x + run < width)
+               run++;
+            put8(&b, run > 1 ? 0x80 | (run - 1) : 0);
+         }
+
+         if (comp == 1)
+            put8(&b, *p & 0xff);
+         else
+         {
+            put8(&b, *p & 0xff);
+            put8(&b, (*p >> 8) & 0xff);
+            put8(&b, (*p >> 16) & 0xff);
+            if (comp == 4)
+               put8(&b, *p >> 24);
+         }
+         x += run - 1;
+      }
+   }
+
+   return b;
+}
+
+static uint32_t *decode(enum image_type_enum type, const struct bytes *b,
+      const struct image_output *output, unsigned *width, unsigned *height)
+{
+   uint32_t *pixels = NULL;
+   void *img        = image_transfer_new(type);
+   int ret;
+
+   image_transfer_set_buffer_ptr(img, type, b->data, b->len);
+   if (output && !image_transfer_set_output(img, type, output))
+   {
+      image_transfer_free(img, type);
+      return NULL;
+   }
+   if (!image_transfer_start(img, type))
+   {
+      image_transfer_free(img, type);
+      return NULL;
+   }
+
+   do
+   {
+      ret = image_transfer_process(img, type, &pixels, b->len, width, height);
+   } while (ret == IMAGE_PROCESS_NEXT);
+
+   image_transfer_free(img, type);
+   return ret == IMAGE_PROCESS_END ? pixels : NULL;
+}
+
+static uint32_t argb_to(uint32_t p, enum image_pixel_format format)
+{
+   switch (format)
+   {
+      case IMAGE_PIXEL_ABGR8888:
+         return (p & 0xff00ff00) | (p >> 16 & 0xff) | (p & 0xff) << 16;
+      case IMAGE_PIXEL_RGB565:
+         return (p >> 8 & 0xf800) | (p >> 5 & 0x07e0) | (p >> 3 & 0x001f);
+      default:
+         break;
+   }
+   return p;
+}
+
+/* Decodes into a padded buffer of each format, and checks the pixels
+ * against ref and that the padding is untouched */
+static void check_formats(enum image_type_enum type, const struct bytes *b,
+      const uint32_t *ref, unsigned width, unsigned height, const char *what)
+{
+   static const char *names[] = { "ARGB8888", "ABGR8888", "RGB565" };
+   unsigned f, x, y, w = 0, h = 0;
+   struct image_output output;
+
+   {
+      void *img = image_transfer_new(type);
+      image_transfer_set_buffer_ptr(img, type, b->data, b->len);
+      CHECK(image_transfer_get_size(img, type, b->len, &w, &h)
+            && w == width && h == height,
+            "%s: size is %ux%u, not %ux%u", what, w, h, width, height);
+      image_transfer_free(img, type);
+   }
+
+   for (f = 0; f <= IMAGE_PIXEL_RGB565; f++)
+   {
+      unsigned bpp    = f == IMAGE_PIXEL_RGB565 ? 2 : 4;
+      size_t pitch    = (width + 5) * bpp;
+      uint8_t *buf    = (uint8_t*)malloc(pitch * (height + 1));
+      uint32_t *out;
+      bool same       = true;
+      bool padding    = true;
+
+      memset(buf, 0xa5, pitch * (height + 1));
+      output.data   = buf;
+      output.pitch  = pitch;
+      output.width  = width;
+      output.height = height + 1;
+      output.format = (enum image_pixel_format)f;
+
+      out = decode(type, b, &output, &w, &h);
+      CHECK(out == (uint32_t*)buf, "%s %s: didn't decode into the buffer", what, names[f]);
+
+      for (y = 0; out && y < height; y++)
+      {
+         const uint8_t *row = buf + pitch * y;
+         for (x = 0; x < width; x++)
+         {
+            uint32_t want = argb_to(ref[y * width + x], output.format);
+            uint32_t got  = bpp == 2 ? ((const uint16_t*)row)[x] : ((const uint32_t*)row)[x];
+            if (got != want)
+               same = false;
+         }
+         for (x = width * bpp; x < pitch; x++)
+            if (row[x] != 0xa5)
+               padding = false;
+      }
+      for (x = 0; x < pitch; x++)
+         if (buf[pitch * height + x] != 0xa5)
+            padding = false;
+
+      CHECK(same, "%s %s: pixels differ", what, names[f]);
+      CHECK(padding, "%s %s: wrote past the rows", what, names[f]);
+
+      /* Left to the decoder, it allocates a packed buffer */
+      output.data = NULL;
+      out = decode(type, b, &output, &w, &h);
+      CHECK(out && w == width && h == height, "%s %s: allocating decode failed", what, names[f]);
+      if (out)
+      {
+         same = true;
+         for (x = 0; x < width * height; x++)
+         {
+            uint32_t got = bpp == 2 ? ((const uint16_t*)out)[x] : out[x];
+            if (got != argb_to(ref[x], output.format))
+               same = false;
+         }
+         CHECK(same, "%s %s: allocated pixels differ", what, names[f]);
+         free(out);
+      }
+
+      /* Too small a buffer fails rather than overflowing it */
+      output.data   = buf;
+      output.height = height - 1;
+      CHECK(!decode(type, b, &output, &w, &h), "%s %s: decoded into too small a buffer", what, names[f]);
+
+      free(buf);
+   }
+}
+
+/* Lossless formats must give back their source */
+static void check_lossless(enum image_type_enum type, const struct bytes *b,
+      const uint32_t *src, unsigned width, unsigned height, const char *what)
+{
+   unsigned w = 0, h = 0;
+   uint32_t *argb = decode(type, b, NULL, &w, &h);
+
+   CHECK(argb && w == width && h == height, "%s: decode failed", what);
+   if (argb && w == width && h == height)
+   {
+      CHECK(!memcmp(argb, src, width * height * 4), "%s: pixels differ from the source", what);
+      check_formats(type, b, src, width, height, what);
+   }
+   free(argb);
+}
+
+static double now(void)
+{
+   return cpu_features_get_time_usec() / 1000000.0;
+}
+
+int main(void)
+{
+   static const unsigned sizes[][2] = { { 1, 1 }, { 7, 3 }, { 61, 47 }, { 320, 240 } };
+   static const char *bmp_names[] = { "24 bit BMP", "32 bit BMP", "8 bit BMP" };
+   static const char *tga_names[] = { "24 bit TGA", "32 bit TGA", "RLE TGA", "grey TGA" };
+   unsigned z, l, w, h, i;
+   jpeg_writer_opts opts = { 3, 2, 2, 90, 0, 0 };
+   double t0, t_alloc, t_into;
+   char what[64];
+
+   for (z = 0; z < sizeof(sizes) / sizeof(sizes[0]); z++)
+   {
+      unsigned width  = sizes[z][0];
+      unsigned height = sizes[z][1];
+      uint32_t *argb  = make_argb(width, height, false);
+      uint32_t *alpha = make_argb(width, height, true);
+      uint32_t *grey  = make_grey(width, height);
+      uint8_t *rgb    = (uint8_t*)malloc(width * height * 3);
+      struct bytes b;
+      uint64_t len;
+      uint32_t *ref;
+
+      for (l = 0; l <= BMP_8_PALETTE_TOP_DOWN; l++)
+      {
+         const uint32_t *src = l == BMP_32_ALPHA ? alpha
+            : l == BMP_8_PALETTE_TOP_DOWN ? grey : argb;
+         snprintf(what, sizeof(what), "%ux%u %s", width, height, bmp_names[l]);
+         b = make_bmp(src, width, height, (enum bmp_layout)l);
+         check_lossless(IMAGE_TYPE_BMP, &b, src, width, height, what);
+         free(b.data);
+      }
+
+      for (l = 0; l <= TGA_8_GREY; l++)
+      {
+         const uint32_t *src = l == TGA_24_BOTTOM_UP ? argb
+            : l == TGA_8_GREY ? grey : alpha;
+         snprintf(what, sizeof(what), "%ux%u %s", width, height, tga_names[l]);
+         b = make_tga(src, width, height, (enum tga_layout)l);
+         check_lossless(IMAGE_TYPE_TGA, &b, src, width, height, what);
+         free(b.data);
+      }
+
+      b.data = rqoi_save_image_string(argb, width, height, width * 4,
+            RQOI_SOURCE_TYPE_XRGB8888, &len);
+      b.len  = (size_t)len;
+      snprintf(what, sizeof(what), "%ux%u RGB QOI", width, height);
+      check_lossless(IMAGE_TYPE_QOI, &b, argb, width, height, what);
+      free(b.data);
+
+      b.data = rqoi_save_image_string(alpha, width, height, width * 4,
+            RQOI_SOURCE_TYPE_ARGB8888, &len);
+      b.len  = (size_t)len;
+      snprintf(what, sizeof(what), "%ux%u RGBA QOI", width, height);
+      check_lossless(IMAGE_TYPE_QOI, &b, alpha, width, height, what);
+      free(b.data);
+
+      /* JPEGs are checked against their own ARGB decode */
+      for (i = 0; i < width * height; i++)
+      {
+         rgb[i * 3 + 0] = argb[i] >> 16;
+         rgb[i * 3 + 1] = argb[i] >> 8;
+         rgb[i * 3 + 2] = argb[i];
+      }
+      b.data = jpeg_writer_encode(rgb, width, height, &opts, &b.len);
+      ref    = decode(IMAGE_TYPE_JPEG, &b, NULL, &w, &h);
+      snprintf(what, sizeof(what), "%ux%u JPEG", width, height);
+      CHECK(ref, "%s: decode failed", what);
+      if (ref)
+         check_formats(IMAGE_TYPE_JPEG, &b, ref, width, height, what);
+      free(ref);
+      free(b.data);
+
+      free(rgb);
+      free(grey);
+      free(alpha);
+      free(argb);
+   }
+
+   /* Times a photo decoded to a new buffer and into a reused one */
+   {
+      unsigned width  = 2048, height = 1536;
+      uint32_t *argb  = make_argb(width, height, false);
+      uint8_t *rgb    = (uint8_t*)malloc(width * height * 3);
+      uint32_t *dst   = (uint32_t*)malloc(width * height * 4);
+      struct image_output output;
+      struct bytes b;
+
+      for (i = 0; i < width * height; i++)
+      {
+         rgb[i * 3 + 0] = argb[i] >> 16;
+         rgb[i * 3 + 1] = argb[i] >> 8;
+         rgb[i * 3 + 2] = argb[i];
+      }
+      b.data = jpeg_writer_encode(rgb, width, height, &opts, &b.len);
+
+      output.data   = dst;
+      output.pitch  = width * 4;
+      output.width  = width;
+      output.height = height;
+      output.format = IMAGE_PIXEL_ABGR8888;
+
+      t0 = now();
+      for (i = 0; i < 4; i++)
+      {
+         struct texture_image img = {0};
+         img.supports_rgba = true;
+         image_texture_load_buffer(&img, IMAGE_TYPE_JPEG, b.data, b.len);
+         image_texture_free(&img);
+      }
+      t_alloc = (now() - t0) / 4;
+
+      t0 = now();
+      for (i = 0; i < 4; i++)
+         decode(IMAGE_TYPE_JPEG, &b, &output, &w, &h);
+      t_into = (now() - t0) / 4;
+
+      printf("%ux%u JPEG to RGBA: %.1f ms loaded, %.1f ms into a reused buffer\n",
+            width, height, t_alloc * 1000.0, t_into * 1000.0);
+
+      free(b.data);
+      free(dst);
+      free(rgb);
+      free(argb);
+   }
+
+   if (failures)
+   {
+      printf("%d check(s) failed\n", failures);
+      return 1;
+   }
+
+   printf("all checks passed\n");
+   return 0;
+}
@@ -0,0 +1,399 @@
+/* Copyright  (C) 2010-2020 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (image_texture_cache_test.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/stat.h>
+
+#include <formats/image.h>
+#include <features/features_cpu.h>
+#include <rthreads/rthreads.h>
+
+#include "../jpeg/jpeg_writer.h"
+
+/* Loads JPEGs through the texture cache, and checks that a hit gives
+ * the same pixels as decoding without reading the source, that a
+ * changed source or scale target misses, that the cache keeps to
+ * its budget, and that loads survive the cache being torn down under
+ * them. */
+
+#define CACHE_DIR "/tmp/image_texture_cache_test"
+#define SRC_DIR   "/tmp/image_texture_cache_src"
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf(__VA_ARGS__); printf("\n"); failures++; } } while (0)
+
+/* Writes a width x height JPEG whose colours depend on seed */
+static bool write_jpeg(const char *path, int width, int height, int seed)
+{
+   int x, y;
+   size_t len            = 0;
+   bool ok               = false;
+   jpeg_writer_opts opts = { 3, 2, 2, 90, 0, 0 };
+   uint8_t *rgb          = (uint8_t*)malloc((size_t)width * height * 3);
+   uint8_t *jpg;
+   FILE *f;
+
+   for (y = 0; y < height; y++)
+      for (x = 0; x < width; x++)
+      {
+         uint8_t *p = rgb + ((size_t)y * width + x) * 3;
+         p[0] = (uint8_t)(128 + 100 * sin((x + seed * 7) / 23.0));
+         p[1] = (uint8_t)(y + seed * 40);
+         p[2] = (uint8_t)(((x / 16) & 1) ? 200 : 40 + seed);
+      }
+
+   jpg = jpeg_writer_encode(rgb, width, height, &opts, &len);
+   if (jpg && (f = fopen(path, "wb")))
+   {
+      ok = fwrite(jpg, 1, len, f) == len;
+      fclose(f);
+   }
+
+   free(jpg);
+   free(rgb);
+   return ok;
+}
+
+static void clear_dir(const char *dir)
+{
+   DIR *d = opendir(dir);
+   struct dirent *ent;
+
+   if (!d)
+      return;
+
+   while ((ent = readdir(d)))
+   {
+      char file[512];
+      if (ent->d_name[0] == '.')
+         continue;
+      snprintf(file, sizeof(file), "%s/%s", dir, ent->d_name);
+      unlink(file);
+   }
+
+   closedir(d);
+}
+
+/* Number and total size of the files in dir */
+static unsigned dir_files(const char *dir, uint64_t *total)
+{
+   unsigned count = 0;
+   DIR *d         = opendir(dir);
+   struct dirent *ent;
+
+   *total = 0;
+   if (!d)
+      return 0;
+
+   while ((ent = readdir(d)))
+   {
+      char file[512];
+      struct stat st;
+      if (ent->d_name[0] == '.')
+         continue;
+      snprintf(file, sizeof(file), "%s/%s", dir, ent->d_name);
+      if (stat(file, &st) == 0)
+      {
+         *total += (uint64_t)st.st_size;
+         count++;
+      }
+   }
+
+   closedir(d);
+   return count;
+}
+
+static bool same_image(const struct texture_image *a, const struct texture_image *b)
+{
+   return a->pixels && b->pixels
+      && a->width == b->width && a->height == b->height
+      && !memcmp(a->pixels, b->pixels, (size_t)a->width * a->height * sizeof(uint32_t));
+}
+
+static void test_hits(void)
+{
+   struct texture_image plain, miss, hit, rgba, small;
+   struct utimbuf times;
+   struct stat st;
+   uint64_t total;
+   size_t i;
+   const char *path = SRC_DIR "/a.jpg";
+   bool swapped     = true;
+
+   memset(&plain, 0, sizeof(plain));
+   memset(&miss,  0, sizeof(miss));
+   memset(&hit,   0, sizeof(hit));
+   memset(&rgba,  0, sizeof(rgba));
+   memset(&small, 0, sizeof(small));
+
+   write_jpeg(path, 512, 384, 0);
+
+   CHECK(image_texture_load(&plain, path), "plain load failed");
+   CHECK(image_texture_load_cached(&miss, path, 0, 0), "first cached load failed");
+   CHECK(same_image(&plain, &miss), "first cached load differs from a plain load");
+   CHECK(dir_files(CACHE_DIR, &total) == 1, "no cache file written");
+
+   CHECK(image_texture_load_cached(&hit, path, 0, 0), "second cached load failed");
+   CHECK(same_image(&plain, &hit), "cache hit differs from a plain load");
+
+   /* Colour order is applied after the cache, so the same file serves both */
+   rgba.supports_rgba = true;
+   CHECK(image_texture_load_cached(&rgba, path, 0, 0), "RGBA cached load failed");
+   for (i = 0; rgba.pixels && i < (size_t)plain.width * plain.height; i++)
+   {
+      uint32_t p = plain.pixels[i];
+      if (rgba.pixels[i] != ((p & 0xff00ff00) | (p >> 16 & 0xff) | (p & 0xff) << 16))
+         swapped = false;
+   }
+   CHECK(rgba.pixels && swapped, "RGBA cached load isn't the plain load swapped");
+   CHECK(same_image(&plain, &hit), "converting to RGBA changed another mapping");
+
+   /* A thumbnail is its own entry */
+   CHECK(image_texture_load_cached(&small, path, 64, 48), "thumbnail load failed");
+   CHECK(small.width == 64 && small.height == 48, "thumbnail is %ux%u", small.width, small.height);
+   CHECK(dir_files(CACHE_DIR, &total) == 2, "thumbnail not cached on its own");
+
+   image_texture_free(&miss);
+   image_texture_free(&hit);
+   image_texture_free(&rgba);
+   image_texture_free(&small);
+
+   /* Zeroes of the old size, with the old time, still hit; that
+    * shows the source isn't read... */
+   stat(path, &st);
+   {
+      FILE *f = fopen(path, "r+b");
+      char *zeroes = (char*)calloc(1, (size_t)st.st_size);
+      if (f)
+      {
+         fwrite(zeroes, 1, (size_t)st.st_size, f);
+         fclose(f);
+      }
+      free(zeroes);
+   }
+   times.actime  = st.st_atime;
+   times.modtime = st.st_mtime;
+   utime(path, &times);
+   CHECK(!image_texture_load(&hit, path), "zeroes decoded");
+   CHECK(image_texture_load_cached(&hit, path, 0, 0), "load of a zeroed file failed");
+   CHECK(same_image(&plain, &hit), "zeroed file with the old time missed");
+   image_texture_free(&hit);
+
+   /* ...and a new time misses */
+   write_jpeg(path, 512, 384, 1);
+   times.modtime += 10;
+   utime(path, &times);
+   CHECK(image_texture_load_cached(&miss, path, 0, 0), "load of a touched file failed");
+   CHECK(miss.pixels && !same_image(&plain, &miss), "touched file still hit");
+   image_texture_free(&miss);
+
+   /* Entries are picked up again after a restart */
+   image_texture_cache_deinit();
+   CHECK(image_texture_cache_init(CACHE_DIR, 0), "cache init failed");
+   CHECK(image_texture_load_cached(&hit, path, 64, 48), "thumbnail load after restart failed");
+   CHECK(hit.width == 64 && hit.height == 48, "thumbnail after restart is %ux%u", hit.width, hit.height);
+   image_texture_free(&hit);
+
+   /* A damaged file misses, and is rewritten */
+   clear_dir(CACHE_DIR);
+   CHECK(image_texture_load_cached(&miss, path, 0, 0), "load into an emptied cache failed");
+   image_texture_free(&miss);
+   {
+      DIR *d = opendir(CACHE_DIR);
+      struct dirent *ent;
+      while (d && (ent = readdir(d)))
+      {
+         char file[512];
+         if (ent->d_name[0] == '.')
+            continue;
+         snprintf(file, sizeof(file), "%s/%s", CACHE_DIR, ent->d_name);
+         truncate(file, 100);
+      }
+      if (d)
+         closedir(d);
+   }
+   CHECK(image_texture_load_cached(&miss, path, 0, 0), "load over a damaged cache file failed");
+   CHECK(miss.width == 512 && miss.height == 384, "damaged cache file was used");
+   image_texture_free(&miss);
+
+   image_texture_free(&plain);
+}
+
+static void test_budget(void)
+{
+   unsigned i, count;
+   uint64_t total;
+   struct texture_image img;
+   /* each entry is a little over 256x256x4 */
+   uint64_t budget = 3 * 256 * 256 * 4 + 3 * 1024;
+
+   image_texture_cache_deinit();
+   clear_dir(CACHE_DIR);
+   CHECK(image_texture_cache_init(CACHE_DIR, budget), "cache init failed");
+
+   for (i = 0; i < 8; i++)
+   {
+      char path[256];
+      snprintf(path, sizeof(path), SRC_DIR "/b%u.jpg", i);
+      write_jpeg(path, 256, 256, (int)i);
+
+      memset(&img, 0, sizeof(img));
+      CHECK(image_texture_load_cached(&img, path, 0, 0), "budget load %u failed", i);
+      image_texture_free(&img);
+
+      /* keep b0 in use, so it outlives the others */
+      memset(&img, 0, sizeof(img));
+      image_texture_load_cached(&img, SRC_DIR "/b0.jpg", 0, 0);
+      image_texture_free(&img);
+
+      count = dir_files(CACHE_DIR, &total);
+      CHECK(total <= budget, "cache is %llu bytes, over its %llu budget",
+            (unsigned long long)total, (unsigned long long)budget);
+   }
+
+   CHECK(count == 3, "%u files cached, not 3", count);
+}
+
+static slock_t *race_lock = NULL;
+static bool race_done     = false;
+
+static void race_loader(void *data)
+{
+   struct texture_image img;
+   const char *path = (const char*)data;
+
+   for (;;)
+   {
+      bool done;
+      slock_lock(race_lock);
+      done = race_done;
+      slock_unlock(race_lock);
+      if (done)
+         break;
+
+      memset(&img, 0, sizeof(img));
+      if (image_texture_load_cached(&img, path, 0, 0))
+         image_texture_free(&img);
+   }
+}
+
+/* deinit frees the directory while loaders may be building names in it */
+static void test_deinit_race(void)
+{
+   unsigned i;
+   sthread_t *threads[2];
+
+   write_jpeg(SRC_DIR "/r0.jpg", 64, 64, 5);
+   write_jpeg(SRC_DIR "/r1.jpg", 64, 48, 6);
+
+   race_lock  = slock_new();
+   race_done  = false;
+   threads[0] = sthread_create(race_loader, (void*)SRC_DIR "/r0.jpg");
+   threads[1] = sthread_create(race_loader, (void*)SRC_DIR "/r1.jpg");
+   CHECK(threads[0] && threads[1], "could not start the loaders");
+
+   for (i = 0; i < 200; i++)
+   {
+      image_texture_cache_deinit();
+      CHECK(image_texture_cache_init(CACHE_DIR, 0), "reinit %u failed", i);
+   }
+
+   slock_lock(race_lock);
+   race_done = true;
+   slock_unlock(race_lock);
+   for (i = 0; i < 2; i++)
+      if (threads[i])
+         sthread_join(threads[i]);
+   slock_free(race_lock);
+}
+
+int main(void)
+{
+   struct texture_image img;
+   double t0, t_decode, t_hit;
+   unsigned i;
+
+   mkdir(SRC_DIR, 0755);
+   clear_dir(SRC_DIR);
+   mkdir(CACHE_DIR, 0755);
+   clear_dir(CACHE_DIR);
+
+   CHECK(image_texture_cache_init(CACHE_DIR, 0), "cache init failed");
+
+   test_hits();
+   test_budget();
+   test_deinit_race();
+
+   /* Thumbnail grid: a decode of each, then hits */
+   image_texture_cache_deinit();
+   clear_dir(CACHE_DIR);
+   image_texture_cache_init(CACHE_DIR, 0);
+   write_jpeg(SRC_DIR "/c.jpg", 1024, 768, 3);
+
+   t0 = cpu_features_get_time_usec();
+   for (i = 0; i < 20; i++)
+   {
+      memset(&img, 0, sizeof(img));
+      image_texture_load(&img, SRC_DIR "/c.jpg");
+      image_texture_free(&img);
+   }
+   t_decode = (cpu_features_get_time_usec() - t0) / 20000.0;
+
+   memset(&img, 0, sizeof(img));
+   image_texture_load_cached(&img, SRC_DIR "/c.jpg", 0, 0);
+   image_texture_free(&img);
+
+   t0 = cpu_features_get_time_usec();
+   for (i = 0; i < 20; i++)
+   {
+      memset(&img, 0, sizeof(img));
+      image_texture_load_cached(&img, SRC_DIR "/c.jpg", 0, 0);
+      image_texture_free(&img);
+   }
+   t_hit = (cpu_features_get_time_usec() - t0) / 20000.0;
+
+   printf("1024x768 JPEG: %.2f ms decoded, %.2f ms from the cache\n", t_decode, t_hit);
+
+   image_texture_cache_deinit();
+   clear_dir(CACHE_DIR);
+   clear_dir(SRC_DIR);
+   rmdir(CACHE_DIR);
+   rmdir(SRC_DIR);
+
+   if (failures)
+   {
+      printf("%d check(s) failed\n", failures);
+      return 1;
+   }
+
+   printf("all checks passed\n");
+   return 0;
+}
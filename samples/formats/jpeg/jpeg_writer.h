@@ -0,0 +1,404 @@
+/* Copyright  (C) 2010-2020 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (jpeg_writer.h).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __JPEG_WRITER_H__
+#define __JPEG_WRITER_H__
+
+/* Minimal JPEG writer for the decoder tests, since there's no JPEG
+ * encoder in the tree. Slow floating point DCT and flat Huffman tables
+ * (every code the same length); what it covers is the stream layout:
+ * grey or YCbCr, any sampling factors, restart intervals, and
+ * progressive files with spectral selection. */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+   int comps;            /* 1 or 3 */
+   int h, v;             /* luma sampling factors, chroma is 1x1 */
+   int quality;          /* 1..100 */
+   int restart_interval; /* in MCUs, 0 for none; baseline only */
+   int progressive;
+} jpeg_writer_opts;
+
+typedef struct
+{
+   uint8_t *data;
+   size_t len, cap;
+   uint32_t bits;
+   int nbits;
+} jpeg_writer_buf;
+
+static void jpeg_writer_byte(jpeg_writer_buf *b, uint8_t c)
+{
+   if (b->len == b->cap)
+   {
+      b->cap  = b->cap ? b->cap * 2 : 4096;
+      b->data = (uint8_t*)realloc(b->data, b->cap);
+   }
+   b->data[b->len++] = c;
+}
+
+static void jpeg_writer_word(jpeg_writer_buf *b, unsigned w)
+{
+   jpeg_writer_byte(b, (uint8_t)(w >> 8));
+   jpeg_writer_byte(b, (uint8_t)w);
+}
+
+static void jpeg_writer_bits(jpeg_writer_buf *b, unsigned code, int size)
+{
+   b->bits   = (b->bits << size) | (code & ((1u << size) - 1));
+   b->nbits += size;
+   while (b->nbits >= 8)
+   {
+      uint8_t c = (uint8_t)(b->bits >> (b->nbits - 8));
+      jpeg_writer_byte(b, c);
+      if (c == 0xff)
+         jpeg_writer_byte(b, 0);
+      b->nbits -= 8;
+   }
+}
+
+static void jpeg_writer_flush(jpeg_writer_buf *b)
+{
+   if (b->nbits)
+      jpeg_writer_bits(b, 0x7f, 8 - b->nbits);
+   b->bits = 0;
+}
+
+/* DC symbols 0..11 all take 4 bits, AC symbols 8 bits, in this order */
+static int jpeg_writer_ac_symbol(int sym)
+{
+   if (sym == 0x00)
+      return 0;
+   if (sym == 0xf0)
+      return 1;
+   return 2 + (sym >> 4) * 10 + (sym & 15) - 1;
+}
+
+/* Number of bits in the magnitude */
+static int jpeg_writer_size(int v)
+{
+   int a = v < 0 ? -v : v;
+   int s = 0;
+   while (a >> s)
+      s++;
+   return s;
+}
+
+static void jpeg_writer_dc(jpeg_writer_buf *b, int diff)
+{
+   int s = jpeg_writer_size(diff);
+   jpeg_writer_bits(b, (unsigned)s, 4);
+   if (s)
+      jpeg_writer_bits(b, (unsigned)(diff < 0 ? diff - 1 : diff), s);
+}
+
+static void jpeg_writer_ac(jpeg_writer_buf *b, const short *zz)
+{
+   int k, run = 0;
+   for (k = 1; k < 64; k++)
+   {
+      int s;
+      if (!zz[k])
+      {
+         run++;
+         continue;
+      }
+      while (run > 15)
+      {
+         jpeg_writer_bits(b, (unsigned)jpeg_writer_ac_symbol(0xf0), 8);
+         run -= 16;
+      }
+      s = jpeg_writer_size(zz[k]);
+      jpeg_writer_bits(b, (unsigned)jpeg_writer_ac_symbol(run << 4 | s), 8);
+      jpeg_writer_bits(b, (unsigned)(zz[k] < 0 ? zz[k] - 1 : zz[k]), s);
+      run = 0;
+   }
+   if (run)
+      jpeg_writer_bits(b, 0, 8); /* EOB */
+}
+
+typedef struct
+{
+   int h, v;
+   int w, ht;   /* plane size in samples */
+   int bw, bh;  /* blocks covering the MCU-padded plane */
+   short *zz;   /* quantized coefficients in zigzag order, per block */
+} jpeg_writer_comp;
+
+/* Returns a malloc'd JPEG of the 8-bit RGB image, or NULL */
+static uint8_t *jpeg_writer_encode(const uint8_t *rgb, int width, int height,
+      const jpeg_writer_opts *opts, size_t *len)
+{
+   static const uint8_t base_q[64] = {
+      16, 11, 10, 16,  24,  40,  51,  61,
+      12, 12, 14, 19,  26,  58,  60,  55,
+      14, 13, 16, 24,  40,  57,  69,  56,
+      14, 17, 22, 29,  51,  87,  80,  62,
+      18, 22, 37, 56,  68, 109, 103,  77,
+      24, 35, 55, 64,  81, 104, 113,  92,
+      49, 64, 78, 87, 103, 121, 120, 101,
+      72, 92, 95, 98, 112, 100, 103,  99
+   };
+   jpeg_writer_buf b;
+   jpeg_writer_comp comp[3];
+   uint8_t zigzag[64], q[64];
+   double cosines[8][8];
+   float *planes[3];
+   int i, j, c, x, y, k;
+   int h_max      = opts->comps == 3 ? opts->h : 1;
+   int v_max      = opts->comps == 3 ? opts->v : 1;
+   int mcu_x      = (width  + 8 * h_max - 1) / (8 * h_max);
+   int mcu_y      = (height + 8 * v_max - 1) / (8 * v_max);
+   int scale      = opts->quality < 50 ? 5000 / opts->quality : 200 - opts->quality * 2;
+
+   memset(&b, 0, sizeof(b));
+
+   /* zigzag[k] is the natural index of the k-th coefficient */
+   for (i = 0, k = 0; i < 15; i++)
+      for (j = 0; j <= i; j++)
+      {
+         int r = (i & 1) ? j : i - j;
+         int col = i - r;
+         if (r < 8 && col < 8)
+            zigzag[k++] = (uint8_t)(r * 8 + col);
+      }
+
+   for (i = 0; i < 64; i++)
+   {
+      int t = (base_q[i] * scale + 50) / 100;
+      q[i]  = (uint8_t)(t < 1 ? 1 : t > 255 ? 255 : t);
+   }
+
+   for (i = 0; i < 8; i++)
+      for (j = 0; j < 8; j++)
+         cosines[i][j] = cos((2 * i + 1) * j * 3.14159265358979323846 / 16)
+            * (j ? 0.5 : 0.5 / sqrt(2.0));
+
+   /* colour convert and subsample, replicating the edges into the padding */
+   for (c = 0; c < opts->comps; c++)
+   {
+      int sx, sy;
+      comp[c].h  = c ? 1 : h_max;
+      comp[c].v  = c ? 1 : v_max;
+      sx         = h_max / comp[c].h;
+      sy         = v_max / comp[c].v;
+      comp[c].w  = (width  + sx - 1) / sx;
+      comp[c].ht = (height + sy - 1) / sy;
+      comp[c].bw = mcu_x * comp[c].h;
+      comp[c].bh = mcu_y * comp[c].v;
+      planes[c]  = (float*)malloc(sizeof(float) * comp[c].bw * 8 * comp[c].bh * 8);
+      comp[c].zz = (short*)malloc(sizeof(short) * 64 * comp[c].bw * comp[c].bh);
+
+      for (y = 0; y < comp[c].bh * 8; y++)
+         for (x = 0; x < comp[c].bw * 8; x++)
+         {
+            float sum = 0;
+            int dx, dy;
+            for (dy = 0; dy < sy; dy++)
+               for (dx = 0; dx < sx; dx++)
+               {
+                  int px = x * sx + dx;
+                  int py = y * sy + dy;
+                  const uint8_t *p;
+                  if (px >= width)
+                     px = width - 1;
+                  if (py >= height)
+                     py = height - 1;
+                  p = rgb + ((size_t)py * width + px) * 3;
+                  if (opts->comps == 1 || c == 0)
+                     sum += 0.299f * p[0] + 0.587f * p[1] + 0.114f * p[2];
+                  else if (c == 1)
+                     sum += -0.168736f * p[0] - 0.331264f * p[1] + 0.5f * p[2] + 128;
+                  else
+                     sum += 0.5f * p[0] - 0.418688f * p[1] - 0.081312f * p[2] + 128;
+               }
+            planes[c][(size_t)y * comp[c].bw * 8 + x] = sum / (sx * sy);
+         }
+
+      /* forward DCT and quantize every block */
+      for (j = 0; j < comp[c].bh; j++)
+         for (i = 0; i < comp[c].bw; i++)
+         {
+            double tmp[64], out[64];
+            short *zz = comp[c].zz + 64 * ((size_t)j * comp[c].bw + i);
+            int u, v;
+            for (y = 0; y < 8; y++)
+               for (u = 0; u < 8; u++)
+               {
+                  double s = 0;
+                  for (x = 0; x < 8; x++)
+                     s += (planes[c][(size_t)(j * 8 + y) * comp[c].bw * 8 + i * 8 + x] - 128)
+                        * cosines[x][u];
+                  tmp[y * 8 + u] = s;
+               }
+            for (v = 0; v < 8; v++)
+               for (u = 0; u < 8; u++)
+               {
+                  double s = 0;
+                  for (y = 0; y < 8; y++)
+                     s += tmp[y * 8 + u] * cosines[y][v];
+                  out[v * 8 + u] = s;
+               }
+            for (k = 0; k < 64; k++)
+            {
+               double d = out[zigzag[k]] / q[zigzag[k]];
+               zz[k]    = (short)(d < 0 ? d - 0.5 : d + 0.5);
+            }
+         }
+      free(planes[c]);
+   }
+
+   /* SOI, DQT */
+   jpeg_writer_word(&b, 0xffd8);
+   jpeg_writer_word(&b, 0xffdb);
+   jpeg_writer_word(&b, 67);
+   jpeg_writer_byte(&b, 0);
+   for (k = 0; k < 64; k++)
+      jpeg_writer_byte(&b, q[zigzag[k]]);
+
+   /* SOF */
+   jpeg_writer_word(&b, opts->progressive ? 0xffc2 : 0xffc0);
+   jpeg_writer_word(&b, 8 + 3 * opts->comps);
+   jpeg_writer_byte(&b, 8);
+   jpeg_writer_word(&b, (unsigned)height);
+   jpeg_writer_word(&b, (unsigned)width);
+   jpeg_writer_byte(&b, (uint8_t)opts->comps);
+   for (c = 0; c < opts->comps; c++)
+   {
+      jpeg_writer_byte(&b, (uint8_t)(c + 1));
+      jpeg_writer_byte(&b, (uint8_t)(comp[c].h << 4 | comp[c].v));
+      jpeg_writer_byte(&b, 0);
+   }
+
+   /* DHT: one flat DC table and one flat AC table */
+   jpeg_writer_word(&b, 0xffc4);
+   jpeg_writer_word(&b, 2 + 17 + 12 + 17 + 162);
+   jpeg_writer_byte(&b, 0x00);
+   for (i = 1; i <= 16; i++)
+      jpeg_writer_byte(&b, (uint8_t)(i == 4 ? 12 : 0));
+   for (i = 0; i < 12; i++)
+      jpeg_writer_byte(&b, (uint8_t)i);
+   jpeg_writer_byte(&b, 0x10);
+   for (i = 1; i <= 16; i++)
+      jpeg_writer_byte(&b, (uint8_t)(i == 8 ? 162 : 0));
+   jpeg_writer_byte(&b, 0x00);
+   jpeg_writer_byte(&b, 0xf0);
+   for (i = 0; i < 16; i++)
+      for (j = 1; j <= 10; j++)
+         jpeg_writer_byte(&b, (uint8_t)(i << 4 | j));
+
+   if (opts->restart_interval && !opts->progressive)
+   {
+      jpeg_writer_word(&b, 0xffdd);
+      jpeg_writer_word(&b, 4);
+      jpeg_writer_word(&b, (unsigned)opts->restart_interval);
+   }
+
+   /* first scan: everything for baseline, the DC terms for progressive */
+   {
+      int pred[3]  = {0, 0, 0};
+      int mcus     = 0;
+      int rst      = 0;
+      int single   = opts->comps == 1;
+      /* a single component scan is in blocks covering the image only */
+      int sx       = single ? (width + 7) / 8 : mcu_x;
+      int sy       = single ? (height + 7) / 8 : mcu_y;
+
+      jpeg_writer_word(&b, 0xffda);
+      jpeg_writer_word(&b, 6 + 2 * opts->comps);
+      jpeg_writer_byte(&b, (uint8_t)opts->comps);
+      for (c = 0; c < opts->comps; c++)
+      {
+         jpeg_writer_byte(&b, (uint8_t)(c + 1));
+         jpeg_writer_byte(&b, 0x00);
+      }
+      jpeg_writer_byte(&b, 0);
+      jpeg_writer_byte(&b, opts->progressive ? 0 : 63);
+      jpeg_writer_byte(&b, 0);
+
+      for (j = 0; j < sy; j++)
+         for (i = 0; i < sx; i++)
+         {
+            if (opts->restart_interval && !opts->progressive
+                  && mcus && !(mcus % opts->restart_interval))
+            {
+               jpeg_writer_flush(&b);
+               jpeg_writer_word(&b, 0xffd0 + (rst++ & 7));
+               pred[0] = pred[1] = pred[2] = 0;
+            }
+            mcus++;
+
+            for (c = 0; c < opts->comps; c++)
+               for (y = 0; y < (single ? 1 : comp[c].v); y++)
+                  for (x = 0; x < (single ? 1 : comp[c].h); x++)
+                  {
+                     int bx   = i * (single ? 1 : comp[c].h) + x;
+                     int by   = j * (single ? 1 : comp[c].v) + y;
+                     short *zz = comp[c].zz + 64 * ((size_t)by * comp[c].bw + bx);
+                     jpeg_writer_dc(&b, zz[0] - pred[c]);
+                     pred[c] = zz[0];
+                     if (!opts->progressive)
+                        jpeg_writer_ac(&b, zz);
+                  }
+         }
+      jpeg_writer_flush(&b);
+   }
+
+   /* progressive: then the AC terms of each component in its own scan */
+   if (opts->progressive)
+   {
+      for (c = 0; c < opts->comps; c++)
+      {
+         int sx = (comp[c].w  + 7) / 8;
+         int sy = (comp[c].ht + 7) / 8;
+
+         jpeg_writer_word(&b, 0xffda);
+         jpeg_writer_word(&b, 8);
+         jpeg_writer_byte(&b, 1);
+         jpeg_writer_byte(&b, (uint8_t)(c + 1));
+         jpeg_writer_byte(&b, 0x00);
+         jpeg_writer_byte(&b, 1);
+         jpeg_writer_byte(&b, 63);
+         jpeg_writer_byte(&b, 0);
+
+         for (j = 0; j < sy; j++)
+            for (i = 0; i < sx; i++)
+               jpeg_writer_ac(&b, comp[c].zz + 64 * ((size_t)j * comp[c].bw + i));
+         jpeg_writer_flush(&b);
+      }
+   }
+
+   jpeg_writer_word(&b, 0xffd9);
+
+   for (c = 0; c < opts->comps; c++)
+      free(comp[c].zz);
+
+   *len = b.len;
+   return b.data;
+}
+
+#endif
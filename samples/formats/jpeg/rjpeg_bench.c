@@ -0,0 +1,417 @@
+/* Copyright  (C) 2010-2020 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (rjpeg_bench.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+/* Built with the decoder itself, to get at its kernels */
+#include "../../../formats/jpeg/rjpeg.c"
+
+#include "jpeg_writer.h"
+
+/* Times each stage of rjpeg with every kernel set this CPU can run
+ * (scalar, SSE2, AVX2), and checks they all give the same bytes.
+ *
+ * usage: rjpeg_bench [file.jpg]
+ *
+ * Without arguments a synthetic 2048x1536 4:2:0 image is used. */
+
+enum
+{
+   LEVEL_SCALAR = 0,
+   LEVEL_SSE2,
+   LEVEL_AVX2,
+   LEVEL_COUNT
+};
+
+static int failures = 0;
+
+/* Raises *diff to the largest difference between two levels' output */
+static void compare(const uint8_t *a, const uint8_t *b, size_t len, int *diff)
+{
+   size_t i;
+   int largest = 0;
+
+   for (i = 0; i < len; i++)
+   {
+      int d = abs(a[i] - b[i]);
+      if (d > largest)
+         largest = d;
+   }
+
+   if (largest)
+      failures++;
+   if (largest > *diff)
+      *diff = largest;
+}
+
+static void print_diff(int diff)
+{
+   if (diff)
+      printf(" (off by up to %d)", diff);
+}
+
+static double now(void)
+{
+   return (double)clock() / CLOCKS_PER_SEC;
+}
+
+static void noop_idct(uint8_t *out, int out_stride, short data[64])
+{
+   (void)out;
+   (void)out_stride;
+   (void)data;
+}
+
+/* Sets up the kernels of a level; false if this build or CPU lacks it */
+static bool setup_level(rjpeg_jpeg *j, int level)
+{
+   rjpeg_setup_jpeg(j);
+
+   switch (level)
+   {
+      case LEVEL_SCALAR:
+         j->idct_block_kernel        = rjpeg_idct_block;
+         j->idct_block_x2_kernel     = NULL;
+         j->YCbCr_to_RGB_kernel      = rjpeg_YCbCr_to_RGB_row;
+         j->resample_row_hv_2_kernel = rjpeg_resample_row_hv_2;
+         return true;
+      case LEVEL_SSE2:
+#if defined(__SSE2__)
+         if (!(cpu_features_get() & RETRO_SIMD_SSE2))
+            return false;
+         j->idct_block_kernel        = rjpeg_idct_simd;
+         j->idct_block_x2_kernel     = NULL;
+         j->YCbCr_to_RGB_kernel      = rjpeg_YCbCr_to_RGB_simd;
+         j->resample_row_hv_2_kernel = rjpeg_resample_row_hv_2_simd;
+         return true;
+#else
+         return false;
+#endif
+      case LEVEL_AVX2:
+#ifdef RJPEG_AVX2
+         return j->idct_block_x2_kernel != NULL;
+#else
+         return false;
+#endif
+   }
+
+   return false;
+}
+
+static uint8_t *decode(const uint8_t *jpg, size_t len, int level,
+      bool entropy_only, unsigned *w, unsigned *h)
+{
+   rjpeg_jpeg j;
+   rjpeg_context s;
+   struct image_output output;
+
+   s.img_buffer          = (uint8_t*)jpg;
+   s.img_buffer_original = (uint8_t*)jpg;
+   s.img_buffer_end      = (uint8_t*)jpg + len;
+   j.s                   = &s;
+   j.scale_shift         = 0;
+   j.scale_min_w         = 0;
+   j.scale_min_h         = 0;
+
+   if (!setup_level(&j, level))
+      return NULL;
+
+   if (entropy_only)
+   {
+      int ok;
+      j.idct_block_kernel    = noop_idct;
+      j.idct_block_x2_kernel = NULL;
+      s.img_n                = 0;
+      ok                     = rjpeg_decode_jpeg_image(&j);
+      rjpeg_cleanup_jpeg(&j);
+      return ok ? (uint8_t*)malloc(1) : NULL;
+   }
+
+   /* R, G, B, A bytes, as the levels are compared byte by byte */
+   output.data   = NULL;
+   output.format = IMAGE_PIXEL_ABGR8888;
+   if (!rjpeg_load_jpeg_image(&j, &output, w, h))
+      return NULL;
+   return (uint8_t*)output.data;
+}
+
+static void bench_decode(const uint8_t *jpg, size_t len)
+{
+   uint8_t *ref = NULL;
+   unsigned rw  = 0, rh = 0;
+   int level, diff = 0;
+
+   printf("%-24s", "entropy decode");
+   for (level = 0; level < LEVEL_COUNT; level++)
+   {
+      unsigned w, h;
+      double t0 = now();
+      uint8_t *img = decode(jpg, len, level, true, &w, &h);
+      if (!img)
+      {
+         printf("%10s", "-");
+         continue;
+      }
+      printf("%8.1fms", (now() - t0) * 1000.0);
+      free(img);
+   }
+   printf("\n%-24s", "full decode");
+
+   for (level = 0; level < LEVEL_COUNT; level++)
+   {
+      unsigned w = 0, h = 0;
+      double t0 = now();
+      uint8_t *img = decode(jpg, len, level, false, &w, &h);
+      if (!img)
+      {
+         printf("%10s", "-");
+         continue;
+      }
+      printf("%8.1fms", (now() - t0) * 1000.0);
+
+      /* each level against the one before */
+      if (ref)
+      {
+         if (w != rw || h != rh)
+            failures++;
+         else
+            compare(ref, img, (size_t)w * h * 4, &diff);
+         free(ref);
+      }
+      ref = img;
+      rw  = w;
+      rh  = h;
+   }
+   print_diff(diff);
+   printf("\n");
+
+   free(ref);
+}
+
+static void bench_idct(void)
+{
+   enum { BLOCKS = 4096, RUNS = 64 };
+   short *coeffs    = (short*)malloc(BLOCKS * 64 * sizeof(short) + 16);
+   short *aligned   = (short*)(((size_t)coeffs + 15) & ~(size_t)15);
+   uint8_t *ref     = (uint8_t*)malloc(BLOCKS * 64);
+   uint8_t *out     = (uint8_t*)malloc(BLOCKS * 64);
+   uint32_t rng     = 1;
+   int level, b, i, r, diff = 0;
+
+   /* mostly small, a few large, like dequantized coefficients */
+   for (i = 0; i < BLOCKS * 64; i++)
+   {
+      int k = i & 63;
+      rng   = rng * 1103515245u + 12345u;
+      aligned[i] = (short)((int)((rng >> 16) % 512) - 256) / (k ? 1 + k / 4 : 1);
+      if ((rng >> 8) % 97 == 0)
+         aligned[i] = (short)((int)((rng >> 12) % 4096) - 2048);
+   }
+
+   printf("%-24s", "idct");
+   for (level = 0; level < LEVEL_COUNT; level++)
+   {
+      rjpeg_jpeg j;
+      double t0;
+
+      if (!setup_level(&j, level))
+      {
+         printf("%10s", "-");
+         continue;
+      }
+
+      t0 = now();
+      for (r = 0; r < RUNS; r++)
+      {
+         if (j.idct_block_x2_kernel)
+            for (b = 0; b < BLOCKS; b += 2)
+               j.idct_block_x2_kernel(out + b * 64, 8, aligned + b * 64,
+                     out + (b + 1) * 64, 8, aligned + (b + 1) * 64);
+         else
+            for (b = 0; b < BLOCKS; b++)
+               j.idct_block_kernel(out + b * 64, 8, aligned + b * 64);
+      }
+      printf("%8.1fms", (now() - t0) * 1000.0);
+
+      if (level != LEVEL_SCALAR)
+         compare(ref, out, BLOCKS * 64, &diff);
+      memcpy(ref, out, BLOCKS * 64);
+   }
+   print_diff(diff);
+   printf("\n");
+
+   free(out);
+   free(ref);
+   free(coeffs);
+}
+
+static void bench_rows(void)
+{
+   enum { WIDTH = 1023, RUNS = 4096 };
+   uint8_t *a       = (uint8_t*)malloc(WIDTH + 16);
+   uint8_t *b       = (uint8_t*)malloc(WIDTH + 16);
+   uint8_t *c       = (uint8_t*)malloc(WIDTH + 16);
+   uint8_t *ref     = (uint8_t*)malloc(WIDTH * 4);
+   uint8_t *out     = (uint8_t*)malloc(WIDTH * 4);
+   uint32_t rng     = 7;
+   int level, i, r, diff = 0;
+
+   for (i = 0; i < WIDTH + 16; i++)
+   {
+      rng  = rng * 1103515245u + 12345u;
+      a[i] = (uint8_t)(rng >> 24);
+      b[i] = (uint8_t)(rng >> 16);
+      c[i] = (uint8_t)(rng >> 8);
+   }
+
+   printf("%-24s", "upsample h2v2");
+   for (level = 0; level < LEVEL_COUNT; level++)
+   {
+      rjpeg_jpeg j;
+      double t0;
+
+      if (!setup_level(&j, level))
+      {
+         printf("%10s", "-");
+         continue;
+      }
+
+      t0 = now();
+      for (r = 0; r < RUNS; r++)
+         j.resample_row_hv_2_kernel(out, a, b, WIDTH / 2, 2);
+      printf("%8.1fms", (now() - t0) * 1000.0);
+
+      if (level != LEVEL_SCALAR)
+         compare(ref, out, WIDTH / 2 * 2, &diff);
+      memcpy(ref, out, WIDTH / 2 * 2);
+   }
+   print_diff(diff);
+
+   diff = 0;
+   printf("\n%-24s", "YCbCr to RGB");
+   for (level = 0; level < LEVEL_COUNT; level++)
+   {
+      rjpeg_jpeg j;
+      double t0;
+
+      if (!setup_level(&j, level))
+      {
+         printf("%10s", "-");
+         continue;
+      }
+
+      t0 = now();
+      for (r = 0; r < RUNS; r++)
+         j.YCbCr_to_RGB_kernel(out, a, b, c, WIDTH, 4);
+      printf("%8.1fms", (now() - t0) * 1000.0);
+
+      if (level != LEVEL_SCALAR)
+         compare(ref, out, WIDTH * 4, &diff);
+      memcpy(ref, out, WIDTH * 4);
+   }
+   print_diff(diff);
+   printf("\n");
+
+   free(out);
+   free(ref);
+   free(c);
+   free(b);
+   free(a);
+}
+
+static uint8_t *load_file(const char *path, size_t *len)
+{
+   long size;
+   uint8_t *data = NULL;
+   FILE *f       = fopen(path, "rb");
+
+   if (!f)
+      return NULL;
+
+   fseek(f, 0, SEEK_END);
+   size = ftell(f);
+   fseek(f, 0, SEEK_SET);
+   if (size > 0 && (data = (uint8_t*)malloc((size_t)size)))
+   {
+      if (fread(data, 1, (size_t)size, f) != (size_t)size)
+      {
+         free(data);
+         data = NULL;
+      }
+      *len = (size_t)size;
+   }
+   fclose(f);
+   return data;
+}
+
+int main(int argc, char **argv)
+{
+   size_t len   = 0;
+   uint8_t *jpg = NULL;
+
+   if (argc > 1)
+   {
+      if (!(jpg = load_file(argv[1], &len)))
+      {
+         fprintf(stderr, "can't read %s\n", argv[1]);
+         return 1;
+      }
+   }
+   else
+   {
+      int x, y;
+      jpeg_writer_opts opts = { 3, 2, 2, 90, 0, 0 };
+      uint8_t *rgb          = (uint8_t*)malloc(2048 * 1536 * 3);
+
+      for (y = 0; y < 1536; y++)
+         for (x = 0; x < 2048; x++)
+         {
+            uint8_t *p = rgb + ((size_t)y * 2048 + x) * 3;
+            p[0] = (uint8_t)(128 + 100 * sin(x / 40.0) * cos(y / 70.0));
+            p[1] = (uint8_t)(y / 6);
+            p[2] = (uint8_t)(((x / 24 + y / 24) & 1) ? 200 : 40);
+         }
+
+      jpg = jpeg_writer_encode(rgb, 2048, 1536, &opts, &len);
+      free(rgb);
+   }
+
+   printf("%-24s%10s%10s%10s\n", "", "scalar", "sse2", "avx2");
+   bench_decode(jpg, len);
+   bench_idct();
+   bench_rows();
+
+   free(jpg);
+
+   if (failures)
+   {
+      printf("%d kernel(s) differ between levels\n", failures);
+      return 1;
+   }
+
+   return 0;
+}
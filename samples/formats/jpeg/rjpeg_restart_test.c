@@ -0,0 +1,238 @@
+/* Copyright  (C) 2010-2020 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (rjpeg_restart_test.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include <formats/rjpeg.h>
+#include <formats/image.h>
+#include <features/features_cpu.h>
+
+#include "jpeg_writer.h"
+
+/* Encodes images with and without restart markers, which gives the
+ * same coefficients, and checks that the restart intervals decoded in
+ * bands on threads come out the same as the single stream. Broken
+ * markers must fall back to decoding serially. */
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf(__VA_ARGS__); printf("\n"); failures++; } } while (0)
+
+static uint8_t *make_image(int width, int height)
+{
+   int x, y;
+   uint8_t *rgb = (uint8_t*)malloc((size_t)width * height * 3);
+
+   /* Smooth gradients with a few hard edges, like a photo of a scan */
+   for (y = 0; y < height; y++)
+      for (x = 0; x < width; x++)
+      {
+         uint8_t *p = rgb + ((size_t)y * width + x) * 3;
+         p[0] = (uint8_t)(128 + 100 * sin(x / 37.0) * cos(y / 53.0));
+         p[1] = (uint8_t)((x + y) / 5);
+         p[2] = (uint8_t)(((x / 16 + y / 16) & 1) ? 210 : 30);
+      }
+
+   return rgb;
+}
+
+static uint32_t *decode(const uint8_t *jpg, size_t len, unsigned denom,
+      unsigned *width, unsigned *height)
+{
+   void *data     = NULL;
+   rjpeg_t *rjpeg = rjpeg_alloc();
+
+   if (!rjpeg)
+      return NULL;
+
+   rjpeg_set_buf_ptr(rjpeg, (void*)jpg);
+   rjpeg_set_scale_denom(rjpeg, denom);
+
+   if (rjpeg_process_image(rjpeg, &data, len, width, height) != IMAGE_PROCESS_END)
+      data = NULL;
+
+   rjpeg_free(rjpeg);
+   return (uint32_t*)data;
+}
+
+/* Decodes jpg and checks it against the reference pixels */
+static void check_same(const uint8_t *jpg, size_t len, unsigned denom,
+      const uint32_t *ref, unsigned ref_w, unsigned ref_h, const char *what)
+{
+   unsigned w = 0, h = 0;
+   uint32_t *img = decode(jpg, len, denom, &w, &h);
+
+   if (!img)
+   {
+      CHECK(0, "%s: decode failed", what);
+      return;
+   }
+
+   CHECK(w == ref_w && h == ref_h, "%s: got %ux%u, not %ux%u", what, w, h, ref_w, ref_h);
+   if (w == ref_w && h == ref_h)
+      CHECK(!memcmp(img, ref, (size_t)w * h * sizeof(*img)), "%s: pixels differ", what);
+   free(img);
+}
+
+/* Points at the first RSTn marker of the scan, if there is one */
+static uint8_t *find_restart(uint8_t *jpg, size_t len)
+{
+   size_t i;
+   bool in_scan = false;
+
+   for (i = 0; i + 1 < len; i++)
+   {
+      if (jpg[i] != 0xff)
+         continue;
+      if (jpg[i + 1] == 0xda)
+         in_scan = true;
+      else if (in_scan && jpg[i + 1] >= 0xd0 && jpg[i + 1] <= 0xd7)
+         return jpg + i;
+   }
+
+   return NULL;
+}
+
+static void test_layout(int width, int height, const jpeg_writer_opts *opts,
+      const char *name)
+{
+   static const int intervals[] = { 1, 3, 16, 60000 };
+   unsigned r, denom, w = 0, h = 0;
+   char what[128];
+   size_t len            = 0;
+   jpeg_writer_opts plain = *opts;
+   uint8_t *rgb          = make_image(width, height);
+   uint8_t *jpg          = NULL;
+   uint32_t *ref[4]      = {NULL};
+   unsigned ref_w[4], ref_h[4];
+
+   /* Without restart markers, the scan is decoded serially */
+   plain.restart_interval = 0;
+   jpg = jpeg_writer_encode(rgb, width, height, &plain, &len);
+   for (denom = 1; denom <= 8; denom *= 2)
+   {
+      unsigned d = denom == 1 ? 0 : denom == 2 ? 1 : denom == 4 ? 2 : 3;
+      ref[d]     = decode(jpg, len, denom, &ref_w[d], &ref_h[d]);
+      CHECK(ref[d], "%s %dx%d 1/%u: decode failed", name, width, height, denom);
+   }
+   free(jpg);
+
+   for (r = 0; r < sizeof(intervals) / sizeof(intervals[0]); r++)
+   {
+      jpeg_writer_opts restarts = *opts;
+      uint8_t *rst;
+
+      restarts.restart_interval = intervals[r];
+      jpg = jpeg_writer_encode(rgb, width, height, &restarts, &len);
+
+      for (denom = 1; denom <= 8; denom *= 2)
+      {
+         unsigned d = denom == 1 ? 0 : denom == 2 ? 1 : denom == 4 ? 2 : 3;
+         if (!ref[d])
+            continue;
+         snprintf(what, sizeof(what), "%s %dx%d every %d MCUs 1/%u",
+               name, width, height, intervals[r], denom);
+         check_same(jpg, len, denom, ref[d], ref_w[d], ref_h[d], what);
+      }
+
+      /* Out of order markers can't be indexed, but still decode */
+      if ((rst = find_restart(jpg, len)))
+      {
+         rst[1] = 0xd5;
+         snprintf(what, sizeof(what), "%s %dx%d every %d MCUs, bad RSTn",
+               name, width, height, intervals[r]);
+         if (ref[0])
+            check_same(jpg, len, 1, ref[0], ref_w[0], ref_h[0], what);
+      }
+
+      /* Cut short, it must not read past the end */
+      free(decode(jpg, len / 2, 1, &w, &h));
+      free(jpg);
+   }
+
+   for (denom = 0; denom < 4; denom++)
+      free(ref[denom]);
+   free(rgb);
+}
+
+static double now(void)
+{
+   return cpu_features_get_time_usec() / 1000000.0;
+}
+
+int main(void)
+{
+   static const int sizes[][2] = {
+      { 1, 1 }, { 100, 75 }, { 1000, 700 }, { 2048, 1536 },
+   };
+   static const struct
+   {
+      const char *name;
+      jpeg_writer_opts opts;
+   } layouts[] = {
+      { "grey",  { 1, 1, 1, 90, 1, 0 } },
+      { "4:4:4", { 3, 1, 1, 90, 1, 0 } },
+      { "4:2:2", { 3, 2, 1, 90, 1, 0 } },
+      { "4:2:0", { 3, 2, 2, 90, 1, 0 } },
+   };
+   jpeg_writer_opts opts = { 3, 2, 2, 85, 0, 0 };
+   unsigned z, l, w, h;
+   uint8_t *rgb, *jpg;
+   size_t len;
+   double t0, t_plain, t_restarts;
+
+   for (l = 0; l < sizeof(layouts) / sizeof(layouts[0]); l++)
+      for (z = 0; z < sizeof(sizes) / sizeof(sizes[0]); z++)
+         test_layout(sizes[z][0], sizes[z][1], &layouts[l].opts, layouts[l].name);
+
+   /* Times a large photo with and without a restart every MCU row */
+   rgb = make_image(4096, 3072);
+   jpg = jpeg_writer_encode(rgb, 4096, 3072, &opts, &len);
+   t0      = now();
+   free(decode(jpg, len, 1, &w, &h));
+   t_plain = now() - t0;
+   free(jpg);
+
+   opts.restart_interval = 4096 / 16;
+   jpg = jpeg_writer_encode(rgb, 4096, 3072, &opts, &len);
+   t0         = now();
+   free(decode(jpg, len, 1, &w, &h));
+   t_restarts = now() - t0;
+   free(jpg);
+   free(rgb);
+
+   printf("4096x3072 on %u cores: %.1f ms without restarts, %.1f ms with\n",
+         cpu_features_get_core_amount(), t_plain * 1000.0, t_restarts * 1000.0);
+
+   if (failures)
+   {
+      printf("%d check(s) failed\n", failures);
+      return 1;
+   }
+
+   printf("all checks passed\n");
+   return 0;
+}
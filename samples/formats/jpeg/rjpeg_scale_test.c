@@ -0,0 +1,260 @@
+/* Copyright  (C) 2010-2020 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (rjpeg_scale_test.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include <formats/rjpeg.h>
+#include <formats/image.h>
+
+#include "jpeg_writer.h"
+
+/* Decodes JPEGs of every layout at 1/2, 1/4 and 1/8 scale, and checks
+ * them against a box filtered full size decode. */
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf(__VA_ARGS__); printf("\n"); failures++; } } while (0)
+
+static uint8_t *make_image(int width, int height)
+{
+   int x, y;
+   uint8_t *rgb = (uint8_t*)malloc((size_t)width * height * 3);
+
+   /* Smooth gradients with a few hard edges, like box art */
+   for (y = 0; y < height; y++)
+      for (x = 0; x < width; x++)
+      {
+         uint8_t *p = rgb + ((size_t)y * width + x) * 3;
+         int inside = (x - width / 2) * (x - width / 2)
+            + (y - height / 3) * (y - height / 3) < 40 * 40;
+         p[0] = (uint8_t)(128 + 100 * sin(x / 40.0));
+         p[1] = (uint8_t)(inside ? 220 : (y / 2) & 0xff);
+         p[2] = (uint8_t)(((x / 24) & 1) ? 200 : 40);
+      }
+
+   return rgb;
+}
+
+static uint32_t *decode(const uint8_t *jpg, size_t len, unsigned denom,
+      unsigned target_w, unsigned target_h, unsigned *width, unsigned *height)
+{
+   void *data   = NULL;
+   rjpeg_t *rjpeg = rjpeg_alloc();
+
+   if (!rjpeg)
+      return NULL;
+
+   rjpeg_set_buf_ptr(rjpeg, (void*)jpg);
+   if (target_w || target_h)
+      rjpeg_set_scale_target(rjpeg, target_w, target_h);
+   else
+      rjpeg_set_scale_denom(rjpeg, denom);
+
+   if (rjpeg_process_image(rjpeg, &data, len, width, height) != IMAGE_PROCESS_END)
+      data = NULL;
+
+   rjpeg_free(rjpeg);
+   return (uint32_t*)data;
+}
+
+/* Mean error against the source, per channel */
+static double error_full(const uint32_t *img, const uint8_t *rgb,
+      int width, int height, int grey)
+{
+   size_t i, n = (size_t)width * height;
+   double sum  = 0;
+
+   for (i = 0; i < n; i++)
+   {
+      int r = (img[i] >> 16) & 0xff;
+      int g = (img[i] >>  8) & 0xff;
+      int b = (img[i]      ) & 0xff;
+      if (grey)
+      {
+         int l = (int)(0.299f * rgb[i * 3] + 0.587f * rgb[i * 3 + 1]
+               + 0.114f * rgb[i * 3 + 2] + 0.5f);
+         sum += abs(r - l) + abs(g - l) + abs(b - l);
+      }
+      else
+         sum += abs(r - rgb[i * 3]) + abs(g - rgb[i * 3 + 1]) + abs(b - rgb[i * 3 + 2]);
+   }
+
+   return sum / (n * 3);
+}
+
+/* Mean error of a scaled decode against the box filtered full decode.
+ * Blocks past the edges are padded with the edge pixels, as the
+ * encoder does. */
+static double error_scaled(const uint32_t *small, const uint32_t *full,
+      unsigned width, unsigned height, unsigned denom)
+{
+   unsigned x, y, sw = (width + denom - 1) / denom, sh = (height + denom - 1) / denom;
+   double sum = 0;
+
+   for (y = 0; y < sh; y++)
+      for (x = 0; x < sw; x++)
+      {
+         int c;
+         for (c = 0; c < 24; c += 8)
+         {
+            unsigned dx, dy, n = denom * denom, acc = 0;
+            for (dy = 0; dy < denom; dy++)
+               for (dx = 0; dx < denom; dx++)
+               {
+                  unsigned px = x * denom + dx < width  ? x * denom + dx : width  - 1;
+                  unsigned py = y * denom + dy < height ? y * denom + dy : height - 1;
+                  acc += (full[py * width + px] >> c) & 0xff;
+               }
+            sum += abs((int)((small[y * sw + x] >> c) & 0xff) - (int)((acc + n / 2) / n));
+         }
+      }
+
+   return sum / (sw * sh * 3);
+}
+
+static void test_layout(int width, int height, const jpeg_writer_opts *opts,
+      const char *name)
+{
+   unsigned w = 0, h = 0, denom;
+   double err;
+   size_t len     = 0;
+   uint8_t *rgb   = make_image(width, height);
+   uint8_t *jpg   = jpeg_writer_encode(rgb, width, height, opts, &len);
+   uint32_t *full = decode(jpg, len, 1, 0, 0, &w, &h);
+
+   if (!full)
+   {
+      CHECK(0, "%s %dx%d: full decode failed", name, width, height);
+      goto end;
+   }
+
+   CHECK(w == (unsigned)width && h == (unsigned)height,
+         "%s %dx%d: full decode is %ux%u", name, width, height, w, h);
+   err = error_full(full, rgb, width, height, opts->comps == 1);
+   CHECK(err < 6.0, "%s %dx%d: mean error %.2f against the source", name, width, height, err);
+
+   for (denom = 2; denom <= 8; denom *= 2)
+   {
+      uint32_t *small = decode(jpg, len, denom, 0, 0, &w, &h);
+
+      if (!small)
+      {
+         CHECK(0, "%s %dx%d 1/%u: decode failed", name, width, height, denom);
+         continue;
+      }
+
+      CHECK(w == (width + denom - 1) / denom && h == (height + denom - 1) / denom,
+            "%s %dx%d 1/%u: got %ux%u", name, width, height, denom, w, h);
+
+      err = error_scaled(small, full, width, height, denom);
+      CHECK(err < 3.0, "%s %dx%d 1/%u: mean error %.2f", name, width, height, denom, err);
+      free(small);
+   }
+
+   free(full);
+
+end:
+   free(jpg);
+   free(rgb);
+}
+
+static double now(void)
+{
+   return (double)clock() / CLOCKS_PER_SEC;
+}
+
+int main(void)
+{
+   static const int sizes[][2] = {
+      { 1, 1 }, { 13, 7 }, { 100, 75 }, { 257, 129 }, { 640, 480 },
+   };
+   static const struct
+   {
+      const char *name;
+      jpeg_writer_opts opts;
+   } layouts[] = {
+      { "grey",             { 1, 1, 1, 90, 0, 0 } },
+      { "4:4:4",            { 3, 1, 1, 90, 0, 0 } },
+      { "4:2:2",            { 3, 2, 1, 90, 0, 0 } },
+      { "4:2:0",            { 3, 2, 2, 90, 0, 0 } },
+      { "4:2:0 restarts",   { 3, 2, 2, 90, 3, 0 } },
+      { "4:4:4 progressive",{ 3, 1, 1, 90, 0, 1 } },
+      { "4:2:0 progressive",{ 3, 2, 2, 90, 0, 1 } },
+   };
+   unsigned z, l, w, h;
+   jpeg_writer_opts opts = { 3, 2, 2, 85, 0, 0 };
+   uint8_t *rgb, *jpg;
+   uint32_t *img;
+   size_t len;
+   double t0, t_full, t_thumb;
+
+   for (l = 0; l < sizeof(layouts) / sizeof(layouts[0]); l++)
+      for (z = 0; z < sizeof(sizes) / sizeof(sizes[0]); z++)
+         test_layout(sizes[z][0], sizes[z][1], &layouts[l].opts, layouts[l].name);
+
+   /* A thumbnail target picks the smallest scale that still covers it */
+   rgb = make_image(2048, 1536);
+   jpg = jpeg_writer_encode(rgb, 2048, 1536, &opts, &len);
+
+   t0     = now();
+   img    = decode(jpg, len, 1, 0, 0, &w, &h);
+   t_full = now() - t0;
+   free(img);
+
+   t0      = now();
+   img     = decode(jpg, len, 1, 256, 192, &w, &h);
+   t_thumb = now() - t0;
+   CHECK(img && w == 256 && h == 192, "2048x1536 for 256x192: got %ux%u", w, h);
+   free(img);
+
+   img = decode(jpg, len, 1, 256, 256, &w, &h);
+   CHECK(img && w == 512 && h == 384, "2048x1536 for 256x256: got %ux%u", w, h);
+   free(img);
+
+   img = decode(jpg, len, 1, 300, 0, &w, &h);
+   CHECK(img && w == 512 && h == 384, "2048x1536 for 300 wide: got %ux%u", w, h);
+   free(img);
+
+   img = decode(jpg, len, 1, 4000, 4000, &w, &h);
+   CHECK(img && w == 2048 && h == 1536, "2048x1536 for 4000x4000: got %ux%u", w, h);
+   free(img);
+
+   printf("2048x1536: full decode %.1f ms, 256 px thumbnail %.1f ms\n",
+         t_full * 1000.0, t_thumb * 1000.0);
+
+   free(jpg);
+   free(rgb);
+
+   if (failures)
+   {
+      printf("%d check(s) failed\n", failures);
+      return 1;
+   }
+
+   printf("all checks passed\n");
+   return 0;
+}
@@ -0,0 +1,157 @@
+/* Copyright  (C) 2010-2020 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (cdrom_ecc_test.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <libchdr/cdrom.h>
+
+/* Built into this file to reach the scalar ecc_generate */
+#include "../../../formats/libchdr/libchdr_cdrom.c"
+
+/* Checks ecc_generate (whichever SIMD path the build selected)
+ * against the table-driven scalar routine it replaces, against a
+ * plain byte-at-a-time ECMA-130 reference and against ecc_verify. */
+
+#define SECTOR_TESTS 4096
+
+static uint8_t gf_mul2(uint8_t v)
+{
+   return (uint8_t)((v << 1) ^ ((v & 0x80) ? 0x1d : 0x00));
+}
+
+static uint8_t gf_mul(uint8_t a, uint8_t b)
+{
+   uint8_t r = 0;
+   while (b)
+   {
+      if (b & 1)
+         r ^= a;
+      a = gf_mul2(a);
+      b >>= 1;
+   }
+   return r;
+}
+
+static uint8_t ref_source(const uint8_t *sector, unsigned offset)
+{
+   if (sector[0x0f] == 2 && offset < 4)
+      return 0;
+   return sector[12 + offset];
+}
+
+static void ref_pair(const uint8_t *sector, const unsigned *offs,
+      unsigned count, uint8_t *out1, uint8_t *out2)
+{
+   unsigned i;
+   uint8_t v1 = 0, v2 = 0;
+   for (i = 0; i < count; i++)
+   {
+      uint8_t s = ref_source(sector, offs[i]);
+      v1 = gf_mul2(v1 ^ s);
+      v2 ^= s;
+   }
+   v1    = gf_mul(gf_mul2(v1) ^ v2, 0xf4);
+   *out1 = v1;
+   *out2 = v2 ^ v1;
+}
+
+static void ref_generate(uint8_t *sector)
+{
+   unsigned n, m;
+   unsigned offs[43];
+
+   for (n = 0; n < 86; n++)
+   {
+      for (m = 0; m < 24; m++)
+         offs[m] = 86 * m + n;
+      ref_pair(sector, offs, 24, &sector[0x81c + n], &sector[0x81c + 86 + n]);
+   }
+
+   for (n = 0; n < 52; n++)
+   {
+      for (m = 0; m < 43; m++)
+         offs[m] = ((((n >> 1) * 43 + m * 44) % 1118) << 1) + (n & 1);
+      ref_pair(sector, offs, 43, &sector[0x8c8 + n], &sector[0x8c8 + 52 + n]);
+   }
+}
+
+int main(void)
+{
+   unsigned i, j;
+   unsigned failures = 0;
+   uint8_t a[CD_MAX_SECTOR_DATA];
+   uint8_t b[CD_MAX_SECTOR_DATA];
+   uint8_t c[CD_MAX_SECTOR_DATA];
+
+   srand(0x5eed);
+
+   for (i = 0; i < SECTOR_TESTS; i++)
+   {
+      for (j = 0; j < sizeof(a); j++)
+         a[j] = (uint8_t)rand();
+
+      /* alternate mode 1 and mode 2 headers, plus some junk modes */
+      if (i & 1)
+         a[0x0f] = (i & 2) ? 2 : 1;
+
+      /* the degenerate all-zero and all-0xff sectors */
+      if (i == 0 || i == 1)
+         memset(a, i ? 0xff : 0x00, 0x81c);
+
+      memcpy(b, a, sizeof(a));
+      memcpy(c, a, sizeof(a));
+      ecc_generate(a);
+      ref_generate(b);
+      ecc_generate_scalar(c);
+
+      if (memcmp(a, c, sizeof(a)) != 0)
+      {
+         printf("sector %u (mode %u): ecc_generate differs from the scalar path\n",
+               i, (unsigned)a[0x0f]);
+         failures++;
+      }
+      else if (memcmp(a, b, sizeof(a)) != 0)
+      {
+         printf("sector %u (mode %u): ecc_generate differs from reference\n",
+               i, (unsigned)a[0x0f]);
+         failures++;
+      }
+      else if (!ecc_verify(a))
+      {
+         printf("sector %u (mode %u): ecc_verify rejected generated ECC\n",
+               i, (unsigned)a[0x0f]);
+         failures++;
+      }
+   }
+
+#ifdef ECC_SIMD_WIDTH
+   printf("%u/%u sectors bit-exact, %d byte SIMD against scalar\n",
+         SECTOR_TESTS - failures, SECTOR_TESTS, ECC_SIMD_WIDTH);
+#else
+   printf("%u/%u sectors bit-exact, scalar only\n",
+         SECTOR_TESTS - failures, SECTOR_TESTS);
+#endif
+   return failures ? 1 : 0;
+}
@@ -0,0 +1,193 @@
+/* Copyright  (C) 2010-2020 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (chd_codec_pool_test.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <libchdr/chd.h>
+#include <libchdr/cdrom.h>
+#include <rthreads/rthreads.h>
+
+/* Opens a CD zlib CHD, which takes one codec context per open, with
+ * the codec pool off and on, and from several threads at once, and
+ * checks the created/reused/idle counters along the way. */
+
+#define FRAMES_PER_HUNK 8
+#define HUNK_BYTES      (FRAMES_PER_HUNK * CD_FRAME_SIZE)
+#define HUNKS           4
+#define MAX_OPEN        12
+#define THREADS         4
+#define THREAD_OPENS    25
+
+static const char *path = "chd_codec_pool_test.chd";
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf(__VA_ARGS__); printf("\n"); failures++; } } while (0)
+
+static int write_chd(void)
+{
+   static const UINT32 compression[4] = { CHD_CODEC_CD_ZLIB, 0, 0, 0 };
+   uint8_t *hunk = (uint8_t*)malloc(HUNK_BYTES);
+   char meta[256];
+   chd_writer *writer;
+   unsigned hunknum, i;
+   chd_error err = chd_writer_create(path, (UINT64)HUNKS * HUNK_BYTES,
+         HUNK_BYTES, CD_FRAME_SIZE, compression, 0, &writer);
+
+   if (err != CHDERR_NONE)
+   {
+      free(hunk);
+      return 0;
+   }
+
+   snprintf(meta, sizeof(meta), CDROM_TRACK_METADATA2_FORMAT,
+         1, "MODE1_RAW", "NONE", HUNKS * FRAMES_PER_HUNK, 0, "MODE1", "RW", 0);
+   chd_writer_add_metadata(writer, CDROM_TRACK_METADATA2_TAG,
+         meta, strlen(meta) + 1, CHD_MDFLAGS_CHECKSUM);
+
+   for (hunknum = 0; hunknum < HUNKS && err == CHDERR_NONE; hunknum++)
+   {
+      for (i = 0; i < HUNK_BYTES; i++)
+         hunk[i] = (uint8_t)((i >> 4) + hunknum);
+      err = chd_writer_write(writer, hunk);
+   }
+
+   free(hunk);
+   return chd_writer_close(writer) == CHDERR_NONE && err == CHDERR_NONE;
+}
+
+/* Opens @count CHDs and reads a hunk from each, then closes them */
+static int open_many(unsigned count)
+{
+   chd_file *chd[MAX_OPEN];
+   uint8_t *hunk = (uint8_t*)malloc(HUNK_BYTES);
+   unsigned i, opened;
+   int ok = 1;
+
+   for (opened = 0; opened < count; opened++)
+   {
+      if (chd_open(path, CHD_OPEN_READ, NULL, &chd[opened]) != CHDERR_NONE)
+      {
+         ok = 0;
+         break;
+      }
+   }
+
+   for (i = 0; i < opened; i++)
+   {
+      if (chd_read(chd[i], i % HUNKS, hunk) != CHDERR_NONE
+            || hunk[HUNK_BYTES - 1] != (uint8_t)(((HUNK_BYTES - 1) >> 4) + i % HUNKS))
+         ok = 0;
+      chd_close(chd[i]);
+   }
+
+   free(hunk);
+   return ok;
+}
+
+static void check_stats(const char *what, UINT32 created, UINT32 reused,
+      UINT32 freed, UINT32 in_use, UINT32 idle)
+{
+   chd_codec_pool_stats stats;
+   chd_codec_pool_get_stats(&stats);
+   CHECK(stats.created == created && stats.reused == reused
+         && stats.freed == freed && stats.in_use == in_use && stats.idle == idle,
+         "%s: created %u reused %u freed %u in use %u idle %u, "
+         "expected %u %u %u %u %u", what,
+         stats.created, stats.reused, stats.freed, stats.in_use, stats.idle,
+         created, reused, freed, in_use, idle);
+}
+
+static int thread_ok[THREADS];
+
+static void open_thread(void *data)
+{
+   int *ok = (int*)data;
+   unsigned i;
+
+   *ok = 1;
+   for (i = 0; i < THREAD_OPENS; i++)
+      if (!open_many(1 + i % 3))
+         *ok = 0;
+}
+
+int main(void)
+{
+   chd_codec_pool_stats stats;
+   sthread_t *threads[THREADS];
+   unsigned i, opens = 0;
+
+   if (!write_chd())
+   {
+      printf("FAIL: could not write %s\n", path);
+      return 1;
+   }
+
+   /* without the pool nothing is kept or counted */
+   CHECK(open_many(2), "no pool: open failed");
+   check_stats("no pool", 0, 0, 0, 0, 0);
+
+   CHECK(chd_codec_pool_init() == CHDERR_NONE, "chd_codec_pool_init failed");
+
+   CHECK(open_many(3), "pool: open failed");
+   check_stats("three opened", 3, 0, 0, 0, 3);
+
+   CHECK(open_many(2), "pool: reopen failed");
+   check_stats("two reopened", 3, 2, 0, 0, 3);
+
+   /* past the idle cap, the extra contexts are freed on close */
+   CHECK(open_many(MAX_OPEN), "pool: open many failed");
+   check_stats("twelve opened", 12, 5, 4, 0, 8);
+
+   chd_codec_pool_trim();
+   check_stats("trimmed", 12, 5, 12, 0, 0);
+
+   for (i = 0; i < THREADS; i++)
+      threads[i] = sthread_create(open_thread, &thread_ok[i]);
+   for (i = 0; i < THREADS; i++)
+   {
+      sthread_join(threads[i]);
+      CHECK(thread_ok[i], "thread %u: open failed", i);
+   }
+   for (i = 0; i < THREAD_OPENS; i++)
+      opens += 1 + i % 3;
+   opens *= THREADS;
+
+   chd_codec_pool_get_stats(&stats);
+   CHECK(stats.in_use == 0 && stats.idle <= 8
+         && stats.created + stats.reused == 12 + 5 + opens
+         && stats.created - stats.freed == 12 - 12 + stats.idle,
+         "threads: created %u reused %u freed %u in use %u idle %u after %u opens",
+         stats.created, stats.reused, stats.freed, stats.in_use, stats.idle, opens);
+
+   chd_codec_pool_deinit();
+   remove(path);
+
+   if (failures)
+      printf("FAIL: %d checks failed\n", failures);
+   else
+      printf("PASS\n");
+   return failures ? 1 : 0;
+}
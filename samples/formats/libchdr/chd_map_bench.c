@@ -0,0 +1,340 @@
+/* Copyright  (C) 2010-2020 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (chd_map_bench.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <libchdr/bitstream.h>
+#include <libchdr/huffman.h>
+#include <features/features_cpu.h>
+
+/* Times decoding of the compression-type section of CHD v5 maps,
+ * one symbol per probe (huffman_decode_one) against the
+ * multi-symbol table (huffman_peek_multi).
+ *
+ * usage: chd_map_bench [file.chd ...]
+ *
+ * Without arguments a synthetic map of skewed symbols is used. */
+
+#define RLE_SMALL    7
+#define RLE_LARGE    8
+#define BENCH_RUNS   50
+
+static uint32_t be32(const uint8_t *p)
+{
+   return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint64_t be64(const uint8_t *p)
+{
+   return ((uint64_t)be32(p) << 32) | be32(p + 4);
+}
+
+/* the loop decompress_v5_map used before the multi-symbol table */
+static void decode_types_single(struct huffman_decoder *decoder,
+      struct bitstream *bitbuf, uint8_t *types, uint32_t hunkcount)
+{
+   uint32_t hunknum;
+   uint8_t lastcomp = 0;
+   int repcount     = 0;
+
+   for (hunknum = 0; hunknum < hunkcount; hunknum++)
+   {
+      if (repcount > 0)
+      {
+         types[hunknum] = lastcomp;
+         repcount--;
+      }
+      else
+      {
+         uint8_t val = huffman_decode_one(decoder, bitbuf);
+         if (val == RLE_SMALL)
+         {
+            types[hunknum] = lastcomp;
+            repcount       = 2 + huffman_decode_one(decoder, bitbuf);
+         }
+         else if (val == RLE_LARGE)
+         {
+            types[hunknum] = lastcomp;
+            repcount       = 2 + 16 + (huffman_decode_one(decoder, bitbuf) << 4);
+            repcount      += huffman_decode_one(decoder, bitbuf);
+         }
+         else
+            types[hunknum] = lastcomp = val;
+      }
+   }
+}
+
+/* same state machine as decompress_v5_map_types */
+static void decode_types_multi(struct huffman_decoder *decoder,
+      struct bitstream *bitbuf, uint8_t *types, uint32_t hunkcount)
+{
+   int state        = 0;
+   uint32_t hunknum = 0;
+   uint8_t lastcomp = 0;
+   int repcount     = 0;
+
+   while (hunknum < hunkcount || state != 0)
+   {
+      const struct huffman_multi_entry *entry = huffman_peek_multi(decoder, bitbuf);
+      int i, used = 0;
+
+      for (i = 0; i < entry->count; i++)
+      {
+         uint8_t val = (uint8_t)entry->symbol[i];
+         used += entry->numbits[i];
+
+         switch (state)
+         {
+            case 0:
+               if (val == RLE_SMALL)
+                  state = 1;
+               else if (val == RLE_LARGE)
+                  state = 2;
+               else
+                  lastcomp = val;
+               types[hunknum++] = lastcomp;
+               break;
+            case 1:
+               repcount = 2 + val;
+               state    = 0;
+               break;
+            case 2:
+               repcount = 2 + 16 + (val << 4);
+               state    = 3;
+               break;
+            case 3:
+               repcount += val;
+               state     = 0;
+               break;
+         }
+
+         if (state != 0)
+            continue;
+         for (; repcount > 0 && hunknum < hunkcount; repcount--)
+            types[hunknum++] = lastcomp;
+         if (hunknum >= hunkcount)
+            break;
+      }
+
+      bitstream_remove(bitbuf, used);
+   }
+}
+
+static int bench_map(const char *name, const uint8_t *map, uint32_t mapbytes,
+      uint32_t hunkcount)
+{
+   int run;
+   retro_time_t start, single_us = 0, multi_us = 0;
+   uint8_t *ref  = (uint8_t*)malloc(hunkcount + 1);
+   uint8_t *test = (uint8_t*)malloc(hunkcount + 1);
+   int ok        = 1;
+
+   for (run = 0; run < BENCH_RUNS && ok; run++)
+   {
+      struct huffman_decoder *decoder;
+      struct bitstream *bitbuf;
+      uint32_t single_end, multi_end;
+
+      decoder = create_huffman_decoder(16, 8);
+      bitbuf  = create_bitstream(map, mapbytes);
+      huffman_import_tree_rle(decoder, bitbuf);
+      start   = cpu_features_get_time_usec();
+      decode_types_single(decoder, bitbuf, ref, hunkcount);
+      single_us += cpu_features_get_time_usec() - start;
+      single_end = bitstream_read_offset(bitbuf);
+      free(bitbuf);
+      delete_huffman_decoder(decoder);
+
+      /* the multi-symbol timing includes building its table */
+      decoder = create_huffman_decoder(16, 8);
+      bitbuf  = create_bitstream(map, mapbytes);
+      huffman_import_tree_rle(decoder, bitbuf);
+      start   = cpu_features_get_time_usec();
+      huffman_build_multi_table(decoder);
+      decode_types_multi(decoder, bitbuf, test, hunkcount);
+      multi_us  += cpu_features_get_time_usec() - start;
+      multi_end  = bitstream_read_offset(bitbuf);
+      free(bitbuf);
+      delete_huffman_decoder(decoder);
+
+      if (memcmp(ref, test, hunkcount) != 0 || single_end != multi_end)
+         ok = 0;
+   }
+
+   printf("%s: %u hunks, single %.2f ns/hunk, multi %.2f ns/hunk%s\n",
+         name, (unsigned)hunkcount,
+         1000.0 * single_us / ((double)hunkcount * BENCH_RUNS),
+         1000.0 * multi_us  / ((double)hunkcount * BENCH_RUNS),
+         ok ? "" : " MISMATCH");
+
+   free(ref);
+   free(test);
+   return ok;
+}
+
+static int bench_file(const char *path)
+{
+   uint8_t header[124];
+   uint8_t maphdr[16];
+   uint64_t logicalbytes, mapoffset;
+   uint32_t hunkbytes, hunkcount, mapbytes;
+   uint8_t *map;
+   int ok = 0;
+   FILE *fp = fopen(path, "rb");
+
+   if (!fp)
+   {
+      printf("%s: cannot open\n", path);
+      return 0;
+   }
+
+   if (     fread(header, 1, sizeof(header), fp) != sizeof(header)
+         || memcmp(header, "MComprHD", 8) != 0
+         || be32(&header[12]) != 5)
+   {
+      printf("%s: not a CHD v5 file\n", path);
+      fclose(fp);
+      return 0;
+   }
+
+   logicalbytes = be64(&header[32]);
+   mapoffset    = be64(&header[40]);
+   hunkbytes    = be32(&header[56]);
+   hunkcount    = (uint32_t)((logicalbytes + hunkbytes - 1) / hunkbytes);
+
+   /* uncompressed CHDs have no huffman map */
+   if (be32(&header[16]) == 0)
+   {
+      printf("%s: uncompressed, no map to decode\n", path);
+      fclose(fp);
+      return 1;
+   }
+
+   fseek(fp, (long)mapoffset, SEEK_SET);
+   if (fread(maphdr, 1, sizeof(maphdr), fp) != sizeof(maphdr))
+   {
+      fclose(fp);
+      return 0;
+   }
+
+   mapbytes = be32(&maphdr[0]);
+   map      = (uint8_t*)malloc(mapbytes);
+   if (map && fread(map, 1, mapbytes, fp) == mapbytes)
+      ok = bench_map(path, map, mapbytes, hunkcount);
+
+   free(map);
+   fclose(fp);
+   return ok;
+}
+
+/* bit writer for the synthetic map */
+struct bitwriter
+{
+   uint8_t *data;
+   uint32_t bits;
+};
+
+static void put_bits(struct bitwriter *w, uint32_t value, int numbits)
+{
+   while (numbits--)
+   {
+      if ((value >> numbits) & 1)
+         w->data[w->bits >> 3] |= 0x80 >> (w->bits & 7);
+      w->bits++;
+   }
+}
+
+static int bench_synthetic(void)
+{
+   /* code lengths of a skewed but complete tree; symbol 0 (the
+    * primary codec) dominates like it does on real CD images */
+   static const uint8_t lengths[16] =
+      { 1, 3, 4, 4, 6, 7, 5, 3, 5, 8, 8, 6, 7, 8, 8, 0 };
+   const uint32_t symbols          = 1 << 20;
+   struct huffman_decoder *encoder = create_huffman_decoder(16, 8);
+   struct bitwriter w;
+   uint32_t i, hunkcount = 0;
+   int ok;
+
+   w.data = (uint8_t*)calloc(symbols * 3 + 64, 1);
+   w.bits = 0;
+
+   for (i = 0; i < 16; i++)
+   {
+      encoder->huffnode[i].numbits = lengths[i];
+      /* the RLE tree format escapes a length of 1 */
+      if (lengths[i] == 1)
+         put_bits(&w, 1, 4);
+      put_bits(&w, lengths[i], 4);
+   }
+   huffman_assign_canonical_codes(encoder);
+   huffman_build_lookup_table(encoder);
+
+   srand(1);
+   for (i = 0; i < symbols; i++)
+   {
+      /* the lookup table maps a random byte to a symbol
+       * with probability 2^-length */
+      uint32_t sym = encoder->lookup[rand() & 0xff] >> 5;
+      put_bits(&w, encoder->huffnode[sym].bits, lengths[sym]);
+
+      if (sym == RLE_SMALL)
+      {
+         uint32_t count = (uint32_t)rand() % 15;
+         put_bits(&w, encoder->huffnode[count].bits, lengths[count]);
+         hunkcount += 1 + 2 + count;
+      }
+      else if (sym == RLE_LARGE)
+      {
+         uint32_t hi = (uint32_t)rand() % 15;
+         uint32_t lo = (uint32_t)rand() % 15;
+         put_bits(&w, encoder->huffnode[hi].bits, lengths[hi]);
+         put_bits(&w, encoder->huffnode[lo].bits, lengths[lo]);
+         hunkcount += 1 + 2 + 16 + (hi << 4) + lo;
+      }
+      else
+         hunkcount++;
+   }
+
+   ok = bench_map("synthetic", w.data, (w.bits + 7) >> 3, hunkcount);
+
+   delete_huffman_decoder(encoder);
+   free(w.data);
+   return ok;
+}
+
+int main(int argc, char *argv[])
+{
+   int i;
+   int ok = 1;
+
+   if (argc < 2)
+      return bench_synthetic() ? 0 : 1;
+
+   for (i = 1; i < argc; i++)
+      ok &= bench_file(argv[i]);
+
+   return ok ? 0 : 1;
+}
@@ -0,0 +1,324 @@
+/* Copyright  (C) 2010-2020 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (chd_writer_test.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <libchdr/chd.h>
+#include <libchdr/cdrom.h>
+#include <streams/chd_stream.h>
+#include <features/features_cpu.h>
+
+/* Writes a synthetic CD image through chd_writer with and without
+ * worker threads, checks both files are byte-identical, reads every
+ * hunk and metadata entry back through chd_open and the track data
+ * back through chdstream. */
+
+#define FRAMES_PER_HUNK 8
+#define HUNK_BYTES      (FRAMES_PER_HUNK * CD_FRAME_SIZE)
+#define WRITTEN_HUNKS   45
+#define TOTAL_HUNKS     (WRITTEN_HUNKS + 2)
+#define TRACK_FRAMES    (TOTAL_HUNKS * FRAMES_PER_HUNK)
+
+static const char *track_meta =
+   "TRACK:1 TYPE:MODE1_RAW SUBTYPE:NONE FRAMES:376 PREGAP:0 PGTYPE:MODE1 PGSUB:RW POSTGAP:0";
+
+static void fill_hunk(uint8_t *hunk, unsigned hunknum)
+{
+   unsigned frame, i;
+   /* short runs at the start, then long runs of one type so the
+    * map gets both literal and RLE coded types */
+   unsigned kind = (hunknum < 8) ? hunknum % 4 : (hunknum < 30) ? 2 : (hunknum < 36) ? 1 : hunknum % 4;
+
+   for (frame = 0; frame < FRAMES_PER_HUNK; frame++)
+   {
+      uint8_t *sector  = &hunk[frame * CD_FRAME_SIZE];
+      uint8_t *subcode = &sector[CD_MAX_SECTOR_DATA];
+      unsigned lba     = hunknum * FRAMES_PER_HUNK + frame;
+
+      switch (kind)
+      {
+         case 0:
+            /* mode 1 data whose ECC the writer can strip */
+            memset(sector, 0, CD_MAX_SECTOR_DATA);
+            memcpy(sector, s_cd_sync_header, sizeof(s_cd_sync_header));
+            sector[12] = lba / 4500;
+            sector[13] = (lba / 75) % 60;
+            sector[14] = lba % 75;
+            sector[15] = 1;
+            for (i = 16; i < 16 + 2048; i++)
+               sector[i] = (uint8_t)(i * lba);
+            ecc_generate(sector);
+            break;
+         case 1:
+            /* noise: only storable uncompressed */
+            for (i = 0; i < CD_MAX_SECTOR_DATA; i++)
+               sector[i] = (uint8_t)rand();
+            break;
+         case 2:
+            memset(sector, 0, CD_MAX_SECTOR_DATA);
+            break;
+         default:
+            /* audio-ish ramps */
+            for (i = 0; i < CD_MAX_SECTOR_DATA; i++)
+               sector[i] = (uint8_t)((i >> 2) + lba);
+            break;
+      }
+
+      for (i = 0; i < CD_MAX_SUBCODE_DATA; i++)
+         subcode[i] = (uint8_t)(lba + (i / 12));
+   }
+}
+
+static int write_chd(const char *path, const uint8_t *image, int threads)
+{
+   static const UINT32 compression[4] = { CHD_CODEC_CD_ZLIB, 0, 0, 0 };
+   chd_writer *writer;
+   unsigned hunknum;
+   chd_error err = chd_writer_create(path,
+         (UINT64)TOTAL_HUNKS * HUNK_BYTES - CD_FRAME_SIZE,
+         HUNK_BYTES, CD_FRAME_SIZE, compression, threads, &writer);
+
+   if (err != CHDERR_NONE)
+   {
+      printf("chd_writer_create: %s\n", chd_error_string(err));
+      return 0;
+   }
+
+   chd_writer_add_metadata(writer, CDROM_TRACK_METADATA2_TAG,
+         track_meta, strlen(track_meta) + 1, CHD_MDFLAGS_CHECKSUM);
+   chd_writer_add_metadata(writer, CDROM_TRACK_METADATA2_TAG,
+         track_meta, strlen(track_meta) + 1, CHD_MDFLAGS_CHECKSUM);
+
+   /* the last two hunks are left for chd_writer_close to pad */
+   for (hunknum = 0; hunknum < WRITTEN_HUNKS; hunknum++)
+   {
+      err = chd_writer_write(writer, &image[hunknum * HUNK_BYTES]);
+      if (err != CHDERR_NONE)
+      {
+         printf("chd_writer_write(%u): %s\n", hunknum, chd_error_string(err));
+         chd_writer_close(writer);
+         return 0;
+      }
+   }
+
+   err = chd_writer_close(writer);
+   if (err != CHDERR_NONE)
+   {
+      printf("chd_writer_close: %s\n", chd_error_string(err));
+      return 0;
+   }
+   return 1;
+}
+
+static uint8_t *load_file(const char *path, long *size)
+{
+   uint8_t *data;
+   FILE *fp = fopen(path, "rb");
+   if (!fp)
+      return NULL;
+   fseek(fp, 0, SEEK_END);
+   *size = ftell(fp);
+   fseek(fp, 0, SEEK_SET);
+   data = (uint8_t*)malloc(*size);
+   if (fread(data, 1, *size, fp) != (size_t)*size)
+   {
+      free(data);
+      data = NULL;
+   }
+   fclose(fp);
+   return data;
+}
+
+static int verify_chd(const char *path, const uint8_t *image)
+{
+   chd_file *chd;
+   const chd_header *header;
+   uint8_t *hunk = (uint8_t*)malloc(HUNK_BYTES);
+   char meta[256];
+   UINT32 metalen, metatag;
+   UINT8 metaflags;
+   unsigned hunknum, index;
+   int ok = 1;
+   chd_error err = chd_open(path, CHD_OPEN_READ, NULL, &chd);
+
+   if (err != CHDERR_NONE)
+   {
+      printf("chd_open: %s\n", chd_error_string(err));
+      free(hunk);
+      return 0;
+   }
+
+   header = chd_get_header(chd);
+   if (header->version != 5 || header->hunkbytes != HUNK_BYTES
+         || header->hunkcount != TOTAL_HUNKS)
+   {
+      printf("unexpected header: version %u, %u bytes x %u hunks\n",
+            header->version, header->hunkbytes, header->hunkcount);
+      ok = 0;
+   }
+
+   for (hunknum = 0; ok && hunknum < TOTAL_HUNKS; hunknum++)
+   {
+      err = chd_read(chd, hunknum, hunk);
+      if (err != CHDERR_NONE)
+      {
+         printf("chd_read(%u): %s\n", hunknum, chd_error_string(err));
+         ok = 0;
+      }
+      else if (memcmp(hunk, &image[hunknum * HUNK_BYTES], HUNK_BYTES) != 0)
+      {
+         printf("hunk %u differs\n", hunknum);
+         ok = 0;
+      }
+   }
+
+   for (index = 0; ok && index < 2; index++)
+   {
+      err = chd_get_metadata(chd, CDROM_TRACK_METADATA2_TAG, index,
+            meta, sizeof(meta), &metalen, &metatag, &metaflags);
+      if (err != CHDERR_NONE || metalen != strlen(track_meta) + 1
+            || strcmp(meta, track_meta) != 0 || metaflags != CHD_MDFLAGS_CHECKSUM)
+      {
+         printf("metadata %u mismatch\n", index);
+         ok = 0;
+      }
+   }
+   if (ok && chd_get_metadata(chd, CDROM_TRACK_METADATA2_TAG, 2,
+            meta, sizeof(meta), &metalen, &metatag, &metaflags) != CHDERR_METADATA_NOT_FOUND)
+   {
+      printf("metadata chain not terminated\n");
+      ok = 0;
+   }
+
+   chd_close(chd);
+   free(hunk);
+   return ok;
+}
+
+/* The track is MODE1_RAW, so chdstream hands out the whole 2352 byte
+ * sector of every frame, without the subcode. */
+static int verify_chdstream(const char *path, const uint8_t *image)
+{
+   uint8_t *data = (uint8_t*)malloc(TRACK_FRAMES * CD_MAX_SECTOR_DATA);
+   uint8_t sector[CD_MAX_SECTOR_DATA];
+   chdstream_t *stream = chdstream_open(path, 1);
+   size_t offset;
+   unsigned frame;
+   int ok = 1;
+
+   if (!stream)
+   {
+      printf("chdstream_open failed\n");
+      free(data);
+      return 0;
+   }
+
+   if (chdstream_get_size(stream) != TRACK_FRAMES * CD_MAX_SECTOR_DATA)
+   {
+      printf("chdstream size %ld, expected %d\n",
+            (long)chdstream_get_size(stream), TRACK_FRAMES * CD_MAX_SECTOR_DATA);
+      ok = 0;
+   }
+
+   /* chunks that straddle frames and hunks */
+   for (offset = 0; ok && offset < TRACK_FRAMES * CD_MAX_SECTOR_DATA; )
+   {
+      ssize_t got = chdstream_read(stream, data + offset, 1000);
+      if (got <= 0)
+      {
+         printf("chdstream_read at %lu failed\n", (unsigned long)offset);
+         ok = 0;
+         break;
+      }
+      offset += (size_t)got;
+   }
+
+   for (frame = 0; ok && frame < TRACK_FRAMES; frame++)
+      if (memcmp(&data[frame * CD_MAX_SECTOR_DATA],
+               &image[frame * CD_FRAME_SIZE], CD_MAX_SECTOR_DATA) != 0)
+      {
+         printf("chdstream frame %u differs\n", frame);
+         ok = 0;
+      }
+
+   frame = 5 * FRAMES_PER_HUNK + 3;
+   if (ok && (chdstream_seek(stream, frame * CD_MAX_SECTOR_DATA, SEEK_SET) != 0
+         || chdstream_read(stream, sector, sizeof(sector)) != sizeof(sector)
+         || memcmp(sector, &image[frame * CD_FRAME_SIZE], sizeof(sector)) != 0))
+   {
+      printf("chdstream seek to frame %u failed\n", frame);
+      ok = 0;
+   }
+
+   chdstream_close(stream);
+   free(data);
+   return ok;
+}
+
+int main(void)
+{
+   const char *single = "chd_writer_test_1.chd";
+   const char *multi  = "chd_writer_test_4.chd";
+   uint8_t *image     = (uint8_t*)calloc(TOTAL_HUNKS, HUNK_BYTES);
+   uint8_t *a, *b;
+   long asize = 0, bsize = 0;
+   retro_time_t start, t1, t4;
+   unsigned hunknum;
+   int ok;
+
+   srand(1);
+   for (hunknum = 0; hunknum < WRITTEN_HUNKS; hunknum++)
+      fill_hunk(&image[hunknum * HUNK_BYTES], hunknum);
+
+   start = cpu_features_get_time_usec();
+   ok    = write_chd(single, image, 0);
+   t1    = cpu_features_get_time_usec() - start;
+   start = cpu_features_get_time_usec();
+   ok    = ok && write_chd(multi, image, 4);
+   t4    = cpu_features_get_time_usec() - start;
+   if (!ok)
+      return 1;
+
+   a = load_file(single, &asize);
+   b = load_file(multi, &bsize);
+   if (!a || !b || asize != bsize || memcmp(a, b, asize) != 0)
+   {
+      printf("threaded output differs from single-threaded output\n");
+      ok = 0;
+   }
+
+   ok = ok && verify_chd(single, image);
+   ok = ok && verify_chdstream(multi, image);
+
+   printf("%s: %u hunks -> %ld bytes, %.1f ms on 1 thread, %.1f ms on 4\n",
+         ok ? "PASS" : "FAIL", TOTAL_HUNKS, asize, t1 / 1000.0, t4 / 1000.0);
+
+   remove(single);
+   remove(multi);
+   free(a);
+   free(b);
+   free(image);
+   return ok ? 0 : 1;
+}
@@ -0,0 +1,148 @@
+/* Copyright  (C) 2010-2020 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (chdstream_swab_test.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <libchdr/chd.h>
+#include <libchdr/cdrom.h>
+#include <streams/chd_stream.h>
+#include <features/features_cpu.h>
+
+/* Writes a CHD with one audio track and reads it back through
+ * chdstream in odd-sized, odd-aligned chunks, checking every sample
+ * comes out little-endian. */
+
+#define FRAMES_PER_HUNK 8
+#define HUNK_BYTES      (FRAMES_PER_HUNK * CD_FRAME_SIZE)
+#define TRACK_FRAMES    1500
+#define TRACK_HUNKS     ((TRACK_FRAMES + FRAMES_PER_HUNK - 1) / FRAMES_PER_HUNK)
+#define TRACK_BYTES     (TRACK_FRAMES * CD_MAX_SECTOR_DATA)
+
+static const char *path = "chdstream_swab_test.chd";
+
+/* big-endian sample data as a CHD stores it */
+static uint8_t stored_byte(unsigned frame, unsigned i)
+{
+   return (uint8_t)((frame * 7) ^ (i * 13) ^ (i >> 7));
+}
+
+static int write_track(void)
+{
+   static const UINT32 compression[4] = { CHD_CODEC_CD_ZLIB, 0, 0, 0 };
+   uint8_t *hunk = (uint8_t*)calloc(1, HUNK_BYTES);
+   char meta[256];
+   chd_writer *writer;
+   unsigned hunknum, frame, i;
+   chd_error err = chd_writer_create(path,
+         (UINT64)TRACK_HUNKS * HUNK_BYTES, HUNK_BYTES, CD_FRAME_SIZE,
+         compression, 4, &writer);
+
+   if (err != CHDERR_NONE)
+   {
+      free(hunk);
+      return 0;
+   }
+
+   snprintf(meta, sizeof(meta), CDROM_TRACK_METADATA2_FORMAT,
+         1, "AUDIO", "NONE", TRACK_FRAMES, 0, "AUDIO", "RW", 0);
+   chd_writer_add_metadata(writer, CDROM_TRACK_METADATA2_TAG,
+         meta, strlen(meta) + 1, CHD_MDFLAGS_CHECKSUM);
+
+   for (hunknum = 0; hunknum < TRACK_HUNKS && err == CHDERR_NONE; hunknum++)
+   {
+      for (frame = 0; frame < FRAMES_PER_HUNK; frame++)
+         for (i = 0; i < CD_FRAME_SIZE; i++)
+            hunk[frame * CD_FRAME_SIZE + i] =
+               stored_byte(hunknum * FRAMES_PER_HUNK + frame, i);
+      err = chd_writer_write(writer, hunk);
+   }
+
+   free(hunk);
+   return chd_writer_close(writer) == CHDERR_NONE && err == CHDERR_NONE;
+}
+
+int main(void)
+{
+   uint8_t *expected = (uint8_t*)malloc(TRACK_BYTES);
+   uint8_t *actual   = (uint8_t*)malloc(TRACK_BYTES);
+   chdstream_t *stream;
+   retro_time_t start, elapsed;
+   size_t offset;
+   unsigned frame, i, pass;
+   int ok = 1;
+
+   for (frame = 0; frame < TRACK_FRAMES; frame++)
+      for (i = 0; i < CD_MAX_SECTOR_DATA; i++)
+         expected[frame * CD_MAX_SECTOR_DATA + i] = stored_byte(frame, i ^ 1);
+
+   if (!write_track() || !(stream = chdstream_open(path, 1)))
+   {
+      printf("could not create the test CHD\n");
+      remove(path);
+      return 1;
+   }
+
+   /* odd chunk sizes put every alignment at the frame and hunk edges */
+   srand(1);
+   memset(actual, 0, TRACK_BYTES);
+   for (offset = 0; offset < TRACK_BYTES; )
+   {
+      size_t chunk = 1 + (rand() % 5000);
+      ssize_t got  = chdstream_read(stream, actual + offset, chunk);
+      if (got <= 0)
+         break;
+      offset += got;
+   }
+   if (offset != TRACK_BYTES || memcmp(actual, expected, TRACK_BYTES) != 0)
+   {
+      printf("chunked read mismatch\n");
+      ok = 0;
+   }
+
+   /* whole-sector reads, as a core streaming CD audio does */
+   start = cpu_features_get_time_usec();
+   for (pass = 0; pass < 20 && ok; pass++)
+   {
+      chdstream_rewind(stream);
+      for (frame = 0; frame < TRACK_FRAMES; frame++)
+         chdstream_read(stream, actual + frame * CD_MAX_SECTOR_DATA, CD_MAX_SECTOR_DATA);
+   }
+   elapsed = cpu_features_get_time_usec() - start;
+   if (ok && memcmp(actual, expected, TRACK_BYTES) != 0)
+   {
+      printf("sector read mismatch\n");
+      ok = 0;
+   }
+
+   printf("%s: %u frames, %.1f MB/s through chdstream_read\n",
+         ok ? "PASS" : "FAIL", TRACK_FRAMES,
+         elapsed ? (20.0 * TRACK_BYTES) / elapsed : 0.0);
+
+   chdstream_close(stream);
+   remove(path);
+   free(expected);
+   free(actual);
+   return ok ? 0 : 1;
+}
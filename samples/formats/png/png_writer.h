@@ -0,0 +1,259 @@
+/* Copyright  (C) 2010-2020 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (png_writer.h).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef __PNG_WRITER_H__
+#define __PNG_WRITER_H__
+
+/* Minimal PNG writer for the decoder tests and benchmarks. rpng only
+ * saves 8 bit RGB and RGBA, so this covers the rest: every colour type
+ * and bit depth, palettes, Adam7 interlacing, and all five filters,
+ * picked in turn row by row. Compression is left to zlib. */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zlib.h>
+
+typedef struct
+{
+   int color_type;          /* 0, 2, 3, 4 or 6 */
+   int depth;               /* 1, 2, 4, 8 or 16, as the type allows */
+   int interlace;           /* Adam7 if set */
+   const uint32_t *palette; /* ARGB, for colour type 3 */
+   unsigned palette_len;
+} png_writer_opts;
+
+typedef struct
+{
+   uint8_t *data;
+   size_t len, cap;
+} png_writer_buf;
+
+static void png_writer_put(png_writer_buf *b, const void *data, size_t len)
+{
+   while (b->len + len > b->cap)
+   {
+      b->cap  = b->cap ? b->cap * 2 : 4096;
+      b->data = (uint8_t*)realloc(b->data, b->cap);
+   }
+   memcpy(b->data + b->len, data, len);
+   b->len += len;
+}
+
+static void png_writer_be32(uint8_t *p, uint32_t v)
+{
+   p[0] = (uint8_t)(v >> 24);
+   p[1] = (uint8_t)(v >> 16);
+   p[2] = (uint8_t)(v >>  8);
+   p[3] = (uint8_t)(v >>  0);
+}
+
+static void png_writer_chunk(png_writer_buf *b, const char *type,
+      const uint8_t *data, size_t len)
+{
+   uint8_t word[4];
+   uLong crc = crc32(0, (const Bytef*)type, 4);
+
+   if (len)
+      crc = crc32(crc, data, (uInt)len);
+
+   png_writer_be32(word, (uint32_t)len);
+   png_writer_put(b, word, 4);
+   png_writer_put(b, type, 4);
+   if (len)
+      png_writer_put(b, data, len);
+   png_writer_be32(word, (uint32_t)crc);
+   png_writer_put(b, word, 4);
+}
+
+static unsigned png_writer_bits(const png_writer_opts *opts)
+{
+   static const unsigned channels[7] = { 1, 0, 3, 1, 2, 0, 4 };
+   return channels[opts->color_type] * opts->depth;
+}
+
+static int png_writer_paeth(int a, int b, int c)
+{
+   int p  = a + b - c;
+   int pa = abs(p - a);
+   int pb = abs(p - b);
+   int pc = abs(p - c);
+   if (pa <= pb && pa <= pc)
+      return a;
+   return pb <= pc ? b : c;
+}
+
+/* Appends a row with the filter byte in front */
+static void png_writer_filter(png_writer_buf *b, const uint8_t *row,
+      const uint8_t *prev, size_t len, unsigned bpp, int filter)
+{
+   size_t i;
+   uint8_t f = (uint8_t)filter;
+   uint8_t *out;
+
+   png_writer_put(b, &f, 1);
+   png_writer_put(b, row, len);
+   out = b->data + b->len - len;
+
+   for (i = 0; i < len; i++)
+   {
+      int a = i >= bpp ? row[i - bpp] : 0;
+      int u = prev ? prev[i] : 0;
+      int c = prev && i >= bpp ? prev[i - bpp] : 0;
+
+      switch (filter)
+      {
+         case 1:
+            out[i] = (uint8_t)(row[i] - a);
+            break;
+         case 2:
+            out[i] = (uint8_t)(row[i] - u);
+            break;
+         case 3:
+            out[i] = (uint8_t)(row[i] - ((a + u) >> 1));
+            break;
+         case 4:
+            out[i] = (uint8_t)(row[i] - png_writer_paeth(a, u, c));
+            break;
+      }
+   }
+}
+
+/* Copies pixel sx of src to pixel dx of dst, bits bits each */
+static void png_writer_copy_pixel(uint8_t *dst, unsigned dx,
+      const uint8_t *src, unsigned sx, unsigned bits)
+{
+   if (bits >= 8)
+      memcpy(dst + dx * (bits / 8), src + sx * (bits / 8), bits / 8);
+   else
+   {
+      unsigned s     = sx * bits;
+      unsigned d     = dx * bits;
+      unsigned mask  = (1u << bits) - 1;
+      unsigned v     = (src[s / 8] >> (8 - bits - s % 8)) & mask;
+      dst[d / 8]    &= (uint8_t)~(mask << (8 - bits - d % 8));
+      dst[d / 8]    |= (uint8_t)(v << (8 - bits - d % 8));
+   }
+}
+
+/* Returns a malloc'd PNG of raw, rows of samples packed as the PNG
+ * stores them (big endian, bits from the top), or NULL */
+static uint8_t *png_writer_encode(const uint8_t *raw, unsigned width,
+      unsigned height, const png_writer_opts *opts, size_t *len)
+{
+   static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+   static const unsigned pass_x0[7]  = { 0, 4, 0, 2, 0, 1, 0 };
+   static const unsigned pass_y0[7]  = { 0, 0, 4, 0, 2, 0, 1 };
+   static const unsigned pass_dx[7]  = { 8, 8, 4, 4, 2, 2, 1 };
+   static const unsigned pass_dy[7]  = { 8, 8, 8, 4, 4, 2, 2 };
+   png_writer_buf out, filtered;
+   uint8_t ihdr[13];
+   unsigned bits     = png_writer_bits(opts);
+   unsigned bpp      = bits < 8 ? 1 : bits / 8;
+   size_t stride     = ((size_t)width * bits + 7) / 8;
+   uint8_t *rows[2];
+   unsigned pass, passes = opts->interlace ? 7 : 1;
+   int filter        = 0;
+   uLongf zlen;
+   uint8_t *z;
+
+   memset(&out, 0, sizeof(out));
+   memset(&filtered, 0, sizeof(filtered));
+   rows[0] = (uint8_t*)calloc(1, stride + 1);
+   rows[1] = (uint8_t*)calloc(1, stride + 1);
+
+   for (pass = 0; pass < passes; pass++)
+   {
+      unsigned x0 = opts->interlace ? pass_x0[pass] : 0;
+      unsigned y0 = opts->interlace ? pass_y0[pass] : 0;
+      unsigned dx = opts->interlace ? pass_dx[pass] : 1;
+      unsigned dy = opts->interlace ? pass_dy[pass] : 1;
+      unsigned pw = width  > x0 ? (width  - x0 + dx - 1) / dx : 0;
+      unsigned ph = height > y0 ? (height - y0 + dy - 1) / dy : 0;
+      size_t plen = ((size_t)pw * bits + 7) / 8;
+      unsigned x, y, n = 0;
+
+      if (!pw || !ph)
+         continue;
+
+      for (y = y0; y < height; y += dy, n++)
+      {
+         uint8_t *row  = rows[n & 1];
+         uint8_t *prev = n ? rows[(n & 1) ^ 1] : NULL;
+
+         memset(row, 0, plen);
+         for (x = 0; x < pw; x++)
+            png_writer_copy_pixel(row, x, raw + stride * y, x0 + x * dx, bits);
+
+         png_writer_filter(&filtered, row, prev, plen, bpp, filter);
+         filter = (filter + 1) % 5;
+      }
+   }
+
+   free(rows[0]);
+   free(rows[1]);
+
+   zlen = compressBound((uLong)filtered.len);
+   z    = (uint8_t*)malloc(zlen);
+   if (!z || compress2(z, &zlen, filtered.data, (uLong)filtered.len, 6) != Z_OK)
+   {
+      free(z);
+      free(filtered.data);
+      return NULL;
+   }
+   free(filtered.data);
+
+   png_writer_put(&out, signature, sizeof(signature));
+
+   png_writer_be32(ihdr + 0, width);
+   png_writer_be32(ihdr + 4, height);
+   ihdr[8]  = (uint8_t)opts->depth;
+   ihdr[9]  = (uint8_t)opts->color_type;
+   ihdr[10] = 0;
+   ihdr[11] = 0;
+   ihdr[12] = opts->interlace ? 1 : 0;
+   png_writer_chunk(&out, "IHDR", ihdr, sizeof(ihdr));
+
+   if (opts->color_type == 3)
+   {
+      unsigned i;
+      uint8_t plte[256 * 3];
+      for (i = 0; i < opts->palette_len; i++)
+      {
+         plte[i * 3 + 0] = (uint8_t)(opts->palette[i] >> 16);
+         plte[i * 3 + 1] = (uint8_t)(opts->palette[i] >>  8);
+         plte[i * 3 + 2] = (uint8_t)(opts->palette[i] >>  0);
+      }
+      png_writer_chunk(&out, "PLTE", plte, opts->palette_len * 3);
+   }
+
+   png_writer_chunk(&out, "IDAT", z, zlen);
+   png_writer_chunk(&out, "IEND", NULL, 0);
+   free(z);
+
+   *len = out.len;
+   return out.data;
+}
+
+#endif
@@ -0,0 +1,575 @@
+/* Copyright  (C) 2010-2020 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (rpng_decode_test.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <zlib.h>
+
+#include <formats/rpng.h>
+#include <formats/image.h>
+
+/* Writes PNGs of every color type and bit depth rpng reads, with every
+ * row filter, plain and interlaced, small and large enough to be
+ * decoded on threads, and checks the decoded pixels against the ones
+ * they were made from, whole and pushed in pieces to rpng_stream. */
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf(__VA_ARGS__); printf("\n"); failures++; } } while (0)
+
+static const unsigned adam7[7][4] = {
+   { 0, 0, 8, 8 }, { 4, 0, 8, 8 }, { 0, 4, 4, 8 }, { 2, 0, 4, 4 },
+   { 0, 2, 2, 4 }, { 1, 0, 2, 2 }, { 0, 1, 1, 2 },
+};
+
+typedef struct
+{
+   uint8_t *data;
+   size_t len;
+   size_t cap;
+} buffer_t;
+
+static uint32_t rng_state = 1;
+
+static uint32_t rng(void)
+{
+   rng_state = rng_state * 1103515245u + 12345u;
+   return rng_state >> 8;
+}
+
+static void buf_put(buffer_t *b, const void *p, size_t len)
+{
+   if (b->len + len > b->cap)
+   {
+      b->cap  = (b->len + len) * 2;
+      b->data = (uint8_t*)realloc(b->data, b->cap);
+   }
+   memcpy(b->data + b->len, p, len);
+   b->len += len;
+}
+
+static void buf_put32(buffer_t *b, uint32_t v)
+{
+   uint8_t d[4];
+   d[0] = v >> 24; d[1] = v >> 16; d[2] = v >> 8; d[3] = v;
+   buf_put(b, d, 4);
+}
+
+static void put_chunk(buffer_t *b, const char *type, const uint8_t *data, size_t len)
+{
+   uint32_t crc = crc32(0, (const uint8_t*)type, 4);
+   if (len)
+      crc = crc32(crc, data, (uInt)len);
+   buf_put32(b, (uint32_t)len);
+   buf_put(b, type, 4);
+   if (len)
+      buf_put(b, data, len);
+   buf_put32(b, crc);
+}
+
+static unsigned channels_of(unsigned color_type)
+{
+   switch (color_type)
+   {
+      case 2: return 3;
+      case 4: return 2;
+      case 6: return 4;
+   }
+   return 1;
+}
+
+static uint8_t paeth_pred(int a, int b, int c)
+{
+   int p  = a + b - c;
+   int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+   if (pa <= pb && pa <= pc)
+      return a;
+   if (pb <= pc)
+      return b;
+   return c;
+}
+
+/* Appends one filtered pass of raw rows to out. */
+static void filter_rows(buffer_t *out, const uint8_t *raw, unsigned pitch,
+      unsigned rows, unsigned bpp, unsigned row_seed)
+{
+   unsigned x, y;
+   uint8_t *line = (uint8_t*)malloc(pitch + 1);
+
+   for (y = 0; y < rows; y++)
+   {
+      const uint8_t *cur  = raw + (size_t)y * pitch;
+      const uint8_t *prev = y ? cur - pitch : NULL;
+      unsigned filter     = (y + row_seed) % 5;
+
+      line[0] = filter;
+      for (x = 0; x < pitch; x++)
+      {
+         int a = x >= bpp ? cur[x - bpp] : 0;
+         int b = prev ? prev[x] : 0;
+         int c = (prev && x >= bpp) ? prev[x - bpp] : 0;
+         uint8_t pred = 0;
+
+         switch (filter)
+         {
+            case 1: pred = a; break;
+            case 2: pred = b; break;
+            case 3: pred = (a + b) >> 1; break;
+            case 4: pred = paeth_pred(a, b, c); break;
+         }
+         line[x + 1] = cur[x] - pred;
+      }
+      buf_put(out, line, pitch + 1);
+   }
+
+   free(line);
+}
+
+/* Packs samples[] (one per channel per pixel) of the pixels at
+ * (x0 + i * sx, y) into a row. */
+static void pack_row(uint8_t *row, const uint16_t *samples, unsigned width,
+      unsigned channels, unsigned depth, unsigned x0, unsigned sx,
+      unsigned count, unsigned y)
+{
+   unsigned i, c, bit = 0;
+   unsigned pitch = (count * channels * depth + 7) / 8;
+
+   memset(row, 0, pitch);
+
+   for (i = 0; i < count; i++)
+   {
+      const uint16_t *px = samples + ((size_t)y * width + x0 + i * sx) * channels;
+
+      for (c = 0; c < channels; c++)
+      {
+         if (depth == 16)
+         {
+            row[bit / 8]     = px[c] >> 8;
+            row[bit / 8 + 1] = px[c] & 0xff;
+         }
+         else if (depth == 8)
+            row[bit / 8] = (uint8_t)px[c];
+         else
+            row[bit / 8] |= px[c] << (8 - depth - (bit & 7));
+         bit += depth;
+      }
+   }
+}
+
+static uint32_t expected_pixel(const uint16_t *px, unsigned color_type,
+      unsigned depth, const uint32_t *palette)
+{
+   unsigned v;
+
+   switch (color_type)
+   {
+      case 0:
+         v = depth == 16 ? px[0] >> 8 : px[0] * (0xff / ((1u << depth) - 1));
+         return 0xff000000u | v * 0x010101u;
+      case 2:
+         if (depth == 16)
+            return 0xff000000u | (px[0] >> 8) << 16 | (px[1] >> 8) << 8 | px[2] >> 8;
+         return 0xff000000u | px[0] << 16 | px[1] << 8 | px[2];
+      case 3:
+         return palette[px[0]];
+      case 4:
+         if (depth == 16)
+            return (uint32_t)(px[1] >> 8) << 24 | (px[0] >> 8) * 0x010101u;
+         return (uint32_t)px[1] << 24 | px[0] * 0x010101u;
+      case 6:
+         if (depth == 16)
+            return (uint32_t)(px[3] >> 8) << 24 | (px[0] >> 8) << 16 | (px[1] >> 8) << 8 | px[2] >> 8;
+         return (uint32_t)px[3] << 24 | px[0] << 16 | px[1] << 8 | px[2];
+   }
+
+   return 0;
+}
+
+static int decode(const uint8_t *png, size_t len, uint32_t **data,
+      unsigned *width, unsigned *height)
+{
+   int ret;
+   rpng_t *rpng = rpng_alloc();
+
+   *data = NULL;
+
+   if (!rpng || !rpng_set_buf_ptr(rpng, (void*)png, len) || !rpng_start(rpng))
+   {
+      rpng_free(rpng);
+      return 0;
+   }
+
+   while (rpng_iterate_image(rpng));
+
+   if (!rpng_is_valid(rpng))
+   {
+      rpng_free(rpng);
+      return 0;
+   }
+
+   do
+   {
+      ret = rpng_process_image(rpng, (void**)data, len, width, height);
+   } while (ret == IMAGE_PROCESS_NEXT);
+
+   rpng_free(rpng);
+
+   if (ret == IMAGE_PROCESS_ERROR || ret == IMAGE_PROCESS_ERROR_END)
+   {
+      free(*data);
+      *data = NULL;
+      return 0;
+   }
+
+   return 1;
+}
+
+struct stream_rows
+{
+   uint32_t *data;
+   unsigned width;
+   unsigned next_y;
+   size_t pushed;   /* bytes pushed when the first row came */
+   size_t offset;
+};
+
+static bool stream_row(void *userdata, unsigned y, const uint32_t *row, unsigned width)
+{
+   struct stream_rows *rows = (struct stream_rows*)userdata;
+
+   if (y != rows->next_y++ || width != rows->width)
+      return false;
+   if (y == 0)
+      rows->pushed = rows->offset;
+   memcpy(rows->data + (size_t)y * width, row, width * sizeof(uint32_t));
+   return true;
+}
+
+/* Decodes with rpng_stream, piece bytes at a time, into a buffer of
+ * its own or through the row callback. first_row_at is how much of
+ * the file was pushed when the first row came. */
+static int decode_stream(const uint8_t *png, size_t len, size_t piece,
+      bool to_buffer, uint32_t **data, unsigned *width, unsigned *height,
+      size_t *first_row_at)
+{
+   struct stream_rows rows = {0};
+   rpng_stream_t *stream   = rpng_stream_new();
+   size_t pos              = 0;
+   int ret                 = IMAGE_PROCESS_NEXT;
+
+   *data         = NULL;
+   *first_row_at = len;
+
+   /* The IHDR chunk ends 33 bytes in */
+   while (pos < len && ret == IMAGE_PROCESS_NEXT && !rpng_stream_get_size(stream, width, height))
+   {
+      size_t n = len - pos < piece ? len - pos : piece;
+      if (n > 33 - pos)
+         n = 33 - pos;
+      ret  = rpng_stream_push(stream, png + pos, n);
+      pos += n;
+   }
+
+   if (ret == IMAGE_PROCESS_NEXT && rpng_stream_get_size(stream, width, height))
+   {
+      *data = (uint32_t*)calloc((size_t)*width * *height, sizeof(uint32_t));
+      if (to_buffer)
+         rpng_stream_set_output(stream, *data, *width * sizeof(uint32_t));
+      else
+      {
+         rows.data  = *data;
+         rows.width = *width;
+         rpng_stream_set_row_cb(stream, stream_row, &rows);
+      }
+   }
+
+   while (pos < len && ret == IMAGE_PROCESS_NEXT)
+   {
+      size_t n    = len - pos < piece ? len - pos : piece;
+      rows.offset = pos + n;
+      ret         = rpng_stream_push(stream, png + pos, n);
+      pos        += n;
+   }
+
+   rpng_stream_free(stream);
+
+   if (!to_buffer && rows.next_y)
+      *first_row_at = rows.pushed;
+
+   if (ret != IMAGE_PROCESS_END || (!to_buffer && rows.next_y != *height))
+   {
+      free(*data);
+      *data = NULL;
+      return 0;
+   }
+
+   return 1;
+}
+
+static void check_pixels(const uint32_t *data, const uint32_t *expected,
+      unsigned width, unsigned height, const char *how, unsigned color_type,
+      unsigned depth, unsigned interlace)
+{
+   size_t i;
+
+   for (i = 0; i < (size_t)width * height; i++)
+   {
+      if (data[i] != expected[i])
+      {
+         CHECK(0, "%ux%u type %u depth %u interlace %u%s: pixel %u,%u is %08x, expected %08x",
+               width, height, color_type, depth, interlace, how,
+               (unsigned)(i % width), (unsigned)(i / width), data[i], expected[i]);
+         break;
+      }
+   }
+}
+
+/* Builds a PNG and the pixels rpng should decode it to. truncate drops
+ * that many bytes from the end of the compressed data. */
+static uint8_t *make_png(unsigned width, unsigned height, unsigned color_type,
+      unsigned depth, unsigned interlace, size_t truncate,
+      size_t *png_len, uint32_t **expected)
+{
+   unsigned channels = channels_of(color_type);
+   unsigned bits     = channels * depth;
+   unsigned bpp      = (bits + 7) / 8;
+   unsigned max      = depth == 16 ? 0xffff : (1u << depth) - 1;
+   unsigned entries  = color_type == 3 ? (1u << depth) : 0;
+   uint16_t *samples = (uint16_t*)malloc((size_t)width * height * channels * sizeof(uint16_t));
+   uint8_t *row      = (uint8_t*)malloc(((size_t)width * bits + 7) / 8 + 16);
+   uint32_t palette[256];
+   buffer_t raw      = {0};
+   buffer_t filtered = {0};
+   buffer_t png      = {0};
+   uLongf zlen;
+   uint8_t *z;
+   uint8_t ihdr[13];
+   size_t i, pos;
+   unsigned x, y, p;
+
+   /* smooth gradients with noise, so filters and deflate have work to do */
+   for (y = 0; y < height; y++)
+      for (x = 0; x < width; x++)
+         for (p = 0; p < channels; p++)
+         {
+            unsigned v = (x * (p + 1) * 3 + y * 5 + (rng() % 7)) * (max / 255 + 1);
+            samples[((size_t)y * width + x) * channels + p] = (uint16_t)((rng() % 13 == 0 ? rng() : v) % (max + 1));
+         }
+
+   for (i = 0; i < entries; i++)
+   {
+      palette[i] = 0xff000000u | (rng() & 0xffffff);
+      if (i % 3 == 1)
+         palette[i] = (palette[i] & 0xffffff) | (rng() & 0xff) << 24;
+   }
+
+   *expected = (uint32_t*)malloc((size_t)width * height * sizeof(uint32_t));
+   for (i = 0; i < (size_t)width * height; i++)
+      (*expected)[i] = expected_pixel(samples + i * channels, color_type, depth, palette);
+
+   if (!interlace)
+   {
+      unsigned pitch = (width * bits + 7) / 8;
+      for (y = 0; y < height; y++)
+      {
+         pack_row(row, samples, width, channels, depth, 0, 1, width, y);
+         buf_put(&raw, row, pitch);
+      }
+      filter_rows(&filtered, raw.data, pitch, height, bpp, 0);
+   }
+   else
+   {
+      for (p = 0; p < 7; p++)
+      {
+         unsigned pw, ph, pitch;
+
+         if (width <= adam7[p][0] || height <= adam7[p][1])
+            continue;
+
+         pw    = (width - adam7[p][0] + adam7[p][2] - 1) / adam7[p][2];
+         ph    = (height - adam7[p][1] + adam7[p][3] - 1) / adam7[p][3];
+         pitch = (pw * bits + 7) / 8;
+         raw.len = 0;
+
+         for (y = 0; y < ph; y++)
+         {
+            pack_row(row, samples, width, channels, depth, adam7[p][0], adam7[p][2],
+                  pw, adam7[p][1] + y * adam7[p][3]);
+            buf_put(&raw, row, pitch);
+         }
+         filter_rows(&filtered, raw.data, pitch, ph, bpp, p);
+      }
+   }
+
+   zlen = compressBound((uLong)filtered.len);
+   z    = (uint8_t*)malloc(zlen);
+   compress2(z, &zlen, filtered.data, (uLong)filtered.len, 6);
+   zlen = zlen > truncate ? zlen - truncate : 0;
+
+   buf_put(&png, "\x89PNG\r\n\x1a\n", 8);
+   ihdr[0] = width >> 24; ihdr[1] = width >> 16; ihdr[2] = width >> 8; ihdr[3] = width;
+   ihdr[4] = height >> 24; ihdr[5] = height >> 16; ihdr[6] = height >> 8; ihdr[7] = height;
+   ihdr[8] = depth; ihdr[9] = color_type; ihdr[10] = 0; ihdr[11] = 0; ihdr[12] = interlace;
+   put_chunk(&png, "IHDR", ihdr, 13);
+
+   if (entries)
+   {
+      uint8_t plte[768], trns[256];
+      for (i = 0; i < entries; i++)
+      {
+         plte[i * 3 + 0] = palette[i] >> 16;
+         plte[i * 3 + 1] = palette[i] >> 8;
+         plte[i * 3 + 2] = palette[i];
+         trns[i]         = palette[i] >> 24;
+      }
+      put_chunk(&png, "PLTE", plte, entries * 3);
+      put_chunk(&png, "tRNS", trns, entries);
+   }
+
+   /* several IDAT chunks of odd sizes */
+   for (pos = 0; pos < zlen; )
+   {
+      size_t n = 1000 + rng() % 20000;
+      if (n > zlen - pos)
+         n = zlen - pos;
+      put_chunk(&png, "IDAT", z + pos, n);
+      pos += n;
+   }
+   put_chunk(&png, "IEND", NULL, 0);
+
+   free(z);
+   free(raw.data);
+   free(filtered.data);
+   free(row);
+   free(samples);
+
+   *png_len = png.len;
+   return png.data;
+}
+
+static void test_image(unsigned width, unsigned height, unsigned color_type,
+      unsigned depth, unsigned interlace)
+{
+   size_t len;
+   uint32_t *expected, *data;
+   unsigned w = 0, h = 0;
+   uint8_t *png = make_png(width, height, color_type, depth, interlace, 0, &len, &expected);
+
+   static const size_t pieces[] = { 1, 7, 4096 };
+   unsigned p;
+
+   if (!decode(png, len, &data, &w, &h))
+      CHECK(0, "%ux%u type %u depth %u interlace %u: decode failed", width, height, color_type, depth, interlace);
+   else
+   {
+      CHECK(w == width && h == height, "%ux%u type %u depth %u interlace %u: got %ux%u",
+            width, height, color_type, depth, interlace, w, h);
+      check_pixels(data, expected, width, height, "", color_type, depth, interlace);
+      free(data);
+   }
+
+   for (p = 0; p < sizeof(pieces) / sizeof(pieces[0]); p++)
+   {
+      unsigned to_buffer;
+
+      /* Byte at a time is slow, so only for the small images */
+      if (pieces[p] == 1 && (size_t)width * height > 10000)
+         continue;
+
+      for (to_buffer = 0; to_buffer < 2; to_buffer++)
+      {
+         size_t first_row_at;
+
+         if (!decode_stream(png, len, pieces[p], to_buffer, &data, &w, &h, &first_row_at))
+         {
+            CHECK(0, "%ux%u type %u depth %u interlace %u: stream decode by %u failed",
+                  width, height, color_type, depth, interlace, (unsigned)pieces[p]);
+            continue;
+         }
+
+         check_pixels(data, expected, width, height,
+               to_buffer ? " (stream to buffer)" : " (stream)", color_type, depth, interlace);
+         free(data);
+
+         /* Plain images give rows well before the end of the file */
+         if (!to_buffer && !interlace && len > 3 * 4096)
+            CHECK(first_row_at < len / 2, "%ux%u type %u depth %u: first row at %u of %u bytes",
+                  width, height, color_type, depth, (unsigned)first_row_at, (unsigned)len);
+      }
+   }
+
+   free(expected);
+   free(png);
+}
+
+static void test_truncated(unsigned width, unsigned height, unsigned interlace)
+{
+   size_t len;
+   uint32_t *expected, *data;
+   unsigned w = 0, h = 0;
+   uint8_t *png = make_png(width, height, 6, 8, interlace, 4000, &len, &expected);
+
+   size_t first_row_at;
+
+   CHECK(!decode(png, len, &data, &w, &h), "%ux%u interlace %u: truncated image decoded", width, height, interlace);
+   free(data);
+   CHECK(!decode_stream(png, len, 4096, false, &data, &w, &h, &first_row_at),
+         "%ux%u interlace %u: truncated image stream decoded", width, height, interlace);
+   free(data);
+   free(expected);
+   free(png);
+}
+
+int main(void)
+{
+   static const unsigned types[][2] = {
+      { 0, 1 }, { 0, 2 }, { 0, 4 }, { 0, 8 }, { 0, 16 },
+      { 2, 8 }, { 2, 16 },
+      { 3, 1 }, { 3, 2 }, { 3, 4 }, { 3, 8 },
+      { 4, 8 }, { 4, 16 },
+      { 6, 8 }, { 6, 16 },
+   };
+   static const unsigned sizes[][2] = {
+      { 1, 1 }, { 3, 2 }, { 7, 9 }, { 33, 17 }, { 301, 257 }, { 1031, 613 },
+   };
+   unsigned t, z, i;
+
+   for (t = 0; t < sizeof(types) / sizeof(types[0]); t++)
+      for (z = 0; z < sizeof(sizes) / sizeof(sizes[0]); z++)
+         for (i = 0; i < 2; i++)
+            test_image(sizes[z][0], sizes[z][1], types[t][0], types[t][1], i);
+
+   test_truncated(1031, 613, 0);
+   test_truncated(1031, 613, 1);
+
+   if (failures)
+   {
+      printf("%d check(s) failed\n", failures);
+      return 1;
+   }
+
+   printf("all checks passed\n");
+   return 0;
+}
@@ -0,0 +1,252 @@
+/* Copyright  (C) 2010-2020 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (rpng_encode_test.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <zlib.h>
+
+#include <formats/rpng.h>
+#include <formats/image.h>
+#include <streams/file_stream.h>
+
+/* Saves images at every encoder level, some large enough to be split
+ * into bands deflated on threads, then checks that zlib accepts the
+ * joined IDAT stream (checksum included) and that they decode back
+ * to the same pixels. */
+
+#define TEST_PATH "/tmp/rpng_encode_test.png"
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf(__VA_ARGS__); printf("\n"); failures++; } } while (0)
+
+static uint32_t rng_state = 1;
+
+static uint32_t rng(void)
+{
+   rng_state = rng_state * 1103515245u + 12345u;
+   return rng_state >> 8;
+}
+
+static uint32_t be32(const uint8_t *p)
+{
+   return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+/* Inflates the IDAT chunks joined together, as one zlib stream */
+static int check_idat(const uint8_t *png, size_t len,
+      unsigned width, unsigned height, unsigned bpp)
+{
+   size_t pos       = 8;
+   size_t idat_len  = 0;
+   size_t raw_size  = ((size_t)width * bpp + 1) * height;
+   uint8_t *idat    = (uint8_t*)malloc(len);
+   uint8_t *raw     = (uint8_t*)malloc(raw_size + 1);
+   uLongf raw_len   = (uLongf)raw_size + 1;
+   int ok           = 0;
+   unsigned y;
+
+   while (pos + 12 <= len)
+   {
+      uint32_t size = be32(png + pos);
+      if (!memcmp(png + pos + 4, "IDAT", 4))
+      {
+         memcpy(idat + idat_len, png + pos + 8, size);
+         idat_len += size;
+      }
+      if (crc32(0, png + pos + 4, size + 4) != be32(png + pos + 8 + size))
+         goto end;
+      pos += 12 + size;
+   }
+
+   if (uncompress(raw, &raw_len, idat, (uLong)idat_len) != Z_OK || raw_len != raw_size)
+      goto end;
+
+   for (y = 0; y < height; y++)
+      if (raw[y * ((size_t)width * bpp + 1)] > 4)
+         goto end;
+
+   ok = 1;
+
+end:
+   free(idat);
+   free(raw);
+   return ok;
+}
+
+static int decode(const uint8_t *png, size_t len, uint32_t **data,
+      unsigned *width, unsigned *height)
+{
+   int ret;
+   rpng_t *rpng = rpng_alloc();
+
+   *data = NULL;
+
+   if (!rpng || !rpng_set_buf_ptr(rpng, (void*)png, len) || !rpng_start(rpng))
+   {
+      rpng_free(rpng);
+      return 0;
+   }
+
+   while (rpng_iterate_image(rpng));
+
+   if (!rpng_is_valid(rpng))
+   {
+      rpng_free(rpng);
+      return 0;
+   }
+
+   do
+   {
+      ret = rpng_process_image(rpng, (void**)data, len, width, height);
+   } while (ret == IMAGE_PROCESS_NEXT);
+
+   rpng_free(rpng);
+
+   if (ret != IMAGE_PROCESS_END)
+   {
+      free(*data);
+      *data = NULL;
+      return 0;
+   }
+
+   return 1;
+}
+
+static void test_image(unsigned width, unsigned height, unsigned bpp, int level)
+{
+   unsigned x, y, w = 0, h = 0;
+   /* Rows padded, to check the pitch is honoured */
+   unsigned pitch     = width * bpp + 12;
+   uint8_t *image     = (uint8_t*)malloc((size_t)pitch * height);
+   uint32_t *expected = (uint32_t*)malloc((size_t)width * height * sizeof(uint32_t));
+   uint32_t *data     = NULL;
+   uint8_t *png       = NULL;
+   size_t len         = 0;
+
+   /* Gradients with flat areas and noise, like a screenshot */
+   for (y = 0; y < height; y++)
+   {
+      for (x = 0; x < width; x++)
+      {
+         uint8_t *px = image + (size_t)y * pitch + x * bpp;
+         uint32_t r  = (x * 255 / width) & 0xff;
+         uint32_t g  = (y < height / 2) ? 0x40 : (y * 3) & 0xff;
+         uint32_t b  = (x / 16 + y / 16) & 1 ? 0xe0 : 0x10;
+         uint32_t a  = bpp == 4 ? (x + y) & 0xff : 0xff;
+
+         if (rng() % 9 == 0)
+            r ^= rng() & 0xff;
+
+         if (bpp == 4)
+         {
+            uint32_t argb = a << 24 | r << 16 | g << 8 | b;
+            memcpy(px, &argb, 4);
+         }
+         else
+         {
+            px[0] = (uint8_t)b;
+            px[1] = (uint8_t)g;
+            px[2] = (uint8_t)r;
+         }
+         expected[(size_t)y * width + x] = a << 24 | r << 16 | g << 8 | b;
+      }
+   }
+
+   if (bpp == 4)
+   {
+      int64_t file_len = 0;
+      void *file       = NULL;
+
+      CHECK(rpng_save_image_argb_level(TEST_PATH, (const uint32_t*)image,
+               width, height, pitch, level),
+            "%ux%u argb level %d: save failed", width, height, level);
+      if (filestream_read_file(TEST_PATH, &file, &file_len))
+      {
+         png = (uint8_t*)file;
+         len = (size_t)file_len;
+      }
+      remove(TEST_PATH);
+   }
+   else
+   {
+      uint64_t bytes = 0;
+      png = rpng_save_image_bgr24_string_level(image, width, height,
+            (signed)pitch, &bytes, level);
+      len = (size_t)bytes;
+   }
+
+   if (!png)
+      CHECK(0, "%ux%u bpp %u level %d: nothing saved", width, height, bpp, level);
+   else
+   {
+      CHECK(check_idat(png, len, width, height, bpp),
+            "%ux%u bpp %u level %d: bad IDAT stream", width, height, bpp, level);
+
+      if (!decode(png, len, &data, &w, &h))
+         CHECK(0, "%ux%u bpp %u level %d: decode failed", width, height, bpp, level);
+      else
+      {
+         CHECK(w == width && h == height, "%ux%u bpp %u level %d: got %ux%u",
+               width, height, bpp, level, w, h);
+         CHECK(!memcmp(data, expected, (size_t)width * height * sizeof(uint32_t)),
+               "%ux%u bpp %u level %d: pixels differ", width, height, bpp, level);
+         free(data);
+      }
+   }
+
+   free(png);
+   free(expected);
+   free(image);
+}
+
+int main(void)
+{
+   static const unsigned sizes[][2] = {
+      { 1, 1 }, { 17, 5 }, { 97, 300 }, { 640, 480 },
+   };
+   unsigned z, bpp;
+   int level;
+
+   for (bpp = 3; bpp <= 4; bpp++)
+   {
+      for (z = 0; z < sizeof(sizes) / sizeof(sizes[0]); z++)
+         for (level = 0; level <= 9; level++)
+            test_image(sizes[z][0], sizes[z][1], bpp, level);
+
+      /* Split into the most bands */
+      test_image(1920, 1080, bpp, 1);
+      test_image(1920, 1080, bpp, 6);
+   }
+
+   if (failures)
+   {
+      printf("%d check(s) failed\n", failures);
+      return 1;
+   }
+
+   printf("all checks passed\n");
+   return 0;
+}
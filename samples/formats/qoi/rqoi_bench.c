@@ -0,0 +1,295 @@
+/* Copyright  (C) 2010-2020 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (rqoi_bench.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <formats/image.h>
+#include <formats/rpng.h>
+#include <formats/rqoi.h>
+#include <features/features_cpu.h>
+#include <streams/file_stream.h>
+
+/* Times rqoi against rpng, encoding and decoding a 4K screenshot,
+ * and checks both give back the pixels they were given.
+ *
+ * usage: rqoi_bench [screenshot.png]
+ *
+ * Without arguments a synthetic 3840x2160 frame is used: pixel art
+ * scaled up 3x over a sky gradient, with a HUD and some dithering,
+ * which is what most saved screenshots look like. */
+
+#define RUNS 3
+
+static int failures = 0;
+
+static uint32_t rng_state = 1;
+
+static uint32_t rng(void)
+{
+   rng_state = rng_state * 1103515245u + 12345u;
+   return rng_state >> 8;
+}
+
+static double now(void)
+{
+   return cpu_features_get_time_usec() / 1000000.0;
+}
+
+static uint32_t *make_screenshot(unsigned width, unsigned height)
+{
+   unsigned x, y;
+   uint32_t *argb = (uint32_t*)malloc((size_t)width * height * 4);
+
+   for (y = 0; y < height; y++)
+   {
+      for (x = 0; x < width; x++)
+      {
+         /* Game pixels are 3x3 blocks of the frame */
+         unsigned gx = x / 3, gy = y / 3;
+         uint32_t r  = 40 + gy * 120 / (height / 3);
+         uint32_t g  = 90 + gy * 100 / (height / 3);
+         uint32_t b  = 230;
+
+         /* Tiles of ground with a few colours each */
+         if (gy > (height / 3) * 2 / 3 + (gx / 40) % 3 * 8)
+         {
+            unsigned t = (gx * 7 + gy * 13 + (gx >> 3) * (gy >> 3)) % 5;
+            r = 80 + t * 20;
+            g = 50 + t * 12;
+            b = 20 + t * 4;
+         }
+         /* Sprites, and ordered dithering on the clouds */
+         else if ((gx / 24 + gy / 24) % 11 == 0 && (gx ^ gy) & 4)
+         {
+            r = 250;
+            g = 200 - (gx % 24) * 4;
+            b = 40;
+         }
+         else if (gy < height / 12 && ((gx + gy) & 1) && rng() % 4)
+            r = g = b = 245;
+
+         /* HUD text along the top */
+         if (y < 96 && x < 1200 && (rng() % 3 == 0))
+            r = g = b = 255;
+
+         argb[(size_t)y * width + x] = 0xff000000 | r << 16 | g << 8 | b;
+      }
+   }
+
+   return argb;
+}
+
+static uint32_t *load_png(const char *path, unsigned *width, unsigned *height)
+{
+   int ret;
+   void *file       = NULL;
+   int64_t len      = 0;
+   uint32_t *argb   = NULL;
+   rpng_t *rpng;
+
+   if (!filestream_read_file(path, &file, &len))
+      return NULL;
+
+   if ((rpng = rpng_alloc()))
+   {
+      if (     rpng_set_buf_ptr(rpng, file, (size_t)len)
+            && rpng_start(rpng))
+      {
+         while (rpng_iterate_image(rpng));
+
+         if (rpng_is_valid(rpng))
+         {
+            do
+            {
+               ret = rpng_process_image(rpng, (void**)&argb,
+                     (size_t)len, width, height);
+            } while (ret == IMAGE_PROCESS_NEXT);
+
+            if (ret != IMAGE_PROCESS_END)
+            {
+               free(argb);
+               argb = NULL;
+            }
+         }
+      }
+      rpng_free(rpng);
+   }
+
+   free(file);
+   return argb;
+}
+
+static uint32_t *decode(enum image_type_enum type, uint8_t *buf,
+      size_t len, unsigned *width, unsigned *height)
+{
+   int ret;
+   uint32_t *argb = NULL;
+   void *img      = NULL;
+
+   if (type == IMAGE_TYPE_QOI)
+   {
+      rqoi_t *rqoi = rqoi_alloc();
+      rqoi_set_buf_ptr(rqoi, buf);
+      if (rqoi_process_image(rqoi, (void**)&argb, len,
+               width, height) != IMAGE_PROCESS_END)
+         argb = NULL;
+      rqoi_free(rqoi);
+      return argb;
+   }
+
+   img = rpng_alloc();
+   rpng_set_buf_ptr((rpng_t*)img, buf, len);
+   if (rpng_start((rpng_t*)img))
+   {
+      while (rpng_iterate_image((rpng_t*)img));
+      if (rpng_is_valid((rpng_t*)img))
+      {
+         do
+         {
+            ret = rpng_process_image((rpng_t*)img, (void**)&argb,
+                  len, width, height);
+         } while (ret == IMAGE_PROCESS_NEXT);
+
+         if (ret != IMAGE_PROCESS_END)
+         {
+            free(argb);
+            argb = NULL;
+         }
+      }
+   }
+   rpng_free((rpng_t*)img);
+   return argb;
+}
+
+/* Best of RUNS: encodes, then decodes and checks the pixels */
+static void bench(const char *name, enum image_type_enum type, int level,
+      const uint32_t *argb, const uint8_t *bgr,
+      unsigned width, unsigned height)
+{
+   int run;
+   double t0, t;
+   double t_enc     = 1e9, t_dec = 1e9;
+   uint8_t *buf     = NULL;
+   uint64_t len     = 0;
+   size_t size      = (size_t)width * height * 4;
+
+   for (run = 0; run < RUNS; run++)
+   {
+      free(buf);
+      t0  = now();
+      if (type == IMAGE_TYPE_QOI)
+         buf = rqoi_save_image_string(argb, width, height,
+               width * 4, RQOI_SOURCE_TYPE_XRGB8888, &len);
+      else
+         buf = rpng_save_image_bgr24_string_level(bgr, width, height,
+               (signed)width * 3, &len, level);
+      t   = now() - t0;
+      if (t < t_enc)
+         t_enc = t;
+   }
+
+   if (!buf)
+   {
+      printf("%-16s encode failed\n", name);
+      failures++;
+      return;
+   }
+
+   for (run = 0; run < RUNS; run++)
+   {
+      unsigned w = 0, h = 0;
+      uint32_t *out;
+
+      t0  = now();
+      out = decode(type, buf, (size_t)len, &w, &h);
+      t   = now() - t0;
+      if (t < t_dec)
+         t_dec = t;
+
+      if (!out || w != width || h != height || memcmp(out, argb, size))
+      {
+         printf("%-16s decoded pixels differ\n", name);
+         failures++;
+         free(out);
+         break;
+      }
+      free(out);
+   }
+
+   printf("%-16s %9.1fms %9.1fms %9.1f MB %6.1f%%\n", name,
+         t_enc * 1000.0, t_dec * 1000.0, len / 1048576.0,
+         100.0 * len / size);
+
+   free(buf);
+}
+
+int main(int argc, char **argv)
+{
+   size_t i;
+   unsigned width  = 3840;
+   unsigned height = 2160;
+   uint32_t *argb  = NULL;
+   uint8_t *bgr    = NULL;
+
+   if (argc > 1)
+   {
+      if (!(argb = load_png(argv[1], &width, &height)))
+      {
+         printf("couldn't load %s\n", argv[1]);
+         return 1;
+      }
+      /* Screenshots are compared without alpha */
+      for (i = 0; i < (size_t)width * height; i++)
+         argb[i] |= 0xff000000;
+   }
+   else
+      argb = make_screenshot(width, height);
+
+   bgr = (uint8_t*)malloc((size_t)width * height * 3);
+   for (i = 0; i < (size_t)width * height; i++)
+   {
+      bgr[i * 3 + 0] = (uint8_t)(argb[i] >>  0);
+      bgr[i * 3 + 1] = (uint8_t)(argb[i] >>  8);
+      bgr[i * 3 + 2] = (uint8_t)(argb[i] >> 16);
+   }
+
+   printf("%ux%u, best of %d\n", width, height, RUNS);
+   printf("%-16s %11s %11s %12s %7s\n", "", "encode", "decode", "size", "ratio");
+   bench("rpng (level 9)", IMAGE_TYPE_PNG, 9, argb, bgr, width, height);
+   bench("rpng (level 1)", IMAGE_TYPE_PNG, 1, argb, bgr, width, height);
+   bench("rqoi",           IMAGE_TYPE_QOI, 0, argb, bgr, width, height);
+
+   free(bgr);
+   free(argb);
+
+   if (failures)
+   {
+      printf("%d check(s) failed\n", failures);
+      return 1;
+   }
+
+   return 0;
+}
@@ -0,0 +1,295 @@
+/* Copyright  (C) 2010-2020 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (rqoi_test.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <formats/image.h>
+#include <formats/rqoi.h>
+#include <streams/file_stream.h>
+
+/* Checks the decoder against hand built streams using every op, then
+ * saves images from every source type, to memory and to a file, and
+ * checks they decode back to the same pixels. Broken files must fail
+ * or decode without reading past the buffer. */
+
+#define TEST_PATH "/tmp/rqoi_test.qoi"
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf(__VA_ARGS__); printf("\n"); failures++; } } while (0)
+
+static uint32_t rng_state = 1;
+
+static uint32_t rng(void)
+{
+   rng_state = rng_state * 1103515245u + 12345u;
+   return rng_state >> 8;
+}
+
+static uint32_t *decode(const uint8_t *qoi, size_t len,
+      unsigned *width, unsigned *height)
+{
+   void *data  = NULL;
+   rqoi_t *img = rqoi_alloc();
+
+   if (!img)
+      return NULL;
+
+   rqoi_set_buf_ptr(img, (void*)qoi);
+   if (rqoi_process_image(img, &data, len, width, height) != IMAGE_PROCESS_END)
+      data = NULL;
+   rqoi_free(img);
+   return (uint32_t*)data;
+}
+
+static size_t put_header(uint8_t *p, unsigned width, unsigned height,
+      unsigned channels)
+{
+   memcpy(p, "qoif", 4);
+   p[4]  = width  >> 24; p[5]  = width  >> 16; p[6]  = width  >> 8; p[7]  = width;
+   p[8]  = height >> 24; p[9]  = height >> 16; p[10] = height >> 8; p[11] = height;
+   p[12] = channels;
+   p[13] = 0;
+   return 14;
+}
+
+static size_t put_end(uint8_t *p)
+{
+   static const uint8_t padding[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+   memcpy(p, padding, 8);
+   return 8;
+}
+
+static void test_ops(void)
+{
+   static const uint8_t ops[] = {
+      0xfe, 10, 20, 30,    /* RGB */
+      0x76,                /* DIFF +1 -1 0 */
+      0xaa, 0x5d,          /* LUMA +10, r -3, b +5 from green */
+      0xff, 1, 2, 3, 4,    /* RGBA */
+      0x09,                /* INDEX of the first pixel */
+      0xc0                 /* RUN of one, into the second row */
+   };
+   static const uint32_t expected[6] = {
+      0xff0a141e, 0xff0b131e, 0xff121d2d,
+      0x04010203, 0xff0a141e, 0xff0a141e
+   };
+   uint8_t qoi[64];
+   size_t len = 0;
+   unsigned w = 0, h = 0;
+   uint32_t *argb;
+   uint8_t *enc;
+   uint64_t enc_len = 0;
+
+   len += put_header(qoi, 3, 2, 4);
+   memcpy(qoi + len, ops, sizeof(ops));
+   len += sizeof(ops);
+   len += put_end(qoi + len);
+
+   argb = decode(qoi, len, &w, &h);
+   CHECK(argb && w == 3 && h == 2, "ops: decode failed");
+   if (argb)
+      CHECK(!memcmp(argb, expected, sizeof(expected)), "ops: pixels differ");
+   free(argb);
+
+   /* The encoder's choice of ops for two pixels is fixed by the spec */
+   {
+      static const uint32_t two[2]   = { 0xff000000, 0xff010101 };
+      static const uint8_t  want[24] = {
+         'q', 'o', 'i', 'f', 0, 0, 0, 2, 0, 0, 0, 1, 3, 0,
+         0xc0, 0x7f, 0, 0, 0, 0, 0, 0, 0, 1
+      };
+      enc = rqoi_save_image_string(two, 2, 1, 8, RQOI_SOURCE_TYPE_XRGB8888, &enc_len);
+      CHECK(enc && enc_len == sizeof(want) && !memcmp(enc, want, sizeof(want)),
+            "ops: encoded bytes differ");
+      free(enc);
+   }
+}
+
+static void test_broken(void)
+{
+   uint8_t qoi[64];
+   unsigned w, h;
+   uint32_t *argb;
+   size_t len;
+
+   memset(qoi, 0, sizeof(qoi));
+
+   len  = put_header(qoi, 4, 4, 4);
+   len += put_end(qoi + len);
+   qoi[0] = 'Q';
+   CHECK(!decode(qoi, len, &w, &h), "broken: bad magic decoded");
+
+   put_header(qoi, 0, 4, 4);
+   CHECK(!decode(qoi, len, &w, &h), "broken: empty image decoded");
+
+   put_header(qoi, 4, 4, 5);
+   CHECK(!decode(qoi, len, &w, &h), "broken: 5 channels decoded");
+
+   put_header(qoi, 100000, 100000, 4);
+   CHECK(!decode(qoi, len, &w, &h), "broken: 10 gigapixels decoded");
+
+   CHECK(!decode(qoi, 14, &w, &h), "broken: header alone decoded");
+
+   /* Out of ops early: the last pixel is repeated, as other decoders do */
+   put_header(qoi, 4, 4, 4);
+   qoi[14] = 0xff;
+   qoi[15] = 1;
+   qoi[16] = 2;
+   qoi[17] = 3;
+   qoi[18] = 4;
+   argb    = decode(qoi, 14 + 5 + 8, &w, &h);
+   CHECK(argb && argb[15] == 0x04010203, "broken: short file not filled in");
+   free(argb);
+}
+
+static uint32_t expand565(uint16_t pixel)
+{
+   uint32_t r = (pixel >> 11) & 0x1f;
+   uint32_t g = (pixel >>  5) & 0x3f;
+   uint32_t b = (pixel >>  0) & 0x1f;
+   r = (r << 3) | (r >> 2);
+   g = (g << 2) | (g >> 4);
+   b = (b << 3) | (b >> 2);
+   return 0xff000000 | r << 16 | g << 8 | b;
+}
+
+static void test_image(unsigned width, unsigned height,
+      enum rqoi_source_type type)
+{
+   static const char *names[] = { "XRGB8888", "ARGB8888", "RGB565", "BGR24" };
+   static const unsigned bpps[] = { 4, 4, 2, 3 };
+   unsigned x, y, w = 0, h = 0;
+   unsigned bpp       = bpps[type];
+   /* Rows padded, to check the pitch is honoured */
+   unsigned pitch     = width * bpp + 12;
+   uint8_t *image     = (uint8_t*)malloc((size_t)pitch * height);
+   uint32_t *expected = (uint32_t*)malloc((size_t)width * height * sizeof(uint32_t));
+   uint32_t *argb     = NULL;
+   uint8_t *qoi       = NULL;
+   uint64_t len       = 0;
+
+   /* Flat areas long enough for runs to span rows, gradients, noise
+    * and alpha ramps, so every op is used */
+   for (y = 0; y < height; y++)
+   {
+      for (x = 0; x < width; x++)
+      {
+         uint8_t *px = image + (size_t)y * pitch + x * bpp;
+         uint32_t r  = (x * 255 / width) & 0xff;
+         uint32_t g  = (y < height / 2) ? 0x40 : (y * 3) & 0xff;
+         uint32_t b  = (x / 16 + y / 16) & 1 ? 0xe0 : 0x10;
+         uint32_t a  = (x + y) & 0xff;
+
+         if (y % 7 == 3)
+            r = g = b = 0x80;
+         else if (rng() % 9 == 0)
+            r ^= rng() & 0xff;
+
+         switch (type)
+         {
+            case RQOI_SOURCE_TYPE_XRGB8888:
+            case RQOI_SOURCE_TYPE_ARGB8888:
+               {
+                  uint32_t v = a << 24 | r << 16 | g << 8 | b;
+                  memcpy(px, &v, 4);
+                  expected[(size_t)y * width + x] = type == RQOI_SOURCE_TYPE_ARGB8888
+                     ? v : (v | 0xff000000);
+               }
+               break;
+            case RQOI_SOURCE_TYPE_RGB565:
+               {
+                  uint16_t v = (uint16_t)((r & 0xf8) << 8 | (g & 0xfc) << 3 | b >> 3);
+                  memcpy(px, &v, 2);
+                  expected[(size_t)y * width + x] = expand565(v);
+               }
+               break;
+            case RQOI_SOURCE_TYPE_BGR24:
+               px[0] = (uint8_t)b;
+               px[1] = (uint8_t)g;
+               px[2] = (uint8_t)r;
+               expected[(size_t)y * width + x] = 0xff000000 | r << 16 | g << 8 | b;
+               break;
+         }
+      }
+   }
+
+   qoi = rqoi_save_image_string(image, width, height, pitch, type, &len);
+   CHECK(qoi, "%ux%u %s: nothing saved", width, height, names[type]);
+
+   if (qoi)
+   {
+      argb = decode(qoi, (size_t)len, &w, &h);
+      CHECK(argb && w == width && h == height, "%ux%u %s: decode failed",
+            width, height, names[type]);
+      if (argb && w == width && h == height)
+         CHECK(!memcmp(argb, expected, (size_t)width * height * 4),
+               "%ux%u %s: pixels differ", width, height, names[type]);
+      free(argb);
+
+      /* Files are written in pieces; they must come out the same */
+      {
+         void *file       = NULL;
+         int64_t file_len = 0;
+
+         CHECK(rqoi_save_image(TEST_PATH, image, width, height, pitch, type),
+               "%ux%u %s: save failed", width, height, names[type]);
+         CHECK(filestream_read_file(TEST_PATH, &file, &file_len)
+               && (uint64_t)file_len == len && !memcmp(file, qoi, (size_t)len),
+               "%ux%u %s: file differs from the buffer", width, height, names[type]);
+         free(file);
+         remove(TEST_PATH);
+      }
+   }
+
+   free(qoi);
+   free(expected);
+   free(image);
+}
+
+int main(void)
+{
+   static const unsigned sizes[][2] = {
+      { 1, 1 }, { 17, 5 }, { 97, 300 }, { 640, 480 }, { 1920, 1080 }
+   };
+   unsigned z, t;
+
+   test_ops();
+   test_broken();
+
+   for (z = 0; z < sizeof(sizes) / sizeof(sizes[0]); z++)
+      for (t = RQOI_SOURCE_TYPE_XRGB8888; t <= RQOI_SOURCE_TYPE_BGR24; t++)
+         test_image(sizes[z][0], sizes[z][1], (enum rqoi_source_type)t);
+
+   if (failures)
+   {
+      printf("%d check(s) failed\n", failures);
+      return 1;
+   }
+
+   printf("all checks passed\n");
+   return 0;
+}
@@ -0,0 +1,270 @@
+/* Copyright  (C) 2010-2020 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (pixconv_test.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Built into this file to reach the SIMD level override */
+#include "../../../gfx/scaler/pixconv.c"
+
+/* Runs every conversion at every SIMD level the CPU has and checks
+ * the output matches the scalar path byte for byte: over every
+ * input value the source format can hold, then over every width up
+ * to a few SIMD blocks with padded strides and unaligned rows so
+ * each tail is covered. Padding must come back untouched. */
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf(__VA_ARGS__); printf("\n"); failures++; } } while (0)
+
+static uint32_t rng_state = 1;
+
+static uint32_t rng(void)
+{
+   rng_state = rng_state * 1103515245u + 12345u;
+   return rng_state >> 8;
+}
+
+typedef void (*conv_fn)(void *output, const void *input,
+      int width, int height, int out_stride, int in_stride);
+
+enum input_kind
+{
+   INPUT_16,
+   INPUT_32,
+   INPUT_24,
+   INPUT_YUYV
+};
+
+struct conv_case
+{
+   const char *name;
+   conv_fn conv;
+   enum input_kind kind;
+   int out_size;
+};
+
+static const struct conv_case cases[] = {
+   { "rgb565_0rgb1555",   conv_rgb565_0rgb1555,   INPUT_16,   2 },
+   { "0rgb1555_rgb565",   conv_0rgb1555_rgb565,   INPUT_16,   2 },
+   { "0rgb1555_argb8888", conv_0rgb1555_argb8888, INPUT_16,   4 },
+   { "rgb565_argb8888",   conv_rgb565_argb8888,   INPUT_16,   4 },
+   { "rgb565_abgr8888",   conv_rgb565_abgr8888,   INPUT_16,   4 },
+   { "rgba4444_argb8888", conv_rgba4444_argb8888, INPUT_16,   4 },
+   { "rgba4444_rgb565",   conv_rgba4444_rgb565,   INPUT_16,   2 },
+   { "0rgb1555_bgr24",    conv_0rgb1555_bgr24,    INPUT_16,   3 },
+   { "rgb565_bgr24",      conv_rgb565_bgr24,      INPUT_16,   3 },
+   { "argb8888_rgba4444", conv_argb8888_rgba4444, INPUT_32,   2 },
+   { "argb8888_0rgb1555", conv_argb8888_0rgb1555, INPUT_32,   2 },
+   { "argb8888_rgb565",   conv_argb8888_rgb565,   INPUT_32,   2 },
+   { "argb8888_bgr24",    conv_argb8888_bgr24,    INPUT_32,   3 },
+   { "abgr8888_bgr24",    conv_abgr8888_bgr24,    INPUT_32,   3 },
+   { "argb8888_abgr8888", conv_argb8888_abgr8888, INPUT_32,   4 },
+   { "bgr24_argb8888",    conv_bgr24_argb8888,    INPUT_24,   4 },
+   { "bgr24_rgb565",      conv_bgr24_rgb565,      INPUT_24,   2 },
+   { "yuyv_argb8888",     conv_yuyv_argb8888,     INPUT_YUYV, 4 }
+};
+
+struct simd_level
+{
+   const char *name;
+   uint64_t mask;
+};
+
+/* Only the levels built into pixconv.c, plus "none" so the list is
+ * never empty */
+static const struct simd_level levels[] = {
+#if defined(__SSE2__)
+   { "sse2", RETRO_SIMD_SSE2 },
+#elif defined(__MMX__)
+   { "mmx",  RETRO_SIMD_MMX },
+#endif
+#ifdef PIXCONV_AVX2
+   { "avx2", RETRO_SIMD_SSE2 | RETRO_SIMD_AVX | RETRO_SIMD_AVX2 },
+#endif
+   { "none", 0 }
+};
+
+static int input_size(enum input_kind kind)
+{
+   switch (kind)
+   {
+      case INPUT_16:
+      case INPUT_YUYV:
+         return 2;
+      case INPUT_24:
+         return 3;
+      default:
+         break;
+   }
+   return 4;
+}
+
+/* Every value of the source format, in slabs of 65536 samples.
+ * A YUYV sample is a pixel pair, and the second Y follows from the
+ * rest so every Y0/U/V triple is covered. */
+static int slab_count(enum input_kind kind)
+{
+   return kind == INPUT_16 ? 1 : 256;
+}
+
+static void fill_slab(uint8_t *in, enum input_kind kind, unsigned slab)
+{
+   unsigned i;
+
+   for (i = 0; i < 65536; i++)
+   {
+      switch (kind)
+      {
+         case INPUT_16:
+            ((uint16_t*)in)[i] = (uint16_t)i;
+            break;
+         case INPUT_32:
+            ((uint32_t*)in)[i] = (slab << 16) | i |
+               ((uint32_t)((i * 167u + slab * 31u) & 0xff) << 24);
+            break;
+         case INPUT_24:
+            in[i * 3 + 0] = (uint8_t)(i >> 0);
+            in[i * 3 + 1] = (uint8_t)(i >> 8);
+            in[i * 3 + 2] = (uint8_t)slab;
+            break;
+         case INPUT_YUYV:
+            in[i * 4 + 0] = (uint8_t)slab;
+            in[i * 4 + 1] = (uint8_t)(i >> 0);
+            in[i * 4 + 2] = (uint8_t)(slab ^ (i * 7) ^ (i >> 8));
+            in[i * 4 + 3] = (uint8_t)(i >> 8);
+            break;
+      }
+   }
+}
+
+/* Writes from @out_offset bytes into @out, after filling all of it */
+static void run_level(uint64_t mask, const struct conv_case *c,
+      uint8_t *out, size_t out_len, int out_offset, const uint8_t *in,
+      int width, int height, int out_stride, int in_stride)
+{
+   pixconv_simd_mask = (unsigned)mask | PIXCONV_SIMD_READY;
+   memset(out, 0xa5, out_len);
+   c->conv(out + out_offset, in, width, height, out_stride, in_stride);
+}
+
+static void test_case(const struct conv_case *c, uint64_t cpu)
+{
+   unsigned l;
+   int slab, width;
+   int in_size        = input_size(c->kind);
+   /* 256 samples a row; a YUYV sample is two pixels */
+   int pixels         = c->kind == INPUT_YUYV ? 512 : 256;
+   size_t in_len      = 65536 * 4 + 64;
+   size_t out_len     = (size_t)pixels * 256 * 4 + 64;
+   uint8_t *in        = (uint8_t*)malloc(in_len);
+   uint8_t *ref       = (uint8_t*)malloc(out_len);
+   uint8_t *out       = (uint8_t*)malloc(out_len);
+
+   for (slab = 0; slab < slab_count(c->kind); slab++)
+   {
+      fill_slab(in, c->kind, slab);
+
+      run_level(0, c, ref, out_len, 0, in, pixels, 256,
+            pixels * c->out_size, pixels * in_size);
+
+      for (l = 0; l < sizeof(levels) / sizeof(levels[0]); l++)
+      {
+         if ((cpu & levels[l].mask) != levels[l].mask)
+            continue;
+         run_level(levels[l].mask, c, out, out_len, 0, in, pixels, 256,
+               pixels * c->out_size, pixels * in_size);
+         CHECK(!memcmp(ref, out, out_len),
+               "%s: %s differs from scalar in slab %d",
+               c->name, levels[l].name, slab);
+      }
+   }
+
+   /* Widths across the SIMD block sizes, with the rows offset from
+    * any alignment and strides padded past the row */
+   for (width = 0; width <= 72; width++)
+   {
+      int i;
+      int height      = 3;
+      int in_stride   = (width + 3) * in_size;
+      int out_stride  = (width + 5) * c->out_size;
+      /* keeps 16 and 32-bit rows on element boundaries */
+      int in_offset   = c->kind == INPUT_24 ? 1 : in_size;
+      int out_offset  = c->out_size == 3 ? 1 : c->out_size;
+
+      if (c->kind == INPUT_YUYV)
+      {
+         if (width & 1)
+            continue;
+         in_stride    = (width + 4) * 2;
+         in_offset    = 4;
+      }
+
+      for (i = 0; i < in_stride * height; i++)
+         in[in_offset + i] = (uint8_t)rng();
+
+      run_level(0, c, ref, out_len, out_offset, in + in_offset,
+            width, height, out_stride, in_stride);
+
+      for (l = 0; l < sizeof(levels) / sizeof(levels[0]); l++)
+      {
+         if ((cpu & levels[l].mask) != levels[l].mask)
+            continue;
+         run_level(levels[l].mask, c, out, out_len, out_offset,
+               in + in_offset, width, height, out_stride, in_stride);
+         CHECK(!memcmp(ref, out, out_len),
+               "%s: %s differs from scalar at width %d",
+               c->name, levels[l].name, width);
+      }
+   }
+
+   free(in);
+   free(ref);
+   free(out);
+}
+
+int main(void)
+{
+   unsigned i;
+   uint64_t cpu = cpu_features_get();
+
+   if (!(cpu & RETRO_SIMD_AVX))
+      cpu &= ~(uint64_t)RETRO_SIMD_AVX2;
+
+   for (i = 0; i < sizeof(levels) / sizeof(levels[0]); i++)
+      printf("%s: %s\n", levels[i].name,
+            (cpu & levels[i].mask) == levels[i].mask ? "checked" : "not available");
+
+   for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+      test_case(&cases[i], cpu);
+
+   if (failures)
+   {
+      printf("%d checks failed\n", failures);
+      return 1;
+   }
+
+   printf("all checks passed\n");
+   return 0;
+}
@@ -0,0 +1,144 @@
+/* Copyright  (C) 2010-2020 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (scaler_bench.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <gfx/scaler/scaler.h>
+#include <features/features_cpu.h>
+
+/* Times scaler_ctx_scale on the frame sizes recording and streaming
+ * use, serially and in bands on one thread per core.
+ *
+ * usage: scaler_bench [threads] */
+
+#define RUNS 5
+
+struct bench_case
+{
+   const char *name;
+   enum scaler_pix_fmt in_fmt;
+   enum scaler_pix_fmt out_fmt;
+   enum scaler_type type;
+   int in_width, in_height, in_bpp;
+   int out_width, out_height, out_bpp;
+};
+
+static const struct bench_case cases[] = {
+   { "1080p -> 4K bilinear",        SCALER_FMT_ARGB8888, SCALER_FMT_ARGB8888,
+      SCALER_TYPE_BILINEAR, 1920, 1080, 4, 3840, 2160, 4 },
+   { "1080p -> 4K point",           SCALER_FMT_ARGB8888, SCALER_FMT_ARGB8888,
+      SCALER_TYPE_POINT,    1920, 1080, 4, 3840, 2160, 4 },
+   { "RGB565 240p -> 4K bilinear",  SCALER_FMT_RGB565,   SCALER_FMT_ARGB8888,
+      SCALER_TYPE_BILINEAR,  320,  240, 2, 3840, 2160, 4 },
+   { "1080p -> 4K BGR24 bilinear",  SCALER_FMT_ARGB8888, SCALER_FMT_BGR24,
+      SCALER_TYPE_BILINEAR, 1920, 1080, 4, 3840, 2160, 3 },
+   { "4K -> 1080p sinc",            SCALER_FMT_ARGB8888, SCALER_FMT_ARGB8888,
+      SCALER_TYPE_SINC,     3840, 2160, 4, 1920, 1080, 4 },
+   { "4K -> 1080p area",            SCALER_FMT_ARGB8888, SCALER_FMT_ARGB8888,
+      SCALER_TYPE_AREA,     3840, 2160, 4, 1920, 1080, 4 },
+   { "4K -> 720p area",             SCALER_FMT_ARGB8888, SCALER_FMT_ARGB8888,
+      SCALER_TYPE_AREA,     3840, 2160, 4, 1280,  720, 4 },
+   { "4K -> 1080p bicubic",         SCALER_FMT_ARGB8888, SCALER_FMT_ARGB8888,
+      SCALER_TYPE_BICUBIC,  3840, 2160, 4, 1920, 1080, 4 },
+   { "1080p -> thumbnail area",     SCALER_FMT_ARGB8888, SCALER_FMT_ARGB8888,
+      SCALER_TYPE_AREA,     1920, 1080, 4,  320,  180, 4 }
+};
+
+static double now(void)
+{
+   return cpu_features_get_time_usec() / 1000.0;
+}
+
+static double run(const struct bench_case *c, unsigned threads,
+      uint8_t *output, const uint8_t *input)
+{
+   int i;
+   double start;
+   struct scaler_ctx ctx;
+
+   memset(&ctx, 0, sizeof(ctx));
+   ctx.in_fmt      = c->in_fmt;
+   ctx.out_fmt     = c->out_fmt;
+   ctx.scaler_type = c->type;
+   ctx.in_width    = c->in_width;
+   ctx.in_height   = c->in_height;
+   ctx.in_stride   = c->in_width  * c->in_bpp;
+   ctx.out_width   = c->out_width;
+   ctx.out_height  = c->out_height;
+   ctx.out_stride  = c->out_width * c->out_bpp;
+   ctx.threads     = threads;
+
+   if (!scaler_ctx_gen_filter(&ctx))
+      return -1.0;
+
+   /* First frame warms up caches and workers */
+   scaler_ctx_scale(&ctx, output, input);
+
+   start = now();
+   for (i = 0; i < RUNS; i++)
+      scaler_ctx_scale(&ctx, output, input);
+   start = (now() - start) / RUNS;
+
+   scaler_ctx_gen_reset(&ctx);
+   return start;
+}
+
+int main(int argc, char *argv[])
+{
+   unsigned i;
+   unsigned threads = cpu_features_get_core_amount();
+   uint8_t *input   = (uint8_t*)malloc(3840 * 2160 * 4);
+   uint8_t *output  = (uint8_t*)malloc(3840 * 2160 * 4);
+
+   if (argc > 1)
+      threads = strtoul(argv[1], NULL, 0);
+   if (threads < 2)
+      threads = 2;
+
+   for (i = 0; i < 3840 * 2160 * 4; i++)
+      input[i] = (i * 2654435761u) >> 24;
+
+   printf("%-28s %10s %10s\n", "", "serial ms", "banded ms");
+
+   for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+   {
+      double serial = run(&cases[i], 1, output, input);
+      double banded = run(&cases[i], threads, output, input);
+
+      if (serial < 0.0 || banded < 0.0)
+      {
+         printf("%s: scaler_ctx_gen_filter failed\n", cases[i].name);
+         return 1;
+      }
+
+      printf("%-28s %10.2f %10.2f  (%u threads, %.2fx)\n", cases[i].name,
+            serial, banded, threads, serial / banded);
+   }
+
+   free(input);
+   free(output);
+   return 0;
+}
@@ -0,0 +1,540 @@
+/* Copyright  (C) 2010-2020 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (scaler_test.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <gfx/scaler/scaler.h>
+#include <gfx/scaler/pixconv.h>
+#include <gfx/scaler/scaler_int.h>
+
+/* Scales random frames between every format pair the scaler takes,
+ * with every filter, serially and in bands on threads, and checks
+ * the banded output matches the serial output byte for byte. The
+ * threaded contexts are reused across sizes without a reset, so the
+ * worker pool is kept across scaler_ctx_gen_filter calls. */
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf(__VA_ARGS__); printf("\n"); failures++; } } while (0)
+
+static uint32_t rng_state = 1;
+
+static uint32_t rng(void)
+{
+   rng_state = rng_state * 1103515245u + 12345u;
+   return rng_state >> 8;
+}
+
+static const enum scaler_pix_fmt in_fmts[] = {
+   SCALER_FMT_ARGB8888,
+   SCALER_FMT_0RGB1555,
+   SCALER_FMT_RGB565,
+   SCALER_FMT_BGR24,
+   SCALER_FMT_RGBA4444
+};
+
+static const enum scaler_pix_fmt out_fmts[] = {
+   SCALER_FMT_ARGB8888,
+   SCALER_FMT_ABGR8888,
+   SCALER_FMT_0RGB1555,
+   SCALER_FMT_RGB565,
+   SCALER_FMT_BGR24,
+   SCALER_FMT_RGBA4444
+};
+
+static const enum scaler_type types[] = {
+   SCALER_TYPE_POINT,
+   SCALER_TYPE_BILINEAR,
+   SCALER_TYPE_SINC,
+   SCALER_TYPE_AREA,
+   SCALER_TYPE_BICUBIC
+};
+
+static const int sizes[][4] = {
+   /* in w, in h, out w, out h */
+   {  64,  48, 128,  96 },
+   { 320, 240,  97,  61 },
+   { 256, 224, 640, 480 },
+   { 128,  96,  32,  48 },
+   {  33, 200,  33,  40 },
+   { 100, 100,  50,  17 },
+   { 160, 144, 480, 432 }
+};
+
+static const unsigned thread_counts[] = { 2, 3, 7 };
+
+#define NUM(a) (sizeof(a) / sizeof((a)[0]))
+
+static int pixel_size(enum scaler_pix_fmt fmt)
+{
+   switch (fmt)
+   {
+      case SCALER_FMT_0RGB1555:
+      case SCALER_FMT_RGB565:
+      case SCALER_FMT_RGBA4444:
+         return 2;
+      case SCALER_FMT_BGR24:
+         return 3;
+      default:
+         break;
+   }
+   return 4;
+}
+
+static void setup(struct scaler_ctx *ctx,
+      enum scaler_pix_fmt in_fmt, enum scaler_pix_fmt out_fmt,
+      enum scaler_type type, const int *size)
+{
+   ctx->in_fmt      = in_fmt;
+   ctx->out_fmt     = out_fmt;
+   ctx->scaler_type = type;
+   ctx->in_width    = size[0];
+   ctx->in_height   = size[1];
+   ctx->out_width   = size[2];
+   ctx->out_height  = size[3];
+   /* Odd padding, so rows are not back to back */
+   ctx->in_stride   = size[0] * pixel_size(in_fmt)  + 12;
+   ctx->out_stride  = size[2] * pixel_size(out_fmt) + 20;
+}
+
+static bool same_rows(const uint8_t *a, const uint8_t *b,
+      int width, int height, int stride)
+{
+   int y;
+   for (y = 0; y < height; y++)
+      if (memcmp(a + y * stride, b + y * stride, width))
+         return false;
+   return true;
+}
+
+static void test_bands(void)
+{
+   unsigned i, j, k, s, t;
+   struct scaler_ctx threaded[NUM(thread_counts)];
+   struct scaler_ctx serial;
+   unsigned cases = 0;
+
+   memset(threaded, 0, sizeof(threaded));
+   for (t = 0; t < NUM(thread_counts); t++)
+      threaded[t].threads = thread_counts[t];
+
+   for (s = 0; s < NUM(sizes); s++)
+   {
+      for (i = 0; i < NUM(in_fmts); i++)
+      {
+         uint8_t *input;
+         size_t in_len;
+
+         setup(&serial, in_fmts[i], out_fmts[0], types[0], sizes[s]);
+         in_len = (size_t)serial.in_stride * serial.in_height;
+         input  = (uint8_t*)malloc(in_len);
+         for (k = 0; k < in_len; k++)
+            input[k] = rng();
+
+         for (j = 0; j < NUM(out_fmts); j++)
+         {
+            for (k = 0; k < NUM(types); k++)
+            {
+               size_t out_len;
+               uint8_t *expected, *output;
+
+               memset(&serial, 0, sizeof(serial));
+               setup(&serial, in_fmts[i], out_fmts[j], types[k], sizes[s]);
+               out_len  = (size_t)serial.out_stride * serial.out_height;
+               expected = (uint8_t*)calloc(1, out_len);
+               output   = (uint8_t*)malloc(out_len);
+
+               CHECK(scaler_ctx_gen_filter(&serial),
+                     "gen_filter failed: fmt %d -> %d type %d size %u",
+                     in_fmts[i], out_fmts[j], types[k], s);
+               scaler_ctx_scale(&serial, expected, input);
+
+               for (t = 0; t < NUM(thread_counts); t++)
+               {
+                  struct scaler_ctx *ctx = &threaded[t];
+
+                  setup(ctx, in_fmts[i], out_fmts[j], types[k], sizes[s]);
+                  CHECK(scaler_ctx_gen_filter(ctx),
+                        "threaded gen_filter failed");
+
+                  memset(output, 0xa5, out_len);
+                  scaler_ctx_scale(ctx, output, input);
+                  CHECK(same_rows(expected, output,
+                           ctx->out_width * pixel_size(out_fmts[j]),
+                           ctx->out_height, ctx->out_stride),
+                        "fmt %d -> %d type %d %dx%d -> %dx%d, %u threads: "
+                        "bands differ from serial", in_fmts[i], out_fmts[j],
+                        types[k], sizes[s][0], sizes[s][1],
+                        sizes[s][2], sizes[s][3], thread_counts[t]);
+
+                  /* A second frame through the same bands */
+                  memset(output, 0x5a, out_len);
+                  scaler_ctx_scale(ctx, output, input);
+                  CHECK(same_rows(expected, output,
+                           ctx->out_width * pixel_size(out_fmts[j]),
+                           ctx->out_height, ctx->out_stride),
+                        "second frame differs");
+                  cases++;
+               }
+
+               scaler_ctx_gen_reset(&serial);
+               free(expected);
+               free(output);
+            }
+         }
+
+         free(input);
+      }
+   }
+
+   for (t = 0; t < NUM(thread_counts); t++)
+   {
+      scaler_ctx_gen_reset(&threaded[t]);
+      CHECK(!threaded[t].pool, "pool left after reset");
+   }
+
+   printf("%u banded cases\n", cases);
+}
+
+/* Scaling to ABGR8888 must give the ARGB8888 result with red and
+ * blue swapped, which catches output converted from the wrong
+ * intermediate buffer. */
+static void test_swizzle(void)
+{
+   unsigned k, t;
+   static const int size[4] = { 80, 60, 200, 150 };
+
+   for (t = 0; t < 2; t++)
+   {
+      for (k = 0; k < NUM(types); k++)
+      {
+         int x;
+         struct scaler_ctx argb, abgr;
+         uint32_t *input    = (uint32_t*)malloc(80 * 60 * 4);
+         uint32_t *expected = (uint32_t*)calloc(200 * 150, 4);
+         uint32_t *output   = (uint32_t*)calloc(200 * 150, 4);
+         bool swapped       = true;
+
+         for (x = 0; x < 80 * 60; x++)
+            input[x] = rng() ^ (rng() << 16);
+
+         memset(&argb, 0, sizeof(argb));
+         memset(&abgr, 0, sizeof(abgr));
+         abgr.threads = t ? 4 : 0;
+         setup(&argb, SCALER_FMT_ARGB8888, SCALER_FMT_ARGB8888,
+               types[k], size);
+         setup(&abgr, SCALER_FMT_ARGB8888, SCALER_FMT_ABGR8888,
+               types[k], size);
+         argb.in_stride  = abgr.in_stride  = 80 * 4;
+         argb.out_stride = abgr.out_stride = 200 * 4;
+         CHECK(scaler_ctx_gen_filter(&argb), "gen_filter failed");
+         CHECK(scaler_ctx_gen_filter(&abgr), "gen_filter failed");
+         scaler_ctx_scale(&argb, expected, input);
+         scaler_ctx_scale(&abgr, output, input);
+
+         for (x = 0; x < 200 * 150; x++)
+         {
+            uint32_t c = expected[x];
+            if (output[x] != ((c & 0xff00ff00)
+                     | ((c >> 16) & 0xff) | ((c & 0xff) << 16)))
+               swapped = false;
+         }
+         CHECK(swapped, "type %d, %u threads: ABGR8888 output is not "
+               "swizzled ARGB8888 (first pixel %08x, expected %08x)",
+               types[k], abgr.threads,
+               (unsigned)output[0], (unsigned)expected[0]);
+
+         scaler_ctx_gen_reset(&argb);
+         scaler_ctx_gen_reset(&abgr);
+         free(input);
+         free(expected);
+         free(output);
+      }
+   }
+}
+
+typedef void (*conv_fn)(void *output, const void *input,
+      int width, int height, int out_stride, int in_stride);
+
+static conv_fn conv_to_argb8888(enum scaler_pix_fmt fmt)
+{
+   switch (fmt)
+   {
+      case SCALER_FMT_0RGB1555:
+         return conv_0rgb1555_argb8888;
+      case SCALER_FMT_RGB565:
+         return conv_rgb565_argb8888;
+      case SCALER_FMT_BGR24:
+         return conv_bgr24_argb8888;
+      case SCALER_FMT_RGBA4444:
+         return conv_rgba4444_argb8888;
+      default:
+         break;
+   }
+   return conv_copy;
+}
+
+static conv_fn conv_from_argb8888(enum scaler_pix_fmt fmt)
+{
+   switch (fmt)
+   {
+      case SCALER_FMT_ABGR8888:
+         return conv_argb8888_abgr8888;
+      case SCALER_FMT_0RGB1555:
+         return conv_argb8888_0rgb1555;
+      case SCALER_FMT_RGB565:
+         return conv_argb8888_rgb565;
+      case SCALER_FMT_BGR24:
+         return conv_argb8888_bgr24;
+      case SCALER_FMT_RGBA4444:
+         return conv_argb8888_rgba4444;
+      default:
+         break;
+   }
+   return conv_copy;
+}
+
+/* Scaling between two formats must give the same bytes as
+ * converting the input to ARGB8888 with pixconv, scaling ARGB8888
+ * and converting the result, which is what the scaler did before it
+ * read and wrote other formats directly. */
+static void test_formats(void)
+{
+   unsigned i, j, k, s, t;
+
+   for (s = 0; s < 4; s++)
+   {
+      for (i = 0; i < NUM(in_fmts); i++)
+      {
+         for (j = 0; j < NUM(out_fmts); j++)
+         {
+            for (k = 0; k < NUM(types); k++)
+            {
+               for (t = 0; t < 2; t++)
+               {
+                  size_t x, in_len, out_len;
+                  uint8_t *input, *expected, *output;
+                  uint32_t *argb_in, *argb_out;
+                  struct scaler_ctx ref, ctx;
+
+                  memset(&ref, 0, sizeof(ref));
+                  memset(&ctx, 0, sizeof(ctx));
+                  setup(&ctx, in_fmts[i], out_fmts[j], types[k], sizes[s]);
+                  setup(&ref, SCALER_FMT_ARGB8888, SCALER_FMT_ARGB8888,
+                        types[k], sizes[s]);
+                  ctx.threads    = t ? 3 : 0;
+                  ref.in_stride  = ctx.in_width  * 4;
+                  ref.out_stride = ctx.out_width * 4;
+
+                  in_len   = (size_t)ctx.in_stride  * ctx.in_height;
+                  out_len  = (size_t)ctx.out_stride * ctx.out_height;
+                  input    = (uint8_t*)malloc(in_len);
+                  expected = (uint8_t*)calloc(1, out_len);
+                  output   = (uint8_t*)calloc(1, out_len);
+                  argb_in  = (uint32_t*)malloc((size_t)ref.in_stride  * ref.in_height);
+                  argb_out = (uint32_t*)malloc((size_t)ref.out_stride * ref.out_height);
+
+                  for (x = 0; x < in_len; x++)
+                     input[x] = rng();
+
+                  CHECK(scaler_ctx_gen_filter(&ref), "gen_filter failed");
+                  CHECK(scaler_ctx_gen_filter(&ctx), "gen_filter failed");
+
+                  conv_to_argb8888(in_fmts[i])(argb_in, input,
+                        ctx.in_width, ctx.in_height,
+                        ref.in_stride, ctx.in_stride);
+                  scaler_ctx_scale(&ref, argb_out, argb_in);
+                  conv_from_argb8888(out_fmts[j])(expected, argb_out,
+                        ctx.out_width, ctx.out_height,
+                        ctx.out_stride, ref.out_stride);
+
+                  scaler_ctx_scale(&ctx, output, input);
+                  CHECK(same_rows(expected, output,
+                           ctx.out_width * pixel_size(out_fmts[j]),
+                           ctx.out_height, ctx.out_stride),
+                        "fmt %d -> %d type %d %dx%d -> %dx%d, %u threads: "
+                        "differs from converting around ARGB8888",
+                        in_fmts[i], out_fmts[j], types[k],
+                        sizes[s][0], sizes[s][1], sizes[s][2], sizes[s][3],
+                        ctx.threads);
+
+                  scaler_ctx_gen_reset(&ref);
+                  scaler_ctx_gen_reset(&ctx);
+                  free(input);
+                  free(expected);
+                  free(output);
+                  free(argb_in);
+                  free(argb_out);
+               }
+            }
+         }
+      }
+   }
+}
+
+/* The 2x and 4x area paths must give exactly rounded block averages,
+ * and the area and bicubic filters have to leave a flat colour alone */
+static void test_area(void)
+{
+   unsigned k, s, t;
+   static const int blocks[][4] = {
+      { 160, 120,  80,  60 },
+      { 160, 120,  40,  30 },
+      { 160, 120,  40,  60 },
+      { 160, 120,  80,  30 }
+   };
+   /* The others drop edge taps that fall outside the image */
+   static const enum scaler_type flat_types[] = {
+      SCALER_TYPE_AREA,
+      SCALER_TYPE_BICUBIC
+   };
+   static const int flat[][4] = {
+      { 160, 120,  80,  60 },
+      { 160, 120,  53,  37 },
+      { 640, 480,  61,  45 },
+      {  61,  45, 160, 120 },
+      {   3,   2,  17,  13 }
+   };
+
+   for (s = 0; s < NUM(blocks); s++)
+   {
+      for (t = 0; t < 2; t++)
+      {
+         int x, y, i, j;
+         struct scaler_ctx ctx;
+         const int *size    = blocks[s];
+         int fx             = size[0] / size[2];
+         int fy             = size[1] / size[3];
+         uint32_t *input    = (uint32_t*)malloc(size[0] * size[1] * 4);
+         uint32_t *output   = (uint32_t*)calloc(size[2] * size[3], 4);
+         bool exact         = true;
+
+         for (x = 0; x < size[0] * size[1]; x++)
+            input[x] = rng() ^ (rng() << 16);
+
+         memset(&ctx, 0, sizeof(ctx));
+         setup(&ctx, SCALER_FMT_ARGB8888, SCALER_FMT_ARGB8888,
+               SCALER_TYPE_AREA, size);
+         ctx.threads    = t ? 3 : 0;
+         ctx.in_stride  = size[0] * 4;
+         ctx.out_stride = size[2] * 4;
+         CHECK(scaler_ctx_gen_filter(&ctx), "gen_filter failed");
+         CHECK(ctx.scaler_special == scaler_argb8888_area_special,
+               "area %dx%d -> %dx%d: no block path",
+               size[0], size[1], size[2], size[3]);
+         scaler_ctx_scale(&ctx, output, input);
+
+         for (y = 0; y < size[3]; y++)
+         {
+            for (x = 0; x < size[2]; x++)
+            {
+               int c;
+               uint32_t expected = 0;
+
+               for (c = 0; c < 32; c += 8)
+               {
+                  unsigned sum = 0;
+                  for (j = 0; j < fy; j++)
+                     for (i = 0; i < fx; i++)
+                        sum += (input[(y * fy + j) * size[0] + x * fx + i] >> c) & 0xff;
+                  expected |= ((sum + fx * fy / 2) / (fx * fy)) << c;
+               }
+
+               if (output[y * size[2] + x] != expected)
+                  exact = false;
+            }
+         }
+
+         CHECK(exact, "area %dx%d -> %dx%d, %u threads: not the block average",
+               size[0], size[1], size[2], size[3], ctx.threads);
+
+         scaler_ctx_gen_reset(&ctx);
+         free(input);
+         free(output);
+      }
+   }
+
+   for (s = 0; s < NUM(flat); s++)
+   {
+      for (k = 0; k < NUM(flat_types); k++)
+      {
+         int x;
+         struct scaler_ctx ctx;
+         const int *size    = flat[s];
+         const uint32_t col = 0xc0804020;
+         uint32_t *input    = (uint32_t*)malloc(size[0] * size[1] * 4);
+         uint32_t *output   = (uint32_t*)calloc(size[2] * size[3], 4);
+         bool kept          = true;
+
+         for (x = 0; x < size[0] * size[1]; x++)
+            input[x] = col;
+
+         memset(&ctx, 0, sizeof(ctx));
+         setup(&ctx, SCALER_FMT_ARGB8888, SCALER_FMT_ARGB8888,
+               flat_types[k], size);
+         ctx.in_stride  = size[0] * 4;
+         ctx.out_stride = size[2] * 4;
+         CHECK(scaler_ctx_gen_filter(&ctx), "gen_filter failed");
+         scaler_ctx_scale(&ctx, output, input);
+
+         /* Rounding may still be a step out */
+         for (x = 0; x < size[2] * size[3]; x++)
+         {
+            int c;
+            for (c = 0; c < 32; c += 8)
+            {
+               int diff = (int)((output[x] >> c) & 0xff) - (int)((col >> c) & 0xff);
+               if (diff < -1 || diff > 1)
+                  kept = false;
+            }
+         }
+
+         CHECK(kept, "type %d %dx%d -> %dx%d: flat colour not kept",
+               flat_types[k], size[0], size[1], size[2], size[3]);
+
+         scaler_ctx_gen_reset(&ctx);
+         free(input);
+         free(output);
+      }
+   }
+}
+
+int main(void)
+{
+   test_swizzle();
+   test_formats();
+   test_area();
+   test_bands();
+
+   if (failures)
+   {
+      printf("%d checks failed\n", failures);
+      return 1;
+   }
+
+   printf("all checks passed\n");
+   return 0;
+}
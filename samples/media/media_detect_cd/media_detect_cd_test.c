@@ -0,0 +1,187 @@
+/* Copyright  (C) 2010-2020 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (media_detect_cd_test.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <media/media_detect_cd.h>
+
+/* Writes small disc images in the layouts the detector knows about
+ * and checks the reported system and header fields, with and without
+ * the result cache. */
+
+#define RAW_SECTOR    2352
+#define COOKED_SECTOR 2048
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf(__VA_ARGS__); printf("\n"); failures++; } } while (0)
+
+static void put_text(uint8_t *p, const char *s, size_t field_len)
+{
+   memset(p, ' ', field_len);
+   memcpy(p, s, strlen(s));
+}
+
+static int write_file(const char *path, const void *data, size_t len)
+{
+   FILE *fp = fopen(path, "wb");
+   if (!fp)
+      return 0;
+   fwrite(data, 1, len, fp);
+   fclose(fp);
+   return 1;
+}
+
+/* 17 raw Mode 1 sectors holding a Saturn system area */
+static int write_saturn(const char *path)
+{
+   size_t len   = 17 * RAW_SECTOR;
+   uint8_t *img = (uint8_t*)calloc(1, len);
+   uint8_t *data;
+   int ret;
+
+   memcpy(img, "\x00\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\x00", 12);
+   img[15] = 1;
+   data    = img + 16;
+   put_text(data, "SEGA SEGASATURN", 16);
+   put_text(data + 0x20, "MK-81020", 10);
+   put_text(data + 0x2a, "V1.003", 6);
+   put_text(data + 0x30, "19960705", 8);
+   put_text(data + 0x60, "   NIGHTS into Dreams...", 112);
+
+   ret = write_file(path, img, len);
+   free(img);
+   return ret;
+}
+
+/* cooked ISO with a PlayStation volume descriptor in sector 16 */
+static int write_psx(const char *path)
+{
+   size_t len   = 20 * COOKED_SECTOR;
+   uint8_t *img = (uint8_t*)calloc(1, len);
+   uint8_t *pvd = img + 16 * COOKED_SECTOR;
+   int ret;
+
+   memcpy(pvd, "\1CD001\1\0PLAYSTATION", 19);
+   put_text(pvd + 40, "SLUS_005.94", 32);
+
+   ret = write_file(path, img, len);
+   free(img);
+   return ret;
+}
+
+/* cooked track behind a two sector pregap, PC Engine header in its second sector */
+static int write_pce(const char *path, const char *cue_path)
+{
+   size_t len   = 8 * COOKED_SECTOR;
+   uint8_t *img = (uint8_t*)calloc(1, len);
+   const char *cue =
+      "FILE \"pce.bin\" BINARY\n"
+      "  TRACK 01 MODE1/2048\n"
+      "    INDEX 01 00:00:02\n";
+   int ret;
+
+   memcpy(img + 2 * COOKED_SECTOR + 0x950, "PC Engine CD-ROM SYSTEM", 23);
+
+   ret = write_file(path, img, len) && write_file(cue_path, cue, strlen(cue));
+   free(img);
+   return ret;
+}
+
+static void run_checks(const char *pass)
+{
+   media_detect_cd_info_t info;
+
+   memset(&info, 0x55, sizeof(info));
+   CHECK(media_detect_cd_info("saturn.bin", 0, &info), "%s: saturn detection failed", pass);
+   CHECK(info.system_id == MEDIA_CD_SYSTEM_SATURN, "%s: saturn system %d", pass, info.system_id);
+   CHECK(!strcmp(info.system, "Sega Saturn"), "%s: saturn system name '%s'", pass, info.system);
+   CHECK(!strcmp(info.title, "NIGHTS into Dreams..."), "%s: saturn title '%s'", pass, info.title);
+   CHECK(!strcmp(info.serial, "MK-81020"), "%s: saturn serial '%s'", pass, info.serial);
+   CHECK(!strcmp(info.version, "V1.003"), "%s: saturn version '%s'", pass, info.version);
+   CHECK(!strcmp(info.release_date, "19960705"), "%s: saturn date '%s'", pass, info.release_date);
+   CHECK(!info.maker[0] && !info.region[0], "%s: saturn left stale fields", pass);
+
+   CHECK(media_detect_cd_info("psx.iso", 0, &info), "%s: psx detection failed", pass);
+   CHECK(info.system_id == MEDIA_CD_SYSTEM_PSX, "%s: psx system %d", pass, info.system_id);
+   CHECK(!strcmp(info.title, "SLUS_005.94"), "%s: psx title '%s'", pass, info.title);
+   CHECK(!info.serial[0], "%s: psx serial '%s'", pass, info.serial);
+
+   CHECK(media_detect_cd_info_cue("pce.cue", &info), "%s: pce detection failed", pass);
+   CHECK(info.system_id == MEDIA_CD_SYSTEM_PC_ENGINE_CD, "%s: pce system %d", pass, info.system_id);
+
+   CHECK(media_detect_cd_info("pce.bin", 0, &info), "%s: unknown detection failed", pass);
+   CHECK(!info.system[0], "%s: pregap data detected as '%s'", pass, info.system);
+
+   CHECK(!media_detect_cd_info("short.bin", 0, &info), "%s: short file detected", pass);
+   CHECK(!media_detect_cd_info("missing.bin", 0, &info), "%s: missing file detected", pass);
+}
+
+int main(void)
+{
+   media_detect_cd_info_t info;
+   uint8_t *zeros;
+
+   if (!write_saturn("saturn.bin") || !write_psx("psx.iso")
+         || !write_pce("pce.bin", "pce.cue") || !write_file("short.bin", "CD001", 5))
+   {
+      printf("could not write test images\n");
+      return 1;
+   }
+
+   run_checks("uncached");
+
+   CHECK(media_detect_cd_cache_init(), "cache init failed");
+   run_checks("filling cache");
+   run_checks("cached");
+
+   /* results are keyed by path and size: the same size is served from
+    * the cache, a different size is read again */
+   zeros = (uint8_t*)calloc(1, 17 * RAW_SECTOR);
+   write_file("saturn.bin", zeros, 17 * RAW_SECTOR);
+   free(zeros);
+   media_detect_cd_info("saturn.bin", 0, &info);
+   CHECK(info.system_id == MEDIA_CD_SYSTEM_SATURN, "cached saturn result was not used");
+   write_saturn("psx.iso");
+   media_detect_cd_info("psx.iso", 0, &info);
+   CHECK(info.system_id == MEDIA_CD_SYSTEM_SATURN, "resized image was not read again");
+
+   media_detect_cd_cache_deinit();
+
+   remove("saturn.bin");
+   remove("psx.iso");
+   remove("pce.bin");
+   remove("pce.cue");
+   remove("short.bin");
+
+   if (failures)
+   {
+      printf("%d check(s) failed\n", failures);
+      return 1;
+   }
+
+   printf("all checks passed\n");
+   return 0;
+}
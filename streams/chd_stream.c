@@ -27,9 +27,16 @@
 #include <boolean.h>
 
 #include <streams/chd_stream.h>
-#include <retro_endianness.h>
 #include <libchdr/chd.h>
 
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__) && !defined(DONT_WANT_ARM_OPTIMIZATIONS)
+#include <arm_neon.h>
+#endif
+
 #define SECTOR_SIZE 2352
 #define SUBCODE_SIZE 96
 #define TRACK_PAD 4
@@ -284,13 +291,62 @@ void chdstream_close(chdstream_t *stream)
    }
 }
 
+/* Copies len bytes from byte pos of a hunk of big-endian 16-bit
+ * audio samples, swapping them to little-endian on the way out so
+ * each byte is only touched once. pos may be odd. */
+static void
+chdstream_copy_swab(uint8_t *out, const uint8_t *hunk, size_t pos, size_t len)
+{
+   const uint8_t *in;
+   size_t i = 0;
+#if defined(__SSSE3__)
+   const __m128i mask = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6,
+         9, 8, 11, 10, 13, 12, 15, 14);
+#endif
+
+   if (len == 0)
+      return;
+
+   /* starting on the low byte of a sample */
+   if (pos & 1)
+   {
+      *out++ = hunk[pos - 1];
+      pos++;
+      len--;
+   }
+   in = hunk + pos;
+
+#if defined(__SSSE3__)
+   for (; i + 16 <= len; i += 16)
+      _mm_storeu_si128((__m128i*)(out + i), _mm_shuffle_epi8(
+               _mm_loadu_si128((const __m128i*)(in + i)), mask));
+#elif defined(__SSE2__)
+   for (; i + 16 <= len; i += 16)
+   {
+      __m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+      _mm_storeu_si128((__m128i*)(out + i),
+            _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+   }
+#elif defined(__ARM_NEON__) && !defined(DONT_WANT_ARM_OPTIMIZATIONS)
+   for (; i + 16 <= len; i += 16)
+      vst1q_u8(out + i, vrev16q_u8(vld1q_u8(in + i)));
+#endif
+
+   for (; i + 2 <= len; i += 2)
+   {
+      out[i]     = in[i + 1];
+      out[i + 1] = in[i];
+   }
+
+   /* ending on the high byte of a sample */
+   if (i < len)
+      out[i] = in[i + 1];
+}
+
 static bool
 chdstream_load_hunk(chdstream_t *stream, uint32_t hunknum)
 {
    chd_error err;
-   uint16_t *array;
-   uint32_t i;
-   uint32_t count;
 
    if (hunknum == stream->hunknum)
       return true;
@@ -299,14 +355,6 @@ chdstream_load_hunk(chdstream_t *stream, uint32_t hunknum)
    if (err != CHDERR_NONE)
       return false;
 
-   if (stream->swab)
-   {
-      count = chd_get_header(stream->chd)->hunkbytes / 2;
-      array = (uint16_t*) stream->hunkmem;
-      for (i = 0; i < count; ++i)
-         array[i] = SWAP16(array[i]);
-   }
-
    stream->hunknum = hunknum;
    return true;
 }
@@ -348,9 +396,13 @@ ssize_t chdstream_read(chdstream_t *stream, void *data, size_t bytes)
          {
             return -1;
          }
-         memcpy(out + data_offset,
-                stream->hunkmem + frame_offset
-                + hunk_offset + stream->frame_offset, amount);
+         if (stream->swab)
+            chdstream_copy_swab(out + data_offset, stream->hunkmem,
+                  frame_offset + hunk_offset + stream->frame_offset, amount);
+         else
+            memcpy(out + data_offset,
+                  stream->hunkmem + frame_offset
+                  + hunk_offset + stream->frame_offset, amount);
       }
 
       data_offset    += amount;
@@ -618,3 +618,24 @@ libretro_vfs_implementation_file* filestream_get_vfs_handle(RFILE *stream)
 {
    return (libretro_vfs_implementation_file*)stream->hfile;
 }
+
+int filestream_get_fd(RFILE *stream)
+{
+#if defined(__WINRT__) || defined(ORBIS)
+   return -1;
+#else
+   libretro_vfs_implementation_file *hfile = NULL;
+
+   /* handles from a frontend VFS are opaque to us */
+   if (!stream || filestream_open_cb != NULL)
+      return -1;
+
+   hfile = (libretro_vfs_implementation_file*)stream->hfile;
+   if (!hfile || hfile->scheme != VFS_SCHEME_NONE)
+      return -1;
+
+   if (hfile->fp)
+      return fileno(hfile->fp);
+   return hfile->fd;
+#endif
+}
@@ -30,6 +30,10 @@
 #include <windows.h>
 #endif
 
+/* sectors kept in flight ahead of reads from a track, as this many READ CD commands of this many sectors each */
+#define CDROM_READAHEAD_CHUNKS        4
+#define CDROM_READAHEAD_CHUNK_SECTORS 16
+
 static cdrom_toc_t vfs_cdrom_toc = {0};
 
 const cdrom_toc_t* retro_vfs_file_get_cdrom_toc(void)
@@ -284,6 +288,14 @@ void retro_vfs_file_open_cdrom(
       stream->cdrom.cur_frame = vfs_cdrom_toc.track[0].frame;
       stream->cdrom.cur_lba = cdrom_msf_to_lba(stream->cdrom.cur_min, stream->cdrom.cur_sec, stream->cdrom.cur_frame);
    }
+
+   if (string_is_equal_noncase(path_get_extension(path), "bin") && stream->cdrom.cur_track)
+   {
+      const cdrom_track_t *track = &vfs_cdrom_toc.track[stream->cdrom.cur_track - 1];
+
+      stream->cdrom.readahead = cdrom_readahead_new(stream, track->lba, track->lba + track->track_bytes / 2352,
+            CDROM_READAHEAD_CHUNKS, CDROM_READAHEAD_CHUNK_SECTORS);
+   }
 }
 
 int retro_vfs_file_close_cdrom(libretro_vfs_implementation_file *stream)
@@ -293,6 +305,10 @@ int retro_vfs_file_close_cdrom(libretro_vfs_implementation_file *stream)
    fflush(stdout);
 #endif
 
+   /* stop the worker before its drive handle goes away */
+   cdrom_readahead_free(stream->cdrom.readahead);
+   stream->cdrom.readahead = NULL;
+
 #if defined(_WIN32) && !defined(_XBOX)
    if (!stream->fh || !CloseHandle(stream->fh))
       return -1;
@@ -384,7 +400,13 @@ int64_t retro_vfs_file_read_cdrom(libretro_vfs_implementation_file *stream,
       fflush(stdout);
 #endif
 
-      rv = cdrom_read(stream, &vfs_cdrom_toc.timeouts, min, sec, frame, s, (size_t)len, skip);
+      rv = 1;
+
+      if (stream->cdrom.readahead)
+         rv = cdrom_readahead_read(stream->cdrom.readahead, stream->cdrom.cur_lba, s, (size_t)len, skip);
+
+      if (rv)
+         rv = cdrom_read(stream, &vfs_cdrom_toc.timeouts, min, sec, frame, s, (size_t)len, skip);
       /*rv = cdrom_read_lba(stream, stream->cdrom.cur_lba, s, (size_t)len, skip);*/
 
       if (rv)